@@ -0,0 +1,1191 @@
+/*
+Copyright (C) 2011 Jay Satiro <raysatiro@yahoo.com>
+All rights reserved.
+
+This file is part of GetHooks.
+
+GetHooks is free software: you can redistribute it and/or modify 
+it under the terms of the GNU General Public License as published by 
+the Free Software Foundation, either version 3 of the License, or 
+(at your option) any later version.
+
+GetHooks is distributed in the hope that it will be useful, 
+but WITHOUT ANY WARRANTY; without even the implied warranty of 
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License 
+along with GetHooks.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/** 
+This file contains functions for an aggregate store (fleet-wide aggregation of snapshot files).
+Each function is documented in the comment block above its definition.
+
+Aggregate mode reads the last record of each of many snapshot files, typically one file collected 
+from each endpoint in a fleet, and counts how many endpoints have each hook. The hooks are counted by 
+identity (HOOK id, flags, module index and the image name of the origin thread) since the addresses 
+and handles of a hook are different on every endpoint. The files are read in parallel by a task for 
+each file run by the scheduler, each file mapped read only by the snapshot file view store.
+
+-
+create_aggregate_store()
+
+Create an aggregate store and its descendants or die.
+-
+
+-
+create_aggregate_table()
+
+Create an aggregate table or die.
+-
+
+-
+add_aggregate_image()
+
+Add an image name to an aggregate table if it isn't already in the table.
+-
+
+-
+add_aggregate_hook()
+
+Add a hook identity to an aggregate table if it isn't already in the table.
+-
+
+-
+add_aggregate_record()
+
+Count the hooks in a snapshot file record.
+-
+
+-
+merge_aggregate_table()
+
+Merge a worker thread's aggregate table into another aggregate table.
+-
+
+-
+read_aggregate_file()
+
+The task that reads a snapshot file.
+-
+
+-
+add_aggregate_files()
+
+Make the aggregate store's array of snapshot file names.
+-
+
+-
+init_aggregate_store()
+
+Initialize an aggregate store by reading and counting the hooks in each snapshot file.
+-
+
+-
+compare_aggregate_hook()
+
+Compare two pointers to hook identities by prevalence.
+-
+
+-
+compare_aggregate_image()
+
+Compare two pointers to images by prevalence.
+-
+
+-
+print_aggregate_hook()
+
+Print a hook identity as a row of the hook tables.
+-
+
+-
+print_aggregate_report()
+
+Print the fleet-wide hook counts, the rare hooks and the image prevalence table.
+-
+
+-
+print_aggregate_store()
+
+Print an aggregate store.
+-
+
+-
+free_aggregate_table()
+
+Free an aggregate table.
+-
+
+-
+free_aggregate_store()
+
+Free an aggregate store and all its descendants.
+-
+
+-
+aggregatemode()
+
+Aggregate snapshot files.
+-
+
+*/
+
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <stdio.h>
+#include <wctype.h>
+
+#include "util.h"
+
+#include "desktop_hook.h"
+
+#include "snapfile.h"
+
+#include "aggregate.h"
+
+#include "scheduler.h"
+
+/* the global stores */
+#include "global.h"
+
+
+
+/* the initial number of slots in the hash tables. must be a power of 2. */
+#define AGGREGATE_SLOTS_DEFAULT   256
+
+/* a hook identity is rare if it is found on no more than one endpoint in this many, or only one */
+#define AGGREGATE_RARE_DIVISOR   1000
+
+/* FNV-1a */
+#define AGGREGATE_HASH_BASIS   2166136261u
+#define AGGREGATE_HASH_PRIME   16777619u
+#define AGGREGATE_HASH(hash,value)   ( ( ( hash ) ^ (unsigned)( value ) ) * AGGREGATE_HASH_PRIME )
+
+/* count 'hooks' hooks for an identity or image on 'endpoints' endpoints. 'endpoint' is the 
+endpoint's file index + 1. the endpoints are only counted once for each endpoint.
+*/
+#define AGGREGATE_COUNT(entry,hooks,endpoints,endpoint)   \
+	do \
+	{ \
+		( entry )->hook_count += ( hooks ); \
+		 \
+		if( ( entry )->last_endpoint != ( endpoint ) ) \
+		{ \
+			( entry )->endpoint_count += ( endpoints ); \
+			( entry )->last_endpoint = ( endpoint ); \
+		} \
+__pragma(warning(push)) \
+__pragma(warning(disable:4127)) \
+	} while( 0 ) \
+__pragma(warning(pop))
+
+
+
+/* the info passed to each task */
+struct aggregate_task
+{
+	struct aggregate *store;
+	
+	/* the array of worker tables, one for each worker thread */
+	struct aggregate_table **table;
+	
+	/* the index of the file to read */
+	unsigned index;
+};
+
+
+
+static void create_aggregate_table( 
+	struct aggregate_table **const out   // out deref
+);
+
+static unsigned add_aggregate_image( 
+	struct aggregate_table *const table,   // in
+	const WCHAR *const name,   // in
+	const unsigned cch   // in
+);
+
+static struct aggregate_hook *add_aggregate_hook( 
+	struct aggregate_table *const table,   // in
+	const INT iHook,   // in
+	const DWORD flags,   // in
+	const INT ihmod,   // in
+	const unsigned image   // in
+);
+
+static void add_aggregate_record( 
+	struct aggregate_table *const table,   // in
+	const struct snapfile_view *const view,   // in
+	const unsigned index,   // in
+	const unsigned endpoint   // in
+);
+
+static void merge_aggregate_table( 
+	struct aggregate_table *const table,   // in
+	const struct aggregate_table *const worker   // in
+);
+
+static int add_aggregate_files( 
+	struct aggregate *const store   // in
+);
+
+static int compare_aggregate_hook( 
+	const void *const p1,   // in
+	const void *const p2   // in
+);
+
+static int compare_aggregate_image( 
+	const void *const p1,   // in
+	const void *const p2   // in
+);
+
+static void print_aggregate_hook( 
+	const struct aggregate_table *const table,   // in
+	const struct aggregate_hook *const hook   // in
+);
+
+static void free_aggregate_table( 
+	struct aggregate_table **const in   // in deref
+);
+
+
+
+/* create_aggregate_store() 
+Create an aggregate store and its descendants or die.
+*/
+void create_aggregate_store( 
+	struct aggregate **const out   // out deref
+)
+{
+	struct aggregate *aggregate = NULL;
+	
+	FAIL_IF( !out );
+	FAIL_IF( *out );
+	
+	
+	/* allocate an aggregate store */
+	aggregate = must_calloc( 1, sizeof( *aggregate ) );
+	
+	/* allocate the list store for the linked list of names read from list files */
+	create_list_store( &aggregate->listed );
+	aggregate->listed->type = LIST_INCLUDE_FILE;
+	
+	/* allocate the merged table */
+	create_aggregate_table( &aggregate->table );
+	
+	InitializeCriticalSection( &aggregate->cs );
+	
+	
+	*out = aggregate;
+	return;
+}
+
+
+
+/* create_aggregate_table() 
+Create an aggregate table or die.
+*/
+static void create_aggregate_table( 
+	struct aggregate_table **const out   // out deref
+)
+{
+	struct aggregate_table *table = NULL;
+	
+	FAIL_IF( !out );
+	FAIL_IF( *out );
+	
+	
+	/* allocate an aggregate table */
+	table = must_calloc( 1, sizeof( *table ) );
+	
+	table->hook_max = AGGREGATE_SLOTS_DEFAULT;
+	table->hook = must_calloc( table->hook_max, sizeof( *table->hook ) );
+	
+	table->image_slot_max = AGGREGATE_SLOTS_DEFAULT;
+	table->image_slot = must_calloc( table->image_slot_max, sizeof( *table->image_slot ) );
+	
+	table->image_max = AGGREGATE_SLOTS_DEFAULT / 2;
+	table->image = must_calloc( table->image_max, sizeof( *table->image ) );
+	
+	
+	*out = table;
+	return;
+}
+
+
+
+/* add_aggregate_image() 
+Add an image name to an aggregate table if it isn't already in the table.
+
+'name' is the image name and 'cch' is its length in characters. 'name' does not have to be null 
+terminated. Image names are compared case insensitive and stored in lowercase.
+
+The image hash table is never more than half full.
+
+returns the index of the image in the table's image array + 1
+*/
+static unsigned add_aggregate_image( 
+	struct aggregate_table *const table,   // in
+	const WCHAR *const name,   // in
+	const unsigned cch   // in
+)
+{
+	unsigned i = 0, slot = 0, hash = AGGREGATE_HASH_BASIS;
+	struct aggregate_image *image = NULL;
+	
+	FAIL_IF( !table );
+	FAIL_IF( !name );
+	
+	
+	for( i = 0; i < cch; ++i )
+		hash = AGGREGATE_HASH( hash, towlower( name[ i ] ) );
+	
+	for( slot = hash & ( table->image_slot_max - 1 );
+		table->image_slot[ slot ];
+		slot = ( slot + 1 ) & ( table->image_slot_max - 1 )
+	)
+	{
+		image = &table->image[ table->image_slot[ slot ] - 1 ];
+		
+		if( ( image->hash == hash ) && !_wcsnicmp( image->name, name, cch ) && !image->name[ cch ] )
+			return table->image_slot[ slot ];
+	}
+	
+	
+	/* the image isn't in the table. if the image array is full double its size */
+	if( table->image_count == table->image_max )
+	{
+		struct aggregate_image *const temp = must_calloc( table->image_max * 2, sizeof( *temp ) );
+		
+		memcpy( temp, table->image, table->image_max * sizeof( *temp ) );
+		free( table->image );
+		
+		table->image = temp;
+		table->image_max *= 2;
+	}
+	
+	image = &table->image[ table->image_count++ ];
+	image->hash = hash;
+	image->name = must_calloc( cch + 1, sizeof( WCHAR ) );
+	
+	for( i = 0; i < cch; ++i )
+		image->name[ i ] = towlower( name[ i ] );
+	
+	table->image_slot[ slot ] = table->image_count;
+	
+	/* if the image hash table is more than half full double its size and rehash */
+	if( ( table->image_count * 2 ) > table->image_slot_max )
+	{
+		table->image_slot_max *= 2;
+		
+		free( table->image_slot );
+		table->image_slot = must_calloc( table->image_slot_max, sizeof( *table->image_slot ) );
+		
+		for( i = 0; i < table->image_count; ++i )
+		{
+			for( slot = table->image[ i ].hash & ( table->image_slot_max - 1 );
+				table->image_slot[ slot ];
+				slot = ( slot + 1 ) & ( table->image_slot_max - 1 )
+			)
+				;
+			
+			table->image_slot[ slot ] = i + 1;
+		}
+	}
+	
+	return table->image_count;
+}
+
+
+
+/* add_aggregate_hook() 
+Add a hook identity to an aggregate table if it isn't already in the table.
+
+'image' is the index of the origin image in the table's image array + 1, or 0 if unknown.
+
+The hook hash table is never more than half full. A slot is empty if its hash is 0, so the hash of 
+an identity is never 0.
+
+returns the identity in the table. the pointer is valid until the next identity is added.
+*/
+static struct aggregate_hook *add_aggregate_hook( 
+	struct aggregate_table *const table,   // in
+	const INT iHook,   // in
+	const DWORD flags,   // in
+	const INT ihmod,   // in
+	const unsigned image   // in
+)
+{
+	unsigned i = 0, slot = 0, hash = AGGREGATE_HASH_BASIS;
+	struct aggregate_hook *hook = NULL;
+	
+	FAIL_IF( !table );
+	
+	
+	hash = AGGREGATE_HASH( hash, iHook );
+	hash = AGGREGATE_HASH( hash, flags );
+	hash = AGGREGATE_HASH( hash, ihmod );
+	hash = AGGREGATE_HASH( hash, image );
+	
+	if( !hash )
+		hash = 1;
+	
+	/* if adding an identity would make the table more than half full double its size and rehash */
+	if( ( ( table->hook_count + 1 ) * 2 ) > table->hook_max )
+	{
+		struct aggregate_hook *const temp = must_calloc( table->hook_max * 2, sizeof( *temp ) );
+		
+		for( i = 0; i < table->hook_max; ++i )
+		{
+			if( !table->hook[ i ].hash )
+				continue;
+			
+			for( slot = table->hook[ i ].hash & ( ( table->hook_max * 2 ) - 1 );
+				temp[ slot ].hash;
+				slot = ( slot + 1 ) & ( ( table->hook_max * 2 ) - 1 )
+			)
+				;
+			
+			temp[ slot ] = table->hook[ i ];
+		}
+		
+		free( table->hook );
+		
+		table->hook = temp;
+		table->hook_max *= 2;
+	}
+	
+	for( slot = hash & ( table->hook_max - 1 );
+		table->hook[ slot ].hash;
+		slot = ( slot + 1 ) & ( table->hook_max - 1 )
+	)
+	{
+		hook = &table->hook[ slot ];
+		
+		if( ( hook->hash == hash ) 
+			&& ( hook->iHook == iHook ) 
+			&& ( hook->flags == flags ) 
+			&& ( hook->ihmod == ihmod ) 
+			&& ( hook->image == image )
+		)
+			return hook;
+	}
+	
+	/* the identity isn't in the table */
+	hook = &table->hook[ slot ];
+	hook->hash = hash;
+	hook->iHook = iHook;
+	hook->flags = flags;
+	hook->ihmod = ihmod;
+	hook->image = image;
+	
+	++table->hook_count;
+	return hook;
+}
+
+
+
+/* add_aggregate_record() 
+Count the hooks in a snapshot file record.
+
+'index' is the index of the record in the view's record array.
+'endpoint' is the index of the record's file in the aggregate store's file array + 1.
+
+The hooks that are filtered out by the user-specified hook list are not counted. The program lists 
+are not used since the thread info of each endpoint isn't aggregated, only the origin image names.
+*/
+static void add_aggregate_record( 
+	struct aggregate_table *const table,   // in
+	const struct snapfile_view *const view,   // in
+	const unsigned index,   // in
+	const unsigned endpoint   // in
+)
+{
+	unsigned i = 0;
+	const struct snapfile_record *record = NULL;
+	const struct snapfile_thread *thread = NULL;
+	const struct snapfile_hook *hook = NULL;
+	
+	FAIL_IF( !table );
+	FAIL_IF( !view );
+	FAIL_IF( index >= view->record_count );
+	FAIL_IF( !endpoint );
+	
+	
+	record = view->record[ index ];
+	thread = SNAPFILE_THREADS( record );
+	hook = SNAPFILE_HOOKS( record );
+	
+	for( i = 0; i < record->hook_count; ++i )
+	{
+		const struct snapfile_hook *const r = &hook[ i ];
+		struct aggregate_hook *identity = NULL;
+		unsigned image = 0;
+		
+		
+		if( !is_HOOK_id_wanted( r->iHook ) )
+			continue;
+		
+		if( ( r->origin != SNAPFILE_NO_THREAD ) && thread[ r->origin ].name_cch )
+		{
+			image = add_aggregate_image( 
+				table, 
+				SNAPFILE_NAME( view->strings[ index ], thread[ r->origin ].name_offset ), 
+				thread[ r->origin ].name_cch
+			);
+			
+			AGGREGATE_COUNT( &table->image[ image - 1 ], 1, 1, endpoint );
+		}
+		
+		identity = add_aggregate_hook( table, r->iHook, ( r->flags & AGGREGATE_HF_MASK ), r->ihmod, image );
+		AGGREGATE_COUNT( identity, 1, 1, endpoint );
+		
+		++table->hook_total;
+	}
+	
+	return;
+}
+
+
+
+/* merge_aggregate_table() 
+Merge a worker thread's aggregate table into another aggregate table.
+
+Each file is read by only one worker thread so an endpoint counted in the worker's table is never 
+counted in any other worker's table.
+*/
+static void merge_aggregate_table( 
+	struct aggregate_table *const table,   // in
+	const struct aggregate_table *const worker   // in
+)
+{
+	unsigned i = 0;
+	
+	/* map[ worker image index ] is the index of the same image in table's image array + 1 */
+	unsigned *map = NULL;
+	
+	FAIL_IF( !table );
+	FAIL_IF( !worker );
+	
+	
+	map = must_calloc( worker->image_count + 1, sizeof( *map ) );
+	
+	for( i = 0; i < worker->image_count; ++i )
+	{
+		const struct aggregate_image *const w = &worker->image[ i ];
+		
+		map[ i ] = add_aggregate_image( table, w->name, (unsigned)wcslen( w->name ) );
+		AGGREGATE_COUNT( &table->image[ map[ i ] - 1 ], w->hook_count, w->endpoint_count, w->last_endpoint );
+	}
+	
+	for( i = 0; i < worker->hook_max; ++i )
+	{
+		const struct aggregate_hook *const w = &worker->hook[ i ];
+		struct aggregate_hook *identity = NULL;
+		
+		if( !w->hash )
+			continue;
+		
+		identity = add_aggregate_hook( 
+			table, 
+			w->iHook, 
+			w->flags, 
+			w->ihmod, 
+			( w->image ? map[ w->image - 1 ] : 0 )
+		);
+		AGGREGATE_COUNT( identity, w->hook_count, w->endpoint_count, w->last_endpoint );
+	}
+	
+	table->endpoint_count += worker->endpoint_count;
+	table->failed_count += worker->failed_count;
+	table->hook_total += worker->hook_total;
+	
+	free( map );
+	return;
+}
+
+
+
+/* read_aggregate_file() 
+The task that reads a snapshot file.
+
+The task maps the file, counts the hooks in its last record in the table of the worker thread that 
+is running the task and then unmaps the file. Only the last record is validated. The workers 
+only take the store's lock to print an error, so that the messages of different files don't mix.
+*/
+static void read_aggregate_file( 
+	void *param,   // in
+	struct sched_group *group   // in
+)
+{
+	const struct aggregate_task *const task = (struct aggregate_task *)param;
+	struct aggregate *const store = task->store;
+	struct aggregate_table *const table = task->table[ get_sched_worker_index( group->store ) ];
+	struct snapfile_view *view = NULL;
+	int ok = FALSE;
+	
+	
+	create_snapfile_view( &view );
+	
+	ok = init_snapfile_view_last( view, store->file[ task->index ] );
+	
+	if( ok )
+	{
+		add_aggregate_record( table, view, 0, task->index + 1 );
+		++table->endpoint_count;
+	}
+	else
+	{
+		EnterCriticalSection( &store->cs );
+		print_snapfile_view_error( view );
+		LeaveCriticalSection( &store->cs );
+		
+		++table->failed_count;
+	}
+	
+	free_snapfile_view( &view );
+	return;
+}
+
+
+
+/* add_aggregate_files() 
+Make the aggregate store's array of snapshot file names.
+
+The names are in the user-specified file list (G->config->filelist). If a name begins with '@' then 
+the rest of the name is a list file: a text file with the name of a snapshot file on each line.
+
+returns nonzero on success
+*/
+static int add_aggregate_files( 
+	struct aggregate *const store   // in
+)
+{
+	const struct list_item *item = NULL;
+	unsigned count = 0;
+	
+	FAIL_IF( !store );
+	FAIL_IF( store->file );
+	
+	
+	for( item = G->config->filelist->head; item; item = item->next )
+	{
+		FILE *fp = NULL;
+		char line[ MAX_PATH * 4 ];
+		
+		
+		if( item->name[ 0 ] != L'@' )
+		{
+			++count;
+			continue;
+		}
+		
+		fp = _wfopen( item->name + 1, L"r" );
+		if( !fp )
+		{
+			MSG_ERROR( "_wfopen() failed to open the list file." );
+			printf( "file: %ls\n", item->name + 1 );
+			return FALSE;
+		}
+		
+		while( fgets( line, sizeof( line ), fp ) )
+		{
+			WCHAR *name = NULL;
+			
+			
+			line[ strcspn( line, "\r\n" ) ] = '\0';
+			
+			if( !line[ 0 ] )
+				continue;
+			
+			if( !get_wstr_from_mbstr( &name, line ) )
+			{
+				MSG_ERROR( "get_wstr_from_mbstr() failed." );
+				printf( "file: %s\n", line );
+				fclose( fp );
+				return FALSE;
+			}
+			
+			if( !add_list_item( store->listed, 0, name ) )
+			{
+				MSG_ERROR( "add_list_item() failed." );
+				printf( "file: %s\n", line );
+				free( name );
+				fclose( fp );
+				return FALSE;
+			}
+			
+			free( name );
+			++count;
+		}
+		
+		fclose( fp );
+	}
+	
+	if( !count )
+	{
+		MSG_ERROR( "There are no snapshot files to aggregate." );
+		return FALSE;
+	}
+	
+	store->file = must_calloc( count, sizeof( *store->file ) );
+	
+	for( item = G->config->filelist->head; item; item = item->next )
+	{
+		if( item->name[ 0 ] != L'@' )
+			store->file[ store->file_count++ ] = item->name;
+	}
+	
+	for( item = store->listed->head; item; item = item->next )
+		store->file[ store->file_count++ ] = item->name;
+	
+	return TRUE;
+}
+
+
+
+/* init_aggregate_store() 
+Initialize an aggregate store by reading and counting the hooks in each snapshot file.
+
+The files are read by a scheduler with one worker thread for each processor, and a task for each 
+file. Each worker thread counts in its own table and when all the files have been read the worker 
+tables are merged. A file that can't be read 
+is counted as failed and is otherwise ignored.
+
+returns nonzero on success
+*/
+int init_aggregate_store( 
+	struct aggregate *const store   // in
+)
+{
+	struct sched *sched = NULL;
+	struct sched_group *group = NULL;
+	struct aggregate_table **table = NULL;
+	struct aggregate_task *task = NULL;
+	unsigned i = 0;
+	
+	FAIL_IF( !G );   // The global store must exist.
+	FAIL_IF( !G->config->init_time );   // The configuration store must be initialized.
+	
+	FAIL_IF( !store );
+	FAIL_IF( store->init_time );   // Fail if this store has already been initialized.
+	
+	FAIL_IF( GetCurrentThreadId() != G->prog->dwMainThreadId );   // main thread only
+	
+	
+	if( !add_aggregate_files( store ) )
+		return FALSE;
+	
+	store->thread_count = get_sched_processor_count();
+	
+	if( store->thread_count > store->file_count )
+		store->thread_count = store->file_count;
+	
+	create_sched_store( &sched );
+	
+	if( !init_sched_store( sched, store->thread_count ) )
+	{
+		MSG_FATAL( "init_sched_store() failed." );
+		exit( 1 );
+	}
+	
+	store->thread_count = sched->worker_count;
+	
+	table = must_calloc( store->thread_count, sizeof( *table ) );
+	
+	for( i = 0; i < store->thread_count; ++i )
+		create_aggregate_table( &table[ i ] );
+	
+	task = must_calloc( store->file_count, sizeof( *task ) );
+	
+	create_sched_group( sched, &group );
+	
+	for( i = 0; i < store->file_count; ++i )
+	{
+		task[ i ].store = store;
+		task[ i ].table = table;
+		task[ i ].index = i;
+		
+		spawn_sched_task( group, read_aggregate_file, &task[ i ] );
+	}
+	
+	join_sched_group( group );
+	
+	free_sched_group( &group );
+	free_sched_store( &sched );
+	free( task );
+	
+	for( i = 0; i < store->thread_count; ++i )
+	{
+		merge_aggregate_table( store->table, table[ i ] );
+		free_aggregate_table( &table[ i ] );
+	}
+	
+	free( table );
+	
+	/* count the distinct identities of each image */
+	for( i = 0; i < store->table->hook_max; ++i )
+	{
+		if( store->table->hook[ i ].hash && store->table->hook[ i ].image )
+			++store->table->image[ store->table->hook[ i ].image - 1 ].identity_count;
+	}
+	
+	if( !store->table->endpoint_count )
+	{
+		MSG_ERROR( "None of the snapshot files could be read." );
+		return FALSE;
+	}
+	
+	
+	/* the aggregate store has been initialized */
+	GetSystemTimeAsFileTime( (FILETIME *)&store->init_time );
+	return TRUE;
+}
+
+
+
+/* compare_aggregate_hook() 
+Compare two pointers to hook identities by prevalence.
+
+The identity found on the most endpoints comes first. If two identities were found on the same 
+number of endpoints then the one with the most hooks comes first, and then the lowest HOOK id.
+
+returns a negative number if p1 should come before p2, otherwise a positive number or 0
+*/
+static int compare_aggregate_hook( 
+	const void *const p1,   // in
+	const void *const p2   // in
+)
+{
+	const struct aggregate_hook *const a = *(const struct aggregate_hook *const *)p1;
+	const struct aggregate_hook *const b = *(const struct aggregate_hook *const *)p2;
+	
+	
+	if( a->endpoint_count != b->endpoint_count )
+		return ( a->endpoint_count > b->endpoint_count ) ? -1 : 1;
+	
+	if( a->hook_count != b->hook_count )
+		return ( a->hook_count > b->hook_count ) ? -1 : 1;
+	
+	if( a->iHook != b->iHook )
+		return ( a->iHook < b->iHook ) ? -1 : 1;
+	
+	if( a->image != b->image )
+		return ( a->image < b->image ) ? -1 : 1;
+	
+	if( a->flags != b->flags )
+		return ( a->flags < b->flags ) ? -1 : 1;
+	
+	if( a->ihmod != b->ihmod )
+		return ( a->ihmod < b->ihmod ) ? -1 : 1;
+	
+	return 0;
+}
+
+
+
+/* compare_aggregate_image() 
+Compare two pointers to images by prevalence.
+
+The image found on the most endpoints comes first. If two images were found on the same number of 
+endpoints then the one with the most hooks comes first, and then by name.
+
+returns a negative number if p1 should come before p2, otherwise a positive number or 0
+*/
+static int compare_aggregate_image( 
+	const void *const p1,   // in
+	const void *const p2   // in
+)
+{
+	const struct aggregate_image *const a = *(const struct aggregate_image *const *)p1;
+	const struct aggregate_image *const b = *(const struct aggregate_image *const *)p2;
+	
+	
+	if( a->endpoint_count != b->endpoint_count )
+		return ( a->endpoint_count > b->endpoint_count ) ? -1 : 1;
+	
+	if( a->hook_count != b->hook_count )
+		return ( a->hook_count > b->hook_count ) ? -1 : 1;
+	
+	return wcscmp( a->name, b->name );
+}
+
+
+
+/* print_aggregate_hook() 
+Print a hook identity as a row of the hook tables in print_aggregate_report().
+*/
+static void print_aggregate_hook( 
+	const struct aggregate_table *const table,   // in
+	const struct aggregate_hook *const hook   // in
+)
+{
+	const unsigned index = (unsigned)( hook->iHook + 1 ); /* the array index is the same as id + 1 */
+	
+	
+	printf( "%10u %8.3f%% %12I64u  %-20ls %4d  0x%02lX %6d  %ls\n", 
+		hook->endpoint_count, 
+		( ( hook->endpoint_count * 100.0 ) / table->endpoint_count ), 
+		hook->hook_count, 
+		( ( index < w_hooknames_count ) ? w_hooknames[ index ] : L"<unknown>" ), 
+		hook->iHook, 
+		hook->flags, 
+		hook->ihmod, 
+		( hook->image ? table->image[ hook->image - 1 ].name : L"<unknown>" )
+	);
+	
+	return;
+}
+
+
+
+/* print_aggregate_report() 
+Print the fleet-wide hook counts, the rare hooks and the image prevalence table.
+
+Hook counts: each hook identity and how many endpoints it was found on, by prevalence.
+
+Rare hooks: the hook identities found on no more than one endpoint in AGGREGATE_RARE_DIVISOR, or 
+on only one endpoint, rarest first. If a rare hook was found on only one endpoint then the file of 
+that endpoint is printed.
+
+Image prevalence: each origin image and how many endpoints have hooks that originated from it.
+
+if 'store' is NULL this function returns without having printed anything.
+*/
+void print_aggregate_report( 
+	const struct aggregate *const store   // in
+)
+{
+	const struct aggregate_table *table = NULL;
+	const struct aggregate_hook **hook = NULL;
+	const struct aggregate_image **image = NULL;
+	unsigned i = 0, j = 0, rare = 0;
+	
+	
+	if( !store )
+		return;
+	
+	FAIL_IF( !store->init_time );   // The aggregate store must be initialized.
+	
+	
+	table = store->table;
+	
+	hook = must_calloc( table->hook_count + 1, sizeof( *hook ) );
+	
+	for( i = 0, j = 0; i < table->hook_max; ++i )
+	{
+		if( table->hook[ i ].hash )
+			hook[ j++ ] = &table->hook[ i ];
+	}
+	
+	qsort( (void *)hook, table->hook_count, sizeof( *hook ), compare_aggregate_hook );
+	
+	image = must_calloc( table->image_count + 1, sizeof( *image ) );
+	
+	for( i = 0; i < table->image_count; ++i )
+		image[ i ] = &table->image[ i ];
+	
+	qsort( (void *)image, table->image_count, sizeof( *image ), compare_aggregate_image );
+	
+	rare = table->endpoint_count / AGGREGATE_RARE_DIVISOR;
+	if( !rare )
+		rare = 1;
+	
+	
+	printf( "Snapshot files: %u (%u could not be read)\n", store->file_count, table->failed_count );
+	printf( "Endpoints: %u\n", table->endpoint_count );
+	printf( "Hooks: %I64u\n", table->hook_total );
+	printf( "Distinct hooks: %u\n", table->hook_count );
+	printf( "Distinct origin images: %u\n", table->image_count );
+	
+	printf( "\nHook counts:\n" );
+	printf( "%10s %9s %12s  %-20s %4s  %4s %6s  %s\n", 
+		"endpoints", "percent", "hooks", "hook", "id", "flags", "ihmod", "origin image"
+	);
+	
+	for( i = 0; i < table->hook_count; ++i )
+		print_aggregate_hook( table, hook[ i ] );
+	
+	printf( "\nRare hooks (found on %u or fewer endpoints):\n", rare );
+	printf( "%10s %9s %12s  %-20s %4s  %4s %6s  %s\n", 
+		"endpoints", "percent", "hooks", "hook", "id", "flags", "ihmod", "origin image"
+	);
+	
+	for( i = table->hook_count; i && ( hook[ i - 1 ]->endpoint_count <= rare ); --i )
+	{
+		print_aggregate_hook( table, hook[ i - 1 ] );
+		
+		if( hook[ i - 1 ]->endpoint_count == 1 )
+			printf( "%10s file: %ls\n", "", store->file[ hook[ i - 1 ]->last_endpoint - 1 ] );
+	}
+	
+	printf( "\nImage prevalence:\n" );
+	printf( "%10s %9s %12s %9s  %s\n", "endpoints", "percent", "hooks", "distinct", "origin image" );
+	
+	for( i = 0; i < table->image_count; ++i )
+	{
+		printf( "%10u %8.3f%% %12I64u %9u  %ls\n", 
+			image[ i ]->endpoint_count, 
+			( ( image[ i ]->endpoint_count * 100.0 ) / table->endpoint_count ), 
+			image[ i ]->hook_count, 
+			image[ i ]->identity_count, 
+			image[ i ]->name
+		);
+	}
+	
+	free( (void *)image );
+	free( (void *)hook );
+	return;
+}
+
+
+
+/* print_aggregate_store() 
+Print an aggregate store.
+
+if 'store' is NULL this function returns without having printed anything.
+*/
+void print_aggregate_store( 
+	const struct aggregate *const store   // in
+)
+{
+	const char *const objname = "Aggregate Store";
+	
+	
+	if( !store )
+		return;
+	
+	PRINT_DBLSEP_BEGIN( objname );
+	print_init_time( "store->init_time", store->init_time );
+	
+	printf( "store->file_count: %u\n", store->file_count );
+	printf( "store->thread_count: %u\n", store->thread_count );
+	
+	if( store->table )
+	{
+		printf( "store->table->hook_max: %u\n", store->table->hook_max );
+		printf( "store->table->hook_count: %u\n", store->table->hook_count );
+		printf( "store->table->image_max: %u\n", store->table->image_max );
+		printf( "store->table->image_count: %u\n", store->table->image_count );
+		printf( "store->table->image_slot_max: %u\n", store->table->image_slot_max );
+		printf( "store->table->endpoint_count: %u\n", store->table->endpoint_count );
+		printf( "store->table->failed_count: %u\n", store->table->failed_count );
+		printf( "store->table->hook_total: %I64u\n", store->table->hook_total );
+	}
+	
+	PRINT_DBLSEP_END( objname );
+	
+	return;
+}
+
+
+
+/* free_aggregate_table() 
+Free an aggregate table.
+
+this function then sets the aggregate table pointer to NULL and returns
+
+'in' is a pointer to a pointer to the aggregate table.
+if( !in || !*in ) then this function returns.
+*/
+static void free_aggregate_table( 
+	struct aggregate_table **const in   // in deref
+)
+{
+	unsigned i = 0;
+	
+	
+	if( !in || !*in )
+		return;
+	
+	for( i = 0; i < (*in)->image_count; ++i )
+		free( (*in)->image[ i ].name );
+	
+	free( (*in)->image );
+	free( (*in)->image_slot );
+	free( (*in)->hook );
+	
+	free( (*in) );
+	*in = NULL;
+	
+	return;
+}
+
+
+
+/* free_aggregate_store() 
+Free an aggregate store and all its descendants.
+
+this function then sets the aggregate store pointer to NULL and returns
+
+'in' is a pointer to a pointer to the aggregate store.
+if( !in || !*in ) then this function returns.
+*/
+void free_aggregate_store( 
+	struct aggregate **const in   // in deref
+)
+{
+	if( !in || !*in )
+		return;
+	
+	free_aggregate_table( &(*in)->table );
+	
+	free( (void *)(*in)->file );
+	free_list_store( &(*in)->listed );
+	
+	DeleteCriticalSection( &(*in)->cs );
+	
+	free( (*in) );
+	*in = NULL;
+	
+	return;
+}
+
+
+
+/* aggregatemode() 
+Aggregate snapshot files.
+
+The files are in the user-specified file list (G->config->filelist).
+
+returns nonzero on success
+*/
+int aggregatemode( void )
+{
+	const char *const objname = "Aggregate Mode";
+	struct aggregate *aggregate = NULL;
+	int ret = FALSE;
+	
+	FAIL_IF( !G );   // The global store must exist.
+	FAIL_IF( !G->config->init_time );   // The configuration store must be initialized.
+	FAIL_IF( G->config->offline != OFFLINE_AGGREGATE );   // Aggregate mode must have been requested.
+	
+	FAIL_IF( GetCurrentThreadId() != G->prog->dwMainThreadId );   // main thread only
+	
+	
+	if( G->config->verbose >= 5 )
+		PRINT_HASHSEP_BEGIN( objname );
+	
+	create_aggregate_store( &aggregate );
+	
+	if( !init_aggregate_store( aggregate ) )
+		goto cleanup;
+	
+	if( G->config->verbose >= 5 )
+		print_aggregate_store( aggregate );
+	
+	print_aggregate_report( aggregate );
+	printf( "\n" );
+	
+	ret = TRUE;
+
+cleanup:
+	free_aggregate_store( &aggregate );
+	
+	if( G->config->verbose >= 5 )
+		PRINT_HASHSEP_END( objname );
+	
+	return ret;
+}
@@ -0,0 +1,213 @@
+/*
+Copyright (C) 2011 Jay Satiro <raysatiro@yahoo.com>
+All rights reserved.
+
+This file is part of GetHooks.
+
+GetHooks is free software: you can redistribute it and/or modify 
+it under the terms of the GNU General Public License as published by 
+the Free Software Foundation, either version 3 of the License, or 
+(at your option) any later version.
+
+GetHooks is distributed in the hope that it will be useful, 
+but WITHOUT ANY WARRANTY; without even the implied warranty of 
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License 
+along with GetHooks.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _AGGREGATE_H
+#define _AGGREGATE_H
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include "portable.h"
+#endif
+
+/* ReactOS structures and supporting functions */
+#include "reactos.h"
+
+/* generic list store (linked list of names/ids) */
+#include "list.h"
+
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/** A hook identity.
+Hooks from different endpoints are the same hook if they have the same identity. The identity does 
+not include any address, handle or thread id since those are different on every endpoint.
+*/
+struct aggregate_hook
+{
+	/* the hash of the identity. see get_aggregate_hook_hash() */
+	unsigned hash;
+	
+	/* the HOOK id (eg WH_MOUSE) */
+	INT iHook;
+	
+	/* the HOOK flags, without the flags that are only a transient state. see AGGREGATE_HF_MASK */
+	DWORD flags;
+	
+	/* the HOOK's module index. -1 if the hook procedure isn't in a module (eg a low level hook) */
+	INT ihmod;
+	
+	/* the origin thread's image. the index of the image in the image array + 1, or 0 if unknown */
+	unsigned image;
+	
+	/* how many endpoints have at least one hook with this identity */
+	unsigned endpoint_count;
+	
+	/* how many hooks with this identity were found on all endpoints. 0 if the slot is empty. */
+	unsigned __int64 hook_count;
+	
+	/* the last endpoint that was counted in endpoint_count: the endpoint's file index + 1 */
+	unsigned last_endpoint;
+};
+
+/* the HOOK flags that are part of a hook identity */
+#define AGGREGATE_HF_MASK   ( HF_VALID & ~( HF_HUNG | HF_DESTROYED ) )
+
+
+
+/** An origin image.
+*/
+struct aggregate_image
+{
+	/* the image name in lowercase */
+	WCHAR *name;   // must_wcsdup(), free()
+	
+	/* the hash of the name */
+	unsigned hash;
+	
+	/* how many endpoints have at least one hook that originated from this image */
+	unsigned endpoint_count;
+	
+	/* how many hooks originated from this image on all endpoints */
+	unsigned __int64 hook_count;
+	
+	/* how many distinct hook identities originated from this image */
+	unsigned identity_count;
+	
+	/* the last endpoint that was counted in endpoint_count: the endpoint's file index + 1 */
+	unsigned last_endpoint;
+};
+
+
+
+/** An aggregate table.
+Each worker thread has its own table so that no locking is needed while files are read. When all 
+the files have been read the worker tables are merged into the store's table.
+*/
+struct aggregate_table
+{
+	/** the hook identity hash table. open addressing with linear probing.
+	*/
+	struct aggregate_hook *hook;   // must_calloc(), free()
+	
+	/* the number of slots in the hook table. always a power of 2. */
+	unsigned hook_max;
+	
+	/* the number of identities in the hook table */
+	unsigned hook_count;
+	
+	
+	/** the origin images. each image name is stored only once.
+	*/
+	/* the image array, in the order the images were found */
+	struct aggregate_image *image;   // must_calloc(), free()
+	
+	/* the allocated/maximum number of elements in the image array */
+	unsigned image_max;
+	
+	/* the number of elements written to in the image array */
+	unsigned image_count;
+	
+	/* the image hash table. each slot is an index in the image array + 1, or 0 if empty. */
+	unsigned *image_slot;   // must_calloc(), free()
+	
+	/* the number of slots in the image hash table. always a power of 2. */
+	unsigned image_slot_max;
+	
+	
+	/* how many files were read and how many could not be read */
+	unsigned endpoint_count;
+	unsigned failed_count;
+	
+	/* how many hooks were found on all endpoints, not including the hooks that are filtered out */
+	unsigned __int64 hook_total;
+};
+
+
+
+/** The aggregate store.
+The aggregate store holds the fleet-wide aggregation of the last record in each of many snapshot 
+files, one file for each endpoint.
+*/
+struct aggregate
+{
+	/* an array of pointers to the snapshot file names. the names point to G->config->filelist 
+	or to names read from a list file.
+	*/
+	const WCHAR **file;   // must_calloc(), free()
+	
+	/* the number of elements in the file array */
+	unsigned file_count;
+	
+	/* the names read from list files */
+	struct list *listed;   // create_list_store(), free_list_store()
+	
+	/* the worker threads hold this lock while printing an error so that the messages aren't mixed */
+	CRITICAL_SECTION cs;
+	
+	/* how many worker threads read the files */
+	unsigned thread_count;
+	
+	/* the merged table */
+	struct aggregate_table *table;   // must_calloc(), free_aggregate_table()
+	
+	/* the system utc time in FILETIME format immediately after this store has been initialized.
+	this is nonzero when this store has been initialized.
+	*/
+	__int64 init_time;
+};
+
+
+
+/** 
+these functions are documented in the comment block above their definitions in aggregate.c
+*/
+void create_aggregate_store( 
+	struct aggregate **const out   // out deref
+);
+
+int init_aggregate_store( 
+	struct aggregate *const store   // in
+);
+
+void print_aggregate_report( 
+	const struct aggregate *const store   // in
+);
+
+void print_aggregate_store( 
+	const struct aggregate *const store   // in
+);
+
+void free_aggregate_store( 
+	struct aggregate **const in   // in deref
+);
+
+int aggregatemode( void );
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _AGGREGATE_H
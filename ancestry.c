@@ -0,0 +1,715 @@
+/*
+Copyright (C) 2011 Jay Satiro <raysatiro@yahoo.com>
+All rights reserved.
+
+This file is part of GetHooks.
+
+GetHooks is free software: you can redistribute it and/or modify 
+it under the terms of the GNU General Public License as published by 
+the Free Software Foundation, either version 3 of the License, or 
+(at your option) any later version.
+
+GetHooks is distributed in the hope that it will be useful, 
+but WITHOUT ANY WARRANTY; without even the implied warranty of 
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License 
+along with GetHooks.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/** 
+This file contains functions for a process ancestry store (parent/child index of processes).
+Each function is documented in the comment block above its definition.
+
+The ancestry store is updated from the system process info during each snapshot's thread traversal, 
+in the same pass that adds the gui threads. A process is identified by its id and creation time, so 
+a process id that has been reused by an unrelated process is never mistaken for the original. The 
+parent of a process is the newest process with the parent process id that was created before it and 
+that hadn't exited before it was created.
+
+The items of processes that have exited are kept so that the ancestors of a live process can still 
+be printed. When exited processes that aren't the ancestor of any live process outnumber the live 
+processes the item array is compacted.
+
+-
+create_ancestry_store()
+
+Create a process ancestry store and its descendants or die.
+-
+
+-
+init_ancestry_store()
+
+Initialize a process ancestry store.
+-
+
+-
+hash_ancestry_pid()
+
+Get the first slot in the hash table for a process id.
+-
+
+-
+rebuild_ancestry_slots()
+
+Rebuild the hash table and the same process id chains from the item array.
+-
+
+-
+begin_ancestry_update()
+
+Begin an update of the process ancestry store.
+-
+
+-
+add_ancestry_process()
+
+Add a process to the process ancestry store if it isn't already in the store.
+-
+
+-
+find_ancestry_parent()
+
+Find the parent of an item in the process ancestry store.
+-
+
+-
+compact_ancestry_store()
+
+Remove the items of exited processes that aren't the ancestor of any live process.
+-
+
+-
+end_ancestry_update()
+
+End an update of the process ancestry store.
+-
+
+-
+find_ancestry_process()
+
+Find a process in the process ancestry store.
+-
+
+-
+print_ancestry_chain()
+
+Print a process and its ancestors. No newline.
+-
+
+-
+print_ancestry_store()
+
+Print a process ancestry store.
+-
+
+-
+free_ancestry_store()
+
+Free a process ancestry store and all its descendants.
+-
+
+*/
+
+#include <stdio.h>
+
+#include "util.h"
+
+#include "ancestry.h"
+
+/* the global stores */
+#include "global.h"
+
+
+
+/* the initial number of elements in the item array */
+#define ANCESTRY_ITEMS_DEFAULT   512
+
+/* the maximum number of ancestors printed by print_ancestry_chain() */
+#define ANCESTRY_DEPTH_MAX   64
+
+/* the number of items of exited processes that are always kept, regardless of how many processes 
+are live. the item array is compacted when it's larger than twice the live count plus this.
+*/
+#define ANCESTRY_COMPACT_SLACK   1024
+
+
+
+static unsigned hash_ancestry_pid( 
+	const struct ancestry *const store,   // in
+	const unsigned __int64 pid   // in
+);
+
+static void rebuild_ancestry_slots( 
+	struct ancestry *const store   // in
+);
+
+static unsigned find_ancestry_parent( 
+	const struct ancestry *const store,   // in
+	const unsigned index   // in
+);
+
+static void compact_ancestry_store( 
+	struct ancestry *const store   // in
+);
+
+
+
+/* create_ancestry_store() 
+Create a process ancestry store and its descendants or die.
+*/
+void create_ancestry_store( 
+	struct ancestry **const out   // out deref
+)
+{
+	struct ancestry *ancestry = NULL;
+	
+	FAIL_IF( !out );
+	FAIL_IF( *out );
+	
+	
+	/* allocate an ancestry store */
+	ancestry = must_calloc( 1, sizeof( *ancestry ) );
+	
+	ancestry->item_max = ANCESTRY_ITEMS_DEFAULT;
+	ancestry->item = must_calloc( ancestry->item_max, sizeof( *ancestry->item ) );
+	
+	/* the hash table is kept at most half full */
+	ancestry->slot_max = ANCESTRY_ITEMS_DEFAULT * 2;
+	ancestry->slot = must_calloc( ancestry->slot_max, sizeof( *ancestry->slot ) );
+	
+	
+	*out = ancestry;
+	return;
+}
+
+
+
+/* init_ancestry_store() 
+Initialize a process ancestry store.
+
+The store is empty until the first update. See begin_ancestry_update().
+
+returns nonzero on success
+*/
+int init_ancestry_store( 
+	struct ancestry *const store   // in
+)
+{
+	FAIL_IF( !store );
+	FAIL_IF( store->init_time );   // Fail if this store has already been initialized.
+	
+	
+	/* the ancestry store has been initialized */
+	GetSystemTimeAsFileTime( (FILETIME *)&store->init_time );
+	return TRUE;
+}
+
+
+
+/* hash_ancestry_pid() 
+Get the first slot in the hash table for a process id.
+
+returns the slot index
+*/
+static unsigned hash_ancestry_pid( 
+	const struct ancestry *const store,   // in
+	const unsigned __int64 pid   // in
+)
+{
+	FAIL_IF( !store );
+	
+	
+	/* process ids are multiples of 4 */
+	return ( (unsigned)( pid >> 2 ) * 2654435761u ) & ( store->slot_max - 1 );
+}
+
+
+
+/* rebuild_ancestry_slots() 
+Rebuild the hash table and the same process id chains from the item array.
+
+Items are in the order the processes were first seen so the last item with a process id is the 
+newest.
+*/
+static void rebuild_ancestry_slots( 
+	struct ancestry *const store   // in
+)
+{
+	unsigned i = 0;
+	
+	FAIL_IF( !store );
+	
+	
+	ZeroMemory( store->slot, store->slot_max * sizeof( *store->slot ) );
+	
+	for( i = 0; i < store->item_count; ++i )
+	{
+		struct ancestry_item *const item = &store->item[ i ];
+		unsigned slot = 0;
+		
+		
+		for( slot = hash_ancestry_pid( store, item->pid );
+			store->slot[ slot ] && ( store->item[ store->slot[ slot ] - 1 ].pid != item->pid );
+			slot = ( slot + 1 ) & ( store->slot_max - 1 )
+		)
+			;
+		
+		item->next_same_pid = store->slot[ slot ];
+		store->slot[ slot ] = i + 1;
+	}
+	
+	return;
+}
+
+
+
+/* begin_ancestry_update() 
+Begin an update of the process ancestry store.
+
+Call this before traversing the threads. Each process seen during the traversal is passed to 
+add_ancestry_process(). If the traversal is retried this function can be called again.
+*/
+void begin_ancestry_update( 
+	struct ancestry *const store   // in
+)
+{
+	FAIL_IF( !store );
+	FAIL_IF( !store->init_time );   // The ancestry store must be initialized.
+	
+	
+	++store->generation;
+	store->update_begin = store->item_count;
+	
+	return;
+}
+
+
+
+/* add_ancestry_process() 
+Add a process to the process ancestry store if it isn't already in the store.
+
+'spi' is the system process info of a process seen in the current update.
+
+The process is marked as seen in the current update. Its parent is resolved when the update ends.
+*/
+void add_ancestry_process( 
+	struct ancestry *const store,   // in
+	const SYSTEM_PROCESS_INFORMATION *const spi   // in
+)
+{
+	unsigned i = 0, slot = 0;
+	unsigned __int64 pid = 0;
+	__int64 create_time = 0;
+	struct ancestry_item *item = NULL;
+	
+	FAIL_IF( !store );
+	FAIL_IF( !store->init_time );   // The ancestry store must be initialized.
+	FAIL_IF( !spi );
+	
+	
+	pid = (uintptr_t)spi->UniqueProcessId;
+	create_time = spi->CreateTime.QuadPart;
+	
+	for( slot = hash_ancestry_pid( store, pid );
+		store->slot[ slot ] && ( store->item[ store->slot[ slot ] - 1 ].pid != pid );
+		slot = ( slot + 1 ) & ( store->slot_max - 1 )
+	)
+		;
+	
+	/* if the process is already in the store then mark it as seen */
+	for( i = store->slot[ slot ]; i; i = store->item[ i - 1 ].next_same_pid )
+	{
+		if( store->item[ i - 1 ].create_time == create_time )
+		{
+			store->item[ i - 1 ].generation = store->generation;
+			return;
+		}
+	}
+	
+	
+	/* the process isn't in the store. if the item array is full double its size */
+	if( store->item_count == store->item_max )
+	{
+		struct ancestry_item *const temp = must_calloc( store->item_max * 2, sizeof( *temp ) );
+		
+		memcpy( temp, store->item, store->item_max * sizeof( *temp ) );
+		free( store->item );
+		
+		store->item = temp;
+		store->item_max *= 2;
+	}
+	
+	item = &store->item[ store->item_count ];
+	
+	item->pid = pid;
+	item->create_time = create_time;
+	item->parent_pid = (uintptr_t)spi->InheritedFromUniqueProcessId;
+	item->parent = 0;
+	item->generation = store->generation;
+	item->exit_time = 0;
+	
+	if( spi->ImageName.Buffer )
+	{
+		const unsigned cch = spi->ImageName.Length / sizeof( WCHAR );
+		
+		item->name = must_calloc( cch + 1, sizeof( WCHAR ) );
+		memcpy( item->name, spi->ImageName.Buffer, cch * sizeof( WCHAR ) );
+	}
+	else
+		item->name = NULL;
+	
+	/* the new item is the newest with its process id */
+	item->next_same_pid = store->slot[ slot ];
+	store->slot[ slot ] = ++store->item_count;
+	
+	/* if the hash table is more than half full double its size and rehash */
+	if( ( store->item_count * 2 ) > store->slot_max )
+	{
+		store->slot_max *= 2;
+		
+		free( store->slot );
+		store->slot = must_calloc( store->slot_max, sizeof( *store->slot ) );
+		
+		rebuild_ancestry_slots( store );
+	}
+	
+	return;
+}
+
+
+
+/* find_ancestry_parent() 
+Find the parent of an item in the process ancestry store.
+
+'index' is the index of the item in the item array.
+
+The parent is the newest process with the item's parent process id that was created no later than 
+the item's process and that hadn't exited when the item's process was created.
+
+returns the index + 1 of the parent in the item array, or 0 if the parent isn't in the store
+*/
+static unsigned find_ancestry_parent( 
+	const struct ancestry *const store,   // in
+	const unsigned index   // in
+)
+{
+	unsigned i = 0, slot = 0;
+	const struct ancestry_item *item = NULL;
+	
+	FAIL_IF( !store );
+	FAIL_IF( index >= store->item_count );
+	
+	
+	item = &store->item[ index ];
+	
+	/* the idle and system processes have no parent */
+	if( item->parent_pid == item->pid )
+		return 0;
+	
+	for( slot = hash_ancestry_pid( store, item->parent_pid );
+		store->slot[ slot ] && ( store->item[ store->slot[ slot ] - 1 ].pid != item->parent_pid );
+		slot = ( slot + 1 ) & ( store->slot_max - 1 )
+	)
+		;
+	
+	for( i = store->slot[ slot ]; i; i = store->item[ i - 1 ].next_same_pid )
+	{
+		const struct ancestry_item *const parent = &store->item[ i - 1 ];
+		
+		
+		if( ( parent->create_time <= item->create_time ) 
+			&& ( !parent->exit_time || ( parent->exit_time > item->create_time ) )
+		)
+			return i;
+	}
+	
+	return 0;
+}
+
+
+
+/* compact_ancestry_store() 
+Remove the items of exited processes that aren't the ancestor of any live process.
+
+The remaining items keep their order and their parent indexes are remapped.
+*/
+static void compact_ancestry_store( 
+	struct ancestry *const store   // in
+)
+{
+	unsigned i = 0, count = 0;
+	
+	/* an array of the new index + 1 of each item, or 0 if the item is removed */
+	unsigned *remap = NULL;
+	
+	FAIL_IF( !store );
+	
+	
+	remap = must_calloc( store->item_count ? store->item_count : 1, sizeof( *remap ) );
+	
+	/* keep each live process and its ancestors */
+	for( i = 0; i < store->item_count; ++i )
+	{
+		unsigned depth = 0, j = 0;
+		
+		
+		if( store->item[ i ].exit_time )
+			continue;
+		
+		for( j = i + 1; j && !remap[ j - 1 ] && ( depth < store->item_count ); ++depth )
+		{
+			remap[ j - 1 ] = TRUE;
+			j = store->item[ j - 1 ].parent;
+		}
+	}
+	
+	/* move the kept items to the front of the array */
+	for( i = 0; i < store->item_count; ++i )
+	{
+		if( !remap[ i ] )
+		{
+			free( store->item[ i ].name );
+			continue;
+		}
+		
+		store->item[ count ] = store->item[ i ];
+		remap[ i ] = ++count;
+	}
+	
+	for( i = 0; i < count; ++i )
+	{
+		if( store->item[ i ].parent )
+			store->item[ i ].parent = remap[ store->item[ i ].parent - 1 ];
+	}
+	
+	ZeroMemory( &store->item[ count ], ( store->item_count - count ) * sizeof( *store->item ) );
+	store->item_count = count;
+	
+	rebuild_ancestry_slots( store );
+	
+	++store->compact_count;
+	free( remap );
+	return;
+}
+
+
+
+/* end_ancestry_update() 
+End an update of the process ancestry store.
+
+Call this after the threads have been traversed successfully.
+
+'time' is the time of the update in FILETIME format. Processes that were live but weren't seen in 
+this update are marked as having exited at this time.
+
+The parents of the processes added in this update are resolved, and the store is compacted if 
+needed.
+*/
+void end_ancestry_update( 
+	struct ancestry *const store,   // in
+	const __int64 time   // in
+)
+{
+	unsigned i = 0;
+	
+	FAIL_IF( !store );
+	FAIL_IF( !store->init_time );   // The ancestry store must be initialized.
+	
+	
+	store->live_count = 0;
+	
+	for( i = 0; i < store->item_count; ++i )
+	{
+		struct ancestry_item *const item = &store->item[ i ];
+		
+		
+		if( item->exit_time )
+			continue;
+		
+		if( item->generation != store->generation )
+			item->exit_time = time;
+		else
+			++store->live_count;
+	}
+	
+	/* the parents are resolved after all the processes in this update have been added since a 
+	parent may have been seen after its child
+	*/
+	for( i = store->update_begin; i < store->item_count; ++i )
+		store->item[ i ].parent = find_ancestry_parent( store, i );
+	
+	if( store->item_count > ( ( store->live_count * 2 ) + ANCESTRY_COMPACT_SLACK ) )
+		compact_ancestry_store( store );
+	
+	store->update_begin = store->item_count;
+	return;
+}
+
+
+
+/* find_ancestry_process() 
+Find a process in the process ancestry store.
+
+'pid' is the process id 
+'create_time' is the process creation time in FILETIME format
+
+returns the process' item or NULL if the process isn't in the store
+*/
+const struct ancestry_item *find_ancestry_process( 
+	const struct ancestry *const store,   // in
+	const unsigned __int64 pid,   // in
+	const __int64 create_time   // in
+)
+{
+	unsigned i = 0, slot = 0;
+	
+	FAIL_IF( !store );
+	
+	
+	for( slot = hash_ancestry_pid( store, pid );
+		store->slot[ slot ] && ( store->item[ store->slot[ slot ] - 1 ].pid != pid );
+		slot = ( slot + 1 ) & ( store->slot_max - 1 )
+	)
+		;
+	
+	for( i = store->slot[ slot ]; i; i = store->item[ i - 1 ].next_same_pid )
+	{
+		if( store->item[ i - 1 ].create_time == create_time )
+			return &store->item[ i - 1 ];
+	}
+	
+	return NULL;
+}
+
+
+
+/* print_ancestry_chain() 
+Print a process and its ancestors. No newline.
+
+'pid' is the process id 
+'create_time' is the process creation time in FILETIME format
+
+eg: notepad.exe (PID 1234) <- explorer.exe (PID 567) [exited] <- <unknown> (PID 89)
+*/
+void print_ancestry_chain( 
+	const struct ancestry *const store,   // in
+	const unsigned __int64 pid,   // in
+	const __int64 create_time   // in
+)
+{
+	unsigned depth = 0;
+	const struct ancestry_item *item = NULL;
+	
+	FAIL_IF( !store );
+	
+	
+	item = find_ancestry_process( store, pid, create_time );
+	if( !item )
+	{
+		printf( "<unknown> (PID %I64u)", pid );
+		return;
+	}
+	
+	for( depth = 0; depth < ANCESTRY_DEPTH_MAX; ++depth )
+	{
+		if( depth )
+			printf( " <- " );
+		
+		printf( "%ls (PID %I64u)", ( item->name ? item->name : L"<unknown>" ), item->pid );
+		
+		if( item->exit_time )
+			printf( " [exited]" );
+		
+		if( !item->parent )
+		{
+			if( item->parent_pid != item->pid )
+				printf( " <- <unknown> (PID %I64u)", item->parent_pid );
+			
+			return;
+		}
+		
+		item = &store->item[ item->parent - 1 ];
+	}
+	
+	printf( " <- ..." );
+	return;
+}
+
+
+
+/* print_ancestry_store() 
+Print a process ancestry store.
+
+if 'store' is NULL this function returns without having printed anything.
+*/
+void print_ancestry_store( 
+	const struct ancestry *const store   // in
+)
+{
+	unsigned i = 0;
+	const char *const objname = "Process Ancestry Store";
+	
+	
+	if( !store )
+		return;
+	
+	PRINT_DBLSEP_BEGIN( objname );
+	print_init_time( "store->init_time", store->init_time );
+	
+	printf( "store->item_max: %u\n", store->item_max );
+	printf( "store->item_count: %u\n", store->item_count );
+	printf( "store->slot_max: %u\n", store->slot_max );
+	printf( "store->generation: %u\n", store->generation );
+	printf( "store->live_count: %u\n", store->live_count );
+	printf( "store->compact_count: %u\n", store->compact_count );
+	
+	if( G->config->verbose >= 9 )
+	{
+		for( i = 0; i < store->item_count; ++i )
+		{
+			if( store->item[ i ].exit_time )
+				continue;
+			
+			print_ancestry_chain( store, store->item[ i ].pid, store->item[ i ].create_time );
+			printf( "\n" );
+		}
+	}
+	
+	PRINT_DBLSEP_END( objname );
+	
+	return;
+}
+
+
+
+/* free_ancestry_store() 
+Free a process ancestry store and all its descendants.
+
+this function then sets the ancestry store pointer to NULL and returns
+
+'in' is a pointer to a pointer to the ancestry store.
+if( !in || !*in ) then this function returns.
+*/
+void free_ancestry_store( 
+	struct ancestry **const in   // in deref
+)
+{
+	unsigned i = 0;
+	
+	
+	if( !in || !*in )
+		return;
+	
+	for( i = 0; i < (*in)->item_count; ++i )
+		free( (*in)->item[ i ].name );
+	
+	free( (*in)->item );
+	free( (*in)->slot );
+	
+	free( (*in) );
+	*in = NULL;
+	
+	return;
+}
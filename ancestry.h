@@ -0,0 +1,167 @@
+/*
+Copyright (C) 2011 Jay Satiro <raysatiro@yahoo.com>
+All rights reserved.
+
+This file is part of GetHooks.
+
+GetHooks is free software: you can redistribute it and/or modify 
+it under the terms of the GNU General Public License as published by 
+the Free Software Foundation, either version 3 of the License, or 
+(at your option) any later version.
+
+GetHooks is distributed in the hope that it will be useful, 
+but WITHOUT ANY WARRANTY; without even the implied warranty of 
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License 
+along with GetHooks.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _ANCESTRY_H
+#define _ANCESTRY_H
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include "portable.h"
+#endif
+
+/* SYSTEM_PROCESS_INFORMATION */
+#include "nt_independent_sysprocinfo_structs.h"
+
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/** This is the info kept for each process that has been seen in a snapshot.
+A process is identified by its id and its creation time since process ids are reused.
+*/
+struct ancestry_item
+{
+	/* the process id */
+	unsigned __int64 pid;
+	
+	/* the process creation time in FILETIME format */
+	__int64 create_time;
+	
+	/* the process id of the parent process as reported by the system.
+	the parent may have exited and its id may have been reused by an unrelated process.
+	*/
+	unsigned __int64 parent_pid;
+	
+	/* the parent process' index in the item array + 1, or 0 if the parent is unknown */
+	unsigned parent;
+	
+	/* the index + 1 of the next older item in the item array that has the same process id */
+	unsigned next_same_pid;
+	
+	/* the update generation in which the process was last seen */
+	unsigned generation;
+	
+	/* the system utc time in FILETIME format of the first update in which the process was not seen.
+	this is 0 if the process has not exited.
+	*/
+	__int64 exit_time;
+	
+	/* the process image name */
+	WCHAR *name;   // calloc(), free()
+};
+
+
+
+/** The process ancestry store.
+The process ancestry store holds a parent/child index of every process that has been seen. It's 
+updated during each snapshot's thread traversal.
+*/
+struct ancestry
+{
+	/* an array of ancestry items. items are appended in the order the processes are first seen */
+	struct ancestry_item *item;   // calloc(), free()
+	
+	/* the allocated/maximum number of elements in the item array */
+	unsigned item_max;
+	
+	/* the number of elements written to in the item array */
+	unsigned item_count;
+	
+	/* a hash table of process ids. each slot is 0 or the index + 1 of the newest item in the item 
+	array that has that process id. the number of slots is a power of 2.
+	*/
+	unsigned *slot;   // calloc(), free()
+	unsigned slot_max;
+	
+	/* the current update generation. see begin_ancestry_update() */
+	unsigned generation;
+	
+	/* the item count when the current update began. items at or after this index are new. */
+	unsigned update_begin;
+	
+	/* the number of processes that were seen in the last update */
+	unsigned live_count;
+	
+	/* the number of times the item array has been compacted */
+	unsigned compact_count;
+	
+	/* the system utc time in FILETIME format immediately after this store has been initialized.
+	this is nonzero when this store has been initialized.
+	*/
+	__int64 init_time;
+};
+
+
+
+/** 
+these functions are documented in the comment block above their definitions in ancestry.c
+*/
+void create_ancestry_store( 
+	struct ancestry **const out   // out deref
+);
+
+int init_ancestry_store( 
+	struct ancestry *const store   // in
+);
+
+void begin_ancestry_update( 
+	struct ancestry *const store   // in
+);
+
+void add_ancestry_process( 
+	struct ancestry *const store,   // in
+	const SYSTEM_PROCESS_INFORMATION *const spi   // in
+);
+
+void end_ancestry_update( 
+	struct ancestry *const store,   // in
+	const __int64 time   // in
+);
+
+const struct ancestry_item *find_ancestry_process( 
+	const struct ancestry *const store,   // in
+	const unsigned __int64 pid,   // in
+	const __int64 create_time   // in
+);
+
+void print_ancestry_chain( 
+	const struct ancestry *const store,   // in
+	const unsigned __int64 pid,   // in
+	const __int64 create_time   // in
+);
+
+void print_ancestry_store( 
+	const struct ancestry *const store   // in
+);
+
+void free_ancestry_store( 
+	struct ancestry **const in   // in deref
+);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _ANCESTRY_H
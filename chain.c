@@ -0,0 +1,798 @@
+/*
+Copyright (C) 2011 Jay Satiro <raysatiro@yahoo.com>
+All rights reserved.
+
+This file is part of GetHooks.
+
+GetHooks is free software: you can redistribute it and/or modify 
+it under the terms of the GNU General Public License as published by 
+the Free Software Foundation, either version 3 of the License, or 
+(at your option) any later version.
+
+GetHooks is distributed in the hope that it will be useful, 
+but WITHOUT ANY WARRANTY; without even the implied warranty of 
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License 
+along with GetHooks.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/** 
+This file contains functions for a chain store (HOOK chain integrity checks).
+Each function is documented in the comment block above its definition.
+
+A HOOK is linked to the next HOOK in its chain by its phkNext. The first HOOK of each global hook 
+chain is in the desktop's DESKTOPINFO.aphkStart. Each check makes a link for every HOOK in a 
+snapshot and resolves every phkNext using a hash table of the HOOKs' kernel addresses, so the 
+cost of a check is linear in the number of HOOKs instead of rescanning every HOOK for each link.
+
+-
+create_chain_store()
+
+Create a chain store and its descendants or die.
+-
+
+-
+init_chain_store()
+
+Initialize a chain store.
+-
+
+-
+hash_chain_pHead()
+
+Get the first slot in the hash table for a HOOK's kernel address.
+-
+
+-
+build_chain_links()
+
+Build a link for each HOOK in a snapshot and resolve each HOOK's next and previous link.
+-
+
+-
+find_chain_link()
+
+Find the link of a HOOK in the chain store.
+-
+
+-
+add_chain_finding()
+
+Add a finding to the current check.
+-
+
+-
+compare_chain_finding()
+
+Compare two chain findings by HOOK address and hook id.
+-
+
+-
+walk_desktop_chain()
+
+Walk a desktop's global hook chain from its aphkStart.
+-
+
+-
+check_chain_store()
+
+Check the integrity of the HOOK chains in a snapshot.
+-
+
+-
+print_chain_anomalies()
+
+Print the names of CHAIN_* anomalies. No newline.
+-
+
+-
+print_chain_report()
+
+Print the anomalies that were found in the last two checks.
+-
+
+-
+print_chain_store()
+
+Print a chain store.
+-
+
+-
+free_chain_store()
+
+Free a chain store and all its descendants.
+-
+
+*/
+
+#include <stdio.h>
+
+#include "util.h"
+
+#include "chain.h"
+
+/* the global stores */
+#include "global.h"
+
+
+
+/* the initial number of elements in the link array */
+#define CHAIN_LINKS_DEFAULT   1024
+
+
+
+static unsigned hash_chain_pHead( 
+	const struct chain *const store,   // in
+	const void *const pHead   // in
+);
+
+static void add_chain_finding( 
+	struct chain *const store,   // in
+	const void *const pHead,   // in
+	const unsigned anomalies,   // in
+	const struct desktop_item *const desktop,   // in
+	const INT iHook,   // in
+	const unsigned link   // in
+);
+
+static int compare_chain_finding( 
+	const void *const p1,   // in
+	const void *const p2   // in
+);
+
+static void walk_desktop_chain( 
+	struct chain *const store,   // in
+	const struct desktop_hook_item *const item,   // in
+	const int i   // in
+);
+
+static void print_chain_anomalies( 
+	const unsigned anomalies   // in
+);
+
+
+
+/* create_chain_store() 
+Create a chain store and its descendants or die.
+*/
+void create_chain_store( 
+	struct chain **const out   // out deref
+)
+{
+	struct chain *chain = NULL;
+	
+	FAIL_IF( !out );
+	FAIL_IF( *out );
+	
+	
+	/* allocate a chain store */
+	chain = must_calloc( 1, sizeof( *chain ) );
+	
+	chain->link_max = CHAIN_LINKS_DEFAULT;
+	chain->link = must_calloc( chain->link_max, sizeof( *chain->link ) );
+	
+	/* the hash table is kept at most half full */
+	chain->slot_max = CHAIN_LINKS_DEFAULT * 2;
+	chain->slot = must_calloc( chain->slot_max, sizeof( *chain->slot ) );
+	
+	/* there is at most a finding for each link and for each aphkStart */
+	chain->finding_max = CHAIN_LINKS_DEFAULT;
+	chain->finding = must_calloc( chain->finding_max, sizeof( *chain->finding ) );
+	
+	chain->previous_max = CHAIN_LINKS_DEFAULT;
+	chain->previous = must_calloc( chain->previous_max, sizeof( *chain->previous ) );
+	
+	
+	*out = chain;
+	return;
+}
+
+
+
+/* init_chain_store() 
+Initialize a chain store.
+
+The store is empty until the first check. See check_chain_store().
+
+returns nonzero on success
+*/
+int init_chain_store( 
+	struct chain *const store   // in
+)
+{
+	FAIL_IF( !store );
+	FAIL_IF( store->init_time );   // Fail if this store has already been initialized.
+	
+	
+	/* the chain store has been initialized */
+	GetSystemTimeAsFileTime( (FILETIME *)&store->init_time );
+	return TRUE;
+}
+
+
+
+/* hash_chain_pHead() 
+Get the first slot in the hash table for a HOOK's kernel address.
+
+returns the slot index
+*/
+static unsigned hash_chain_pHead( 
+	const struct chain *const store,   // in
+	const void *const pHead   // in
+)
+{
+	FAIL_IF( !store );
+	
+	
+	/* HOOKs are allocated from the desktop heap and are at least 8 byte aligned */
+	return ( (unsigned)( (uintptr_t)pHead >> 3 ) * 2654435761u ) & ( store->slot_max - 1 );
+}
+
+
+
+/* build_chain_links() 
+Build a link for each HOOK in a snapshot and resolve each HOOK's next and previous link.
+
+The links of the previous call are discarded. This function doesn't check the chains, it only 
+builds the links so that a chain can be followed in either direction. See check_chain_store().
+
+'snapshot' is the snapshot with the HOOKs. The snapshot must outlive the use of the links.
+*/
+void build_chain_links( 
+	struct chain *const store,   // in
+	const struct snapshot *const snapshot   // in
+)
+{
+	unsigned i = 0, count = 0;
+	const struct desktop_hook_item *item = NULL;
+	
+	FAIL_IF( !store );
+	FAIL_IF( !store->init_time );   // The chain store must be initialized.
+	FAIL_IF( !snapshot );
+	FAIL_IF( !snapshot->desktop_hooks );
+	
+	
+	for( item = snapshot->desktop_hooks->head; item; item = item->next )
+		count += item->hook_count;
+	
+	if( count > store->link_max )
+	{
+		free( store->link );
+		
+		for( store->link_max = CHAIN_LINKS_DEFAULT; store->link_max < count; store->link_max *= 2 )
+			;
+		
+		store->link = must_calloc( store->link_max, sizeof( *store->link ) );
+	}
+	
+	if( ( store->link_max * 2 ) > store->slot_max )
+	{
+		free( store->slot );
+		
+		store->slot_max = store->link_max * 2;
+		store->slot = must_calloc( store->slot_max, sizeof( *store->slot ) );
+	}
+	else
+		ZeroMemory( store->slot, store->slot_max * sizeof( *store->slot ) );
+	
+	ZeroMemory( store->link, store->link_max * sizeof( *store->link ) );
+	store->link_count = 0;
+	store->walk = 0;
+	
+	
+	/* make a link for each HOOK and add its kernel address to the hash table */
+	for( item = snapshot->desktop_hooks->head; item; item = item->next )
+	{
+		for( i = 0; i < item->hook_count; ++i )
+		{
+			const struct hook *const hook = &item->hook[ i ];
+			unsigned slot = 0;
+			
+			
+			for( slot = hash_chain_pHead( store, hook->entry.pHead );
+				store->slot[ slot ] 
+					&& ( store->link[ store->slot[ slot ] - 1 ].hook->entry.pHead != hook->entry.pHead );
+				slot = ( slot + 1 ) & ( store->slot_max - 1 )
+			)
+				;
+			
+			/* a HOOK has one handle entry. if it's seen again keep the first */
+			if( store->slot[ slot ] )
+				continue;
+			
+			store->link[ store->link_count ].hook = hook;
+			store->link[ store->link_count ].desktop = item->desktop;
+			store->slot[ slot ] = ++store->link_count;
+		}
+	}
+	
+	/* resolve the next link of each HOOK and count the HOOKs that point to each link */
+	for( i = 0; i < store->link_count; ++i )
+	{
+		struct chain_link *const link = &store->link[ i ];
+		
+		
+		if( !link->hook->object.phkNext )
+			continue;
+		
+		link->next = find_chain_link( store, link->hook->object.phkNext );
+		
+		if( !link->next )
+			continue;
+		
+		if( !store->link[ link->next - 1 ].prev )
+			store->link[ link->next - 1 ].prev = i + 1;
+		
+		++store->link[ link->next - 1 ].in_degree;
+	}
+	
+	return;
+}
+
+
+
+/* find_chain_link() 
+Find the link of a HOOK in the chain store.
+
+'pHead' is the kernel address of the HOOK.
+
+returns the index + 1 of the HOOK's link in the link array.
+returns 0 if there is no link for the HOOK.
+*/
+unsigned find_chain_link( 
+	const struct chain *const store,   // in
+	const void *const pHead   // in
+)
+{
+	unsigned slot = 0;
+	
+	FAIL_IF( !store );
+	
+	
+	if( !pHead )
+		return 0;
+	
+	for( slot = hash_chain_pHead( store, pHead );
+		store->slot[ slot ] && ( store->link[ store->slot[ slot ] - 1 ].hook->entry.pHead != pHead );
+		slot = ( slot + 1 ) & ( store->slot_max - 1 )
+	)
+		;
+	
+	return store->slot[ slot ];
+}
+
+
+
+/* add_chain_finding() 
+Add a finding to the current check.
+
+'link' is the index + 1 of the HOOK's link, or 0 if the finding is for an aphkStart.
+*/
+static void add_chain_finding( 
+	struct chain *const store,   // in
+	const void *const pHead,   // in
+	const unsigned anomalies,   // in
+	const struct desktop_item *const desktop,   // in
+	const INT iHook,   // in
+	const unsigned link   // in
+)
+{
+	struct chain_finding *finding = NULL;
+	
+	FAIL_IF( !store );
+	FAIL_IF( store->finding_count >= store->finding_max );
+	
+	
+	finding = &store->finding[ store->finding_count++ ];
+	
+	finding->pHead = pHead;
+	finding->anomalies = anomalies;
+	finding->confirmed = 0;
+	finding->desktop = desktop;
+	finding->iHook = iHook;
+	finding->link = link;
+	
+	return;
+}
+
+
+
+/* compare_chain_finding() 
+Compare two chain findings by HOOK address and hook id.
+
+This function is called by qsort() and bsearch().
+
+returns an integer that is less than, equal to, or greater than zero
+*/
+static int compare_chain_finding( 
+	const void *const p1,   // in
+	const void *const p2   // in
+)
+{
+	const struct chain_finding *const a = p1;
+	const struct chain_finding *const b = p2;
+	
+	
+	if( a->pHead != b->pHead )
+		return ( (uintptr_t)a->pHead < (uintptr_t)b->pHead ) ? -1 : 1;
+	
+	if( a->iHook != b->iHook )
+		return ( a->iHook < b->iHook ) ? -1 : 1;
+	
+	if( a->desktop != b->desktop )
+		return ( (uintptr_t)a->desktop < (uintptr_t)b->desktop ) ? -1 : 1;
+	
+	return 0;
+}
+
+
+
+/* walk_desktop_chain() 
+Walk a desktop's global hook chain from its aphkStart.
+
+'item' is the desktop hook item with the copy of the desktop's aphkStart.
+'i' is the index of the chain in aphkStart. the hook id of the chain is WH_MIN + i.
+
+Each HOOK reached is counted. The walk stops at a HOOK that was already reached by another walk, 
+because the rest of that chain has already been walked. That's also an anomaly, see 
+check_chain_store(). So no HOOK is walked more than once for each HOOK that points to it.
+*/
+static void walk_desktop_chain( 
+	struct chain *const store,   // in
+	const struct desktop_hook_item *const item,   // in
+	const int i   // in
+)
+{
+	unsigned index = 0, previous = 0;
+	
+	FAIL_IF( !store );
+	FAIL_IF( !item );
+	FAIL_IF( ( i < 0 ) || ( i >= CWINHOOKS ) );
+	
+	
+	if( !item->aphkStart[ i ] )
+		return;
+	
+	index = find_chain_link( store, item->aphkStart[ i ] );
+	
+	if( !index )
+	{
+		add_chain_finding( store, 
+			item->aphkStart[ i ], CHAIN_DANGLING, item->desktop, ( WH_MIN + i ), 0
+		);
+		return;
+	}
+	
+	++store->walk;
+	
+	for( ; index; previous = index, index = store->link[ index - 1 ].next )
+	{
+		struct chain_link *const link = &store->link[ index - 1 ];
+		
+		
+		/* the previous HOOK's phkNext leads back into this chain */
+		if( link->walk == store->walk )
+		{
+			store->link[ previous - 1 ].anomalies |= CHAIN_CYCLIC;
+			break;
+		}
+		
+		++link->reached;
+		
+		if( ( link->hook->object.iHook != ( WH_MIN + i ) ) 
+			|| !( link->hook->object.flags & HF_GLOBAL ) 
+			|| ( link->desktop != item->desktop )
+		)
+			link->anomalies |= CHAIN_MISPLACED;
+		
+		/* the rest of the chain was already walked */
+		if( link->walk )
+			break;
+		
+		link->walk = store->walk;
+	}
+	
+	return;
+}
+
+
+
+/* check_chain_store() 
+Check the integrity of the HOOK chains in a snapshot.
+
+'snapshot' is the snapshot with the HOOKs and the copy of each desktop's aphkStart.
+
+Every live global HOOK should be reached exactly once from the aphkStart of its desktop and hook 
+id. The anomalies of each HOOK are recorded as a finding. A finding is confirmed if the same 
+anomaly was also found for the same HOOK in the previous check. See print_chain_report().
+
+The cost of a check is linear in the number of HOOKs.
+*/
+void check_chain_store( 
+	struct chain *const store,   // in
+	const struct snapshot *const snapshot   // in
+)
+{
+	int j = 0;
+	unsigned i = 0, max = 0;
+	const struct desktop_hook_item *item = NULL;
+	
+	FAIL_IF( !store );
+	FAIL_IF( !store->init_time );   // The chain store must be initialized.
+	FAIL_IF( !snapshot );
+	FAIL_IF( !snapshot->desktop_hooks );
+	
+	
+	build_chain_links( store, snapshot );
+	++store->check_total;
+	
+	
+	/* the findings of the last check are the previous findings */
+	{
+		struct chain_finding *const temp = store->previous;
+		const unsigned temp_max = store->previous_max;
+		
+		store->previous = store->finding;
+		store->previous_max = store->finding_max;
+		store->previous_count = store->finding_count;
+		
+		store->finding = temp;
+		store->finding_max = temp_max;
+		store->finding_count = 0;
+	}
+	
+	/* there is at most a finding for each link and for each aphkStart */
+	max = store->link_count;
+	
+	for( item = snapshot->desktop_hooks->head; item; item = item->next )
+		max += CWINHOOKS;
+	
+	if( max > store->finding_max )
+	{
+		free( store->finding );
+		
+		store->finding_max = max;
+		store->finding = must_calloc( store->finding_max, sizeof( *store->finding ) );
+	}
+	
+	
+	/* find any cycles. a chain that isn't reachable from aphkStart can still be cyclic, like the 
+	chains of a thread's hooks. each link is walked at most once.
+	*/
+	for( i = 0; i < store->link_count; ++i )
+	{
+		unsigned index = 0, previous = 0;
+		
+		
+		if( store->link[ i ].walk )
+			continue;
+		
+		++store->walk;
+		
+		for( index = i + 1; index; previous = index, index = store->link[ index - 1 ].next )
+		{
+			struct chain_link *const link = &store->link[ index - 1 ];
+			
+			
+			if( link->walk == store->walk )
+			{
+				store->link[ previous - 1 ].anomalies |= CHAIN_CYCLIC;
+				break;
+			}
+			
+			if( link->walk )
+				break;
+			
+			link->walk = store->walk;
+		}
+	}
+	
+	for( i = 0; i < store->link_count; ++i )
+		store->link[ i ].walk = 0;
+	
+	
+	/* walk each desktop's global hook chains */
+	for( item = snapshot->desktop_hooks->head; item; item = item->next )
+	{
+		for( j = 0; j < CWINHOOKS; ++j )
+			walk_desktop_chain( store, item, j );
+	}
+	
+	
+	/* record the anomalies of each link */
+	for( i = 0; i < store->link_count; ++i )
+	{
+		struct chain_link *const link = &store->link[ i ];
+		const DWORD flags = link->hook->object.flags;
+		
+		
+		if( link->hook->object.phkNext && !link->next )
+			link->anomalies |= CHAIN_DANGLING;
+		
+		if( ( link->in_degree > 1 ) || ( link->reached > 1 ) )
+			link->anomalies |= CHAIN_DOUBLY_LINKED;
+		
+		if( ( flags & HF_GLOBAL ) && !( flags & HF_DESTROYED ) && !link->reached )
+			link->anomalies |= CHAIN_ORPHANED;
+		
+		if( link->anomalies )
+		{
+			add_chain_finding( store, 
+				link->hook->entry.pHead, link->anomalies, link->desktop, link->hook->object.iHook, i + 1
+			);
+		}
+	}
+	
+	
+	/* confirm the findings that were also found in the previous check */
+	qsort( store->finding, store->finding_count, sizeof( *store->finding ), compare_chain_finding );
+	
+	for( i = 0; i < store->finding_count; ++i )
+	{
+		struct chain_finding *const finding = &store->finding[ i ];
+		const struct chain_finding *const found = bsearch( finding, 
+			store->previous, store->previous_count, sizeof( *store->previous ), compare_chain_finding
+		);
+		
+		
+		if( found )
+			finding->confirmed = ( finding->anomalies & found->anomalies );
+		
+		++store->found_total;
+		
+		if( finding->confirmed )
+			++store->confirmed_total;
+	}
+	
+	return;
+}
+
+
+
+/* print_chain_anomalies() 
+Print the names of CHAIN_* anomalies. No newline.
+*/
+static void print_chain_anomalies( 
+	const unsigned anomalies   // in
+)
+{
+	if( anomalies & CHAIN_ORPHANED )
+		printf( " orphaned" );
+	
+	if( anomalies & CHAIN_CYCLIC )
+		printf( " cyclic" );
+	
+	if( anomalies & CHAIN_DOUBLY_LINKED )
+		printf( " doubly-linked" );
+	
+	if( anomalies & CHAIN_DANGLING )
+		printf( " dangling" );
+	
+	if( anomalies & CHAIN_MISPLACED )
+		printf( " misplaced" );
+	
+	return;
+}
+
+
+
+/* print_chain_report() 
+Print the anomalies that were found in the last two checks.
+
+A HOOK that the user filtered out isn't reported. An aphkStart that doesn't point to a live HOOK 
+is reported if its hook id is wanted.
+
+if 'store' is NULL or no anomaly was confirmed this function returns without having printed anything.
+*/
+void print_chain_report( 
+	const struct chain *const store   // in
+)
+{
+	unsigned i = 0, count = 0;
+	
+	
+	if( !store )
+		return;
+	
+	FAIL_IF( !store->init_time );   // The chain store must be initialized.
+	
+	
+	for( i = 0; i < store->finding_count; ++i )
+	{
+		const struct chain_finding *const finding = &store->finding[ i ];
+		const unsigned index = (unsigned)( finding->iHook + 1 ); /* the array index is the same as id + 1 */
+		
+		
+		if( !finding->confirmed )
+			continue;
+		
+		if( finding->link 
+			? store->link[ finding->link - 1 ].hook->ignore 
+			: !is_HOOK_id_wanted( finding->iHook )
+		)
+			continue;
+		
+		if( !count++ )
+			printf( "\nHOOK chain anomalies:\n" );
+		
+		printf( "%s ", ( finding->link ? "HOOK" : "aphkStart ->" ) );
+		PRINT_HEX_BARE( finding->pHead );
+		printf( "  %-20ls  desktop '%ls':", 
+			( ( index < w_hooknames_count ) ? w_hooknames[ index ] : L"<unknown>" ), 
+			finding->desktop->pwszDesktopName
+		);
+		print_chain_anomalies( finding->confirmed );
+		printf( "\n" );
+	}
+	
+	if( count )
+		fflush( stdout );
+	
+	return;
+}
+
+
+
+/* print_chain_store() 
+Print a chain store.
+
+if 'store' is NULL this function returns without having printed anything.
+*/
+void print_chain_store( 
+	const struct chain *const store   // in
+)
+{
+	const char *const objname = "Chain Store";
+	
+	
+	if( !store )
+		return;
+	
+	PRINT_DBLSEP_BEGIN( objname );
+	print_init_time( "store->init_time", store->init_time );
+	
+	printf( "store->link_count: %u\n", store->link_count );
+	printf( "store->link_max: %u\n", store->link_max );
+	printf( "store->slot_max: %u\n", store->slot_max );
+	printf( "store->finding_count: %u\n", store->finding_count );
+	printf( "store->finding_max: %u\n", store->finding_max );
+	printf( "store->previous_count: %u\n", store->previous_count );
+	printf( "store->previous_max: %u\n", store->previous_max );
+	printf( "store->check_total: %I64u\n", store->check_total );
+	printf( "store->found_total: %I64u\n", store->found_total );
+	printf( "store->confirmed_total: %I64u\n", store->confirmed_total );
+	
+	PRINT_DBLSEP_END( objname );
+	
+	return;
+}
+
+
+
+/* free_chain_store() 
+Free a chain store and all its descendants.
+
+this function then sets the chain store pointer to NULL and returns
+
+'in' is a pointer to a pointer to the chain store.
+if( !in || !*in ) then this function returns.
+*/
+void free_chain_store( 
+	struct chain **const in   // in deref
+)
+{
+	if( !in || !*in )
+		return;
+	
+	free( (*in)->link );
+	free( (*in)->slot );
+	free( (*in)->finding );
+	free( (*in)->previous );
+	
+	free( *in );
+	*in = NULL;
+	
+	return;
+}
@@ -0,0 +1,211 @@
+/*
+Copyright (C) 2011 Jay Satiro <raysatiro@yahoo.com>
+All rights reserved.
+
+This file is part of GetHooks.
+
+GetHooks is free software: you can redistribute it and/or modify 
+it under the terms of the GNU General Public License as published by 
+the Free Software Foundation, either version 3 of the License, or 
+(at your option) any later version.
+
+GetHooks is distributed in the hope that it will be useful, 
+but WITHOUT ANY WARRANTY; without even the implied warranty of 
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License 
+along with GetHooks.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _CHAIN_H
+#define _CHAIN_H
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include "portable.h"
+#endif
+
+/* snapshot store (system process info, gui threads, desktop hooks) */
+#include "snapshot.h"
+
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/** The anomalies that can be found in a HOOK chain.
+*/
+/* a live global HOOK that isn't reached from its desktop's aphkStart */
+#define CHAIN_ORPHANED   (1u)
+
+/* a HOOK whose phkNext leads back to a HOOK already in the same chain */
+#define CHAIN_CYCLIC   (1u << 1)
+
+/* a HOOK that the phkNext of more than one HOOK points to */
+#define CHAIN_DOUBLY_LINKED   (1u << 2)
+
+/* a HOOK whose phkNext, or an aphkStart, points to an address that isn't a live HOOK */
+#define CHAIN_DANGLING   (1u << 3)
+
+/* a HOOK reached from a desktop's aphkStart that isn't a global HOOK of that type on that desktop */
+#define CHAIN_MISPLACED   (1u << 4)
+
+
+
+/** This is the info kept for each HOOK in a snapshot that is checked.
+*/
+struct chain_link
+{
+	/* the hook info in the snapshot */
+	const struct hook *hook;
+	
+	/* the desktop the HOOK is on */
+	const struct desktop_item *desktop;
+	
+	/* the index + 1 of the link of the HOOK that phkNext points to.
+	0 if phkNext is NULL or doesn't point to a live HOOK.
+	*/
+	unsigned next;
+	
+	/* the index + 1 of the link of a HOOK whose phkNext points to this HOOK. 0 if none. */
+	unsigned prev;
+	
+	/* how many HOOKs' phkNext point to this HOOK */
+	unsigned in_degree;
+	
+	/* how many times this HOOK was reached walking the desktops' global hook chains */
+	unsigned reached;
+	
+	/* the last walk that reached this HOOK. used to detect a cycle */
+	unsigned walk;
+	
+	/* the CHAIN_* anomalies found */
+	unsigned anomalies;
+};
+
+
+
+/** This is the info kept for each anomaly found in a check.
+An anomaly is only reported if it's found in two consecutive checks. The HOOKs and the start of 
+the chains aren't read at exactly the same time and a HOOK that's being linked or unlinked can 
+look like an anomaly in a single check.
+*/
+struct chain_finding
+{
+	/* the kernel address of the HOOK, or the address an aphkStart points to if it's dangling */
+	const void *pHead;
+	
+	/* the CHAIN_* anomalies */
+	unsigned anomalies;
+	
+	/* the CHAIN_* anomalies that were also found in the previous check. these are reported. */
+	unsigned confirmed;
+	
+	/* the desktop and the hook id of the chain */
+	const struct desktop_item *desktop;
+	INT iHook;
+	
+	/* the index + 1 of the link in the current check. 0 if an aphkStart is dangling. */
+	unsigned link;
+};
+
+
+
+/** The chain store.
+The chain store checks the integrity of the HOOK chains in each snapshot. A link is made for every 
+HOOK and a hash table of their kernel addresses is built, so every phkNext is resolved in one pass.
+Then each desktop's global hook chains are walked from its aphkStart, which reaches each HOOK a 
+bounded number of times. The cost of a check is linear in the number of HOOKs.
+
+Only global hooks are linked from a desktop's aphkStart. The chains of a thread's hooks start in 
+its THREADINFO, which can't be read, so those are only checked for cycles and double links.
+*/
+struct chain
+{
+	/* an array of a link for each HOOK in the snapshot that was last checked */
+	struct chain_link *link;   // calloc(), free()
+	
+	/* the allocated/maximum number of elements in the link array */
+	unsigned link_max;
+	
+	/* the number of elements written to in the link array */
+	unsigned link_count;
+	
+	/* a hash table of the HOOKs' kernel addresses. each slot is 0 or the index + 1 of a link.
+	the number of slots is a power of 2 and the table is kept at most half full.
+	*/
+	unsigned *slot;   // calloc(), free()
+	unsigned slot_max;
+	
+	/* the number of chain walks. see the link's 'walk' member */
+	unsigned walk;
+	
+	/* arrays of the anomalies found in the current and the previous check, sorted by address */
+	struct chain_finding *finding;   // calloc(), free()
+	unsigned finding_max;
+	unsigned finding_count;
+	struct chain_finding *previous;   // calloc(), free()
+	unsigned previous_max;
+	unsigned previous_count;
+	
+	/* the number of checks, and how many findings had an anomaly found and confirmed */
+	unsigned __int64 check_total;
+	unsigned __int64 found_total;
+	unsigned __int64 confirmed_total;
+	
+	/* the system utc time in FILETIME format immediately after this store has been initialized.
+	this is nonzero when this store has been initialized.
+	*/
+	__int64 init_time;
+};
+
+
+
+/** 
+these functions are documented in the comment block above their definitions in chain.c
+*/
+void create_chain_store( 
+	struct chain **const out   // out deref
+);
+
+int init_chain_store( 
+	struct chain *const store   // in
+);
+
+void build_chain_links( 
+	struct chain *const store,   // in
+	const struct snapshot *const snapshot   // in
+);
+
+unsigned find_chain_link( 
+	const struct chain *const store,   // in
+	const void *const pHead   // in
+);
+
+void check_chain_store( 
+	struct chain *const store,   // in
+	const struct snapshot *const snapshot   // in
+);
+
+void print_chain_report( 
+	const struct chain *const store   // in
+);
+
+void print_chain_store( 
+	const struct chain *const store   // in
+);
+
+void free_chain_store( 
+	struct chain **const in   // in deref
+);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _CHAIN_H
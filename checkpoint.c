@@ -0,0 +1,1128 @@
+/*
+Copyright (C) 2011 Jay Satiro <raysatiro@yahoo.com>
+All rights reserved.
+
+This file is part of GetHooks.
+
+GetHooks is free software: you can redistribute it and/or modify 
+it under the terms of the GNU General Public License as published by 
+the Free Software Foundation, either version 3 of the License, or 
+(at your option) any later version.
+
+GetHooks is distributed in the hope that it will be useful, 
+but WITHOUT ANY WARRANTY; without even the implied warranty of 
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License 
+along with GetHooks.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/** 
+This file contains functions for a checkpoint store (warm state kept across snapshots and runs).
+Each function is documented in the comment block above its definition.
+
+The TEB address of a thread doesn't change during its lifetime and neither does its 
+Win32ThreadInfo once it's a GUI thread, so callback_add_gui() only has to open a process and read a 
+TEB for the threads that are new or whose cached info is due to be verified. The first time each 
+HOOK was found is kept as well. The store is written to a checkpoint file so that a restarted 
+program can reuse whatever in it is still valid, and the first snapshot after a restart costs 
+about the same as any other.
+
+-
+create_checkpoint_store()
+
+Create a checkpoint store and its descendants or die.
+-
+
+-
+hash_checkpoint_key()
+
+Get the first slot in a hash table for a thread id or a HOOK address.
+-
+
+-
+rebuild_checkpoint_thread_slots()
+
+Rebuild the hash table of thread ids from the thread array.
+-
+
+-
+rebuild_checkpoint_hook_slots()
+
+Rebuild the hash table of HOOK addresses from the hook array.
+-
+
+-
+read_checkpoint_file()
+
+Read the entries in the checkpoint file into the checkpoint store.
+-
+
+-
+ctrl_handler()
+
+The console control handler. Write the checkpoint file before the program is terminated.
+-
+
+-
+init_checkpoint_store()
+
+Initialize a checkpoint store by reading its checkpoint file, if there is one.
+-
+
+-
+begin_checkpoint_update()
+
+Begin an update of the thread entries.
+-
+
+-
+use_checkpoint_thread()
+
+Find a thread in the checkpoint store and mark it as seen.
+-
+
+-
+add_checkpoint_thread()
+
+Add or update a thread whose TEB was read.
+-
+
+-
+end_checkpoint_update()
+
+End an update of the thread entries.
+-
+
+-
+update_checkpoint_hooks()
+
+Update the hook entries from a snapshot.
+-
+
+-
+find_checkpoint_hook_time()
+
+Find the first time a HOOK was found.
+-
+
+-
+save_checkpoint_store()
+
+Write the checkpoint store to its checkpoint file.
+-
+
+-
+print_checkpoint_report()
+
+Print how much of the cached info was used.
+-
+
+-
+print_checkpoint_store()
+
+Print a checkpoint store.
+-
+
+-
+free_checkpoint_store()
+
+Free a checkpoint store and all its descendants.
+-
+
+*/
+
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <stdio.h>
+
+#include "util.h"
+
+#include "checkpoint.h"
+
+/* the global stores */
+#include "global.h"
+
+
+
+/* the default number of thread entries and hook entries allocated */
+#define CHECKPOINT_THREADS_DEFAULT   1024
+#define CHECKPOINT_HOOKS_DEFAULT   256
+
+/* the maximum number of thread entries and of hook entries. the arrays double up to this, so it's 
+a power of 2. a checkpoint file with more entries isn't valid.
+*/
+#define CHECKPOINT_ENTRIES_MAX   ( 1u << 20 )
+
+
+
+static unsigned hash_checkpoint_key( 
+	const UINT64 key,   // in
+	const unsigned shift,   // in
+	const unsigned slot_max   // in
+);
+
+static void rebuild_checkpoint_thread_slots( 
+	struct checkpoint *const store   // in
+);
+
+static void rebuild_checkpoint_hook_slots( 
+	struct checkpoint *const store   // in
+);
+
+static void read_checkpoint_file( 
+	struct checkpoint *const store   // in
+);
+
+static BOOL WINAPI ctrl_handler( 
+	DWORD dwCtrlType   // in
+);
+
+
+
+/* create_checkpoint_store() 
+Create a checkpoint store and its descendants or die.
+*/
+void create_checkpoint_store( 
+	struct checkpoint **const out   // out deref
+)
+{
+	struct checkpoint *checkpoint = NULL;
+	
+	FAIL_IF( !out );
+	FAIL_IF( *out );
+	
+	
+	/* allocate a checkpoint store */
+	checkpoint = must_calloc( 1, sizeof( *checkpoint ) );
+	
+	checkpoint->thread_max = CHECKPOINT_THREADS_DEFAULT;
+	checkpoint->thread = must_calloc( checkpoint->thread_max, sizeof( *checkpoint->thread ) );
+	
+	checkpoint->hook_max = CHECKPOINT_HOOKS_DEFAULT;
+	checkpoint->hook = must_calloc( checkpoint->hook_max, sizeof( *checkpoint->hook ) );
+	
+	/* the hash tables are kept at most half full */
+	checkpoint->thread_slot_max = CHECKPOINT_THREADS_DEFAULT * 2;
+	checkpoint->thread_slot = 
+		must_calloc( checkpoint->thread_slot_max, sizeof( *checkpoint->thread_slot ) );
+	
+	checkpoint->hook_slot_max = CHECKPOINT_HOOKS_DEFAULT * 2;
+	checkpoint->hook_slot = must_calloc( checkpoint->hook_slot_max, sizeof( *checkpoint->hook_slot ) );
+	
+	InitializeCriticalSection( &checkpoint->cs );
+	
+	
+	*out = checkpoint;
+	return;
+}
+
+
+
+/* hash_checkpoint_key() 
+Get the first slot in a hash table for a thread id or a HOOK address.
+
+Thread ids are multiples of 4 and HOOK addresses are multiples of 8, so the low bits are dropped.
+
+'shift' is the number of low bits to drop: 2 for a thread id or 3 for a HOOK address.
+'slot_max' is the number of slots in the hash table. It must be a power of 2.
+
+returns the slot index
+*/
+static unsigned hash_checkpoint_key( 
+	const UINT64 key,   // in
+	const unsigned shift,   // in
+	const unsigned slot_max   // in
+)
+{
+	return ( (unsigned)( key >> shift ) * 2654435761u ) & ( slot_max - 1 );
+}
+
+
+
+/* rebuild_checkpoint_thread_slots() 
+Rebuild the hash table of thread ids from the thread array.
+
+If the hash table would be more than half full its size is doubled first.
+*/
+static void rebuild_checkpoint_thread_slots( 
+	struct checkpoint *const store   // in
+)
+{
+	unsigned i = 0;
+	
+	FAIL_IF( !store );
+	
+	
+	if( ( store->thread_count * 2 ) > store->thread_slot_max )
+	{
+		while( ( store->thread_count * 2 ) > store->thread_slot_max )
+			store->thread_slot_max *= 2;
+		
+		free( store->thread_slot );
+		store->thread_slot = must_calloc( store->thread_slot_max, sizeof( *store->thread_slot ) );
+	}
+	else
+		ZeroMemory( store->thread_slot, store->thread_slot_max * sizeof( *store->thread_slot ) );
+	
+	for( i = 0; i < store->thread_count; ++i )
+	{
+		unsigned slot = 0;
+		
+		
+		for( slot = hash_checkpoint_key( store->thread[ i ].tid, 2, store->thread_slot_max );
+			store->thread_slot[ slot ];
+			slot = ( slot + 1 ) & ( store->thread_slot_max - 1 )
+		)
+			;
+		
+		store->thread_slot[ slot ] = i + 1;
+	}
+	
+	return;
+}
+
+
+
+/* rebuild_checkpoint_hook_slots() 
+Rebuild the hash table of HOOK addresses from the hook array.
+
+If the hash table would be more than half full its size is doubled first.
+*/
+static void rebuild_checkpoint_hook_slots( 
+	struct checkpoint *const store   // in
+)
+{
+	unsigned i = 0;
+	
+	FAIL_IF( !store );
+	
+	
+	if( ( store->hook_count * 2 ) > store->hook_slot_max )
+	{
+		while( ( store->hook_count * 2 ) > store->hook_slot_max )
+			store->hook_slot_max *= 2;
+		
+		free( store->hook_slot );
+		store->hook_slot = must_calloc( store->hook_slot_max, sizeof( *store->hook_slot ) );
+	}
+	else
+		ZeroMemory( store->hook_slot, store->hook_slot_max * sizeof( *store->hook_slot ) );
+	
+	for( i = 0; i < store->hook_count; ++i )
+	{
+		unsigned slot = 0;
+		
+		
+		for( slot = hash_checkpoint_key( store->hook[ i ].pHead, 3, store->hook_slot_max );
+			store->hook_slot[ slot ];
+			slot = ( slot + 1 ) & ( store->hook_slot_max - 1 )
+		)
+			;
+		
+		store->hook_slot[ slot ] = i + 1;
+	}
+	
+	return;
+}
+
+
+
+/* read_checkpoint_file() 
+Read the entries in the checkpoint file into the checkpoint store.
+
+A checkpoint file that doesn't exist isn't an error. A checkpoint file that was written by a 
+program with a different pointer size or on a different version of Windows is ignored, and so is a 
+checkpoint file that can't be read or isn't valid: its size must match the counts in its header.
+The checkpoint is only an optimization, so in any of those cases the program starts cold.
+
+The generations written to the file are from the program that wrote it. Each thread entry's 
+generation is set to 0 so that it's dropped after the first snapshot if its thread isn't found, and 
+the snapshots in which the entries are verified are spread over the next 
+CHECKPOINT_VERIFY_SNAPSHOTS snapshots so that the cached threads aren't all read again at once.
+*/
+static void read_checkpoint_file( 
+	struct checkpoint *const store   // in
+)
+{
+	unsigned i = 0;
+	__int64 bcount = 0;
+	FILE *fp = NULL;
+	struct checkpoint_header header;
+	
+	FAIL_IF( !G );   // The global store must exist.
+	FAIL_IF( !G->prog->init_time );   // The program store must be initialized.
+	
+	FAIL_IF( !store );
+	FAIL_IF( !store->pwszFile );
+	
+	
+	fp = _wfopen( store->pwszFile, L"rb" );
+	if( !fp )
+	{
+		if( G->config->verbose >= 1 )
+			printf( "The checkpoint file doesn't exist yet. Starting cold.\n" );
+		
+		return;
+	}
+	
+	if( !_fseeki64( fp, 0, SEEK_END ) )
+		bcount = _ftelli64( fp );
+	
+	if( ( bcount < (__int64)sizeof( header ) ) 
+		|| _fseeki64( fp, 0, SEEK_SET ) 
+		|| ( fread( &header, sizeof( header ), 1, fp ) != 1 ) 
+		|| memcmp( header.magic, CHECKPOINT_MAGIC, CHECKPOINT_MAGIC_LEN ) 
+		|| ( header.version != CHECKPOINT_VERSION ) 
+		|| ( header.header_bcount != sizeof( header ) )
+	)
+	{
+		MSG_WARNING( "The checkpoint file is not valid. Ignoring it and starting cold." );
+		printf( "file: %ls\n", store->pwszFile );
+		goto cleanup;
+	}
+	
+	if( ( header.pointer_bcount != sizeof( void * ) ) 
+		|| ( header.os_version != G->prog->dwOSVersion )
+	)
+	{
+		MSG_WARNING( "The checkpoint file was written by a different build or system. Ignoring it." );
+		printf( "file: %ls\n", store->pwszFile );
+		goto cleanup;
+	}
+	
+	/* the counts are checked against the size of the file before any memory is allocated for them */
+	if( ( header.thread_count > CHECKPOINT_ENTRIES_MAX ) 
+		|| ( header.hook_count > CHECKPOINT_ENTRIES_MAX ) 
+		|| ( (UINT64)( bcount - sizeof( header ) )
+			!= ( ( (UINT64)header.thread_count * sizeof( *store->thread ) ) 
+				+ ( (UINT64)header.hook_count * sizeof( *store->hook ) )
+			)
+		)
+	)
+	{
+		MSG_WARNING( "The checkpoint file is truncated or corrupt. Ignoring it and starting cold." );
+		printf( "file: %ls\n", store->pwszFile );
+		printf( "thread_count: %lu, hook_count: %lu, file size: %I64d\n", 
+			header.thread_count, 
+			header.hook_count, 
+			bcount
+		);
+		goto cleanup;
+	}
+	
+	/* the counts are at most CHECKPOINT_ENTRIES_MAX, which the doubling doesn't pass */
+	if( header.thread_count > store->thread_max )
+	{
+		while( header.thread_count > store->thread_max )
+			store->thread_max *= 2;
+		
+		free( store->thread );
+		store->thread = must_calloc( store->thread_max, sizeof( *store->thread ) );
+	}
+	
+	if( header.hook_count > store->hook_max )
+	{
+		while( header.hook_count > store->hook_max )
+			store->hook_max *= 2;
+		
+		free( store->hook );
+		store->hook = must_calloc( store->hook_max, sizeof( *store->hook ) );
+	}
+	
+	if( ( fread( store->thread, sizeof( *store->thread ), header.thread_count, fp )
+			!= header.thread_count ) 
+		|| ( fread( store->hook, sizeof( *store->hook ), header.hook_count, fp )
+			!= header.hook_count )
+	)
+	{
+		MSG_WARNING( "The checkpoint file could not be read. Ignoring it and starting cold." );
+		printf( "file: %ls\n", store->pwszFile );
+		
+		ZeroMemory( store->thread, store->thread_max * sizeof( *store->thread ) );
+		ZeroMemory( store->hook, store->hook_max * sizeof( *store->hook ) );
+		goto cleanup;
+	}
+	
+	for( i = 0; i < header.thread_count; ++i )
+	{
+		store->thread[ i ].generation = 0;
+		store->thread[ i ].verified = 0 - ( i % CHECKPOINT_VERIFY_SNAPSHOTS );
+	}
+	
+	for( i = 0; i < header.hook_count; ++i )
+		store->hook[ i ].generation = 0;
+	
+	store->thread_count = store->loaded_threads = header.thread_count;
+	store->hook_count = store->loaded_hooks = header.hook_count;
+	
+	rebuild_checkpoint_thread_slots( store );
+	rebuild_checkpoint_hook_slots( store );
+	
+	store->save_time = header.save_time;
+	
+cleanup:
+	fclose( fp );
+	return;
+}
+
+
+
+/* ctrl_handler() 
+The console control handler. Write the checkpoint file before the program is terminated.
+
+This function is called on another thread when the user presses CTRL+C or closes the console, or 
+when the user logs off or the system shuts down.
+
+returns FALSE so that the next handler, which by default terminates the program, is called
+*/
+static BOOL WINAPI ctrl_handler( 
+	DWORD dwCtrlType   // in
+)
+{
+	if( G && G->checkpoint && G->checkpoint->init_time )
+		save_checkpoint_store( G->checkpoint );
+	
+	return FALSE;
+}
+
+
+
+/* init_checkpoint_store() 
+Initialize a checkpoint store by reading its checkpoint file, if there is one.
+
+'pwszFile' is the checkpoint file. It's written by save_checkpoint_store().
+
+returns nonzero on success
+*/
+int init_checkpoint_store( 
+	struct checkpoint *const store,   // in
+	const WCHAR *const pwszFile   // in
+)
+{
+	FAIL_IF( !store );
+	FAIL_IF( !pwszFile );
+	FAIL_IF( store->init_time );   // Fail if this store has already been initialized.
+	
+	
+	store->pwszFile = must_wcsdup( pwszFile );
+	
+	/* a checkpoint file that can't be used is ignored */
+	read_checkpoint_file( store );
+	
+	if( !SetConsoleCtrlHandler( ctrl_handler, TRUE ) )
+	{
+		MSG_ERROR_GLE( "SetConsoleCtrlHandler() failed." );
+		return FALSE;
+	}
+	
+	
+	/* the checkpoint store has been initialized */
+	GetSystemTimeAsFileTime( (FILETIME *)&store->init_time );
+	return TRUE;
+}
+
+
+
+/* begin_checkpoint_update() 
+Begin an update of the thread entries.
+
+Call this before traversing the threads. Each thread seen during the traversal is passed to 
+use_checkpoint_thread(), and to add_checkpoint_thread() if its TEB is read. If the traversal is 
+retried this function can be called again.
+*/
+void begin_checkpoint_update( 
+	struct checkpoint *const store   // in
+)
+{
+	FAIL_IF( !store );
+	FAIL_IF( !store->init_time );   // The checkpoint store must be initialized.
+	
+	
+	++store->generation;
+	
+	store->read_count = 0;
+	store->cached_count = 0;
+	
+	return;
+}
+
+
+
+/* use_checkpoint_thread() 
+Find a thread in the checkpoint store and mark it as seen.
+
+'spi' and 'sti' are the system process and thread info of a thread seen in the current update.
+
+The entry's TEB address can be used. Its Win32ThreadInfo and desktop can be used if its 
+Win32ThreadInfo is nonzero and CHECKPOINT_VERIFY_DUE() is false, otherwise the TEB must be read 
+again. The entry must not be used after add_checkpoint_thread() is called.
+
+returns the thread's entry or NULL if the thread isn't in the store
+*/
+const struct checkpoint_thread *use_checkpoint_thread( 
+	struct checkpoint *const store,   // in
+	const SYSTEM_PROCESS_INFORMATION *const spi,   // in
+	const SYSTEM_THREAD_INFORMATION *const sti   // in
+)
+{
+	unsigned slot = 0;
+	const UINT64 tid = (uintptr_t)sti->ClientId.UniqueThread;
+	
+	FAIL_IF( !store );
+	FAIL_IF( !store->init_time );   // The checkpoint store must be initialized.
+	FAIL_IF( !spi );
+	FAIL_IF( !sti );
+	
+	
+	for( slot = hash_checkpoint_key( tid, 2, store->thread_slot_max );
+		store->thread_slot[ slot ];
+		slot = ( slot + 1 ) & ( store->thread_slot_max - 1 )
+	)
+	{
+		struct checkpoint_thread *const thread = &store->thread[ store->thread_slot[ slot ] - 1 ];
+		
+		
+		if( ( thread->tid != tid ) 
+			|| ( thread->create_time != sti->CreateTime.QuadPart ) 
+			|| ( thread->pid != (uintptr_t)spi->UniqueProcessId ) 
+			|| ( thread->process_create_time != spi->CreateTime.QuadPart )
+		)
+			continue;
+		
+		/* the thread was read from the checkpoint file and this is the first time it's been seen */
+		if( !thread->generation )
+			++store->reused_threads;
+		
+		thread->generation = store->generation;
+		
+		if( thread->pvWin32ThreadInfo && !CHECKPOINT_VERIFY_DUE( store, thread ) )
+			++store->cached_count;
+		
+		return thread;
+	}
+	
+	return NULL;
+}
+
+
+
+/* add_checkpoint_thread() 
+Add or update a thread whose TEB was read.
+
+'spi' and 'sti' are the system process and thread info of a thread seen in the current update.
+'pvTeb' is the thread's TEB address.
+'pvWin32ThreadInfo' is the thread's Win32ThreadInfo, or NULL if it isn't a GUI thread.
+'desktop_key' is the kernel address of the thread's DESKTOPINFO, or 0 if it's unknown.
+
+A new thread is due to be verified after a number of snapshots that depends on its thread id, so 
+that the threads added in the same snapshot aren't all verified in the same snapshot.
+*/
+void add_checkpoint_thread( 
+	struct checkpoint *const store,   // in
+	const SYSTEM_PROCESS_INFORMATION *const spi,   // in
+	const SYSTEM_THREAD_INFORMATION *const sti,   // in
+	const void *const pvTeb,   // in
+	const void *const pvWin32ThreadInfo,   // in, optional
+	const UINT64 desktop_key   // in, optional
+)
+{
+	unsigned slot = 0;
+	const UINT64 tid = (uintptr_t)sti->ClientId.UniqueThread;
+	struct checkpoint_thread *thread = NULL;
+	
+	FAIL_IF( !store );
+	FAIL_IF( !store->init_time );   // The checkpoint store must be initialized.
+	FAIL_IF( !spi );
+	FAIL_IF( !sti );
+	FAIL_IF( !pvTeb );
+	
+	
+	EnterCriticalSection( &store->cs );
+	
+	++store->read_count;
+	
+	for( slot = hash_checkpoint_key( tid, 2, store->thread_slot_max );
+		store->thread_slot[ slot ];
+		slot = ( slot + 1 ) & ( store->thread_slot_max - 1 )
+	)
+	{
+		thread = &store->thread[ store->thread_slot[ slot ] - 1 ];
+		
+		if( ( thread->tid == tid ) 
+			&& ( thread->create_time == sti->CreateTime.QuadPart ) 
+			&& ( thread->pid == (uintptr_t)spi->UniqueProcessId ) 
+			&& ( thread->process_create_time == spi->CreateTime.QuadPart )
+		)
+			break;
+		
+		thread = NULL;
+	}
+	
+	if( thread )
+		thread->verified = store->generation;
+	else
+	{
+		/* the thread isn't in the store. if the thread array is full double its size, unless it's 
+		at the maximum size. then the thread isn't cached.
+		*/
+		if( store->thread_count == CHECKPOINT_ENTRIES_MAX )
+		{
+			LeaveCriticalSection( &store->cs );
+			return;
+		}
+		
+		if( store->thread_count == store->thread_max )
+		{
+			struct checkpoint_thread *const temp = 
+				must_calloc( store->thread_max * 2, sizeof( *temp ) );
+			
+			memcpy( temp, store->thread, store->thread_max * sizeof( *temp ) );
+			free( store->thread );
+			
+			store->thread = temp;
+			store->thread_max *= 2;
+		}
+		
+		thread = &store->thread[ store->thread_count ];
+		
+		thread->tid = tid;
+		thread->create_time = sti->CreateTime.QuadPart;
+		thread->pid = (uintptr_t)spi->UniqueProcessId;
+		thread->process_create_time = spi->CreateTime.QuadPart;
+		thread->verified = 
+			store->generation - (unsigned)( ( tid >> 2 ) % CHECKPOINT_VERIFY_SNAPSHOTS );
+		
+		store->thread_slot[ slot ] = ++store->thread_count;
+		
+		/* if the hash table is more than half full double its size and rehash */
+		if( ( store->thread_count * 2 ) > store->thread_slot_max )
+			rebuild_checkpoint_thread_slots( store );
+	}
+	
+	thread->pvTeb = (uintptr_t)pvTeb;
+	thread->pvWin32ThreadInfo = (uintptr_t)pvWin32ThreadInfo;
+	thread->desktop_key = desktop_key;
+	thread->generation = store->generation;
+	
+	LeaveCriticalSection( &store->cs );
+	return;
+}
+
+
+
+/* end_checkpoint_update() 
+End an update of the thread entries.
+
+Call this after the threads have been traversed successfully. The entries of the threads that 
+weren't seen in this update are removed.
+*/
+void end_checkpoint_update( 
+	struct checkpoint *const store   // in
+)
+{
+	unsigned i = 0, count = 0;
+	
+	FAIL_IF( !store );
+	FAIL_IF( !store->init_time );   // The checkpoint store must be initialized.
+	
+	
+	EnterCriticalSection( &store->cs );
+	
+	for( i = 0; i < store->thread_count; ++i )
+	{
+		if( store->thread[ i ].generation != store->generation )
+			continue;
+		
+		if( count != i )
+			store->thread[ count ] = store->thread[ i ];
+		
+		++count;
+	}
+	
+	if( count != store->thread_count )
+	{
+		ZeroMemory( &store->thread[ count ], 
+			( store->thread_count - count ) * sizeof( *store->thread )
+		);
+		store->thread_count = count;
+		
+		rebuild_checkpoint_thread_slots( store );
+	}
+	
+	LeaveCriticalSection( &store->cs );
+	return;
+}
+
+
+
+/* update_checkpoint_hooks() 
+Update the hook entries from a snapshot.
+
+'snapshot' is the snapshot that was just taken.
+
+Each HOOK in the snapshot that isn't in the store is added with the time of the snapshot as the 
+first time it was found. The entry of a HOOK that wasn't found is kept for one more update so that 
+its first time can be printed when it's reported as removed.
+*/
+void update_checkpoint_hooks( 
+	struct checkpoint *const store,   // in
+	const struct snapshot *const snapshot   // in
+)
+{
+	unsigned i = 0, count = 0;
+	const struct desktop_hook_item *dh = NULL;
+	
+	FAIL_IF( !store );
+	FAIL_IF( !store->init_time );   // The checkpoint store must be initialized.
+	FAIL_IF( !snapshot );
+	FAIL_IF( !snapshot->desktop_hooks );
+	
+	
+	EnterCriticalSection( &store->cs );
+	
+	++store->hook_generation;
+	
+	/* remove the entries of the HOOKs that weren't found in the last update */
+	for( i = 0; i < store->hook_count; ++i )
+	{
+		if( ( store->hook[ i ].generation + 1 ) < store->hook_generation )
+			continue;
+		
+		if( count != i )
+			store->hook[ count ] = store->hook[ i ];
+		
+		++count;
+	}
+	
+	if( count != store->hook_count )
+	{
+		ZeroMemory( &store->hook[ count ], ( store->hook_count - count ) * sizeof( *store->hook ) );
+		store->hook_count = count;
+		
+		rebuild_checkpoint_hook_slots( store );
+	}
+	
+	for( dh = snapshot->desktop_hooks->head; dh; dh = dh->next )
+	{
+		for( i = 0; i < dh->hook_count; ++i )
+		{
+			unsigned slot = 0;
+			const UINT64 pHead = (uintptr_t)dh->hook[ i ].entry.pHead;
+			const UINT64 handle = (uintptr_t)dh->hook[ i ].object.head.h;
+			const UINT64 pti = (uintptr_t)dh->hook[ i ].object.pti;
+			struct checkpoint_hook *hook = NULL;
+			
+			
+			for( slot = hash_checkpoint_key( pHead, 3, store->hook_slot_max );
+				store->hook_slot[ slot ];
+				slot = ( slot + 1 ) & ( store->hook_slot_max - 1 )
+			)
+			{
+				hook = &store->hook[ store->hook_slot[ slot ] - 1 ];
+				
+				if( ( hook->pHead == pHead ) && ( hook->handle == handle ) && ( hook->pti == pti ) )
+					break;
+				
+				hook = NULL;
+			}
+			
+			if( hook )
+			{
+				/* the hook was read from the checkpoint file and this is the first time it's been found */
+				if( !hook->generation )
+					++store->reused_hooks;
+				
+				hook->generation = store->hook_generation;
+				continue;
+			}
+			
+			/* the hook isn't in the store. if the hook array is full double its size, unless it's 
+			at the maximum size. then the hook isn't kept.
+			*/
+			if( store->hook_count == CHECKPOINT_ENTRIES_MAX )
+				continue;
+			
+			if( store->hook_count == store->hook_max )
+			{
+				struct checkpoint_hook *const temp = must_calloc( store->hook_max * 2, sizeof( *temp ) );
+				
+				memcpy( temp, store->hook, store->hook_max * sizeof( *temp ) );
+				free( store->hook );
+				
+				store->hook = temp;
+				store->hook_max *= 2;
+			}
+			
+			hook = &store->hook[ store->hook_count ];
+			
+			hook->pHead = pHead;
+			hook->handle = handle;
+			hook->pti = pti;
+			hook->first_time = snapshot->desktop_hooks->init_time;
+			hook->generation = store->hook_generation;
+			
+			store->hook_slot[ slot ] = ++store->hook_count;
+			
+			/* if the hash table is more than half full double its size and rehash */
+			if( ( store->hook_count * 2 ) > store->hook_slot_max )
+				rebuild_checkpoint_hook_slots( store );
+		}
+	}
+	
+	LeaveCriticalSection( &store->cs );
+	return;
+}
+
+
+
+/* find_checkpoint_hook_time() 
+Find the first time a HOOK was found.
+
+'hook' is the hook info of a HOOK in the last snapshot or the one before it.
+
+returns the first time the HOOK was found in FILETIME format, or 0 if the HOOK isn't in the store
+*/
+__int64 find_checkpoint_hook_time( 
+	const struct checkpoint *const store,   // in
+	const struct hook *const hook   // in
+)
+{
+	unsigned slot = 0;
+	const UINT64 pHead = (uintptr_t)hook->entry.pHead;
+	
+	FAIL_IF( !store );
+	FAIL_IF( !store->init_time );   // The checkpoint store must be initialized.
+	FAIL_IF( !hook );
+	
+	
+	for( slot = hash_checkpoint_key( pHead, 3, store->hook_slot_max );
+		store->hook_slot[ slot ];
+		slot = ( slot + 1 ) & ( store->hook_slot_max - 1 )
+	)
+	{
+		const struct checkpoint_hook *const item = &store->hook[ store->hook_slot[ slot ] - 1 ];
+		
+		
+		if( ( item->pHead == pHead ) 
+			&& ( item->handle == (uintptr_t)hook->object.head.h ) 
+			&& ( item->pti == (uintptr_t)hook->object.pti )
+		)
+			return item->first_time;
+	}
+	
+	return 0;
+}
+
+
+
+/* save_checkpoint_store() 
+Write the checkpoint store to its checkpoint file.
+
+The entries are written to a temporary file that then replaces the checkpoint file, so that the 
+checkpoint file is always complete even if the program is terminated while it's being written.
+
+This function can be called from any thread.
+
+returns nonzero on success
+*/
+int save_checkpoint_store( 
+	struct checkpoint *const store   // in
+)
+{
+	int ret = FALSE;
+	FILE *fp = NULL;
+	WCHAR *pwszTemp = NULL;
+	struct checkpoint_header header;
+	
+	FAIL_IF( !G );   // The global store must exist.
+	FAIL_IF( !G->prog->init_time );   // The program store must be initialized.
+	
+	FAIL_IF( !store );
+	FAIL_IF( !store->init_time );   // The checkpoint store must be initialized.
+	
+	
+	EnterCriticalSection( &store->cs );
+	
+	pwszTemp = must_calloc( wcslen( store->pwszFile ) + 5, sizeof( WCHAR ) );
+	wcscpy( pwszTemp, store->pwszFile );
+	wcscat( pwszTemp, L".tmp" );
+	
+	fp = _wfopen( pwszTemp, L"wb" );
+	if( !fp )
+	{
+		MSG_ERROR( "_wfopen() failed." );
+		printf( "file: %ls\n", pwszTemp );
+		goto cleanup;
+	}
+	
+	ZeroMemory( &header, sizeof( header ) );
+	
+	memcpy( header.magic, CHECKPOINT_MAGIC, CHECKPOINT_MAGIC_LEN );
+	header.version = CHECKPOINT_VERSION;
+	header.header_bcount = sizeof( header );
+	header.pointer_bcount = sizeof( void * );
+	header.os_version = G->prog->dwOSVersion;
+	GetSystemTimeAsFileTime( (FILETIME *)&header.save_time );
+	header.thread_count = store->thread_count;
+	header.hook_count = store->hook_count;
+	
+	if( ( fwrite( &header, sizeof( header ), 1, fp ) != 1 ) 
+		|| ( fwrite( store->thread, sizeof( *store->thread ), store->thread_count, fp )
+			!= store->thread_count ) 
+		|| ( fwrite( store->hook, sizeof( *store->hook ), store->hook_count, fp )
+			!= store->hook_count ) 
+		|| fflush( fp )
+	)
+	{
+		MSG_ERROR( "Failed to write the checkpoint file." );
+		printf( "file: %ls\n", pwszTemp );
+		goto cleanup;
+	}
+	
+	fclose( fp );
+	fp = NULL;
+	
+	if( !MoveFileExW( pwszTemp, store->pwszFile, MOVEFILE_REPLACE_EXISTING ) )
+	{
+		MSG_ERROR_GLE( "MoveFileExW() failed." );
+		printf( "file: %ls\n", store->pwszFile );
+		goto cleanup;
+	}
+	
+	store->save_time = header.save_time;
+	++store->save_count;
+	
+	ret = TRUE;
+
+cleanup:
+	if( fp )
+		fclose( fp );
+	
+	free( pwszTemp );
+	
+	LeaveCriticalSection( &store->cs );
+	return ret;
+}
+
+
+
+/* print_checkpoint_report() 
+Print how much of the cached info was used.
+
+The number of entries read from the checkpoint file that were still valid is printed after the 
+first snapshot, and the number of TEBs read and cached in the last snapshot after every snapshot.
+
+if 'store' is NULL this function returns without having printed anything.
+*/
+void print_checkpoint_report( 
+	const struct checkpoint *const store   // in
+)
+{
+	if( !store )
+		return;
+	
+	FAIL_IF( !store->init_time );   // The checkpoint store must be initialized.
+	
+	
+	if( ( store->generation == 1 ) && ( store->loaded_threads || store->loaded_hooks ) )
+	{
+		printf( "\nCheckpoint: reused %u of %u threads and %u of %u hooks from '%ls'.\n", 
+			store->reused_threads, 
+			store->loaded_threads, 
+			store->reused_hooks, 
+			store->loaded_hooks, 
+			store->pwszFile
+		);
+	}
+	
+	printf( "Checkpoint: read %u TEBs, used %u cached GUI threads, tracking %u threads, %u hooks.\n", 
+		store->read_count, 
+		store->cached_count, 
+		store->thread_count, 
+		store->hook_count
+	);
+	
+	fflush( stdout );
+	return;
+}
+
+
+
+/* print_checkpoint_store() 
+Print a checkpoint store.
+
+if 'store' is NULL this function returns without having printed anything.
+*/
+void print_checkpoint_store( 
+	const struct checkpoint *const store   // in
+)
+{
+	const char *const objname = "Checkpoint Store";
+	
+	
+	if( !store )
+		return;
+	
+	PRINT_DBLSEP_BEGIN( objname );
+	print_init_time( "store->init_time", store->init_time );
+	
+	printf( "store->pwszFile: %ls\n", ( store->pwszFile ? store->pwszFile : L"<none>" ) );
+	printf( "store->thread_max: %u\n", store->thread_max );
+	printf( "store->thread_count: %u\n", store->thread_count );
+	printf( "store->thread_slot_max: %u\n", store->thread_slot_max );
+	printf( "store->hook_max: %u\n", store->hook_max );
+	printf( "store->hook_count: %u\n", store->hook_count );
+	printf( "store->hook_slot_max: %u\n", store->hook_slot_max );
+	printf( "store->generation: %u\n", store->generation );
+	printf( "store->hook_generation: %u\n", store->hook_generation );
+	printf( "store->loaded_threads: %u\n", store->loaded_threads );
+	printf( "store->loaded_hooks: %u\n", store->loaded_hooks );
+	printf( "store->reused_threads: %u\n", store->reused_threads );
+	printf( "store->reused_hooks: %u\n", store->reused_hooks );
+	printf( "store->read_count: %u\n", store->read_count );
+	printf( "store->cached_count: %u\n", store->cached_count );
+	printf( "store->save_count: %u\n", store->save_count );
+	print_init_time( "store->save_time", store->save_time );
+	
+	PRINT_DBLSEP_END( objname );
+	
+	return;
+}
+
+
+
+/* free_checkpoint_store() 
+Free a checkpoint store and all its descendants.
+
+The console control handler is removed first.
+
+this function then sets the checkpoint store pointer to NULL and returns
+
+'in' is a pointer to a pointer to the checkpoint store.
+if( !in || !*in ) then this function returns.
+*/
+void free_checkpoint_store( 
+	struct checkpoint **const in   // in deref
+)
+{
+	if( !in || !*in )
+		return;
+	
+	if( (*in)->init_time )
+		SetConsoleCtrlHandler( ctrl_handler, FALSE );
+	
+	DeleteCriticalSection( &(*in)->cs );
+	
+	free( (*in)->pwszFile );
+	free( (*in)->thread );
+	free( (*in)->thread_slot );
+	free( (*in)->hook );
+	free( (*in)->hook_slot );
+	
+	free( (*in) );
+	*in = NULL;
+	
+	return;
+}
@@ -0,0 +1,273 @@
+/*
+Copyright (C) 2011 Jay Satiro <raysatiro@yahoo.com>
+All rights reserved.
+
+This file is part of GetHooks.
+
+GetHooks is free software: you can redistribute it and/or modify 
+it under the terms of the GNU General Public License as published by 
+the Free Software Foundation, either version 3 of the License, or 
+(at your option) any later version.
+
+GetHooks is distributed in the hope that it will be useful, 
+but WITHOUT ANY WARRANTY; without even the implied warranty of 
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License 
+along with GetHooks.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _CHECKPOINT_H
+#define _CHECKPOINT_H
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include "portable.h"
+#endif
+
+/* snapshot store (system process info, gui threads, desktop hooks) */
+#include "snapshot.h"
+
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/** The checkpoint file format.
+A checkpoint file is a file header followed by the thread entries and then the hook entries, which 
+are written the same as they're kept in the checkpoint store.
+
+All members are fixed width and little endian. Addresses are stored as UINT64 regardless of the 
+pointer size of the program that wrote the file. A checkpoint file is only read by a program with 
+the same pointer size on the same version of Windows, and every entry is validated against the 
+live system before it's used.
+
+file layout:
+struct checkpoint_header 
+struct checkpoint_thread [ thread_count ] 
+struct checkpoint_hook [ hook_count ]
+*/
+#define CHECKPOINT_MAGIC   "GHCKPT\r\n"
+#define CHECKPOINT_MAGIC_LEN   8
+#define CHECKPOINT_VERSION   1
+
+/* the number of seconds between the checkpoints written in monitor mode */
+#define CHECKPOINT_SAVE_SECONDS   60
+
+/* the number of snapshots a GUI thread's cached TEB info is used for before it's read again. a 
+thread that has no windows or hooks can switch desktops.
+*/
+#define CHECKPOINT_VERIFY_SNAPSHOTS   64
+
+/* nonzero if a thread entry's cached Win32ThreadInfo and desktop are due to be verified */
+#define CHECKPOINT_VERIFY_DUE(store,entry)   \
+	( (int)( (store)->generation - (entry)->verified ) >= CHECKPOINT_VERIFY_SNAPSHOTS )
+
+struct checkpoint_header
+{
+	char magic[ CHECKPOINT_MAGIC_LEN ];
+	DWORD version;
+	
+	/* sizeof( struct checkpoint_header ) */
+	DWORD header_bcount;
+	
+	/* sizeof( void * ) in the program that wrote the file */
+	DWORD pointer_bcount;
+	
+	/* G->prog->dwOSVersion in the program that wrote the file */
+	DWORD os_version;
+	
+	/* the system utc time in FILETIME format when the file was written */
+	__int64 save_time;
+	
+	DWORD thread_count;
+	DWORD hook_count;
+};
+
+
+/** This is the info cached for each thread that has a TEB.
+A thread is identified by its id and creation time, and by its process' id and creation time, 
+since thread and process ids are reused. A thread's TEB address doesn't change during its 
+lifetime, and neither does its Win32ThreadInfo once it's a GUI thread.
+*/
+struct checkpoint_thread
+{
+	UINT64 pid;
+	__int64 process_create_time;
+	UINT64 tid;
+	__int64 create_time;
+	
+	UINT64 pvTeb;
+	
+	/* 0 if the thread wasn't a GUI thread when its TEB was last read */
+	UINT64 pvWin32ThreadInfo;
+	
+	/* the kernel address of the thread's DESKTOPINFO (CLIENTINFO.pDeskInfo + ulClientDelta), or 0 
+	if unknown. see callback_add_gui()
+	*/
+	UINT64 desktop_key;
+	
+	/* the snapshot generation in which the thread was last seen, and in which its TEB was last read.
+	see begin_checkpoint_update()
+	*/
+	DWORD generation;
+	DWORD verified;
+};
+
+
+/** This is the info kept for each HOOK that has been seen, to know how long it has existed.
+A HOOK is identified by its kernel address, its handle and the kernel address of the thread it 
+originated from.
+*/
+struct checkpoint_hook
+{
+	UINT64 pHead;
+	UINT64 handle;
+	UINT64 pti;
+	
+	/* the time of the first snapshot in which the HOOK was found, in FILETIME format */
+	__int64 first_time;
+	
+	/* the hook generation in which the HOOK was last found. see update_checkpoint_hooks() */
+	DWORD generation;
+	DWORD reserved;
+};
+
+
+
+/** The checkpoint store.
+The checkpoint store caches the TEB info of each thread across snapshots, so that a thread's TEB 
+is only read when it's new or when its cached info is due to be verified, and it keeps the first 
+time each HOOK was found. The store is written to the checkpoint file periodically and when the 
+program is terminated from the console, and it's read from the file on startup so that a restarted 
+program begins with the cache of the one it replaced.
+*/
+struct checkpoint
+{
+	/* the checkpoint file */
+	WCHAR *pwszFile;   // _wcsdup(), free()
+	
+	/* an array of thread entries. the allocated/maximum number and the number written to. */
+	struct checkpoint_thread *thread;   // calloc(), free()
+	unsigned thread_max;
+	unsigned thread_count;
+	
+	/* a hash table of thread ids. each slot is 0 or the index + 1 of an entry in the thread array.
+	the number of slots is a power of 2.
+	*/
+	unsigned *thread_slot;   // calloc(), free()
+	unsigned thread_slot_max;
+	
+	/* an array of hook entries and its hash table of HOOK addresses, the same as the threads */
+	struct checkpoint_hook *hook;   // calloc(), free()
+	unsigned hook_max;
+	unsigned hook_count;
+	unsigned *hook_slot;   // calloc(), free()
+	unsigned hook_slot_max;
+	
+	/* the current snapshot generation and hook generation */
+	unsigned generation;
+	unsigned hook_generation;
+	
+	/* the number of thread and hook entries read from the checkpoint file on startup, and the 
+	number of those that were still valid in the first snapshot
+	*/
+	unsigned loaded_threads;
+	unsigned loaded_hooks;
+	unsigned reused_threads;
+	unsigned reused_hooks;
+	
+	/* the number of threads whose TEB was read and the number whose cached info was used, in the 
+	last snapshot
+	*/
+	unsigned read_count;
+	unsigned cached_count;
+	
+	/* the number of times the checkpoint file was written, and the time it was last written */
+	unsigned save_count;
+	__int64 save_time;
+	
+	/* serializes writing the checkpoint file from the console control handler with the main 
+	thread's changes to the entries
+	*/
+	CRITICAL_SECTION cs;
+	
+	/* the system utc time in FILETIME format immediately after this store has been initialized.
+	this is nonzero when this store has been initialized.
+	*/
+	__int64 init_time;
+};
+
+
+
+/** 
+these functions are documented in the comment block above their definitions in checkpoint.c
+*/
+void create_checkpoint_store( 
+	struct checkpoint **const out   // out deref
+);
+
+int init_checkpoint_store( 
+	struct checkpoint *const store,   // in
+	const WCHAR *const pwszFile   // in
+);
+
+void begin_checkpoint_update( 
+	struct checkpoint *const store   // in
+);
+
+const struct checkpoint_thread *use_checkpoint_thread( 
+	struct checkpoint *const store,   // in
+	const SYSTEM_PROCESS_INFORMATION *const spi,   // in
+	const SYSTEM_THREAD_INFORMATION *const sti   // in
+);
+
+void add_checkpoint_thread( 
+	struct checkpoint *const store,   // in
+	const SYSTEM_PROCESS_INFORMATION *const spi,   // in
+	const SYSTEM_THREAD_INFORMATION *const sti,   // in
+	const void *const pvTeb,   // in
+	const void *const pvWin32ThreadInfo,   // in, optional
+	const UINT64 desktop_key   // in, optional
+);
+
+void end_checkpoint_update( 
+	struct checkpoint *const store   // in
+);
+
+void update_checkpoint_hooks( 
+	struct checkpoint *const store,   // in
+	const struct snapshot *const snapshot   // in
+);
+
+__int64 find_checkpoint_hook_time( 
+	const struct checkpoint *const store,   // in
+	const struct hook *const hook   // in
+);
+
+int save_checkpoint_store( 
+	struct checkpoint *const store   // in
+);
+
+void print_checkpoint_report( 
+	const struct checkpoint *const store   // in
+);
+
+void print_checkpoint_store( 
+	const struct checkpoint *const store   // in
+);
+
+void free_checkpoint_store( 
+	struct checkpoint **const in   // in deref
+);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _CHECKPOINT_H
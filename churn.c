@@ -0,0 +1,657 @@
+/*
+Copyright (C) 2011 Jay Satiro <raysatiro@yahoo.com>
+All rights reserved.
+
+This file is part of GetHooks.
+
+GetHooks is free software: you can redistribute it and/or modify 
+it under the terms of the GNU General Public License as published by 
+the Free Software Foundation, either version 3 of the License, or 
+(at your option) any later version.
+
+GetHooks is distributed in the hope that it will be useful, 
+but WITHOUT ANY WARRANTY; without even the implied warranty of 
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License 
+along with GetHooks.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/** 
+This file contains functions for a churn store (USER handle churn time series).
+Each function is documented in the comment block above its definition.
+
+A background thread counts the handle entries of each type in the USER handle table every few 
+milliseconds. Each sample is put in a ring that's only written by the background thread and only 
+read by the main thread, so neither thread waits on a lock. After each snapshot the main thread 
+drains the ring, optionally exports the samples to a file, and computes the rate of change of 
+each type and the percentiles of the changes between samples.
+
+-
+create_churn_store()
+
+Create a churn store and its descendants or die.
+-
+
+-
+count_churn_sample()
+
+Count the handle entries of each type in the USER handle table.
+-
+
+-
+thread()
+
+The background thread's main function. Sample the USER handle table every interval.
+-
+
+-
+init_churn_store()
+
+Initialize a churn store and start its background thread.
+-
+
+-
+compare_churn_total()
+
+Compare two sums of changes.
+-
+
+-
+drain_churn_store()
+
+Drain the samples in the ring.
+-
+
+-
+print_churn_report()
+
+Print the churn of the USER handles in the last drain.
+-
+
+-
+print_churn_store()
+
+Print a churn store.
+-
+
+-
+free_churn_store()
+
+Free a churn store and all its descendants.
+-
+
+*/
+
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <stdio.h>
+#include <process.h>
+
+#include "util.h"
+
+#include "churn.h"
+
+/* the global stores */
+#include "global.h"
+
+
+
+static unsigned __stdcall thread( 
+	void *param   // in
+);
+
+static int compare_churn_total( 
+	const void *const p1,   // in
+	const void *const p2   // in
+);
+
+
+
+/* create_churn_store() 
+Create a churn store and its descendants or die.
+*/
+void create_churn_store( 
+	struct churn **const out   // out deref
+)
+{
+	struct churn *churn = NULL;
+	
+	FAIL_IF( !out );
+	FAIL_IF( *out );
+	
+	
+	/* allocate a churn store */
+	churn = must_calloc( 1, sizeof( *churn ) );
+	
+	churn->ring = must_calloc( CHURN_RING_SAMPLES, sizeof( *churn->ring ) );
+	churn->total = must_calloc( CHURN_RING_SAMPLES, sizeof( *churn->total ) );
+	
+	
+	*out = churn;
+	return;
+}
+
+
+
+/* count_churn_sample() 
+Count the handle entries of each type in the USER handle table.
+
+'sample' receives the counts. Its performance counter isn't set.
+
+The type of each entry is counted in one of four sets of counters in turn, which are summed at the 
+end. Consecutive entries usually have the same type, and with a single set of counters each 
+increment would have to wait for the previous one to the same counter.
+*/
+void count_churn_sample( 
+	struct churn_sample *const sample   // out
+)
+{
+	unsigned i = 0, j = 0, count = 0;
+	unsigned lane[ 4 ][ 256 ];
+	const HANDLEENTRY *entry = NULL;
+	
+	FAIL_IF( !G );   // The global store must exist.
+	FAIL_IF( !G->prog->init_time );   // The program store must be initialized.
+	FAIL_IF( !sample );
+	
+	
+	ZeroMemory( lane, sizeof( lane ) );
+	
+	/* the number of entries can change while they're counted */
+	count = *G->prog->pcHandleEntries;
+	entry = G->prog->pSharedInfo->aheList;
+	
+	for( i = 0; ( i + 4 ) <= count; i += 4 )
+	{
+		++lane[ 0 ][ entry[ i ].bType ];
+		++lane[ 1 ][ entry[ i + 1 ].bType ];
+		++lane[ 2 ][ entry[ i + 2 ].bType ];
+		++lane[ 3 ][ entry[ i + 3 ].bType ];
+	}
+	
+	for( ; i < count; ++i )
+		++lane[ 0 ][ entry[ i ].bType ];
+	
+	ZeroMemory( sample->count, sizeof( sample->count ) );
+	
+	for( i = 0; i < 256; ++i )
+	{
+		const unsigned sum = lane[ 0 ][ i ] + lane[ 1 ][ i ] + lane[ 2 ][ i ] + lane[ 3 ][ i ];
+		
+		
+		j = ( i < TYPE_CTYPES ) ? i : TYPE_CTYPES;
+		sample->count[ j ] += sum;
+	}
+	
+	return;
+}
+
+
+
+/* thread() 
+The background thread's main function. Sample the USER handle table every interval.
+
+If the ring is full the sample is dropped. Every CHURN_WINDOW_MS milliseconds this thread checks 
+how much of a core its samples used in that time. If it's more than CHURN_OVERHEAD_PERCENT then the 
+interval is doubled, and if it's less than a quarter of that the interval is halved, but never 
+below the interval the user requested.
+
+The interval is subject to the resolution of the system timer, which is often about 15 ms unless 
+another program has raised it. The time of each sample is taken from the performance counter.
+
+use _beginthreadex() to call this function.
+currently the return value doesn't matter as long as it's != STILL_ACTIVE (259)
+*/
+static unsigned __stdcall thread( 
+	void *param   // in
+)
+{
+	struct churn *const store = param;
+	__int64 window_begin = 0, window_busy = 0;
+	
+	FAIL_IF( !store );
+	
+	
+	window_begin = store->qpc_begin;
+	
+	for( ;; )
+	{
+		DWORD ret = 0;
+		ULONG head = 0;
+		__int64 begin = 0, end = 0;
+		
+		
+		ret = WaitForSingleObject( store->terminate, (DWORD)store->current_interval );
+		
+		if( ret == WAIT_OBJECT_0 )
+			break;
+		
+		if( ret != WAIT_TIMEOUT )
+		{
+			MSG_FATAL_GLE( "WaitForSingleObject() failed." );
+			exit( 1 );
+		}
+		
+		QueryPerformanceCounter( (LARGE_INTEGER *)&begin );
+		
+		head = store->head;
+		
+		if( ( head - store->tail ) >= CHURN_RING_SAMPLES )
+			InterlockedIncrement( &store->dropped );
+		else
+		{
+			struct churn_sample *const sample = &store->ring[ head & ( CHURN_RING_SAMPLES - 1 ) ];
+			
+			
+			count_churn_sample( sample );
+			sample->qpc = begin;
+			
+			/* the sample must be written before the main thread can see it */
+			InterlockedExchange( (volatile LONG *)&store->head, (LONG)( head + 1 ) );
+		}
+		
+		QueryPerformanceCounter( (LARGE_INTEGER *)&end );
+		window_busy += end - begin;
+		
+		if( ( ( end - window_begin ) * 1000 ) >= ( store->qpc_frequency * CHURN_WINDOW_MS ) )
+		{
+			/* hundredths of a percent */
+			const LONG overhead = (LONG)( ( window_busy * 10000 ) / ( end - window_begin ) );
+			
+			LONG interval = store->current_interval;
+			
+			if( overhead > ( CHURN_OVERHEAD_PERCENT * 100 ) )
+				interval *= 2;
+			else if( overhead < ( CHURN_OVERHEAD_PERCENT * 100 / 4 ) )
+				interval /= 2;
+			
+			if( interval > CHURN_INTERVAL_MAX )
+				interval = CHURN_INTERVAL_MAX;
+			else if( interval < (LONG)store->interval )
+				interval = (LONG)store->interval;
+			
+			store->current_interval = interval;
+			
+			InterlockedExchange( &store->overhead, overhead );
+			
+			window_begin = end;
+			window_busy = 0;
+		}
+	}
+	
+	return 0;
+}
+
+
+
+/* init_churn_store() 
+Initialize a churn store and start its background thread.
+
+'interval' is the interval in milliseconds between samples 
+'pwszFile' is the file the samples are exported to, or NULL. If the file exists it's truncated.
+
+returns nonzero on success
+*/
+int init_churn_store( 
+	struct churn *const store,   // in
+	const unsigned interval,   // in
+	const WCHAR *const pwszFile   // in, optional
+)
+{
+	unsigned i = 0;
+	
+	FAIL_IF( !G );   // The global store must exist.
+	FAIL_IF( !G->prog->init_time );   // The program store must be initialized.
+	
+	FAIL_IF( !store );
+	FAIL_IF( store->init_time );   // Fail if this store has already been initialized.
+	
+	
+	if( ( interval < CHURN_INTERVAL_MIN ) || ( interval > CHURN_INTERVAL_MAX ) )
+	{
+		MSG_ERROR( "The churn interval is invalid." );
+		printf( "interval: %u\n", interval );
+		return FALSE;
+	}
+	
+	store->interval = interval;
+	store->current_interval = (LONG)interval;
+	
+	if( !QueryPerformanceFrequency( (LARGE_INTEGER *)&store->qpc_frequency ) 
+		|| !store->qpc_frequency
+	)
+	{
+		MSG_ERROR_GLE( "QueryPerformanceFrequency() failed." );
+		return FALSE;
+	}
+	
+	QueryPerformanceCounter( (LARGE_INTEGER *)&store->qpc_begin );
+	
+	if( pwszFile )
+	{
+		store->pwszFile = must_wcsdup( pwszFile );
+		
+		store->fp = _wfopen( store->pwszFile, L"w" );
+		if( !store->fp )
+		{
+			MSG_ERROR( "_wfopen() failed." );
+			printf( "file: %ls\n", store->pwszFile );
+			return FALSE;
+		}
+		
+		/* the header row. the time is in microseconds since the store was initialized. */
+		fprintf( store->fp, "us" );
+		
+		for( i = 0; i < CHURN_TYPES; ++i )
+		{
+			fprintf( store->fp, ",%ls", 
+				( ( i < TYPE_CTYPES ) && ( i < w_handlenames_count ) ) ? w_handlenames[ i ] : L"Other"
+			);
+		}
+		
+		fprintf( store->fp, "\n" );
+	}
+	
+	store->terminate = CreateEvent( NULL, 0, 0, NULL );
+	if( !store->terminate )
+	{
+		MSG_ERROR_GLE( "CreateEvent() failed." );
+		return FALSE;
+	}
+	
+	store->thread = (HANDLE)_beginthreadex( NULL, 0, thread, store, 0, NULL );
+	if( !store->thread )
+	{
+		MSG_ERROR( _strerror( "_beginthreadex() failed" ) );
+		return FALSE;
+	}
+	
+	
+	/* the churn store has been initialized */
+	GetSystemTimeAsFileTime( (FILETIME *)&store->init_time );
+	return TRUE;
+}
+
+
+
+/* compare_churn_total() 
+Compare two sums of changes.
+
+This function is called by qsort().
+
+returns an integer that is less than, equal to, or greater than zero
+*/
+static int compare_churn_total( 
+	const void *const p1,   // in
+	const void *const p2   // in
+)
+{
+	const unsigned a = *(const unsigned *)p1;
+	const unsigned b = *(const unsigned *)p2;
+	
+	
+	if( a != b )
+		return ( a < b ) ? -1 : 1;
+	
+	return 0;
+}
+
+
+
+/* drain_churn_store() 
+Drain the samples in the ring.
+
+Each sample is compared to the one before it, including the last sample of the previous drain. If 
+the user specified an export file then all the samples are written to it at once.
+
+This function must only be called from the main thread.
+
+returns nonzero on success. returns zero if the samples couldn't be written to the export file.
+*/
+int drain_churn_store( 
+	struct churn *const store   // in
+)
+{
+	unsigned i = 0;
+	ULONG head = 0, tail = 0;
+	
+	FAIL_IF( !store );
+	FAIL_IF( !store->init_time );   // The churn store must be initialized.
+	
+	FAIL_IF( GetCurrentThreadId() != G->prog->dwMainThreadId );   // main thread only
+	
+	
+	/* the samples before 'head' have been written */
+	head = (ULONG)InterlockedCompareExchange( (volatile LONG *)&store->head, 0, 0 );
+	tail = store->tail;
+	
+	ZeroMemory( store->change, sizeof( store->change ) );
+	ZeroMemory( store->change_max, sizeof( store->change_max ) );
+	ZeroMemory( store->net, sizeof( store->net ) );
+	store->count = 0;
+	store->total_count = 0;
+	store->total_p50 = store->total_p95 = store->total_p99 = store->total_max = 0;
+	
+	if( store->have_last )
+		store->begin_qpc = store->last.qpc;
+	else if( head != tail )
+		store->begin_qpc = store->ring[ tail & ( CHURN_RING_SAMPLES - 1 ) ].qpc;
+	
+	for( ; tail != head; ++tail )
+	{
+		const struct churn_sample *const sample = &store->ring[ tail & ( CHURN_RING_SAMPLES - 1 ) ];
+		
+		
+		if( store->fp )
+		{
+			fprintf( store->fp, "%I64d", 
+				( ( sample->qpc - store->qpc_begin ) * 1000000 ) / store->qpc_frequency
+			);
+			
+			for( i = 0; i < CHURN_TYPES; ++i )
+				fprintf( store->fp, ",%u", sample->count[ i ] );
+			
+			fprintf( store->fp, "\n" );
+		}
+		
+		if( store->have_last )
+		{
+			unsigned total = 0;
+			
+			for( i = 0; i < CHURN_TYPES; ++i )
+			{
+				const __int64 diff = (__int64)sample->count[ i ] - store->last.count[ i ];
+				const unsigned change = (unsigned)( ( diff < 0 ) ? -diff : diff );
+				
+				store->net[ i ] += diff;
+				store->change[ i ] += change;
+				
+				if( change > store->change_max[ i ] )
+					store->change_max[ i ] = change;
+				
+				total += change;
+			}
+			
+			store->total[ store->total_count++ ] = total;
+		}
+		
+		store->last = *sample;
+		store->have_last = TRUE;
+		++store->count;
+	}
+	
+	/* the samples before 'tail' can be overwritten */
+	InterlockedExchange( (volatile LONG *)&store->tail, (LONG)tail );
+	store->sample_total += store->count;
+	
+	if( store->total_count )
+	{
+		qsort( store->total, store->total_count, sizeof( *store->total ), compare_churn_total );
+		
+		store->total_p50 = store->total[ ( store->total_count - 1 ) * 50 / 100 ];
+		store->total_p95 = store->total[ ( store->total_count - 1 ) * 95 / 100 ];
+		store->total_p99 = store->total[ ( store->total_count - 1 ) * 99 / 100 ];
+		store->total_max = store->total[ store->total_count - 1 ];
+	}
+	
+	if( store->fp && ( fflush( store->fp ) || ferror( store->fp ) ) )
+	{
+		MSG_ERROR( "The samples could not be written to the churn file." );
+		printf( "file: %ls\n", store->pwszFile );
+		return FALSE;
+	}
+	
+	return TRUE;
+}
+
+
+
+/* print_churn_report() 
+Print the churn of the USER handles in the last drain.
+
+count: the number of handle entries of the type in the last sample 
+changes/s: the sum of the absolute changes between samples, per second 
+net/s: the net change per second 
+max: the largest change between two samples
+
+The percentiles are of the sum of the absolute changes of all types between two samples.
+
+if 'store' is NULL this function returns without having printed anything.
+*/
+void print_churn_report( 
+	const struct churn *const store   // in
+)
+{
+	unsigned i = 0;
+	double seconds = 0;
+	
+	
+	if( !store )
+		return;
+	
+	FAIL_IF( !store->init_time );   // The churn store must be initialized.
+	
+	
+	if( !store->have_last )
+		return;
+	
+	seconds = (double)( store->last.qpc - store->begin_qpc ) / store->qpc_frequency;
+	
+	printf( "\nUSER handle churn (%u samples in %.0f ms, %ld ms interval, %ld dropped, "
+		"sampler %.2f%% of a core):\n", 
+		store->count, 
+		( seconds * 1000 ), 
+		store->current_interval, 
+		store->dropped, 
+		( store->overhead / 100.0 )
+	);
+	printf( "Changes between samples: p50 %u  p95 %u  p99 %u  max %u\n", 
+		store->total_p50, 
+		store->total_p95, 
+		store->total_p99, 
+		store->total_max
+	);
+	printf( "%-16s %8s %10s %10s %8s\n", "type", "count", "changes/s", "net/s", "max" );
+	
+	for( i = 0; i < CHURN_TYPES; ++i )
+	{
+		if( !store->last.count[ i ] && !store->change[ i ] )
+			continue;
+		
+		/* free entries are not objects */
+		if( i == TYPE_FREE )
+			continue;
+		
+		printf( "%-16ls %8u %10.1f %10.1f %8u\n", 
+			( ( i < TYPE_CTYPES ) && ( i < w_handlenames_count ) ) ? w_handlenames[ i ] : L"Other", 
+			store->last.count[ i ], 
+			( ( seconds > 0 ) ? ( store->change[ i ] / seconds ) : 0 ), 
+			( ( seconds > 0 ) ? ( store->net[ i ] / seconds ) : 0 ), 
+			store->change_max[ i ]
+		);
+	}
+	
+	fflush( stdout );
+	return;
+}
+
+
+
+/* print_churn_store() 
+Print a churn store.
+
+if 'store' is NULL this function returns without having printed anything.
+*/
+void print_churn_store( 
+	const struct churn *const store   // in
+)
+{
+	const char *const objname = "Churn Store";
+	
+	
+	if( !store )
+		return;
+	
+	PRINT_DBLSEP_BEGIN( objname );
+	print_init_time( "store->init_time", store->init_time );
+	
+	printf( "store->head: %lu\n", store->head );
+	printf( "store->tail: %lu\n", store->tail );
+	printf( "store->dropped: %ld\n", store->dropped );
+	printf( "store->interval: %u\n", store->interval );
+	printf( "store->current_interval: %ld\n", store->current_interval );
+	printf( "store->overhead: %ld\n", store->overhead );
+	printf( "store->qpc_frequency: %I64d\n", store->qpc_frequency );
+	printf( "store->count: %u\n", store->count );
+	printf( "store->total_count: %u\n", store->total_count );
+	printf( "store->pwszFile: %ls\n", ( store->pwszFile ? store->pwszFile : L"<none>" ) );
+	printf( "store->sample_total: %I64u\n", store->sample_total );
+	
+	PRINT_DBLSEP_END( objname );
+	
+	return;
+}
+
+
+
+/* free_churn_store() 
+Free a churn store and all its descendants.
+
+The background thread is terminated first.
+
+this function then sets the churn store pointer to NULL and returns
+
+'in' is a pointer to a pointer to the churn store.
+if( !in || !*in ) then this function returns.
+*/
+void free_churn_store( 
+	struct churn **const in   // in deref
+)
+{
+	if( !in || !*in )
+		return;
+	
+	if( (*in)->thread )
+	{
+		SetEvent( (*in)->terminate );
+		WaitForSingleObject( (*in)->thread, INFINITE );
+		CloseHandle( (*in)->thread );
+	}
+	
+	if( (*in)->terminate )
+		CloseHandle( (*in)->terminate );
+	
+	if( (*in)->fp )
+		fclose( (*in)->fp );
+	
+	free( (*in)->pwszFile );
+	free( (*in)->ring );
+	free( (*in)->total );
+	
+	free( (*in) );
+	*in = NULL;
+	
+	return;
+}
@@ -0,0 +1,198 @@
+/*
+Copyright (C) 2011 Jay Satiro <raysatiro@yahoo.com>
+All rights reserved.
+
+This file is part of GetHooks.
+
+GetHooks is free software: you can redistribute it and/or modify 
+it under the terms of the GNU General Public License as published by 
+the Free Software Foundation, either version 3 of the License, or 
+(at your option) any later version.
+
+GetHooks is distributed in the hope that it will be useful, 
+but WITHOUT ANY WARRANTY; without even the implied warranty of 
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License 
+along with GetHooks.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _CHURN_H
+#define _CHURN_H
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include "portable.h"
+#endif
+#include <stdio.h>
+
+#include "reactos.h"
+
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/* the number of counters in a sample. one for each HANDLEENTRY.bType up to TYPE_CTYPES, and the 
+last one for any other type (eg TYPE_GENERIC).
+*/
+#define CHURN_TYPES   ( TYPE_CTYPES + 1 )
+
+
+/** This is a sample of the handle table: the number of handle entries of each type.
+*/
+struct churn_sample
+{
+	/* the performance counter when the sample was taken */
+	__int64 qpc;
+	
+	/* the number of handle entries of each type */
+	unsigned count[ CHURN_TYPES ];
+};
+
+
+
+/** The churn store.
+The churn store samples the USER handle table on a background thread every few milliseconds and 
+counts the handle entries of each type. The samples are put in a single producer, single consumer 
+ring that doesn't need a lock, and they're drained by the main thread after each snapshot. See 
+drain_churn_store().
+*/
+struct churn
+{
+	/* the ring of samples. the number of samples is a power of 2. */
+	#define CHURN_RING_SAMPLES   8192
+	struct churn_sample *ring;   // calloc(), free()
+	
+	/* the number of samples written by the background thread and read by the main thread.
+	the index of a sample in the ring is the number modulo CHURN_RING_SAMPLES. 'head' is only 
+	written by the background thread and 'tail' is only written by the main thread. they're 
+	unsigned so that they wrap, and the number of unread samples is always 'head' - 'tail'.
+	*/
+	volatile ULONG head;
+	volatile ULONG tail;
+	
+	/* the number of samples the background thread dropped because the ring was full */
+	volatile LONG dropped;
+	
+	/* the background thread and the event that terminates it */
+	HANDLE thread;   // _beginthreadex(), CloseHandle()
+	HANDLE terminate;   // CreateEvent(), CloseHandle()
+	
+	/* the interval in milliseconds between samples that the user requested */
+	#define CHURN_INTERVAL_MIN   1
+	#define CHURN_INTERVAL_MAX   1000
+	unsigned interval;
+	
+	/* the interval in milliseconds that the background thread is currently using. the thread backs 
+	off if its samples use more than CHURN_OVERHEAD_PERCENT of a core. written by the background 
+	thread.
+	*/
+	#define CHURN_OVERHEAD_PERCENT   1
+	volatile LONG current_interval;
+	
+	/* the time the background thread spent sampling in the last CHURN_WINDOW_MS milliseconds, in 
+	hundredths of a percent of a core. written by the background thread.
+	*/
+	#define CHURN_WINDOW_MS   1000
+	volatile LONG overhead;
+	
+	/* the performance counter frequency, and the counter when this store was initialized */
+	__int64 qpc_frequency;
+	__int64 qpc_begin;
+	
+	
+	
+	/** these members are only used by the main thread.
+	*/
+	/* the last sample drained, which the next samples are compared to */
+	struct churn_sample last;
+	
+	/* nonzero if 'last' has a sample */
+	unsigned have_last;
+	
+	/* the performance counter of the last sample drained before the last drain, or of the first 
+	sample if there wasn't one. the samples in the last drain are from this time to 'last'.
+	*/
+	__int64 begin_qpc;
+	
+	/* the number of samples in the last drain */
+	unsigned count;
+	
+	/* the sum of the absolute changes and the largest change of each type between each pair of 
+	samples in the last drain
+	*/
+	unsigned __int64 change[ CHURN_TYPES ];
+	unsigned change_max[ CHURN_TYPES ];
+	
+	/* the net change of each type in the last drain */
+	__int64 net[ CHURN_TYPES ];
+	
+	/* the sum of the absolute changes of all types between each pair of samples in the last 
+	drain, and its percentiles.
+	*/
+	unsigned *total;   // calloc(), free()
+	unsigned total_count;
+	unsigned total_p50;
+	unsigned total_p95;
+	unsigned total_p99;
+	unsigned total_max;
+	
+	/* the file the samples are exported to, or NULL */
+	WCHAR *pwszFile;   // _wcsdup(), free()
+	FILE *fp;   // _wfopen(), fclose()
+	
+	/* the number of samples drained and exported */
+	unsigned __int64 sample_total;
+	
+	/* the system utc time in FILETIME format immediately after this store has been initialized.
+	this is nonzero when this store has been initialized.
+	*/
+	__int64 init_time;
+};
+
+
+
+/** 
+these functions are documented in the comment block above their definitions in churn.c
+*/
+void create_churn_store( 
+	struct churn **const out   // out deref
+);
+
+int init_churn_store( 
+	struct churn *const store,   // in
+	const unsigned interval,   // in
+	const WCHAR *const pwszFile   // in, optional
+);
+
+void count_churn_sample( 
+	struct churn_sample *const sample   // out
+);
+
+int drain_churn_store( 
+	struct churn *const store   // in
+);
+
+void print_churn_report( 
+	const struct churn *const store   // in
+);
+
+void print_churn_store( 
+	const struct churn *const store   // in
+);
+
+void free_churn_store( 
+	struct churn **const in   // in deref
+);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _CHURN_H
@@ -31,12 +31,30 @@ create_config_store()
 Create a configuration store and its descendants or die.
 -
 
+-
+duplicate_config_store()
+
+Create a configuration store that is a copy of another configuration store, or die.
+-
+
+-
+copy_list_store()
+
+Copy the type, items and init time of a list store to an empty list store, or die.
+-
+
 -
 get_next_arg()
 
 Get the next argument in the array of command line arguments.
 -
 
+-
+parse_long_option()
+
+Parse a long option and its arguments.
+-
+
 -
 init_global_config_store()
 
@@ -81,11 +99,38 @@ Free a configuration store and all its descendants.
 
 #include "config.h"
 
+#include "snapfile.h"
+
+#include "latency.h"
+
+#include "fastpoll.h"
+
+#include "hookscan.h"
+
+#include "prefetch.h"
+
+#include "occupancy.h"
+
+#include "churn.h"
+
+#include "governor.h"
+
+#include "stream.h"
+
 /* the global stores */
 #include "global.h"
 
 
 
+static void copy_list_store( 
+	struct list *const dest,   // in, out
+	const struct list *const src   // in
+);
+
+static unsigned parse_long_option( 
+	int *const index   // in, out
+);
+
 static void print_config_store( 
 	struct config *store   // in
 );
@@ -122,6 +167,76 @@ void create_config_store(
 	/* allocate the list store for the linked list of test parameters */
 	create_list_store( &config->testlist );
 	
+	/* allocate the list store for the linked list of snapshot files */
+	create_list_store( &config->filelist );
+	
+	
+	*out = config;
+	return;
+}
+
+
+
+/* duplicate_config_store() 
+Create a configuration store that is a copy of another configuration store, or die.
+
+The copy has its own lists and strings, so either store can be freed or modified without affecting 
+the other. The copy's init time is the same as the original's.
+*/
+void duplicate_config_store( 
+	struct config **const out,   // out deref
+	const struct config *const in   // in
+)
+{
+	struct config *config = NULL;
+	
+	FAIL_IF( !out );
+	FAIL_IF( *out );
+	FAIL_IF( !in );
+	
+	
+	create_config_store( &config );
+	
+	config->polling = in->polling;
+	config->verbose = in->verbose;
+	config->max_threads = in->max_threads;
+	config->flags = in->flags;
+	config->offline = in->offline;
+	config->latency = in->latency;
+	config->fastpoll = in->fastpoll;
+	config->hookscan = in->hookscan;
+	config->prefetch = in->prefetch;
+	config->occupancy = in->occupancy;
+	config->churn = in->churn;
+	config->budget = in->budget;
+	config->stream = in->stream;
+	config->session = in->session;
+	config->init_time = in->init_time;
+	
+	if( in->pwszRecordFile )
+		config->pwszRecordFile = must_wcsdup( in->pwszRecordFile );
+	
+	if( in->pwszColumnsFile )
+		config->pwszColumnsFile = must_wcsdup( in->pwszColumnsFile );
+	
+	if( in->pwszConfigFile )
+		config->pwszConfigFile = must_wcsdup( in->pwszConfigFile );
+	
+	if( in->pwszChurnFile )
+		config->pwszChurnFile = must_wcsdup( in->pwszChurnFile );
+	
+	if( in->pwszCheckpointFile )
+		config->pwszCheckpointFile = must_wcsdup( in->pwszCheckpointFile );
+	
+	if( in->pwszRulesFile )
+		config->pwszRulesFile = must_wcsdup( in->pwszRulesFile );
+	
+	copy_list_store( config->desklist, in->desklist );
+	copy_list_store( config->hooklist, in->hooklist );
+	copy_list_store( config->proglist, in->proglist );
+	copy_list_store( config->testlist, in->testlist );
+	copy_list_store( config->filelist, in->filelist );
+	
 	
 	*out = config;
 	return;
@@ -129,6 +244,39 @@ void create_config_store(
 
 
 
+/* copy_list_store() 
+Copy the type, items and init time of a list store to an empty list store, or die.
+*/
+static void copy_list_store( 
+	struct list *const dest,   // in, out
+	const struct list *const src   // in
+)
+{
+	const struct list_item *item = NULL;
+	
+	FAIL_IF( !dest );
+	FAIL_IF( !src );
+	FAIL_IF( dest->head );
+	
+	
+	dest->type = src->type;
+	
+	for( item = src->head; item; item = item->next )
+	{
+		if( !add_list_item( dest, item->id, item->name ) )
+		{
+			MSG_FATAL( "add_list_item() failed." );
+			print_list_item( item );
+			exit( 1 );
+		}
+	}
+	
+	dest->init_time = src->init_time;
+	return;
+}
+
+
+
 /* get_next_arg()
 Get the next argument in the array of command line arguments.
 
@@ -225,6 +373,20 @@ unsigned get_next_arg(
 			else if( !_stricmp( G->prog->argv[ *index ], "--version" ) )
 				exit( 1 ); /* version always printed */
 			
+			if( ( G->prog->argv[ *index ][ 0 ] == '-' ) && ( G->prog->argv[ *index ][ 1 ] == '-' ) )
+			{
+				/* the command line argument is a long option. eg --record */
+				
+				if( !( expected_types & OPT ) )
+				{
+					MSG_FATAL( "An option has no associated option argument." );
+					printf( "OPT: %s\n", G->prog->argv[ *index - 1 ] );
+					exit( 1 );
+				}
+				
+				return OPT;
+			}
+			
 			/* the command line argument is an option's argument (optarg) */
 			
 			if( !( expected_types & OPTARG ) )
@@ -243,6 +405,664 @@ unsigned get_next_arg(
 
 
 
+/* parse_long_option() 
+Parse a long option and its arguments.
+
+'index' is a pointer to the current index in the array of command line arguments, which is the 
+index of the long option. this function advances the index past the option's arguments.
+
+Long options are matched case insensitive and are not abbreviated.
+
+returns what get_next_arg() returned for the argument after the option's arguments.
+*/
+static unsigned parse_long_option( 
+	int *const index   // in, out
+)
+{
+	unsigned arf = 0;
+	const char *name = NULL;
+	
+	FAIL_IF( !index );
+	
+	
+	/* skip the leading dashes */
+	name = G->prog->argv[ *index ] + 2;
+	
+	/** 
+	option to record each snapshot to a snapshot file
+	*/
+	if( !_stricmp( name, "record" ) )
+	{
+		if( G->config->pwszRecordFile )
+		{
+			MSG_FATAL( "Option '--record': this option has already been specified." );
+			printf( "file: %ls\n", G->config->pwszRecordFile );
+			exit( 1 );
+		}
+		
+		/* this option must have an associated argument (optarg).
+		if an optarg is not found get_next_arg() will exit(1)
+		*/
+		arf = get_next_arg( index, OPTARG );
+		
+		if( !get_wstr_from_mbstr( &G->config->pwszRecordFile, G->prog->argv[ *index ] ) )
+		{
+			MSG_FATAL( "get_wstr_from_mbstr() failed." );
+			printf( "file: %s\n", G->prog->argv[ *index ] );
+			exit( 1 );
+		}
+		
+		return get_next_arg( index, OPT );
+	}
+	
+	/** 
+	option to read more options from a configuration file that is reloaded when it changes
+	*/
+	if( !_stricmp( name, "config" ) )
+	{
+		if( G->config->pwszConfigFile )
+		{
+			MSG_FATAL( "Option '--config': this option has already been specified." );
+			printf( "file: %ls\n", G->config->pwszConfigFile );
+			exit( 1 );
+		}
+		
+		/* this option must have an associated argument (optarg).
+		if an optarg is not found get_next_arg() will exit(1)
+		*/
+		arf = get_next_arg( index, OPTARG );
+		
+		if( !get_wstr_from_mbstr( &G->config->pwszConfigFile, G->prog->argv[ *index ] ) )
+		{
+			MSG_FATAL( "get_wstr_from_mbstr() failed." );
+			printf( "file: %s\n", G->prog->argv[ *index ] );
+			exit( 1 );
+		}
+		
+		return get_next_arg( index, OPT );
+	}
+	
+	/** 
+	option to write each hook event to a columnar export file
+	*/
+	if( !_stricmp( name, "columns" ) )
+	{
+		if( G->config->pwszColumnsFile )
+		{
+			MSG_FATAL( "Option '--columns': this option has already been specified." );
+			printf( "file: %ls\n", G->config->pwszColumnsFile );
+			exit( 1 );
+		}
+		
+		/* this option must have an associated argument (optarg).
+		if an optarg is not found get_next_arg() will exit(1)
+		*/
+		arf = get_next_arg( index, OPTARG );
+		
+		if( !get_wstr_from_mbstr( &G->config->pwszColumnsFile, G->prog->argv[ *index ] ) )
+		{
+			MSG_FATAL( "get_wstr_from_mbstr() failed." );
+			printf( "file: %s\n", G->prog->argv[ *index ] );
+			exit( 1 );
+		}
+		
+		return get_next_arg( index, OPT );
+	}
+	
+	/** 
+	option to sample the state of low-level and global hooks' origin threads between snapshots
+	*/
+	if( !_stricmp( name, "latency" ) )
+	{
+		if( G->config->latency )
+		{
+			MSG_FATAL( "Option '--latency': this option has already been specified." );
+			printf( "interval: %u\n", G->config->latency );
+			exit( 1 );
+		}
+		
+		/* this option must have an associated argument (optarg).
+		if an optarg is not found get_next_arg() will exit(1)
+		*/
+		arf = get_next_arg( index, OPTARG );
+		
+		if( ( str_to_uint( &G->config->latency, G->prog->argv[ *index ] ) != NUM_POS ) 
+			|| ( G->config->latency < LATENCY_INTERVAL_MIN ) 
+			|| ( G->config->latency > LATENCY_INTERVAL_MAX )
+		)
+		{
+			MSG_FATAL( "Option '--latency': sample interval invalid." );
+			printf( "Valid intervals are %u to %u milliseconds.\n", 
+				LATENCY_INTERVAL_MIN, 
+				LATENCY_INTERVAL_MAX
+			);
+			printf( "interval: %s\n", G->prog->argv[ *index ] );
+			exit( 1 );
+		}
+		
+		return get_next_arg( index, OPT );
+	}
+	
+	/** 
+	option to re-poll the owner and origin threads of each hook between snapshots
+	*/
+	if( !_stricmp( name, "fastpoll" ) )
+	{
+		if( G->config->fastpoll )
+		{
+			MSG_FATAL( "Option '--fastpoll': this option has already been specified." );
+			printf( "ratio: %u\n", G->config->fastpoll );
+			exit( 1 );
+		}
+		
+		/* this option must have an associated argument (optarg).
+		if an optarg is not found get_next_arg() will exit(1)
+		*/
+		arf = get_next_arg( index, OPTARG );
+		
+		if( ( str_to_uint( &G->config->fastpoll, G->prog->argv[ *index ] ) != NUM_POS ) 
+			|| ( G->config->fastpoll < FASTPOLL_RATIO_MIN ) 
+			|| ( G->config->fastpoll > FASTPOLL_RATIO_MAX )
+		)
+		{
+			MSG_FATAL( "Option '--fastpoll': re-polls per snapshot invalid." );
+			printf( "Valid ratios are %u to %u re-polls per snapshot.\n", 
+				FASTPOLL_RATIO_MIN, 
+				FASTPOLL_RATIO_MAX
+			);
+			printf( "ratio: %s\n", G->prog->argv[ *index ] );
+			exit( 1 );
+		}
+		
+		return get_next_arg( index, OPT );
+	}
+	
+	/** 
+	option to report the hooks added and removed between snapshots as soon as they're found
+	*/
+	if( !_stricmp( name, "hookscan" ) )
+	{
+		if( G->config->hookscan )
+		{
+			MSG_FATAL( "Option '--hookscan': this option has already been specified." );
+			printf( "interval: %u\n", G->config->hookscan );
+			exit( 1 );
+		}
+		
+		/* this option must have an associated argument (optarg).
+		if an optarg is not found get_next_arg() will exit(1)
+		*/
+		arf = get_next_arg( index, OPTARG );
+		
+		if( ( str_to_uint( &G->config->hookscan, G->prog->argv[ *index ] ) != NUM_POS ) 
+			|| ( G->config->hookscan < HOOKSCAN_INTERVAL_MIN ) 
+			|| ( G->config->hookscan > HOOKSCAN_INTERVAL_MAX )
+		)
+		{
+			MSG_FATAL( "Option '--hookscan': milliseconds invalid." );
+			printf( "Valid intervals are %u to %u milliseconds.\n", 
+				HOOKSCAN_INTERVAL_MIN, 
+				HOOKSCAN_INTERVAL_MAX
+			);
+			printf( "interval: %s\n", G->prog->argv[ *index ] );
+			exit( 1 );
+		}
+		
+		return get_next_arg( index, OPT );
+	}
+	
+	/** 
+	option to query the system process info on a background thread ahead of each snapshot
+	*/
+	if( !_stricmp( name, "prefetch" ) )
+	{
+		if( G->config->prefetch )
+		{
+			MSG_FATAL( "Option '--prefetch': this option has already been specified." );
+			printf( "max age: %u\n", G->config->prefetch );
+			exit( 1 );
+		}
+		
+		/* this option must have an associated argument (optarg).
+		if an optarg is not found get_next_arg() will exit(1)
+		*/
+		arf = get_next_arg( index, OPTARG );
+		
+		if( ( str_to_uint( &G->config->prefetch, G->prog->argv[ *index ] ) != NUM_POS ) 
+			|| ( G->config->prefetch < PREFETCH_AGE_MIN ) 
+			|| ( G->config->prefetch > PREFETCH_AGE_MAX )
+		)
+		{
+			MSG_FATAL( "Option '--prefetch': maximum age invalid." );
+			printf( "Valid maximum ages are %u to %u milliseconds.\n", 
+				PREFETCH_AGE_MIN, 
+				PREFETCH_AGE_MAX
+			);
+			printf( "max age: %s\n", G->prog->argv[ *index ] );
+			exit( 1 );
+		}
+		
+		return get_next_arg( index, OPT );
+	}
+	
+	/** 
+	option to estimate the occupancy of each desktop heap and alert when it trends toward exhaustion
+	*/
+	if( !_stricmp( name, "occupancy" ) )
+	{
+		if( G->config->occupancy )
+		{
+			MSG_FATAL( "Option '--occupancy': this option has already been specified." );
+			printf( "horizon: %u\n", G->config->occupancy );
+			exit( 1 );
+		}
+		
+		/* this option must have an associated argument (optarg).
+		if an optarg is not found get_next_arg() will exit(1)
+		*/
+		arf = get_next_arg( index, OPTARG );
+		
+		if( ( str_to_uint( &G->config->occupancy, G->prog->argv[ *index ] ) != NUM_POS ) 
+			|| ( G->config->occupancy < OCCUPANCY_HORIZON_MIN ) 
+			|| ( G->config->occupancy > OCCUPANCY_HORIZON_MAX )
+		)
+		{
+			MSG_FATAL( "Option '--occupancy': minutes invalid." );
+			printf( "Valid horizons are %u to %u minutes.\n", 
+				OCCUPANCY_HORIZON_MIN, 
+				OCCUPANCY_HORIZON_MAX
+			);
+			printf( "horizon: %s\n", G->prog->argv[ *index ] );
+			exit( 1 );
+		}
+		
+		return get_next_arg( index, OPT );
+	}
+	
+	/** 
+	option to sample the USER handle table every few milliseconds and report the churn
+	*/
+	if( !_stricmp( name, "churn" ) )
+	{
+		if( G->config->churn )
+		{
+			MSG_FATAL( "Option '--churn': this option has already been specified." );
+			printf( "interval: %u\n", G->config->churn );
+			exit( 1 );
+		}
+		
+		/* this option must have an associated argument (optarg).
+		if an optarg is not found get_next_arg() will exit(1)
+		*/
+		arf = get_next_arg( index, OPTARG );
+		
+		if( ( str_to_uint( &G->config->churn, G->prog->argv[ *index ] ) != NUM_POS ) 
+			|| ( G->config->churn < CHURN_INTERVAL_MIN ) 
+			|| ( G->config->churn > CHURN_INTERVAL_MAX )
+		)
+		{
+			MSG_FATAL( "Option '--churn': milliseconds invalid." );
+			printf( "Valid intervals are %u to %u milliseconds.\n", 
+				CHURN_INTERVAL_MIN, 
+				CHURN_INTERVAL_MAX
+			);
+			printf( "interval: %s\n", G->prog->argv[ *index ] );
+			exit( 1 );
+		}
+		
+		/* the file to export the samples to is optional */
+		arf = get_next_arg( index, OPT | OPTARG );
+		
+		if( arf != OPTARG )
+			return arf;
+		
+		if( !get_wstr_from_mbstr( &G->config->pwszChurnFile, G->prog->argv[ *index ] ) )
+		{
+			MSG_FATAL( "get_wstr_from_mbstr() failed." );
+			printf( "file: %s\n", G->prog->argv[ *index ] );
+			exit( 1 );
+		}
+		
+		return get_next_arg( index, OPT );
+	}
+	
+	/** 
+	option to keep the monitor loop within a CPU budget
+	*/
+	if( !_stricmp( name, "budget" ) )
+	{
+		if( G->config->budget )
+		{
+			MSG_FATAL( "Option '--budget': this option has already been specified." );
+			printf( "budget: %u\n", G->config->budget );
+			exit( 1 );
+		}
+		
+		/* this option must have an associated argument (optarg).
+		if an optarg is not found get_next_arg() will exit(1)
+		*/
+		arf = get_next_arg( index, OPTARG );
+		
+		if( ( str_to_uint( &G->config->budget, G->prog->argv[ *index ] ) != NUM_POS ) 
+			|| ( G->config->budget < GOVERNOR_BUDGET_MIN ) 
+			|| ( G->config->budget > GOVERNOR_BUDGET_MAX )
+		)
+		{
+			MSG_FATAL( "Option '--budget': percent invalid." );
+			printf( "Valid budgets are %u to %u percent of a core.\n", 
+				GOVERNOR_BUDGET_MIN, 
+				GOVERNOR_BUDGET_MAX
+			);
+			printf( "budget: %s\n", G->prog->argv[ *index ] );
+			exit( 1 );
+		}
+		
+		return get_next_arg( index, OPT );
+	}
+	
+	/** 
+	option to print each desktop's initial hooks as soon as the threads they refer to are found
+	*/
+	if( !_stricmp( name, "stream" ) )
+	{
+		if( G->config->stream )
+		{
+			MSG_FATAL( "Option '--stream': this option has already been specified." );
+			printf( "mode: %u\n", G->config->stream );
+			exit( 1 );
+		}
+		
+		G->config->stream = STREAM_RESOLVED;
+		
+		/* the order is optional */
+		arf = get_next_arg( index, OPT | OPTARG );
+		
+		if( arf != OPTARG )
+			return arf;
+		
+		if( _stricmp( G->prog->argv[ *index ], "ordered" ) )
+		{
+			MSG_FATAL( "Option '--stream': order invalid." );
+			printf( "The only valid order is 'ordered'.\n" );
+			printf( "order: %s\n", G->prog->argv[ *index ] );
+			exit( 1 );
+		}
+		
+		G->config->stream = STREAM_ORDERED;
+		
+		return get_next_arg( index, OPT );
+	}
+	
+	/** 
+	option to keep the warm state in a checkpoint file that is reused when the program restarts
+	*/
+	if( !_stricmp( name, "checkpoint" ) )
+	{
+		if( G->config->pwszCheckpointFile )
+		{
+			MSG_FATAL( "Option '--checkpoint': this option has already been specified." );
+			printf( "file: %ls\n", G->config->pwszCheckpointFile );
+			exit( 1 );
+		}
+		
+		/* this option must have an associated argument (optarg).
+		if an optarg is not found get_next_arg() will exit(1)
+		*/
+		arf = get_next_arg( index, OPTARG );
+		
+		if( !get_wstr_from_mbstr( &G->config->pwszCheckpointFile, G->prog->argv[ *index ] ) )
+		{
+			MSG_FATAL( "get_wstr_from_mbstr() failed." );
+			printf( "file: %s\n", G->prog->argv[ *index ] );
+			exit( 1 );
+		}
+		
+		return get_next_arg( index, OPT );
+	}
+	
+	/** 
+	option to match the hook events against the rules in a rules file
+	*/
+	if( !_stricmp( name, "rules" ) )
+	{
+		if( G->config->pwszRulesFile )
+		{
+			MSG_FATAL( "Option '--rules': this option has already been specified." );
+			printf( "file: %ls\n", G->config->pwszRulesFile );
+			exit( 1 );
+		}
+		
+		/* this option must have an associated argument (optarg).
+		if an optarg is not found get_next_arg() will exit(1)
+		*/
+		arf = get_next_arg( index, OPTARG );
+		
+		if( !get_wstr_from_mbstr( &G->config->pwszRulesFile, G->prog->argv[ *index ] ) )
+		{
+			MSG_FATAL( "get_wstr_from_mbstr() failed." );
+			printf( "file: %s\n", G->prog->argv[ *index ] );
+			exit( 1 );
+		}
+		
+		return get_next_arg( index, OPT );
+	}
+	
+	/** 
+	option to only traverse the processes in one session
+	*/
+	if( !_stricmp( name, "session" ) )
+	{
+		if( G->config->flags & CFG_SESSION_FILTER )
+		{
+			MSG_FATAL( "Option '--session': this option has already been specified." );
+			printf( "session: %u\n", G->config->session );
+			exit( 1 );
+		}
+		
+		/* this option must have an associated argument (optarg).
+		if an optarg is not found get_next_arg() will exit(1)
+		*/
+		arf = get_next_arg( index, OPTARG );
+		
+		if( str_to_uint( &G->config->session, G->prog->argv[ *index ] ) != NUM_POS )
+		{
+			MSG_FATAL( "Option '--session': session id invalid." );
+			printf( "session: %s\n", G->prog->argv[ *index ] );
+			exit( 1 );
+		}
+		
+		G->config->flags |= CFG_SESSION_FILTER;
+		
+		return get_next_arg( index, OPT );
+	}
+	
+	/** 
+	option to account for the CPU time used by the owner and origin threads of each hook
+	*/
+	if( !_stricmp( name, "cost" ) )
+	{
+		G->config->flags |= CFG_COST_ACCOUNTING;
+		
+		return get_next_arg( index, OPT );
+	}
+	
+	/** 
+	option to check the integrity of the HOOK chains in each snapshot
+	*/
+	if( !_stricmp( name, "chains" ) )
+	{
+		G->config->flags |= CFG_CHECK_CHAINS;
+		
+		return get_next_arg( index, OPT );
+	}
+	
+	/** 
+	option to aggregate the hook metrics per minute, hour and day
+	*/
+	if( !_stricmp( name, "rollup" ) )
+	{
+		G->config->flags |= CFG_ROLLUP;
+		
+		return get_next_arg( index, OPT );
+	}
+	
+	/** 
+	option to print the ancestors of the process that each hook originated from
+	*/
+	if( !_stricmp( name, "ancestry" ) )
+	{
+		G->config->flags |= CFG_SHOW_ANCESTRY;
+		
+		return get_next_arg( index, OPT );
+	}
+	
+	/** 
+	offline options 
+	inspect: print the records in a snapshot file, and optionally the HOOKs in one of them 
+	diff: compare a record in one snapshot file to a record in another (or the same) file
+	*/
+	if( !_stricmp( name, "inspect" ) || !_stricmp( name, "diff" ) )
+	{
+		struct list_item *item = NULL;
+		unsigned timed = FALSE;
+		
+		
+		if( G->config->offline )
+		{
+			MSG_FATAL( "Options '--inspect', '--diff' and '--aggregate' may only be specified once." );
+			exit( 1 );
+		}
+		
+		G->config->offline = !_stricmp( name, "inspect" ) ? OFFLINE_INSPECT : OFFLINE_DIFF;
+		G->config->filelist->type = LIST_INCLUDE_FILE;
+		
+		/* the option requires at least one associated argument (optarg), the first file.
+		if an optarg is not found get_next_arg() will exit(1)
+		*/
+		arf = get_next_arg( index, OPTARG );
+		
+		while( arf == OPTARG ) /* option argument found */
+		{
+			__int64 time = 0;
+			WCHAR *file = NULL;
+			
+			
+			/* if the argument is a time (FILETIME or #n) then it is the time of the record to use 
+			in the last file. if the last file already has a time then the time is for a second 
+			record in the same file. otherwise the argument is a file.
+			*/
+			if( item && get_snapfile_time( &time, G->prog->argv[ *index ] ) )
+			{
+				if( timed )
+				{
+					item = add_list_item( G->config->filelist, time, item->name );
+					
+					if( !item )
+					{
+						MSG_FATAL( "add_list_item() failed." );
+						printf( "time: %s\n", G->prog->argv[ *index ] );
+						exit( 1 );
+					}
+				}
+				else
+					item->id = time;
+				
+				timed = TRUE;
+			}
+			else
+			{
+				/* make the file name as a wide character string */
+				if( !get_wstr_from_mbstr( &file, G->prog->argv[ *index ] ) )
+				{
+					MSG_FATAL( "get_wstr_from_mbstr() failed." );
+					printf( "file: %s\n", G->prog->argv[ *index ] );
+					exit( 1 );
+				}
+				
+				/* append to the linked list */
+				item = add_list_item( G->config->filelist, SNAPFILE_TIME_LAST, file );
+				
+				if( !item )
+				{
+					MSG_FATAL( "add_list_item() failed." );
+					printf( "file: %s\n", G->prog->argv[ *index ] );
+					exit( 1 );
+				}
+				
+				/* add_list_item() made a duplicate of the wide string pointed to by file */
+				free( file );
+				file = NULL;
+				
+				timed = FALSE;
+			}
+			
+			/* get the option's next argument, which is optional */
+			arf = get_next_arg( index, OPT | OPTARG );
+		}
+		
+		return arf;
+	}
+	
+	/** 
+	offline option to aggregate the hooks in the last record of each of many snapshot files
+	*/
+	if( !_stricmp( name, "aggregate" ) )
+	{
+		if( G->config->offline )
+		{
+			MSG_FATAL( "Options '--inspect', '--diff' and '--aggregate' may only be specified once." );
+			exit( 1 );
+		}
+		
+		G->config->offline = OFFLINE_AGGREGATE;
+		G->config->filelist->type = LIST_INCLUDE_FILE;
+		
+		/* the option requires at least one associated argument (optarg), the first file.
+		if an optarg is not found get_next_arg() will exit(1)
+		*/
+		arf = get_next_arg( index, OPTARG );
+		
+		while( arf == OPTARG ) /* option argument found */
+		{
+			WCHAR *file = NULL;
+			
+			
+			/* make the file name as a wide character string. a name that begins with '@' is a 
+			list file, which is read by aggregatemode().
+			*/
+			if( !get_wstr_from_mbstr( &file, G->prog->argv[ *index ] ) )
+			{
+				MSG_FATAL( "get_wstr_from_mbstr() failed." );
+				printf( "file: %s\n", G->prog->argv[ *index ] );
+				exit( 1 );
+			}
+			
+			/* append to the linked list */
+			if( !add_list_item( G->config->filelist, SNAPFILE_TIME_LAST, file ) )
+			{
+				MSG_FATAL( "add_list_item() failed." );
+				printf( "file: %s\n", G->prog->argv[ *index ] );
+				exit( 1 );
+			}
+			
+			/* add_list_item() made a duplicate of the wide string pointed to by file */
+			free( file );
+			file = NULL;
+			
+			/* get the option's next argument, which is optional */
+			arf = get_next_arg( index, OPT | OPTARG );
+		}
+		
+		return arf;
+	}
+	
+	MSG_FATAL( "Unknown option." );
+	printf( "OPT: %s\n", G->prog->argv[ *index ] );
+	exit( 1 );
+}
+
+
+
 /* init_global_config_store()
 Initialize the global configuration store by parsing command line arguments.
 
@@ -683,7 +1503,9 @@ void init_global_config_store( void )
 			
 			/**
 			test mode include option (advanced)
+			test mode is only built on Windows.
 			*/
+#ifdef _WIN32
 			case 'z':
 			case 'Z':
 			{
@@ -740,6 +1562,7 @@ void init_global_config_store( void )
 				
 				continue;
 			}
+#endif // _WIN32
 			
 			
 			
@@ -821,6 +1644,17 @@ void init_global_config_store( void )
 			
 			
 			
+			/** 
+			long options. eg --record
+			*/
+			case '-':
+			{
+				arf = parse_long_option( &i );
+				continue;
+			}
+			
+			
+			
 			default:
 			{
 				MSG_FATAL( "Unknown option." );
@@ -848,6 +1682,157 @@ void init_global_config_store( void )
 	if( ( G->config->testlist->type == LIST_INCLUDE_TEST ) )
 		GetSystemTimeAsFileTime( (FILETIME *)&G->config->testlist->init_time );
 	
+	if( G->config->offline )
+	{
+		unsigned count = 0;
+		const struct list_item *item = NULL;
+		
+		
+		/* offline mode doesn't take any snapshots */
+		if( ( G->config->polling != POLLING_DEFAULT ) 
+			|| G->config->testlist->init_time 
+			|| G->config->pwszRecordFile 
+			|| G->config->pwszColumnsFile 
+			|| ( G->config->flags & CFG_SHOW_ANCESTRY ) 
+			|| G->config->latency 
+			|| ( G->config->flags & CFG_COST_ACCOUNTING ) 
+			|| G->config->fastpoll 
+			|| G->config->hookscan 
+			|| G->config->prefetch 
+			|| ( G->config->flags & CFG_SESSION_FILTER ) 
+			|| G->config->pwszConfigFile 
+			|| ( G->config->flags & CFG_CHECK_CHAINS ) 
+			|| G->config->occupancy 
+			|| G->config->churn 
+			|| G->config->pwszCheckpointFile 
+			|| G->config->stream
+			|| G->config->pwszRulesFile
+			|| ( G->config->flags & CFG_ROLLUP )
+			|| G->config->budget
+		)
+		{
+			MSG_FATAL( "The offline options are incompatible with 'm', 'z', '--record', '--columns', "
+				"'--ancestry', '--latency', '--cost', '--fastpoll', '--hookscan', '--prefetch', "
+				"'--session', '--config', '--chains', '--occupancy', '--churn', '--checkpoint', "
+				"'--stream', '--rules', '--rollup' and '--budget'."
+			);
+			exit( 1 );
+		}
+		
+		for( item = G->config->filelist->head; item; item = item->next )
+			++count;
+		
+		if( ( ( G->config->offline == OFFLINE_INSPECT ) && ( count != 1 ) ) 
+			|| ( ( G->config->offline == OFFLINE_DIFF ) && ( count != 2 ) ) 
+			|| ( ( G->config->offline == OFFLINE_AGGREGATE ) && !count )
+		)
+		{
+			MSG_FATAL( "Wrong number of snapshot files or record times." );
+			printf( "Usage: --inspect <file> [time]\n" );
+			printf( "Usage: --diff <file> [time] <file> [time]\n" );
+			printf( "Usage: --diff <file> <time> <time>\n" );
+			printf( "Usage: --aggregate <file|@listfile> [...]\n" );
+			exit( 1 );
+		}
+		
+		GetSystemTimeAsFileTime( (FILETIME *)&G->config->filelist->init_time );
+	}
+	
+	/* the hook origin threads are sampled between snapshots, and their states are only known if 
+	the threads are traversed
+	*/
+	if( G->config->latency 
+		&& ( ( G->config->polling < POLLING_MIN ) || ( G->config->flags & CFG_COMPLETELY_PASSIVE ) )
+	)
+	{
+		MSG_FATAL( "Option '--latency' requires monitor mode ('m') and is incompatible with 'y'." );
+		exit( 1 );
+	}
+	
+	/* the CPU time is accounted for between snapshots from the thread info in each snapshot */
+	if( ( G->config->flags & CFG_COST_ACCOUNTING ) 
+		&& ( ( G->config->polling < POLLING_MIN ) || ( G->config->flags & CFG_COMPLETELY_PASSIVE ) )
+	)
+	{
+		MSG_FATAL( "Option '--cost' requires monitor mode ('m') and is incompatible with 'y'." );
+		exit( 1 );
+	}
+	
+	/* the samples are drained after each snapshot */
+	if( G->config->churn && ( G->config->polling < POLLING_MIN ) )
+	{
+		MSG_FATAL( "Option '--churn' requires monitor mode ('m')." );
+		exit( 1 );
+	}
+	
+	/* the budget is measured over the cycles of the monitor loop */
+	if( G->config->budget && ( G->config->polling < POLLING_MIN ) )
+	{
+		MSG_FATAL( "Option '--budget' requires monitor mode ('m')." );
+		exit( 1 );
+	}
+	
+	/* the metrics are rolled up from the snapshots taken over time */
+	if( ( G->config->flags & CFG_ROLLUP ) && ( G->config->polling < POLLING_MIN ) )
+	{
+		MSG_FATAL( "Option '--rollup' requires monitor mode ('m')." );
+		exit( 1 );
+	}
+	
+	/* an anomaly is only reported if it's found in two consecutive snapshots */
+	if( ( G->config->flags & CFG_CHECK_CHAINS ) && ( G->config->polling < POLLING_MIN ) )
+	{
+		MSG_FATAL( "Option '--chains' requires monitor mode ('m')." );
+		exit( 1 );
+	}
+	
+	/* the re-polls take the place of the wait between snapshots, as do the latency samples */
+	if( G->config->fastpoll 
+		&& ( ( G->config->polling < POLLING_MIN ) 
+			|| ( G->config->flags & CFG_COMPLETELY_PASSIVE ) 
+			|| G->config->latency
+		)
+	)
+	{
+		MSG_FATAL( "Option '--fastpoll' requires monitor mode ('m') and is incompatible with 'y' and "
+			"'--latency'."
+		);
+		exit( 1 );
+	}
+	
+	/* the hook scans take the place of the wait between snapshots too. in passive mode there are 
+	no threads to attribute the hook events to.
+	*/
+	if( G->config->hookscan 
+		&& ( ( G->config->polling < POLLING_MIN ) 
+			|| ( G->config->flags & CFG_COMPLETELY_PASSIVE ) 
+			|| G->config->latency 
+			|| G->config->fastpoll
+		)
+	)
+	{
+		MSG_FATAL( "Option '--hookscan' requires monitor mode ('m') and is incompatible with 'y', "
+			"'--latency' and '--fastpoll'."
+		);
+		exit( 1 );
+	}
+	
+	/* the system process info is only queried ahead of a snapshot if the threads are traversed */
+	if( G->config->prefetch 
+		&& ( ( G->config->polling < POLLING_MIN ) || ( G->config->flags & CFG_COMPLETELY_PASSIVE ) )
+	)
+	{
+		MSG_FATAL( "Option '--prefetch' requires monitor mode ('m') and is incompatible with 'y'." );
+		exit( 1 );
+	}
+	
+	/* in passive mode no processes are traversed */
+	if( ( G->config->flags & CFG_SESSION_FILTER ) && ( G->config->flags & CFG_COMPLETELY_PASSIVE ) )
+	{
+		MSG_FATAL( "Option '--session' is incompatible with 'y'." );
+		exit( 1 );
+	}
+	
 	
 	/* G->config has been initialized */
 	GetSystemTimeAsFileTime( (FILETIME *)&G->config->init_time );
@@ -889,6 +1874,21 @@ void print_config_flags(
 	if( flags & CFG_DEBUG )
 		printf( "CFG_DEBUG " );
 	
+	if( flags & CFG_SHOW_ANCESTRY )
+		printf( "CFG_SHOW_ANCESTRY " );
+	
+	if( flags & CFG_COST_ACCOUNTING )
+		printf( "CFG_COST_ACCOUNTING " );
+	
+	if( flags & CFG_SESSION_FILTER )
+		printf( "CFG_SESSION_FILTER " );
+	
+	if( flags & CFG_CHECK_CHAINS )
+		printf( "CFG_CHECK_CHAINS " );
+	
+	if( flags & CFG_ROLLUP )
+		printf( "CFG_ROLLUP " );
+	
 	if( flags & ~CFG_VALID )
 		printf( "<0x%X> ", ( flags & ~CFG_VALID ) );
 	
@@ -925,6 +1925,49 @@ static void print_config_store(
 	printf( "store->verbose: %d\n", store->verbose );
 	printf( "store->max_threads: %u\n", store->max_threads );
 	
+	printf( "store->offline: %d", store->offline );
+	if( store->offline == OFFLINE_INSPECT )
+		printf( " (Inspecting a snapshot file)" );
+	else if( store->offline == OFFLINE_DIFF )
+		printf( " (Comparing snapshot files)" );
+	else if( store->offline == OFFLINE_AGGREGATE )
+		printf( " (Aggregating snapshot files)" );
+	printf( "\n" );
+	
+	printf( "store->pwszRecordFile: %ls\n", 
+		( store->pwszRecordFile ? store->pwszRecordFile : L"<none>" )
+	);
+	
+	printf( "store->pwszColumnsFile: %ls\n", 
+		( store->pwszColumnsFile ? store->pwszColumnsFile : L"<none>" )
+	);
+	
+	printf( "store->pwszConfigFile: %ls\n", 
+		( store->pwszConfigFile ? store->pwszConfigFile : L"<none>" )
+	);
+	
+	printf( "store->pwszChurnFile: %ls\n", 
+		( store->pwszChurnFile ? store->pwszChurnFile : L"<none>" )
+	);
+	
+	printf( "store->pwszCheckpointFile: %ls\n", 
+		( store->pwszCheckpointFile ? store->pwszCheckpointFile : L"<none>" )
+	);
+	
+	printf( "store->pwszRulesFile: %ls\n", 
+		( store->pwszRulesFile ? store->pwszRulesFile : L"<none>" )
+	);
+	
+	printf( "store->latency: %u\n", store->latency );
+	printf( "store->fastpoll: %u\n", store->fastpoll );
+	printf( "store->hookscan: %u\n", store->hookscan );
+	printf( "store->prefetch: %u\n", store->prefetch );
+	printf( "store->occupancy: %u\n", store->occupancy );
+	printf( "store->churn: %u\n", store->churn );
+	printf( "store->budget: %u\n", store->budget );
+	printf( "store->stream: %u\n", store->stream );
+	printf( "store->session: %u\n", store->session );
+	
 	printf( "store->flags: " );
 	PRINT_HEX_BARE( store->flags );
 	if( store->flags )
@@ -947,6 +1990,9 @@ static void print_config_store(
 	printf( "\n\nPrinting list store of user specified tests:\n" );
 	print_list_store( store->testlist );
 	
+	printf( "\n\nPrinting list store of user specified snapshot files:\n" );
+	print_list_store( store->filelist );
+	
 	PRINT_DBLSEP_END( objname );
 	
 	return;
@@ -980,7 +2026,15 @@ void free_config_store(
 	if( !in || !*in )
 		return;
 	
+	free( (*in)->pwszRecordFile );
+	free( (*in)->pwszColumnsFile );
+	free( (*in)->pwszConfigFile );
+	free( (*in)->pwszChurnFile );
+	free( (*in)->pwszCheckpointFile );
+	free( (*in)->pwszRulesFile );
+	
 	/* free the list stores */
+	free_list_store( &(*in)->filelist );
 	free_list_store( &(*in)->testlist );
 	free_list_store( &(*in)->proglist );
 	free_list_store( &(*in)->hooklist );
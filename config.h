@@ -21,7 +21,11 @@ along with GetHooks.  If not, see <http://www.gnu.org/licenses/>.
 #ifndef _CONFIG_H
 #define _CONFIG_H
 
+#ifdef _WIN32
 #include <windows.h>
+#else
+#include "portable.h"
+#endif
 
 /* generic list store (linked list of names/ids) */
 #include "list.h"
@@ -104,7 +108,32 @@ struct config
 	
 	/* general purpose debug flag to handle my whims */
 	#define CFG_DEBUG   ( 1u << 6 )
-	#define CFG_VALID   ( ~( (unsigned)(-1) << 7 ) )
+	
+	/* show the ancestry of the process that each hook originated from.
+	the ancestry is the chain of parent processes, which is kept in the global ancestry store.
+	*/
+	#define CFG_SHOW_ANCESTRY   ( 1u << 7 )
+	
+	/* account for the CPU time used by the owner and origin threads of each hook between snapshots.
+	the most expensive hook owners are printed after each snapshot in monitor mode.
+	*/
+	#define CFG_COST_ACCOUNTING   ( 1u << 8 )
+	
+	/* only traverse the processes in one session. see the 'session' member.
+	the threads of processes in other sessions are never matched to hooks.
+	*/
+	#define CFG_SESSION_FILTER   ( 1u << 9 )
+	
+	/* check the integrity of the HOOK chains in each snapshot. see the global chain store.
+	an anomaly that's found in two consecutive snapshots is printed in monitor mode.
+	*/
+	#define CFG_CHECK_CHAINS   ( 1u << 10 )
+	
+	/* aggregate the hook metrics per minute, hour and day. see the global rollup store.
+	the last hour and day are printed in monitor mode when they end.
+	*/
+	#define CFG_ROLLUP   ( 1u << 11 )
+	#define CFG_VALID   ( ~( (unsigned)(-1) << 12 ) )
 	
 	unsigned flags;
 	
@@ -122,6 +151,88 @@ struct config
 	/* a linked list of test parameters for test mode */
 	struct list *testlist;   // create_list_store(), free_list_store()
 	
+	/* a linked list of snapshot files and record times for offline mode */
+	struct list *filelist;   // create_list_store(), free_list_store()
+	
+	
+	/* offline mode. read snapshots from snapshot files instead of taking them.
+	by default offline mode is disabled.
+	*/
+	#define OFFLINE_DISABLED   0
+	#define OFFLINE_INSPECT   1   // user specified '--inspect': print a snapshot file's records
+	#define OFFLINE_DIFF   2   // user specified '--diff': compare the records of snapshot files
+	#define OFFLINE_AGGREGATE   3   // user specified '--aggregate': count the hooks in many files
+	int offline;
+	
+	/* the name of the snapshot file to record each snapshot to. NULL if not recording. */
+	WCHAR *pwszRecordFile;   // get_wstr_from_mbstr(), free()
+	
+	/* the name of the columnar export file to write hook events to. NULL if not exporting. */
+	WCHAR *pwszColumnsFile;   // get_wstr_from_mbstr(), free()
+	
+	/* the name of the configuration file that is watched for changes in monitor mode. NULL if none.
+	see reload.h
+	*/
+	WCHAR *pwszConfigFile;   // get_wstr_from_mbstr(), free()
+	
+	/* the name of the file the USER handle churn samples are exported to. NULL if none.
+	see churn.h
+	*/
+	WCHAR *pwszChurnFile;   // get_wstr_from_mbstr(), free()
+	
+	/* the name of the file the warm state is checkpointed to and restored from. NULL if none.
+	see checkpoint.h
+	*/
+	WCHAR *pwszCheckpointFile;   // get_wstr_from_mbstr(), free()
+	
+	/* the name of the file of rules that the hook events are matched against. NULL if none.
+	see rules.h
+	*/
+	WCHAR *pwszRulesFile;   // get_wstr_from_mbstr(), free()
+	
+	/* how many milliseconds to wait between samples of the hook origin threads' states in monitor 
+	mode. 0 if the user didn't request input latency analysis. see latency.h
+	*/
+	unsigned latency;
+	
+	/* how many times the hook owner and origin threads are re-polled for each snapshot in monitor 
+	mode. 0 if the user didn't request fast polling. see fastpoll.h
+	*/
+	unsigned fastpoll;
+	
+	/* how many milliseconds to wait between hooks only snapshots in monitor mode. 0 if the user 
+	didn't request hook scans. see hookscan.h
+	*/
+	unsigned hookscan;
+	
+	/* the maximum age in milliseconds of system process info that is queried ahead of each 
+	snapshot in monitor mode. 0 if the user didn't request prefetching. see prefetch.h
+	*/
+	unsigned prefetch;
+	
+	/* the number of minutes ahead that a desktop heap projected to be exhausted is alerted. 0 if 
+	the user didn't request desktop heap occupancy estimates. see occupancy.h
+	*/
+	unsigned occupancy;
+	
+	/* how many milliseconds to wait between samples of the USER handle table in monitor mode. 0 if 
+	the user didn't request USER handle churn sampling. see churn.h
+	*/
+	unsigned churn;
+	
+	/* the CPU budget of the monitor loop in percent of one core. 0 if the user didn't request a 
+	budget. see governor.h
+	*/
+	unsigned budget;
+	
+	/* how the initial hooks are printed while the first snapshot is taken. STREAM_OFF (0) if the 
+	user didn't request streaming. see stream.h
+	*/
+	unsigned stream;
+	
+	/* the id of the session whose processes are traversed, if the flag CFG_SESSION_FILTER is set */
+	unsigned session;
+	
 	
 	/* the system utc time in FILETIME format immediately after this store has been initialized.
 	this is nonzero when this store has been initialized.
@@ -138,6 +249,11 @@ void create_config_store(
 	struct config **const out   // out deref
 );
 
+void duplicate_config_store( 
+	struct config **const out,   // out deref
+	const struct config *const in   // in
+);
+
 unsigned get_next_arg( 
 	int *const index,   // in, out
 	const unsigned expected_types   // in
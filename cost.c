@@ -0,0 +1,933 @@
+/*
+Copyright (C) 2011 Jay Satiro <raysatiro@yahoo.com>
+All rights reserved.
+
+This file is part of GetHooks.
+
+GetHooks is free software: you can redistribute it and/or modify 
+it under the terms of the GNU General Public License as published by 
+the Free Software Foundation, either version 3 of the License, or 
+(at your option) any later version.
+
+GetHooks is distributed in the hope that it will be useful, 
+but WITHOUT ANY WARRANTY; without even the implied warranty of 
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License 
+along with GetHooks.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/** 
+This file contains functions for a cost store (CPU cost accounting for hook owner threads).
+Each function is documented in the comment block above its definition.
+
+The procedure of a low-level hook runs in the thread that set it, and every input event on the 
+desktop waits for it. A hook whose owner or origin thread uses a lot of CPU time slows down input.
+
+Each SYSTEM_THREAD_INFORMATION in a snapshot has the thread's kernel time, user time and context 
+switch count. For each snapshot the cost store collects those counters for the owner and origin 
+threads of every hook, matches the threads to the previous snapshot by thread id and creation time, 
+and accumulates the increase per hook and per process. This is one pass over the thread info that 
+was already captured for the snapshot; there are no additional system calls.
+
+-
+create_cost_store()
+
+Create a cost store and its descendants or die.
+-
+
+-
+init_cost_store()
+
+Initialize a cost store.
+-
+
+-
+grow_cost_array()
+
+Double the size of one of the cost store's arrays.
+-
+
+-
+copy_cost_name()
+
+Copy a process image name.
+-
+
+-
+compare_cost_thread()
+
+Compare two cost threads by thread id and creation time.
+-
+
+-
+find_cost_thread()
+
+Search an array of cost threads for a thread.
+-
+
+-
+get_cost_process()
+
+Find the process of a cost thread in the cost store, or add it.
+-
+
+-
+get_cost_hook()
+
+Find a hook in the cost store, or add it.
+-
+
+-
+update_cost_store()
+
+Account for the CPU time used by the hook threads since the previous snapshot.
+-
+
+-
+compare_cost_process()
+
+Compare two cost processes by CPU time.
+-
+
+-
+compare_cost_hook()
+
+Compare two cost hooks by CPU time.
+-
+
+-
+print_cost_report()
+
+Print the most expensive hook owners and hooks.
+-
+
+-
+print_cost_store()
+
+Print a cost store.
+-
+
+-
+free_cost_store()
+
+Free a cost store and all its descendants.
+-
+
+*/
+
+#include <stdio.h>
+
+#include "util.h"
+
+#include "reactos.h"
+
+#include "cost.h"
+
+/* the global stores */
+#include "global.h"
+
+
+
+/* the initial number of elements in each array */
+#define COST_ITEMS_DEFAULT   64
+
+/* the maximum number of rows in each table of the report */
+#define COST_REPORT_ROWS   20
+
+/* the number of FILETIME intervals in a millisecond */
+#define COST_FILETIME_MS   10000
+
+
+
+static void grow_cost_array( 
+	void **const array,   // in, out
+	unsigned *const max,   // in, out
+	const size_t size   // in
+);
+
+static WCHAR *copy_cost_name( 
+	const WCHAR *const name,   // in, optional
+	const unsigned cch   // in
+);
+
+static int compare_cost_thread( 
+	const void *const p1,   // in
+	const void *const p2   // in
+);
+
+static struct cost_thread *find_cost_thread( 
+	const struct cost_thread *const array,   // in
+	const unsigned count,   // in
+	const struct gui *const gui   // in
+);
+
+static struct cost_process *get_cost_process( 
+	struct cost *const store,   // in
+	const struct cost_thread *const thread   // in
+);
+
+static struct cost_hook *get_cost_hook( 
+	struct cost *const store,   // in
+	const struct hook *const hook   // in
+);
+
+static int compare_cost_process( 
+	const void *const p1,   // in
+	const void *const p2   // in
+);
+
+static int compare_cost_hook( 
+	const void *const p1,   // in
+	const void *const p2   // in
+);
+
+
+
+/* create_cost_store() 
+Create a cost store and its descendants or die.
+*/
+void create_cost_store( 
+	struct cost **const out   // out deref
+)
+{
+	struct cost *cost = NULL;
+	
+	FAIL_IF( !out );
+	FAIL_IF( *out );
+	
+	
+	/* allocate a cost store */
+	cost = must_calloc( 1, sizeof( *cost ) );
+	
+	cost->thread_max = COST_ITEMS_DEFAULT;
+	cost->thread = must_calloc( cost->thread_max, sizeof( *cost->thread ) );
+	
+	cost->previous_max = COST_ITEMS_DEFAULT;
+	cost->previous = must_calloc( cost->previous_max, sizeof( *cost->previous ) );
+	
+	cost->hook_max = COST_ITEMS_DEFAULT;
+	cost->hook = must_calloc( cost->hook_max, sizeof( *cost->hook ) );
+	
+	cost->process_max = COST_ITEMS_DEFAULT;
+	cost->process = must_calloc( cost->process_max, sizeof( *cost->process ) );
+	
+	
+	*out = cost;
+	return;
+}
+
+
+
+/* init_cost_store() 
+Initialize a cost store.
+
+The store is empty until the first snapshot. See update_cost_store().
+
+returns nonzero on success
+*/
+int init_cost_store( 
+	struct cost *const store   // in
+)
+{
+	FAIL_IF( !store );
+	FAIL_IF( store->init_time );   // Fail if this store has already been initialized.
+	
+	
+	/* the cost store has been initialized */
+	GetSystemTimeAsFileTime( (FILETIME *)&store->init_time );
+	return TRUE;
+}
+
+
+
+/* grow_cost_array() 
+Double the size of one of the cost store's arrays.
+
+'array' is a pointer to the array 
+'max' is a pointer to the allocated/maximum number of elements in the array 
+'size' is the size of an element
+*/
+static void grow_cost_array( 
+	void **const array,   // in, out
+	unsigned *const max,   // in, out
+	const size_t size   // in
+)
+{
+	void *temp = NULL;
+	
+	FAIL_IF( !array );
+	FAIL_IF( !*array );
+	FAIL_IF( !max );
+	
+	
+	temp = must_calloc( *max * 2, size );
+	
+	memcpy( temp, *array, *max * size );
+	free( *array );
+	
+	*array = temp;
+	*max *= 2;
+	
+	return;
+}
+
+
+
+/* copy_cost_name() 
+Copy a process image name.
+
+'name' is the name, which doesn't have to be null terminated.
+'cch' is the length of the name in characters.
+
+returns the null terminated copy or NULL if 'name' is NULL
+*/
+static WCHAR *copy_cost_name( 
+	const WCHAR *const name,   // in, optional
+	const unsigned cch   // in
+)
+{
+	WCHAR *copy = NULL;
+	
+	
+	if( !name )
+		return NULL;
+	
+	copy = must_calloc( cch + 1, sizeof( WCHAR ) );
+	memcpy( copy, name, cch * sizeof( WCHAR ) );
+	
+	return copy;
+}
+
+
+
+/* compare_cost_thread() 
+Compare two cost threads by thread id and creation time.
+
+qsort() callback: this function is called when sorting an array of cost threads 
+bsearch() callback: this function is called when searching an array of cost threads
+*/
+static int compare_cost_thread( 
+	const void *const p1,   // in
+	const void *const p2   // in
+)
+{
+	const struct cost_thread *const a = p1;
+	const struct cost_thread *const b = p2;
+	
+	
+	if( a->tid != b->tid )
+		return ( a->tid < b->tid ) ? -1 : 1;
+	
+	if( a->create_time != b->create_time )
+		return ( a->create_time < b->create_time ) ? -1 : 1;
+	
+	return 0;
+}
+
+
+
+/* find_cost_thread() 
+Search an array of cost threads for a thread.
+
+'array' is the array, sorted by compare_cost_thread() 
+'count' is the number of elements in the array 
+'gui' is the thread to search for. If it's NULL or has no thread info this function returns NULL.
+
+returns the matching cost thread or NULL if not found
+*/
+static struct cost_thread *find_cost_thread( 
+	const struct cost_thread *const array,   // in
+	const unsigned count,   // in
+	const struct gui *const gui   // in
+)
+{
+	struct cost_thread findme;
+	
+	
+	if( !count || !gui || !gui->sti )
+		return NULL;
+	
+	ZeroMemory( &findme, sizeof( findme ) );
+	
+	/* only the tid and create_time members are compared */
+	findme.tid = (uintptr_t)gui->sti->ClientId.UniqueThread;
+	findme.create_time = gui->sti->CreateTime.QuadPart;
+	
+	return bsearch( &findme, array, count, sizeof( *array ), compare_cost_thread );
+}
+
+
+
+/* get_cost_process() 
+Find the process of a cost thread in the cost store, or add it.
+
+If the process is found for the first time in the current generation its counts for the previous 
+snapshot are reset.
+
+returns the process
+*/
+static struct cost_process *get_cost_process( 
+	struct cost *const store,   // in
+	const struct cost_thread *const thread   // in
+)
+{
+	unsigned i = 0;
+	struct cost_process *process = NULL;
+	
+	FAIL_IF( !store );
+	FAIL_IF( !thread );
+	
+	
+	for( i = 0; i < store->process_count; ++i )
+	{
+		if( ( store->process[ i ].pid == thread->pid ) 
+			&& ( store->process[ i ].create_time == thread->process_create_time )
+		)
+			break;
+	}
+	
+	if( i == store->process_count )
+	{
+		if( store->process_count == store->process_max )
+		{
+			grow_cost_array( 
+				(void **)&store->process, 
+				&store->process_max, 
+				sizeof( *store->process )
+			);
+		}
+		
+		process = &store->process[ store->process_count++ ];
+		
+		process->pid = thread->pid;
+		process->create_time = thread->process_create_time;
+		process->name = copy_cost_name( thread->name, thread->name_cch );
+	}
+	else
+		process = &store->process[ i ];
+	
+	if( process->generation != store->generation )
+	{
+		process->generation = store->generation;
+		process->hook_count = 0;
+		process->cpu_last = 0;
+		process->switch_last = 0;
+	}
+	
+	return process;
+}
+
+
+
+/* get_cost_hook() 
+Find a hook in the cost store, or add it.
+
+If the hook is found for the first time in the current generation its counts for the previous 
+snapshot are reset.
+
+returns the hook
+*/
+static struct cost_hook *get_cost_hook( 
+	struct cost *const store,   // in
+	const struct hook *const hook   // in
+)
+{
+	unsigned i = 0;
+	struct cost_hook *item = NULL;
+	
+	FAIL_IF( !store );
+	FAIL_IF( !hook );
+	
+	
+	for( i = 0; i < store->hook_count; ++i )
+	{
+		if( ( store->hook[ i ].h == hook->object.head.h ) 
+			&& ( store->hook[ i ].pHead == hook->entry.pHead )
+		)
+			break;
+	}
+	
+	if( i == store->hook_count )
+	{
+		if( store->hook_count == store->hook_max )
+			grow_cost_array( (void **)&store->hook, &store->hook_max, sizeof( *store->hook ) );
+		
+		item = &store->hook[ store->hook_count++ ];
+		
+		item->h = hook->object.head.h;
+		item->pHead = hook->entry.pHead;
+		item->iHook = hook->object.iHook;
+		
+		if( hook->origin && hook->origin->spi )
+		{
+			item->pid = (uintptr_t)hook->origin->spi->UniqueProcessId;
+			item->name = copy_cost_name( 
+				hook->origin->spi->ImageName.Buffer, 
+				( hook->origin->spi->ImageName.Length / sizeof( WCHAR ) )
+			);
+		}
+	}
+	else
+		item = &store->hook[ i ];
+	
+	if( item->generation != store->generation )
+	{
+		item->generation = store->generation;
+		item->cpu_last = 0;
+		item->switch_last = 0;
+	}
+	
+	return item;
+}
+
+
+
+/* update_cost_store() 
+Account for the CPU time used by the hook threads since the previous snapshot.
+
+The owner and origin threads of each hook that wasn't ignored are collected from the snapshot, and 
+each thread's CPU time and context switches are compared to the same thread in the previous 
+snapshot. The increase is added to each hook the thread owns or originated, and once to the 
+thread's process. A thread that wasn't in the previous snapshot has no increase.
+
+Hooks and processes that don't have a hook thread in the snapshot aren't accounted for anymore.
+
+This function must only be called from the main thread.
+*/
+void update_cost_store( 
+	struct cost *const store,   // in
+	const struct snapshot *const snapshot   // in
+)
+{
+	unsigned i = 0, count = 0;
+	const struct desktop_hook_item *dh = NULL;
+	
+	FAIL_IF( !store );
+	FAIL_IF( !store->init_time );   // The cost store must be initialized.
+	FAIL_IF( !snapshot );
+	FAIL_IF( !snapshot->init_time );   // The snapshot store must be initialized.
+	
+	FAIL_IF( GetCurrentThreadId() != G->prog->dwMainThreadId );   // main thread only
+	
+	
+	++store->generation;
+	
+	/* the current threads become the previous threads */
+	{
+		struct cost_thread *const temp = store->previous;
+		const unsigned temp_max = store->previous_max;
+		
+		
+		store->previous = store->thread;
+		store->previous_max = store->thread_max;
+		store->previous_count = store->thread_count;
+		
+		store->thread = temp;
+		store->thread_max = temp_max;
+		store->thread_count = 0;
+	}
+	
+	store->previous_time = store->time;
+	store->time = snapshot->init_time_spi;
+	
+	
+	/* collect the owner and origin threads of each hook */
+	for( dh = snapshot->desktop_hooks->head; dh; dh = dh->next )
+	{
+		for( i = 0; i < dh->hook_count; ++i )
+		{
+			const struct gui *gui[ 2 ];
+			unsigned j = 0;
+			
+			
+			if( dh->hook[ i ].ignore )
+				continue;
+			
+			gui[ 0 ] = dh->hook[ i ].owner;
+			gui[ 1 ] = ( dh->hook[ i ].origin != dh->hook[ i ].owner ) ? dh->hook[ i ].origin : NULL;
+			
+			for( j = 0; j < 2; ++j )
+			{
+				struct cost_thread *thread = NULL;
+				
+				
+				if( !gui[ j ] || !gui[ j ]->spi || !gui[ j ]->sti )
+					continue;
+				
+				if( store->thread_count == store->thread_max )
+				{
+					grow_cost_array( 
+						(void **)&store->thread, 
+						&store->thread_max, 
+						sizeof( *store->thread )
+					);
+				}
+				
+				thread = &store->thread[ store->thread_count++ ];
+				
+				thread->tid = (uintptr_t)gui[ j ]->sti->ClientId.UniqueThread;
+				thread->create_time = gui[ j ]->sti->CreateTime.QuadPart;
+				thread->pid = (uintptr_t)gui[ j ]->spi->UniqueProcessId;
+				thread->process_create_time = gui[ j ]->spi->CreateTime.QuadPart;
+				thread->kernel_time = gui[ j ]->sti->KernelTime.QuadPart;
+				thread->user_time = gui[ j ]->sti->UserTime.QuadPart;
+				thread->context_switches = gui[ j ]->sti->ContextSwitches;
+				thread->name = gui[ j ]->spi->ImageName.Buffer;
+				thread->name_cch = gui[ j ]->spi->ImageName.Length / sizeof( WCHAR );
+				thread->cpu_delta = 0;
+				thread->switch_delta = 0;
+			}
+		}
+	}
+	
+	/* sort the threads and remove the duplicates */
+	qsort( store->thread, store->thread_count, sizeof( *store->thread ), compare_cost_thread );
+	
+	for( i = 0, count = 0; i < store->thread_count; ++i )
+	{
+		if( count && !compare_cost_thread( &store->thread[ count - 1 ], &store->thread[ i ] ) )
+			continue;
+		
+		store->thread[ count++ ] = store->thread[ i ];
+	}
+	
+	store->thread_count = count;
+	
+	
+	/* match each thread to the previous snapshot and add the increase to its process */
+	for( i = 0; i < store->thread_count; ++i )
+	{
+		struct cost_thread *const thread = &store->thread[ i ];
+		struct cost_process *const process = get_cost_process( store, thread );
+		const struct cost_thread *const previous = 
+			bsearch( 
+				thread, 
+				store->previous, 
+				store->previous_count, 
+				sizeof( *thread ), 
+				compare_cost_thread
+			);
+		
+		
+		if( previous 
+			&& ( thread->kernel_time >= previous->kernel_time ) 
+			&& ( thread->user_time >= previous->user_time )
+		)
+		{
+			thread->cpu_delta = 
+				( thread->kernel_time - previous->kernel_time ) 
+				+ ( thread->user_time - previous->user_time );
+			
+			/* the context switch count is a ULONG that can wrap */
+			thread->switch_delta = (ULONG)( thread->context_switches - previous->context_switches );
+		}
+		
+		process->cpu_last += thread->cpu_delta;
+		process->cpu_total += thread->cpu_delta;
+		process->switch_last += thread->switch_delta;
+		process->switch_total += thread->switch_delta;
+	}
+	
+	
+	/* add the increase of each hook's owner and origin threads to the hook */
+	for( dh = snapshot->desktop_hooks->head; dh; dh = dh->next )
+	{
+		for( i = 0; i < dh->hook_count; ++i )
+		{
+			const struct hook *const hook = &dh->hook[ i ];
+			const struct cost_thread *owner = NULL, *origin = NULL;
+			struct cost_hook *item = NULL;
+			
+			
+			if( hook->ignore )
+				continue;
+			
+			owner = find_cost_thread( store->thread, store->thread_count, hook->owner );
+			origin = find_cost_thread( store->thread, store->thread_count, hook->origin );
+			
+			if( !owner && !origin )
+				continue;
+			
+			if( origin == owner )
+				origin = NULL;
+			
+			item = get_cost_hook( store, hook );
+			
+			if( owner )
+			{
+				item->cpu_last += owner->cpu_delta;
+				item->switch_last += owner->switch_delta;
+				++get_cost_process( store, owner )->hook_count;
+			}
+			
+			if( origin )
+			{
+				item->cpu_last += origin->cpu_delta;
+				item->switch_last += origin->switch_delta;
+				
+				if( !owner 
+					|| ( owner->pid != origin->pid ) 
+					|| ( owner->process_create_time != origin->process_create_time )
+				)
+					++get_cost_process( store, origin )->hook_count;
+			}
+			
+			item->cpu_total += item->cpu_last;
+			item->switch_total += item->switch_last;
+		}
+	}
+	
+	
+	/* remove the hooks and processes that don't have a hook thread in the snapshot */
+	for( i = 0, count = 0; i < store->hook_count; ++i )
+	{
+		if( store->hook[ i ].generation != store->generation )
+		{
+			free( store->hook[ i ].name );
+			continue;
+		}
+		
+		store->hook[ count++ ] = store->hook[ i ];
+	}
+	
+	ZeroMemory( &store->hook[ count ], ( store->hook_count - count ) * sizeof( *store->hook ) );
+	store->hook_count = count;
+	
+	for( i = 0, count = 0; i < store->process_count; ++i )
+	{
+		if( store->process[ i ].generation != store->generation )
+		{
+			free( store->process[ i ].name );
+			continue;
+		}
+		
+		store->process[ count++ ] = store->process[ i ];
+	}
+	
+	ZeroMemory( &store->process[ count ], ( store->process_count - count ) * sizeof( *store->process ) );
+	store->process_count = count;
+	
+	return;
+}
+
+
+
+/* compare_cost_process() 
+Compare two cost processes by CPU time.
+
+qsort() callback: sort an array of pointers to cost processes, most CPU time first.
+*/
+static int compare_cost_process( 
+	const void *const p1,   // in
+	const void *const p2   // in
+)
+{
+	const struct cost_process *const a = *(const struct cost_process *const *)p1;
+	const struct cost_process *const b = *(const struct cost_process *const *)p2;
+	
+	
+	if( a->cpu_total != b->cpu_total )
+		return ( a->cpu_total < b->cpu_total ) ? 1 : -1;
+	
+	if( a->switch_total != b->switch_total )
+		return ( a->switch_total < b->switch_total ) ? 1 : -1;
+	
+	return 0;
+}
+
+
+
+/* compare_cost_hook() 
+Compare two cost hooks by CPU time.
+
+qsort() callback: sort an array of pointers to cost hooks, most CPU time first.
+*/
+static int compare_cost_hook( 
+	const void *const p1,   // in
+	const void *const p2   // in
+)
+{
+	const struct cost_hook *const a = *(const struct cost_hook *const *)p1;
+	const struct cost_hook *const b = *(const struct cost_hook *const *)p2;
+	
+	
+	if( a->cpu_total != b->cpu_total )
+		return ( a->cpu_total < b->cpu_total ) ? 1 : -1;
+	
+	if( a->switch_total != b->switch_total )
+		return ( a->switch_total < b->switch_total ) ? 1 : -1;
+	
+	return 0;
+}
+
+
+
+/* print_cost_report() 
+Print the most expensive hook owners and hooks.
+
+The processes and hooks are ranked by the CPU time their owner and origin threads used since they 
+were first found. At most COST_REPORT_ROWS of each are printed.
+
+cpu ms: the CPU time in milliseconds since the process or hook was first found 
+last ms: the CPU time in milliseconds since the previous snapshot 
+last cpu: the CPU time since the previous snapshot as a percentage of one processor 
+switches: the context switches since the process or hook was first found
+
+if 'store' is NULL this function returns without having printed anything.
+*/
+void print_cost_report( 
+	const struct cost *const store   // in
+)
+{
+	unsigned i = 0;
+	const struct cost_process **process = NULL;
+	const struct cost_hook **hook = NULL;
+	__int64 elapsed = 0;
+	
+	
+	if( !store )
+		return;
+	
+	FAIL_IF( !store->init_time );   // The cost store must be initialized.
+	
+	
+	/* the time between the previous and the current snapshot, in 100ns intervals */
+	elapsed = store->time - store->previous_time;
+	
+	process = must_calloc( store->process_count + 1, sizeof( *process ) );
+	
+	for( i = 0; i < store->process_count; ++i )
+		process[ i ] = &store->process[ i ];
+	
+	qsort( (void *)process, store->process_count, sizeof( *process ), compare_cost_process );
+	
+	hook = must_calloc( store->hook_count + 1, sizeof( *hook ) );
+	
+	for( i = 0; i < store->hook_count; ++i )
+		hook[ i ] = &store->hook[ i ];
+	
+	qsort( (void *)hook, store->hook_count, sizeof( *hook ), compare_cost_hook );
+	
+	
+	printf( "\nMost expensive hook owners (%u processes, %u threads):\n", 
+		store->process_count, 
+		store->thread_count
+	);
+	printf( "%10s %9s %8s %12s %6s  %s\n", 
+		"cpu ms", "last ms", "last cpu", "switches", "hooks", "process"
+	);
+	
+	for( i = 0; ( i < store->process_count ) && ( i < COST_REPORT_ROWS ); ++i )
+	{
+		printf( "%10I64d %9I64d %7.2f%% %12I64u %6u  %ls (PID %I64u)\n", 
+			( process[ i ]->cpu_total / COST_FILETIME_MS ), 
+			( process[ i ]->cpu_last / COST_FILETIME_MS ), 
+			( ( elapsed > 0 ) ? ( ( process[ i ]->cpu_last * 100.0 ) / elapsed ) : 0 ), 
+			process[ i ]->switch_total, 
+			process[ i ]->hook_count, 
+			( process[ i ]->name ? process[ i ]->name : L"<unknown>" ), 
+			process[ i ]->pid
+		);
+	}
+	
+	printf( "\nMost expensive hooks (%u hooks):\n", store->hook_count );
+	printf( "%10s %9s %12s  %-20s %s\n", 
+		"cpu ms", "last ms", "switches", "hook", "origin"
+	);
+	
+	for( i = 0; ( i < store->hook_count ) && ( i < COST_REPORT_ROWS ); ++i )
+	{
+		const unsigned index = (unsigned)( hook[ i ]->iHook + 1 ); /* the array index is the same as id + 1 */
+		
+		
+		printf( "%10I64d %9I64d %12I64u  %-20ls %ls (PID %I64u)\n", 
+			( hook[ i ]->cpu_total / COST_FILETIME_MS ), 
+			( hook[ i ]->cpu_last / COST_FILETIME_MS ), 
+			hook[ i ]->switch_total, 
+			( ( index < w_hooknames_count ) ? w_hooknames[ index ] : L"<unknown>" ), 
+			( hook[ i ]->name ? hook[ i ]->name : L"<unknown>" ), 
+			hook[ i ]->pid
+		);
+	}
+	
+	fflush( stdout );
+	free( (void *)process );
+	free( (void *)hook );
+	return;
+}
+
+
+
+/* print_cost_store() 
+Print a cost store.
+
+if 'store' is NULL this function returns without having printed anything.
+*/
+void print_cost_store( 
+	const struct cost *const store   // in
+)
+{
+	const char *const objname = "Cost Store";
+	
+	
+	if( !store )
+		return;
+	
+	PRINT_DBLSEP_BEGIN( objname );
+	print_init_time( "store->init_time", store->init_time );
+	
+	printf( "store->thread_count: %u\n", store->thread_count );
+	printf( "store->thread_max: %u\n", store->thread_max );
+	printf( "store->previous_count: %u\n", store->previous_count );
+	printf( "store->previous_max: %u\n", store->previous_max );
+	printf( "store->hook_count: %u\n", store->hook_count );
+	printf( "store->hook_max: %u\n", store->hook_max );
+	printf( "store->process_count: %u\n", store->process_count );
+	printf( "store->process_max: %u\n", store->process_max );
+	printf( "store->generation: %u\n", store->generation );
+	print_init_time( "store->time", store->time );
+	print_init_time( "store->previous_time", store->previous_time );
+	
+	PRINT_DBLSEP_END( objname );
+	
+	return;
+}
+
+
+
+/* free_cost_store() 
+Free a cost store and all its descendants.
+
+this function then sets the cost store pointer to NULL and returns
+
+'in' is a pointer to a pointer to the cost store.
+if( !in || !*in ) then this function returns.
+*/
+void free_cost_store( 
+	struct cost **const in   // in deref
+)
+{
+	unsigned i = 0;
+	
+	
+	if( !in || !*in )
+		return;
+	
+	for( i = 0; i < (*in)->hook_count; ++i )
+		free( (*in)->hook[ i ].name );
+	
+	for( i = 0; i < (*in)->process_count; ++i )
+		free( (*in)->process[ i ].name );
+	
+	free( (*in)->thread );
+	free( (*in)->previous );
+	free( (*in)->hook );
+	free( (*in)->process );
+	
+	free( (*in) );
+	*in = NULL;
+	
+	return;
+}
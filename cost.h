@@ -0,0 +1,201 @@
+/*
+Copyright (C) 2011 Jay Satiro <raysatiro@yahoo.com>
+All rights reserved.
+
+This file is part of GetHooks.
+
+GetHooks is free software: you can redistribute it and/or modify 
+it under the terms of the GNU General Public License as published by 
+the Free Software Foundation, either version 3 of the License, or 
+(at your option) any later version.
+
+GetHooks is distributed in the hope that it will be useful, 
+but WITHOUT ANY WARRANTY; without even the implied warranty of 
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License 
+along with GetHooks.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _COST_H
+#define _COST_H
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include "portable.h"
+#endif
+
+/* snapshot store (system process info, gui threads, desktop hooks) */
+#include "snapshot.h"
+
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/** This is the CPU counters of a hook owner or origin thread in a snapshot.
+A thread is identified by its thread id and creation time.
+*/
+struct cost_thread
+{
+	unsigned __int64 tid;
+	__int64 create_time;
+	
+	/* the thread's process id and the process creation time */
+	unsigned __int64 pid;
+	__int64 process_create_time;
+	
+	/* the thread's counters from SYSTEM_THREAD_INFORMATION. times are in 100ns intervals. */
+	__int64 kernel_time;
+	__int64 user_time;
+	ULONG context_switches;
+	
+	/* the thread's process image name. this points into the snapshot's spi buffer and is only valid 
+	while update_cost_store() is processing that snapshot.
+	*/
+	const WCHAR *name;
+	unsigned name_cch;
+	
+	/* the increase in the thread's CPU time and context switches since the previous snapshot.
+	these are 0 if the thread wasn't in the previous snapshot.
+	*/
+	__int64 cpu_delta;
+	unsigned __int64 switch_delta;
+};
+
+
+
+/** This is the accumulated CPU cost of a hook's owner and origin threads.
+A hook is identified by its handle and the address of its handle entry.
+*/
+struct cost_hook
+{
+	HANDLE h;
+	void *pHead;
+	INT iHook;
+	
+	/* the origin thread's process id and process image name */
+	unsigned __int64 pid;
+	WCHAR *name;   // calloc(), free()
+	
+	/* the snapshot generation in which the hook was last found */
+	unsigned generation;
+	
+	/* the CPU time in 100ns intervals and the context switches, since the hook was first found and 
+	since the previous snapshot
+	*/
+	__int64 cpu_total;
+	__int64 cpu_last;
+	unsigned __int64 switch_total;
+	unsigned __int64 switch_last;
+};
+
+
+
+/** This is the accumulated CPU cost of the hook owner and origin threads in a process.
+A process is identified by its process id and creation time. Each thread is counted once per 
+snapshot regardless of how many hooks it owns or originated.
+*/
+struct cost_process
+{
+	unsigned __int64 pid;
+	__int64 create_time;
+	WCHAR *name;   // calloc(), free()
+	
+	/* the snapshot generation in which the process last had a hook thread */
+	unsigned generation;
+	
+	/* the number of hooks with an owner or origin thread in the process in the last snapshot */
+	unsigned hook_count;
+	
+	/* the CPU time in 100ns intervals and the context switches, since the process was first found 
+	and since the previous snapshot
+	*/
+	__int64 cpu_total;
+	__int64 cpu_last;
+	unsigned __int64 switch_total;
+	unsigned __int64 switch_last;
+};
+
+
+
+/** The cost store.
+The cost store accounts for the CPU time used by the owner and origin threads of each hook between 
+snapshots. It uses only the thread info already in each snapshot.
+*/
+struct cost
+{
+	/* the hook threads in the current and the previous snapshot, sorted by thread id and creation 
+	time. the arrays are swapped for each snapshot.
+	*/
+	struct cost_thread *thread;   // calloc(), free()
+	unsigned thread_count;
+	unsigned thread_max;
+	
+	struct cost_thread *previous;   // calloc(), free()
+	unsigned previous_count;
+	unsigned previous_max;
+	
+	/* the hooks being accounted for */
+	struct cost_hook *hook;   // calloc(), free()
+	unsigned hook_count;
+	unsigned hook_max;
+	
+	/* the processes being accounted for */
+	struct cost_process *process;   // calloc(), free()
+	unsigned process_count;
+	unsigned process_max;
+	
+	/* the current snapshot generation. see update_cost_store() */
+	unsigned generation;
+	
+	/* the spi init time of the current and the previous snapshot */
+	__int64 time;
+	__int64 previous_time;
+	
+	/* the system utc time in FILETIME format immediately after this store has been initialized.
+	this is nonzero when this store has been initialized.
+	*/
+	__int64 init_time;
+};
+
+
+
+/** 
+these functions are documented in the comment block above their definitions in cost.c
+*/
+void create_cost_store( 
+	struct cost **const out   // out deref
+);
+
+int init_cost_store( 
+	struct cost *const store   // in
+);
+
+void update_cost_store( 
+	struct cost *const store,   // in
+	const struct snapshot *const snapshot   // in
+);
+
+void print_cost_report( 
+	const struct cost *const store   // in
+);
+
+void print_cost_store( 
+	const struct cost *const store   // in
+);
+
+void free_cost_store( 
+	struct cost **const in   // in deref
+);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _COST_H
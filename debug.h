@@ -21,7 +21,11 @@ along with GetHooks.  If not, see <http://www.gnu.org/licenses/>.
 #ifndef _DEBUG_H
 #define _DEBUG_H
 
+#ifdef _WIN32
 #include <windows.h>
+#else
+#include "portable.h"
+#endif
 
 
 
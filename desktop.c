@@ -19,7 +19,7 @@ along with GetHooks.  If not, see <http://www.gnu.org/licenses/>.
 */
 
 /** 
-This file contains functions for a desktop store (linked list of desktops' heap and thread info).
+This file contains functions for a desktop store (table of desktops' heap and thread info).
 Each function is documented in the comment block above its definition.
 
 For now there is only one desktop store implemented and it's a global store (G->desktops).
@@ -45,10 +45,16 @@ This is the worker thread main function.
 Calls attach() to attach to a desktop.
 -
 
+-
+append_desktop_item()
+
+Append a copy of a desktop item to a desktop store's table.
+-
+
 -
 add_desktop_item()
 
-Create a desktop item, attach to a desktop, and append the item to the desktop store's linked list.
+Create a desktop item, attach to a desktop, and append the item to the desktop store's table.
 Calls _beginthreadex() to call thread(), or calls attach() directly.
 -
 
@@ -76,7 +82,7 @@ Calls add_all_desktops(), or calls add_desktop_item() for each desktop if not ad
 -
 print_desktop_item()
 
-Print an item from a desktop store's linked list.
+Print an item from a desktop store's table.
 -
 
 -
@@ -94,7 +100,7 @@ Print the global desktop store and all its descendants.
 -
 free_desktop_item()
 
-Free a desktop item (dirty -- linked list isn't updated).
+Free the resources of a desktop item.
 -
 
 -
@@ -108,7 +114,9 @@ Free a desktop store and all its descendants.
 #define _CRT_SECURE_NO_WARNINGS
 
 #include <stdio.h>
+#ifdef _WIN32
 #include <process.h>
+#endif
 
 #include "util.h"
 
@@ -119,6 +127,8 @@ Free a desktop store and all its descendants.
 
 
 
+/* Desktops are only attached to on Windows. Other systems only use the store offline. */
+#ifdef _WIN32
 static int attach( 
 	struct desktop_item *d   // in, out
 );
@@ -140,13 +150,14 @@ static BOOL CALLBACK EnumDesktopProc(
 static int add_all_desktops( 
 	struct desktop_list *store   // out
 );
+#endif // _WIN32
 
 static void print_desktop_store( 
 	const struct desktop_list *const store   // in
 );
 
 static void free_desktop_item( 
-	struct desktop_item **const in   // in deref
+	struct desktop_item *const item   // in
 );
 
 
@@ -174,6 +185,7 @@ void create_desktop_store(
 
 
 
+#ifdef _WIN32
 /* attach()
 Attach the calling thread to a desktop and record its heap info in a desktop item.
 Calls SetThreadDesktop().
@@ -423,11 +435,65 @@ static unsigned __stdcall thread(
 	
 	return 0; /* doesn't matter right now, as long as it's != STILL_ACTIVE (259) */
 }
+#endif // _WIN32
 
 
 
+/* append_desktop_item() 
+Append a copy of a desktop item to a desktop store's table.
+
+The store takes over the item's resources (its name, handles and worker thread), so the caller 
+must not free them. If the table is full it's doubled and moved.
+
+returns a pointer to the item in the table. the pointer is only valid until the next item is added.
+*/
+struct desktop_item *append_desktop_item( 
+	struct desktop_list *const store,   // in
+	const struct desktop_item *const item   // in
+)
+{
+	struct desktop_item *d = NULL;
+	
+	FAIL_IF( !store );
+	FAIL_IF( !item );
+	
+	
+	if( store->count >= store->max )
+	{
+		unsigned i = 0;
+		const unsigned max = ( store->max ? ( store->max * 2 ) : 8 );
+		
+		store->item = must_recalloc( store->item, store->max, max, sizeof( *store->item ) );
+		store->max = max;
+		
+		/* the table moved. link the items again. */
+		for( i = 1; i < store->count; ++i )
+			store->item[ i - 1 ].next = &store->item[ i ];
+		
+		store->head = ( store->count ? &store->item[ 0 ] : NULL );
+		store->tail = ( store->count ? &store->item[ store->count - 1 ] : NULL );
+	}
+	
+	d = &store->item[ store->count ];
+	*d = *item;
+	d->next = NULL;
+	
+	if( store->tail )
+		store->tail->next = d;
+	
+	++store->count;
+	
+	store->head = &store->item[ 0 ];
+	store->tail = d;
+	
+	return d;
+}
+
+
+
+#ifdef _WIN32
 /* add_desktop_item()
-Create a desktop item, attach to a desktop, and append the item to the desktop store's linked list.
+Create a desktop item, attach to a desktop, and append the item to the desktop store's table.
 Calls _beginthreadex() to call thread(), or calls attach() directly.
 
 This should only be called from the main thread.
@@ -451,6 +517,7 @@ static struct desktop_item *add_desktop_item(
 	const WCHAR *name   // in, optional
 )
 {
+	unsigned i = 0;
 	HDESK hMainDesktop = NULL;
 	WCHAR *pwszMainDesktopName = NULL;
 	struct desktop_item *current = NULL;
@@ -486,8 +553,10 @@ static struct desktop_item *add_desktop_item(
 	hMainDesktop = NULL;
 	
 	/* check if there is already an entry for this desktop */
-	for( current = store->head; current; current = current->next )
+	for( i = 0; i < store->count; ++i )
 	{
+		current = &store->item[ i ];
+		
 		if( current->pwszDesktopName && !_wcsicmp( name, current->pwszDesktopName ) )
 		{
 			if( G->config->verbose >= 1 )
@@ -581,18 +650,12 @@ static struct desktop_item *add_desktop_item(
 		d->pwszDesktopName = must_wcsdup( pwszMainDesktopName );
 	}
 	
-	/* the desktop item is initialized. add the new item to the end of the list */
-	
-	if( !store->head )
-	{
-		store->head = d;
-		store->tail = d;
-	}
-	else
-	{
-		store->tail->next = d;
-		store->tail = d;
-	}
+	/* the desktop item is initialized. the worker thread doesn't use it anymore so it's copied to 
+	the end of the table.
+	*/
+	current = append_desktop_item( store, d );
+	free( d );
+	d = current;
 	
 	goto cleanup;
 	
@@ -600,7 +663,9 @@ fail:
 	/* freeing the desktop item frees all its associated resources except 
 	hEventTerminate which is freed by the worker thread before terminating
 	*/
-	free_desktop_item( &d );
+	free_desktop_item( d );
+	free( d );
+	d = NULL;
 	
 cleanup:
 	
@@ -672,7 +737,6 @@ static int add_all_desktops(
 {
 	int count = 0;
 	HWINSTA station = NULL;
-	struct desktop_item *d = NULL;
 	
 	FAIL_IF( !store );
 	
@@ -736,8 +800,7 @@ static int add_all_desktops(
 	station = NULL;
 	
 	/* count how many desktops this store is now attached to */
-	for( d = store->head; d; d = d->next )
-		++count;
+	count = (int)store->count;
 	
 	return count;
 }
@@ -822,11 +885,12 @@ void init_global_desktop_store( void )
 	GetSystemTimeAsFileTime( (FILETIME *)&G->desktops->init_time );
 	return;
 }
+#endif // _WIN32
 
 
 
 /* print_desktop_item()
-Print an item from a desktop store's linked list.
+Print an item from a desktop store's table.
 
 if 'item' is NULL this function returns without having printed anything.
 */
@@ -871,7 +935,7 @@ static void print_desktop_store(
 )
 {
 	const char *const objname = "Desktop List Store";
-	struct desktop_item *item = NULL;
+	unsigned i = 0;
 	
 	
 	if( !store )
@@ -900,14 +964,13 @@ static void print_desktop_store(
 	}
 	printf( "\n" );
 	
-	//printf( "\nNow printing the desktop items in the list from head to tail.\n " );
+	printf( "store->count: %u\n", store->count );
+	printf( "store->max: %u\n", store->max );
+	
 	PRINT_HEX( store->head );
 	
-	for( item = store->head; item; item = item->next )
-	{
-		//PRINT_HEX( item );
-		print_desktop_item( item );
-	}
+	for( i = 0; i < store->count; ++i )
+		print_desktop_item( &store->item[ i ] );
 	
 	PRINT_HEX( store->tail );
 	
@@ -930,28 +993,30 @@ void print_global_desktop_store( void )
 
 
 /* free_desktop_item()
-Free a desktop item (dirty -- linked list isn't updated).
+Free the resources of a desktop item.
 
-this function then sets the desktop item pointer to NULL and returns.
+the item itself isn't freed. it's either part of a desktop store's table, which is freed by 
+free_desktop_store(), or it's an item that add_desktop_item() failed to initialize.
 
-this function has no regard for the other items in the list and should only be called by 
+this function has no regard for the other items in the table and should only be called by 
 free_desktop_store() or add_desktop_item().
 
-'in' is a pointer to a pointer to the desktop item, which contains desktop heap information.
-if( !in || !*in ) then this function returns.
+'item' is the desktop item, which contains desktop heap information.
+if( !item ) then this function returns.
 */
 static void free_desktop_item( 
-	struct desktop_item **const in   // in deref
+	struct desktop_item *const item   // in
 )
 {
-	if( !in || !*in )
+	if( !item )
 		return;
 	
+#ifdef _WIN32
 	// if the thread is alive then both hThread and hEventTerminate are != NULL and not signaled.
-	if( (*in)->hThread && (*in)->hEventTerminate ) // active worker thread
+	if( item->hThread && item->hEventTerminate ) // active worker thread
 	{
 		/* signal the worker thread to terminate */
-		if( !SetEvent( (*in)->hEventTerminate ) )
+		if( !SetEvent( item->hEventTerminate ) )
 		{
 			MSG_FATAL_GLE( "SetEvent() failed." );
 			printf( "Failed to signal the worker thread's termination event.\n" );
@@ -960,7 +1025,7 @@ static void free_desktop_item(
 		
 		/* wait for the worker thread to terminate. maybe always do this. */
 		SetLastError( 0 ); // error code is not set by WaitForSingleObject() unless WAIT_FAILED
-		if( WaitForSingleObject( (*in)->hThread, INFINITE ) )
+		if( WaitForSingleObject( item->hThread, INFINITE ) )
 		{
 			MSG_FATAL_GLE( "WaitForSingleObject() failed." );
 			printf( "Failed to wait for a worker thread to terminate.\n" );
@@ -970,17 +1035,19 @@ static void free_desktop_item(
 	
 	/* The hEventTerminate event handle is closed by the worker thread before it terminates. */
 	
-	if( (*in)->hThread )
-		CloseHandle( (*in)->hThread );
+	if( item->hThread )
+		CloseHandle( item->hThread );
 	
-	free( (*in)->pwszDesktopName );
+	free( item->pwszDesktopName );
 	
 	/* the handle to the desktop should be closed after the thread's other resources are freed */
-	if( (*in)->hDesktop )
-		FAIL_IF( !CloseDesktop( (*in)->hDesktop ) ); // thread has terminated so this should work
+	if( item->hDesktop )
+		FAIL_IF( !CloseDesktop( item->hDesktop ) ); // thread has terminated so this should work
+#else
+	free( item->pwszDesktopName );
+#endif // _WIN32
 	
-	free( (*in) );
-	*in = NULL;
+	ZeroMemory( item, sizeof( *item ) );
 	
 	return;
 }
@@ -992,7 +1059,7 @@ Free a desktop store and all its descendants.
 
 this function then sets the desktop store pointer to NULL and returns
 
-'in' is a pointer to a pointer to the desktop store, which contains a linked list of desktop heap 
+'in' is a pointer to a pointer to the desktop store, which contains a table of desktop heap 
 information.
 if( !in || !*in ) then this function returns.
 */
@@ -1000,20 +1067,15 @@ void free_desktop_store(
 	struct desktop_list **const in   // in deref
 )
 {
+	unsigned i = 0;
+	
 	if( !in || !*in )
 		return;
 	
-	if( (*in)->head )
-	{
-		struct desktop_item *current = NULL, *p = NULL;
-		
-		for( current = (*in)->head; current; current = p )
-		{
-			p = current->next;
-			
-			free_desktop_item( &current );
-		}
-	}
+	for( i = 0; i < (*in)->count; ++i )
+		free_desktop_item( &(*in)->item[ i ] );
+	
+	free( (*in)->item );
 	
 	free( (*in) );
 	*in = NULL;
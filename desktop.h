@@ -21,7 +21,11 @@ along with GetHooks.  If not, see <http://www.gnu.org/licenses/>.
 #ifndef _DESKTOP_H
 #define _DESKTOP_H
 
+#ifdef _WIN32
 #include <windows.h>
+#else
+#include "portable.h"
+#endif
 
 #include "reactos.h"
 
@@ -77,7 +81,9 @@ struct desktop_item
 	//const void *pDeskInfo;
 	const DESKTOPINFO *pDeskInfo;
 	
-	/* The next item in the list */
+	/* The next item in the list. This is the next element in the table, or NULL for the last.
+	It's kept for the code that walks the list from its head. see struct desktop_list
+	*/
 	struct desktop_item *next;
 };
 
@@ -97,14 +103,29 @@ enum desktop_type
 
 
 /** The desktop store. 
-The desktop store holds a linked list of attached to desktops and their associated heaps.
+The desktop store holds a table of attached to desktops and their associated heaps.
+
+The items are contiguous and in the order they were added. An item's index never changes since 
+items aren't removed, but the table is moved when it grows so a pointer to an item is only valid 
+until the next item is added. All the desktops are added before the store is used, so the desktop 
+hook stores point to items that don't move. The table can also be walked through the head/next 
+adapters. see struct list in list.h
 */
 struct desktop_list
 {
-	/* linked list of desktop_item. this is a pointer to the first item in the desktop list. */
-	struct desktop_item *head;   // items calloc'd. the list is freed when the store is freed.
+	/* the table of desktop items */
+	struct desktop_item *item;   // calloc(), free()
+	
+	/* the allocated/maximum number of items in the table */
+	unsigned max;
+	
+	/* the number of items in the table */
+	unsigned count;
 	
-	/* the last item in the desktop list */
+	/* this is a pointer to the first item in the table, or NULL if there are none. */
+	struct desktop_item *head;
+	
+	/* the last item in the table */
 	struct desktop_item *tail;
 	
 	/* the desktop list type */
@@ -125,6 +146,11 @@ void create_desktop_store(
 	struct desktop_list **const out   // out deref
 );
 
+struct desktop_item *append_desktop_item( 
+	struct desktop_list *const store,   // in
+	const struct desktop_item *const item   // in
+);
+
 void init_global_desktop_store( void );
 
 void print_desktop_item( 
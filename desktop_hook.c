@@ -19,7 +19,7 @@ along with GetHooks.  If not, see <http://www.gnu.org/licenses/>.
 */
 
 /** 
-This file contains functions for a desktop hook store (linked list of desktop and hook information).
+This file contains functions for a desktop hook store (table of desktop and hook information).
 Each function is documented in the comment block above its definition.
 
 There are multiple desktop hook stores: Each snapshot has its own desktop hook store.
@@ -31,10 +31,16 @@ create_desktop_hook_store()
 Create a desktop hook store and its descendants or die.
 -
 
+-
+link_desktop_hook_items()
+
+Link the items in a desktop hook store's table from head to tail.
+-
+
 -
 add_desktop_hook_item()
 
-Create a desktop hook item and append it to the desktop hook store's linked list.
+Create a desktop hook item and append it to the desktop hook store's table.
 -
 
 -
@@ -79,6 +85,30 @@ init_desktop_hook_store()
 Initialize the desktop hook store by recording the hooks for each desktop.
 -
 
+-
+resolve_desktop_hook_store()
+
+Identify the threads of each hook again after the parent snapshot's gui array has changed.
+-
+
+-
+get_hook_anomalies()
+
+Get the anomaly bits of a hook struct.
+-
+
+-
+set_hook_anomalies()
+
+Set the anomaly bits of each hook in a desktop hook item's array of hook structs.
+-
+
+-
+print_hook_anomaly_names()
+
+Print the names of HOOK_ANOMALY_* bits. No newline.
+-
+
 -
 print_hook_anomalies()
 
@@ -100,7 +130,7 @@ Print a desktop hook item's array of hook structs.
 -
 print_desktop_hook_item()
 
-Print an item from a desktop hook store's linked list.
+Print an item from a desktop hook store's table.
 -
 
 -
@@ -112,7 +142,7 @@ Print a desktop hook store and all its descendants.
 -
 free_desktop_hook_item()
 
-Free a desktop hook item (dirty -- linked list isn't updated).
+Free the resources of an item in a desktop hook store's table.
 -
 
 -
@@ -131,18 +161,34 @@ Free a desktop hook store and all its descendants.
 
 #include "desktop_hook.h"
 
+/* the desktop heap occupancy is estimated in the same pass over the handle table */
+#include "occupancy.h"
+
+/* get_governor_retry_delay() */
+#include "governor.h"
+
 /* the global stores */
 #include "global.h"
 
 
 
-static struct desktop_hook_item *add_desktop_hook_item(
-	struct desktop_hook_list *const store,   // in
-	struct desktop_item *const desktop   // in
+/* the ids of the HOOKs that are supposed to be global-only, as bits shifted by ( id - WH_MIN ) */
+#define HOOK_GLOBAL_ONLY_IDS   \
+	( ( 1u << ( WH_JOURNALRECORD - WH_MIN ) ) | ( 1u << ( WH_JOURNALPLAYBACK - WH_MIN ) ) \
+		| ( 1u << ( WH_SYSMSGFILTER - WH_MIN ) ) | ( 1u << ( WH_KEYBOARD_LL - WH_MIN ) ) \
+		| ( 1u << ( WH_MOUSE_LL - WH_MIN ) ) )
+
+/* 'bit' if 'cond' is nonzero, otherwise 0. 'cond' is evaluated without branching. */
+#define HOOK_ANOMALY_IF( bit, cond )   ( ( bit ) & ( 0u - (unsigned)!!( cond ) ) )
+
+
+
+static void link_desktop_hook_items( 
+	struct desktop_hook_list *const store   // in
 );
 
 static void free_desktop_hook_item( 
-	struct desktop_hook_item **const in   // in deref
+	struct desktop_hook_item *const item   // in
 );
 
 
@@ -170,38 +216,89 @@ void create_desktop_hook_store(
 
 
 
+/* link_desktop_hook_items() 
+Link the items in a desktop hook store's table from head to tail.
+
+This must be called when the table has moved.
+*/
+static void link_desktop_hook_items( 
+	struct desktop_hook_list *const store   // in
+)
+{
+	unsigned i = 0;
+	
+	FAIL_IF( !store );
+	
+	
+	for( i = 1; i < store->count; ++i )
+		store->item[ i - 1 ].next = &store->item[ i ];
+	
+	if( store->count )
+		store->item[ store->count - 1 ].next = NULL;
+	
+	store->head = ( store->count ? &store->item[ 0 ] : NULL );
+	store->tail = ( store->count ? &store->item[ store->count - 1 ] : NULL );
+	
+	return;
+}
+
+
+
 /* add_desktop_hook_item()
-Create a desktop hook item and append it to the desktop hook store's linked list.
+Create a desktop hook item and append it to the desktop hook store's table.
+
+The heap range of the desktop is recorded in the range table at the same index.
 
-returns on success a pointer to the desktop hook item that was added to the list.
+returns on success a pointer to the desktop hook item that was added to the table.
 if there is already an existing item with the same desktop a pointer to it is returned.
+the pointer is only valid until the next item is added.
 returns NULL on fail
 */
-static struct desktop_hook_item *add_desktop_hook_item(
+struct desktop_hook_item *add_desktop_hook_item( 
 	struct desktop_hook_list *const store,   // in
 	struct desktop_item *const desktop   // in
 )
 {
+	unsigned i = 0;
 	struct desktop_hook_item *item = NULL;
+	struct desktop_hook_range *range = NULL;
 	
 	FAIL_IF( !store );
 	FAIL_IF( !desktop );
 	
 	
 	/* check if there is already an entry for this desktop */
-	for( item = store->head; item; item = item->next )
+	for( i = 0; i < store->count; ++i )
 	{
-		if( item->desktop == desktop )
-			return item;
+		if( store->item[ i ].desktop == desktop )
+			return &store->item[ i ];
 	}
 	
 	
-	/* create a new item and add it to the list */
+	/* add a new item to the end of the table. if the table is full it's doubled and moved. */
+	
+	if( store->count >= store->max )
+	{
+		const unsigned max = ( store->max ? ( store->max * 2 ) : 8 );
+		
+		store->item = must_recalloc( store->item, store->max, max, sizeof( *store->item ) );
+		store->range = must_recalloc( store->range, store->max, max, sizeof( *store->range ) );
+		store->max = max;
+		
+		link_desktop_hook_items( store );
+	}
 	
-	item = must_calloc( 1, sizeof( *item ) );
+	item = &store->item[ store->count ];
+	range = &store->range[ store->count ];
 	
 	item->desktop = desktop;
 	
+	if( desktop->pDeskInfo )
+	{
+		range->base = (uintptr_t)desktop->pDeskInfo->pvDesktopBase;
+		range->limit = (uintptr_t)desktop->pDeskInfo->pvDesktopLimit - sizeof( HOOK );
+	}
+	
 	/* the allocated/maximum number of elements in the array pointed to by hook.
 	
 	65535 is the maximum number of user objects
@@ -214,18 +311,17 @@ static struct desktop_hook_item *add_desktop_hook_item(
 	item->hook = must_calloc( item->hook_max, sizeof( *item->hook ) );
 	
 	
-	/* the desktop hook item is initialized. add the new item to the end of the list */
+	/* the desktop hook item is initialized. link it after the last item. */
 	
-	if( !store->head )
-	{
-		store->head = item;
-		store->tail = item;
-	}
-	else
-	{
+	item->next = NULL;
+	
+	if( store->tail )
 		store->tail->next = item;
-		store->tail = item;
-	}
+	
+	++store->count;
+	
+	store->head = &store->item[ 0 ];
+	store->tail = item;
 	
 	return item;
 }
@@ -323,12 +419,12 @@ int is_HOOK_id_wanted(
 		)
 	)
 	{
-		unsigned yes = 0;
-		const struct list_item *item = NULL;
+		unsigned i = 0, yes = 0;
+		const struct list *const list = G->config->hooklist;
 		
 		
-		for( item = G->config->hooklist->head; ( item && !yes ); item = item->next )
-			yes = ( item->id == id ); // match HOOK id
+		for( i = 0; ( i < list->count ) && !yes; ++i )
+			yes = ( list->item[ i ].id == id ); // match HOOK id
 		
 		if( ( yes && ( G->config->hooklist->type == LIST_EXCLUDE_HOOK ) )
 			|| ( !yes && ( G->config->hooklist->type == LIST_INCLUDE_HOOK ) )
@@ -348,7 +444,7 @@ The user can filter hooks (eg WH_MOUSE) and programs (eg notepad.exe).
 
 init_desktop_hook_store() calls this function to set hook->ignore when initializing each hook.
 
-This function should not access hook->ignore.
+This function should not access hook->ignore or hook->anomalies, which may not be set yet.
 
 returns nonzero if the hook struct should be processed
 */
@@ -409,12 +505,14 @@ int is_hook_wanted(
 		)
 	)
 	{
-		unsigned yes = 0;
-		const struct list_item *item = NULL;
+		unsigned i = 0, yes = 0;
+		const struct list *const list = G->config->proglist;
 		
 		
-		for( item = G->config->proglist->head; ( item && !yes ); item = item->next )
+		for( i = 0; ( i < list->count ) && !yes; ++i )
 		{
+			const struct list_item *const item = &list->item[ i ];
+			
 			if( item->name ) // match program name
 				yes = !!match_hook_process_name( hook, item->name );
 			else // match PID/TID
@@ -483,6 +581,8 @@ int compare_hook(
 
 
 
+/* The hooks are only read from the desktop heaps on Windows. */
+#ifdef _WIN32
 /* init_desktop_hook_store()
 Initialize the desktop hook store by recording the hooks for each desktop.
 
@@ -496,11 +596,15 @@ int init_desktop_hook_store(
 	const struct snapshot *const parent   // in
 )
 {
-	unsigned i = 0;
+	unsigned i = 0, d = 0;
 	__int64 first_fail_time = 0;
+	unsigned retry_count = 0;
 	struct desktop_hook_list *store = NULL;
 	struct desktop_hook_item *item = NULL;
 	
+	/* nonzero if the USER objects are counted for the desktop heap occupancy */
+	unsigned occupancy = 0;
+	
 	FAIL_IF( !G );   // The global store must exist.
 	FAIL_IF( !G->prog->init_time );   // The program store must be initialized.
 	FAIL_IF( !G->config->init_time );   // The configuration store must be initialized.
@@ -508,13 +612,22 @@ int init_desktop_hook_store(
 	
 	FAIL_IF( !parent );   // The snapshot parent of the desktop_hook store must always be passed in.
 	
-	/*  valid spi and gui arrays are expected if passive mode isn't enabled */
-	FAIL_IF( !parent->init_time_spi && !( G->config->flags & CFG_COMPLETELY_PASSIVE ) );
-	FAIL_IF( !parent->init_time_gui && !( G->config->flags & CFG_COMPLETELY_PASSIVE ) );
+	/*  valid spi and gui arrays are expected if passive mode isn't enabled, unless the parent is a 
+	hooks only snapshot store (no gui array). see create_hook_snapshot_store()
+	*/
+	FAIL_IF( !parent->init_time_spi && parent->gui_max 
+		&& !( G->config->flags & CFG_COMPLETELY_PASSIVE )
+	);
+	FAIL_IF( !parent->init_time_gui && parent->gui_max 
+		&& !( G->config->flags & CFG_COMPLETELY_PASSIVE )
+	);
 	
 	FAIL_IF( GetCurrentThreadId() != G->prog->dwMainThreadId );   // main thread only
 	
 	
+	/* only the handle tables of full snapshots are counted, not those of hooks only snapshots */
+	occupancy = ( G->occupancy->init_time && parent->gui_max );
+	
 retry:
 	item = NULL;
 	store = parent->desktop_hooks;
@@ -522,25 +635,24 @@ retry:
 	/* this store is reused. do a soft reset */
 	store->init_time = 0;
 	
-	/* if the desktop hook store does not have a list of desktops yet create it */
-	if( !store->head )
+	/* if the desktop hook store does not have a table of desktops yet create it */
+	if( !store->count )
 	{
-		struct desktop_item *current = NULL;
-		
 		/* add the desktops from the global desktop store */
-		for( current = G->desktops->head; current; current = current->next )
-			add_desktop_hook_item( store, current );
+		for( i = 0; i < G->desktops->count; ++i )
+			add_desktop_hook_item( store, &G->desktops->item[ i ] );
 	}
-	else // the desktop hook list already exists. reuse it.
+	else // the desktop hook table already exists. reuse it.
 	{
-		struct desktop_hook_item *current = NULL;
-		
 		/* soft reset on each desktop hook item's array of hooks */
-		for( current = store->head; current; current = current->next )
-			current->hook_count = 0; // soft reset of hook array
+		for( i = 0; i < store->count; ++i )
+			store->item[ i ].hook_count = 0; // soft reset of hook array
 	}
 	
 	
+	if( occupancy )
+		begin_occupancy_pass( G->occupancy );
+	
 	SwitchToThread();
 	/* for every handle if it is a HOOK then add it to the desktop's hook array */
 	for( i = 0; i < *G->prog->pcHandleEntries; ++i )
@@ -558,20 +670,23 @@ retry:
 			print_HANDLEENTRY( &entry );
 		}
 		
+		if( occupancy )
+			add_occupancy_object( G->occupancy, &entry );
+		
 		if( entry.bType != TYPE_HOOK ) /* not for a HOOK object */
 			continue;
 		
 		/* Check to see if the HOOK is located on a desktop we're attached to */
-		for( item = store->head; item; item = item->next )
+		for( d = 0; d < store->count; ++d )
 		{
-			if( ( (uintptr_t)entry.pHead 
-					< ( (uintptr_t)item->desktop->pDeskInfo->pvDesktopLimit - sizeof( HOOK ) ) 
-				)
-				&& ( (uintptr_t)entry.pHead >= (uintptr_t)item->desktop->pDeskInfo->pvDesktopBase )
+			if( ( (uintptr_t)entry.pHead < store->range[ d ].limit ) 
+				&& ( (uintptr_t)entry.pHead >= store->range[ d ].base )
 			) /* The HOOK is on an accessible desktop */
 				break;
 		}
 		
+		item = ( ( d < store->count ) ? &store->item[ d ] : NULL );
+		
 		if( !item ) /* The HOOK is on an inaccessible desktop */
 		{
 			if( G->config->verbose >= 9 )
@@ -630,10 +745,28 @@ retry:
 		}
 	}
 	
+	if( occupancy )
+		end_occupancy_pass( G->occupancy );
+	
+	
+	/* copy the start of each desktop's global hook chains. see check_chain_store() */
+	for( d = 0; d < store->count; ++d )
+	{
+		item = &store->item[ d ];
+		
+		memcpy( 
+			item->aphkStart, 
+			(const void *)item->desktop->pDeskInfo->aphkStart, 
+			sizeof( item->aphkStart )
+		);
+	}
+	
 	
 	/* sort the hook array for each desktop according to its position in the heap */
-	for( item = store->head; item; item = item->next )
+	for( d = 0; d < store->count; ++d )
 	{
+		item = &store->item[ d ];
+		
 		/* sort according to HANDLEENTRY's entry.pHead */
 		qsort( 
 			item->hook, 
@@ -686,8 +819,9 @@ retry:
 					)
 					MSG_WARNING( "Duplicate pHead detected. Retrying..." );
 
+				/* so as not to suck up cpu. with a CPU budget the delay increases with each retry. */
 				if( G->config->polling != 0 )
-					Sleep( 1 ); // so as not to suck up cpu
+					Sleep( get_governor_retry_delay( G->governor, retry_count++ ) );
 
 				goto retry;
 			}
@@ -717,16 +851,200 @@ retry:
 	}
 	
 	
+	/* check each desktop's hooks for anomalies once, now that their threads are known */
+	for( d = 0; d < store->count; ++d )
+		set_hook_anomalies( &store->item[ d ] );
+	
+	
 	/* the desktop hook store has been initialized */
 	GetSystemTimeAsFileTime( (FILETIME *)&store->init_time );
 	return TRUE;
 }
+#endif // _WIN32
+
+
+
+/* resolve_desktop_hook_store() 
+Identify the threads of each hook again after the parent snapshot's gui array has changed.
+
+The gui array is sorted so each hook's owner, origin and target have to be found again even if 
+they were known. Whether each hook is wanted is decided again as well. See is_hook_wanted()
+
+returns the number of THREADINFO addresses that were unknown and are now identified
+*/
+unsigned resolve_desktop_hook_store( 
+	const struct snapshot *const parent   // in
+)
+{
+	unsigned resolved = 0, d = 0;
+	struct desktop_hook_item *item = NULL;
+	
+	FAIL_IF( !parent );
+	FAIL_IF( !parent->desktop_hooks );
+	FAIL_IF( !parent->desktop_hooks->init_time );   // The desktop hook store must be initialized.
+	
+	
+	for( d = 0; d < parent->desktop_hooks->count; ++d )
+	{
+		unsigned i = 0;
+		
+		item = &parent->desktop_hooks->item[ d ];
+		
+		for( i = 0; i < item->hook_count; ++i )
+		{
+			struct hook *const hook = &item->hook[ i ];
+			const unsigned before = !hook->owner + !hook->origin + !hook->target;
+			unsigned after = 0;
+			
+			
+			hook->owner = find_Win32ThreadInfo( parent, hook->entry.pOwner );
+			hook->origin = find_Win32ThreadInfo( parent, hook->object.pti );
+			hook->target = find_Win32ThreadInfo( parent, hook->object.ptiHooked );
+			
+			after = !hook->owner + !hook->origin + !hook->target;
+			if( after < before )
+				resolved += before - after;
+			
+			hook->ignore = !is_hook_wanted( hook );
+		}
+		
+		/* whether a thread is unknown may have changed */
+		set_hook_anomalies( item );
+	}
+	
+	return resolved;
+}
+
+
+
+/* get_hook_anomalies() 
+Get the anomaly bits of a hook struct.
+
+The checks are made with bitwise rather than logical operators so that they don't branch. Each 
+hook is checked once when it's captured and the bits are kept in hook->anomalies. see 
+set_hook_anomalies()
+
+returns the HOOK_ANOMALY_* bits
+*/
+unsigned get_hook_anomalies( 
+	const struct hook *const hook   // in
+)
+{
+	const HOOK *object = NULL;
+	unsigned id = 0, global = 0;
+	
+	FAIL_IF( !hook );
+	
+	
+	object = &hook->object;
+	
+	/* an id outside of WH_MIN to WH_MAX is shifted out of the mask */
+	id = (unsigned)( object->iHook - WH_MIN );
+	global = !!( object->flags & HF_GLOBAL );
+	
+	return HOOK_ANOMALY_IF( HOOK_ANOMALY_SELF, 
+			( hook->entry.pHead != NULL ) & ( object->pSelf != NULL )
+			& ( hook->entry.pHead != object->pSelf )
+		)
+		| HOOK_ANOMALY_IF( HOOK_ANOMALY_GLOBAL_ONLY, 
+			!global & ( id < 32 ) & ( HOOK_GLOBAL_ONLY_IDS >> ( id & 31 ) )
+		)
+		| HOOK_ANOMALY_IF( HOOK_ANOMALY_GLOBAL_TARGET, 
+			global & ( ( object->ptiHooked != NULL ) | ( hook->target != NULL ) )
+		)
+		| HOOK_ANOMALY_IF( HOOK_ANOMALY_HANDLE, 
+			( hook->entry.pHead != NULL )
+			& ( ( ( (DWORD)object->head.h & 0xFFFF ) != hook->entry_index )
+				| ( ( (DWORD)object->head.h >> 16 ) != hook->entry.wUniq )
+			)
+		)
+		| HOOK_ANOMALY_IF( HOOK_ANOMALY_FLAGS, object->flags & ~(DWORD)HF_VALID )
+		| HOOK_ANOMALY_IF( HOOK_ANOMALY_DESTROYED, object->flags & HF_DESTROYED )
+		| HOOK_ANOMALY_IF( HOOK_ANOMALY_UNKNOWN, 
+			( ( hook->entry.pOwner != NULL ) & ( hook->owner == NULL ) )
+			| ( ( object->pti != NULL ) & ( hook->origin == NULL ) )
+			| ( ( object->ptiHooked != NULL ) & ( hook->target == NULL ) )
+		);
+}
+
+
+
+/* set_hook_anomalies() 
+Set the anomaly bits of each hook in a desktop hook item's array of hook structs.
+
+This is a single pass over the array that's made after the hooks have been captured and their 
+threads found. The diff, the rule's anomaly field and the per-desktop count read hook->anomalies 
+instead of making the checks again, and print_hook_anomalies() only decodes it. The bits aren't 
+used to filter hooks: hook->ignore is set before them. see is_hook_wanted()
+
+'item' is the desktop hook item
+
+returns the number of hooks that have any anomaly. that's also kept in item->anomaly_count.
+*/
+unsigned set_hook_anomalies( 
+	struct desktop_hook_item *const item   // in
+)
+{
+	unsigned i = 0, count = 0;
+	
+	FAIL_IF( !item );
+	
+	
+	for( i = 0; i < item->hook_count; ++i )
+	{
+		const unsigned anomalies = get_hook_anomalies( &item->hook[ i ] );
+		
+		item->hook[ i ].anomalies = anomalies;
+		count += !!anomalies;
+	}
+	
+	item->anomaly_count = count;
+	return count;
+}
+
+
+
+/* print_hook_anomaly_names() 
+Print the names of HOOK_ANOMALY_* bits. No newline.
+
+The names are the same ones that a rule's anomaly field accepts. see rules.c
+*/
+void print_hook_anomaly_names( 
+	const unsigned anomalies   // in
+)
+{
+	if( anomalies & HOOK_ANOMALY_SELF )
+		printf( "self " );
+	
+	if( anomalies & HOOK_ANOMALY_GLOBAL_ONLY )
+		printf( "globalonly " );
+	
+	if( anomalies & HOOK_ANOMALY_GLOBAL_TARGET )
+		printf( "globaltarget " );
+	
+	if( anomalies & HOOK_ANOMALY_HANDLE )
+		printf( "handle " );
+	
+	if( anomalies & HOOK_ANOMALY_FLAGS )
+		printf( "flags " );
+	
+	if( anomalies & HOOK_ANOMALY_DESTROYED )
+		printf( "destroyed " );
+	
+	if( anomalies & HOOK_ANOMALY_UNKNOWN )
+		printf( "unknown " );
+	
+	return;
+}
 
 
 
 /* print_hook_anomalies()
 Print any anomalies found in a hook struct.
 
+Only the HOOK_ANOMALY_ERRORS bits of hook->anomalies are printed. The anomalies aren't checked 
+again here. see set_hook_anomalies()
+
 if 'hook' is NULL this function returns without having printed anything.
 */
 void print_hook_anomalies(
@@ -736,16 +1054,21 @@ void print_hook_anomalies(
 	if( !hook )
 		return;
 	
-	if( hook->entry.pHead && hook->object.pSelf && ( hook->entry.pHead != hook->object.pSelf ) )
+	if( hook->anomalies & HOOK_ANOMALY_SELF )
 	{
 		printf( "ERROR: The HOOK's pointer to itself is incorrect.\n" );
 		PRINT_HEX( hook->entry.pHead );
 		PRINT_HEX( hook->object.pSelf );
 	}
 	
-	print_HOOK_anomalies( &hook->object );
+	if( hook->anomalies & HOOK_ANOMALY_GLOBAL_ONLY )
+	{
+		printf( "ERROR: The HOOK @ " );
+		PRINT_HEX_BARE( hook->object.pSelf );
+		printf( " is supposed to be global-only but is missing the HF_GLOBAL flag!\n" );
+	}
 	
-	if( ( hook->object.flags & HF_GLOBAL ) && hook->target )
+	if( hook->anomalies & HOOK_ANOMALY_GLOBAL_TARGET )
 	{
 		printf( "ERROR: The global HOOK " );
 		PRINT_HEX_BARE( hook->object.head.h );
@@ -754,18 +1077,13 @@ void print_hook_anomalies(
 		printf( " has a target address even though global HOOKs aren't supposed to have them.\n" );
 	}
 	
-	if( hook->entry.pHead ) // there is a HANDLEENTRY for this HOOK
+	if( hook->anomalies & HOOK_ANOMALY_HANDLE )
 	{
-		if( ( ( (DWORD)hook->object.head.h & 0xFFFF ) != hook->entry_index )
-			|| ( ( (DWORD)hook->object.head.h >> 16 ) != hook->entry.wUniq )
-		)
-		{
-			printf( "ERROR: The handle check failed for HOOK handle " );
-			PRINT_HEX_BARE( hook->object.head.h );
-			printf( " @ " );
-			PRINT_HEX_BARE( hook->entry.pHead );
-			printf( ".\n" );
-		}
+		printf( "ERROR: The handle check failed for HOOK handle " );
+		PRINT_HEX_BARE( hook->object.head.h );
+		printf( " @ " );
+		PRINT_HEX_BARE( hook->entry.pHead );
+		printf( ".\n" );
 	}
 	
 	return;
@@ -792,6 +1110,15 @@ void print_hook(
 	
 	printf( "hook->ignore: %s\n", ( hook->ignore ? "TRUE" : "FALSE" ) );
 	
+	printf( "hook->anomalies: 0x%02X", hook->anomalies );
+	if( hook->anomalies )
+	{
+		printf( " ( " );
+		print_hook_anomaly_names( hook->anomalies );
+		printf( ")" );
+	}
+	printf( "\n" );
+	
 	printf( "\nhook->entry_index: %u\n", hook->entry_index );
 	print_HANDLEENTRY( &hook->entry );
 	
@@ -843,6 +1170,7 @@ void print_hook_array(
 	
 	printf( "item->hook_max: %u\n", item->hook_max );
 	printf( "item->hook_count: %u\n", item->hook_count );
+	printf( "item->anomaly_count: %u\n", item->anomaly_count );
 	
 	if( item->hook )
 	{
@@ -901,7 +1229,7 @@ void print_desktop_hook_store(
 	const struct desktop_hook_list *const store   // in
 )
 {
-	struct desktop_hook_item *item = NULL;
+	unsigned i = 0;
 	const char *const objname = "Desktop Hook List Store";
 	
 	
@@ -911,11 +1239,18 @@ void print_desktop_hook_store(
 	PRINT_DBLSEP_BEGIN( objname );
 	print_init_time( "store->init_time", store->init_time );
 	
+	printf( "store->count: %u\n", store->count );
+	printf( "store->max: %u\n", store->max );
+	
 	PRINT_HEX( store->head );
 	
-	for( item = store->head; item; item = item->next )
+	for( i = 0; i < store->count; ++i )
 	{
+		const struct desktop_hook_item *const item = &store->item[ i ];
+		
 		PRINT_HEX( item );
+		PRINT_HEX( store->range[ i ].base );
+		PRINT_HEX( store->range[ i ].limit );
 		print_desktop_hook_item( item );
 		printf( "\n" );
 	}
@@ -930,27 +1265,23 @@ void print_desktop_hook_store(
 
 
 /* free_desktop_hook_item()
-Free a desktop hook item (dirty -- linked list isn't updated).
-
-this function then sets the desktop hook item pointer to NULL and returns.
+Free the resources of an item in a desktop hook store's table.
 
-this function has no regard for the other items in the list and should only be called by 
-free_desktop_hook_store().
+the item itself is part of the table, which is freed by free_desktop_hook_store().
+this function should only be called by free_desktop_hook_store().
 
-'in' is a pointer to a pointer to the desktop hook item, which contains a desktop and its hooks.
-if( !in || !*in ) then this function returns.
+'item' is the desktop hook item, which contains a desktop and its hooks.
+if( !item ) then this function returns.
 */
 static void free_desktop_hook_item( 
-	struct desktop_hook_item **const in   // in deref
+	struct desktop_hook_item *const item   // in
 )
 {
-	if( !in || !*in )
+	if( !item )
 		return;
 	
-	free( (*in)->hook );
-	
-	free( (*in) );
-	*in = NULL;
+	free( item->hook );
+	item->hook = NULL;
 	
 	return;
 }
@@ -962,7 +1293,7 @@ Free a desktop hook store and all its descendants.
 
 this function then sets the desktop hook store pointer to NULL and returns
 
-'in' is a pointer to a pointer to the desktop hook store, which contains a linked list of desktops 
+'in' is a pointer to a pointer to the desktop hook store, which contains a table of desktops 
 and their hooks.
 if( !in || !*in ) then this function returns.
 */
@@ -970,20 +1301,17 @@ void free_desktop_hook_store(
 	struct desktop_hook_list **const in   // in deref
 )
 {
+	unsigned i = 0;
+	
 	if( !in || !*in )
 		return;
 	
-	if( (*in)->head )
-	{
-		struct desktop_hook_item *current = NULL, *p = NULL;
-		
-		for( current = (*in)->head; current; current = p )
-		{
-			p = current->next;
-			
-			free_desktop_hook_item( &current );
-		}
-	}
+	for( i = 0; i < (*in)->count; ++i )
+		free_desktop_hook_item( &(*in)->item[ i ] );
+	
+	free( (*in)->range );
+	
+	free( (*in)->item );
 	
 	free( (*in) );
 	*in = NULL;
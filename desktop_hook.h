@@ -21,7 +21,11 @@ along with GetHooks.  If not, see <http://www.gnu.org/licenses/>.
 #ifndef _DESKTOP_HOOK_H
 #define _DESKTOP_HOOK_H
 
+#ifdef _WIN32
 #include <windows.h>
+#else
+#include "portable.h"
+#endif
 
 /* ReactOS structures and supporting functions */
 #include "reactos.h"
@@ -45,6 +49,23 @@ struct snapshot;
 
 
 
+/* the anomaly bits of a hook. they're computed once for each hook when it's captured and read by 
+the diff and the rules, not by the include/exclude filters. see set_hook_anomalies()
+*/
+#define HOOK_ANOMALY_SELF   0x01   // the HOOK's pointer to itself is incorrect
+#define HOOK_ANOMALY_GLOBAL_ONLY   0x02   // a global-only HOOK id without HF_GLOBAL
+#define HOOK_ANOMALY_GLOBAL_TARGET   0x04   // a global HOOK that has a target
+#define HOOK_ANOMALY_HANDLE   0x08   // the handle doesn't match the HANDLEENTRY
+#define HOOK_ANOMALY_FLAGS   0x10   // flags outside of HF_VALID
+#define HOOK_ANOMALY_DESTROYED   0x20   // HF_DESTROYED
+#define HOOK_ANOMALY_UNKNOWN   0x40   // a thread the HOOK refers to wasn't found
+
+/* the anomalies that are errors. print_hook_anomalies() prints these. */
+#define HOOK_ANOMALY_ERRORS   \
+	( HOOK_ANOMALY_SELF | HOOK_ANOMALY_GLOBAL_ONLY | HOOK_ANOMALY_GLOBAL_TARGET | HOOK_ANOMALY_HANDLE )
+
+
+
 /** This is the info to keep track of when a HOOK object is found.
 For each HANDLEENTRY traversed if its bType == TYPE_HOOK then the handle entry is for a HOOK.
 */
@@ -53,6 +74,11 @@ struct hook
 	/* nonzero if this hook is filtered out by the user-specified configuration lists */
 	unsigned ignore;
 	
+	/* the HOOK_ANOMALY_* bits. they depend on all the other information in the hook, so they're 
+	set after 'ignore' and don't affect it.
+	*/
+	unsigned anomalies;
+	
 	/* what was the HANDLEENTRY's index position in the list of user handles */
 	unsigned entry_index;
 	
@@ -97,25 +123,66 @@ struct desktop_hook_item
 	*/
 	unsigned hook_count;
 	
+	/* how many hooks in the hook array have any anomaly. see set_hook_anomalies() */
+	unsigned anomaly_count;
+	
+	/* a copy of the desktop's DESKTOPINFO.aphkStart, the first HOOK in each global hook chain.
+	it's copied right after the hooks so that it's as close as possible to the same point in time.
+	*/
+	PHOOK aphkStart[ CWINHOOKS ];
+	
 	
 	
-	/* The next item in the list */
+	/* The next item in the list. This is the next element in the table, or NULL for the last.
+	It's kept for the code that walks the list from its head. see struct desktop_hook_list
+	*/
 	struct desktop_hook_item *next;
 };
 
 
 
+/** The kernel address range of a desktop's heap in which a HOOK can be found.
+*/
+struct desktop_hook_range
+{
+	/* the heap's base and the last address at which a whole HOOK fits. both are 0 if the desktop 
+	isn't attached to (eg an offline desktop), so no address is in the range.
+	*/
+	uintptr_t base;
+	uintptr_t limit;
+};
+
+
+
 /** The desktop hook store.
-The desktop hook store holds a linked list of desktops and their hooks.
+The desktop hook store holds a table of desktops and their hooks.
+
+The items are contiguous and in the order of the desktops they were added for. An item's index 
+never changes since items aren't removed, but the table is moved when it grows so a pointer to an 
+item is only valid until the next item is added. The items are added when the store is first 
+initialized and then the store is reused. The table can also be walked through the head/next 
+adapters. see struct list in list.h
 */
 struct desktop_hook_list
 {
-	/* linked list of desktop_hook_item.
-	this is a pointer to the first item in the desktop hook list.
+	/* the table of desktop hook items */
+	struct desktop_hook_item *item;   // calloc(), free()
+	
+	/* the heap range of the desktop of each item in the table, at the same index. the ranges are 
+	searched for each HOOK's handle entry so they're kept apart from the items.
 	*/
-	struct desktop_hook_item *head;   // items calloc'd. the list is freed when the store is freed.
+	struct desktop_hook_range *range;   // calloc(), free()
+	
+	/* the allocated/maximum number of elements in the item and range tables */
+	unsigned max;
+	
+	/* the number of items in the table */
+	unsigned count;
 	
-	/* the last item in the desktop hook list */
+	/* this is a pointer to the first item in the table, or NULL if there are none. */
+	struct desktop_hook_item *head;
+	
+	/* the last item in the table */
 	struct desktop_hook_item *tail;
 	
 	/* the desktop list type */
@@ -136,6 +203,11 @@ void create_desktop_hook_store(
 	struct desktop_hook_list **const out   // out deref
 );
 
+struct desktop_hook_item *add_desktop_hook_item( 
+	struct desktop_hook_list *const store,   // in
+	struct desktop_item *const desktop   // in
+);
+
 int match_hook_process_name(
 	const struct hook *const hook,   // in
 	const WCHAR *const name   // in
@@ -168,6 +240,22 @@ int init_desktop_hook_store(
 	const struct snapshot *const parent   // in
 );
 
+unsigned resolve_desktop_hook_store( 
+	const struct snapshot *const parent   // in
+);
+
+unsigned get_hook_anomalies( 
+	const struct hook *const hook   // in
+);
+
+unsigned set_hook_anomalies( 
+	struct desktop_hook_item *const item   // in
+);
+
+void print_hook_anomaly_names( 
+	const unsigned anomalies   // in
+);
+
 void print_hook_anomalies(
 	const struct hook *const hook   // in
 );
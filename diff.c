@@ -46,6 +46,12 @@ print_hook_notice_end()
 Helper function to print a hook [end] header.
 -
 
+-
+add_hook_event()
+
+Add a hook event to the global export store and the global rules store.
+-
+
 -
 print_diff_gui()
 
@@ -92,9 +98,31 @@ Print the HOOKs that have been found on all desktops in an initial snapshot.
 
 #include "diff.h"
 
+#include "export.h"
+
+#include "ancestry.h"
+
+#include "hookscan.h"
+
+#include "checkpoint.h"
+
+#include "stream.h"
+
+#include "rules.h"
+
+#include "rollup.h"
+
 /* the global stores */
 #include "global.h"
 
+/* The monitor stores are only built on Windows. Offline there are no hook scans between snapshots 
+and nothing is streamed.
+*/
+#ifndef _WIN32
+#define is_hookscan_event( store, hook, difftype )   FALSE
+#define note_stream_output( store )
+#endif
+
 
 
 static void print_unknown_address(
@@ -106,6 +134,7 @@ static int print_diff_gui(
 	const struct hook *const newhook,   // in
 	const enum threadtype threadtype,   // in
 	const WCHAR *const deskname,   // in
+	const __int64 time,   // in
 	unsigned *const modified_header   // in, out
 );
 
@@ -195,12 +224,16 @@ Helper function to print a hook [begin] header with basic hook info.
 
 'hook' is the hook info
 'deskname' is the desktop name
-'difftype' is the reported action, eg HOOK_ADDED, HOOK_MODIFIED, HOOK_REMOVED
+'difftype' is the reported action, eg HOOK_ADDED, HOOK_MODIFIED, HOOK_REMOVED, HOOK_ATTRIBUTED
+'time' is the time of the snapshot or hook scan the action was found in, in FILETIME format. It's 
+printed as local time. When snapshot files are inspected or compared it's the time of the record, 
+not of the analysis. If 'time' is 0 the current time is printed.
 */
 void print_hook_notice_begin(
 	const struct hook *const hook,   // in
 	const WCHAR *const deskname,   // in
-	const enum difftype difftype   // in
+	const enum difftype difftype,   // in
+	const __int64 time   // in, optional
 )
 {
 	const char *diffname = NULL;
@@ -222,6 +255,8 @@ void print_hook_notice_begin(
 		diffname = "Modified";
 	else if( difftype == HOOK_REMOVED )
 		diffname = "Removed";
+	else if( difftype == HOOK_ATTRIBUTED )
+		diffname = "Attributed";
 	else
 	{
 		MSG_FATAL( "Unknown diff type." );
@@ -242,7 +277,10 @@ void print_hook_notice_begin(
 	printf( "]" );
 	
 	printf( " [" );
-	print_time();
+	if( time )
+		print_filetime_as_local( (const FILETIME *)&time );
+	else
+		print_time();
 	printf( "]" );
 	
 	printf( "\n" );
@@ -319,6 +357,32 @@ void print_hook_notice_begin(
 	
 	print_brief_thread_info( hook, THREAD_TARGET );
 	
+#ifdef _WIN32
+	/* the ancestry store is only initialized if the user requested the ancestry of hook origins */
+	if( G->ancestry->init_time && hook->origin && hook->origin->spi )
+	{
+		printf( "Origin ancestry: " );
+		print_ancestry_chain( 
+			G->ancestry, 
+			(uintptr_t)hook->origin->spi->UniqueProcessId, 
+			hook->origin->spi->CreateTime.QuadPart
+		);
+		printf( "\n" );
+	}
+	
+	/* the checkpoint store is only initialized if the user requested a checkpoint file. the first 
+	time may be from before the program was restarted.
+	*/
+	if( G->checkpoint->init_time )
+	{
+		const __int64 first_time = find_checkpoint_hook_time( G->checkpoint, hook );
+		
+		
+		if( first_time )
+			print_init_time( "First found", first_time );
+	}
+#endif // _WIN32
+	
 	
 	if( G->config->verbose == 6 )
 		print_HOOK( &hook->object );
@@ -346,6 +410,33 @@ void print_hook_notice_end( void )
 
 
 
+/* add_hook_event() 
+Add a hook event to the global export store and the global rules store.
+
+'hook' is the hook info 
+'deskname' is the desktop name 
+'difftype' is the event, eg HOOK_ADDED, HOOK_MODIFIED, HOOK_REMOVED 
+'time' is the time of the snapshot the hook info is from
+
+Each store ignores the event if the user didn't request it.
+*/
+void add_hook_event( 
+	const struct hook *const hook,   // in
+	const WCHAR *const deskname,   // in
+	const enum difftype difftype,   // in
+	const __int64 time   // in
+)
+{
+	add_export_event( G->exporter, hook, deskname, difftype, time );
+#ifdef _WIN32
+	add_rules_event( G->rules, hook, deskname, difftype, time );
+	add_rollup_event( G->rollup, difftype, time );
+#endif
+	return;
+}
+
+
+
 /* print_diff_gui()
 Compare two gui structs and print any significant differences. Helper function for print_diff_hook()
 
@@ -353,6 +444,7 @@ Compare two gui structs and print any significant differences. Helper function f
 'newhook' is the new hook info
 'threadtype' is the gui thread info in the hook struct to compare eg THREAD_TARGET (hook->target)
 'deskname' is the name of the desktop the hook is on
+'time' is the time of the snapshot 'newhook' is from
 
 '*modified_header' receives nonzero if the "Modified HOOK" header is printed by this function.
 the header is printed before any difference in the gui structs has been printed.
@@ -366,6 +458,7 @@ static int print_diff_gui(
 	const struct hook *const newhook,   // in
 	const enum threadtype threadtype,   // in
 	const WCHAR *const deskname,   // in
+	const __int64 time,   // in
 	unsigned *const modified_header   // in, out
 )
 {
@@ -519,7 +612,7 @@ static int print_diff_gui(
 	*/
 	if( !*modified_header )
 	{
-		print_hook_notice_begin( newhook, deskname, HOOK_MODIFIED );
+		print_hook_notice_begin( newhook, deskname, HOOK_MODIFIED, time );
 		*modified_header = TRUE;
 	}
 	
@@ -544,13 +637,15 @@ Compare two hook structs, both for the same HOOK object, and print any significa
 'a' is the old hook info
 'b' is the new hook info
 'deskname' is the name of the desktop the HOOK is on
+'time' is the time of the snapshot 'b' is from
 
 returns nonzero if any difference was printed. 
 */
 int print_diff_hook( 
 	const struct hook *const a,   // in
 	const struct hook *const b,   // in
-	const WCHAR *const deskname   // in
+	const WCHAR *const deskname,   // in
+	const __int64 time   // in
 )
 {
 	/* modified_header is set nonzero if/when the "Modified HOOK" header has been printed */
@@ -568,7 +663,7 @@ int print_diff_hook(
 		
 		if( !modified_header )
 		{
-			print_hook_notice_begin( b, deskname, HOOK_MODIFIED );
+			print_hook_notice_begin( b, deskname, HOOK_MODIFIED, time );
 			modified_header = TRUE;
 		}
 		
@@ -602,13 +697,13 @@ int print_diff_hook(
 	/* compare entry.pOwner
 	print any significant differences in the owner of the HOOK
 	*/
-	print_diff_gui( a, b, THREAD_OWNER, deskname, &modified_header );
+	print_diff_gui( a, b, THREAD_OWNER, deskname, time, &modified_header );
 	
 	if( a->object.head.h != b->object.head.h )
 	{
 		if( !modified_header )
 		{
-			print_hook_notice_begin( b, deskname, HOOK_MODIFIED );
+			print_hook_notice_begin( b, deskname, HOOK_MODIFIED, time );
 			modified_header = TRUE;
 		}
 		
@@ -626,7 +721,7 @@ int print_diff_hook(
 	{
 		if( !modified_header )
 		{
-			print_hook_notice_begin( b, deskname, HOOK_MODIFIED );
+			print_hook_notice_begin( b, deskname, HOOK_MODIFIED, time );
 			modified_header = TRUE;
 		}
 		
@@ -638,13 +733,13 @@ int print_diff_hook(
 	/* compare object.pti
 	print any significant differences in the origin of the HOOK
 	*/
-	print_diff_gui( a, b, THREAD_ORIGIN, deskname, &modified_header );
+	print_diff_gui( a, b, THREAD_ORIGIN, deskname, time, &modified_header );
 	
 	if( a->object.rpdesk1 != b->object.rpdesk1 )
 	{
 		if( !modified_header )
 		{
-			print_hook_notice_begin( b, deskname, HOOK_MODIFIED );
+			print_hook_notice_begin( b, deskname, HOOK_MODIFIED, time );
 			modified_header = TRUE;
 		}
 		
@@ -657,7 +752,7 @@ int print_diff_hook(
 	{
 		if( !modified_header )
 		{
-			print_hook_notice_begin( b, deskname, HOOK_MODIFIED );
+			print_hook_notice_begin( b, deskname, HOOK_MODIFIED, time );
 			modified_header = TRUE;
 		}
 		
@@ -670,7 +765,7 @@ int print_diff_hook(
 	{
 		if( !modified_header )
 		{
-			print_hook_notice_begin( b, deskname, HOOK_MODIFIED );
+			print_hook_notice_begin( b, deskname, HOOK_MODIFIED, time );
 			modified_header = TRUE;
 		}
 		
@@ -683,7 +778,7 @@ int print_diff_hook(
 	{
 		if( !modified_header )
 		{
-			print_hook_notice_begin( b, deskname, HOOK_MODIFIED );
+			print_hook_notice_begin( b, deskname, HOOK_MODIFIED, time );
 			modified_header = TRUE;
 		}
 		
@@ -702,7 +797,7 @@ int print_diff_hook(
 	{
 		if( !modified_header )
 		{
-			print_hook_notice_begin( b, deskname, HOOK_MODIFIED );
+			print_hook_notice_begin( b, deskname, HOOK_MODIFIED, time );
 			modified_header = TRUE;
 		}
 		
@@ -718,7 +813,7 @@ int print_diff_hook(
 		
 		if( !modified_header )
 		{
-			print_hook_notice_begin( b, deskname, HOOK_MODIFIED );
+			print_hook_notice_begin( b, deskname, HOOK_MODIFIED, time );
 			modified_header = TRUE;
 		}
 		
@@ -753,7 +848,7 @@ int print_diff_hook(
 	{
 		if( !modified_header )
 		{
-			print_hook_notice_begin( b, deskname, HOOK_MODIFIED );
+			print_hook_notice_begin( b, deskname, HOOK_MODIFIED, time );
 			modified_header = TRUE;
 		}
 		
@@ -765,13 +860,13 @@ int print_diff_hook(
 	/* compare object.ptiHooked
 	print any significant differences in the target of the HOOK
 	*/
-	print_diff_gui( a, b, THREAD_TARGET, deskname, &modified_header );
+	print_diff_gui( a, b, THREAD_TARGET, deskname, time, &modified_header );
 	
 	if( a->object.rpdesk2 != b->object.rpdesk2 )
 	{
 		if( !modified_header )
 		{
-			print_hook_notice_begin( b, deskname, HOOK_MODIFIED );
+			print_hook_notice_begin( b, deskname, HOOK_MODIFIED, time );
 			modified_header = TRUE;
 		}
 		
@@ -785,6 +880,38 @@ int print_diff_hook(
 		PRINT_HEX_NAME( "New", b->object.rpdesk2 );
 	}
 	
+	/* the anomaly bits were computed when each hook was captured. whether a thread is unknown is 
+	already covered by the thread comparisons above.
+	*/
+	if( ( a->anomalies ^ b->anomalies ) & ~(unsigned)HOOK_ANOMALY_UNKNOWN )
+	{
+		const unsigned old_anomalies = ( a->anomalies & ~(unsigned)HOOK_ANOMALY_UNKNOWN );
+		const unsigned new_anomalies = ( b->anomalies & ~(unsigned)HOOK_ANOMALY_UNKNOWN );
+		
+		
+		if( !modified_header )
+		{
+			print_hook_notice_begin( b, deskname, HOOK_MODIFIED, time );
+			modified_header = TRUE;
+		}
+		
+		printf( "\nThe HOOK's anomalies have changed.\n" );
+		
+		if( old_anomalies & ~new_anomalies )
+		{
+			printf( "Anomalies removed: " );
+			print_hook_anomaly_names( old_anomalies & ~new_anomalies );
+			printf( "\n" );
+		}
+		
+		if( new_anomalies & ~old_anomalies )
+		{
+			printf( "Anomalies added: " );
+			print_hook_anomaly_names( new_anomalies & ~old_anomalies );
+			printf( "\n" );
+		}
+	}
+	
 	
 	if( modified_header )
 		print_hook_notice_end();
@@ -799,10 +926,15 @@ Print the HOOKs that have been added/removed/modified from a single desktop betw
 
 'a' is a desktop and its HOOKs captured in the previous snapshot
 'b' is the same desktop and its HOOKs captured in the current snapshot
+'time' is the time of the current snapshot
+
+Each HOOK printed is also added as an event to the global export and rules stores.
+A HOOK added or removed that was already reported by a hook scan isn't printed again.
 */
 void print_diff_desktop_hook_items( 
 	const struct desktop_hook_item *const a,   // in
-	const struct desktop_hook_item *const b   // in
+	const struct desktop_hook_item *const b,   // in
+	const __int64 time   // in
 )
 {
 	WCHAR *deskname = NULL;
@@ -829,20 +961,26 @@ void print_diff_desktop_hook_items(
 		
 		if( ret < 0 ) // hook removed
 		{
-			if( !a->hook[ a_hi ].ignore )
+			if( !a->hook[ a_hi ].ignore 
+				&& !is_hookscan_event( G->hookscan, &a->hook[ a_hi ], HOOK_REMOVED )
+			)
 			{
-				print_hook_notice_begin( &a->hook[ a_hi ], deskname, HOOK_REMOVED );
+				print_hook_notice_begin( &a->hook[ a_hi ], deskname, HOOK_REMOVED, time );
 				print_hook_notice_end();
+				add_hook_event( &a->hook[ a_hi ], deskname, HOOK_REMOVED, time );
 			}
 			
 			++a_hi;
 		}
 		else if( ret > 0 ) // hook added
 		{
-			if( !b->hook[ b_hi ].ignore )
+			if( !b->hook[ b_hi ].ignore 
+				&& !is_hookscan_event( G->hookscan, &b->hook[ b_hi ], HOOK_ADDED )
+			)
 			{
-				print_hook_notice_begin( &b->hook[ b_hi ], deskname, HOOK_ADDED );
+				print_hook_notice_begin( &b->hook[ b_hi ], deskname, HOOK_ADDED, time );
 				print_hook_notice_end();
+				add_hook_event( &b->hook[ b_hi ], deskname, HOOK_ADDED, time );
 			}
 			
 			++b_hi;
@@ -853,8 +991,10 @@ void print_diff_desktop_hook_items(
 			In this case check there is no reason to print the HOOK again unless certain 
 			information has changed (like the hook is hung, etc).
 			*/
-			if( !a->hook[ a_hi ].ignore || !b->hook[ b_hi ].ignore )
-				print_diff_hook( &a->hook[ a_hi ], &b->hook[ b_hi ], deskname );
+			if( ( !a->hook[ a_hi ].ignore || !b->hook[ b_hi ].ignore ) 
+				&& print_diff_hook( &a->hook[ a_hi ], &b->hook[ b_hi ], deskname, time )
+			)
+				add_hook_event( &b->hook[ b_hi ], deskname, HOOK_MODIFIED, time );
 			
 			++a_hi;
 			++b_hi;
@@ -863,10 +1003,13 @@ void print_diff_desktop_hook_items(
 	
 	while( a_hi < a->hook_count ) // hooks removed
 	{
-		if( !a->hook[ a_hi ].ignore )
+		if( !a->hook[ a_hi ].ignore 
+			&& !is_hookscan_event( G->hookscan, &a->hook[ a_hi ], HOOK_REMOVED )
+		)
 		{
-			print_hook_notice_begin( &a->hook[ a_hi ], deskname, HOOK_REMOVED );
+			print_hook_notice_begin( &a->hook[ a_hi ], deskname, HOOK_REMOVED, time );
 			print_hook_notice_end();
+			add_hook_event( &a->hook[ a_hi ], deskname, HOOK_REMOVED, time );
 		}
 		
 		++a_hi;
@@ -874,10 +1017,13 @@ void print_diff_desktop_hook_items(
 	
 	while( b_hi < b->hook_count ) // hooks added
 	{
-		if( !b->hook[ b_hi ].ignore )
+		if( !b->hook[ b_hi ].ignore 
+			&& !is_hookscan_event( G->hookscan, &b->hook[ b_hi ], HOOK_ADDED )
+		)
 		{
-			print_hook_notice_begin( &b->hook[ b_hi ], deskname, HOOK_ADDED );
+			print_hook_notice_begin( &b->hook[ b_hi ], deskname, HOOK_ADDED, time );
 			print_hook_notice_end();
+			add_hook_event( &b->hook[ b_hi ], deskname, HOOK_ADDED, time );
 		}
 		
 		++b_hi;
@@ -899,17 +1045,19 @@ void print_diff_desktop_hook_lists(
 	const struct desktop_hook_list *const list_b   // in
 )
 {
-	struct desktop_hook_item *a = NULL;
-	struct desktop_hook_item *b = NULL;
+	unsigned i = 0;
 	
 	FAIL_IF( !list_a );
 	FAIL_IF( !list_b );
 	
 	
-	for( a = list_a->head, b = list_b->head; ( a && b ); a = a->next, b = b->next )
-		print_diff_desktop_hook_items( a, b );
+	/* both tables are built from the same desktop store, so the items at the same index are for 
+	the same desktop
+	*/
+	for( i = 0; ( i < list_a->count ) && ( i < list_b->count ); ++i )
+		print_diff_desktop_hook_items( &list_a->item[ i ], &list_b->item[ i ], list_b->init_time );
 	
-	if( a || b )
+	if( list_a->count != list_b->count )
 	{
 		MSG_FATAL( "The desktop hook stores could not be fully compared." );
 		exit( 1 );
@@ -924,11 +1072,16 @@ void print_diff_desktop_hook_lists(
 Print the HOOKs that have been found on a single desktop in an initial snapshot.
 
 'item' is a desktop and its HOOKs captured in the snapshot
+'time' is the time of the snapshot
+
+Each HOOK printed is also added as an event to the global export and rules stores.
+The time the first HOOK is printed is noted in the global stream store. See print_stream_report().
 
 returns the number of HOOKs printed
 */
 unsigned print_initial_desktop_hook_item( 
-	const struct desktop_hook_item *const item   // in
+	const struct desktop_hook_item *const item,   // in
+	const __int64 time   // in
 )
 {
 	unsigned i = 0;
@@ -944,8 +1097,10 @@ unsigned print_initial_desktop_hook_item(
 	{
 		if( !item->hook[ i ].ignore )
 		{
-			print_hook_notice_begin( &item->hook[ i ], item->desktop->pwszDesktopName, HOOK_FOUND );
+			note_stream_output( G->stream );
+			print_hook_notice_begin( &item->hook[ i ], item->desktop->pwszDesktopName, HOOK_FOUND, time );
 			print_hook_notice_end();
+			add_hook_event( &item->hook[ i ], item->desktop->pwszDesktopName, HOOK_FOUND, time );
 			++printed;
 		}
 	}
@@ -966,14 +1121,13 @@ unsigned print_initial_desktop_hook_list(
 	const struct desktop_hook_list *const list   // in
 )
 {
-	unsigned printed = 0;
-	struct desktop_hook_item *item = NULL;
+	unsigned i = 0, printed = 0;
 	
 	FAIL_IF( !list );
 	
 	/* for each desktop in a snapshot print the HOOKs found */
-	for( item = list->head; item; item = item->next )
-		printed += print_initial_desktop_hook_item( item );
+	for( i = 0; i < list->count; ++i )
+		printed += print_initial_desktop_hook_item( &list->item[ i ], list->init_time );
 	
 	return printed;
 }
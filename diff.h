@@ -21,7 +21,11 @@ along with GetHooks.  If not, see <http://www.gnu.org/licenses/>.
 #ifndef _DIFF_H
 #define _DIFF_H
 
+#ifdef _WIN32
 #include <windows.h>
+#else
+#include "portable.h"
+#endif
 
 /* snapshot store (system process info, gui threads, desktop hooks) */
 #include "snapshot.h"
@@ -49,7 +53,12 @@ enum difftype
 	HOOK_MODIFIED, 
 	
 	/* a HOOK that is present in the previous snapshot but not in the current */
-	HOOK_REMOVED
+	HOOK_REMOVED, 
+	
+	/* a HOOK that was added or removed in a hooks only snapshot, and whose threads have since 
+	been identified in a full snapshot. see hookscan.h
+	*/
+	HOOK_ATTRIBUTED
 };
 
 
@@ -79,20 +88,30 @@ void print_brief_thread_info(
 void print_hook_notice_begin(
 	const struct hook *const hook,   // in
 	const WCHAR *const deskname,   // in
-	const enum difftype difftype   // in
+	const enum difftype difftype,   // in
+	const __int64 time   // in, optional
 );
 
 void print_hook_notice_end( void );
 
+void add_hook_event( 
+	const struct hook *const hook,   // in
+	const WCHAR *const deskname,   // in
+	const enum difftype difftype,   // in
+	const __int64 time   // in
+);
+
 int print_diff_hook( 
 	const struct hook *const a,   // in
 	const struct hook *const b,   // in
-	const WCHAR *const deskname   // in
+	const WCHAR *const deskname,   // in
+	const __int64 time   // in
 );
 
 void print_diff_desktop_hook_items( 
 	const struct desktop_hook_item *const a,   // in
-	const struct desktop_hook_item *const b   // in
+	const struct desktop_hook_item *const b,   // in
+	const __int64 time   // in
 );
 
 void print_diff_desktop_hook_lists( 
@@ -101,7 +120,8 @@ void print_diff_desktop_hook_lists(
 );
 
 unsigned print_initial_desktop_hook_item( 
-	const struct desktop_hook_item *const item   // in
+	const struct desktop_hook_item *const item,   // in
+	const __int64 time   // in
 );
 
 unsigned print_initial_desktop_hook_list( 
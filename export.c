@@ -0,0 +1,1045 @@
+/*
+Copyright (C) 2011 Jay Satiro <raysatiro@yahoo.com>
+All rights reserved.
+
+This file is part of GetHooks.
+
+GetHooks is free software: you can redistribute it and/or modify 
+it under the terms of the GNU General Public License as published by 
+the Free Software Foundation, either version 3 of the License, or 
+(at your option) any later version.
+
+GetHooks is distributed in the hope that it will be useful, 
+but WITHOUT ANY WARRANTY; without even the implied warranty of 
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License 
+along with GetHooks.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/** 
+This file contains functions for an export store (write hook events to a columnar export file) and 
+a reader for columnar export files.
+Each function is documented in the comment block above its definition.
+
+The file format is documented in export.h. Each hook event that is printed, in the initial listing 
+or in monitor mode, is also added as a row to the export store, which writes the rows in row groups 
+with one typed column chunk for each member of the event.
+
+-
+create_export_store()
+
+Create an export store and its descendants or die.
+-
+
+-
+write_export_footer()
+
+Write the footer and trailer of a columnar export file.
+-
+
+-
+init_export_store()
+
+Initialize an export store by creating the file and writing the file header and an empty footer.
+-
+
+-
+add_export_string()
+
+Add a string to the export store's dictionary if it isn't already in the dictionary.
+-
+
+-
+add_export_event()
+
+Add a hook event as a row to the export store.
+-
+
+-
+encode_export_column()
+
+Encode a column chunk.
+-
+
+-
+flush_export_store()
+
+Write the rows that haven't been written yet as a row group.
+-
+
+-
+is_export_file()
+
+Check whether a file is a columnar export file.
+-
+
+-
+decode_export_column()
+
+Decode a column chunk.
+-
+
+-
+print_export_file()
+
+Read a columnar export file and print its rows.
+-
+
+-
+print_export_store()
+
+Print an export store.
+-
+
+-
+free_export_store()
+
+Free an export store and all its descendants.
+-
+
+*/
+
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <stdio.h>
+
+#include "util.h"
+
+/* the file view */
+#include "portable.h"
+
+#include "reactos.h"
+
+#include "export.h"
+
+/* the global stores */
+#include "global.h"
+
+
+
+/* the initial number of slots in the string hash table. must be a power of 2. */
+#define EXPORT_SLOTS_DEFAULT   256
+
+/* the maximum number of bytes in an encoded value */
+#define EXPORT_VARINT_MAX   10
+
+/* the number of FILETIME intervals in a second */
+#define EXPORT_FILETIME_SECOND   10000000
+
+
+
+static int write_export_footer( 
+	struct exporter *const store   // in
+);
+
+static unsigned add_export_string( 
+	struct exporter *const store,   // in
+	const WCHAR *const str,   // in
+	const unsigned cch   // in
+);
+
+static size_t encode_export_column( 
+	BYTE *const out,   // out
+	const UINT64 *const value,   // in
+	const unsigned count   // in
+);
+
+static int decode_export_column( 
+	UINT64 *const value,   // out
+	const unsigned count,   // in
+	const BYTE *const in,   // in
+	const size_t bcount   // in
+);
+
+
+
+/* create_export_store() 
+Create an export store and its descendants or die.
+*/
+void create_export_store( 
+	struct exporter **const out   // out deref
+)
+{
+	unsigned i = 0;
+	struct exporter *exporter = NULL;
+	
+	FAIL_IF( !out );
+	FAIL_IF( *out );
+	
+	
+	/* allocate an export store */
+	exporter = must_calloc( 1, sizeof( *exporter ) );
+	
+	for( i = 0; i < EXPORT_COLUMN_COUNT; ++i )
+		exporter->column[ i ] = must_calloc( EXPORT_GROUP_ROWS, sizeof( *exporter->column[ i ] ) );
+	
+	exporter->dict_max = EXPORT_SLOTS_DEFAULT / 2;
+	exporter->dict = must_calloc( exporter->dict_max, sizeof( *exporter->dict ) );
+	
+	exporter->dict_slot_max = EXPORT_SLOTS_DEFAULT;
+	exporter->dict_slot = must_calloc( exporter->dict_slot_max, sizeof( *exporter->dict_slot ) );
+	
+	exporter->footer_max = 64;
+	exporter->footer = must_calloc( exporter->footer_max, sizeof( *exporter->footer ) );
+	
+	
+	*out = exporter;
+	return;
+}
+
+
+
+/* write_export_footer() 
+Write the footer and trailer of a columnar export file.
+
+The footer is written at the footer offset, after the last row group.
+
+returns nonzero on success
+*/
+static int write_export_footer( 
+	struct exporter *const store   // in
+)
+{
+	struct export_trailer trailer;
+	
+	FAIL_IF( !store );
+	FAIL_IF( !store->fp );
+	
+	
+	ZeroMemory( &trailer, sizeof( trailer ) );
+	
+	trailer.footer_offset = store->footer_offset;
+	trailer.group_count = store->group_count;
+	memcpy( trailer.magic, EXPORT_TRAILER_MAGIC, EXPORT_TRAILER_MAGIC_LEN );
+	
+	if( _fseeki64( store->fp, (__int64)store->footer_offset, SEEK_SET ) 
+		|| ( store->group_count 
+			&& ( fwrite( store->footer, sizeof( *store->footer ), store->group_count, store->fp )
+				!= store->group_count
+			)
+		) 
+		|| ( fwrite( &trailer, sizeof( trailer ), 1, store->fp ) != 1 ) 
+		|| fflush( store->fp )
+	)
+	{
+		MSG_ERROR( "Failed to write the columnar export file footer." );
+		printf( "file: %ls\n", store->pwszFile );
+		return FALSE;
+	}
+	
+	return TRUE;
+}
+
+
+
+/* init_export_store() 
+Initialize an export store by creating the file and writing the file header and an empty footer.
+
+If the file already exists it is overwritten.
+
+returns nonzero on success
+*/
+int init_export_store( 
+	struct exporter *const store,   // in
+	const WCHAR *const file   // in
+)
+{
+	struct export_header header;
+	
+	FAIL_IF( !store );
+	FAIL_IF( !file );
+	FAIL_IF( store->init_time );   // Fail if this store has already been initialized.
+	
+	
+	store->pwszFile = must_wcsdup( file );
+	
+	store->fp = _wfopen( store->pwszFile, L"w+b" );
+	if( !store->fp )
+	{
+		MSG_ERROR( "_wfopen() failed." );
+		printf( "file: %ls\n", store->pwszFile );
+		return FALSE;
+	}
+	
+	ZeroMemory( &header, sizeof( header ) );
+	
+	memcpy( header.magic, EXPORT_MAGIC, EXPORT_MAGIC_LEN );
+	header.version = EXPORT_VERSION;
+	header.header_bcount = sizeof( header );
+	header.column_count = EXPORT_COLUMN_COUNT;
+	GetSystemTimeAsFileTime( (FILETIME *)&header.create_time );
+	
+	if( fwrite( &header, sizeof( header ), 1, store->fp ) != 1 )
+	{
+		MSG_ERROR( "Failed to write the columnar export file header." );
+		printf( "file: %ls\n", store->pwszFile );
+		return FALSE;
+	}
+	
+	store->footer_offset = sizeof( header );
+	
+	if( !write_export_footer( store ) )
+		return FALSE;
+	
+	
+	/* the export store has been initialized */
+	GetSystemTimeAsFileTime( (FILETIME *)&store->init_time );
+	store->flush_time = store->init_time;
+	return TRUE;
+}
+
+
+
+/* add_export_string() 
+Add a string to the export store's dictionary if it isn't already in the dictionary.
+
+'str' is the string and 'cch' is its length in characters. 'str' does not have to be null 
+terminated. Strings are compared case sensitive.
+
+returns the string's id: its index in the dictionary + 1
+*/
+static unsigned add_export_string( 
+	struct exporter *const store,   // in
+	const WCHAR *const str,   // in
+	const unsigned cch   // in
+)
+{
+	unsigned i = 0, slot = 0, hash = 2166136261u;
+	
+	FAIL_IF( !store );
+	FAIL_IF( !str );
+	
+	
+	/* FNV-1a */
+	for( i = 0; i < cch; ++i )
+		hash = ( hash ^ str[ i ] ) * 16777619u;
+	
+	for( slot = hash & ( store->dict_slot_max - 1 );
+		store->dict_slot[ slot ];
+		slot = ( slot + 1 ) & ( store->dict_slot_max - 1 )
+	)
+	{
+		const WCHAR *const name = store->dict[ store->dict_slot[ slot ] - 1 ];
+		
+		if( !wcsncmp( name, str, cch ) && !name[ cch ] )
+			return store->dict_slot[ slot ];
+	}
+	
+	
+	/* the string isn't in the dictionary. if the string array is full double its size */
+	if( store->dict_count == store->dict_max )
+	{
+		WCHAR **const temp = must_calloc( store->dict_max * 2, sizeof( *temp ) );
+		
+		memcpy( temp, store->dict, store->dict_max * sizeof( *temp ) );
+		free( store->dict );
+		
+		store->dict = temp;
+		store->dict_max *= 2;
+	}
+	
+	store->dict[ store->dict_count ] = must_calloc( cch + 1, sizeof( WCHAR ) );
+	memcpy( store->dict[ store->dict_count ], str, cch * sizeof( WCHAR ) );
+	
+	store->dict_slot[ slot ] = ++store->dict_count;
+	
+	/* if the string hash table is more than half full double its size and rehash */
+	if( ( store->dict_count * 2 ) > store->dict_slot_max )
+	{
+		store->dict_slot_max *= 2;
+		
+		free( store->dict_slot );
+		store->dict_slot = must_calloc( store->dict_slot_max, sizeof( *store->dict_slot ) );
+		
+		for( i = 0; i < store->dict_count; ++i )
+		{
+			const WCHAR *p = NULL;
+			
+			
+			for( hash = 2166136261u, p = store->dict[ i ]; *p; ++p )
+				hash = ( hash ^ *p ) * 16777619u;
+			
+			for( slot = hash & ( store->dict_slot_max - 1 );
+				store->dict_slot[ slot ];
+				slot = ( slot + 1 ) & ( store->dict_slot_max - 1 )
+			)
+				;
+			
+			store->dict_slot[ slot ] = i + 1;
+		}
+	}
+	
+	return store->dict_count;
+}
+
+
+
+/* add_export_event() 
+Add a hook event as a row to the export store.
+
+'hook' is the hook info 
+'deskname' is the desktop name 
+'difftype' is the event, eg HOOK_ADDED, HOOK_MODIFIED, HOOK_REMOVED 
+'time' is the time of the snapshot the hook info is from
+
+If the store has the maximum number of rows then they're written as a row group. If they can't be 
+written it's fatal.
+
+if 'store' is NULL or hasn't been initialized this function returns.
+*/
+void add_export_event( 
+	struct exporter *const store,   // in
+	const struct hook *const hook,   // in
+	const WCHAR *const deskname,   // in
+	const enum difftype difftype,   // in
+	const __int64 time   // in
+)
+{
+	unsigned row = 0;
+	
+	FAIL_IF( !hook );
+	FAIL_IF( !deskname );
+	FAIL_IF( !difftype );
+	
+	
+	if( !store || !store->init_time )
+		return;
+	
+	row = store->row_count;
+	FAIL_IF( row >= EXPORT_GROUP_ROWS );
+	
+	store->column[ EXPORT_TIME ][ row ] = (UINT64)time;
+	store->column[ EXPORT_EVENT ][ row ] = (UINT64)difftype;
+	store->column[ EXPORT_HOOK_ID ][ row ] = (UINT64)(__int64)hook->object.iHook;
+	store->column[ EXPORT_HOOK_FLAGS ][ row ] = hook->object.flags;
+	store->column[ EXPORT_HANDLE ][ row ] = (uintptr_t)hook->object.head.h;
+	
+	#define EXPORT_THREAD(gui,pid,tid)   \
+		do \
+		{ \
+			store->column[ pid ][ row ] = ( ( gui ) && ( gui )->spi ) \
+				? (uintptr_t)( gui )->spi->UniqueProcessId : 0; \
+			store->column[ tid ][ row ] = ( ( gui ) && ( gui )->sti ) \
+				? (uintptr_t)( gui )->sti->ClientId.UniqueThread : 0; \
+__pragma(warning(push)) \
+__pragma(warning(disable:4127)) \
+		} while( 0 ) \
+__pragma(warning(pop))
+
+	EXPORT_THREAD( hook->owner, EXPORT_OWNER_PID, EXPORT_OWNER_TID );
+	EXPORT_THREAD( hook->origin, EXPORT_ORIGIN_PID, EXPORT_ORIGIN_TID );
+	EXPORT_THREAD( hook->target, EXPORT_TARGET_PID, EXPORT_TARGET_TID );
+	
+	#undef EXPORT_THREAD
+	
+	#define EXPORT_IMAGE(gui,index)   \
+		( store->column[ index ][ row ] = \
+			( ( gui ) && ( gui )->spi && ( gui )->spi->ImageName.Buffer ) \
+				? add_export_string( store, \
+					( gui )->spi->ImageName.Buffer, \
+					( gui )->spi->ImageName.Length / sizeof( WCHAR ) \
+				) \
+				: 0 \
+		)
+	
+	EXPORT_IMAGE( hook->origin, EXPORT_ORIGIN_IMAGE );
+	EXPORT_IMAGE( hook->target, EXPORT_TARGET_IMAGE );
+	
+	#undef EXPORT_IMAGE
+	
+	store->column[ EXPORT_DESKTOP ][ row ] = add_export_string( store, deskname, (unsigned)wcslen( deskname ) );
+	
+	++store->row_count;
+	
+	if( ( store->row_count == EXPORT_GROUP_ROWS ) && !flush_export_store( store, TRUE ) )
+	{
+		MSG_FATAL( "The hook events could not be written to the columnar export file." );
+		exit( 1 );
+	}
+	
+	return;
+}
+
+
+
+/* encode_export_column() 
+Encode a column chunk.
+
+'out' must be at least count * EXPORT_VARINT_MAX bytes.
+
+returns the number of bytes written to out
+*/
+static size_t encode_export_column( 
+	BYTE *const out,   // out
+	const UINT64 *const value,   // in
+	const unsigned count   // in
+)
+{
+	unsigned i = 0;
+	size_t bcount = 0;
+	UINT64 previous = 0;
+	
+	FAIL_IF( !out );
+	FAIL_IF( !value );
+	
+	
+	for( i = 0; i < count; ++i )
+	{
+		/* the difference from the previous value, zigzag encoded so small negatives are small */
+		const __int64 delta = (__int64)( value[ i ] - previous );
+		UINT64 zigzag = ( (UINT64)delta << 1 ) ^ (UINT64)( delta >> 63 );
+		
+		
+		while( zigzag >= 0x80 )
+		{
+			out[ bcount++ ] = (BYTE)( zigzag | 0x80 );
+			zigzag >>= 7;
+		}
+		
+		out[ bcount++ ] = (BYTE)zigzag;
+		
+		previous = value[ i ];
+	}
+	
+	return bcount;
+}
+
+
+
+/* flush_export_store() 
+Write the rows that haven't been written yet as a row group.
+
+If 'force' is zero the rows are only written if it has been at least EXPORT_FLUSH_SECONDS since the 
+last row group was written, so that each row group has more rows and the columns encode better.
+
+The row group is written where the footer is and then the footer is written after it.
+
+returns nonzero on success
+*/
+int flush_export_store( 
+	struct exporter *const store,   // in
+	const int force   // in
+)
+{
+	struct export_group_header *header = NULL;
+	struct export_footer_entry *entry = NULL;
+	__int64 now = 0;
+	size_t bcount = 0, dict_bcount = 0;
+	unsigned i = 0;
+	BYTE *group = NULL;
+	int ret = FALSE;
+	
+	FAIL_IF( !store );
+	FAIL_IF( !store->init_time );   // The export store must be initialized.
+	
+	
+	if( !store->row_count )
+		return TRUE;
+	
+	GetSystemTimeAsFileTime( (FILETIME *)&now );
+	
+	if( !force && ( ( now - store->flush_time ) < ( (__int64)EXPORT_FLUSH_SECONDS * EXPORT_FILETIME_SECOND ) ) )
+		return TRUE;
+	
+	for( i = store->dict_written; i < store->dict_count; ++i )
+		dict_bcount += ( wcslen( store->dict[ i ] ) + 1 ) * sizeof( UINT16 );
+	
+	/* build the row group in memory and then write it all at once */
+	group = must_calloc( 
+		sizeof( *header ) + dict_bcount + ( EXPORT_COLUMN_COUNT * store->row_count * EXPORT_VARINT_MAX ) + 8, 
+		1
+	);
+	
+	header = (struct export_group_header *)group;
+	memcpy( header->magic, EXPORT_GROUP_MAGIC, EXPORT_GROUP_MAGIC_LEN );
+	header->row_count = store->row_count;
+	header->dict_first = store->dict_written + 1;
+	header->dict_count = store->dict_count - store->dict_written;
+	header->dict_bcount = (UINT32)dict_bcount;
+	header->first_time = (__int64)store->column[ EXPORT_TIME ][ 0 ];
+	header->last_time = (__int64)store->column[ EXPORT_TIME ][ store->row_count - 1 ];
+	
+	bcount = sizeof( *header );
+	
+	/* the strings are written as UTF-16 even where WCHAR is wider */
+	for( i = store->dict_written; i < store->dict_count; ++i )
+	{
+		const WCHAR *str = store->dict[ i ];
+		UINT16 *out = (UINT16 *)( group + bcount );
+		
+		do
+		{
+			*out++ = (UINT16)*str;
+		} while( *str++ );
+		
+		bcount = (size_t)( (BYTE *)out - group );
+	}
+	
+	for( i = 0; i < EXPORT_COLUMN_COUNT; ++i )
+	{
+		const size_t len = encode_export_column( group + bcount, store->column[ i ], store->row_count );
+		
+		header->column_bcount[ i ] = (UINT32)len;
+		bcount += len;
+	}
+	
+	bcount = ( bcount + 7 ) & ~(size_t)7;
+	header->group_bcount = (UINT32)bcount;
+	
+	if( _fseeki64( store->fp, (__int64)store->footer_offset, SEEK_SET ) 
+		|| ( fwrite( group, bcount, 1, store->fp ) != 1 )
+	)
+	{
+		MSG_ERROR( "Failed to write the columnar export file row group." );
+		printf( "file: %ls\n", store->pwszFile );
+		goto cleanup;
+	}
+	
+	/* if the footer array is full double its size */
+	if( store->group_count == store->footer_max )
+	{
+		struct export_footer_entry *const temp = must_calloc( store->footer_max * 2, sizeof( *temp ) );
+		
+		memcpy( temp, store->footer, store->footer_max * sizeof( *temp ) );
+		free( store->footer );
+		
+		store->footer = temp;
+		store->footer_max *= 2;
+	}
+	
+	entry = &store->footer[ store->group_count++ ];
+	entry->offset = store->footer_offset;
+	entry->row_count = header->row_count;
+	entry->group_bcount = header->group_bcount;
+	entry->first_time = header->first_time;
+	entry->last_time = header->last_time;
+	
+	store->footer_offset += bcount;
+	store->total_rows += store->row_count;
+	store->row_count = 0;
+	store->dict_written = store->dict_count;
+	store->flush_time = now;
+	
+	if( !write_export_footer( store ) )
+		goto cleanup;
+	
+	ret = TRUE;
+
+cleanup:
+	free( group );
+	return ret;
+}
+
+
+
+/* is_export_file() 
+Check whether a file is a columnar export file.
+
+returns nonzero if the file begins with the columnar export file magic
+*/
+int is_export_file( 
+	const WCHAR *const file   // in
+)
+{
+	char magic[ EXPORT_MAGIC_LEN ];
+	FILE *fp = NULL;
+	int ret = FALSE;
+	
+	FAIL_IF( !file );
+	
+	
+	fp = _wfopen( file, L"rb" );
+	if( !fp )
+		return FALSE;
+	
+	if( ( fread( magic, sizeof( magic ), 1, fp ) == 1 ) && !memcmp( magic, EXPORT_MAGIC, EXPORT_MAGIC_LEN ) )
+		ret = TRUE;
+	
+	fclose( fp );
+	return ret;
+}
+
+
+
+/* decode_export_column() 
+Decode a column chunk.
+
+'count' is the number of values in the chunk and 'bcount' is the size of the chunk in bytes.
+
+returns nonzero if exactly 'count' values were decoded from exactly 'bcount' bytes
+*/
+static int decode_export_column( 
+	UINT64 *const value,   // out
+	const unsigned count,   // in
+	const BYTE *const in,   // in
+	const size_t bcount   // in
+)
+{
+	unsigned i = 0;
+	size_t offset = 0;
+	UINT64 previous = 0;
+	
+	FAIL_IF( !value );
+	FAIL_IF( !in );
+	
+	
+	for( i = 0; i < count; ++i )
+	{
+		UINT64 zigzag = 0;
+		unsigned shift = 0;
+		
+		
+		for( ;; )
+		{
+			BYTE b = 0;
+			
+			
+			if( ( offset >= bcount ) || ( shift >= 64 ) )
+				return FALSE;
+			
+			b = in[ offset++ ];
+			zigzag |= (UINT64)( b & 0x7F ) << shift;
+			shift += 7;
+			
+			if( !( b & 0x80 ) )
+				break;
+		}
+		
+		previous += ( zigzag >> 1 ) ^ ( 0 - ( zigzag & 1 ) );
+		value[ i ] = previous;
+	}
+	
+	return ( offset == bcount );
+}
+
+
+
+/* print_export_file() 
+Read a columnar export file and print its rows.
+
+The file is mapped read only by open_portable_view() and each row group in the footer is validated 
+and decoded. The time it 
+took to decode the columns is printed and then each row is printed as a line of text.
+
+returns nonzero on success
+*/
+int print_export_file( 
+	const WCHAR *const file   // in
+)
+{
+	struct portable_view view;
+	const BYTE *base = NULL;
+	LARGE_INTEGER frequency, start, stop;
+	const struct export_header *header = NULL;
+	const struct export_trailer *trailer = NULL;
+	const struct export_footer_entry *footer = NULL;
+	UINT64 *column[ EXPORT_COLUMN_COUNT ] = { NULL };
+	const WCHAR **dict = NULL;
+	
+	/* the strings of each row group. on Windows they point into the view. on other systems WCHAR is 
+	wider than the strings in the file, and the strings of each row group are a copy that has been 
+	widened.
+	*/
+	const WCHAR **pool = NULL;
+	unsigned __int64 total_rows = 0, dict_total = 0, row = 0;
+	unsigned i = 0, j = 0;
+	const char *const events[] = { "<unknown>", "Found", "Added", "Modified", "Removed", "Attributed" };
+	int ret = FALSE;
+	
+	FAIL_IF( !file );
+	
+	
+	if( !open_portable_view( &view, file ) )
+	{
+		print_portable_view_error( &view, file );
+		goto cleanup;
+	}
+	
+	if( view.bcount < ( sizeof( *header ) + sizeof( *trailer ) ) )
+	{
+		MSG_ERROR( "The file is not a columnar export file." );
+		printf( "file: %ls\n", file );
+		goto cleanup;
+	}
+	
+	base = view.base;
+	header = (const struct export_header *)base;
+	trailer = (const struct export_trailer *)( base + view.bcount - sizeof( *trailer ) );
+	
+	if( memcmp( header->magic, EXPORT_MAGIC, EXPORT_MAGIC_LEN ) 
+		|| ( header->version != EXPORT_VERSION ) 
+		|| ( header->header_bcount != sizeof( *header ) ) 
+		|| ( header->column_count != EXPORT_COLUMN_COUNT ) 
+		|| memcmp( trailer->magic, EXPORT_TRAILER_MAGIC, EXPORT_TRAILER_MAGIC_LEN ) 
+		|| ( trailer->footer_offset < sizeof( *header ) ) 
+		|| ( trailer->footer_offset % 8 ) 
+		|| ( trailer->footer_offset > ( (UINT64)view.bcount - sizeof( *trailer ) ) ) 
+		|| ( ( (UINT64)view.bcount - sizeof( *trailer ) - trailer->footer_offset ) 
+			!= ( (UINT64)trailer->group_count * sizeof( *footer ) )
+		)
+	)
+	{
+		MSG_ERROR( "The file is not a columnar export file, its version is not supported or its footer is invalid." );
+		printf( "file: %ls\n", file );
+		goto cleanup;
+	}
+	
+	footer = (const struct export_footer_entry *)( base + (size_t)trailer->footer_offset );
+	
+	/* validate the row groups */
+	for( i = 0; i < trailer->group_count; ++i )
+	{
+		const struct export_group_header *group = NULL;
+		UINT64 bcount = sizeof( *group );
+		
+		
+		if( ( footer[ i ].offset % 8 ) 
+			|| ( footer[ i ].offset < sizeof( *header ) ) 
+			|| ( footer[ i ].group_bcount < sizeof( *group ) ) 
+			|| ( footer[ i ].offset > trailer->footer_offset ) 
+			|| ( footer[ i ].group_bcount > ( trailer->footer_offset - footer[ i ].offset ) )
+		)
+			break;
+		
+		group = (const struct export_group_header *)( base + (size_t)footer[ i ].offset );
+		
+		bcount += group->dict_bcount;
+		
+		for( j = 0; j < EXPORT_COLUMN_COUNT; ++j )
+			bcount += group->column_bcount[ j ];
+		
+		if( memcmp( group->magic, EXPORT_GROUP_MAGIC, EXPORT_GROUP_MAGIC_LEN ) 
+			|| ( group->group_bcount != footer[ i ].group_bcount ) 
+			|| ( group->row_count != footer[ i ].row_count ) 
+			|| ( group->dict_first != ( dict_total + 1 ) ) 
+			|| ( group->dict_bcount % sizeof( UINT16 ) ) 
+			|| ( bcount > group->group_bcount )
+		)
+			break;
+		
+		total_rows += group->row_count;
+		dict_total += group->dict_count;
+	}
+	
+	if( i != trailer->group_count )
+	{
+		MSG_ERROR( "The columnar export file has an invalid row group." );
+		printf( "file: %ls\n", file );
+		printf( "row group index: %u\n", i );
+		goto cleanup;
+	}
+	
+	if( ( total_rows > ( (size_t)-1 / sizeof( UINT64 ) ) ) || ( dict_total > ( (size_t)-1 / sizeof( WCHAR * ) ) ) )
+	{
+		MSG_ERROR( "The columnar export file is too large." );
+		printf( "file: %ls\n", file );
+		goto cleanup;
+	}
+	
+	
+	/* decode the dictionary and the columns */
+	QueryPerformanceFrequency( &frequency );
+	QueryPerformanceCounter( &start );
+	
+	dict = must_calloc( (size_t)dict_total + 1, sizeof( *dict ) );
+	pool = must_calloc( (size_t)trailer->group_count + 1, sizeof( *pool ) );
+	
+	for( i = 0; i < EXPORT_COLUMN_COUNT; ++i )
+		column[ i ] = must_calloc( (size_t)total_rows + 1, sizeof( *column[ i ] ) );
+	
+	for( i = 0, row = 0, dict_total = 0; i < trailer->group_count; ++i )
+	{
+		const struct export_group_header *const group = 
+			(const struct export_group_header *)( base + (size_t)footer[ i ].offset );
+		const size_t ecount = group->dict_bcount / sizeof( UINT16 );
+		const BYTE *chunk = (const BYTE *)( group + 1 ) + group->dict_bcount;
+		const WCHAR *str = NULL, *str_end = NULL;
+		
+
+#ifdef _WIN32
+		pool[ i ] = (const WCHAR *)( group + 1 );
+#else
+		pool[ i ] = widen_portable_string( (const UINT16 *)( group + 1 ), ecount );
+#endif
+		str = pool[ i ];
+		str_end = str + ecount;
+		
+		for( j = 0; j < group->dict_count; ++j )
+		{
+			dict[ dict_total++ ] = str;
+			
+			while( ( str < str_end ) && *str )
+				++str;
+			
+			if( str == str_end )
+				break;
+			
+			++str;
+		}
+		
+		if( ( j != group->dict_count ) || ( str != str_end ) )
+		{
+			MSG_ERROR( "The columnar export file has an invalid dictionary." );
+			printf( "file: %ls\n", file );
+			printf( "row group index: %u\n", i );
+			goto cleanup;
+		}
+		
+		for( j = 0; j < EXPORT_COLUMN_COUNT; ++j )
+		{
+			if( !decode_export_column( column[ j ] + row, group->row_count, chunk, group->column_bcount[ j ] ) )
+			{
+				MSG_ERROR( "The columnar export file has an invalid column chunk." );
+				printf( "file: %ls\n", file );
+				printf( "row group index: %u\n", i );
+				printf( "column: %u\n", j );
+				goto cleanup;
+			}
+			
+			chunk += group->column_bcount[ j ];
+		}
+		
+		row += group->row_count;
+	}
+	
+	QueryPerformanceCounter( &stop );
+	
+	
+	printf( "Columnar export file: %ls\n", file );
+	print_init_time( "Created", header->create_time );
+	printf( "Row groups: %u\n", trailer->group_count );
+	printf( "Rows: %I64u\n", total_rows );
+	printf( "Dictionary strings: %I64u\n", dict_total );
+	printf( "Decoded in %.3f ms\n", 
+		( ( stop.QuadPart - start.QuadPart ) * 1000.0 ) / ( frequency.QuadPart ? frequency.QuadPart : 1 )
+	);
+	printf( "\n" );
+	
+	for( row = 0; row < total_rows; ++row )
+	{
+		const UINT64 event = column[ EXPORT_EVENT ][ row ];
+		const unsigned index = (unsigned)( (INT)column[ EXPORT_HOOK_ID ][ row ] + 1 );
+		
+		#define EXPORT_NAME(column_index)   \
+			( ( column[ column_index ][ row ] && ( column[ column_index ][ row ] <= dict_total ) ) \
+				? dict[ column[ column_index ][ row ] - 1 ] : L"<unknown>" \
+			)
+		
+		printf( "%I64d %s %ls 0x%02I64X 0x%I64X owner %I64u/%I64u origin %I64u/%I64u %ls "
+			"target %I64u/%I64u %ls desktop %ls\n", 
+			(__int64)column[ EXPORT_TIME ][ row ], 
+			events[ ( event <= HOOK_ATTRIBUTED ) ? event : 0 ], 
+			( ( index < w_hooknames_count ) ? w_hooknames[ index ] : L"<unknown>" ), 
+			column[ EXPORT_HOOK_FLAGS ][ row ], 
+			column[ EXPORT_HANDLE ][ row ], 
+			column[ EXPORT_OWNER_PID ][ row ], 
+			column[ EXPORT_OWNER_TID ][ row ], 
+			column[ EXPORT_ORIGIN_PID ][ row ], 
+			column[ EXPORT_ORIGIN_TID ][ row ], 
+			EXPORT_NAME( EXPORT_ORIGIN_IMAGE ), 
+			column[ EXPORT_TARGET_PID ][ row ], 
+			column[ EXPORT_TARGET_TID ][ row ], 
+			EXPORT_NAME( EXPORT_TARGET_IMAGE ), 
+			EXPORT_NAME( EXPORT_DESKTOP )
+		);
+		
+		#undef EXPORT_NAME
+	}
+	
+	ret = TRUE;
+
+cleanup:
+	for( i = 0; i < EXPORT_COLUMN_COUNT; ++i )
+		free( column[ i ] );
+	
+	free( (void *)dict );
+	
+#ifndef _WIN32
+	for( i = 0; pool && pool[ i ]; ++i )
+		free( (void *)pool[ i ] );
+#endif
+	
+	free( (void *)pool );
+	
+	close_portable_view( &view );
+	return ret;
+}
+
+
+
+/* print_export_store() 
+Print an export store.
+
+if 'store' is NULL this function returns without having printed anything.
+*/
+void print_export_store( 
+	const struct exporter *const store   // in
+)
+{
+	const char *const objname = "Export Store";
+	
+	
+	if( !store )
+		return;
+	
+	PRINT_DBLSEP_BEGIN( objname );
+	print_init_time( "store->init_time", store->init_time );
+	
+	printf( "store->pwszFile: %ls\n", ( store->pwszFile ? store->pwszFile : L"<none>" ) );
+	printf( "store->row_count: %u\n", store->row_count );
+	printf( "store->dict_count: %u\n", store->dict_count );
+	printf( "store->dict_written: %u\n", store->dict_written );
+	printf( "store->group_count: %u\n", store->group_count );
+	printf( "store->footer_offset: %I64u\n", store->footer_offset );
+	printf( "store->total_rows: %I64u\n", store->total_rows );
+	print_init_time( "store->flush_time", store->flush_time );
+	
+	PRINT_DBLSEP_END( objname );
+	
+	return;
+}
+
+
+
+/* free_export_store() 
+Free an export store and all its descendants.
+
+The rows that haven't been written are not written. Call flush_export_store() first.
+
+this function then sets the export store pointer to NULL and returns
+
+'in' is a pointer to a pointer to the export store.
+if( !in || !*in ) then this function returns.
+*/
+void free_export_store( 
+	struct exporter **const in   // in deref
+)
+{
+	unsigned i = 0;
+	
+	
+	if( !in || !*in )
+		return;
+	
+	if( (*in)->fp )
+		fclose( (*in)->fp );
+	
+	free( (*in)->pwszFile );
+	
+	for( i = 0; i < EXPORT_COLUMN_COUNT; ++i )
+		free( (*in)->column[ i ] );
+	
+	for( i = 0; i < (*in)->dict_count; ++i )
+		free( (*in)->dict[ i ] );
+	
+	free( (*in)->dict );
+	free( (*in)->dict_slot );
+	free( (*in)->footer );
+	
+	free( (*in) );
+	*in = NULL;
+	
+	return;
+}
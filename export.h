@@ -0,0 +1,303 @@
+/*
+Copyright (C) 2011 Jay Satiro <raysatiro@yahoo.com>
+All rights reserved.
+
+This file is part of GetHooks.
+
+GetHooks is free software: you can redistribute it and/or modify 
+it under the terms of the GNU General Public License as published by 
+the Free Software Foundation, either version 3 of the License, or 
+(at your option) any later version.
+
+GetHooks is distributed in the hope that it will be useful, 
+but WITHOUT ANY WARRANTY; without even the implied warranty of 
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License 
+along with GetHooks.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _EXPORT_H
+#define _EXPORT_H
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include "portable.h"
+#endif
+#include <stdio.h>
+
+/* desktop hook store (linked list of desktop and hook information) */
+#include "desktop_hook.h"
+
+/* enum difftype */
+#include "diff.h"
+
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/** The columnar export file format.
+A columnar export file is a file header followed by zero or more row groups and then a footer. Each 
+row is a hook event: a hook that was found, added, modified or removed. Each row group holds the 
+rows added since the previous row group, one column after another, so that a reader can load a 
+column without parsing any text.
+
+Each column chunk is an array of values encoded as the difference from the previous value in the 
+chunk (the first value is the difference from 0), zigzag encoded and then written as a variable 
+length integer: 7 bits per byte, least significant first, with the high bit set if more bytes 
+follow. Consecutive events usually have the same or nearby values so most values take one byte.
+
+The desktop and image columns are dictionary encoded. Their values are ids in the file's string 
+dictionary, or 0 if there is no name. Each row group begins with the strings that were added to the 
+dictionary since the previous row group. A string's id is its position in the dictionary + 1.
+
+All members are fixed width and little endian. The strings are UTF-16, which is the WCHAR of Windows.
+
+file layout:
+struct export_header 
+row group [ group_count ] 
+struct export_footer_entry [ group_count ] 
+struct export_trailer
+
+row group layout:
+struct export_group_header 
+UINT16 strings [ dict_bcount / sizeof( UINT16 ) ]   // dict_count null terminated strings 
+BYTE column chunks [ column_bcount[ 0 ] + ... + column_bcount[ EXPORT_COLUMN_COUNT - 1 ] ] 
+BYTE padding [ ]   // to a multiple of 8 bytes
+
+The footer and trailer are rewritten after every row group is written, so a file that is still 
+being written to can be read between row groups. Each row group is written over the previous 
+footer, so a file whose writer was terminated while it was writing a row group or the footer has 
+no valid trailer and can't be read.
+*/
+#define EXPORT_MAGIC   "GHCOLS\r\n"
+#define EXPORT_MAGIC_LEN   8
+#define EXPORT_VERSION   1
+
+#define EXPORT_GROUP_MAGIC   "CGRP"
+#define EXPORT_GROUP_MAGIC_LEN   4
+
+#define EXPORT_TRAILER_MAGIC   "GHCOLEND"
+#define EXPORT_TRAILER_MAGIC_LEN   8
+
+/* the columns, in the order they are written in each row group */
+enum export_column
+{
+	/* the snapshot's init_time in FILETIME format */
+	EXPORT_TIME, 
+	
+	/* the event: enum difftype */
+	EXPORT_EVENT, 
+	
+	/* the HOOK's id, flags and handle */
+	EXPORT_HOOK_ID, 
+	EXPORT_HOOK_FLAGS, 
+	EXPORT_HANDLE, 
+	
+	/* the owner, origin and target threads. 0 if the thread is unknown. */
+	EXPORT_OWNER_PID, 
+	EXPORT_OWNER_TID, 
+	EXPORT_ORIGIN_PID, 
+	EXPORT_ORIGIN_TID, 
+	EXPORT_TARGET_PID, 
+	EXPORT_TARGET_TID, 
+	
+	/* dictionary encoded. the image names of the origin and target threads and the desktop name */
+	EXPORT_ORIGIN_IMAGE, 
+	EXPORT_TARGET_IMAGE, 
+	EXPORT_DESKTOP, 
+	
+	EXPORT_COLUMN_COUNT
+};
+
+/* the maximum number of rows in a row group */
+#define EXPORT_GROUP_ROWS   16384
+
+/* the maximum number of seconds rows are buffered before they're written as a row group */
+#define EXPORT_FLUSH_SECONDS   60
+
+struct export_header
+{
+	char magic[ EXPORT_MAGIC_LEN ];
+	UINT32 version;
+	
+	/* sizeof( struct export_header ) */
+	UINT32 header_bcount;
+	
+	/* EXPORT_COLUMN_COUNT in the program that wrote the file */
+	UINT32 column_count;
+	UINT32 reserved;
+	
+	/* the system utc time in FILETIME format when the file was created */
+	__int64 create_time;
+};
+
+struct export_group_header
+{
+	char magic[ EXPORT_GROUP_MAGIC_LEN ];
+	
+	/* the size of the row group in bytes, including this struct and padding */
+	UINT32 group_bcount;
+	
+	UINT32 row_count;
+	
+	/* the id of the first string in this row group, the number of strings and their size in bytes */
+	UINT32 dict_first;
+	UINT32 dict_count;
+	UINT32 dict_bcount;
+	
+	/* the time of the first and last rows */
+	__int64 first_time;
+	__int64 last_time;
+	
+	/* the size of each column chunk in bytes */
+	UINT32 column_bcount[ EXPORT_COLUMN_COUNT ];
+};
+
+struct export_footer_entry
+{
+	/* the offset of the row group from the beginning of the file */
+	UINT64 offset;
+	
+	UINT32 row_count;
+	UINT32 group_bcount;
+	
+	__int64 first_time;
+	__int64 last_time;
+};
+
+struct export_trailer
+{
+	/* the offset of the footer from the beginning of the file */
+	UINT64 footer_offset;
+	
+	UINT32 group_count;
+	UINT32 reserved;
+	
+	char magic[ EXPORT_TRAILER_MAGIC_LEN ];
+};
+
+
+
+/** The export store.
+The export store writes hook events to a columnar export file.
+*/
+struct exporter
+{
+	/* the name of the file */
+	WCHAR *pwszFile;   // must_wcsdup(), free()
+	
+	FILE *fp;   // _wfopen(), fclose()
+	
+	
+	/** the rows that haven't been written yet.
+	*/
+	/* an array for each column */
+	UINT64 *column[ EXPORT_COLUMN_COUNT ];   // must_calloc( EXPORT_GROUP_ROWS ), free()
+	
+	/* the number of rows in the column arrays */
+	unsigned row_count;
+	
+	/* the system utc time in FILETIME format when the last row group was written */
+	__int64 flush_time;
+	
+	
+	/** the string dictionary.
+	*/
+	/* an array of the strings in the order they were added */
+	WCHAR **dict;   // must_calloc(), free()
+	
+	/* the allocated/maximum number of elements in the string array */
+	unsigned dict_max;
+	
+	/* the number of elements written to in the string array */
+	unsigned dict_count;
+	
+	/* the number of strings that have been written to the file */
+	unsigned dict_written;
+	
+	/* the string hash table. each slot is an index in the string array + 1, or 0 if empty. */
+	unsigned *dict_slot;   // must_calloc(), free()
+	
+	/* the number of slots in the string hash table. always a power of 2. */
+	unsigned dict_slot_max;
+	
+	
+	/** the footer.
+	*/
+	/* an entry for each row group that has been written */
+	struct export_footer_entry *footer;   // must_calloc(), free()
+	
+	/* the allocated/maximum number of elements in the footer array */
+	unsigned footer_max;
+	
+	/* the number of row groups that have been written */
+	unsigned group_count;
+	
+	/* the offset in the file where the next row group is written, which is where the footer is */
+	UINT64 footer_offset;
+	
+	
+	/* the total number of rows written */
+	unsigned __int64 total_rows;
+	
+	/* the system utc time in FILETIME format immediately after this store has been initialized.
+	this is nonzero when this store has been initialized.
+	*/
+	__int64 init_time;
+};
+
+
+
+/** 
+these functions are documented in the comment block above their definitions in export.c
+*/
+void create_export_store( 
+	struct exporter **const out   // out deref
+);
+
+int init_export_store( 
+	struct exporter *const store,   // in
+	const WCHAR *const file   // in
+);
+
+void add_export_event( 
+	struct exporter *const store,   // in
+	const struct hook *const hook,   // in
+	const WCHAR *const deskname,   // in
+	const enum difftype difftype,   // in
+	const __int64 time   // in
+);
+
+int flush_export_store( 
+	struct exporter *const store,   // in
+	const int force   // in
+);
+
+int is_export_file( 
+	const WCHAR *const file   // in
+);
+
+int print_export_file( 
+	const WCHAR *const file   // in
+);
+
+void print_export_store( 
+	const struct exporter *const store   // in
+);
+
+void free_export_store( 
+	struct exporter **const in   // in deref
+);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _EXPORT_H
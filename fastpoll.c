@@ -0,0 +1,662 @@
+/*
+Copyright (C) 2011 Jay Satiro <raysatiro@yahoo.com>
+All rights reserved.
+
+This file is part of GetHooks.
+
+GetHooks is free software: you can redistribute it and/or modify 
+it under the terms of the GNU General Public License as published by 
+the Free Software Foundation, either version 3 of the License, or 
+(at your option) any later version.
+
+GetHooks is distributed in the hope that it will be useful, 
+but WITHOUT ANY WARRANTY; without even the implied warranty of 
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License 
+along with GetHooks.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/** 
+This file contains functions for a fast poll store (re-poll hook owner threads between snapshots).
+Each function is documented in the comment block above its definition.
+
+A full snapshot queries the info of every thread in the system and reads the memory of every 
+process with a gui thread. Between full snapshots only the handful of threads that own or originated 
+a hook are of interest. The fast poll store keeps a handle open to each of those threads and 
+re-polls them with one NtQueryInformationThread() call each, and QueryThreadCycleTime() on Vista+. 
+That is a tiny fraction of the cost of a full snapshot. The number of re-polls for each full 
+snapshot is adjustable.
+
+-
+create_fastpoll_store()
+
+Create a fast poll store and its descendants or die.
+-
+
+-
+init_fastpoll_store()
+
+Initialize a fast poll store.
+-
+
+-
+query_fastpoll_thread()
+
+Query a tracked thread's CPU time and cycle count.
+-
+
+-
+update_fastpoll_store()
+
+Update the tracked threads from a snapshot.
+-
+
+-
+sample_fastpoll_store()
+
+Re-poll the tracked threads until a number of milliseconds have elapsed.
+-
+
+-
+compare_fastpoll_thread()
+
+Compare two tracked threads by the CPU time they used since the last snapshot.
+-
+
+-
+print_fastpoll_report()
+
+Print the tracked threads ranked by the CPU time they used since the last snapshot.
+-
+
+-
+print_fastpoll_store()
+
+Print a fast poll store.
+-
+
+-
+free_fastpoll_store()
+
+Free a fast poll store and all its descendants.
+-
+
+*/
+
+#include <stdio.h>
+
+#include "util.h"
+
+#include "fastpoll.h"
+
+/* the global stores */
+#include "global.h"
+
+
+
+/* the initial number of elements in the thread array */
+#define FASTPOLL_THREADS_DEFAULT   32
+
+/* NtQueryInformationThread() ThreadTimes */
+#define FASTPOLL_THREAD_TIMES   1
+
+/* THREAD_QUERY_LIMITED_INFORMATION (Vista+) may not be defined by older SDKs */
+#define FASTPOLL_QUERY_LIMITED_INFORMATION   0x0800
+
+/* the number of FILETIME intervals in a millisecond */
+#define FASTPOLL_FILETIME_MS   10000
+
+
+
+static int query_fastpoll_thread( 
+	const struct fastpoll *const store,   // in
+	struct fastpoll_thread *const thread,   // in, out
+	__int64 *const cpu,   // out
+	unsigned __int64 *const cycles   // out
+);
+
+static int compare_fastpoll_thread( 
+	const void *const p1,   // in
+	const void *const p2   // in
+);
+
+
+
+/* create_fastpoll_store() 
+Create a fast poll store and its descendants or die.
+*/
+void create_fastpoll_store( 
+	struct fastpoll **const out   // out deref
+)
+{
+	struct fastpoll *fastpoll = NULL;
+	
+	FAIL_IF( !out );
+	FAIL_IF( *out );
+	
+	
+	/* allocate a fast poll store */
+	fastpoll = must_calloc( 1, sizeof( *fastpoll ) );
+	
+	fastpoll->thread_max = FASTPOLL_THREADS_DEFAULT;
+	fastpoll->thread = must_calloc( fastpoll->thread_max, sizeof( *fastpoll->thread ) );
+	
+	
+	*out = fastpoll;
+	return;
+}
+
+
+
+/* init_fastpoll_store() 
+Initialize a fast poll store.
+
+'ratio' is how many re-polls there are for each full snapshot.
+
+returns nonzero on success
+*/
+int init_fastpoll_store( 
+	struct fastpoll *const store,   // in
+	const unsigned ratio   // in
+)
+{
+	FAIL_IF( !store );
+	FAIL_IF( store->init_time );   // Fail if this store has already been initialized.
+	
+	
+	if( ( ratio < FASTPOLL_RATIO_MIN ) || ( ratio > FASTPOLL_RATIO_MAX ) )
+	{
+		MSG_ERROR( "The fast poll ratio is invalid." );
+		printf( "ratio: %u\n", ratio );
+		return FALSE;
+	}
+	
+	store->ratio = ratio;
+	
+	SetLastError( 0 ); // error code is evaluated on success
+	*(FARPROC *)&store->NtQueryInformationThread = 
+		(FARPROC)GetProcAddress( GetModuleHandleA( "ntdll" ), "NtQueryInformationThread" );
+	
+	if( !store->NtQueryInformationThread )
+	{
+		MSG_ERROR_GLE( "GetProcAddress() failed to get NtQueryInformationThread()." );
+		return FALSE;
+	}
+	
+	/* this is optional. the cycle count is more precise than the CPU time, which is only updated 
+	at each clock tick.
+	*/
+	*(FARPROC *)&store->QueryThreadCycleTime = 
+		(FARPROC)GetProcAddress( GetModuleHandleA( "kernel32" ), "QueryThreadCycleTime" );
+	
+	
+	/* the fast poll store has been initialized */
+	GetSystemTimeAsFileTime( (FILETIME *)&store->init_time );
+	return TRUE;
+}
+
+
+
+/* query_fastpoll_thread() 
+Query a tracked thread's CPU time and cycle count.
+
+'*cpu' receives the thread's kernel and user time in 100ns intervals 
+'*cycles' receives the thread's cycle count, or 0 if QueryThreadCycleTime() isn't available
+
+If the thread has exited or its thread id now belongs to a different thread then thread->exited is 
+set.
+
+returns nonzero on success
+*/
+static int query_fastpoll_thread( 
+	const struct fastpoll *const store,   // in
+	struct fastpoll_thread *const thread,   // in, out
+	__int64 *const cpu,   // out
+	unsigned __int64 *const cycles   // out
+)
+{
+	struct /* KERNEL_USER_TIMES */
+	{
+		LARGE_INTEGER CreateTime;
+		LARGE_INTEGER ExitTime;
+		LARGE_INTEGER KernelTime;
+		LARGE_INTEGER UserTime;
+	} times;
+	
+	FAIL_IF( !store );
+	FAIL_IF( !thread );
+	FAIL_IF( !cpu );
+	FAIL_IF( !cycles );
+	
+	
+	*cpu = 0;
+	*cycles = 0;
+	
+	if( !thread->thread || thread->exited )
+		return FALSE;
+	
+	ZeroMemory( &times, sizeof( times ) );
+	
+	if( store->NtQueryInformationThread( 
+			thread->thread, 
+			FASTPOLL_THREAD_TIMES, 
+			&times, 
+			sizeof( times ), 
+			NULL
+		)
+	)
+		return FALSE;
+	
+	if( times.ExitTime.QuadPart || ( times.CreateTime.QuadPart != thread->create_time ) )
+	{
+		thread->exited = TRUE;
+		return FALSE;
+	}
+	
+	*cpu = times.KernelTime.QuadPart + times.UserTime.QuadPart;
+	
+	if( store->QueryThreadCycleTime 
+		&& !store->QueryThreadCycleTime( thread->thread, cycles )
+	)
+		*cycles = 0;
+	
+	return TRUE;
+}
+
+
+
+/* update_fastpoll_store() 
+Update the tracked threads from a snapshot.
+
+The owner and origin threads of each hook that wasn't ignored are tracked. A handle is opened to 
+each new thread. The threads that no longer own or originated a hook aren't tracked anymore and 
+their handles are closed. The counts since the last snapshot are reset.
+
+This function must only be called from the main thread.
+*/
+void update_fastpoll_store( 
+	struct fastpoll *const store,   // in
+	const struct snapshot *const snapshot   // in
+)
+{
+	unsigned i = 0, count = 0;
+	const struct desktop_hook_item *dh = NULL;
+	
+	FAIL_IF( !store );
+	FAIL_IF( !store->init_time );   // The fast poll store must be initialized.
+	FAIL_IF( !snapshot );
+	FAIL_IF( !snapshot->init_time );   // The snapshot store must be initialized.
+	
+	FAIL_IF( GetCurrentThreadId() != G->prog->dwMainThreadId );   // main thread only
+	
+	
+	++store->generation;
+	store->sample_total = 0;
+	store->query_failed = 0;
+	
+	for( dh = snapshot->desktop_hooks->head; dh; dh = dh->next )
+	{
+		for( i = 0; i < dh->hook_count; ++i )
+		{
+			const struct gui *gui[ 2 ];
+			unsigned j = 0;
+			
+			
+			if( dh->hook[ i ].ignore )
+				continue;
+			
+			gui[ 0 ] = dh->hook[ i ].owner;
+			gui[ 1 ] = ( dh->hook[ i ].origin != dh->hook[ i ].owner ) ? dh->hook[ i ].origin : NULL;
+			
+			for( j = 0; j < 2; ++j )
+			{
+				struct fastpoll_thread *thread = NULL;
+				unsigned k = 0;
+				
+				
+				if( !gui[ j ] || !gui[ j ]->spi || !gui[ j ]->sti )
+					continue;
+				
+				for( k = 0; k < store->thread_count; ++k )
+				{
+					if( ( store->thread[ k ].tid == (uintptr_t)gui[ j ]->sti->ClientId.UniqueThread ) 
+						&& ( store->thread[ k ].create_time == gui[ j ]->sti->CreateTime.QuadPart )
+					)
+						break;
+				}
+				
+				if( k == store->thread_count )
+				{
+					/* the thread isn't tracked. if the thread array is full double its size */
+					if( store->thread_count == store->thread_max )
+					{
+						struct fastpoll_thread *const temp = 
+							must_calloc( store->thread_max * 2, sizeof( *temp ) );
+						
+						memcpy( temp, store->thread, store->thread_max * sizeof( *temp ) );
+						free( store->thread );
+						
+						store->thread = temp;
+						store->thread_max *= 2;
+					}
+					
+					thread = &store->thread[ store->thread_count++ ];
+					
+					thread->tid = (uintptr_t)gui[ j ]->sti->ClientId.UniqueThread;
+					thread->create_time = gui[ j ]->sti->CreateTime.QuadPart;
+					thread->pid = (uintptr_t)gui[ j ]->spi->UniqueProcessId;
+					
+					if( gui[ j ]->spi->ImageName.Buffer )
+					{
+						const unsigned cch = gui[ j ]->spi->ImageName.Length / sizeof( WCHAR );
+						
+						thread->name = must_calloc( cch + 1, sizeof( WCHAR ) );
+						memcpy( thread->name, gui[ j ]->spi->ImageName.Buffer, cch * sizeof( WCHAR ) );
+					}
+					
+					thread->thread = OpenThread( 
+						( ( G->prog->dwOSMajorVersion >= 6 ) 
+							? FASTPOLL_QUERY_LIMITED_INFORMATION 
+							: THREAD_QUERY_INFORMATION
+						), 
+						FALSE, 
+						(DWORD)thread->tid
+					);
+					
+					/* the first query is the baseline for the first re-poll */
+					query_fastpoll_thread( store, thread, &thread->last_cpu, &thread->last_cycles );
+				}
+				else
+					thread = &store->thread[ k ];
+				
+				if( thread->generation != store->generation )
+				{
+					thread->generation = store->generation;
+					thread->hook_count = 0;
+				}
+				
+				++thread->hook_count;
+			}
+		}
+	}
+	
+	/* stop tracking the threads that don't own or originated a hook in the snapshot */
+	for( i = 0, count = 0; i < store->thread_count; ++i )
+	{
+		struct fastpoll_thread *const thread = &store->thread[ i ];
+		
+		
+		if( thread->generation != store->generation )
+		{
+			if( thread->thread )
+				CloseHandle( thread->thread );
+			
+			free( thread->name );
+			continue;
+		}
+		
+		thread->sample_count = 0;
+		thread->busy_count = 0;
+		thread->cpu = 0;
+		thread->cpu_peak = 0;
+		thread->cycles = 0;
+		
+		store->thread[ count++ ] = *thread;
+	}
+	
+	ZeroMemory( &store->thread[ count ], ( store->thread_count - count ) * sizeof( *store->thread ) );
+	store->thread_count = count;
+	
+	return;
+}
+
+
+
+/* sample_fastpoll_store() 
+Re-poll the tracked threads until a number of milliseconds have elapsed.
+
+This is used in place of Sleep() between snapshots in monitor mode. The time is divided into 
+store->ratio intervals and the tracked threads are re-polled at the end of each interval.
+
+This function must only be called from the main thread.
+*/
+void sample_fastpoll_store( 
+	struct fastpoll *const store,   // in
+	const DWORD milliseconds   // in
+)
+{
+	const DWORD start = GetTickCount();
+	DWORD elapsed = 0;
+	
+	FAIL_IF( !store );
+	FAIL_IF( !store->init_time );   // The fast poll store must be initialized.
+	
+	FAIL_IF( GetCurrentThreadId() != G->prog->dwMainThreadId );   // main thread only
+	
+	
+	store->interval = milliseconds / store->ratio;
+	if( !store->interval )
+		store->interval = 1;
+	
+	while( ( elapsed = GetTickCount() - start ) < milliseconds )
+	{
+		const DWORD remaining = milliseconds - elapsed;
+		unsigned i = 0;
+		
+		
+		Sleep( ( remaining < store->interval ) ? remaining : store->interval );
+		
+		++store->sample_total;
+		
+		for( i = 0; i < store->thread_count; ++i )
+		{
+			struct fastpoll_thread *const thread = &store->thread[ i ];
+			__int64 cpu = 0;
+			unsigned __int64 cycles = 0;
+			
+			
+			if( !thread->thread || thread->exited )
+				continue;
+			
+			if( !query_fastpoll_thread( store, thread, &cpu, &cycles ) )
+			{
+				if( !thread->exited )
+					++store->query_failed;
+				
+				continue;
+			}
+			
+			++thread->sample_count;
+			
+			if( ( cpu > thread->last_cpu ) || ( cycles > thread->last_cycles ) )
+				++thread->busy_count;
+			
+			if( ( cpu - thread->last_cpu ) > thread->cpu_peak )
+				thread->cpu_peak = cpu - thread->last_cpu;
+			
+			thread->cpu += cpu - thread->last_cpu;
+			thread->cycles += cycles - thread->last_cycles;
+			
+			thread->last_cpu = cpu;
+			thread->last_cycles = cycles;
+		}
+	}
+	
+	return;
+}
+
+
+
+/* compare_fastpoll_thread() 
+Compare two tracked threads by the CPU time they used since the last snapshot.
+
+qsort() callback: sort an array of pointers to tracked threads, most cycles and CPU time first.
+*/
+static int compare_fastpoll_thread( 
+	const void *const p1,   // in
+	const void *const p2   // in
+)
+{
+	const struct fastpoll_thread *const a = *(const struct fastpoll_thread *const *)p1;
+	const struct fastpoll_thread *const b = *(const struct fastpoll_thread *const *)p2;
+	
+	
+	if( a->cycles != b->cycles )
+		return ( a->cycles < b->cycles ) ? 1 : -1;
+	
+	if( a->cpu != b->cpu )
+		return ( a->cpu < b->cpu ) ? 1 : -1;
+	
+	if( a->busy_count != b->busy_count )
+		return ( a->busy_count < b->busy_count ) ? 1 : -1;
+	
+	return 0;
+}
+
+
+
+/* print_fastpoll_report() 
+Print the tracked threads ranked by the CPU time they used since the last snapshot.
+
+busy: the percentage of re-polls in which the thread had used CPU since the previous re-poll 
+cpu ms: the CPU time in milliseconds 
+peak ms: the most CPU time in milliseconds used between two re-polls 
+Mcycles: the CPU cycles in millions, or 0 if the OS doesn't have QueryThreadCycleTime() 
+hooks: the number of hooks the thread owned or originated in the last snapshot
+
+if 'store' is NULL this function returns without having printed anything.
+*/
+void print_fastpoll_report( 
+	const struct fastpoll *const store   // in
+)
+{
+	unsigned i = 0;
+	const struct fastpoll_thread **thread = NULL;
+	
+	
+	if( !store )
+		return;
+	
+	FAIL_IF( !store->init_time );   // The fast poll store must be initialized.
+	
+	
+	thread = must_calloc( store->thread_count + 1, sizeof( *thread ) );
+	
+	for( i = 0; i < store->thread_count; ++i )
+		thread[ i ] = &store->thread[ i ];
+	
+	qsort( (void *)thread, store->thread_count, sizeof( *thread ), compare_fastpoll_thread );
+	
+	printf( "\nHook thread re-polls (%u threads, %u re-polls every %lu ms, %I64u failed queries):\n", 
+		store->thread_count, 
+		store->sample_total, 
+		store->interval, 
+		store->query_failed
+	);
+	printf( "%7s %8s %8s %10s %6s  %s\n", 
+		"busy", "cpu ms", "peak ms", "Mcycles", "hooks", "thread"
+	);
+	
+	for( i = 0; i < store->thread_count; ++i )
+	{
+		const struct fastpoll_thread *const a = thread[ i ];
+		
+		
+		printf( "%6.1f%% %8I64d %8I64d %10I64u %6u  %ls (PID %I64u, TID %I64u)", 
+			( a->sample_count ? ( ( a->busy_count * 100.0 ) / a->sample_count ) : 0 ), 
+			( a->cpu / FASTPOLL_FILETIME_MS ), 
+			( a->cpu_peak / FASTPOLL_FILETIME_MS ), 
+			( a->cycles / 1000000 ), 
+			a->hook_count, 
+			( a->name ? a->name : L"<unknown>" ), 
+			a->pid, 
+			a->tid
+		);
+		
+		if( !a->thread )
+			printf( " [not opened]" );
+		else if( a->exited )
+			printf( " [exited]" );
+		
+		printf( "\n" );
+	}
+	
+	fflush( stdout );
+	free( (void *)thread );
+	return;
+}
+
+
+
+/* print_fastpoll_store() 
+Print a fast poll store.
+
+if 'store' is NULL this function returns without having printed anything.
+*/
+void print_fastpoll_store( 
+	const struct fastpoll *const store   // in
+)
+{
+	const char *const objname = "Fast Poll Store";
+	
+	
+	if( !store )
+		return;
+	
+	PRINT_DBLSEP_BEGIN( objname );
+	print_init_time( "store->init_time", store->init_time );
+	
+	printf( "store->thread_max: %u\n", store->thread_max );
+	printf( "store->thread_count: %u\n", store->thread_count );
+	printf( "store->generation: %u\n", store->generation );
+	printf( "store->ratio: %u\n", store->ratio );
+	printf( "store->interval: %lu\n", store->interval );
+	printf( "store->NtQueryInformationThread: %p\n", store->NtQueryInformationThread );
+	printf( "store->QueryThreadCycleTime: %p\n", store->QueryThreadCycleTime );
+	printf( "store->sample_total: %u\n", store->sample_total );
+	printf( "store->query_failed: %I64u\n", store->query_failed );
+	
+	PRINT_DBLSEP_END( objname );
+	
+	return;
+}
+
+
+
+/* free_fastpoll_store() 
+Free a fast poll store and all its descendants.
+
+The handles to the tracked threads are closed.
+
+this function then sets the fast poll store pointer to NULL and returns
+
+'in' is a pointer to a pointer to the fast poll store.
+if( !in || !*in ) then this function returns.
+*/
+void free_fastpoll_store( 
+	struct fastpoll **const in   // in deref
+)
+{
+	unsigned i = 0;
+	
+	
+	if( !in || !*in )
+		return;
+	
+	for( i = 0; i < (*in)->thread_count; ++i )
+	{
+		if( (*in)->thread[ i ].thread )
+			CloseHandle( (*in)->thread[ i ].thread );
+		
+		free( (*in)->thread[ i ].name );
+	}
+	
+	free( (*in)->thread );
+	
+	free( (*in) );
+	*in = NULL;
+	
+	return;
+}
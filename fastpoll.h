@@ -0,0 +1,174 @@
+/*
+Copyright (C) 2011 Jay Satiro <raysatiro@yahoo.com>
+All rights reserved.
+
+This file is part of GetHooks.
+
+GetHooks is free software: you can redistribute it and/or modify 
+it under the terms of the GNU General Public License as published by 
+the Free Software Foundation, either version 3 of the License, or 
+(at your option) any later version.
+
+GetHooks is distributed in the hope that it will be useful, 
+but WITHOUT ANY WARRANTY; without even the implied warranty of 
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License 
+along with GetHooks.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _FASTPOLL_H
+#define _FASTPOLL_H
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include "portable.h"
+#endif
+
+/* snapshot store (system process info, gui threads, desktop hooks) */
+#include "snapshot.h"
+
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/** This is the info kept for each hook owner or origin thread that is re-polled.
+A thread is identified by its thread id and creation time.
+*/
+struct fastpoll_thread
+{
+	unsigned __int64 tid;
+	__int64 create_time;
+	
+	/* the thread's process id and process image name */
+	unsigned __int64 pid;
+	WCHAR *name;   // calloc(), free()
+	
+	/* a handle to the thread that is kept open while the thread is tracked.
+	NULL if the thread couldn't be opened, in which case it isn't re-polled.
+	*/
+	HANDLE thread;   // OpenThread(), CloseHandle()
+	
+	/* the snapshot generation in which the thread last owned or originated a hook */
+	unsigned generation;
+	
+	/* the number of hooks the thread owned or originated in the last snapshot */
+	unsigned hook_count;
+	
+	/* nonzero if a re-poll found that the thread has exited */
+	unsigned exited;
+	
+	/* the thread's CPU time in 100ns intervals and cycle count from the last re-poll */
+	__int64 last_cpu;
+	unsigned __int64 last_cycles;
+	
+	/* counts since the last snapshot.
+	a re-poll is busy if the thread used any CPU since the previous re-poll.
+	*/
+	unsigned sample_count;
+	unsigned busy_count;
+	__int64 cpu;
+	__int64 cpu_peak;
+	unsigned __int64 cycles;
+};
+
+
+
+/** The fast poll store.
+The fast poll store re-polls only the hook owner and origin threads between full snapshots, with 
+one query per thread instead of a query of every thread in the system.
+*/
+struct fastpoll
+{
+	/* an array of tracked threads */
+	struct fastpoll_thread *thread;   // calloc(), free()
+	
+	/* the allocated/maximum number of elements in the thread array */
+	unsigned thread_max;
+	
+	/* the number of elements written to in the thread array */
+	unsigned thread_count;
+	
+	/* the current snapshot generation. see update_fastpoll_store() */
+	unsigned generation;
+	
+	/* how many re-polls there are for each full snapshot */
+	#define FASTPOLL_RATIO_MIN   1
+	#define FASTPOLL_RATIO_MAX   10000
+	unsigned ratio;
+	
+	/* the interval in milliseconds between the re-polls since the last snapshot */
+	DWORD interval;
+	
+	/* ntdll's NtQueryInformationThread() */
+	LONG ( __stdcall *NtQueryInformationThread )( 
+		HANDLE ThreadHandle, 
+		int ThreadInformationClass, 
+		PVOID ThreadInformation, 
+		ULONG ThreadInformationLength, 
+		PULONG ReturnLength
+	);
+	
+	/* kernel32's QueryThreadCycleTime(). NULL if the OS is older than Vista. */
+	BOOL ( WINAPI *QueryThreadCycleTime )( 
+		HANDLE ThreadHandle, 
+		unsigned __int64 *CycleTime
+	);
+	
+	/* the number of re-polls since the last snapshot, and how many thread queries failed */
+	unsigned sample_total;
+	unsigned __int64 query_failed;
+	
+	/* the system utc time in FILETIME format immediately after this store has been initialized.
+	this is nonzero when this store has been initialized.
+	*/
+	__int64 init_time;
+};
+
+
+
+/** 
+these functions are documented in the comment block above their definitions in fastpoll.c
+*/
+void create_fastpoll_store( 
+	struct fastpoll **const out   // out deref
+);
+
+int init_fastpoll_store( 
+	struct fastpoll *const store,   // in
+	const unsigned ratio   // in
+);
+
+void update_fastpoll_store( 
+	struct fastpoll *const store,   // in
+	const struct snapshot *const snapshot   // in
+);
+
+void sample_fastpoll_store( 
+	struct fastpoll *const store,   // in
+	const DWORD milliseconds   // in
+);
+
+void print_fastpoll_report( 
+	const struct fastpoll *const store   // in
+);
+
+void print_fastpoll_store( 
+	const struct fastpoll *const store   // in
+);
+
+void free_fastpoll_store( 
+	struct fastpoll **const in   // in deref
+);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _FASTPOLL_H
@@ -26,6 +26,22 @@ There are several global stores (these are referred to as descendants of 'G'):
 'G->prog' is the global program store. It holds basic program and system info.
 'G->config' is the global configuration store. It holds the user's configuration.
 'G->desktops' is the global desktop store. It holds the list of attached to desktops.
+'G->exporter' is the global export store. It writes hook events to a columnar export file.
+'G->ancestry' is the global process ancestry store. It holds a parent/child index of processes.
+'G->latency' is the global latency store. It tracks the origin threads of low-level and global hooks.
+'G->cost' is the global cost store. It accounts for the CPU time used by hook threads.
+'G->fastpoll' is the global fast poll store. It re-polls hook threads between snapshots.
+'G->hookscan' is the global hook scan store. It reports hook events between snapshots.
+'G->prefetch' is the global prefetch store. It queries the system process info ahead of time.
+'G->reload' is the global reload store. It reloads the configuration file when it changes.
+'G->chain' is the global chain store. It checks the integrity of the HOOK chains.
+'G->occupancy' is the global occupancy store. It estimates how full each desktop heap is.
+'G->churn' is the global churn store. It samples the USER handle counts every few milliseconds.
+'G->checkpoint' is the global checkpoint store. It caches thread and hook info across snapshots.
+'G->stream' is the global stream store. It prints the initial hooks as soon as they're resolved.
+'G->rules' is the global rules store. It matches the hook events against the user's rules.
+'G->rollup' is the global rollup store. It aggregates the hook metrics per minute, hour and day.
+'G->governor' is the global governor store. It keeps the monitor loop within a CPU budget.
 
 Each of the global stores and their functions are defined in their own units, eg prog.h/prog.c
 
@@ -55,6 +71,38 @@ Free the global store and all its descendants.
 
 #include "global.h"
 
+#include "export.h"
+
+#include "ancestry.h"
+
+#include "latency.h"
+
+#include "cost.h"
+
+#include "fastpoll.h"
+
+#include "hookscan.h"
+
+#include "prefetch.h"
+
+#include "reload.h"
+
+#include "chain.h"
+
+#include "occupancy.h"
+
+#include "churn.h"
+
+#include "checkpoint.h"
+
+#include "stream.h"
+
+#include "rules.h"
+
+#include "rollup.h"
+
+#include "governor.h"
+
 
 
 /* A pointer to this process' global store. The global store is the store of global stores. */
@@ -84,6 +132,57 @@ void create_global_store( void )
 	/* desktop store (linked list of desktops' heap and thread info) */
 	create_desktop_store( &G->desktops );
 	
+	/* export store (columnar export file of hook events) */
+	create_export_store( &G->exporter );
+	
+	/* The remaining stores are only used in monitor mode, which is only built on Windows. */
+#ifdef _WIN32
+	/* process ancestry store (parent/child index of processes) */
+	create_ancestry_store( &G->ancestry );
+	
+	/* latency store (input latency impact of hook origin threads) */
+	create_latency_store( &G->latency );
+	
+	/* cost store (CPU cost accounting for hook owner threads) */
+	create_cost_store( &G->cost );
+	
+	/* fast poll store (re-poll hook owner threads between snapshots) */
+	create_fastpoll_store( &G->fastpoll );
+	
+	/* hook scan store (hook events between snapshots) */
+	create_hookscan_store( &G->hookscan );
+	
+	/* prefetch store (system process info queried ahead of each snapshot) */
+	create_prefetch_store( &G->prefetch );
+	
+	/* reload store (configuration file reloaded at runtime) */
+	create_reload_store( &G->reload );
+	
+	/* chain store (HOOK chain integrity checks) */
+	create_chain_store( &G->chain );
+	
+	/* occupancy store (desktop heap occupancy estimates) */
+	create_occupancy_store( &G->occupancy );
+	
+	/* churn store (USER handle churn time series) */
+	create_churn_store( &G->churn );
+	
+	/* checkpoint store (thread and hook info cached across snapshots and restarts) */
+	create_checkpoint_store( &G->checkpoint );
+	
+	/* stream store (incremental initial hook list and time to first hook) */
+	create_stream_store( &G->stream );
+	
+	/* rules store (compiled rules matched against the hook events) */
+	create_rules_store( &G->rules );
+	
+	/* rollup store (hook metrics per minute, hour and day) */
+	create_rollup_store( &G->rollup );
+	
+	/* governor store (CPU budget of the monitor loop) */
+	create_governor_store( &G->governor );
+#endif // _WIN32
+	
 	
 	return;
 }
@@ -105,6 +204,40 @@ void print_global_store( void )
 	printf( "\n" );
 	print_global_desktop_store();
 	printf( "\n" );
+	print_export_store( G->exporter );
+	printf( "\n" );
+#ifdef _WIN32
+	print_ancestry_store( G->ancestry );
+	printf( "\n" );
+	print_latency_store( G->latency );
+	printf( "\n" );
+	print_cost_store( G->cost );
+	printf( "\n" );
+	print_fastpoll_store( G->fastpoll );
+	printf( "\n" );
+	print_hookscan_store( G->hookscan );
+	printf( "\n" );
+	print_prefetch_store( G->prefetch );
+	printf( "\n" );
+	print_reload_store( G->reload );
+	printf( "\n" );
+	print_chain_store( G->chain );
+	printf( "\n" );
+	print_occupancy_store( G->occupancy );
+	printf( "\n" );
+	print_churn_store( G->churn );
+	printf( "\n" );
+	print_checkpoint_store( G->checkpoint );
+	printf( "\n" );
+	print_stream_store( G->stream );
+	printf( "\n" );
+	print_rules_store( G->rules );
+	printf( "\n" );
+	print_rollup_store( G->rollup );
+	printf( "\n" );
+	print_governor_store( G->governor );
+	printf( "\n" );
+#endif // _WIN32
 	
 	return;
 }
@@ -122,6 +255,40 @@ void free_global_store( void )
 	if( !G )
 		return;
 	
+#ifdef _WIN32
+	free_governor_store( &G->governor );
+	
+	free_rollup_store( &G->rollup );
+	
+	free_rules_store( &G->rules );
+	
+	free_stream_store( &G->stream );
+	
+	free_checkpoint_store( &G->checkpoint );
+	
+	free_churn_store( &G->churn );
+	
+	free_occupancy_store( &G->occupancy );
+	
+	free_chain_store( &G->chain );
+	
+	free_reload_store( &G->reload );
+	
+	free_prefetch_store( &G->prefetch );
+	
+	free_hookscan_store( &G->hookscan );
+	
+	free_fastpoll_store( &G->fastpoll );
+	
+	free_cost_store( &G->cost );
+	
+	free_latency_store( &G->latency );
+	
+	free_ancestry_store( &G->ancestry );
+#endif // _WIN32
+	
+	free_export_store( &G->exporter );
+	
 	free_desktop_store( &G->desktops );
 	
 	free_config_store( &G->config );
@@ -21,7 +21,11 @@ along with GetHooks.  If not, see <http://www.gnu.org/licenses/>.
 #ifndef _GLOBAL_H
 #define _GLOBAL_H
 
+#ifdef _WIN32
 #include <windows.h>
+#else
+#include "portable.h"
+#endif
 
 /* program store (command line arguments, OS version, etc) */
 #include "prog.h"
@@ -39,6 +43,72 @@ extern "C" {
 #endif
 
 
+/** Forward declaration for export store. export.h is only included where the store is used.
+*/
+struct exporter;
+
+/** Forward declaration for process ancestry store. ancestry.h is only included where the store is used.
+*/
+struct ancestry;
+
+/** Forward declaration for latency store. latency.h is only included where the store is used.
+*/
+struct latency;
+
+/** Forward declaration for cost store. cost.h is only included where the store is used.
+*/
+struct cost;
+
+/** Forward declaration for fast poll store. fastpoll.h is only included where the store is used.
+*/
+struct fastpoll;
+
+/** Forward declaration for hook scan store. hookscan.h is only included where the store is used.
+*/
+struct hookscan;
+
+/** Forward declaration for prefetch store. prefetch.h is only included where the store is used.
+*/
+struct prefetch;
+
+/** Forward declaration for reload store. reload.h is only included where the store is used.
+*/
+struct reload;
+
+/** Forward declaration for chain store. chain.h is only included where the store is used.
+*/
+struct chain;
+
+/** Forward declaration for occupancy store. occupancy.h is only included where the store is used.
+*/
+struct occupancy;
+
+/** Forward declaration for churn store. churn.h is only included where the store is used.
+*/
+struct churn;
+
+/** Forward declaration for checkpoint store. checkpoint.h is only included where the store is used.
+*/
+struct checkpoint;
+
+/** Forward declaration for stream store. stream.h is only included where the store is used.
+*/
+struct stream;
+
+/** Forward declaration for rules store. rules.h is only included where the store is used.
+*/
+struct rules;
+
+/** Forward declaration for rollup store. rollup.h is only included where the store is used.
+*/
+struct rollup;
+
+/** Forward declaration for governor store. governor.h is only included where the store is used.
+*/
+struct governor;
+
+
+
 /** The global store. 
 This store holds all the stores that must be available globally.
 */
@@ -52,6 +122,87 @@ struct global
 	
 	/* linked list of attached to desktops and their heap info. requires config init. */
 	struct desktop_list *desktops;   // create_desktop_store(), free_desktop_store()
+	
+	/* the columnar export file that hook events are written to. requires config init.
+	this store is only initialized if the user is exporting.
+	*/
+	struct exporter *exporter;   // create_export_store(), free_export_store()
+	
+	/* the parent/child index of processes that have been seen. requires config init.
+	this store is only initialized if the user requested the ancestry of hook origins.
+	*/
+	struct ancestry *ancestry;   // create_ancestry_store(), free_ancestry_store()
+	
+	/* the origin threads of low-level and global hooks and their states. requires config init.
+	this store is only initialized if the user requested input latency analysis.
+	*/
+	struct latency *latency;   // create_latency_store(), free_latency_store()
+	
+	/* the CPU time used by hook owner and origin threads. requires config init.
+	this store is only initialized if the user requested CPU cost accounting.
+	*/
+	struct cost *cost;   // create_cost_store(), free_cost_store()
+	
+	/* the hook owner and origin threads that are re-polled between snapshots. requires config init.
+	this store is only initialized if the user requested fast polling.
+	*/
+	struct fastpoll *fastpoll;   // create_fastpoll_store(), free_fastpoll_store()
+	
+	/* the hooks only snapshots taken between snapshots and the events they reported.
+	requires config init. this store is only initialized if the user requested hook scans.
+	*/
+	struct hookscan *hookscan;   // create_hookscan_store(), free_hookscan_store()
+	
+	/* the system process info queried on a background thread ahead of each snapshot.
+	requires config init. this store is only initialized if the user requested prefetching.
+	*/
+	struct prefetch *prefetch;   // create_prefetch_store(), free_prefetch_store()
+	
+	/* the configuration file that is reloaded when it changes. requires config init.
+	this store is only initialized if the user specified a configuration file.
+	*/
+	struct reload *reload;   // create_reload_store(), free_reload_store()
+	
+	/* the links of the HOOKs in the last snapshot that was checked and the anomalies found.
+	requires config init. this store is only initialized if the user requested chain checks.
+	*/
+	struct chain *chain;   // create_chain_store(), free_chain_store()
+	
+	/* the USER objects counted on each desktop heap and their growth. requires desktops init.
+	this store is only initialized if the user requested desktop heap occupancy estimates.
+	*/
+	struct occupancy *occupancy;   // create_occupancy_store(), free_occupancy_store()
+	
+	/* the samples of the USER handle table taken on a background thread. requires prog init.
+	this store is only initialized if the user requested USER handle churn sampling.
+	*/
+	struct churn *churn;   // create_churn_store(), free_churn_store()
+	
+	/* the TEB info of each thread and the first time each HOOK was found, kept across snapshots and 
+	restarts. this store is only initialized if the user requested a checkpoint file.
+	*/
+	struct checkpoint *checkpoint;   // create_checkpoint_store(), free_checkpoint_store()
+	
+	/* the hooks only snapshot whose hooks are printed while the first snapshot is taken, and the 
+	time to first hook. requires desktops init. this store is initialized for every full snapshot 
+	mode, and only streams if the user requested it.
+	*/
+	struct stream *stream;   // create_stream_store(), free_stream_store()
+	
+	/* the compiled rules that the hook events are matched against after each snapshot.
+	this store is only initialized if the user requested a rules file.
+	*/
+	struct rules *rules;   // create_rules_store(), free_rules_store()
+	
+	/* the hook metrics per minute, hour and day for long term trending.
+	this store is only initialized if the user requested rollups.
+	*/
+	struct rollup *rollup;   // create_rollup_store(), free_rollup_store()
+	
+	/* the CPU budget of the monitor loop.
+	this store is only initialized if the user requested a budget.
+	*/
+	struct governor *governor;   // create_governor_store(), free_governor_store()
 };
 
 
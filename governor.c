@@ -0,0 +1,793 @@
+/*
+Copyright (C) 2011 Jay Satiro <raysatiro@yahoo.com>
+All rights reserved.
+
+This file is part of GetHooks.
+
+GetHooks is free software: you can redistribute it and/or modify 
+it under the terms of the GNU General Public License as published by 
+the Free Software Foundation, either version 3 of the License, or 
+(at your option) any later version.
+
+GetHooks is distributed in the hope that it will be useful, 
+but WITHOUT ANY WARRANTY; without even the implied warranty of 
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License 
+along with GetHooks.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/** 
+This file contains functions for a governor store (a CPU budget for the monitor loop).
+Each function is documented in the comment block above its definition.
+
+On a thin client gethooks competes with the user's foreground applications. The governor measures 
+the CPU time used by this process in each cycle of the monitor loop and keeps it within a budget by 
+stretching the wait between snapshots, deferring the sampling between snapshots and lowering the 
+priority of the main thread. See governor.h
+
+When _WIN32 isn't defined this file doesn't depend on the rest of gethooks, so that the governor can 
+be built and tested with the simulated backend on other systems. See portable.h
+
+-
+get_real_cpu(), get_real_clock(), set_real_priority()
+
+The real backend.
+-
+
+-
+get_sim_cpu(), get_sim_clock(), set_sim_priority()
+
+The simulated backend.
+-
+
+-
+create_governor_store()
+
+Create a governor store or die.
+-
+
+-
+init_governor_store()
+
+Initialize a governor store.
+-
+
+-
+update_governor_store()
+
+Measure the cycle of the monitor loop that just ended and decide the next one.
+-
+
+-
+get_governor_retry_delay()
+
+Get the milliseconds to wait before retrying a failed snapshot query.
+-
+
+-
+print_governor_report()
+
+Print the CPU time used over the window and how the freshness is degraded.
+-
+
+-
+print_governor_store()
+
+Print a governor store.
+-
+
+-
+free_governor_store()
+
+Restore the priority of the main thread and free a governor store.
+-
+
+-
+simulate_governor_store()
+
+Run the governor with the simulated backend and injected costs.
+-
+
+*/
+
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include "util.h"
+#else
+#include <time.h>
+#endif
+
+#include "portable.h"
+
+#include "governor.h"
+
+
+
+/** the simulated backend's state */
+struct governor_sim
+{
+	/* the simulated CPU time and clock in microseconds */
+	__int64 cpu;
+	__int64 clock;
+	
+	/* nonzero if the simulated main thread's priority is lowered */
+	int lowered;
+};
+
+
+
+static __int64 get_real_cpu( 
+	void *context   // in, optional
+);
+
+static __int64 get_real_clock( 
+	void *context   // in, optional
+);
+
+static void set_real_priority( 
+	void *context,   // in, optional
+	const int lowered   // in
+);
+
+static __int64 get_sim_cpu( 
+	void *context   // in
+);
+
+static __int64 get_sim_clock( 
+	void *context   // in
+);
+
+static void set_sim_priority( 
+	void *context,   // in
+	const int lowered   // in
+);
+
+
+
+/* get_real_cpu(), get_real_clock(), set_real_priority() 
+The real backend.
+
+get_real_cpu() returns the user and kernel time used by this process in microseconds.
+get_real_clock() returns the performance counter in microseconds.
+set_real_priority() lowers the calling thread's priority to below normal or restores it to normal.
+In the portable backend the priority isn't changed.
+*/
+static __int64 get_real_cpu( 
+	void *context   // in, optional
+)
+{
+#ifdef _WIN32
+	FILETIME creation, exited;
+	__int64 kernel = 0, user = 0;
+	
+	
+	(void)context;
+	
+	if( !GetProcessTimes( 
+		GetCurrentProcess(), &creation, &exited, (FILETIME *)&kernel, (FILETIME *)&user )
+	)
+		return 0;
+	
+	return ( kernel + user ) / 10;
+#else
+	struct timespec ts;
+	
+	
+	(void)context;
+	
+	clock_gettime( CLOCK_PROCESS_CPUTIME_ID, &ts );
+	
+	return ( (__int64)ts.tv_sec * 1000000 ) + ( ts.tv_nsec / 1000 );
+#endif
+}
+
+static __int64 get_real_clock( 
+	void *context   // in, optional
+)
+{
+#ifdef _WIN32
+	static __int64 frequency;
+	__int64 counter = 0;
+	
+	
+	(void)context;
+	
+	if( !frequency )
+		QueryPerformanceFrequency( (LARGE_INTEGER *)&frequency );
+	
+	QueryPerformanceCounter( (LARGE_INTEGER *)&counter );
+	
+	return ( ( counter / frequency ) * 1000000 ) 
+		+ ( ( ( counter % frequency ) * 1000000 ) / frequency );
+#else
+	struct timespec ts;
+	
+	
+	(void)context;
+	
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	
+	return ( (__int64)ts.tv_sec * 1000000 ) + ( ts.tv_nsec / 1000 );
+#endif
+}
+
+static void set_real_priority( 
+	void *context,   // in, optional
+	const int lowered   // in
+)
+{
+	(void)context;
+
+#ifdef _WIN32
+	if( !SetThreadPriority( GetCurrentThread(), 
+		( lowered ? THREAD_PRIORITY_BELOW_NORMAL : THREAD_PRIORITY_NORMAL ) )
+	)
+		MSG_WARNING_GLE( "SetThreadPriority() failed." );
+#else
+	(void)lowered;
+#endif
+
+	return;
+}
+
+
+
+/* get_sim_cpu(), get_sim_clock(), set_sim_priority() 
+The simulated backend.
+
+'context' is a pointer to the simulated backend's state, which is advanced by the simulation.
+*/
+static __int64 get_sim_cpu( 
+	void *context   // in
+)
+{
+	return ( (struct governor_sim *)context )->cpu;
+}
+
+static __int64 get_sim_clock( 
+	void *context   // in
+)
+{
+	return ( (struct governor_sim *)context )->clock;
+}
+
+static void set_sim_priority( 
+	void *context,   // in
+	const int lowered   // in
+)
+{
+	( (struct governor_sim *)context )->lowered = lowered;
+	return;
+}
+
+
+
+/* create_governor_store() 
+Create a governor store or die.
+*/
+void create_governor_store( 
+	struct governor **const out   // out deref
+)
+{
+	struct governor *governor = NULL;
+	
+	FAIL_IF( !out );
+	FAIL_IF( *out );
+	
+	
+	/* allocate a governor store */
+	governor = must_calloc( 1, sizeof( *governor ) );
+	
+	
+	*out = governor;
+	return;
+}
+
+
+
+/* init_governor_store() 
+Initialize a governor store.
+
+'budget' is the budget in percent of one core (GOVERNOR_BUDGET_MIN to GOVERNOR_BUDGET_MAX).
+'polling' is the polling interval in milliseconds. It's the wait before the first snapshot.
+'backend' is the backend to use. If it's NULL then the real backend is used.
+
+The first cycle starts when this function is called, so the monitor loop is measured and not the 
+startup before it.
+
+returns nonzero on success
+*/
+int init_governor_store( 
+	struct governor *const store,   // in
+	const unsigned budget,   // in
+	const unsigned polling,   // in
+	const struct governor_backend *const backend   // in, optional
+)
+{
+	FAIL_IF( !store );
+	FAIL_IF( store->init_time );   // Fail if this store has already been initialized.
+	
+	
+	if( ( budget < GOVERNOR_BUDGET_MIN ) || ( budget > GOVERNOR_BUDGET_MAX ) )
+	{
+		MSG_ERROR( "The CPU budget is invalid." );
+		printf( "budget: %u\n", budget );
+		return FALSE;
+	}
+	
+	if( backend )
+		store->backend = *backend;
+	else
+	{
+		store->backend.get_cpu = get_real_cpu;
+		store->backend.get_clock = get_real_clock;
+		store->backend.set_priority = set_real_priority;
+		store->backend.context = NULL;
+	}
+	
+	store->budget = budget;
+	store->polling = polling;
+	store->interval = polling;
+	
+	store->begin_cpu = store->backend.get_cpu( store->backend.context );
+	store->begin_clock = store->backend.get_clock( store->backend.context );
+	
+	
+	/* the governor store has been initialized */
+#ifdef _WIN32
+	GetSystemTimeAsFileTime( (FILETIME *)&store->init_time );
+#else
+	store->init_time = PORTABLE_UTC_NOW();
+#endif
+	return TRUE;
+}
+
+
+
+/* update_governor_store() 
+Measure the cycle of the monitor loop that just ended and decide the next one.
+
+This function is called at the end of each cycle, after the snapshot and the work after it. The 
+wait before the next snapshot is 'store->interval' milliseconds and the slow tier work is deferred 
+if 'store->deferred' is nonzero. See governor.h
+
+The wait is stretched so that a cycle's CPU time is within the budget of its wall time: the wall time 
+a cycle needs is its average CPU time divided by the budget, and the wait is that less the time the 
+cycle spends working. If the wait would be stretched beyond GOVERNOR_STRETCH_MAX times the polling 
+interval, or the window is over budget, then the slow tier work is deferred.
+
+'polling' is the polling interval in milliseconds, which may have changed since the last cycle.
+*/
+void update_governor_store( 
+	struct governor *const store,   // in
+	const unsigned polling   // in
+)
+{
+	struct governor_cycle *cycle = NULL;
+	__int64 cpu = 0, wall = 0, work = 0, need = 0;
+	unsigned __int64 interval = 0, limit = 0;
+	unsigned count = 0, i = 0;
+	int stretched = FALSE, capped = FALSE, over = FALSE;
+	const int was_stretched = ( store->interval > store->polling );
+	const int was_deferred = store->deferred;
+	const int was_lowered = store->lowered;
+	
+	FAIL_IF( !store );
+	FAIL_IF( !store->init_time );   // The governor store must be initialized.
+	
+	
+	/* measure the cycle that just ended. its wait was the interval decided by the last update. */
+	cycle = &store->cycle[ store->cycle_count % GOVERNOR_WINDOW ];
+	
+	cpu = store->backend.get_cpu( store->backend.context );
+	wall = store->backend.get_clock( store->backend.context );
+	
+	cycle->cpu = cpu - store->begin_cpu;
+	cycle->wall = wall - store->begin_clock;
+	cycle->wait = (__int64)store->interval * 1000;
+	
+	store->begin_cpu = cpu;
+	store->begin_clock = wall;
+	++store->cycle_count;
+	
+	/* sum the window */
+	count = ( store->cycle_count < GOVERNOR_WINDOW ) ? store->cycle_count : GOVERNOR_WINDOW;
+	cpu = 0;
+	wall = 0;
+	
+	for( i = 0; i < count; ++i )
+	{
+		cpu += store->cycle[ i ].cpu;
+		wall += store->cycle[ i ].wall;
+		
+		if( store->cycle[ i ].wall > store->cycle[ i ].wait )
+			work += store->cycle[ i ].wall - store->cycle[ i ].wait;
+	}
+	
+	if( cpu < 0 )
+		cpu = 0;
+	
+	if( wall > 0 )
+	{
+		const __int64 usage = ( cpu * 10000 ) / wall;
+		
+		store->usage = ( usage > 1000000 ) ? 1000000 : (unsigned)usage;
+	}
+	
+	over = ( store->usage > ( store->budget * 100 ) );
+	
+	/* stretch the wait so that a cycle's CPU time is within the budget of its wall time */
+	need = ( ( ( cpu / count ) * 100 ) / store->budget ) - ( work / count );
+	
+	interval = polling;
+	
+	if( need > ( (__int64)polling * 1000 ) )
+		interval = (unsigned __int64)( ( need + 999 ) / 1000 );
+	
+	limit = (unsigned __int64)( ( polling > 1000 ) ? polling : 1000 ) * GOVERNOR_STRETCH_MAX;
+	
+	if( interval > limit )
+	{
+		interval = limit;
+		capped = TRUE;
+	}
+	
+	store->polling = polling;
+	store->interval = (unsigned)interval;
+	stretched = ( store->interval > store->polling );
+	
+	/* defer the slow tier work if stretching isn't enough. resume it with some hysteresis. */
+	if( !store->deferred && ( over || capped ) )
+		store->deferred = TRUE;
+	else if( store->deferred 
+		&& !capped 
+		&& ( store->usage <= ( store->budget * GOVERNOR_RESUME_PERCENT ) )
+	)
+		store->deferred = FALSE;
+	
+	/* lower the priority of the main thread while the window is over budget */
+	if( !store->lowered && over )
+	{
+		store->lowered = TRUE;
+		store->backend.set_priority( store->backend.context, TRUE );
+	}
+	else if( store->lowered && ( store->usage <= ( store->budget * GOVERNOR_RESUME_PERCENT ) ) )
+	{
+		store->lowered = FALSE;
+		store->backend.set_priority( store->backend.context, FALSE );
+	}
+	
+	store->changed = ( ( stretched != was_stretched ) 
+		|| ( store->deferred != was_deferred ) 
+		|| ( store->lowered != was_lowered )
+	);
+	
+	if( stretched || store->deferred )
+		++store->degraded_count;
+	
+	if( store->deferred )
+		++store->deferred_count;
+	
+	store->delay_total += store->interval - store->polling;
+	
+	return;
+}
+
+
+
+/* get_governor_retry_delay() 
+Get the milliseconds to wait before retrying a failed snapshot query.
+
+'retry' is the number of times the query has been retried. Without a governor the delay is always 1 
+millisecond. With a governor the delay doubles with each retry up to GOVERNOR_RETRY_MAX_MS 
+milliseconds, so that a query that keeps failing doesn't spin.
+
+returns the delay in milliseconds
+*/
+unsigned get_governor_retry_delay( 
+	const struct governor *const store,   // in, optional
+	const unsigned retry   // in
+)
+{
+	if( !store || !store->init_time )
+		return 1;
+	
+	if( retry >= 6 )
+		return GOVERNOR_RETRY_MAX_MS;
+	
+	return 1u << retry;
+}
+
+
+
+/* print_governor_report() 
+Print the CPU time used over the window and how the freshness is degraded.
+
+This is printed whenever the governor stretches the wait, defers the sampling or lowers the 
+priority, or stops doing so (store->changed), and after every snapshot if 'v' is specified.
+*/
+void print_governor_report( 
+	const struct governor *const store   // in
+)
+{
+	FAIL_IF( !store );
+	
+	
+	printf( "\nCPU budget: %u.%02u%% of a core used over the last %u snapshots (budget %u%%).\n", 
+		store->usage / 100, 
+		store->usage % 100, 
+		( ( store->cycle_count < GOVERNOR_WINDOW ) ? store->cycle_count : GOVERNOR_WINDOW ), 
+		store->budget
+	);
+	
+	if( store->interval > store->polling )
+	{
+		printf( "The next snapshot is delayed by the budget: %u.%03u seconds instead of %u.%03u.\n", 
+			store->interval / 1000, 
+			store->interval % 1000, 
+			store->polling / 1000, 
+			store->polling % 1000
+		);
+	}
+	
+	if( store->deferred )
+		printf( "The sampling between snapshots is deferred by the budget.\n" );
+	
+	if( store->lowered )
+		printf( "The priority of the main thread is lowered by the budget.\n" );
+	
+	if( ( store->interval <= store->polling ) && !store->deferred && !store->lowered )
+		printf( "The snapshots are within the budget and aren't delayed.\n" );
+	
+	fflush( stdout );
+	return;
+}
+
+
+
+/* print_governor_store() 
+Print a governor store.
+
+if 'store' is NULL this function returns without having printed anything.
+*/
+void print_governor_store( 
+	const struct governor *const store   // in
+)
+{
+	const char *const objname = "Governor Store";
+	unsigned i = 0;
+	
+	
+	if( !store )
+		return;
+	
+	PRINT_DBLSEP_BEGIN( objname );
+	print_init_time( "store->init_time", store->init_time );
+	
+	printf( "store->budget: %u\n", store->budget );
+	printf( "store->cycle_count: %u\n", store->cycle_count );
+	printf( "store->usage: %u\n", store->usage );
+	printf( "store->interval: %u\n", store->interval );
+	printf( "store->polling: %u\n", store->polling );
+	printf( "store->deferred: %d\n", store->deferred );
+	printf( "store->lowered: %d\n", store->lowered );
+	printf( "store->changed: %d\n", store->changed );
+	printf( "store->degraded_count: %u\n", store->degraded_count );
+	printf( "store->deferred_count: %u\n", store->deferred_count );
+	printf( "store->delay_total: %" PORTABLE_I64U "\n", store->delay_total );
+	
+	for( i = 0; ( i < GOVERNOR_WINDOW ) && ( i < store->cycle_count ); ++i )
+	{
+		printf( "store->cycle[ %u ]: cpu %" PORTABLE_I64U " us, wall %" PORTABLE_I64U " us, wait %"
+			PORTABLE_I64U " us\n", 
+			i, 
+			(unsigned __int64)store->cycle[ i ].cpu, 
+			(unsigned __int64)store->cycle[ i ].wall, 
+			(unsigned __int64)store->cycle[ i ].wait
+		);
+	}
+	
+	PRINT_DBLSEP_END( objname );
+	
+	return;
+}
+
+
+
+/* free_governor_store() 
+Restore the priority of the main thread and free a governor store.
+
+this function then sets the governor store pointer to NULL and returns
+
+'in' is a pointer to a pointer to the governor store.
+if( !in || !*in ) then this function returns.
+*/
+void free_governor_store( 
+	struct governor **const in   // in deref
+)
+{
+	if( !in || !*in )
+		return;
+	
+	if( (*in)->lowered )
+		(*in)->backend.set_priority( (*in)->backend.context, FALSE );
+	
+	free( (*in) );
+	*in = NULL;
+	
+	return;
+}
+
+
+
+/* simulate_governor_store() 
+Run the governor with the simulated backend and injected costs.
+
+The simulated monitor loop has a polling interval of GOVERNOR_SIM_POLLING milliseconds and runs 
+three phases: light snapshots, heavy snapshots that take a second of CPU time each with costly 
+sampling between them, and light snapshots again. While the main thread's priority is lowered its 
+work takes half again as long in wall time. Each change the governor makes is printed.
+
+'budget' is the budget in percent of one core. If it's 0 or UI64_MAX then it's 
+GOVERNOR_SIM_BUDGET.
+
+returns nonzero if the governor kept each phase within the budget, and by the end of each phase that 
+is within the budget ungoverned it had stopped degrading the snapshots
+*/
+#define GOVERNOR_SIM_POLLING   7000
+#define GOVERNOR_SIM_BUDGET   10
+
+unsigned __int64 simulate_governor_store( 
+	const unsigned __int64 budget   // in
+)
+{
+	/* the phases. the cost of each snapshot in milliseconds of CPU time, and the cost of the 
+	sampling between snapshots in thousandths of a core.
+	*/
+	static const struct
+	{
+		const char *name;
+		unsigned cycles;
+		unsigned snapshot;
+		unsigned sampling;
+	} phase[] = 
+	{
+		{ "light", 24, 40, 10 }, 
+		{ "heavy", 48, 1000, 80 }, 
+		{ "light", 48, 40, 10 }
+	};
+	const unsigned phase_count = sizeof( phase ) / sizeof( phase[ 0 ] );
+	
+	struct governor *store = NULL;
+	struct governor_backend backend;
+	struct governor_sim sim;
+	unsigned b = 0, p = 0, n = 0, cycle = 0;
+	int ok = TRUE;
+	
+	
+	if( !budget || ( budget == (unsigned __int64)-1 ) )
+		b = GOVERNOR_SIM_BUDGET;
+	else if( budget > GOVERNOR_BUDGET_MAX )
+		b = GOVERNOR_BUDGET_MAX;
+	else
+		b = (unsigned)budget;
+	
+	memset( &sim, 0, sizeof( sim ) );
+	
+	backend.get_cpu = get_sim_cpu;
+	backend.get_clock = get_sim_clock;
+	backend.set_priority = set_sim_priority;
+	backend.context = &sim;
+	
+	create_governor_store( &store );
+	
+	if( !init_governor_store( store, b, GOVERNOR_SIM_POLLING, &backend ) )
+	{
+		free_governor_store( &store );
+		return FALSE;
+	}
+	
+	printf( "\nGovernor simulation: polling every %u ms with a budget of %u%% of a core.\n", 
+		GOVERNOR_SIM_POLLING, 
+		b
+	);
+	
+	for( p = 0; p < phase_count; ++p )
+	{
+		const unsigned ungoverned = 
+			( ( phase[ p ].snapshot * 10000 ) + ( phase[ p ].sampling * GOVERNOR_SIM_POLLING * 10 ) ) 
+			/ ( phase[ p ].snapshot + GOVERNOR_SIM_POLLING );
+		
+		
+		printf( "\nPhase %u (%s): %u snapshots of %u ms CPU time, sampling %u.%u%% of a core. "
+			"Ungoverned this would be %u.%02u%% of a core.\n", 
+			p + 1, 
+			phase[ p ].name, 
+			phase[ p ].cycles, 
+			phase[ p ].snapshot, 
+			phase[ p ].sampling / 10, 
+			phase[ p ].sampling % 10, 
+			ungoverned / 100, 
+			ungoverned % 100
+		);
+		
+		for( n = 0; n < phase[ p ].cycles; ++n, ++cycle )
+		{
+			const __int64 work = (__int64)phase[ p ].snapshot * 1000;
+			
+			
+			/* the wait, with the sampling during it unless it's deferred */
+			sim.clock += (__int64)store->interval * 1000;
+			
+			if( !store->deferred )
+				sim.cpu += (__int64)store->interval * phase[ p ].sampling;
+			
+			/* the snapshot */
+			sim.cpu += work;
+			sim.clock += sim.lowered ? ( ( work * 3 ) / 2 ) : work;
+			
+			update_governor_store( store, GOVERNOR_SIM_POLLING );
+			
+			if( store->changed )
+			{
+				printf( "\nSnapshot %u:", cycle + 1 );
+				print_governor_report( store );
+			}
+		}
+		
+		printf( "\nAt the end of phase %u the monitor used %u.%02u%% of a core. "
+			"The wait is %u ms, the sampling is %s and the priority is %s.\n", 
+			p + 1, 
+			store->usage / 100, 
+			store->usage % 100, 
+			store->interval, 
+			( store->deferred ? "deferred" : "running" ), 
+			( store->lowered ? "lowered" : "normal" )
+		);
+		
+		/* a phase that is well within the budget ungoverned shouldn't be degraded by its end */
+		if( ( ungoverned <= ( b * GOVERNOR_RESUME_PERCENT ) ) 
+			&& ( ( store->interval != GOVERNOR_SIM_POLLING ) || store->deferred || store->lowered )
+		)
+		{
+			printf( "The snapshots are degraded although they're within the budget.\n" );
+			ok = FALSE;
+		}
+		
+		/* allow 5% over the budget for rounding. the budget can't be met if the wait is already 
+		stretched as far as it goes.
+		*/
+		if( store->usage > ( b * 105 ) )
+		{
+			if( store->interval < ( GOVERNOR_SIM_POLLING * GOVERNOR_STRETCH_MAX ) )
+			{
+				printf( "The monitor is over the budget.\n" );
+				ok = FALSE;
+			}
+			else
+				printf( "The budget can't be met without delaying the snapshots more than %u times.\n", 
+					GOVERNOR_STRETCH_MAX
+				);
+		}
+	}
+	
+	printf( "\nThe freshness was degraded in %u of %u snapshots, the sampling was deferred in %u and "
+		"the snapshots were delayed by %" PORTABLE_I64U " ms in total.\n", 
+		store->degraded_count, 
+		store->cycle_count, 
+		store->deferred_count, 
+		store->delay_total
+	);
+	
+	free_governor_store( &store );
+	
+	printf( "\nThe simulation %s.\n", ( ok ? "passed" : "failed" ) );
+	return ok;
+}
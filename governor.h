@@ -0,0 +1,197 @@
+/*
+Copyright (C) 2011 Jay Satiro <raysatiro@yahoo.com>
+All rights reserved.
+
+This file is part of GetHooks.
+
+GetHooks is free software: you can redistribute it and/or modify 
+it under the terms of the GNU General Public License as published by 
+the Free Software Foundation, either version 3 of the License, or 
+(at your option) any later version.
+
+GetHooks is distributed in the hope that it will be useful, 
+but WITHOUT ANY WARRANTY; without even the implied warranty of 
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License 
+along with GetHooks.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _GOVERNOR_H
+#define _GOVERNOR_H
+
+/* governor.c can be built on its own on other systems with the simulated backend. see portable.h */
+#ifdef _WIN32
+#include <windows.h>
+#else
+#ifndef __int64
+#define __int64   long long
+#endif
+#endif
+
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/** The governor's backend.
+The real backend reads the CPU time used by this process and a monotonic clock, and sets the 
+priority of the thread that calls update_governor_store(). The simulated backend is advanced by 
+simulate_governor_store() with injected costs so that the governor can be tested on any system.
+*/
+struct governor_backend
+{
+	/* get the CPU time used by this process in microseconds */
+	__int64 (*get_cpu)( void *context );
+	
+	/* get a monotonic clock in microseconds */
+	__int64 (*get_clock)( void *context );
+	
+	/* lower the calling thread's priority if 'lowered' is nonzero, otherwise restore it */
+	void (*set_priority)( void *context, const int lowered );
+	
+	/* the context passed to the functions */
+	void *context;
+};
+
+
+
+/** A cycle of the monitor loop: the wait for a snapshot, the snapshot and the work after it.
+*/
+struct governor_cycle
+{
+	/* the CPU time used by this process during the cycle, in microseconds */
+	__int64 cpu;
+	
+	/* the wall time of the cycle, and the part of it that was the wait, in microseconds */
+	__int64 wall;
+	__int64 wait;
+};
+
+
+
+/** The governor store.
+The governor keeps the monitor's own CPU time within a budget: a percentage of one core, measured 
+over the last GOVERNOR_WINDOW cycles of the monitor loop. It has three levers:
+
+The wait between snapshots is stretched so that the CPU time of a cycle is within the budget of the 
+cycle's wall time, up to GOVERNOR_STRETCH_MAX times the polling interval.
+
+If the window is still over budget then the slow tier work, which is the sampling between snapshots 
+(latency, fast polls and hook scans), is deferred and the wait is a plain sleep. That work costs CPU 
+in proportion to the wait, so stretching the wait doesn't bring it within the budget.
+
+If the window is over budget then the priority of the main thread is lowered too.
+
+The sampling is resumed and the priority is restored once the window is at or below 
+GOVERNOR_RESUME_PERCENT percent of the budget. The retries of failed snapshot queries back off 
+exponentially instead of retrying every millisecond.
+*/
+struct governor
+{
+	struct governor_backend backend;
+	
+	/* the budget in percent of one core */
+	#define GOVERNOR_BUDGET_MIN   1
+	#define GOVERNOR_BUDGET_MAX   100
+	unsigned budget;
+	
+	/* the last cycles. the index of a cycle in the array is its number modulo GOVERNOR_WINDOW. */
+	#define GOVERNOR_WINDOW   8
+	struct governor_cycle cycle[ GOVERNOR_WINDOW ];
+	
+	/* the number of cycles measured */
+	unsigned cycle_count;
+	
+	/* the CPU time and the clock at the start of the current cycle */
+	__int64 begin_cpu;
+	__int64 begin_clock;
+	
+	/* the CPU time used over the window, in hundredths of a percent of one core */
+	unsigned usage;
+	
+	/* the wait in milliseconds before the next snapshot, and the polling interval it's stretched 
+	from.
+	*/
+	#define GOVERNOR_STRETCH_MAX   8
+	unsigned interval;
+	unsigned polling;
+	
+	/* nonzero if the slow tier work is deferred */
+	#define GOVERNOR_RESUME_PERCENT   80
+	int deferred;
+	
+	/* nonzero if the priority of the main thread is lowered */
+	int lowered;
+	
+	/* nonzero if the interval was stretched, or the sampling was deferred, or the priority was 
+	lowered or restored, by the last update.
+	*/
+	int changed;
+	
+	/* the number of cycles in which the freshness was degraded, the number of cycles in which the 
+	slow tier work was deferred, and the total milliseconds that the snapshots were delayed by 
+	stretching.
+	*/
+	#define GOVERNOR_RETRY_MAX_MS   64
+	unsigned degraded_count;
+	unsigned deferred_count;
+	unsigned __int64 delay_total;
+	
+	/* the system utc time in FILETIME format immediately after this store has been initialized.
+	this is nonzero when this store has been initialized.
+	*/
+	__int64 init_time;
+};
+
+
+
+/** 
+these functions are documented in the comment block above their definitions in governor.c
+*/
+void create_governor_store( 
+	struct governor **const out   // out deref
+);
+
+int init_governor_store( 
+	struct governor *const store,   // in
+	const unsigned budget,   // in
+	const unsigned polling,   // in
+	const struct governor_backend *const backend   // in, optional
+);
+
+void update_governor_store( 
+	struct governor *const store,   // in
+	const unsigned polling   // in
+);
+
+unsigned get_governor_retry_delay( 
+	const struct governor *const store,   // in, optional
+	const unsigned retry   // in
+);
+
+void print_governor_report( 
+	const struct governor *const store   // in
+);
+
+void print_governor_store( 
+	const struct governor *const store   // in
+);
+
+void free_governor_store( 
+	struct governor **const in   // in deref
+);
+
+unsigned __int64 simulate_governor_store( 
+	const unsigned __int64 budget   // in
+);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _GOVERNOR_H
@@ -0,0 +1,689 @@
+/*
+Copyright (C) 2011 Jay Satiro <raysatiro@yahoo.com>
+All rights reserved.
+
+This file is part of GetHooks.
+
+GetHooks is free software: you can redistribute it and/or modify 
+it under the terms of the GNU General Public License as published by 
+the Free Software Foundation, either version 3 of the License, or 
+(at your option) any later version.
+
+GetHooks is distributed in the hope that it will be useful, 
+but WITHOUT ANY WARRANTY; without even the implied warranty of 
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License 
+along with GetHooks.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/** 
+This file contains functions for a hook scan store (hook events between snapshots).
+Each function is documented in the comment block above its definition.
+
+A full snapshot traverses every thread in the system before the hooks are read, so a hook that is 
+added and removed between snapshots is never seen, and a hook that is added is only reported after 
+the next full snapshot. Reading the handle table and the HOOK objects is cheap by comparison. The 
+hook scan store takes hooks only snapshots every few milliseconds between full snapshots and 
+reports the hooks added and removed immediately, with the THREADINFO kernel addresses of their 
+threads. When the next full snapshot is taken the threads are identified and each event gets a 
+follow-up notice, and the full snapshot's diff skips the events that were already reported.
+
+-
+create_hookscan_store()
+
+Create a hook scan store and its descendants or die.
+-
+
+-
+init_hookscan_store()
+
+Initialize a hook scan store.
+-
+
+-
+reconfigure_hookscan_store()
+
+Update the settings of a hook scan store that are derived from the global configuration store.
+-
+
+-
+add_hookscan_event()
+
+Print a hook event from a hook scan and keep it until its threads are identified.
+-
+
+-
+scan_desktop_hook_items()
+
+Report the hooks added and removed from a single desktop between hook scans.
+-
+
+-
+sample_hookscan_store()
+
+Scan the hooks until a number of milliseconds have elapsed.
+-
+
+-
+is_hookscan_event()
+
+Check if a hook event has already been reported by a hook scan.
+-
+
+-
+find_hookscan_hook()
+
+Search a snapshot for a hook on a desktop.
+-
+
+-
+attribute_hookscan_events()
+
+Identify the threads of the hook events reported since the last full snapshot.
+-
+
+-
+print_hookscan_store()
+
+Print a hook scan store.
+-
+
+-
+free_hookscan_store()
+
+Free a hook scan store and all its descendants.
+-
+
+*/
+
+#include <stdio.h>
+
+#include "util.h"
+
+#include "hookscan.h"
+
+/* the global stores */
+#include "global.h"
+
+
+
+/* the initial number of elements in the event array */
+#define HOOKSCAN_EVENTS_DEFAULT   32
+
+/* the number of FILETIME intervals in a millisecond */
+#define HOOKSCAN_FILETIME_MS   10000
+
+
+
+static void add_hookscan_event( 
+	struct hookscan *const store,   // in
+	const struct hook *const hook,   // in
+	const struct desktop_item *const desktop,   // in
+	const enum difftype difftype,   // in
+	const unsigned attributed,   // in
+	const __int64 time   // in
+);
+
+static void scan_desktop_hook_items( 
+	struct hookscan *const store,   // in
+	const struct desktop_hook_item *const a,   // in
+	const struct desktop_hook_item *const b,   // in
+	const unsigned attributed,   // in
+	const __int64 time   // in
+);
+
+static const struct hook *find_hookscan_hook( 
+	const struct snapshot *const snapshot,   // in
+	const struct desktop_item *const desktop,   // in
+	const struct hook *const hook   // in
+);
+
+
+
+/* create_hookscan_store() 
+Create a hook scan store and its descendants or die.
+*/
+void create_hookscan_store( 
+	struct hookscan **const out   // out deref
+)
+{
+	struct hookscan *hookscan = NULL;
+	
+	FAIL_IF( !out );
+	FAIL_IF( *out );
+	
+	
+	/* allocate a hook scan store */
+	hookscan = must_calloc( 1, sizeof( *hookscan ) );
+	
+	create_hook_snapshot_store( &hookscan->current );
+	create_hook_snapshot_store( &hookscan->previous );
+	
+	hookscan->event_max = HOOKSCAN_EVENTS_DEFAULT;
+	hookscan->event = must_calloc( hookscan->event_max, sizeof( *hookscan->event ) );
+	
+	
+	*out = hookscan;
+	return;
+}
+
+
+
+/* init_hookscan_store() 
+Initialize a hook scan store.
+
+'interval' is how many milliseconds to wait between hook scans.
+
+returns nonzero on success
+*/
+int init_hookscan_store( 
+	struct hookscan *const store,   // in
+	const unsigned interval   // in
+)
+{
+	FAIL_IF( !store );
+	FAIL_IF( store->init_time );   // Fail if this store has already been initialized.
+	
+	FAIL_IF( !G->config->init_time );   // The configuration store must be initialized.
+	
+	
+	if( ( interval < HOOKSCAN_INTERVAL_MIN ) || ( interval > HOOKSCAN_INTERVAL_MAX ) )
+	{
+		MSG_ERROR( "The hook scan interval is invalid." );
+		printf( "interval: %u\n", interval );
+		return FALSE;
+	}
+	
+	store->interval = interval;
+	
+	reconfigure_hookscan_store( store );
+	
+	
+	/* the hook scan store has been initialized */
+	GetSystemTimeAsFileTime( (FILETIME *)&store->init_time );
+	return TRUE;
+}
+
+
+
+/* reconfigure_hookscan_store() 
+Update the settings of a hook scan store that are derived from the global configuration store.
+
+This function is called on init and whenever the configuration is reloaded. see reload.c
+*/
+void reconfigure_hookscan_store( 
+	struct hookscan *const store   // in
+)
+{
+	FAIL_IF( !store );
+	
+	
+	/* is_hook_wanted() can't tell whether a hook is known or belongs to a listed program until 
+	its threads have been identified
+	*/
+	store->deferred = 
+		( ( G->config->flags & CFG_IGNORE_KNOWN_HOOKS ) || G->config->proglist->init_time );
+	
+	return;
+}
+
+
+
+/* add_hookscan_event() 
+Print a hook event from a hook scan and keep it until its threads are identified.
+
+'hook' is the hook info 
+'desktop' is the desktop the hook is on 
+'difftype' is HOOK_ADDED or HOOK_REMOVED 
+'attributed' is nonzero if the hook's threads are already known 
+'time' is the time of the hook scan
+
+If the hook is ignored, or if whether it's wanted can't be decided until its threads are known, it 
+isn't reported here and is left to the next full snapshot's diff.
+
+Each event printed is also added to the global export and rules stores. See add_hook_event().
+*/
+static void add_hookscan_event( 
+	struct hookscan *const store,   // in
+	const struct hook *const hook,   // in
+	const struct desktop_item *const desktop,   // in
+	const enum difftype difftype,   // in
+	const unsigned attributed,   // in
+	const __int64 time   // in
+)
+{
+	struct hookscan_event *event = NULL;
+	
+	FAIL_IF( !store );
+	FAIL_IF( !hook );
+	FAIL_IF( !desktop );
+	FAIL_IF( ( difftype != HOOK_ADDED ) && ( difftype != HOOK_REMOVED ) );
+	
+	
+	if( hook->ignore || ( store->deferred && !attributed ) )
+		return;
+	
+	print_hook_notice_begin( hook, desktop->pwszDesktopName, difftype, time );
+	if( !attributed )
+		printf( "The threads of this HOOK will be identified in the next snapshot.\n" );
+	print_hook_notice_end();
+	
+	add_hook_event( hook, desktop->pwszDesktopName, difftype, time );
+	
+	
+	if( store->event_count >= store->event_max )
+	{
+		struct hookscan_event *event_array = NULL;
+		
+		
+		event_array = must_calloc( store->event_max * 2, sizeof( *event_array ) );
+		memcpy( event_array, store->event, store->event_count * sizeof( *event_array ) );
+		
+		free( store->event );
+		store->event = event_array;
+		store->event_max *= 2;
+	}
+	
+	event = &store->event[ store->event_count++ ];
+	
+	event->hook = *hook;
+	event->desktop = desktop;
+	event->difftype = difftype;
+	event->time = time;
+	event->attributed = attributed;
+	
+	/* the gui structs are in a snapshot that will be reused */
+	event->hook.owner = NULL;
+	event->hook.origin = NULL;
+	event->hook.target = NULL;
+	
+	++store->event_total;
+	
+	return;
+}
+
+
+
+/* scan_desktop_hook_items() 
+Report the hooks added and removed from a single desktop between hook scans.
+
+'a' is a desktop and its HOOKs from the full snapshot or the previous hook scan 
+'b' is the same desktop and its HOOKs from the current hook scan 
+'attributed' is nonzero if 'a' is from the full snapshot, in which case its threads are known 
+'time' is the time of the current hook scan
+
+A HOOK that has been modified isn't reported. That's left to the next full snapshot's diff.
+*/
+static void scan_desktop_hook_items( 
+	struct hookscan *const store,   // in
+	const struct desktop_hook_item *const a,   // in
+	const struct desktop_hook_item *const b,   // in
+	const unsigned attributed,   // in
+	const __int64 time   // in
+)
+{
+	unsigned a_hi = 0, b_hi = 0;
+	
+	FAIL_IF( !store );
+	FAIL_IF( !a );
+	FAIL_IF( !b );
+	
+	/* Both desktop hook items should have a pointer to the same desktop item */
+	FAIL_IF( !a->desktop );
+	FAIL_IF( a->desktop != b->desktop );
+	
+	
+	while( ( a_hi < a->hook_count ) || ( b_hi < b->hook_count ) )
+	{
+		int ret = 0;
+		
+		
+		if( a_hi >= a->hook_count )
+			ret = 1;
+		else if( b_hi >= b->hook_count )
+			ret = -1;
+		else
+			ret = compare_hook( &a->hook[ a_hi ], &b->hook[ b_hi ] );
+		
+		if( ret < 0 ) // hook removed
+		{
+			add_hookscan_event( store, &a->hook[ a_hi ], a->desktop, HOOK_REMOVED, attributed, time );
+			++a_hi;
+		}
+		else if( ret > 0 ) // hook added
+		{
+			add_hookscan_event( store, &b->hook[ b_hi ], b->desktop, HOOK_ADDED, FALSE, time );
+			++b_hi;
+		}
+		else
+		{
+			++a_hi;
+			++b_hi;
+		}
+	}
+	
+	return;
+}
+
+
+
+/* sample_hookscan_store() 
+Scan the hooks until a number of milliseconds have elapsed.
+
+'snapshot' is the last full snapshot 
+'milliseconds' is how long to scan
+
+This is used in place of Sleep() between snapshots in monitor mode. The first hook scan is compared 
+to the full snapshot and each hook scan after that is compared to the one before it. The hooks 
+added and removed are printed as soon as they're found.
+
+This function must only be called from the main thread.
+*/
+void sample_hookscan_store( 
+	struct hookscan *const store,   // in
+	const struct snapshot *const snapshot,   // in
+	const DWORD milliseconds   // in
+)
+{
+	const DWORD start = GetTickCount();
+	DWORD elapsed = 0;
+	const struct desktop_hook_list *baseline = NULL;
+	unsigned attributed = TRUE;
+	
+	FAIL_IF( !store );
+	FAIL_IF( !store->init_time );   // The hook scan store must be initialized.
+	
+	FAIL_IF( !snapshot );
+	FAIL_IF( !snapshot->init_time );   // The full snapshot must be initialized.
+	
+	FAIL_IF( GetCurrentThreadId() != G->prog->dwMainThreadId );   // main thread only
+	
+	
+	baseline = snapshot->desktop_hooks;
+	
+	while( ( elapsed = GetTickCount() - start ) < milliseconds )
+	{
+		const DWORD remaining = milliseconds - elapsed;
+		const unsigned event_count = store->event_count;
+		const struct desktop_hook_list *const current = store->current->desktop_hooks;
+		unsigned i = 0;
+		struct snapshot *temp = NULL;
+		
+		
+		Sleep( ( remaining < store->interval ) ? remaining : store->interval );
+		
+		++store->scan_total;
+		
+		/* the baseline is either the full snapshot or store->previous, so it's still intact */
+		if( !init_hook_snapshot_store( store->current ) )
+		{
+			++store->scan_failed;
+			continue;
+		}
+		
+		/* both desktop hook tables are built from the global desktop store in the same order */
+		for( i = 0; ( i < baseline->count ) && ( i < current->count ); ++i )
+		{
+			scan_desktop_hook_items( store, &baseline->item[ i ], &current->item[ i ], attributed, 
+				current->init_time
+			);
+		}
+		
+		if( store->event_count != event_count )
+			fflush( stdout );
+		
+		/* the current hook scan is the baseline for the next */
+		temp = store->previous;
+		store->previous = store->current;
+		store->current = temp;
+		
+		baseline = store->previous->desktop_hooks;
+		attributed = FALSE;
+	}
+	
+	return;
+}
+
+
+
+/* is_hookscan_event() 
+Check if a hook event has already been reported by a hook scan.
+
+'hook' is the hook info 
+'difftype' is the event
+
+print_diff_desktop_hook_items() calls this function so that a hook added or removed since the last 
+full snapshot isn't reported twice.
+
+if 'store' is NULL or hasn't been initialized this function returns FALSE.
+
+returns nonzero if the event was reported by a hook scan since the last full snapshot
+*/
+int is_hookscan_event( 
+	const struct hookscan *const store,   // in
+	const struct hook *const hook,   // in
+	const enum difftype difftype   // in
+)
+{
+	unsigned i = 0;
+	
+	FAIL_IF( !hook );
+	
+	
+	if( !store || !store->init_time )
+		return FALSE;
+	
+	for( i = 0; i < store->event_count; ++i )
+	{
+		if( ( store->event[ i ].difftype == difftype ) 
+			&& !compare_hook( &store->event[ i ].hook, hook )
+		)
+			return TRUE;
+	}
+	
+	return FALSE;
+}
+
+
+
+/* find_hookscan_hook() 
+Search a snapshot for a hook on a desktop.
+
+returns a pointer to the hook in the snapshot if found, else NULL
+*/
+static const struct hook *find_hookscan_hook( 
+	const struct snapshot *const snapshot,   // in
+	const struct desktop_item *const desktop,   // in
+	const struct hook *const hook   // in
+)
+{
+	const struct desktop_hook_item *item = NULL;
+	
+	FAIL_IF( !snapshot );
+	FAIL_IF( !desktop );
+	FAIL_IF( !hook );
+	
+	
+	for( item = snapshot->desktop_hooks->head; item; item = item->next )
+	{
+		/* the hook array is sorted by compare_hook() */
+		if( item->desktop == desktop )
+			return bsearch( hook, item->hook, item->hook_count, sizeof( *item->hook ), compare_hook );
+	}
+	
+	return NULL;
+}
+
+
+
+/* attribute_hookscan_events() 
+Identify the threads of the hook events reported since the last full snapshot.
+
+'previous' is the previous full snapshot 
+'current' is the current full snapshot
+
+This is called after the current full snapshot's diff has been printed. For each event that was 
+reported without its threads a follow-up notice is printed with the hook's threads, from the full 
+snapshot the hook is in or else by searching the current snapshot for its THREADINFO addresses.
+If a hook was added and then removed before the current full snapshot without a hook scan having 
+seen it removed then it's reported as removed.
+
+Each notice printed is also added to the global export and rules stores. See add_hook_event().
+The events are then discarded.
+*/
+void attribute_hookscan_events( 
+	struct hookscan *const store,   // in
+	const struct snapshot *const previous,   // in
+	const struct snapshot *const current   // in
+)
+{
+	unsigned i = 0;
+	
+	FAIL_IF( !store );
+	FAIL_IF( !store->init_time );   // The hook scan store must be initialized.
+	
+	FAIL_IF( !previous );
+	FAIL_IF( !current );
+	FAIL_IF( !current->init_time );   // The current full snapshot must be initialized.
+	
+	
+	for( i = 0; i < store->event_count; ++i )
+	{
+		const struct hookscan_event *const event = &store->event[ i ];
+		const WCHAR *const deskname = event->desktop->pwszDesktopName;
+		const struct hook *found = NULL;
+		struct hook hook;
+		unsigned removed = FALSE;
+		
+		
+		if( event->attributed )
+			continue;
+		
+		/* a removed hook's threads are more likely to be found in the previous snapshot */
+		found = find_hookscan_hook( 
+			( ( event->difftype == HOOK_REMOVED ) ? previous : current ), 
+			event->desktop, 
+			&event->hook
+		);
+		
+		if( found )
+			hook = *found;
+		else
+		{
+			hook = event->hook;
+			hook.owner = find_Win32ThreadInfo( current, hook.entry.pOwner );
+			hook.origin = find_Win32ThreadInfo( current, hook.object.pti );
+			hook.target = find_Win32ThreadInfo( current, hook.object.ptiHooked );
+			hook.anomalies = get_hook_anomalies( &hook );
+			hook.ignore = !is_hook_wanted( &hook );
+		}
+		
+		/* an added hook that isn't in the current snapshot has been removed, but if a hook scan 
+		saw it removed then that event follows this one
+		*/
+		if( ( event->difftype == HOOK_ADDED ) && !found )
+		{
+			unsigned j = 0;
+			
+			
+			removed = TRUE;
+			
+			for( j = i + 1; ( j < store->event_count ) && removed; ++j )
+			{
+				if( ( store->event[ j ].difftype == HOOK_REMOVED ) 
+					&& !compare_hook( &store->event[ j ].hook, &event->hook )
+				)
+					removed = FALSE;
+			}
+		}
+		
+		if( hook.ignore )
+			continue;
+		
+		print_hook_notice_begin( &hook, deskname, HOOK_ATTRIBUTED, current->init_time );
+		printf( "The threads of this HOOK were identified %I64d ms after it was %s.\n", 
+			( ( current->init_time - event->time ) / HOOKSCAN_FILETIME_MS ), 
+			( ( event->difftype == HOOK_ADDED ) ? "added" : "removed" )
+		);
+		print_hook_notice_end();
+		
+		add_hook_event( &hook, deskname, HOOK_ATTRIBUTED, current->init_time );
+		++store->attributed_total;
+		
+		if( removed )
+		{
+			print_hook_notice_begin( &hook, deskname, HOOK_REMOVED, current->init_time );
+			print_hook_notice_end();
+			
+			add_hook_event( &hook, deskname, HOOK_REMOVED, current->init_time );
+		}
+	}
+	
+	store->event_count = 0;
+	
+	return;
+}
+
+
+
+/* print_hookscan_store() 
+Print a hook scan store.
+
+if 'store' is NULL this function returns without having printed anything.
+*/
+void print_hookscan_store( 
+	const struct hookscan *const store   // in
+)
+{
+	const char *const objname = "Hook Scan Store";
+	
+	
+	if( !store )
+		return;
+	
+	PRINT_DBLSEP_BEGIN( objname );
+	print_init_time( "store->init_time", store->init_time );
+	
+	printf( "store->event_max: %u\n", store->event_max );
+	printf( "store->event_count: %u\n", store->event_count );
+	printf( "store->interval: %u\n", store->interval );
+	printf( "store->deferred: %u\n", store->deferred );
+	printf( "store->scan_total: %I64u\n", store->scan_total );
+	printf( "store->scan_failed: %I64u\n", store->scan_failed );
+	printf( "store->event_total: %I64u\n", store->event_total );
+	printf( "store->attributed_total: %I64u\n", store->attributed_total );
+	
+	PRINT_DBLSEP_END( objname );
+	
+	return;
+}
+
+
+
+/* free_hookscan_store() 
+Free a hook scan store and all its descendants.
+
+this function then sets the hook scan store pointer to NULL and returns
+
+'in' is a pointer to a pointer to the hook scan store.
+if( !in || !*in ) then this function returns.
+*/
+void free_hookscan_store( 
+	struct hookscan **const in   // in deref
+)
+{
+	if( !in || !*in )
+		return;
+	
+	free_snapshot_store( &(*in)->current );
+	free_snapshot_store( &(*in)->previous );
+	
+	free( (*in)->event );
+	
+	free( (*in) );
+	*in = NULL;
+	
+	return;
+}
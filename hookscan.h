@@ -0,0 +1,161 @@
+/*
+Copyright (C) 2011 Jay Satiro <raysatiro@yahoo.com>
+All rights reserved.
+
+This file is part of GetHooks.
+
+GetHooks is free software: you can redistribute it and/or modify 
+it under the terms of the GNU General Public License as published by 
+the Free Software Foundation, either version 3 of the License, or 
+(at your option) any later version.
+
+GetHooks is distributed in the hope that it will be useful, 
+but WITHOUT ANY WARRANTY; without even the implied warranty of 
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License 
+along with GetHooks.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _HOOKSCAN_H
+#define _HOOKSCAN_H
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include "portable.h"
+#endif
+
+/* snapshot store (system process info, gui threads, desktop hooks) */
+#include "snapshot.h"
+
+/* enum difftype */
+#include "diff.h"
+
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/** This is the info kept for each hook event reported by a hook scan.
+The event is kept until the hook's threads are identified in the next full snapshot.
+*/
+struct hookscan_event
+{
+	/* a copy of the hook info from the hooks only snapshot.
+	owner, origin and target are always NULL since they would point into a reused snapshot.
+	*/
+	struct hook hook;
+	
+	/* the desktop the hook is on */
+	const struct desktop_item *desktop;
+	
+	/* the event: HOOK_ADDED or HOOK_REMOVED */
+	enum difftype difftype;
+	
+	/* the system utc time in FILETIME format of the hook scan that reported the event */
+	__int64 time;
+	
+	/* nonzero if the hook's threads were already known when the event was reported. that's the 
+	case for a hook removed since the last full snapshot, and no follow-up is needed.
+	*/
+	unsigned attributed;
+};
+
+
+
+/** The hook scan store.
+Between full snapshots the hook scan store takes hooks only snapshots, which read only the handle 
+table and the HOOK objects, and reports the hooks added and removed immediately. The threads of 
+those hooks are identified in the next full snapshot and reported as a follow-up.
+*/
+struct hookscan
+{
+	/* the hooks only snapshots. see create_hook_snapshot_store() */
+	struct snapshot *current;   // create_hook_snapshot_store(), free_snapshot_store()
+	struct snapshot *previous;   // create_hook_snapshot_store(), free_snapshot_store()
+	
+	/* an array of the events reported since the last full snapshot, in the order reported */
+	struct hookscan_event *event;   // calloc(), free()
+	
+	/* the allocated/maximum number of elements in the event array */
+	unsigned event_max;
+	
+	/* the number of elements written to in the event array */
+	unsigned event_count;
+	
+	/* the interval in milliseconds between hook scans */
+	#define HOOKSCAN_INTERVAL_MIN   1
+	#define HOOKSCAN_INTERVAL_MAX   1000
+	unsigned interval;
+	
+	/* nonzero if whether a hook is wanted depends on its threads (eg a program list), in which 
+	case a new hook isn't reported until its threads are identified in the next full snapshot.
+	*/
+	unsigned deferred;
+	
+	/* the number of hook scans, how many failed, and how many events were reported and attributed */
+	unsigned __int64 scan_total;
+	unsigned __int64 scan_failed;
+	unsigned __int64 event_total;
+	unsigned __int64 attributed_total;
+	
+	/* the system utc time in FILETIME format immediately after this store has been initialized.
+	this is nonzero when this store has been initialized.
+	*/
+	__int64 init_time;
+};
+
+
+
+/** 
+these functions are documented in the comment block above their definitions in hookscan.c
+*/
+void create_hookscan_store( 
+	struct hookscan **const out   // out deref
+);
+
+int init_hookscan_store( 
+	struct hookscan *const store,   // in
+	const unsigned interval   // in
+);
+
+void reconfigure_hookscan_store( 
+	struct hookscan *const store   // in
+);
+
+void sample_hookscan_store( 
+	struct hookscan *const store,   // in
+	const struct snapshot *const snapshot,   // in
+	const DWORD milliseconds   // in
+);
+
+int is_hookscan_event( 
+	const struct hookscan *const store,   // in
+	const struct hook *const hook,   // in
+	const enum difftype difftype   // in
+);
+
+void attribute_hookscan_events( 
+	struct hookscan *const store,   // in
+	const struct snapshot *const previous,   // in
+	const struct snapshot *const current   // in
+);
+
+void print_hookscan_store( 
+	const struct hookscan *const store   // in
+);
+
+void free_hookscan_store( 
+	struct hookscan **const in   // in deref
+);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _HOOKSCAN_H
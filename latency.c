@@ -0,0 +1,822 @@
+/*
+Copyright (C) 2011 Jay Satiro <raysatiro@yahoo.com>
+All rights reserved.
+
+This file is part of GetHooks.
+
+GetHooks is free software: you can redistribute it and/or modify 
+it under the terms of the GNU General Public License as published by 
+the Free Software Foundation, either version 3 of the License, or 
+(at your option) any later version.
+
+GetHooks is distributed in the hope that it will be useful, 
+but WITHOUT ANY WARRANTY; without even the implied warranty of 
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License 
+along with GetHooks.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/** 
+This file contains functions for a latency store (input latency impact of hook origin threads).
+Each function is documented in the comment block above its definition.
+
+The procedure of a low-level hook (WH_KEYBOARD_LL, WH_MOUSE_LL) is called in the thread that set 
+the hook, and the system waits for it before the input is passed on. If that thread is busy or hung 
+then all input is delayed. A thread that's ready to service a hook call is waiting for input, which 
+in the system thread info is a thread state of Waiting with a wait reason of UserRequest or 
+WrUserRequest.
+
+The latency store tracks the origin thread of each low-level and global hook found in a snapshot.
+Between snapshots the system thread info is sampled every few milliseconds and the state of each 
+tracked thread is recorded. Only the system process info is queried for a sample; no process is 
+opened and no memory is read.
+
+-
+create_latency_store()
+
+Create a latency store and its descendants or die.
+-
+
+-
+init_latency_store()
+
+Initialize a latency store.
+-
+
+-
+is_latency_hook()
+
+Check whether a hook's origin thread should be tracked.
+-
+
+-
+add_latency_sample()
+
+Add a sample of a tracked thread's state to a latency item.
+-
+
+-
+update_latency_store()
+
+Update the tracked hooks from a snapshot.
+-
+
+-
+callback_sample_latency()
+
+traverse_threads() callback to sample the state of each tracked thread.
+-
+
+-
+sample_latency_store()
+
+Sample the state of each tracked thread until a number of milliseconds have elapsed.
+-
+
+-
+get_latency_estimate()
+
+Get the estimated input delay in milliseconds caused by a hook.
+-
+
+-
+compare_latency_pid()
+
+Compare two process ids.
+-
+
+-
+compare_latency_item()
+
+Compare two latency items by their impact on input latency.
+-
+
+-
+print_latency_report()
+
+Print the tracked hooks ranked by their estimated impact on input latency.
+-
+
+-
+print_latency_store()
+
+Print a latency store.
+-
+
+-
+free_latency_store()
+
+Free a latency store and all its descendants.
+-
+
+*/
+
+#include <stdio.h>
+
+#include "util.h"
+
+#include "reactos.h"
+
+/* traverse_threads() */
+#include "nt_independent_sysprocinfo_structs.h"
+#include "traverse_threads.h"
+
+#include "latency.h"
+
+/* the global stores */
+#include "global.h"
+
+
+
+/* the initial number of elements in the item array */
+#define LATENCY_ITEMS_DEFAULT   32
+
+/* the thread state and wait reasons of a thread that's waiting for input.
+these are KTHREAD_STATE and KWAIT_REASON values, which are only declared in traverse_threads.
+*/
+#define LATENCY_STATE_WAITING   5
+#define LATENCY_WAIT_USERREQUEST   6
+#define LATENCY_WAIT_WRUSERREQUEST   13
+
+/* the minimum number of samples before a thread is flagged as often busy */
+#define LATENCY_BUSY_SAMPLES_MIN   10
+
+
+
+static int is_latency_hook( 
+	const struct hook *const hook   // in
+);
+
+static void add_latency_sample( 
+	struct latency_item *const item,   // in
+	const SYSTEM_THREAD_INFORMATION *const sti   // in
+);
+
+static int callback_sample_latency( 
+	void *cb_param,   // in, out
+	SYSTEM_PROCESS_INFORMATION *const spi,   // in
+	SYSTEM_THREAD_INFORMATION *const sti,   // in
+	const ULONG remaining,   // in
+	const DWORD flags   // in, optional
+);
+
+static unsigned get_latency_estimate( 
+	const struct latency *const store,   // in
+	const struct latency_item *const item   // in
+);
+
+static int compare_latency_pid( 
+	const void *const p1,   // in
+	const void *const p2   // in
+);
+
+static int compare_latency_item( 
+	const void *const p1,   // in
+	const void *const p2   // in
+);
+
+
+
+/* create_latency_store() 
+Create a latency store and its descendants or die.
+*/
+void create_latency_store( 
+	struct latency **const out   // out deref
+)
+{
+	struct latency *latency = NULL;
+	
+	FAIL_IF( !out );
+	FAIL_IF( *out );
+	
+	
+	/* allocate a latency store */
+	latency = must_calloc( 1, sizeof( *latency ) );
+	
+	latency->item_max = LATENCY_ITEMS_DEFAULT;
+	latency->item = must_calloc( latency->item_max, sizeof( *latency->item ) );
+	
+	
+	*out = latency;
+	return;
+}
+
+
+
+/* init_latency_store() 
+Initialize a latency store.
+
+'interval' is how many milliseconds to wait between samples.
+
+The sample buffer is allocated here rather than when the store is created because its size depends 
+on the maximum number of threads, and most runs don't sample.
+
+returns nonzero on success
+*/
+int init_latency_store( 
+	struct latency *const store,   // in
+	const unsigned interval   // in
+)
+{
+	FAIL_IF( !store );
+	FAIL_IF( store->init_time );   // Fail if this store has already been initialized.
+	FAIL_IF( !G->config->init_time );   // The configuration store must be initialized.
+	
+	
+	if( ( interval < LATENCY_INTERVAL_MIN ) || ( interval > LATENCY_INTERVAL_MAX ) )
+	{
+		MSG_ERROR( "The latency sample interval is invalid." );
+		printf( "interval: %u\n", interval );
+		return FALSE;
+	}
+	
+	store->interval = interval;
+	
+	/* the samples don't use extended info. see create_snapshot_store() for the worst case size */
+	store->spi_max_bytes = 
+		G->config->max_threads 
+		* ( sizeof( SYSTEM_PROCESS_INFORMATION ) + sizeof( SYSTEM_THREAD_INFORMATION ) );
+	
+	store->spi = must_calloc( store->spi_max_bytes, 1 );
+	
+	
+	/* the latency store has been initialized */
+	GetSystemTimeAsFileTime( (FILETIME *)&store->init_time );
+	return TRUE;
+}
+
+
+
+/* is_latency_hook() 
+Check whether a hook's origin thread should be tracked.
+
+A hook's origin thread is tracked if the hook is a low-level or global hook, it wasn't ignored and 
+its origin thread is known.
+
+returns nonzero if the hook's origin thread should be tracked
+*/
+static int is_latency_hook( 
+	const struct hook *const hook   // in
+)
+{
+	FAIL_IF( !hook );
+	
+	
+	if( hook->ignore || !hook->origin || !hook->origin->spi || !hook->origin->sti )
+		return FALSE;
+	
+	if( ( hook->object.iHook == WH_KEYBOARD_LL ) 
+		|| ( hook->object.iHook == WH_MOUSE_LL ) 
+		|| ( hook->object.flags & HF_GLOBAL )
+	)
+		return TRUE;
+	
+	return FALSE;
+}
+
+
+
+/* add_latency_sample() 
+Add a sample of a tracked thread's state to a latency item.
+*/
+static void add_latency_sample( 
+	struct latency_item *const item,   // in
+	const SYSTEM_THREAD_INFORMATION *const sti   // in
+)
+{
+	FAIL_IF( !item );
+	FAIL_IF( !sti );
+	
+	
+	if( item->sample_count 
+		&& ( ( item->state != sti->ThreadState ) || ( item->wait_reason != sti->WaitReason ) )
+	)
+		++item->transition_count;
+	
+	++item->sample_count;
+	item->state = sti->ThreadState;
+	item->wait_reason = sti->WaitReason;
+	
+	if( ( sti->ThreadState == LATENCY_STATE_WAITING ) 
+		&& ( ( sti->WaitReason == LATENCY_WAIT_USERREQUEST ) 
+			|| ( sti->WaitReason == LATENCY_WAIT_WRUSERREQUEST )
+		)
+	)
+	{
+		++item->idle_count;
+		item->streak = 0;
+		return;
+	}
+	
+	item->busy_state = sti->ThreadState;
+	item->busy_wait_reason = sti->WaitReason;
+	
+	if( ++item->streak > item->streak_max )
+		item->streak_max = item->streak;
+	
+	return;
+}
+
+
+
+/* update_latency_store() 
+Update the tracked hooks from a snapshot.
+
+Each low-level and global hook in the snapshot is tracked, and the state of its origin thread in the 
+snapshot is added as a sample. Hooks that are no longer in the snapshot aren't tracked anymore. If 
+a hook's origin thread changed then the hook's samples are discarded.
+
+This function must only be called from the main thread.
+*/
+void update_latency_store( 
+	struct latency *const store,   // in
+	const struct snapshot *const snapshot   // in
+)
+{
+	unsigned i = 0, count = 0;
+	const struct desktop_hook_item *dh = NULL;
+	
+	FAIL_IF( !store );
+	FAIL_IF( !store->init_time );   // The latency store must be initialized.
+	FAIL_IF( !snapshot );
+	FAIL_IF( !snapshot->init_time );   // The snapshot store must be initialized.
+	
+	FAIL_IF( GetCurrentThreadId() != G->prog->dwMainThreadId );   // main thread only
+	
+	
+	++store->generation;
+	
+	for( dh = snapshot->desktop_hooks->head; dh; dh = dh->next )
+	{
+		for( i = 0; i < dh->hook_count; ++i )
+		{
+			const struct hook *const hook = &dh->hook[ i ];
+			struct latency_item *item = NULL;
+			unsigned j = 0;
+			
+			
+			if( !is_latency_hook( hook ) )
+				continue;
+			
+			for( j = 0; j < store->item_count; ++j )
+			{
+				if( ( store->item[ j ].h == hook->object.head.h ) 
+					&& ( store->item[ j ].pHead == hook->entry.pHead )
+				)
+					break;
+			}
+			
+			if( j == store->item_count )
+			{
+				/* the hook isn't tracked. if the item array is full double its size */
+				if( store->item_count == store->item_max )
+				{
+					struct latency_item *const temp = 
+						must_calloc( store->item_max * 2, sizeof( *temp ) );
+					
+					memcpy( temp, store->item, store->item_max * sizeof( *temp ) );
+					free( store->item );
+					
+					store->item = temp;
+					store->item_max *= 2;
+				}
+				
+				++store->item_count;
+			}
+			
+			item = &store->item[ j ];
+			
+			/* if the hook is new or its origin thread changed then start over */
+			if( !item->h 
+				|| ( item->tid != (uintptr_t)hook->origin->sti->ClientId.UniqueThread ) 
+				|| ( item->create_time != hook->origin->sti->CreateTime.QuadPart )
+			)
+			{
+				free( item->name );
+				ZeroMemory( item, sizeof( *item ) );
+				
+				item->h = hook->object.head.h;
+				item->pHead = hook->entry.pHead;
+				item->pid = (uintptr_t)hook->origin->spi->UniqueProcessId;
+				item->tid = (uintptr_t)hook->origin->sti->ClientId.UniqueThread;
+				item->create_time = hook->origin->sti->CreateTime.QuadPart;
+				
+				if( hook->origin->spi->ImageName.Buffer )
+				{
+					const unsigned cch = hook->origin->spi->ImageName.Length / sizeof( WCHAR );
+					
+					item->name = must_calloc( cch + 1, sizeof( WCHAR ) );
+					memcpy( item->name, hook->origin->spi->ImageName.Buffer, cch * sizeof( WCHAR ) );
+				}
+			}
+			
+			item->iHook = hook->object.iHook;
+			item->flags = hook->object.flags;
+			item->deskname = dh->desktop->pwszDesktopName;
+			item->generation = store->generation;
+			
+			if( hook->object.flags & HF_HUNG )
+				++item->hung_count;
+			
+			add_latency_sample( item, hook->origin->sti );
+		}
+	}
+	
+	/* remove the hooks that weren't in the snapshot */
+	for( i = 0, count = 0; i < store->item_count; ++i )
+	{
+		if( store->item[ i ].generation != store->generation )
+		{
+			free( store->item[ i ].name );
+			continue;
+		}
+		
+		store->item[ count++ ] = store->item[ i ];
+	}
+	
+	ZeroMemory( &store->item[ count ], ( store->item_count - count ) * sizeof( *store->item ) );
+	store->item_count = count;
+	
+	/* the samples only traverse the processes of the tracked origin threads */
+	free( store->pid );
+	store->pid = must_calloc( ( store->item_count ? store->item_count : 1 ), sizeof( *store->pid ) );
+	
+	for( i = 0; i < store->item_count; ++i )
+		store->pid[ i ] = (ULONG_PTR)store->item[ i ].pid;
+	
+	qsort( store->pid, store->item_count, sizeof( *store->pid ), compare_latency_pid );
+	
+	for( i = 0, store->pid_count = 0; i < store->item_count; ++i )
+	{
+		if( !store->pid_count || ( store->pid[ store->pid_count - 1 ] != store->pid[ i ] ) )
+			store->pid[ store->pid_count++ ] = store->pid[ i ];
+	}
+	
+	return;
+}
+
+
+
+/* callback_sample_latency() 
+traverse_threads() callback to sample the state of each tracked thread.
+
+The processes that don't have a tracked thread are skipped.
+
+The behavior of a traverse_threads() callback is documented in traverse_threads.txt.
+*/
+static int callback_sample_latency( 
+	void *cb_param,   // in, out
+	SYSTEM_PROCESS_INFORMATION *const spi,   // in
+	SYSTEM_THREAD_INFORMATION *const sti,   // in
+	const ULONG remaining,   // in
+	const DWORD flags   // in, optional
+)
+{
+	unsigned i = 0;
+	struct latency *const store = (struct latency *)cb_param;
+	
+	
+	if( !store || !spi )
+		return TRAVERSE_CALLBACK_ABORT;
+	
+	if( !sti )
+		return TRAVERSE_CALLBACK_CONTINUE;
+	
+	/* if this is the process' first thread check whether the process has a tracked thread */
+	if( sti == (void *)&spi->Threads )
+	{
+		for( i = 0; i < store->item_count; ++i )
+		{
+			if( store->item[ i ].pid == (uintptr_t)spi->UniqueProcessId )
+				break;
+		}
+		
+		if( i == store->item_count )
+			return TRAVERSE_CALLBACK_SKIP;
+	}
+	
+	for( i = 0; i < store->item_count; ++i )
+	{
+		struct latency_item *const item = &store->item[ i ];
+		
+		
+		if( ( item->tid == (uintptr_t)sti->ClientId.UniqueThread ) 
+			&& ( item->create_time == sti->CreateTime.QuadPart )
+		)
+			add_latency_sample( item, sti );
+	}
+	
+	return TRAVERSE_CALLBACK_CONTINUE;
+}
+
+
+
+/* sample_latency_store() 
+Sample the state of each tracked thread until a number of milliseconds have elapsed.
+
+This is used in place of Sleep() between snapshots in monitor mode. A sample is taken every 
+store->interval milliseconds. If the system thread info can't be queried the sample is counted as 
+failed and sampling continues.
+
+This function must only be called from the main thread.
+*/
+void sample_latency_store( 
+	struct latency *const store,   // in
+	const DWORD milliseconds   // in
+)
+{
+	const DWORD start = GetTickCount();
+	DWORD elapsed = 0;
+	struct traverse_filter filter;
+	
+	FAIL_IF( !store );
+	FAIL_IF( !store->init_time );   // The latency store must be initialized.
+	
+	FAIL_IF( GetCurrentThreadId() != G->prog->dwMainThreadId );   // main thread only
+	
+	
+	/* only the processes of the tracked threads are traversed. if the user requested only one 
+	session then only the processes in that session are queried.
+	*/
+	ZeroMemory( &filter, sizeof( filter ) );
+	filter.pid = store->pid;
+	filter.pid_count = store->pid_count;
+	
+	if( G->config->flags & CFG_SESSION_FILTER )
+	{
+		filter.flags = TRAVERSE_FILTER_SESSION;
+		filter.session_id = G->config->session;
+	}
+	
+	while( ( elapsed = GetTickCount() - start ) < milliseconds )
+	{
+		const DWORD remaining = milliseconds - elapsed;
+		
+		
+		if( store->item_count )
+		{
+			++store->sample_total;
+			
+			if( traverse_threads_ex( 
+				callback_sample_latency, 
+				store, 
+				store->spi, 
+				store->spi_max_bytes, 
+				TRAVERSE_FLAG_VALIDATE_ONCE, 
+				NULL, 
+				&filter
+				) != TRAVERSE_SUCCESS
+			)
+				++store->sample_failed;
+		}
+		
+		Sleep( ( remaining < store->interval ) ? remaining : store->interval );
+	}
+	
+	return;
+}
+
+
+
+/* get_latency_estimate() 
+Get the estimated input delay in milliseconds caused by a hook.
+
+The estimate for a low-level hook is its origin thread's longest run of samples in which it wasn't 
+waiting for input, multiplied by the sample interval. The procedures of other global hooks are 
+called in the hooked threads so their estimate is 0.
+
+returns the estimated input delay in milliseconds
+*/
+static unsigned get_latency_estimate( 
+	const struct latency *const store,   // in
+	const struct latency_item *const item   // in
+)
+{
+	FAIL_IF( !store );
+	FAIL_IF( !item );
+	
+	
+	if( ( item->iHook != WH_KEYBOARD_LL ) && ( item->iHook != WH_MOUSE_LL ) )
+		return 0;
+	
+	return item->streak_max * store->interval;
+}
+
+
+
+/* compare_latency_pid() 
+Compare two process ids.
+
+qsort() callback: sort the array of process ids of the tracked origin threads in ascending order.
+*/
+static int compare_latency_pid( 
+	const void *const p1,   // in
+	const void *const p2   // in
+)
+{
+	const ULONG_PTR a = *(const ULONG_PTR *)p1;
+	const ULONG_PTR b = *(const ULONG_PTR *)p2;
+	
+	
+	if( a < b )
+		return -1;
+	else if( a > b )
+		return 1;
+	else
+		return 0;
+}
+
+
+
+/* compare_latency_item() 
+Compare two latency items by their impact on input latency.
+
+qsort() callback: sort an array of pointers to latency items so that the hooks with the greatest 
+impact are first. Hung hooks are first, then by estimated input delay, then by the percentage of 
+samples in which the origin thread wasn't waiting for input.
+*/
+static int compare_latency_item( 
+	const void *const p1,   // in
+	const void *const p2   // in
+)
+{
+	const struct latency_item *const a = *(const struct latency_item *const *)p1;
+	const struct latency_item *const b = *(const struct latency_item *const *)p2;
+	unsigned estimate_a = 0, estimate_b = 0;
+	double busy_a = 0, busy_b = 0;
+	
+	
+	if( !a->hung_count != !b->hung_count )
+		return b->hung_count ? 1 : -1;
+	
+	estimate_a = get_latency_estimate( G->latency, a );
+	estimate_b = get_latency_estimate( G->latency, b );
+	
+	if( estimate_a != estimate_b )
+		return ( estimate_a < estimate_b ) ? 1 : -1;
+	
+	busy_a = a->sample_count ? ( (double)( a->sample_count - a->idle_count ) / a->sample_count ) : 0;
+	busy_b = b->sample_count ? ( (double)( b->sample_count - b->idle_count ) / b->sample_count ) : 0;
+	
+	if( busy_a != busy_b )
+		return ( busy_a < busy_b ) ? 1 : -1;
+	
+	return 0;
+}
+
+
+
+/* print_latency_report() 
+Print the tracked hooks ranked by their estimated impact on input latency.
+
+est ms: the estimated input delay. see get_latency_estimate() 
+busy: the percentage of samples in which the origin thread wasn't waiting for input 
+trans: the number of thread state or wait reason transitions 
+last busy: the thread state and wait reason in the last sample in which the thread wasn't idle
+
+The origin thread is flagged [busy] if it wasn't waiting for input in at least half of the samples, 
+and [hung] if the HOOK had the flag HF_HUNG in any snapshot.
+
+if 'store' is NULL this function returns without having printed anything.
+*/
+void print_latency_report( 
+	const struct latency *const store   // in
+)
+{
+	unsigned i = 0;
+	const struct latency_item **item = NULL;
+	
+	
+	if( !store )
+		return;
+	
+	FAIL_IF( !store->init_time );   // The latency store must be initialized.
+	
+	
+	item = must_calloc( store->item_count + 1, sizeof( *item ) );
+	
+	for( i = 0; i < store->item_count; ++i )
+		item[ i ] = &store->item[ i ];
+	
+	qsort( (void *)item, store->item_count, sizeof( *item ), compare_latency_item );
+	
+	printf( "\nInput latency impact (%u hooks, a sample every %u ms, %I64u samples, %I64u failed):\n", 
+		store->item_count, 
+		store->interval, 
+		store->sample_total, 
+		store->sample_failed
+	);
+	printf( "%6s %7s %8s %6s  %-16s %-24s  %s\n", 
+		"est ms", "busy", "samples", "trans", "hook", "last busy", "origin"
+	);
+	
+	for( i = 0; i < store->item_count; ++i )
+	{
+		const struct latency_item *const a = item[ i ];
+		const unsigned index = (unsigned)( a->iHook + 1 ); /* the array index is the same as id + 1 */
+		const char *laststate = "-";
+		
+		
+		/* the wait reason is only applicable when the thread is in the wait state */
+		if( a->sample_count == a->idle_count )
+			laststate = "-";
+		else if( a->busy_state == LATENCY_STATE_WAITING )
+			laststate = WaitReason_to_cstr( a->busy_wait_reason );
+		else
+			laststate = ThreadState_to_cstr( a->busy_state );
+		
+		printf( "%6u %6.1f%% %8u %6u  %-16ls %-24s  %ls (PID %I64u, TID %I64u) on %ls", 
+			get_latency_estimate( store, a ), 
+			( a->sample_count ? ( ( ( a->sample_count - a->idle_count ) * 100.0 ) / a->sample_count ) : 0 ), 
+			a->sample_count, 
+			a->transition_count, 
+			( ( index < w_hooknames_count ) ? w_hooknames[ index ] : L"<unknown>" ), 
+			laststate, 
+			( a->name ? a->name : L"<unknown>" ), 
+			a->pid, 
+			a->tid, 
+			a->deskname
+		);
+		
+		if( ( a->sample_count >= LATENCY_BUSY_SAMPLES_MIN ) && ( ( a->idle_count * 2 ) <= a->sample_count ) )
+			printf( " [busy]" );
+		
+		if( a->hung_count )
+			printf( " [hung]" );
+		
+		printf( "\n" );
+	}
+	
+	fflush( stdout );
+	free( (void *)item );
+	return;
+}
+
+
+
+/* print_latency_store() 
+Print a latency store.
+
+if 'store' is NULL this function returns without having printed anything.
+*/
+void print_latency_store( 
+	const struct latency *const store   // in
+)
+{
+	const char *const objname = "Latency Store";
+	
+	
+	if( !store )
+		return;
+	
+	PRINT_DBLSEP_BEGIN( objname );
+	print_init_time( "store->init_time", store->init_time );
+	
+	printf( "store->item_max: %u\n", store->item_max );
+	printf( "store->item_count: %u\n", store->item_count );
+	printf( "store->generation: %u\n", store->generation );
+	printf( "store->interval: %u\n", store->interval );
+	printf( "store->spi_max_bytes: %Iu\n", store->spi_max_bytes );
+	printf( "store->pid_count: %Iu\n", store->pid_count );
+	printf( "store->sample_total: %I64u\n", store->sample_total );
+	printf( "store->sample_failed: %I64u\n", store->sample_failed );
+	
+	PRINT_DBLSEP_END( objname );
+	
+	return;
+}
+
+
+
+/* free_latency_store() 
+Free a latency store and all its descendants.
+
+this function then sets the latency store pointer to NULL and returns
+
+'in' is a pointer to a pointer to the latency store.
+if( !in || !*in ) then this function returns.
+*/
+void free_latency_store( 
+	struct latency **const in   // in deref
+)
+{
+	unsigned i = 0;
+	
+	
+	if( !in || !*in )
+		return;
+	
+	for( i = 0; i < (*in)->item_count; ++i )
+		free( (*in)->item[ i ].name );
+	
+	free( (*in)->item );
+	free( (*in)->spi );
+	free( (*in)->pid );
+	
+	free( (*in) );
+	*in = NULL;
+	
+	return;
+}
@@ -0,0 +1,184 @@
+/*
+Copyright (C) 2011 Jay Satiro <raysatiro@yahoo.com>
+All rights reserved.
+
+This file is part of GetHooks.
+
+GetHooks is free software: you can redistribute it and/or modify 
+it under the terms of the GNU General Public License as published by 
+the Free Software Foundation, either version 3 of the License, or 
+(at your option) any later version.
+
+GetHooks is distributed in the hope that it will be useful, 
+but WITHOUT ANY WARRANTY; without even the implied warranty of 
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License 
+along with GetHooks.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _LATENCY_H
+#define _LATENCY_H
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include "portable.h"
+#endif
+
+/* snapshot store (system process info, gui threads, desktop hooks) */
+#include "snapshot.h"
+
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/** This is the info kept for each low-level or global hook whose origin thread is tracked.
+A hook is identified by its handle and the address of its handle entry. Its origin thread is 
+identified by its thread id and creation time.
+*/
+struct latency_item
+{
+	/* the HOOK's handle and the address of its handle entry */
+	HANDLE h;
+	void *pHead;
+	
+	/* the HOOK's id and the flags from the last snapshot it was found in */
+	INT iHook;
+	DWORD flags;
+	
+	/* the name of the desktop the hook is on. this points to the name in the global desktop store. */
+	const WCHAR *deskname;
+	
+	/* the origin thread's process id, thread id and thread creation time */
+	unsigned __int64 pid;
+	unsigned __int64 tid;
+	__int64 create_time;
+	
+	/* the origin thread's process image name */
+	WCHAR *name;   // calloc(), free()
+	
+	/* the snapshot generation in which the hook was last found */
+	unsigned generation;
+	
+	/* the number of times the origin thread's state was sampled */
+	unsigned sample_count;
+	
+	/* the number of samples in which the origin thread was waiting for input (UserRequest or 
+	WrUserRequest). a thread that's waiting for input can service a hook call right away.
+	*/
+	unsigned idle_count;
+	
+	/* the number of snapshots in which the HOOK had the flag HF_HUNG */
+	unsigned hung_count;
+	
+	/* the number of samples in which the thread state or wait reason changed from the last sample */
+	unsigned transition_count;
+	
+	/* the current and the longest run of consecutive samples in which the thread wasn't idle */
+	unsigned streak;
+	unsigned streak_max;
+	
+	/* the thread state and wait reason in the last sample */
+	ULONG state;
+	ULONG wait_reason;
+	
+	/* the thread state and wait reason in the last sample in which the thread wasn't idle */
+	ULONG busy_state;
+	ULONG busy_wait_reason;
+};
+
+
+
+/** The latency store.
+The latency store tracks the state of the origin thread of each low-level and global hook across 
+snapshots, and between snapshots at a higher frequency, to estimate each hook's impact on input 
+latency.
+*/
+struct latency
+{
+	/* an array of latency items */
+	struct latency_item *item;   // calloc(), free()
+	
+	/* the allocated/maximum number of elements in the item array */
+	unsigned item_max;
+	
+	/* the number of elements written to in the item array */
+	unsigned item_count;
+	
+	/* the current snapshot generation. see update_latency_store() */
+	unsigned generation;
+	
+	/* how many milliseconds to wait between samples */
+	#define LATENCY_INTERVAL_MIN   1
+	#define LATENCY_INTERVAL_MAX   1000
+	unsigned interval;
+	
+	/* a buffer for the system process info of each sample. see create_snapshot_store() */
+	SYSTEM_PROCESS_INFORMATION *spi;   // calloc(), free()
+	
+	/* the allocated size of the buffer in bytes */
+	size_t spi_max_bytes;
+	
+	/* the sorted process ids of the tracked origin threads. the samples only traverse these 
+	processes. see update_latency_store()
+	*/
+	ULONG_PTR *pid;   // calloc(), free()
+	size_t pid_count;
+	
+	/* the number of samples taken between snapshots, and how many of those failed */
+	unsigned __int64 sample_total;
+	unsigned __int64 sample_failed;
+	
+	/* the system utc time in FILETIME format immediately after this store has been initialized.
+	this is nonzero when this store has been initialized.
+	*/
+	__int64 init_time;
+};
+
+
+
+/** 
+these functions are documented in the comment block above their definitions in latency.c
+*/
+void create_latency_store( 
+	struct latency **const out   // out deref
+);
+
+int init_latency_store( 
+	struct latency *const store,   // in
+	const unsigned interval   // in
+);
+
+void update_latency_store( 
+	struct latency *const store,   // in
+	const struct snapshot *const snapshot   // in
+);
+
+void sample_latency_store( 
+	struct latency *const store,   // in
+	const DWORD milliseconds   // in
+);
+
+void print_latency_report( 
+	const struct latency *const store   // in
+);
+
+void print_latency_store( 
+	const struct latency *const store   // in
+);
+
+void free_latency_store( 
+	struct latency **const in   // in deref
+);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _LATENCY_H
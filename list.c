@@ -19,7 +19,7 @@ along with GetHooks.  If not, see <http://www.gnu.org/licenses/>.
 */
 
 /** 
-This file contains functions for a generic list store (linked list of names and/or ids).
+This file contains functions for a generic list store (table of names and/or ids).
 Each function is documented in the comment block above its definition.
 
 -
@@ -28,16 +28,22 @@ create_list_store()
 Create a list store and its descendants or die.
 -
 
+-
+link_list_items()
+
+Link the items in a list store's table from head to tail.
+-
+
 -
 add_list_item()
 
-Append an item to a list store's linked list.
+Append an item to a list store's table.
 -
 
 -
 print_list_item()
 
-Print an item from a list store's linked list.
+Print an item from a list store's table.
 -
 
 -
@@ -64,6 +70,12 @@ Free a list store and all its descendants.
 
 
 
+static void link_list_items( 
+	struct list *const store   // in
+);
+
+
+
 /* create_list_store()
 Create a list store and its descendants or die.
 */
@@ -82,8 +94,36 @@ void create_list_store(
 
 
 
+/* link_list_items() 
+Link the items in a list store's table from head to tail.
+
+This must be called when the table has moved.
+*/
+static void link_list_items( 
+	struct list *const store   // in
+)
+{
+	unsigned i = 0;
+	
+	FAIL_IF( !store );
+	
+	
+	for( i = 1; i < store->count; ++i )
+		store->item[ i - 1 ].next = &store->item[ i ];
+	
+	if( store->count )
+		store->item[ store->count - 1 ].next = NULL;
+	
+	store->head = ( store->count ? &store->item[ 0 ] : NULL );
+	store->tail = ( store->count ? &store->item[ store->count - 1 ] : NULL );
+	
+	return;
+}
+
+
+
 /* add_list_item()
-Append an item to a list store's linked list.
+Append an item to a list store's table.
 
 this function appends an item to a list if the id and/or name (depending on list type) is not 
 already in the list. any comparison of 'name' is case insensitive.
@@ -105,10 +145,14 @@ desktop:
 test:
 'name' required. 'id' required.
 
+file:
+'name' required. 'id' required. an item is always appended.
+
 the item's name will point to a duplicate of the passed in 'name'.
 
 returns on success a pointer to the list item that was added to the list. if there is already an 
 existing item with the same id and/or name (depending on list type) a pointer to it is returned.
+the pointer is only valid until the next item is added.
 */
 struct list_item *add_list_item( 
 	struct list *const store,   // in
@@ -259,6 +303,14 @@ struct list_item *add_list_item(
 		
 		goto new_item;
 	}
+	else if( store->type == LIST_INCLUDE_FILE )
+	{
+		FAIL_IF( !name );
+		// id can be 0
+		
+		/* a file may be specified more than once to compare two records in the same file */
+		goto new_item;
+	}
 	else // handle generic here?
 	{
 		MSG_FATAL( "Unknown list type." );
@@ -268,9 +320,19 @@ struct list_item *add_list_item(
 	
 	
 new_item:
-	/* create a new item and add it to the list */
+	/* add a new item to the end of the table. if the table is full it's doubled and moved. */
+	
+	if( store->count >= store->max )
+	{
+		const unsigned max = ( store->max ? ( store->max * 2 ) : LIST_ITEMS_MIN );
+		
+		store->item = must_recalloc( store->item, store->max, max, sizeof( *store->item ) );
+		store->max = max;
+		
+		link_list_items( store );
+	}
 	
-	item = must_calloc( 1, sizeof( *item ) );
+	item = &store->item[ store->count ];
 	
 	if( hookname ) /* special case. this function already has made a copy of the name to store */
 		item->name = hookname;
@@ -282,16 +344,13 @@ new_item:
 	item->id = id;
 	item->next = NULL;
 	
-	if( !store->head )
-	{
-		store->head = item;
-		store->tail = item;
-	}
-	else
-	{
+	if( store->tail )
 		store->tail->next = item;
-		store->tail = item;
-	}
+	
+	++store->count;
+	
+	store->head = &store->item[ 0 ];
+	store->tail = item;
 	
 	return item;
 	
@@ -306,7 +365,7 @@ existing_item:
 
 
 /* print_list_item()
-Print an item from a list store's linked list.
+Print an item from a list store's table.
 
 if 'item' is NULL this function returns without having printed anything.
 */
@@ -346,7 +405,7 @@ void print_list_store(
 )
 {
 	const char *const objname = "Generic List Store";
-	struct list_item *item = NULL;
+	unsigned i = 0;
 	
 	
 	if( !store )
@@ -379,19 +438,21 @@ void print_list_store(
 		case LIST_EXCLUDE_PROG:
 			printf( "LIST_EXCLUDE_PROG (user-specified list of programs to exclude.)" );
 			break;
+		case LIST_INCLUDE_FILE:
+			printf( "LIST_INCLUDE_FILE (user-specified list of snapshot files to include.)" );
+			break;
 		default:
 			printf( "%d (unknown type)", store->type );
 	}
 	printf( "\n" );
 	
-	//printf( "\nNow printing the desktop items in the list from head to tail.\n " );
+	printf( "store->count: %u\n", store->count );
+	printf( "store->max: %u\n", store->max );
+	
 	PRINT_HEX( store->head );
 	
-	for( item = store->head; item; item = item->next )
-	{
-		//PRINT_HEX( item );
-		print_list_item( item );
-	}
+	for( i = 0; i < store->count; ++i )
+		print_list_item( &store->item[ i ] );
 	
 	PRINT_HEX( store->tail );
 	
@@ -414,25 +475,16 @@ void free_list_store(
 	struct list **const in   // in deref
 )
 {
+	unsigned i = 0;
+	
 	if( !in || !*in )
 		return;
 	
-	if( (*in)->head )
-	{
-		struct list_item *current = NULL, *p = NULL;
-		
-		for( current = (*in)->head; current; current = p )
-		{
-			p = current->next;
-			
-			/* free any resources associated with the item */
-			if( current->name )
-				free( current->name );
-			
-			/* free the item */
-			free( current );
-		}
-	}
+	/* free any resources associated with each item */
+	for( i = 0; i < (*in)->count; ++i )
+		free( (*in)->item[ i ].name );
+	
+	free( (*in)->item );
 	
 	free( (*in) );
 	*in = NULL;
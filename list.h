@@ -21,7 +21,11 @@ along with GetHooks.  If not, see <http://www.gnu.org/licenses/>.
 #ifndef _LIST_H
 #define _LIST_H
 
+#ifdef _WIN32
 #include <windows.h>
+#else
+#include "portable.h"
+#endif
 
 
 
@@ -32,7 +36,7 @@ extern "C" {
 
 /** This is the info needed for each item in a generic list.
 What members are valid depends on the type of list.
-GetHooks config currently uses four lists:
+GetHooks config currently uses five lists:
 
 test include list:
 name is required. id is required.
@@ -43,6 +47,10 @@ name is required. id is unused.
 hook include/exclude list:
 name is optional. id is required.
 
+snapshot file include list:
+name is required. id is the time of the record to use in the file (see snapfile.h).
+the same file may be in the list more than once.
+
 program include/exclude list:
 name and id are currently handled elsewhere as mutually exclusive.
 if( name ) then the name is used, but if( !name ) then the id is used.
@@ -53,7 +61,9 @@ struct list_item
 	__int64 id;
 	WCHAR *name;   // _wcsdup(), free()
 	
-	/* The next item in the list */
+	/* The next item in the list. This is the next element in the table, or NULL for the last.
+	It's kept for the code that walks the list from its head. see struct list
+	*/
 	struct list_item *next;
 };
 
@@ -70,20 +80,37 @@ enum list_type
 	LIST_INCLUDE_HOOK,   // list of hooks to include
 	LIST_INCLUDE_PROG,   // list of programs to include
 	LIST_EXCLUDE_HOOK,   // list of hooks to exclude
-	LIST_EXCLUDE_PROG   // list of programs to exclude
+	LIST_EXCLUDE_PROG,   // list of programs to exclude
+	LIST_INCLUDE_FILE   // list of snapshot files to include
 };
 
 
 
 /** The generic list store. 
-The list store holds a linked list of some type specified below.
+The list store holds a table of items of some type specified below.
+
+The items are contiguous and in the order they were added. An item's index never changes since 
+items aren't removed, but the table is moved when it grows so a pointer to an item is only valid 
+until the next item is added. The table can also be walked through the head/next adapters: 'head' 
+is its first element, each item's 'next' is the element after it and 'tail' is its last element. 
+The desktop and desktop hook stores keep their items the same way.
 */
 struct list
 {
-	/* list item. this is a pointer to the first item in the list. */
-	struct list_item *head;   // items calloc'd. the list is freed when the store is freed.
+	/* the table of items */
+	#define LIST_ITEMS_MIN   8
+	struct list_item *item;   // calloc(), free()
+	
+	/* the allocated/maximum number of items in the table */
+	unsigned max;
+	
+	/* the number of items in the table */
+	unsigned count;
+	
+	/* list item. this is a pointer to the first item in the table, or NULL if there are none. */
+	struct list_item *head;
 	
-	/* the last item in the list */
+	/* the last item in the table */
 	struct list_item *tail;
 	
 	/* the list type */
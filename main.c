@@ -54,6 +54,9 @@ Create and initialize the global stores, print the license and version and then
 */
 
 #include <stdio.h>
+#ifndef _WIN32
+#include <locale.h>
+#endif
 
 #include "util.h"
 
@@ -61,6 +64,42 @@ Create and initialize the global stores, print the license and version and then
 
 #include "diff.h"
 
+#include "snapfile.h"
+
+#include "aggregate.h"
+
+#include "export.h"
+
+#include "ancestry.h"
+
+#include "latency.h"
+
+#include "cost.h"
+
+#include "fastpoll.h"
+
+#include "hookscan.h"
+
+#include "prefetch.h"
+
+#include "reload.h"
+
+#include "chain.h"
+
+#include "occupancy.h"
+
+#include "churn.h"
+
+#include "checkpoint.h"
+
+#include "stream.h"
+
+#include "rules.h"
+
+#include "rollup.h"
+
+#include "governor.h"
+
 #include "test.h"
 
 /* the global stores */
@@ -121,6 +160,8 @@ void print_license( void )
 
 
 
+/* Only the offline modes are built on other systems. See BUILD.txt */
+#ifdef _WIN32
 /* warn_x64()
 Warn if Windows x64 host.
 
@@ -161,6 +202,36 @@ snapshot and then matches the HOOKs to their threads. This function then prints
 If monitoring/polling is enabled then snapshots are taken continuously with each current snapshot 
 compared to the previous one for differences. The results are printed for each difference.
 
+If the user specified a snapshot file to record to then each snapshot is also written to the file.
+If the user specified a columnar export file then each hook event printed is also written to it.
+If the user requested the ancestry of hook origins then the process ancestry store is updated with 
+each snapshot.
+If the user requested input latency analysis then the origin threads of low-level and global hooks 
+are sampled between snapshots and ranked by their impact on input latency after each snapshot.
+If the user requested CPU cost accounting then the most expensive hook owners are printed after 
+each snapshot.
+If the user requested fast polling then the hook owner and origin threads are re-polled between 
+snapshots.
+If the user requested hook scans then the hooks added and removed between snapshots are reported 
+as soon as they're found, and their threads are identified after the next snapshot.
+If the user requested prefetching then the system process info for each snapshot is queried on a 
+background thread shortly before the snapshot is due.
+If the user specified a configuration file then it's read first, and in monitor mode it's reloaded 
+between snapshots whenever it changes.
+If the user requested chain checks then the HOOK chains in each snapshot are checked and the 
+anomalies found in two consecutive snapshots are printed.
+If the user requested desktop heap occupancy estimates then the USER objects on each desktop heap 
+are counted with each snapshot, and a desktop is alerted when it trends toward heap exhaustion.
+If the user requested USER handle churn sampling then the handle table is sampled on a background 
+thread and the churn since the last snapshot is printed after each snapshot.
+If the user specified a rules file then the hook events printed in each snapshot are matched 
+against its rules after the snapshot.
+If the user requested rollups then the hooks in each snapshot and the hook events are aggregated 
+per minute, hour and day, and each hour and day is printed when it ends.
+If the user requested a CPU budget then the wait between snapshots is stretched, the sampling 
+between snapshots is deferred and the priority of the main thread is lowered as needed to keep the 
+monitor loop within it.
+
 returns nonzero on success (a single snapshot was taken and its results printed to stdout).
 if polling is enabled this function will loop continuously and never return.
 */
@@ -171,6 +242,8 @@ int gethooks()
 	struct snapshot *previous = NULL;
 	struct snapshot *current = NULL;
 	struct snapshot *temp = NULL;
+	struct snapfile *recording = NULL;
+	unsigned interval = 0;
 	int ret = 0;
 	
 	FAIL_IF( !G );   // The global store must exist.
@@ -182,9 +255,136 @@ int gethooks()
 	if( G->config->verbose >= 5 )
 		PRINT_HASHSEP_BEGIN( objname );
 	
+	/* if the user specified a configuration file then read it before anything else depends on the 
+	configuration. in monitor mode it's reloaded between snapshots whenever it changes.
+	*/
+	if( G->config->pwszConfigFile && !init_reload_store( G->reload, G->config->pwszConfigFile ) )
+	{
+		MSG_FATAL( "The reload store failed to initialize." );
+		exit( 1 );
+	}
+	
+	/* if the user requested recording then create the snapshot file */
+	if( G->config->pwszRecordFile )
+	{
+		create_snapfile_store( &recording );
+		
+		if( !init_snapfile_store( recording, G->config->pwszRecordFile ) )
+		{
+			MSG_FATAL( "The snapshot file store failed to initialize." );
+			exit( 1 );
+		}
+	}
+	
+	/* if the user requested a columnar export then create the export file */
+	if( G->config->pwszColumnsFile && !init_export_store( G->exporter, G->config->pwszColumnsFile ) )
+	{
+		MSG_FATAL( "The export store failed to initialize." );
+		exit( 1 );
+	}
+	
+	/* if the user requested the ancestry of hook origins then index the processes in each snapshot */
+	if( ( G->config->flags & CFG_SHOW_ANCESTRY ) && !init_ancestry_store( G->ancestry ) )
+	{
+		MSG_FATAL( "The ancestry store failed to initialize." );
+		exit( 1 );
+	}
+	
+	/* if the user requested input latency analysis then track the hook origin threads */
+	if( G->config->latency && !init_latency_store( G->latency, G->config->latency ) )
+	{
+		MSG_FATAL( "The latency store failed to initialize." );
+		exit( 1 );
+	}
+	
+	/* if the user requested CPU cost accounting then track the hook threads' CPU counters */
+	if( ( G->config->flags & CFG_COST_ACCOUNTING ) && !init_cost_store( G->cost ) )
+	{
+		MSG_FATAL( "The cost store failed to initialize." );
+		exit( 1 );
+	}
+	
+	/* if the user requested fast polling then re-poll the hook threads between snapshots */
+	if( G->config->fastpoll && !init_fastpoll_store( G->fastpoll, G->config->fastpoll ) )
+	{
+		MSG_FATAL( "The fast poll store failed to initialize." );
+		exit( 1 );
+	}
+	
+	/* if the user requested hook scans then report hook events between snapshots */
+	if( G->config->hookscan && !init_hookscan_store( G->hookscan, G->config->hookscan ) )
+	{
+		MSG_FATAL( "The hook scan store failed to initialize." );
+		exit( 1 );
+	}
+	
+	/* if the user requested chain checks then check the HOOK chains in each snapshot */
+	if( ( G->config->flags & CFG_CHECK_CHAINS ) && !init_chain_store( G->chain ) )
+	{
+		MSG_FATAL( "The chain store failed to initialize." );
+		exit( 1 );
+	}
+	
+	/* if the user requested occupancy estimates then count the USER objects with each snapshot */
+	if( G->config->occupancy && !init_occupancy_store( G->occupancy, G->config->occupancy ) )
+	{
+		MSG_FATAL( "The occupancy store failed to initialize." );
+		exit( 1 );
+	}
+	
+	/* if the user requested churn sampling then start sampling the handle table */
+	if( G->config->churn 
+		&& !init_churn_store( G->churn, G->config->churn, G->config->pwszChurnFile )
+	)
+	{
+		MSG_FATAL( "The churn store failed to initialize." );
+		exit( 1 );
+	}
+	
+	/* if the user requested a checkpoint file then restore the warm state from it */
+	if( G->config->pwszCheckpointFile 
+		&& !init_checkpoint_store( G->checkpoint, G->config->pwszCheckpointFile )
+	)
+	{
+		MSG_FATAL( "The checkpoint store failed to initialize." );
+		exit( 1 );
+	}
+	
+	/* if the user specified a rules file then compile its rules */
+	if( G->config->pwszRulesFile && !init_rules_store( G->rules, G->config->pwszRulesFile ) )
+	{
+		MSG_FATAL( "The rules store failed to initialize." );
+		exit( 1 );
+	}
+	
+	/* if the user requested rollups then aggregate the hook metrics from each snapshot */
+	if( ( G->config->flags & CFG_ROLLUP ) && !init_rollup_store( G->rollup ) )
+	{
+		MSG_FATAL( "The rollup store failed to initialize." );
+		exit( 1 );
+	}
+	
 	/* allocate the memory needed to take a snapshot */
 	create_snapshot_store( &current );
 	
+	/* if the user requested prefetching then start the background thread. its spare buffer is 
+	swapped with the snapshot stores' buffers so it must be the same size.
+	*/
+	if( G->config->prefetch && !init_prefetch_store( G->prefetch, G->config->prefetch, current ) )
+	{
+		MSG_FATAL( "The prefetch store failed to initialize." );
+		exit( 1 );
+	}
+	
+	/* measure the time to first hook. if the user requested streaming then capture the hooks now 
+	and print each desktop's hooks during the snapshot as soon as their threads are found.
+	*/
+	if( !init_stream_store( G->stream, G->config->stream ) )
+	{
+		MSG_FATAL( "The stream store failed to initialize." );
+		exit( 1 );
+	}
+	
 	/* take a snapshot */
 	ret = init_snapshot_store( current );
 	
@@ -197,10 +397,73 @@ int gethooks()
 		exit( 1 );
 	}
 	
-	/* print the HOOKs found in the snapshot */
-	print_initial_desktop_hook_list( current->desktop_hooks );
+	if( recording && !write_snapfile_record( recording, current ) )
+	{
+		MSG_FATAL( "The snapshot could not be written to the snapshot file." );
+		exit( 1 );
+	}
+	
+	/* the hooks in the snapshot are added to the rollups before the events found in it */
+	if( G->config->flags & CFG_ROLLUP )
+		update_rollup_store( G->rollup, current );
+	
+	/* the first time each HOOK was found is printed with it */
+	if( G->config->pwszCheckpointFile )
+	{
+		update_checkpoint_hooks( G->checkpoint, current );
+		print_checkpoint_report( G->checkpoint );
+	}
+	
+	/* print the HOOKs found in the snapshot. if they were streamed then print the rest of them, 
+	and the HOOKs that changed between when they were captured and the snapshot.
+	*/
+	if( G->config->stream )
+	{
+		end_stream_store( G->stream, current );
+		print_diff_desktop_hook_lists( G->stream->capture->desktop_hooks, current->desktop_hooks );
+	}
+	else
+		print_initial_desktop_hook_list( current->desktop_hooks );
+	
 	printf( "\n" );
 	
+	if( G->config->stream || ( G->config->verbose >= 1 ) )
+		print_stream_report( G->stream );
+	
+	/* match the HOOKs found against the rules */
+	if( G->config->pwszRulesFile )
+	{
+		evaluate_rules_store( G->rules );
+		
+		if( G->config->verbose >= 1 )
+			print_rules_report( G->rules );
+	}
+	
+	if( G->config->latency )
+		update_latency_store( G->latency, current );
+	
+	if( G->config->flags & CFG_COST_ACCOUNTING )
+		update_cost_store( G->cost, current );
+	
+	if( G->config->fastpoll )
+		update_fastpoll_store( G->fastpoll, current );
+	
+	if( G->config->flags & CFG_CHECK_CHAINS )
+		check_chain_store( G->chain, current );
+	
+	if( G->config->occupancy )
+	{
+		print_occupancy_report( G->occupancy, current );
+		print_occupancy_alerts( G->occupancy, current );
+	}
+	
+	/* the events are buffered and written periodically. see flush_export_store() */
+	if( G->config->pwszColumnsFile && !flush_export_store( G->exporter, FALSE ) )
+	{
+		MSG_FATAL( "The hook events could not be written to the columnar export file." );
+		exit( 1 );
+	}
+	
 	/* for each desktop in the snapshot */
 	for( dh = current->desktop_hooks->head; dh; dh = dh->next )
 	{
@@ -222,6 +485,10 @@ int gethooks()
 				hook_ignore_count, 
 				( dh->hook_count - hook_ignore_count ) 
 			);
+			
+			/* the anomalies were counted when the hooks were captured. see set_hook_anomalies() */
+			if( dh->anomaly_count )
+				printf( "%u of the hooks have anomalies.\n", dh->anomaly_count );
 		}
 	}
 	
@@ -237,9 +504,43 @@ int gethooks()
 	/* allocate the memory needed to take another snapshot */
 	create_snapshot_store( &previous );
 	
+	/* if the user requested a CPU budget then measure the monitor loop from here */
+	if( G->config->budget 
+		&& !init_governor_store( G->governor, G->config->budget, G->config->polling * 1000, NULL )
+	)
+	{
+		MSG_FATAL( "The governor store failed to initialize." );
+		exit( 1 );
+	}
+	
 	for( ;; )
 	{
-		Sleep( G->config->polling * 1000 );
+		/* if the configuration file has changed then swap in the new configuration. the desktops, 
+		snapshots and tracked threads are kept.
+		*/
+		if( G->reload->init_time )
+			check_reload_store( G->reload, previous, current );
+		
+		/* the wait before the next snapshot. the governor may stretch it to keep within the budget. */
+		interval = G->config->budget ? G->governor->interval : (unsigned)G->config->polling * 1000;
+		
+		/* query the system process info for the next snapshot shortly before it's due */
+		if( G->config->prefetch )
+			request_prefetch_store( G->prefetch, interval );
+		
+		/* sample the hook origin threads' states while waiting for the next snapshot, unless the 
+		governor deferred the sampling to keep within the budget
+		*/
+		if( G->config->budget && G->governor->deferred )
+			Sleep( interval );
+		else if( G->config->latency )
+			sample_latency_store( G->latency, interval );
+		else if( G->config->fastpoll )
+			sample_fastpoll_store( G->fastpoll, interval );
+		else if( G->config->hookscan )
+			sample_hookscan_store( G->hookscan, current, interval );
+		else
+			Sleep( interval );
 		
 		/* swap pointers to previous and current snapshot stores.
 		this is better than continually freeing and creating the stores.
@@ -262,15 +563,138 @@ int gethooks()
 			exit( 1 );
 		}
 		
+		if( recording && !write_snapfile_record( recording, current ) )
+		{
+			MSG_FATAL( "The snapshot could not be written to the snapshot file." );
+			exit( 1 );
+		}
+		
+		/* the buckets that ended before this snapshot are closed before its events are added */
+		if( G->config->flags & CFG_ROLLUP )
+			update_rollup_store( G->rollup, current );
+		
+		/* the HOOKs removed since the last snapshot are kept until the next update */
+		if( G->config->pwszCheckpointFile )
+		{
+			update_checkpoint_hooks( G->checkpoint, current );
+			
+			if( G->config->verbose >= 1 )
+				print_checkpoint_report( G->checkpoint );
+		}
+		
 		/* Print the HOOKs that have been added/removed/modified since the last snapshot */
 		print_diff_desktop_hook_lists( previous->desktop_hooks, current->desktop_hooks );
+		
+		/* identify the threads of the hooks the hook scans reported since the last snapshot */
+		if( G->config->hookscan )
+			attribute_hookscan_events( G->hookscan, previous, current );
+		
+		/* match the hook events since the last snapshot against the rules. the events refer to 
+		both snapshots so they're evaluated before the next swap.
+		*/
+		if( G->config->pwszRulesFile )
+		{
+			evaluate_rules_store( G->rules );
+			
+			if( G->config->verbose >= 1 )
+				print_rules_report( G->rules );
+		}
+		
+		/* rank the hooks tracked since the last snapshot, then track the hooks in this snapshot */
+		if( G->config->latency )
+		{
+			print_latency_report( G->latency );
+			update_latency_store( G->latency, current );
+		}
+		
+		/* account for the CPU time used by the hook threads since the last snapshot */
+		if( G->config->flags & CFG_COST_ACCOUNTING )
+		{
+			update_cost_store( G->cost, current );
+			print_cost_report( G->cost );
+		}
+		
+		/* print the re-polls since the last snapshot, then track the threads in this snapshot */
+		if( G->config->fastpoll )
+		{
+			print_fastpoll_report( G->fastpoll );
+			update_fastpoll_store( G->fastpoll, current );
+		}
+		
+		/* print the chain anomalies found in both this snapshot and the last one */
+		if( G->config->flags & CFG_CHECK_CHAINS )
+		{
+			check_chain_store( G->chain, current );
+			print_chain_report( G->chain );
+		}
+		
+		/* print the desktops that started or stopped trending toward heap exhaustion */
+		if( G->config->occupancy )
+		{
+			if( G->config->verbose >= 1 )
+				print_occupancy_report( G->occupancy, current );
+			
+			print_occupancy_alerts( G->occupancy, current );
+		}
+		
+		/* print the churn of the USER handles sampled since the last snapshot */
+		if( G->config->churn )
+		{
+			if( !drain_churn_store( G->churn ) )
+			{
+				MSG_FATAL( "The samples could not be written to the churn file." );
+				exit( 1 );
+			}
+			
+			print_churn_report( G->churn );
+		}
+		
+		/* print the hours and days that ended before this snapshot */
+		if( G->config->flags & CFG_ROLLUP )
+			print_rollup_report( G->rollup );
+		
+		if( G->config->pwszColumnsFile && !flush_export_store( G->exporter, FALSE ) )
+		{
+			MSG_FATAL( "The hook events could not be written to the columnar export file." );
+			exit( 1 );
+		}
+		
+		/* the checkpoint is only an optimization so a failure to write it isn't fatal */
+		if( G->config->pwszCheckpointFile 
+			&& ( ( current->init_time - G->checkpoint->save_time )
+				>= ( (__int64)CHECKPOINT_SAVE_SECONDS * 10000000 ) ) 
+			&& !save_checkpoint_store( G->checkpoint )
+		)
+			MSG_WARNING( "The checkpoint file could not be written." );
+		
+		/* measure this cycle's CPU time and decide the wait before the next snapshot. the budget is 
+		printed whenever it starts or stops degrading the freshness of the snapshots.
+		*/
+		if( G->config->budget )
+		{
+			update_governor_store( G->governor, G->config->polling * 1000 );
+			
+			if( G->governor->changed || ( G->config->verbose >= 1 ) )
+				print_governor_report( G->governor );
+		}
 	}
 	
 	
 cleanup:
+	/* write any hook events that haven't been written yet */
+	if( G->config->pwszColumnsFile && !flush_export_store( G->exporter, TRUE ) )
+	{
+		MSG_FATAL( "The hook events could not be written to the columnar export file." );
+		exit( 1 );
+	}
+	
+	if( G->config->pwszCheckpointFile && !save_checkpoint_store( G->checkpoint ) )
+		MSG_WARNING( "The checkpoint file could not be written." );
+	
 	/* free the stores and all their descendants */
 	free_snapshot_store( &previous );
 	free_snapshot_store( &current );
+	free_snapfile_store( &recording );
 	
 	if( G->config->verbose >= 5 )
 		PRINT_HASHSEP_END( objname );
@@ -293,6 +717,7 @@ static void pause( void )
 #pragma auto_inline( on ) /* revert automatic inlining setting */
 #pragma optimize( "g", on ) /* revert global optimizations setting */
 #endif
+#endif // _WIN32
 
 
 
@@ -303,6 +728,7 @@ returns zero on success
 */
 int main( int argc, char **argv )
 {
+#ifdef _WIN32
 	/* If the program is started in its own window then pause before exit
 	(eg user clicks on gethooks.exe in explorer, or vs debugger initiated program)
 	*/
@@ -331,6 +757,10 @@ int main( int argc, char **argv )
 			atexit( pause );
 		}
 	}
+#else
+	/* the wide character strings are printed in the user's locale */
+	setlocale( LC_CTYPE, "" );
+#endif
 	
 	//_set_printf_count_output( 1 ); // enable support for %n.
 	
@@ -342,7 +772,9 @@ int main( int argc, char **argv )
 	print_license();
 	printf( "\n\n" );
 	
+#ifdef _WIN32
 	warn_x64();
+#endif
 	
 	
 	/* Create the global store 'G' and its descendants or die.
@@ -371,6 +803,22 @@ int main( int argc, char **argv )
 	/* G->config has been initialized */
 	
 	
+	/* If the user requested offline mode then read snapshots from snapshot files instead of taking 
+	them. Offline mode doesn't need any desktops so the global desktop store isn't initialized.
+	offlinemode() and aggregatemode() return nonzero on success, but main should return zero on success.
+	*/
+	if( G->config->offline == OFFLINE_AGGREGATE )
+		return !aggregatemode();
+	else if( G->config->offline )
+		return !offlinemode();
+	
+#ifndef _WIN32
+	MSG_FATAL( "Only the offline modes are built on this system. See BUILD.txt" );
+	exit( 1 );
+#endif
+	
+	
+#ifdef _WIN32
 	/* Initialize the global desktop store 'G->desktops', a descendant of the global store.
 	The global desktop store holds a linked list of attached to desktops and their heaps.
 	'G->config' must be initialized before initializing the global desktop store.
@@ -391,4 +839,5 @@ int main( int argc, char **argv )
 	testmode() and gethooks() return nonzero on success, but main should return zero on success.
 	*/
 	return ( ( G->config->testlist->init_time ) ? !testmode() : !gethooks() );
+#endif // _WIN32
 }
@@ -0,0 +1,818 @@
+/*
+Copyright (C) 2011 Jay Satiro <raysatiro@yahoo.com>
+All rights reserved.
+
+This file is part of GetHooks.
+
+GetHooks is free software: you can redistribute it and/or modify 
+it under the terms of the GNU General Public License as published by 
+the Free Software Foundation, either version 3 of the License, or 
+(at your option) any later version.
+
+GetHooks is distributed in the hope that it will be useful, 
+but WITHOUT ANY WARRANTY; without even the implied warranty of 
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License 
+along with GetHooks.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/** 
+This file contains functions for an occupancy store (desktop heap occupancy estimates).
+Each function is documented in the comment block above its definition.
+
+Every USER object in the handle table is classified by the desktop heap its pHead is in, and is 
+counted by type and by owner. This is done in the same pass over the handle table that finds the 
+hooks, see init_desktop_hook_store(). The desktop heap is allocated from the bottom up, so the 
+highest offset of an object from the base of the heap is an estimate of how much of it is in use, 
+and the average space an object takes is that offset divided by the number of objects. The growth 
+of the object count is tracked as a moving average of objects per minute, which projects when the 
+heap will be exhausted at that density.
+
+-
+create_occupancy_store()
+
+Create an occupancy store and its descendants or die.
+-
+
+-
+init_occupancy_store()
+
+Initialize an occupancy store.
+-
+
+-
+begin_occupancy_pass()
+
+Begin a pass over the handle table.
+-
+
+-
+add_occupancy_owner()
+
+Count an object for its owner on a desktop.
+-
+
+-
+add_occupancy_object()
+
+Count a USER object for the desktop heap it's in.
+-
+
+-
+end_occupancy_pass()
+
+End a pass over the handle table and update the growth of each desktop's object count.
+-
+
+-
+get_occupancy_projection()
+
+Get the estimated capacity of a desktop heap and the minutes until it's exhausted.
+-
+
+-
+compare_occupancy_owner()
+
+Compare two owners by their object counts, descending.
+-
+
+-
+print_occupancy_owners()
+
+Print the owners of the most objects on a desktop.
+-
+
+-
+print_occupancy_report()
+
+Print the occupancy of each desktop heap.
+-
+
+-
+print_occupancy_alerts()
+
+Print the desktops that started or stopped trending toward exhaustion.
+-
+
+-
+print_occupancy_store()
+
+Print an occupancy store.
+-
+
+-
+free_occupancy_store()
+
+Free an occupancy store and all its descendants.
+-
+
+*/
+
+#include <stdio.h>
+
+#include "util.h"
+
+#include "occupancy.h"
+
+/* the global stores */
+#include "global.h"
+
+
+
+/* the initial number of elements in each desktop's owner array */
+#define OCCUPANCY_OWNERS_DEFAULT   256
+
+/* the weight of the newest sample in the moving average of the growth rate */
+#define OCCUPANCY_RATE_WEIGHT   0.2
+
+/* the number of samples needed before the growth rate is used to project exhaustion */
+#define OCCUPANCY_TREND_SAMPLES   5
+
+/* the number of owners and types printed for each desktop */
+#define OCCUPANCY_REPORT_ROWS   5
+
+/* the number of 100-nanosecond intervals in a minute */
+#define OCCUPANCY_FILETIME_MINUTE   600000000.0
+
+
+
+static void add_occupancy_owner( 
+	struct occupancy_desktop *const item,   // in
+	const void *const pOwner   // in
+);
+
+static double get_occupancy_projection( 
+	const struct occupancy_desktop *const item,   // in
+	double *const capacity   // out
+);
+
+static int compare_occupancy_owner( 
+	const void *const p1,   // in
+	const void *const p2   // in
+);
+
+static void print_occupancy_owners( 
+	const struct occupancy_desktop *const item,   // in
+	const struct snapshot *const snapshot   // in
+);
+
+
+
+/* create_occupancy_store() 
+Create an occupancy store and its descendants or die.
+
+The desktop array is allocated when the store is initialized.
+*/
+void create_occupancy_store( 
+	struct occupancy **const out   // out deref
+)
+{
+	struct occupancy *occupancy = NULL;
+	
+	FAIL_IF( !out );
+	FAIL_IF( *out );
+	
+	
+	/* allocate an occupancy store */
+	occupancy = must_calloc( 1, sizeof( *occupancy ) );
+	
+	
+	*out = occupancy;
+	return;
+}
+
+
+
+/* init_occupancy_store() 
+Initialize an occupancy store.
+
+'horizon' is the number of minutes ahead that a desktop heap that's projected to be exhausted is 
+alerted.
+
+The store has an item for each desktop in the global desktop store, which must be initialized.
+
+returns nonzero on success
+*/
+int init_occupancy_store( 
+	struct occupancy *const store,   // in
+	const unsigned horizon   // in
+)
+{
+	unsigned i = 0;
+	const struct desktop_item *desktop = NULL;
+	
+	FAIL_IF( !G );   // The global store must exist.
+	FAIL_IF( !G->desktops->init_time );   // The desktop store must be initialized.
+	
+	FAIL_IF( !store );
+	FAIL_IF( store->init_time );   // Fail if this store has already been initialized.
+	FAIL_IF( ( horizon < OCCUPANCY_HORIZON_MIN ) || ( horizon > OCCUPANCY_HORIZON_MAX ) );
+	
+	
+	store->horizon = horizon;
+	
+	for( desktop = G->desktops->head; desktop; desktop = desktop->next )
+		++store->desktop_count;
+	
+	store->desktop = must_calloc( store->desktop_count + 1, sizeof( *store->desktop ) );
+	
+	for( i = 0, desktop = G->desktops->head; desktop; ++i, desktop = desktop->next )
+	{
+		struct occupancy_desktop *const item = &store->desktop[ i ];
+		
+		
+		item->desktop = desktop;
+		item->base = (uintptr_t)desktop->pDeskInfo->pvDesktopBase;
+		item->limit = (uintptr_t)desktop->pDeskInfo->pvDesktopLimit;
+		
+		item->owner_max = OCCUPANCY_OWNERS_DEFAULT;
+		item->owner = must_calloc( item->owner_max, sizeof( *item->owner ) );
+		item->slot = must_calloc( item->owner_max * 2, sizeof( *item->slot ) );
+	}
+	
+	/* the occupancy store has been initialized */
+	GetSystemTimeAsFileTime( (FILETIME *)&store->init_time );
+	return TRUE;
+}
+
+
+
+/* begin_occupancy_pass() 
+Begin a pass over the handle table.
+
+Each USER object seen during the pass is passed to add_occupancy_object(). If the pass is retried 
+this function can be called again.
+*/
+void begin_occupancy_pass( 
+	struct occupancy *const store   // in
+)
+{
+	unsigned i = 0;
+	
+	FAIL_IF( !store );
+	FAIL_IF( !store->init_time );   // The occupancy store must be initialized.
+	
+	
+	for( i = 0; i < store->desktop_count; ++i )
+	{
+		struct occupancy_desktop *const item = &store->desktop[ i ];
+		
+		
+		ZeroMemory( item->type_count, sizeof( item->type_count ) );
+		ZeroMemory( item->slot, item->owner_max * 2 * sizeof( *item->slot ) );
+		
+		item->object_count = 0;
+		item->high_offset = 0;
+		item->owner_count = 0;
+	}
+	
+	store->outside_count = 0;
+	store->counting = TRUE;
+	
+	return;
+}
+
+
+
+/* add_occupancy_owner() 
+Count an object for its owner on a desktop.
+*/
+static void add_occupancy_owner( 
+	struct occupancy_desktop *const item,   // in
+	const void *const pOwner   // in
+)
+{
+	unsigned i = 0, slot = 0, slot_max = 0;
+	
+	FAIL_IF( !item );
+	
+	
+	/* the owner array is full. double it and rebuild the hash table */
+	if( item->owner_count >= item->owner_max )
+	{
+		struct occupancy_owner *const owner = 
+			must_calloc( item->owner_max * 2, sizeof( *item->owner ) );
+		
+		memcpy( owner, item->owner, item->owner_max * sizeof( *item->owner ) );
+		free( item->owner );
+		free( item->slot );
+		
+		item->owner = owner;
+		item->owner_max *= 2;
+		item->slot = must_calloc( item->owner_max * 2, sizeof( *item->slot ) );
+		
+		for( i = 0; i < item->owner_count; ++i )
+		{
+			for( slot = ( (unsigned)( (uintptr_t)item->owner[ i ].pOwner >> 3 ) * 2654435761u )
+					& ( item->owner_max * 2 - 1 );
+				item->slot[ slot ];
+				slot = ( slot + 1 ) & ( item->owner_max * 2 - 1 )
+			)
+				;
+			
+			item->slot[ slot ] = i + 1;
+		}
+	}
+	
+	slot_max = item->owner_max * 2;
+	
+	for( slot = ( (unsigned)( (uintptr_t)pOwner >> 3 ) * 2654435761u ) & ( slot_max - 1 );
+		item->slot[ slot ] && ( item->owner[ item->slot[ slot ] - 1 ].pOwner != pOwner );
+		slot = ( slot + 1 ) & ( slot_max - 1 )
+	)
+		;
+	
+	if( !item->slot[ slot ] )
+	{
+		item->owner[ item->owner_count ].pOwner = pOwner;
+		item->owner[ item->owner_count ].count = 0;
+		item->slot[ slot ] = ++item->owner_count;
+	}
+	
+	++item->owner[ item->slot[ slot ] - 1 ].count;
+	return;
+}
+
+
+
+/* add_occupancy_object() 
+Count a USER object for the desktop heap it's in.
+
+'entry' is a copy of the object's HANDLEENTRY. A free entry isn't counted.
+*/
+void add_occupancy_object( 
+	struct occupancy *const store,   // in
+	const HANDLEENTRY *const entry   // in
+)
+{
+	unsigned i = 0;
+	uintptr_t pHead = 0;
+	struct occupancy_desktop *item = NULL;
+	
+	FAIL_IF( !store );
+	FAIL_IF( !store->counting );   // A pass must have begun.
+	FAIL_IF( !entry );
+	
+	
+	if( ( entry->bType == TYPE_FREE ) || !entry->pHead )
+		return;
+	
+	pHead = (uintptr_t)entry->pHead;
+	
+	for( i = 0; i < store->desktop_count; ++i )
+	{
+		if( ( pHead >= store->desktop[ i ].base ) && ( pHead < store->desktop[ i ].limit ) )
+		{
+			item = &store->desktop[ i ];
+			break;
+		}
+	}
+	
+	/* the object is on another desktop, or it's not allocated from a desktop heap */
+	if( !item )
+	{
+		++store->outside_count;
+		return;
+	}
+	
+	++item->object_count;
+	++item->type_count[ ( entry->bType < TYPE_CTYPES ) ? entry->bType : TYPE_CTYPES ];
+	
+	if( ( pHead - item->base ) > item->high_offset )
+		item->high_offset = pHead - item->base;
+	
+	add_occupancy_owner( item, entry->pOwner );
+	return;
+}
+
+
+
+/* end_occupancy_pass() 
+End a pass over the handle table and update the growth of each desktop's object count.
+
+The growth is updated incrementally from the previous sample, so the cost doesn't depend on how 
+long the desktops have been tracked.
+*/
+void end_occupancy_pass( 
+	struct occupancy *const store   // in
+)
+{
+	unsigned i = 0;
+	
+	FAIL_IF( !store );
+	FAIL_IF( !store->counting );   // A pass must have begun.
+	
+	
+	store->counting = FALSE;
+	++store->pass_total;
+	GetSystemTimeAsFileTime( (FILETIME *)&store->time );
+	
+	for( i = 0; i < store->desktop_count; ++i )
+	{
+		struct occupancy_desktop *const item = &store->desktop[ i ];
+		const double minutes = ( store->time - item->sample_time ) / OCCUPANCY_FILETIME_MINUTE;
+		
+		
+		if( item->samples && ( minutes <= 0 ) )
+			continue;
+		
+		if( item->samples )
+		{
+			const double rate = ( (double)item->object_count - item->sample_count ) / minutes;
+			
+			if( item->samples == 1 )
+				item->rate = rate;
+			else
+				item->rate += OCCUPANCY_RATE_WEIGHT * ( rate - item->rate );
+		}
+		
+		item->sample_count = item->object_count;
+		item->sample_time = store->time;
+		++item->samples;
+	}
+	
+	return;
+}
+
+
+
+/* get_occupancy_projection() 
+Get the estimated capacity of a desktop heap and the minutes until it's exhausted.
+
+'*capacity' receives the number of objects the heap would hold at the current density, or 0 if 
+there are no objects.
+
+returns the minutes until the heap is exhausted at the current growth rate.
+returns a negative number if the object count isn't growing or there aren't enough samples.
+*/
+static double get_occupancy_projection( 
+	const struct occupancy_desktop *const item,   // in
+	double *const capacity   // out
+)
+{
+	FAIL_IF( !item );
+	FAIL_IF( !capacity );
+	
+	
+	*capacity = 0;
+	
+	if( !item->high_offset || ( item->limit <= item->base ) )
+		return -1;
+	
+	*capacity = (double)item->object_count * ( item->limit - item->base ) / item->high_offset;
+	
+	if( ( item->samples < OCCUPANCY_TREND_SAMPLES ) || ( item->rate <= 0 ) )
+		return -1;
+	
+	return ( *capacity - item->object_count ) / item->rate;
+}
+
+
+
+/* compare_occupancy_owner() 
+Compare two owners by their object counts, descending.
+
+This function is called by qsort().
+
+returns an integer that is less than, equal to, or greater than zero
+*/
+static int compare_occupancy_owner( 
+	const void *const p1,   // in
+	const void *const p2   // in
+)
+{
+	const struct occupancy_owner *const a = *(const struct occupancy_owner **)p1;
+	const struct occupancy_owner *const b = *(const struct occupancy_owner **)p2;
+	
+	
+	if( a->count != b->count )
+		return ( a->count < b->count ) ? 1 : -1;
+	
+	return 0;
+}
+
+
+
+/* print_occupancy_owners() 
+Print the owners of the most objects on a desktop.
+
+An owner that's a thread in the snapshot is printed with its process. Otherwise the owner is 
+printed by its kernel address, which for some types of objects is a PROCESSINFO.
+*/
+static void print_occupancy_owners( 
+	const struct occupancy_desktop *const item,   // in
+	const struct snapshot *const snapshot   // in
+)
+{
+	unsigned i = 0;
+	const struct occupancy_owner **owner = NULL;
+	
+	FAIL_IF( !item );
+	FAIL_IF( !snapshot );
+	
+	
+	owner = must_calloc( item->owner_count + 1, sizeof( *owner ) );
+	
+	for( i = 0; i < item->owner_count; ++i )
+		owner[ i ] = &item->owner[ i ];
+	
+	qsort( (void *)owner, item->owner_count, sizeof( *owner ), compare_occupancy_owner );
+	
+	for( i = 0; ( i < item->owner_count ) && ( i < OCCUPANCY_REPORT_ROWS ); ++i )
+	{
+		const struct gui *const gui = 
+			owner[ i ]->pOwner ? find_Win32ThreadInfo( snapshot, owner[ i ]->pOwner ) : NULL;
+		
+		
+		printf( "%10u  ", owner[ i ]->count );
+		
+		if( gui )
+			print_gui_brief( gui );
+		else if( owner[ i ]->pOwner )
+		{
+			printf( "owner " );
+			PRINT_HEX_BARE( owner[ i ]->pOwner );
+		}
+		else
+			printf( "<no owner>" );
+		
+		printf( "\n" );
+	}
+	
+	free( (void *)owner );
+	return;
+}
+
+
+
+/* print_occupancy_report() 
+Print the occupancy of each desktop heap.
+
+objects: the number of USER objects on the desktop 
+heap KB: the size of the desktop heap 
+used: the highest offset of an object as a percentage of the size of the heap 
+obj/min: the growth of the object count 
+left min: the estimated minutes until the heap is exhausted at that growth
+
+For each desktop the most common types of objects and the owners of the most objects are printed.
+
+'snapshot' is the snapshot whose pass was last ended. It's used to identify the owners.
+
+if 'store' is NULL this function returns without having printed anything.
+*/
+void print_occupancy_report( 
+	const struct occupancy *const store,   // in
+	const struct snapshot *const snapshot   // in
+)
+{
+	unsigned i = 0, j = 0, k = 0;
+	
+	
+	if( !store )
+		return;
+	
+	FAIL_IF( !store->init_time );   // The occupancy store must be initialized.
+	FAIL_IF( !snapshot );
+	
+	
+	printf( "\nDesktop heap occupancy (%u objects not on an attached to desktop):\n", 
+		store->outside_count
+	);
+	
+	for( i = 0; i < store->desktop_count; ++i )
+	{
+		const struct occupancy_desktop *const item = &store->desktop[ i ];
+		unsigned type[ TYPE_CTYPES + 1 ];
+		double capacity = 0;
+		const double minutes = get_occupancy_projection( item, &capacity );
+		
+		
+		printf( "\n%10s %9s %6s %9s %9s  %s\n", 
+			"objects", "heap KB", "used", "obj/min", "left min", "desktop"
+		);
+		printf( "%10u %9Iu %5.1f%% %9.1f ", 
+			item->object_count, 
+			( ( item->limit - item->base ) / 1024 ), 
+			( ( item->limit > item->base ) ?
+				( ( item->high_offset * 100.0 ) / ( item->limit - item->base ) ) : 0 ), 
+			item->rate
+		);
+		
+		if( minutes >= 0 )
+			printf( "%9.0f", minutes );
+		else
+			printf( "%9s", "-" );
+		
+		printf( "  %ls\n", item->desktop->pwszDesktopName );
+		
+		/* the most common types, by a selection of the largest counts */
+		for( j = 0; j <= TYPE_CTYPES; ++j )
+			type[ j ] = j;
+		
+		printf( "Types:" );
+		
+		for( j = 0; ( j < OCCUPANCY_REPORT_ROWS ) && ( j <= TYPE_CTYPES ); ++j )
+		{
+			unsigned temp = 0;
+			
+			for( k = j + 1; k <= TYPE_CTYPES; ++k )
+			{
+				if( item->type_count[ type[ k ] ] > item->type_count[ type[ j ] ] )
+				{
+					temp = type[ j ];
+					type[ j ] = type[ k ];
+					type[ k ] = temp;
+				}
+			}
+			
+			if( !item->type_count[ type[ j ] ] )
+				break;
+			
+			printf( " %ls %u", 
+				( ( type[ j ] < TYPE_CTYPES ) && ( type[ j ] < w_handlenames_count ) ) ?
+					w_handlenames[ type[ j ] ] : L"<unknown>", 
+				item->type_count[ type[ j ] ]
+			);
+		}
+		
+		printf( "\nOwners of the most objects:\n" );
+		print_occupancy_owners( item, snapshot );
+	}
+	
+	fflush( stdout );
+	return;
+}
+
+
+
+/* print_occupancy_alerts() 
+Print the desktops that started or stopped trending toward exhaustion.
+
+A desktop is trending toward exhaustion if at its growth rate the heap is projected to be exhausted 
+within the horizon, or if its highest object is at OCCUPANCY_FULL_PERCENT of the heap. A desktop 
+is alerted once when it starts trending, with the owners of the most objects, and again when it 
+stops.
+
+'snapshot' is the snapshot whose pass was last ended. It's used to identify the owners.
+
+if 'store' is NULL this function returns without having printed anything.
+*/
+void print_occupancy_alerts( 
+	struct occupancy *const store,   // in
+	const struct snapshot *const snapshot   // in
+)
+{
+	unsigned i = 0;
+	
+	
+	if( !store )
+		return;
+	
+	FAIL_IF( !store->init_time );   // The occupancy store must be initialized.
+	FAIL_IF( !snapshot );
+	
+	
+	for( i = 0; i < store->desktop_count; ++i )
+	{
+		struct occupancy_desktop *const item = &store->desktop[ i ];
+		double capacity = 0;
+		const double minutes = get_occupancy_projection( item, &capacity );
+		const unsigned full = ( item->limit > item->base ) 
+			&& ( ( item->high_offset * 100.0 ) / ( item->limit - item->base ) >= OCCUPANCY_FULL_PERCENT );
+		const unsigned trending = full || ( ( minutes >= 0 ) && ( minutes <= store->horizon ) );
+		
+		
+		if( trending == item->alerted )
+			continue;
+		
+		item->alerted = trending;
+		
+		if( !trending )
+		{
+			printf( "\n[Occupancy] Desktop '%ls' is no longer trending toward heap exhaustion "
+				"(%u objects).\n", 
+				item->desktop->pwszDesktopName, 
+				item->object_count
+			);
+			continue;
+		}
+		
+		++store->alert_total;
+		
+		printf( "\n[Occupancy] Desktop '%ls' is trending toward heap exhaustion: ", 
+			item->desktop->pwszDesktopName
+		);
+		
+		if( minutes >= 0 )
+		{
+			printf( "%u objects growing %.1f per minute, about %.0f minutes to %.0f objects.\n", 
+				item->object_count, 
+				item->rate, 
+				minutes, 
+				capacity
+			);
+		}
+		else
+		{
+			printf( "%u objects, the highest at %.1f%% of the heap.\n", 
+				item->object_count, 
+				( ( item->high_offset * 100.0 ) / ( item->limit - item->base ) )
+			);
+		}
+		
+		printf( "Owners of the most objects:\n" );
+		print_occupancy_owners( item, snapshot );
+	}
+	
+	fflush( stdout );
+	return;
+}
+
+
+
+/* print_occupancy_store() 
+Print an occupancy store.
+
+if 'store' is NULL this function returns without having printed anything.
+*/
+void print_occupancy_store( 
+	const struct occupancy *const store   // in
+)
+{
+	const char *const objname = "Occupancy Store";
+	unsigned i = 0;
+	
+	
+	if( !store )
+		return;
+	
+	PRINT_DBLSEP_BEGIN( objname );
+	print_init_time( "store->init_time", store->init_time );
+	
+	printf( "store->desktop_count: %u\n", store->desktop_count );
+	
+	for( i = 0; i < store->desktop_count; ++i )
+	{
+		const struct occupancy_desktop *const item = &store->desktop[ i ];
+		
+		
+		printf( "store->desktop[ %u ]: %ls, %u objects, %u owners (max %u), %u samples, "
+			"%.1f obj/min, alerted: %u\n", 
+			i, 
+			item->desktop->pwszDesktopName, 
+			item->object_count, 
+			item->owner_count, 
+			item->owner_max, 
+			item->samples, 
+			item->rate, 
+			item->alerted
+		);
+	}
+	
+	printf( "store->outside_count: %u\n", store->outside_count );
+	printf( "store->horizon: %u\n", store->horizon );
+	printf( "store->counting: %u\n", store->counting );
+	printf( "store->pass_total: %I64u\n", store->pass_total );
+	printf( "store->alert_total: %I64u\n", store->alert_total );
+	print_init_time( "store->time", store->time );
+	
+	PRINT_DBLSEP_END( objname );
+	
+	return;
+}
+
+
+
+/* free_occupancy_store() 
+Free an occupancy store and all its descendants.
+
+this function then sets the occupancy store pointer to NULL and returns
+
+'in' is a pointer to a pointer to the occupancy store.
+if( !in || !*in ) then this function returns.
+*/
+void free_occupancy_store( 
+	struct occupancy **const in   // in deref
+)
+{
+	unsigned i = 0;
+	
+	
+	if( !in || !*in )
+		return;
+	
+	for( i = 0; i < (*in)->desktop_count; ++i )
+	{
+		free( (*in)->desktop[ i ].owner );
+		free( (*in)->desktop[ i ].slot );
+	}
+	
+	free( (*in)->desktop );
+	
+	free( *in );
+	*in = NULL;
+	
+	return;
+}
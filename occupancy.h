@@ -0,0 +1,195 @@
+/*
+Copyright (C) 2011 Jay Satiro <raysatiro@yahoo.com>
+All rights reserved.
+
+This file is part of GetHooks.
+
+GetHooks is free software: you can redistribute it and/or modify 
+it under the terms of the GNU General Public License as published by 
+the Free Software Foundation, either version 3 of the License, or 
+(at your option) any later version.
+
+GetHooks is distributed in the hope that it will be useful, 
+but WITHOUT ANY WARRANTY; without even the implied warranty of 
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License 
+along with GetHooks.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _OCCUPANCY_H
+#define _OCCUPANCY_H
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include "portable.h"
+#endif
+
+#include "reactos.h"
+
+/* snapshot store (system process info, gui threads, desktop hooks) */
+#include "snapshot.h"
+
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/** This is the info kept for each owner of USER objects on a desktop.
+The owner of an object is the kernel address of a THREADINFO or a PROCESSINFO, depending on the 
+type of the object.
+*/
+struct occupancy_owner
+{
+	/* HANDLEENTRY.pOwner */
+	const void *pOwner;
+	
+	/* the number of objects owned on the desktop in the last pass */
+	unsigned count;
+};
+
+
+
+/** This is the info kept for each attached to desktop.
+*/
+struct occupancy_desktop
+{
+	/* the desktop */
+	const struct desktop_item *desktop;
+	
+	/* the kernel addresses of the desktop heap, from DESKTOPINFO */
+	uintptr_t base;
+	uintptr_t limit;
+	
+	/* the number of objects of each type in the last pass. the last element counts unknown types */
+	unsigned type_count[ TYPE_CTYPES + 1 ];
+	
+	/* the number of objects in the last pass */
+	unsigned object_count;
+	
+	/* the highest offset of an object from the base of the heap in the last pass.
+	the heap is allocated from the bottom up, so this is about how much of the heap is in use.
+	*/
+	uintptr_t high_offset;
+	
+	/* an array of the owners of the objects in the last pass */
+	struct occupancy_owner *owner;   // calloc(), free()
+	unsigned owner_max;
+	unsigned owner_count;
+	
+	/* a hash table of the owners. each slot is 0 or the index + 1 of an owner.
+	the number of slots is twice owner_max so the table is kept at most half full.
+	*/
+	unsigned *slot;   // calloc(), free()
+	
+	/* the object count and the time of the previous sample */
+	unsigned sample_count;
+	__int64 sample_time;
+	
+	/* the number of samples */
+	unsigned samples;
+	
+	/* the growth of the object count in objects per minute, an exponential moving average */
+	double rate;
+	
+	/* nonzero if the desktop is trending toward exhaustion. see print_occupancy_alerts() */
+	unsigned alerted;
+};
+
+
+
+/** The occupancy store.
+The occupancy store estimates how full each attached to desktop's heap is. Every USER object in the 
+handle table is classified into the desktop whose heap its pHead is in, in the same pass over the 
+handle table that finds the hooks. See init_desktop_hook_store().
+*/
+struct occupancy
+{
+	/* an array of the attached to desktops */
+	struct occupancy_desktop *desktop;   // calloc(), free()
+	unsigned desktop_count;
+	
+	/* the number of objects in the last pass that aren't on an attached to desktop */
+	unsigned outside_count;
+	
+	/* the number of minutes ahead that a desktop heap that's projected to be exhausted is alerted */
+	#define OCCUPANCY_HORIZON_MIN   1
+	#define OCCUPANCY_HORIZON_MAX   1440
+	unsigned horizon;
+	
+	/* a desktop heap whose highest object is at this percentage of its size is alerted regardless 
+	of its growth rate.
+	*/
+	#define OCCUPANCY_FULL_PERCENT   90
+	
+	/* nonzero while objects are being added in a pass */
+	unsigned counting;
+	
+	/* the number of passes and alerts */
+	unsigned __int64 pass_total;
+	unsigned __int64 alert_total;
+	
+	/* the system utc time in FILETIME format immediately after the last pass */
+	__int64 time;
+	
+	/* the system utc time in FILETIME format immediately after this store has been initialized.
+	this is nonzero when this store has been initialized.
+	*/
+	__int64 init_time;
+};
+
+
+
+/** 
+these functions are documented in the comment block above their definitions in occupancy.c
+*/
+void create_occupancy_store( 
+	struct occupancy **const out   // out deref
+);
+
+int init_occupancy_store( 
+	struct occupancy *const store,   // in
+	const unsigned horizon   // in
+);
+
+void begin_occupancy_pass( 
+	struct occupancy *const store   // in
+);
+
+void add_occupancy_object( 
+	struct occupancy *const store,   // in
+	const HANDLEENTRY *const entry   // in
+);
+
+void end_occupancy_pass( 
+	struct occupancy *const store   // in
+);
+
+void print_occupancy_report( 
+	const struct occupancy *const store,   // in
+	const struct snapshot *const snapshot   // in
+);
+
+void print_occupancy_alerts( 
+	struct occupancy *const store,   // in
+	const struct snapshot *const snapshot   // in
+);
+
+void print_occupancy_store( 
+	const struct occupancy *const store   // in
+);
+
+void free_occupancy_store( 
+	struct occupancy **const in   // in deref
+);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _OCCUPANCY_H
@@ -0,0 +1,469 @@
+/*
+Copyright (C) 2011 Jay Satiro <raysatiro@yahoo.com>
+All rights reserved.
+
+This file is part of GetHooks.
+
+GetHooks is free software: you can redistribute it and/or modify 
+it under the terms of the GNU General Public License as published by 
+the Free Software Foundation, either version 3 of the License, or 
+(at your option) any later version.
+
+GetHooks is distributed in the hope that it will be useful, 
+but WITHOUT ANY WARRANTY; without even the implied warranty of 
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License 
+along with GetHooks.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/** 
+This file contains the functions that let parts of gethooks be built on other systems.
+Each function is documented in the comment block above its definition.
+
+The file view is used on every system. The rest of the functions are the stand-ins for Windows and 
+Microsoft CRT functions that the offline build uses, and are only built when _WIN32 isn't defined.
+See portable.h
+
+-
+open_portable_view()
+
+Open a read only view of a whole file.
+-
+
+-
+print_portable_view_error()
+
+Print why a file view couldn't be opened.
+-
+
+-
+close_portable_view()
+
+Close a file view.
+-
+
+-
+portable_printf()
+
+printf() with the Microsoft size prefixes I64 and I translated.
+-
+
+-
+_wfopen()
+
+Open a file that has a wide character name.
+-
+
+-
+widen_portable_string()
+
+Widen a UTF-16 string from a file to a WCHAR string.
+-
+
+-
+print_filetime_as_local()
+
+Print a FILETIME as local time and date. No newline.
+-
+
+*/
+
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <stdio.h>
+#include <stdarg.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "util.h"
+
+#include "portable.h"
+
+
+
+/* open_portable_view() 
+Open a read only view of a whole file.
+
+'view' is zeroed and then receives the view. The file may be opened while another program is 
+still writing to it, in which case the view is the part of the file that had been written.
+
+Nothing is printed, so that a view can be opened on any thread. If the view couldn't be opened then 
+view->error and view->error_code say why. see print_portable_view_error()
+
+returns nonzero on success. on failure the view must still be closed by close_portable_view().
+*/
+int open_portable_view( 
+	struct portable_view *const view,   // out
+	const WCHAR *const file   // in
+)
+{
+#ifdef _WIN32
+	LARGE_INTEGER size;
+	
+	FAIL_IF( !view );
+	FAIL_IF( !file );
+	
+	
+	ZeroMemory( view, sizeof( *view ) );
+	
+	view->hFile = CreateFileW( 
+		file, 
+		GENERIC_READ, 
+		( FILE_SHARE_READ | FILE_SHARE_WRITE ), 
+		NULL, 
+		OPEN_EXISTING, 
+		FILE_ATTRIBUTE_NORMAL, 
+		NULL
+	);
+	if( view->hFile == INVALID_HANDLE_VALUE )
+	{
+		view->error_code = GetLastError();
+		view->error = "CreateFileW() failed.";
+		return FALSE;
+	}
+	
+	ZeroMemory( &size, sizeof( size ) );
+	
+	if( !GetFileSizeEx( view->hFile, &size ) )
+	{
+		view->error_code = GetLastError();
+		view->error = "GetFileSizeEx() failed.";
+		return FALSE;
+	}
+	
+	if( !size.QuadPart || ( (UINT64)size.QuadPart > (size_t)-1 ) )
+	{
+		view->error = "The file is empty or too large to be mapped.";
+		return FALSE;
+	}
+	
+	view->bcount = (size_t)size.QuadPart;
+	
+	view->hMapping = CreateFileMappingW( view->hFile, NULL, PAGE_READONLY, 0, 0, NULL );
+	if( !view->hMapping )
+	{
+		view->error_code = GetLastError();
+		view->error = "CreateFileMappingW() failed.";
+		return FALSE;
+	}
+	
+	view->base = MapViewOfFile( view->hMapping, FILE_MAP_READ, 0, 0, 0 );
+	if( !view->base )
+	{
+		view->error_code = GetLastError();
+		view->error = "MapViewOfFile() failed.";
+		return FALSE;
+	}
+	
+	return TRUE;
+#else
+	char name[ MAX_PATH * 4 ];
+	struct stat st;
+	void *base = NULL;
+	
+	FAIL_IF( !view );
+	FAIL_IF( !file );
+	
+	
+	ZeroMemory( view, sizeof( *view ) );
+	view->fd = -1;
+	
+	if( wcstombs( name, file, sizeof( name ) ) >= sizeof( name ) )
+	{
+		view->error = "The file name could not be converted.";
+		return FALSE;
+	}
+	
+	view->fd = open( name, O_RDONLY );
+	if( view->fd == -1 )
+	{
+		view->error_code = GetLastError();
+		view->error = "open() failed.";
+		return FALSE;
+	}
+	
+	ZeroMemory( &st, sizeof( st ) );
+	
+	if( fstat( view->fd, &st ) )
+	{
+		view->error_code = GetLastError();
+		view->error = "fstat() failed.";
+		return FALSE;
+	}
+	
+	if( !st.st_size || ( (UINT64)st.st_size > (size_t)-1 ) )
+	{
+		view->error = "The file is empty or too large to be mapped.";
+		return FALSE;
+	}
+	
+	view->bcount = (size_t)st.st_size;
+	
+	base = mmap( NULL, view->bcount, PROT_READ, MAP_SHARED, view->fd, 0 );
+	if( base == MAP_FAILED )
+	{
+		view->error_code = GetLastError();
+		view->error = "mmap() failed.";
+		return FALSE;
+	}
+	
+	view->base = base;
+	return TRUE;
+#endif
+}
+
+
+
+/* print_portable_view_error() 
+Print why a file view couldn't be opened.
+
+'view' is a view that open_portable_view() failed to open 
+'file' is the file
+*/
+void print_portable_view_error( 
+	const struct portable_view *const view,   // in
+	const WCHAR *const file   // in
+)
+{
+	FAIL_IF( !view );
+	FAIL_IF( !file );
+	
+	
+	MSG_ERROR( ( view->error ? view->error : "The file could not be opened." ) );
+	
+	if( view->error_code )
+		printf( "GetLastError(): %lu\n", view->error_code );
+	
+	printf( "file: %ls\n", file );
+	return;
+}
+
+
+
+/* close_portable_view() 
+Close a file view.
+
+The view is zeroed. It's ok to close a view that wasn't opened or failed to open.
+*/
+void close_portable_view( 
+	struct portable_view *const view   // in, out
+)
+{
+	FAIL_IF( !view );
+	
+	
+#ifdef _WIN32
+	if( view->base )
+		UnmapViewOfFile( view->base );
+	
+	if( view->hMapping )
+		CloseHandle( view->hMapping );
+	
+	if( view->hFile && ( view->hFile != INVALID_HANDLE_VALUE ) )
+		CloseHandle( view->hFile );
+#else
+	if( view->base )
+		munmap( (void *)view->base, view->bcount );
+	
+	if( view->fd > 0 )
+		close( view->fd );
+#endif
+	
+	ZeroMemory( view, sizeof( *view ) );
+	return;
+}
+
+
+
+#ifndef _WIN32
+
+/* portable_printf() 
+printf() with the Microsoft size prefixes I64 and I translated.
+
+The printf formats in gethooks use the Microsoft size prefixes, eg %I64u for an unsigned __int64 and 
+%Iu for a size_t. In the offline build printf is defined as this function by util.h, and those 
+prefixes are translated to the standard ll and z before the format is passed to vprintf().
+
+returns the number of characters printed, or a negative value on error
+*/
+#undef printf
+int portable_printf( 
+	const char *const format,   // in
+	...
+)
+{
+	char buffer[ 512 ];
+	char *fmt = buffer;
+	const char *in = NULL;
+	char *out = NULL;
+	int ret = 0;
+	va_list args;
+	
+	FAIL_IF( !format );
+	
+	
+	/* the translated format is never longer than the format */
+	if( strlen( format ) >= sizeof( buffer ) )
+		fmt = must_calloc( strlen( format ) + 1, 1 );
+	
+	for( in = format, out = fmt; *in; )
+	{
+		if( *in != '%' )
+		{
+			*out++ = *in++;
+			continue;
+		}
+		
+		*out++ = *in++;
+		
+		/* flags, width and precision */
+		while( *in && strchr( "-+ #0123456789.*", *in ) )
+			*out++ = *in++;
+		
+		if( ( in[ 0 ] == 'I' ) && ( in[ 1 ] == '6' ) && ( in[ 2 ] == '4' ) )
+		{
+			*out++ = 'l';
+			*out++ = 'l';
+			in += 3;
+		}
+		else if( ( in[ 0 ] == 'I' ) && in[ 1 ] && strchr( "diouxX", in[ 1 ] ) )
+		{
+			*out++ = 'z';
+			in += 1;
+		}
+		else if( *in == '%' )
+		{
+			*out++ = *in++;
+		}
+	}
+	
+	*out = '\0';
+	
+	va_start( args, format );
+	ret = vprintf( fmt, args );
+	va_end( args );
+	
+	if( fmt != buffer )
+		free( fmt );
+	
+	return ret;
+}
+#define printf   portable_printf
+
+
+
+/* _wfopen() 
+Open a file that has a wide character name.
+
+The name and mode are converted to multibyte strings in the current locale and passed to fopen().
+
+returns the FILE pointer on success, or NULL on error
+*/
+FILE *_wfopen( 
+	const WCHAR *const file,   // in
+	const WCHAR *const mode   // in
+)
+{
+	char name[ MAX_PATH * 4 ];
+	char mbmode[ 16 ];
+	
+	FAIL_IF( !file );
+	FAIL_IF( !mode );
+	
+	
+	if( ( wcstombs( name, file, sizeof( name ) ) >= sizeof( name ) ) 
+		|| ( wcstombs( mbmode, mode, sizeof( mbmode ) ) >= sizeof( mbmode ) )
+	)
+	{
+		errno = ENAMETOOLONG;
+		return NULL;
+	}
+	
+	return fopen( name, mbmode );
+}
+
+
+
+/* widen_portable_string() 
+Widen a UTF-16 string from a file to a WCHAR string.
+
+'str' is the UTF-16 string and 'ecount' is its number of 16-bit units, including any nulls.
+
+The strings in snapshot files and columnar export files are UTF-16, which is the WCHAR of Windows.
+On other systems WCHAR is wider, so the strings are widened one unit to one character. The offsets 
+and lengths in the file are counted in units and so they are valid for the widened string as well.
+
+returns the widened string. free() when done.
+*/
+WCHAR *widen_portable_string( 
+	const UINT16 *const str,   // in
+	const size_t ecount   // in
+)
+{
+	size_t i = 0;
+	WCHAR *wstr = NULL;
+	
+	FAIL_IF( !str && ecount );
+	
+	
+	wstr = must_calloc( ecount + 1, sizeof( *wstr ) );
+	
+	for( i = 0; i < ecount; ++i )
+		wstr[ i ] = str[ i ];
+	
+	return wstr;
+}
+
+
+
+/* print_filetime_as_local() 
+Print a FILETIME as local time and date. No newline.
+
+This is the same format as the function of the same name in traverse_threads__support.c
+
+returns nonzero on success
+*/
+int print_filetime_as_local( 
+	const FILETIME *const ft   // in
+)
+{
+	__int64 utc = 0;
+	time_t t = 0;
+	struct tm local;
+	unsigned hour = 0;
+	
+	
+	ZeroMemory( &local, sizeof( local ) );
+	
+	if( ft )
+	{
+		utc = (__int64)( ( (unsigned __int64)ft->dwHighDateTime << 32 ) | ft->dwLowDateTime );
+		t = (time_t)( ( utc - 116444736000000000LL ) / 10000000 );
+	}
+	
+	if( !ft || ( utc < 116444736000000000LL ) || !localtime_r( &t, &local ) )
+	{
+		printf( "<conversion to local time failed>" );
+		return FALSE;
+	}
+	
+	hour = (unsigned)( local.tm_hour % 12 );
+	
+	printf( "%u:%02u:%02u %s"
+		"  %u/%u/%04u", 
+		( hour ? hour : 12 ), (unsigned)local.tm_min, (unsigned)local.tm_sec, 
+		( ( local.tm_hour >= 12 ) ? "PM" : "AM" ), 
+		(unsigned)( local.tm_mon + 1 ), (unsigned)local.tm_mday, (unsigned)( local.tm_year + 1900 )
+	);
+	
+	return TRUE;
+}
+
+#endif // _WIN32
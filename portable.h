@@ -0,0 +1,365 @@
+/*
+Copyright (C) 2011 Jay Satiro <raysatiro@yahoo.com>
+All rights reserved.
+
+This file is part of GetHooks.
+
+GetHooks is free software: you can redistribute it and/or modify 
+it under the terms of the GNU General Public License as published by 
+the Free Software Foundation, either version 3 of the License, or 
+(at your option) any later version.
+
+GetHooks is distributed in the hope that it will be useful, 
+but WITHOUT ANY WARRANTY; without even the implied warranty of 
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License 
+along with GetHooks.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _PORTABLE_H
+#define _PORTABLE_H
+
+/** 
+This header is what lets parts of gethooks be built on other systems.
+
+The offline build (see BUILD.txt) is the part of gethooks that reads snapshot files and columnar 
+export files: offline mode (inspect, diff and aggregate) and the diff engine that it shares with 
+monitor mode. When _WIN32 isn't defined the headers include this header instead of windows.h, and it 
+has stand-ins for the Windows types, constants and functions that the offline build uses. The few 
+stand-ins that can't be macros are in portable.c.
+
+The file view is used by the snapshot file view and the columnar export file reader on every system.
+On Windows the file is mapped with CreateFileMappingW() and on other systems with mmap().
+
+The files that can also be built on their own on other systems (scheduler.c and governor.c) include 
+this header after util.h. When _WIN32 isn't defined util.h isn't included, and this header has 
+stand-ins for the parts of it that those files use. The stand-ins aren't defined if util.h has been 
+included, so the other files in the offline build include util.h before any other header.
+*/
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/* the printf format of an unsigned __int64, without the '%' */
+#ifdef _WIN32
+#define PORTABLE_I64U   "I64u"
+#else
+#define PORTABLE_I64U   "llu"
+#endif
+
+
+#ifndef _WIN32
+
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <wchar.h>
+#include <wctype.h>
+
+#ifndef __int64
+#define __int64   long long
+#endif
+
+#ifndef TRUE
+#define TRUE   1
+#define FALSE   0
+#endif
+
+#define __cdecl
+#define __stdcall
+#define WINAPI
+
+#define MAX_PATH   260
+
+typedef unsigned char BYTE;
+typedef unsigned short WORD;
+typedef unsigned short USHORT;
+typedef int INT;
+typedef int BOOL;
+typedef unsigned UINT;
+typedef long LONG;
+typedef unsigned long ULONG;
+typedef ULONG *PULONG;
+typedef unsigned long DWORD;   // as wide as a long so that the "%lu" formats work
+typedef short INT16;
+typedef unsigned short UINT16;
+typedef int INT32;
+typedef unsigned UINT32;
+typedef long long INT64;
+typedef unsigned long long UINT64;
+typedef long long LONGLONG;
+typedef unsigned long long ULONGLONG;
+typedef long KPRIORITY;
+typedef size_t SIZE_T;
+typedef uintptr_t ULONG_PTR;
+typedef intptr_t LONG_PTR;
+typedef ULONG_PTR DWORD_PTR;
+typedef void *PVOID;
+typedef void *HANDLE;
+typedef wchar_t WCHAR;
+typedef WCHAR *PWSTR;
+
+typedef union _LARGE_INTEGER
+{
+	long long QuadPart;
+} LARGE_INTEGER;
+
+typedef struct _FILETIME
+{
+	UINT32 dwLowDateTime;
+	UINT32 dwHighDateTime;
+} FILETIME;
+
+typedef pthread_mutex_t CRITICAL_SECTION;
+
+/* the hook types (winuser.h) */
+#define WH_MIN   (-1)
+#define WH_MSGFILTER   (-1)
+#define WH_JOURNALRECORD   0
+#define WH_JOURNALPLAYBACK   1
+#define WH_KEYBOARD   2
+#define WH_GETMESSAGE   3
+#define WH_CALLWNDPROC   4
+#define WH_CBT   5
+#define WH_SYSMSGFILTER   6
+#define WH_MOUSE   7
+#define WH_HARDWARE   8
+#define WH_DEBUG   9
+#define WH_SHELL   10
+#define WH_FOREGROUNDIDLE   11
+#define WH_CALLWNDPROCRET   12
+#define WH_KEYBOARD_LL   13
+#define WH_MOUSE_LL   14
+#define WH_MAX   14
+
+#define _I64_MIN   LLONG_MIN
+#define _I64_MAX   LLONG_MAX
+#define _UI64_MAX   ULLONG_MAX
+
+#define ZeroMemory(dest,bcount)   memset( ( dest ), 0, ( bcount ) )
+
+/* the errno of a failed system call is reported as the last error */
+#define GetLastError()   ( (DWORD)errno )
+#define SetLastError(error)   ( errno = (int)( error ) )
+
+#define GetCurrentThreadId()   ( (DWORD)(uintptr_t)pthread_self() )
+
+#define _stricmp   strcasecmp
+#define _strnicmp   strncasecmp
+#define _wcsicmp   wcscasecmp
+#define _wcsnicmp   wcsncasecmp
+#define _wcsdup   wcsdup
+#define _strtoi64   strtoll
+#define _strtoui64   strtoull
+#define _fseeki64   fseeko
+#define _ftelli64   ftello
+
+#define InitializeCriticalSection(cs)   pthread_mutex_init( ( cs ), NULL )
+#define EnterCriticalSection(cs)   pthread_mutex_lock( ( cs ) )
+#define LeaveCriticalSection(cs)   pthread_mutex_unlock( ( cs ) )
+#define DeleteCriticalSection(cs)   pthread_mutex_destroy( ( cs ) )
+
+/* the system utc time in FILETIME format */
+#define PORTABLE_UTC_NOW()   ( ( (__int64)time( NULL ) * 10000000 ) + 116444736000000000LL )
+
+static __inline void GetSystemTimeAsFileTime( 
+	FILETIME *const ft   // out
+)
+{
+	struct timespec ts;
+	UINT64 utc = 0;
+	
+	
+	clock_gettime( CLOCK_REALTIME, &ts );
+	utc = ( (UINT64)ts.tv_sec * 10000000 ) + ( (UINT64)ts.tv_nsec / 100 ) + 116444736000000000ULL;
+	
+	ft->dwLowDateTime = (UINT32)utc;
+	ft->dwHighDateTime = (UINT32)( utc >> 32 );
+	return;
+}
+
+static __inline WCHAR *_wcsupr( 
+	WCHAR *const str   // in, out
+)
+{
+	WCHAR *p = NULL;
+	
+	
+	for( p = str; *p; ++p )
+		*p = (WCHAR)towupper( *p );
+	
+	return str;
+}
+
+static __inline WCHAR *_wcslwr( 
+	WCHAR *const str   // in, out
+)
+{
+	WCHAR *p = NULL;
+	
+	
+	for( p = str; *p; ++p )
+		*p = (WCHAR)towlower( *p );
+	
+	return str;
+}
+
+/* the performance counter is the monotonic clock in nanoseconds */
+static __inline BOOL QueryPerformanceFrequency( 
+	LARGE_INTEGER *const frequency   // out
+)
+{
+	frequency->QuadPart = 1000000000;
+	return TRUE;
+}
+
+static __inline BOOL QueryPerformanceCounter( 
+	LARGE_INTEGER *const counter   // out
+)
+{
+	struct timespec ts;
+	
+	
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	counter->QuadPart = ( (long long)ts.tv_sec * 1000000000 ) + ts.tv_nsec;
+	return TRUE;
+}
+
+/** 
+these functions are documented in the comment block above their definitions in portable.c
+*/
+int portable_printf( 
+	const char *const format,   // in
+	...
+);
+
+FILE *_wfopen( 
+	const WCHAR *const file,   // in
+	const WCHAR *const mode   // in
+);
+
+WCHAR *widen_portable_string( 
+	const UINT16 *const str,   // in
+	const size_t ecount   // in
+);
+
+int print_filetime_as_local( 
+	const FILETIME *const ft   // in
+);
+
+#endif // _WIN32
+
+
+
+/** The portable file view.
+A read only view of a whole file.
+*/
+struct portable_view
+{
+#ifdef _WIN32
+	HANDLE hFile;   // CreateFileW(), CloseHandle()
+	HANDLE hMapping;   // CreateFileMappingW(), CloseHandle()
+#else
+	int fd;   // open(), close()
+#endif
+
+	/* the view of the file */
+	const BYTE *base;   // MapViewOfFile(), UnmapViewOfFile() or mmap(), munmap()
+	
+	/* the size of the view in bytes */
+	size_t bcount;
+	
+	/* if the view couldn't be opened, what failed and the last error, or 0 if there isn't one. 
+	see print_portable_view_error()
+	*/
+	const char *error;
+	DWORD error_code;
+};
+
+int open_portable_view( 
+	struct portable_view *const view,   // out
+	const WCHAR *const file   // in
+);
+
+void print_portable_view_error( 
+	const struct portable_view *const view,   // in
+	const WCHAR *const file   // in
+);
+
+void close_portable_view( 
+	struct portable_view *const view   // in, out
+);
+
+
+
+#if !defined( _WIN32 ) && !defined( _UTIL_H )
+
+#define MSG_LOCATION(type,msg)   \
+	( \
+		fflush( stdout ), \
+		printf( "\n%s: %s line %d, %s(): %s\n", ( type ), __FILE__, __LINE__, __func__, ( msg ) ), \
+		fflush( stdout ) \
+	)
+
+#define MSG_WARNING(msg)   MSG_LOCATION( "Warning", ( msg ) )
+#define MSG_ERROR(msg)   MSG_LOCATION( "Error", ( msg ) )
+#define MSG_FATAL(msg)   MSG_LOCATION( "FATAL", ( msg ) )
+
+#define FAIL_IF(expr)   \
+	do \
+	{ \
+		if( expr ) \
+		{ \
+			MSG_FATAL( "A parameter or expression failed validation." ); \
+			printf( "The following expression is true: ( " #expr " )\n" ); \
+			fflush( stdout ); \
+			exit( 1 ); \
+		} \
+	} while( 0 )
+
+#define PRINT_DBLSEP_BEGIN(msg)   \
+	printf( "\n=========================== [begin] %s\n", ( msg ) )
+
+#define PRINT_DBLSEP_END(msg)   \
+	( printf( "=========================== [end] %s\n", ( msg ) ), fflush( stdout ) )
+
+#define print_init_time(msg,utc)   printf( "%s: %lld\n", ( msg ), (long long)( utc ) )
+
+static __inline void *must_calloc( 
+	const size_t num,   // in
+	const size_t size   // in
+)
+{
+	void *const mem = calloc( num, size );
+	
+	if( !mem )
+	{
+		MSG_FATAL( "calloc() failed." );
+		exit( 1 );
+	}
+	
+	return mem;
+}
+
+#endif // !_WIN32 && !_UTIL_H
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _PORTABLE_H
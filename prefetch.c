@@ -0,0 +1,468 @@
+/*
+Copyright (C) 2011 Jay Satiro <raysatiro@yahoo.com>
+All rights reserved.
+
+This file is part of GetHooks.
+
+GetHooks is free software: you can redistribute it and/or modify 
+it under the terms of the GNU General Public License as published by 
+the Free Software Foundation, either version 3 of the License, or 
+(at your option) any later version.
+
+GetHooks is distributed in the hope that it will be useful, 
+but WITHOUT ANY WARRANTY; without even the implied warranty of 
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License 
+along with GetHooks.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/** 
+This file contains functions for a prefetch store (query the system process info ahead of time).
+Each function is documented in the comment block above its definition.
+
+Each snapshot starts with a query of the system process info, which on a busy system can take tens 
+of milliseconds. In monitor mode the time each snapshot is due is known in advance, so the prefetch 
+store queries the info on a background thread shortly before then into a spare buffer. When the 
+snapshot is taken the spare buffer is swapped with the snapshot's and the snapshot traverses the 
+threads using TRAVERSE_FLAG_RECYCLE instead of querying. Prefetched info that is older than the 
+user-specified maximum age is never used.
+
+-
+create_prefetch_store()
+
+Create a prefetch store and its descendants or die.
+-
+
+-
+thread()
+
+The background thread's main function. Query the system process info when a prefetch is due.
+-
+
+-
+init_prefetch_store()
+
+Initialize a prefetch store and start its background thread.
+-
+
+-
+request_prefetch_store()
+
+Request a prefetch of the system process info for the next snapshot.
+-
+
+-
+claim_prefetch_store()
+
+Claim the prefetched system process info for a snapshot.
+-
+
+-
+print_prefetch_store()
+
+Print a prefetch store.
+-
+
+-
+free_prefetch_store()
+
+Stop the background thread and free a prefetch store and all its descendants.
+-
+
+*/
+
+#include <stdio.h>
+#include <process.h>
+
+#include "util.h"
+
+#include "nt_independent_sysprocinfo_structs.h"
+#include "traverse_threads.h"
+
+#include "prefetch.h"
+
+/* the global stores */
+#include "global.h"
+
+
+
+/* how many milliseconds ahead of the query duration a query is started, to allow for jitter */
+#define PREFETCH_LEAD_MARGIN   5
+
+/* the number of FILETIME intervals in a millisecond */
+#define PREFETCH_FILETIME_MS   10000
+
+
+
+static unsigned __stdcall thread( 
+	void *param   // in
+);
+
+
+
+/* create_prefetch_store() 
+Create a prefetch store and its descendants or die.
+
+The spare buffer isn't allocated until the store is initialized, since its size depends on the 
+snapshot stores.
+*/
+void create_prefetch_store( 
+	struct prefetch **const out   // out deref
+)
+{
+	struct prefetch *prefetch = NULL;
+	
+	FAIL_IF( !out );
+	FAIL_IF( *out );
+	
+	
+	/* allocate a prefetch store */
+	prefetch = must_calloc( 1, sizeof( *prefetch ) );
+	
+	prefetch->state = PREFETCH_IDLE;
+	
+	
+	*out = prefetch;
+	return;
+}
+
+
+
+/* thread() 
+The background thread's main function. Query the system process info when a prefetch is due.
+
+When a prefetch is requested this thread waits until the query's last duration plus a margin 
+before the next snapshot is due, then queries the info into the spare buffer and signals that it's 
+ready. If the main thread has given up on the prefetch by then (see claim_prefetch_store()) the 
+query is skipped. If another prefetch is requested while waiting then its due time is used instead.
+
+use _beginthreadex() to call this function.
+currently the return value doesn't matter as long as it's != STILL_ACTIVE (259)
+*/
+static unsigned __stdcall thread( 
+	void *param   // in
+)
+{
+	struct prefetch *const store = param;
+	HANDLE handles[ 2 ];
+	
+	FAIL_IF( !store );
+	
+	
+	handles[ 0 ] = store->terminate;
+	handles[ 1 ] = store->request;
+	
+	for( ;; )
+	{
+		DWORD ret = 0;
+		DWORD start = 0;
+		
+		
+		ret = WaitForMultipleObjects( 2, handles, FALSE, INFINITE );
+		
+		/* wait until shortly before the snapshot is due, or until the next request */
+		while( ret == ( WAIT_OBJECT_0 + 1 ) )
+		{
+			const DWORD lead = store->duration + PREFETCH_LEAD_MARGIN;
+			const DWORD elapsed = GetTickCount() - store->request_tick;
+			
+			
+			if( ( elapsed + lead ) >= store->request_ms )
+				break;
+			
+			ret = WaitForMultipleObjects( 2, handles, FALSE, ( store->request_ms - elapsed - lead ) );
+		}
+		
+		if( ret == WAIT_OBJECT_0 )
+			break;
+		
+		if( ( ret != ( WAIT_OBJECT_0 + 1 ) ) && ( ret != WAIT_TIMEOUT ) )
+		{
+			MSG_FATAL_GLE( "WaitForMultipleObjects() failed." );
+			exit( 1 );
+		}
+		
+		/* the main thread may have already taken the snapshot without waiting for this prefetch */
+		if( InterlockedCompareExchange( &store->state, PREFETCH_QUERYING, PREFETCH_WAITING )
+			!= PREFETCH_WAITING
+		)
+			continue;
+		
+		start = GetTickCount();
+		
+		/* no callback. the info is only written to the buffer. */
+		store->ret = traverse_threads( 
+			NULL, 
+			NULL, 
+			store->spi, 
+			store->spi_max_bytes, 
+			TRAVERSE_FLAG_EXTENDED, 
+			&store->nt_status
+		);
+		
+		GetSystemTimeAsFileTime( (FILETIME *)&store->time );
+		store->duration = GetTickCount() - start;
+		
+		InterlockedExchange( &store->state, PREFETCH_READY );
+		SetEvent( store->ready );
+	}
+	
+	return 0;
+}
+
+
+
+/* init_prefetch_store() 
+Initialize a prefetch store and start its background thread.
+
+'max_age' is the maximum age in milliseconds of prefetched info that can be used in a snapshot 
+'snapshot' is a snapshot store. The spare buffer is the same size as its spi buffer.
+
+returns nonzero on success
+*/
+int init_prefetch_store( 
+	struct prefetch *const store,   // in
+	const unsigned max_age,   // in
+	const struct snapshot *const snapshot   // in
+)
+{
+	FAIL_IF( !store );
+	FAIL_IF( store->init_time );   // Fail if this store has already been initialized.
+	
+	FAIL_IF( !snapshot );
+	FAIL_IF( !snapshot->spi );   // The snapshot store must not be hooks only.
+	
+	
+	if( ( max_age < PREFETCH_AGE_MIN ) || ( max_age > PREFETCH_AGE_MAX ) )
+	{
+		MSG_ERROR( "The prefetch maximum age is invalid." );
+		printf( "max_age: %u\n", max_age );
+		return FALSE;
+	}
+	
+	store->max_age = max_age;
+	
+	store->spi_max_bytes = snapshot->spi_max_bytes;
+	store->spi = must_calloc( store->spi_max_bytes, 1 );
+	
+	store->request = CreateEvent( NULL, 0, 0, NULL );
+	store->terminate = CreateEvent( NULL, 0, 0, NULL );
+	store->ready = CreateEvent( NULL, 0, 0, NULL );
+	
+	if( !store->request || !store->terminate || !store->ready )
+	{
+		MSG_ERROR_GLE( "CreateEvent() failed." );
+		return FALSE;
+	}
+	
+	store->thread = (HANDLE)_beginthreadex( NULL, 0, thread, store, 0, NULL );
+	if( !store->thread )
+	{
+		MSG_ERROR( _strerror( "_beginthreadex() failed" ) );
+		return FALSE;
+	}
+	
+	
+	/* the prefetch store has been initialized */
+	GetSystemTimeAsFileTime( (FILETIME *)&store->init_time );
+	return TRUE;
+}
+
+
+
+/* request_prefetch_store() 
+Request a prefetch of the system process info for the next snapshot.
+
+'milliseconds' is how long until the next snapshot is due
+
+If a prefetch is already in progress this function returns without having done anything.
+
+This function must only be called from the main thread.
+*/
+void request_prefetch_store( 
+	struct prefetch *const store,   // in
+	const DWORD milliseconds   // in
+)
+{
+	FAIL_IF( !store );
+	FAIL_IF( !store->init_time );   // The prefetch store must be initialized.
+	
+	FAIL_IF( GetCurrentThreadId() != G->prog->dwMainThreadId );   // main thread only
+	
+	
+	if( store->state != PREFETCH_IDLE )
+		return;
+	
+	store->request_tick = GetTickCount();
+	store->request_ms = milliseconds;
+	
+	InterlockedExchange( &store->state, PREFETCH_WAITING );
+	++store->request_total;
+	
+	SetEvent( store->request );
+	return;
+}
+
+
+
+/* claim_prefetch_store() 
+Claim the prefetched system process info for a snapshot.
+
+'snapshot' is the snapshot store that is being initialized
+
+If the prefetch's query hasn't started yet it's abandoned. If the query is in progress then this 
+function waits for it, since it will finish sooner than a new query would. If the query succeeded 
+and its info is no older than the maximum age then the spare buffer is swapped with the snapshot's 
+spi buffer and the snapshot's spi init time is set to the time of the query. The caller should 
+then call traverse_threads() using TRAVERSE_FLAG_RECYCLE and TRAVERSE_FLAG_EXTENDED.
+
+if 'store' is NULL or hasn't been initialized this function returns FALSE.
+
+This function must only be called from the main thread.
+
+returns nonzero if the snapshot's spi buffer now holds the prefetched info
+*/
+int claim_prefetch_store( 
+	struct prefetch *const store,   // in
+	struct snapshot *const snapshot   // in
+)
+{
+	LONG state = 0;
+	__int64 now = 0;
+	SYSTEM_PROCESS_INFORMATION *temp = NULL;
+	
+	FAIL_IF( !snapshot );
+	
+	
+	if( !store || !store->init_time )
+		return FALSE;
+	
+	FAIL_IF( GetCurrentThreadId() != G->prog->dwMainThreadId );   // main thread only
+	
+	FAIL_IF( snapshot->spi_max_bytes != store->spi_max_bytes );
+	
+	
+	state = InterlockedCompareExchange( &store->state, PREFETCH_IDLE, PREFETCH_WAITING );
+	
+	if( state == PREFETCH_IDLE )
+		return FALSE;
+	
+	if( state == PREFETCH_WAITING )
+	{
+		++store->early_total;
+		return FALSE;
+	}
+	
+	/* the query is in progress or has finished */
+	if( WaitForSingleObject( store->ready, INFINITE ) != WAIT_OBJECT_0 )
+	{
+		MSG_FATAL_GLE( "WaitForSingleObject() failed." );
+		exit( 1 );
+	}
+	
+	InterlockedExchange( &store->state, PREFETCH_IDLE );
+	
+	if( store->ret != TRAVERSE_SUCCESS )
+	{
+		++store->failed_total;
+		return FALSE;
+	}
+	
+	GetSystemTimeAsFileTime( (FILETIME *)&now );
+	
+	if( ( now - store->time ) > ( (__int64)store->max_age * PREFETCH_FILETIME_MS ) )
+	{
+		++store->stale_total;
+		return FALSE;
+	}
+	
+	temp = snapshot->spi;
+	snapshot->spi = store->spi;
+	store->spi = temp;
+	
+	snapshot->spi_extended = TRUE;
+	snapshot->init_time_spi = store->time;
+	
+	++store->used_total;
+	return TRUE;
+}
+
+
+
+/* print_prefetch_store() 
+Print a prefetch store.
+
+if 'store' is NULL this function returns without having printed anything.
+*/
+void print_prefetch_store( 
+	const struct prefetch *const store   // in
+)
+{
+	const char *const objname = "Prefetch Store";
+	
+	
+	if( !store )
+		return;
+	
+	PRINT_DBLSEP_BEGIN( objname );
+	print_init_time( "store->init_time", store->init_time );
+	
+	printf( "store->spi: %p\n", store->spi );
+	printf( "store->spi_max_bytes: %Iu\n", store->spi_max_bytes );
+	printf( "store->state: %ld\n", store->state );
+	printf( "store->max_age: %u\n", store->max_age );
+	printf( "store->duration: %lu\n", store->duration );
+	print_init_time( "store->time", store->time );
+	printf( "store->request_total: %I64u\n", store->request_total );
+	printf( "store->used_total: %I64u\n", store->used_total );
+	printf( "store->early_total: %I64u\n", store->early_total );
+	printf( "store->stale_total: %I64u\n", store->stale_total );
+	printf( "store->failed_total: %I64u\n", store->failed_total );
+	
+	PRINT_DBLSEP_END( objname );
+	
+	return;
+}
+
+
+
+/* free_prefetch_store() 
+Stop the background thread and free a prefetch store and all its descendants.
+
+this function then sets the prefetch store pointer to NULL and returns
+
+'in' is a pointer to a pointer to the prefetch store.
+if( !in || !*in ) then this function returns.
+*/
+void free_prefetch_store( 
+	struct prefetch **const in   // in deref
+)
+{
+	if( !in || !*in )
+		return;
+	
+	if( (*in)->thread )
+	{
+		SetEvent( (*in)->terminate );
+		WaitForSingleObject( (*in)->thread, INFINITE );
+		CloseHandle( (*in)->thread );
+	}
+	
+	if( (*in)->request )
+		CloseHandle( (*in)->request );
+	
+	if( (*in)->terminate )
+		CloseHandle( (*in)->terminate );
+	
+	if( (*in)->ready )
+		CloseHandle( (*in)->ready );
+	
+	free( (*in)->spi );
+	
+	free( (*in) );
+	*in = NULL;
+	
+	return;
+}
@@ -0,0 +1,147 @@
+/*
+Copyright (C) 2011 Jay Satiro <raysatiro@yahoo.com>
+All rights reserved.
+
+This file is part of GetHooks.
+
+GetHooks is free software: you can redistribute it and/or modify 
+it under the terms of the GNU General Public License as published by 
+the Free Software Foundation, either version 3 of the License, or 
+(at your option) any later version.
+
+GetHooks is distributed in the hope that it will be useful, 
+but WITHOUT ANY WARRANTY; without even the implied warranty of 
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License 
+along with GetHooks.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _PREFETCH_H
+#define _PREFETCH_H
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include "portable.h"
+#endif
+
+/* snapshot store (system process info, gui threads, desktop hooks) */
+#include "snapshot.h"
+
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/* the states of a prefetch. see claim_prefetch_store() */
+#define PREFETCH_IDLE   0
+#define PREFETCH_WAITING   1
+#define PREFETCH_QUERYING   2
+#define PREFETCH_READY   3
+
+
+/** The prefetch store.
+The prefetch store queries the system process info on a background thread shortly before each 
+snapshot is due, so that the snapshot doesn't have to wait for the query.
+*/
+struct prefetch
+{
+	/* a spare buffer that receives the system process info, the same size as a snapshot's spi 
+	buffer. when a prefetch is claimed this buffer is swapped with the snapshot's.
+	the info is always queried using SystemExtendedProcessInformation (TRAVERSE_FLAG_EXTENDED).
+	*/
+	SYSTEM_PROCESS_INFORMATION *spi;   // calloc(), free()
+	
+	/* the allocated size of the buffer in bytes */
+	size_t spi_max_bytes;
+	
+	/* the background thread, and the events it waits on */
+	HANDLE thread;   // _beginthreadex(), CloseHandle()
+	HANDLE request;   // CreateEvent(), CloseHandle()
+	HANDLE terminate;   // CreateEvent(), CloseHandle()
+	
+	/* signaled by the background thread when a query has finished */
+	HANDLE ready;   // CreateEvent(), CloseHandle()
+	
+	/* the state of the current prefetch, eg PREFETCH_WAITING.
+	it's changed by both threads using interlocked functions.
+	*/
+	volatile LONG state;
+	
+	/* the tick count when the current prefetch was requested, and how many milliseconds after 
+	that the next snapshot is due. written by the main thread before signaling 'request'.
+	*/
+	DWORD request_tick;
+	DWORD request_ms;
+	
+	/* the result of the last query. written by the background thread before signaling 'ready'.
+	'time' is the system utc time in FILETIME format immediately after the query.
+	'duration' is how many milliseconds the query took, which is how far ahead of the next 
+	snapshot the next query is started.
+	*/
+	int ret;
+	LONG nt_status;
+	__int64 time;
+	DWORD duration;
+	
+	/* the maximum age in milliseconds of prefetched info that can be used in a snapshot */
+	#define PREFETCH_AGE_MIN   1
+	#define PREFETCH_AGE_MAX   60000
+	unsigned max_age;
+	
+	/* the number of prefetches requested and how many were used, too early, stale or failed */
+	unsigned __int64 request_total;
+	unsigned __int64 used_total;
+	unsigned __int64 early_total;
+	unsigned __int64 stale_total;
+	unsigned __int64 failed_total;
+	
+	/* the system utc time in FILETIME format immediately after this store has been initialized.
+	this is nonzero when this store has been initialized.
+	*/
+	__int64 init_time;
+};
+
+
+
+/** 
+these functions are documented in the comment block above their definitions in prefetch.c
+*/
+void create_prefetch_store( 
+	struct prefetch **const out   // out deref
+);
+
+int init_prefetch_store( 
+	struct prefetch *const store,   // in
+	const unsigned max_age,   // in
+	const struct snapshot *const snapshot   // in
+);
+
+void request_prefetch_store( 
+	struct prefetch *const store,   // in
+	const DWORD milliseconds   // in
+);
+
+int claim_prefetch_store( 
+	struct prefetch *const store,   // in
+	struct snapshot *const snapshot   // in
+);
+
+void print_prefetch_store( 
+	const struct prefetch *const store   // in
+);
+
+void free_prefetch_store( 
+	struct prefetch **const in   // in deref
+);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _PREFETCH_H
@@ -110,6 +110,8 @@ void create_prog_store(
 
 
 
+/* The USER objects are only read on Windows. */
+#ifdef _WIN32
 /* get_SharedInfo()
 Return the address of Microsoft's SHAREDINFO structure (aka gSharedInfo) or die.
 
@@ -174,6 +176,7 @@ SHAREDINFO *get_SharedInfo( void )
 	
 	return (SHAREDINFO *)SharedInfo;
 }
+#endif // _WIN32
 
 
 
@@ -188,22 +191,26 @@ void init_global_prog_store(
 	char **argv   // in deref
 )
 {
+#ifdef _WIN32
 	unsigned offsetof_cHandleEntries = 0;
+#endif
 	
 	FAIL_IF( !G );   // The global store must exist.
 	
 	FAIL_IF( G->prog->init_time );   // Fail if this store has already been initialized.
 	
 	
+#ifdef _WIN32
 	/* get_SharedInfo() or die.
 	This function loads user32.dll and must be called before any other pointer to GUI related info 
 	is initialized.
 	*/
 	G->prog->pSharedInfo = get_SharedInfo();
+#endif
 	
 	
 	G->prog->argc = argc;
-	G->prog->argv = argv;
+	G->prog->argv = (const char *const *)argv;
 	
 	/* point pszBasename to this program's basename */
 	if( argc && argv[ 0 ][ 0 ] )
@@ -223,6 +230,8 @@ void init_global_prog_store(
 	/* main thread id */
 	G->prog->dwMainThreadId = GetCurrentThreadId();
 	
+	/* The rest of the program store is only needed to read the USER objects on Windows. */
+#ifdef _WIN32
 	/* operating system version and platform */
 	G->prog->dwOSVersion = GetVersion();
 	G->prog->dwOSMajorVersion = (BYTE)G->prog->dwOSVersion;
@@ -252,6 +261,7 @@ void init_global_prog_store(
 	*/
 	G->prog->pcHandleEntries = 
 		(volatile DWORD *)( (char *)G->prog->pSharedInfo->psi + offsetof_cHandleEntries );
+#endif // _WIN32
 	
 	
 	/* G->prog has been initialized */
@@ -261,6 +271,7 @@ void init_global_prog_store(
 
 
 
+#ifdef _WIN32
 /* print_SharedInfo()
 Print some pointers from the SHAREDINFO struct.
 
@@ -287,6 +298,7 @@ void print_SharedInfo(
 	
 	return;
 }
+#endif // _WIN32
 
 
 
@@ -318,10 +330,12 @@ static void print_prog_store(
 	printf( "store->dwOSMajorVersion: %lu\n", store->dwOSMajorVersion );
 	printf( "store->dwOSMinorVersion: %lu\n", store->dwOSMinorVersion );
 	printf( "store->dwOSBuild: %lu\n", store->dwOSBuild );
+#ifdef _WIN32
 	printf( "store->pwszWinstaName: %ls\n", store->pwszWinstaName );
 	print_SharedInfo( store->pSharedInfo );
 	printf( "\n" );
 	printf( "*store->pcHandleEntries: %lu\n", *store->pcHandleEntries );
+#endif
 	
 	PRINT_DBLSEP_END( objname );
 	
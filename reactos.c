@@ -64,12 +64,6 @@ print_HOOK_flags()
 Print user-readable names of a HOOK's flags. No newline.
 -
 
--
-print_HOOK_anomalies()
-
-Print any anomalies found in a HOOK struct.
--
-
 -
 print_HOOK()
 
@@ -319,44 +313,6 @@ void print_HOOK_flags(
 
 
 
-/* print_HOOK_anomalies()
-Print any anomalies found in a HOOK struct.
-
-if 'object' is NULL this function returns without having printed anything.
-*/
-void print_HOOK_anomalies(
-	const HOOK *const object   // in
-)
-{
-	if( !object )
-		return;
-	
-	if( !( object->flags & HF_GLOBAL )
-		&& ( ( object->iHook == WH_JOURNALPLAYBACK )
-			|| ( object->iHook == WH_JOURNALRECORD )
-			|| ( object->iHook == WH_KEYBOARD_LL )
-			|| ( object->iHook == WH_MOUSE_LL )
-			|| ( object->iHook == WH_SYSMSGFILTER )
-		)
-	)
-	{
-		printf( "ERROR: The HOOK @ " );
-		PRINT_HEX_BARE( object->pSelf );
-		printf( " is supposed to be global-only but is missing the HF_GLOBAL flag!\n" );
-	}
-	
-	if( ( object->flags & HF_GLOBAL ) && object->ptiHooked )
-	{
-		printf( "ERROR: The global HOOK @ " );
-		PRINT_HEX_BARE( object->pSelf );
-		printf( " has a target address even though global HOOKs aren't supposed to have them.\n" );
-	}
-	
-	return;
-}
-
-
-
 /* print_HOOK()
 Print a HOOK struct.
 
@@ -418,7 +374,7 @@ if success then '*name' has received a pointer to the HOOK name. free() when don
 if fail then '*name' has received NULL.
 */
 int get_HOOK_name_from_id( 
-	const WCHAR **const name,   // out deref
+	WCHAR **const name,   // out deref
 	const int id   // in
 )
 {
@@ -27,7 +27,11 @@ minor modifications to names or types (eg changing to void* to avoid dependency)
 #ifndef _REACTOS_H
 #define _REACTOS_H
 
+#ifdef _WIN32
 #include <windows.h>
+#else
+#include "portable.h"
+#endif
 
 
 
@@ -224,16 +228,12 @@ void print_HOOK_flags(
 	const DWORD flags   // in
 );
 
-void print_HOOK_anomalies(
-	const HOOK *const object   // in
-);
-
 void print_HOOK(
 	const HOOK *const object   // in
 );
 
 int get_HOOK_name_from_id( 
-	const WCHAR **const name,   // out deref
+	WCHAR **const name,   // out deref
 	const int id   // in
 );
 
@@ -0,0 +1,750 @@
+/*
+Copyright (C) 2011 Jay Satiro <raysatiro@yahoo.com>
+All rights reserved.
+
+This file is part of GetHooks.
+
+GetHooks is free software: you can redistribute it and/or modify 
+it under the terms of the GNU General Public License as published by 
+the Free Software Foundation, either version 3 of the License, or 
+(at your option) any later version.
+
+GetHooks is distributed in the hope that it will be useful, 
+but WITHOUT ANY WARRANTY; without even the implied warranty of 
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License 
+along with GetHooks.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/** 
+This file contains functions for a reload store (configuration file reloaded at runtime).
+Each function is documented in the comment block above its definition.
+
+Changing a filter or the polling interval used to mean restarting the program, which attaches to 
+every desktop again and loses everything tracked between snapshots. The reload store watches a 
+configuration file that holds the options that can be changed at runtime. When the file changes 
+it's read into a new configuration store and validated. Only if it's valid does the new store 
+replace the global configuration store, and that's done on the main thread between snapshots so 
+nothing is using the old store. Only the state derived from the configuration is rebuilt. The 
+desktops, snapshots and tracked threads are kept, and whether each hook in the snapshots is wanted 
+is decided again.
+
+The configuration file has one option per line, written the same as on the command line. Blank 
+lines are ignored and a comment begins with '#'. These options can be in the file:
+m <sec>, v [level], i|x <hook> [...], p|r <prog> [...], e, u, g, f, c 
+A hook or program list in the file replaces the one from the command line, and the ignore flags 
+are added to those from the command line. An option that's removed from the file reverts to what 
+was specified on the command line.
+
+-
+create_reload_store()
+
+Create a reload store and its descendants or die.
+-
+
+-
+init_reload_store()
+
+Initialize a reload store by reading the configuration file for the first time.
+-
+
+-
+add_config_list_arg()
+
+Add an option argument from the configuration file to a hook or program list.
+-
+
+-
+read_config_file()
+
+Read the options in a configuration file into a configuration store.
+-
+
+-
+update_wanted_hooks()
+
+Decide again whether each hook in a snapshot is wanted, after the configuration was replaced.
+-
+
+-
+check_reload_store()
+
+Check if the configuration file has changed and if so reload it.
+-
+
+-
+print_reload_store()
+
+Print a reload store.
+-
+
+-
+free_reload_store()
+
+Free a reload store and all its descendants.
+-
+
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "util.h"
+
+#include "diff.h"
+
+#include "hookscan.h"
+
+#include "reload.h"
+
+/* the global stores */
+#include "global.h"
+
+
+
+/* the characters that separate an option and its arguments in the configuration file */
+#define RELOAD_DELIMITERS   " \t"
+
+
+
+static int add_config_list_arg( 
+	struct list *const list,   // in
+	const char *const arg   // in
+);
+
+static int read_config_file( 
+	struct config *const config,   // in
+	const WCHAR *const file   // in
+);
+
+static unsigned update_wanted_hooks( 
+	struct snapshot *const snapshot,   // in, optional
+	const int print   // in
+);
+
+
+
+/* create_reload_store() 
+Create a reload store and its descendants or die.
+*/
+void create_reload_store( 
+	struct reload **const out   // out deref
+)
+{
+	struct reload *store = NULL;
+	
+	FAIL_IF( !out );
+	FAIL_IF( *out );
+	
+	
+	/* allocate a reload store */
+	store = must_calloc( 1, sizeof( *store ) );
+	
+	
+	*out = store;
+	return;
+}
+
+
+
+/* init_reload_store() 
+Initialize a reload store by reading the configuration file for the first time.
+
+'file' is the name of the configuration file
+
+The global configuration store is copied before the file is read, and the copy is what each later 
+read of the file starts from. If the file is valid the options in it replace the global 
+configuration store's, so this function must be called before anything depends on those options.
+
+returns nonzero on success
+*/
+int init_reload_store( 
+	struct reload *const store,   // in
+	const WCHAR *const file   // in
+)
+{
+	FAIL_IF( !store );
+	FAIL_IF( !file );
+	
+	FAIL_IF( store->init_time );   // Fail if this store has already been initialized.
+	
+	FAIL_IF( !G->config->init_time );   // The configuration store must be initialized.
+	
+	FAIL_IF( GetCurrentThreadId() != G->prog->dwMainThreadId );   // main thread only
+	
+	
+	store->pwszFile = must_wcsdup( file );
+	
+	duplicate_config_store( &store->base, G->config );
+	
+	if( GetFileAttributesW( store->pwszFile ) == INVALID_FILE_ATTRIBUTES )
+	{
+		MSG_ERROR( "The configuration file can't be found." );
+		printf( "file: %ls\n", store->pwszFile );
+		return FALSE;
+	}
+	
+	if( !check_reload_store( store, NULL, NULL ) )
+	{
+		MSG_ERROR( "The configuration file could not be read." );
+		printf( "file: %ls\n", store->pwszFile );
+		return FALSE;
+	}
+	
+	
+	/* the reload store has been initialized */
+	GetSystemTimeAsFileTime( (FILETIME *)&store->init_time );
+	return TRUE;
+}
+
+
+
+/* add_config_list_arg() 
+Add an option argument from the configuration file to a hook or program list.
+
+'list' is the hook or program list. its type must already be set.
+'arg' is the option argument, which is parsed the same as on the command line.
+
+returns nonzero on success
+*/
+static int add_config_list_arg( 
+	struct list *const list,   // in
+	const char *const arg   // in
+)
+{
+	__int64 id = 0;
+	WCHAR *name = NULL;
+	const char *p = arg;
+	int ret = FALSE;
+	
+	FAIL_IF( !list );
+	FAIL_IF( !arg );
+	
+	
+	if( ( list->type == LIST_INCLUDE_HOOK ) || ( list->type == LIST_EXCLUDE_HOOK ) )
+	{
+		/* if the string is not an integer then it's a hook name not an id */
+		if( !str_to_int64( &id, arg ) )
+		{
+			id = 0;
+			
+			if( !get_wstr_from_mbstr( &name, arg ) )
+			{
+				MSG_ERROR( "get_wstr_from_mbstr() failed." );
+				printf( "hook: %s\n", arg );
+				return FALSE;
+			}
+			
+			_wcsupr( name ); /* convert hook name to uppercase */
+		}
+	}
+	else
+	{
+		/* a colon is used as the escape character for a program name. see config.c */
+		if( *p == ':' )
+			++p;
+		
+		if( ( p != arg ) || ( str_to_int64( &id, arg ) != NUM_POS ) )
+		{
+			id = 0;
+			
+			if( !get_wstr_from_mbstr( &name, p ) )
+			{
+				MSG_ERROR( "get_wstr_from_mbstr() failed." );
+				printf( "prog: %s\n", arg );
+				return FALSE;
+			}
+		}
+	}
+	
+	ret = !!add_list_item( list, id, name );
+	
+	free( name );
+	return ret;
+}
+
+
+
+/* read_config_file() 
+Read the options in a configuration file into a configuration store.
+
+'config' is the configuration store, which should be a duplicate of the reload store's base.
+'file' is the name of the configuration file
+
+The format of the file is described at the top of this file. An option that isn't allowed in the 
+file or is invalid is an error, and the file is read no further.
+
+returns nonzero if every option in the file is valid
+*/
+static int read_config_file( 
+	struct config *const config,   // in
+	const WCHAR *const file   // in
+)
+{
+	FILE *fp = NULL;
+	char line[ MAX_PATH * 4 ];
+	unsigned line_num = 0;
+	
+	/* nonzero if the hook/program list from the command line was replaced by one in the file */
+	unsigned hooklist_read = FALSE;
+	unsigned proglist_read = FALSE;
+	
+	int ret = FALSE;
+	
+	FAIL_IF( !config );
+	FAIL_IF( !file );
+	
+	
+	fp = _wfopen( file, L"r" );
+	if( !fp )
+	{
+		MSG_ERROR( "_wfopen() failed to open the configuration file." );
+		printf( "file: %ls\n", file );
+		return FALSE;
+	}
+	
+	while( fgets( line, sizeof( line ), fp ) )
+	{
+		char *opt = NULL;
+		char *arg = NULL;
+		
+		
+		++line_num;
+		
+		/* a comment begins with '#' */
+		line[ strcspn( line, "#\r\n" ) ] = '\0';
+		
+		opt = strtok( line, RELOAD_DELIMITERS );
+		if( !opt )
+			continue;
+		
+		/* the option may be written as on the command line, eg -u or /u */
+		if( ( opt[ 0 ] == '-' ) || ( opt[ 0 ] == '/' ) )
+			++opt;
+		
+		if( !opt[ 0 ] || opt[ 1 ] )
+		{
+			MSG_ERROR( "Configuration file: an option must be a single letter." );
+			printf( "line %u: %s\n", line_num, opt );
+			goto cleanup;
+		}
+		
+		switch( opt[ 0 ] )
+		{
+			/** 
+			monitor option. only the interval can be changed.
+			*/
+			case 'm':
+			case 'M':
+			{
+				if( config->polling < POLLING_MIN )
+				{
+					MSG_ERROR( "Configuration file: option 'm' must be specified on the command line." );
+					printf( "line %u\n", line_num );
+					goto cleanup;
+				}
+				
+				arg = strtok( NULL, RELOAD_DELIMITERS );
+				
+				if( !arg 
+					|| ( str_to_int( &config->polling, arg ) != NUM_POS ) 
+					|| ( config->polling > POLLING_MAX )
+				)
+				{
+					MSG_ERROR( "Configuration file: option 'm': the interval is invalid." );
+					printf( "line %u: sec: %s\n", line_num, ( arg ? arg : "<none>" ) );
+					printf( "POLLING_MIN: %d, POLLING_MAX: %d\n", POLLING_MIN, POLLING_MAX );
+					goto cleanup;
+				}
+				
+				break;
+			}
+			
+			
+			
+			/** 
+			verbosity option
+			*/
+			case 'v':
+			case 'V':
+			{
+				arg = strtok( NULL, RELOAD_DELIMITERS );
+				
+				if( !arg )
+				{
+					config->verbose = VERBOSE_ENABLED_DEFAULT;
+				}
+				else if( !str_to_int( &config->verbose, arg ) 
+					|| ( config->verbose < VERBOSE_MIN ) 
+					|| ( config->verbose > VERBOSE_MAX )
+				)
+				{
+					MSG_ERROR( "Configuration file: option 'v': the verbosity level is invalid." );
+					printf( "line %u: level: %s\n", line_num, arg );
+					printf( "VERBOSE_MIN: %d, VERBOSE_MAX: %d\n", VERBOSE_MIN, VERBOSE_MAX );
+					goto cleanup;
+				}
+				
+				break;
+			}
+			
+			
+			
+			/** 
+			hook and program include/exclude options.
+			the first of these options in the file replaces the command line's list.
+			*/
+			case 'i':
+			case 'I':
+			case 'x':
+			case 'X':
+			case 'p':
+			case 'P':
+			case 'r':
+			case 'R':
+			{
+				struct list **list = NULL;
+				unsigned *list_read = NULL;
+				enum list_type type = LIST_INVALID_TYPE;
+				
+				
+				if( ( opt[ 0 ] == 'i' ) || ( opt[ 0 ] == 'I' ) )
+					type = LIST_INCLUDE_HOOK;
+				else if( ( opt[ 0 ] == 'x' ) || ( opt[ 0 ] == 'X' ) )
+					type = LIST_EXCLUDE_HOOK;
+				else if( ( opt[ 0 ] == 'p' ) || ( opt[ 0 ] == 'P' ) )
+					type = LIST_INCLUDE_PROG;
+				else
+					type = LIST_EXCLUDE_PROG;
+				
+				if( ( type == LIST_INCLUDE_HOOK ) || ( type == LIST_EXCLUDE_HOOK ) )
+				{
+					list = &config->hooklist;
+					list_read = &hooklist_read;
+				}
+				else
+				{
+					list = &config->proglist;
+					list_read = &proglist_read;
+				}
+				
+				if( !*list_read )
+				{
+					free_list_store( list );
+					create_list_store( list );
+					(*list)->type = type;
+					*list_read = TRUE;
+				}
+				else if( (*list)->type != type )
+				{
+					MSG_ERROR( "Configuration file: options 'i' and 'x', or 'p' and 'r', are "
+						"mutually exclusive."
+					);
+					printf( "line %u: %c\n", line_num, opt[ 0 ] );
+					goto cleanup;
+				}
+				
+				/* the option requires at least one argument */
+				arg = strtok( NULL, RELOAD_DELIMITERS );
+				if( !arg )
+				{
+					MSG_ERROR( "Configuration file: the option has no associated argument." );
+					printf( "line %u: %c\n", line_num, opt[ 0 ] );
+					goto cleanup;
+				}
+				
+				for( ; arg; arg = strtok( NULL, RELOAD_DELIMITERS ) )
+				{
+					if( !add_config_list_arg( *list, arg ) )
+					{
+						MSG_ERROR( "Configuration file: the option argument is invalid." );
+						printf( "line %u: %c %s\n", line_num, opt[ 0 ], arg );
+						goto cleanup;
+					}
+				}
+				
+				GetSystemTimeAsFileTime( (FILETIME *)&(*list)->init_time );
+				break;
+			}
+			
+			
+			
+			/** 
+			ignore flags
+			*/
+			case 'e':
+			case 'E':
+			{
+				config->flags |= CFG_IGNORE_INTERNAL_HOOKS;
+				break;
+			}
+			case 'u':
+			case 'U':
+			{
+				config->flags |= CFG_IGNORE_KNOWN_HOOKS;
+				break;
+			}
+			case 'g':
+			case 'G':
+			{
+				config->flags |= CFG_IGNORE_TARGETED_HOOKS;
+				break;
+			}
+			case 'f':
+			case 'F':
+			{
+				config->flags |= CFG_IGNORE_FAILED_QUERIES;
+				break;
+			}
+			case 'c':
+			case 'C':
+			{
+				config->flags |= CFG_IGNORE_LOCK_COUNTS;
+				break;
+			}
+			
+			
+			
+			default:
+			{
+				MSG_ERROR( "Configuration file: the option is unknown or can't be changed at runtime." );
+				printf( "line %u: %c\n", line_num, opt[ 0 ] );
+				goto cleanup;
+			}
+		}
+		
+		/* an option's arguments have been read. anything else on the line is an error */
+		arg = strtok( NULL, RELOAD_DELIMITERS );
+		if( arg )
+		{
+			MSG_ERROR( "Configuration file: the option has too many arguments." );
+			printf( "line %u: %c ... %s\n", line_num, opt[ 0 ], arg );
+			goto cleanup;
+		}
+	}
+	
+	if( ferror( fp ) )
+	{
+		MSG_ERROR( "fgets() failed to read the configuration file." );
+		printf( "file: %ls\n", file );
+		goto cleanup;
+	}
+	
+	ret = TRUE;
+
+cleanup:
+	fclose( fp );
+	return ret;
+}
+
+
+
+/* update_wanted_hooks() 
+Decide again whether each hook in a snapshot is wanted, after the configuration was replaced.
+
+The hooks in a snapshot were filtered by the configuration when the snapshot was taken. A hook that 
+exists in two snapshots is only printed again if it changed, so a hook that was unwanted and is now 
+wanted would never be printed. If 'print' is nonzero each of those hooks is printed as found.
+
+if 'snapshot' is NULL or hasn't been initialized then this function returns 0.
+
+returns the number of hooks that were unwanted and are now wanted
+*/
+static unsigned update_wanted_hooks( 
+	struct snapshot *const snapshot,   // in, optional
+	const int print   // in
+)
+{
+	unsigned wanted = 0, d = 0;
+	
+	
+	if( !snapshot || !snapshot->init_time )
+		return 0;
+	
+	for( d = 0; d < snapshot->desktop_hooks->count; ++d )
+	{
+		struct desktop_hook_item *const item = &snapshot->desktop_hooks->item[ d ];
+		unsigned i = 0;
+		
+		
+		for( i = 0; i < item->hook_count; ++i )
+		{
+			struct hook *const hook = &item->hook[ i ];
+			const int ignore = !is_hook_wanted( hook );
+			
+			
+			if( hook->ignore && !ignore )
+			{
+				++wanted;
+				
+				if( print )
+				{
+					const WCHAR *const deskname = item->desktop->pwszDesktopName;
+					
+					
+					print_hook_notice_begin( hook, deskname, HOOK_FOUND, snapshot->init_time );
+					print_hook_notice_end();
+					add_hook_event( hook, deskname, HOOK_FOUND, snapshot->init_time );
+				}
+			}
+			
+			hook->ignore = ignore;
+		}
+	}
+	
+	return wanted;
+}
+
+
+
+/* check_reload_store() 
+Check if the configuration file has changed and if so reload it.
+
+This function must only be called from the main thread between snapshots, since the global 
+configuration store may be replaced. A pointer to the old store must not be kept across this call.
+
+If the file has changed since it was last read it's read into a duplicate of the base 
+configuration store. If every option in the file is valid the duplicate replaces the global 
+configuration store and the state derived from the configuration is rebuilt. Otherwise the 
+configuration is unchanged. The file is not read again until it changes again.
+
+'previous' and 'current' are the snapshots that are kept across the reload. Whether each of their 
+hooks is wanted is decided again, and the hooks in 'current' that are now wanted are printed.
+
+returns nonzero if the global configuration store was replaced
+*/
+int check_reload_store( 
+	struct reload *const store,   // in
+	struct snapshot *const previous,   // in, optional
+	struct snapshot *const current   // in, optional
+)
+{
+	WIN32_FILE_ATTRIBUTE_DATA fad;
+	__int64 last_write = 0;
+	struct config *config = NULL;
+	
+	FAIL_IF( !store );
+	FAIL_IF( !store->pwszFile );
+	FAIL_IF( !store->base );
+	
+	FAIL_IF( GetCurrentThreadId() != G->prog->dwMainThreadId );   // main thread only
+	
+	
+	/* the file may be missing for a moment while it's being saved. try again next time */
+	ZeroMemory( &fad, sizeof( fad ) );
+	if( !GetFileAttributesExW( store->pwszFile, GetFileExInfoStandard, &fad ) )
+		return FALSE;
+	
+	last_write = (__int64)( ( (unsigned __int64)fad.ftLastWriteTime.dwHighDateTime << 32 )
+		| fad.ftLastWriteTime.dwLowDateTime
+	);
+	
+	if( store->last_write == last_write )
+		return FALSE;
+	
+	store->last_write = last_write;
+	++store->reload_total;
+	
+	duplicate_config_store( &config, store->base );
+	
+	if( !read_config_file( config, store->pwszFile ) )
+	{
+		++store->reload_failed;
+		
+		MSG_WARNING( "The configuration file is invalid. The configuration is unchanged." );
+		printf( "file: %ls\n", store->pwszFile );
+		
+		free_config_store( &config );
+		return FALSE;
+	}
+	
+	/* swap in the new configuration store and free the old one */
+	{
+		struct config *old = G->config;
+		
+		G->config = config;
+		free_config_store( &old );
+	}
+	
+	/* rebuild only the state derived from the configuration */
+	if( G->hookscan->init_time )
+		reconfigure_hookscan_store( G->hookscan );
+	
+	GetSystemTimeAsFileTime( (FILETIME *)&store->reload_time );
+	
+	if( store->init_time )
+	{
+		printf( "\nThe configuration was reloaded from '%ls'.\n", store->pwszFile );
+		
+		if( G->config->verbose >= 5 )
+			print_global_config_store();
+		
+		fflush( stdout );
+	}
+	
+	/* the previous snapshot is only compared to the current one, so its hooks aren't printed */
+	update_wanted_hooks( previous, FALSE );
+	update_wanted_hooks( current, TRUE );
+	fflush( stdout );
+	
+	return TRUE;
+}
+
+
+
+/* print_reload_store() 
+Print a reload store.
+
+if 'store' is NULL this function returns without having printed anything.
+*/
+void print_reload_store( 
+	const struct reload *const store   // in
+)
+{
+	const char *const objname = "Reload Store";
+	
+	
+	if( !store )
+		return;
+	
+	PRINT_DBLSEP_BEGIN( objname );
+	print_init_time( "store->init_time", store->init_time );
+	
+	printf( "store->pwszFile: %ls\n", ( store->pwszFile ? store->pwszFile : L"<none>" ) );
+	print_init_time( "store->last_write", store->last_write );
+	print_init_time( "store->reload_time", store->reload_time );
+	printf( "store->reload_total: %u\n", store->reload_total );
+	printf( "store->reload_failed: %u\n", store->reload_failed );
+	
+	PRINT_DBLSEP_END( objname );
+	
+	return;
+}
+
+
+
+/* free_reload_store() 
+Free a reload store and all its descendants.
+
+this function then sets the reload store pointer to NULL and returns
+
+'in' is a pointer to a pointer to the reload store.
+if( !in || !*in ) then this function returns.
+*/
+void free_reload_store( 
+	struct reload **const in   // in deref
+)
+{
+	if( !in || !*in )
+		return;
+	
+	free( (*in)->pwszFile );
+	free_config_store( &(*in)->base );
+	
+	free( (*in) );
+	*in = NULL;
+	
+	return;
+}
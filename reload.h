@@ -0,0 +1,110 @@
+/*
+Copyright (C) 2011 Jay Satiro <raysatiro@yahoo.com>
+All rights reserved.
+
+This file is part of GetHooks.
+
+GetHooks is free software: you can redistribute it and/or modify 
+it under the terms of the GNU General Public License as published by 
+the Free Software Foundation, either version 3 of the License, or 
+(at your option) any later version.
+
+GetHooks is distributed in the hope that it will be useful, 
+but WITHOUT ANY WARRANTY; without even the implied warranty of 
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License 
+along with GetHooks.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _RELOAD_H
+#define _RELOAD_H
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include "portable.h"
+#endif
+
+/* configuration store (user-specified command line configuration) */
+#include "config.h"
+
+/* snapshot store (system process info, gui threads, desktop hooks) */
+#include "snapshot.h"
+
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/** The reload store.
+The reload store watches the configuration file specified by '--config'. The file holds options 
+that can be changed at runtime. When the file changes it's read into a new configuration store, 
+which if valid replaces the global configuration store between snapshots.
+*/
+struct reload
+{
+	/* the name of the configuration file that is watched */
+	WCHAR *pwszFile;   // must_wcsdup(), free()
+	
+	/* a copy of the configuration store from the command line. each time the file is read it's 
+	read into a duplicate of this store, so an option that's removed from the file reverts to 
+	what was specified on the command line.
+	*/
+	struct config *base;   // duplicate_config_store(), free_config_store()
+	
+	/* the last write time of the configuration file in FILETIME format when it was last read */
+	__int64 last_write;
+	
+	/* the number of times the file was read, and how many of those times it was invalid and the 
+	configuration was kept
+	*/
+	unsigned reload_total;
+	unsigned reload_failed;
+	
+	/* the system utc time in FILETIME format of the last time the configuration was replaced */
+	__int64 reload_time;
+	
+	/* the system utc time in FILETIME format immediately after this store has been initialized.
+	this is nonzero when this store has been initialized.
+	*/
+	__int64 init_time;
+};
+
+
+
+/** 
+these functions are documented in the comment block above their definitions in reload.c
+*/
+void create_reload_store( 
+	struct reload **const out   // out deref
+);
+
+int init_reload_store( 
+	struct reload *const store,   // in
+	const WCHAR *const file   // in
+);
+
+int check_reload_store( 
+	struct reload *const store,   // in
+	struct snapshot *const previous,   // in, optional
+	struct snapshot *const current   // in, optional
+);
+
+void print_reload_store( 
+	const struct reload *const store   // in
+);
+
+void free_reload_store( 
+	struct reload **const in   // in deref
+);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _RELOAD_H
@@ -0,0 +1,733 @@
+/*
+Copyright (C) 2011 Jay Satiro <raysatiro@yahoo.com>
+All rights reserved.
+
+This file is part of GetHooks.
+
+GetHooks is free software: you can redistribute it and/or modify 
+it under the terms of the GNU General Public License as published by 
+the Free Software Foundation, either version 3 of the License, or 
+(at your option) any later version.
+
+GetHooks is distributed in the hope that it will be useful, 
+but WITHOUT ANY WARRANTY; without even the implied warranty of 
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License 
+along with GetHooks.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/** 
+This file contains functions for a rollup store (hook metrics per minute, hour and day).
+Each function is documented in the comment block above its definition.
+
+The metrics are kept as running totals. The hooks in each snapshot are counted by type and by 
+origin image and added to the totals, as are the diff events and the time each snapshot took.
+Each resolution has a fixed size ring of the totals at the end of each of its buckets. When a 
+minute ends the totals are copied to the minute ring, and the same totals are the end of an hour 
+or a day when one of those ends, so a coarser bucket holds exactly the sum of the finer buckets it 
+spans without storing them. The metrics in any range of buckets are the difference of two slots.
+
+-
+create_rollup_store()
+
+Create a rollup store and its descendants or die.
+-
+
+-
+init_rollup_store()
+
+Initialize a rollup store.
+-
+
+-
+get_rollup_bucket()
+
+Get the number of the bucket of a ring that a time falls in.
+-
+
+-
+close_rollup_ring()
+
+Close the buckets of a ring up to the bucket that a time falls in.
+-
+
+-
+advance_rollup_store()
+
+Close the buckets of every resolution that end at or before a time.
+-
+
+-
+add_rollup_event()
+
+Add a hook event to the running totals.
+-
+
+-
+get_rollup_image()
+
+Get the counter of an origin image.
+-
+
+-
+update_rollup_store()
+
+Add the hooks in a snapshot to the running totals.
+-
+
+-
+query_rollup_store()
+
+Get the metrics in a time range at a resolution.
+-
+
+-
+print_rollup_totals()
+
+Print the metrics in a range of buckets.
+-
+
+-
+print_rollup_report()
+
+Print the metrics in the buckets that closed in the last update.
+-
+
+-
+print_rollup_store()
+
+Print a rollup store.
+-
+
+-
+free_rollup_store()
+
+Free a rollup store and all its descendants.
+-
+
+*/
+
+#include <stdio.h>
+
+#include "util.h"
+
+#include "rollup.h"
+
+/* the global stores */
+#include "global.h"
+
+
+/* the number of FILETIME units in a second */
+#define ROLLUP_SECOND   ( (__int64)10000000 )
+
+
+
+static __int64 get_rollup_bucket( 
+	const struct rollup_ring *const ring,   // in
+	const __int64 time   // in
+);
+
+static void close_rollup_ring( 
+	struct rollup_ring *const ring,   // in
+	const struct rollup_totals *const totals,   // in
+	const __int64 time   // in
+);
+
+static void advance_rollup_store( 
+	struct rollup *const store,   // in
+	const __int64 time   // in
+);
+
+static unsigned get_rollup_image( 
+	struct rollup *const store,   // in
+	const struct gui *const origin   // in, optional
+);
+
+static void print_rollup_totals( 
+	const struct rollup *const store,   // in
+	const struct rollup_totals *const totals,   // in
+	const unsigned buckets   // in
+);
+
+
+
+/* create_rollup_store() 
+Create a rollup store and its descendants or die.
+*/
+void create_rollup_store( 
+	struct rollup **const out   // out deref
+)
+{
+	struct rollup *rollup = NULL;
+	
+	FAIL_IF( !out );
+	FAIL_IF( *out );
+	
+	
+	/* allocate a rollup store */
+	rollup = must_calloc( 1, sizeof( *rollup ) );
+	
+	rollup->ring[ ROLLUP_MINUTE ].seconds = 60;
+	rollup->ring[ ROLLUP_MINUTE ].count = ROLLUP_MINUTES;
+	
+	rollup->ring[ ROLLUP_HOUR ].seconds = 60 * 60;
+	rollup->ring[ ROLLUP_HOUR ].count = ROLLUP_HOURS;
+	
+	rollup->ring[ ROLLUP_DAY ].seconds = 24 * 60 * 60;
+	rollup->ring[ ROLLUP_DAY ].count = ROLLUP_DAYS;
+	
+	
+	*out = rollup;
+	return;
+}
+
+
+
+/* init_rollup_store() 
+Initialize a rollup store.
+
+The rings are allocated here rather than when the store is created because they're only needed if 
+the user requested rollups. Together they take a few MB.
+
+returns nonzero on success
+*/
+int init_rollup_store( 
+	struct rollup *const store   // in
+)
+{
+	unsigned i = 0;
+	__int64 now = 0;
+	
+	FAIL_IF( !G->prog->init_time );   // The program store must be initialized.
+	FAIL_IF( !G->config->init_time );   // The configuration store must be initialized.
+	
+	FAIL_IF( GetCurrentThreadId() != G->prog->dwMainThreadId );   // main thread only
+	
+	FAIL_IF( !store );
+	FAIL_IF( store->init_time );   // The rollup store must not be initialized.
+	
+	
+	GetSystemTimeAsFileTime( (FILETIME *)&now );
+	
+	/* each ring starts empty with the bucket that's open now. the slot before it holds the totals 
+	at the beginning, which are 0.
+	*/
+	for( i = 0; i < ROLLUP_RESOLUTIONS; ++i )
+	{
+		struct rollup_ring *const ring = &store->ring[ i ];
+		
+		ring->slot = must_calloc( ( ring->count + 1 ), sizeof( *ring->slot ) );
+		
+		ring->open = get_rollup_bucket( ring, now );
+		ring->first = ring->open;
+	}
+	
+	/* the rollup store has been initialized */
+	GetSystemTimeAsFileTime( (FILETIME *)&store->init_time );
+	return TRUE;
+}
+
+
+
+/* get_rollup_bucket() 
+Get the number of the bucket of a ring that a time falls in.
+
+'time' is a system utc time in FILETIME format.
+
+returns the bucket number, which is the number of whole bucket lengths since 1601
+*/
+static __int64 get_rollup_bucket( 
+	const struct rollup_ring *const ring,   // in
+	const __int64 time   // in
+)
+{
+	FAIL_IF( !ring );
+	FAIL_IF( !ring->seconds );
+	
+	
+	return ( time / ( ring->seconds * ROLLUP_SECOND ) );
+}
+
+
+
+/* close_rollup_ring() 
+Close the buckets of a ring up to the bucket that a time falls in.
+
+Every bucket that's closed gets 'totals'. The first of them is the bucket that was open, and the 
+others had no events so their totals are the same. If more buckets closed than the ring holds 
+then only the last ones are written, and the buckets before them are dropped.
+
+If 'time' falls in the bucket that's open or an earlier one then nothing is closed.
+*/
+static void close_rollup_ring( 
+	struct rollup_ring *const ring,   // in
+	const struct rollup_totals *const totals,   // in
+	const __int64 time   // in
+)
+{
+	__int64 bucket = 0, target = 0;
+	
+	FAIL_IF( !ring );
+	FAIL_IF( !ring->slot );
+	FAIL_IF( !totals );
+	
+	
+	target = get_rollup_bucket( ring, time );
+	
+	if( target <= ring->open )
+		return;
+	
+	/* the slot before the oldest bucket must also be written */
+	bucket = ring->open;
+	
+	if( ( target - bucket ) > ( ring->count + 1 ) )
+		bucket = target - ( ring->count + 1 );
+	
+	for( ; bucket < target; ++bucket )
+		ring->slot[ bucket % ( ring->count + 1 ) ] = *totals;
+	
+	ring->open = target;
+	
+	if( ( ring->open - ring->first ) > ring->count )
+		ring->first = ring->open - ring->count;
+	
+	return;
+}
+
+
+
+/* advance_rollup_store() 
+Close the buckets of every resolution that end at or before a time.
+
+The number of buckets closed in each resolution is added to store->closed.
+*/
+static void advance_rollup_store( 
+	struct rollup *const store,   // in
+	const __int64 time   // in
+)
+{
+	unsigned i = 0;
+	
+	FAIL_IF( !store );
+	
+	
+	for( i = 0; i < ROLLUP_RESOLUTIONS; ++i )
+	{
+		struct rollup_ring *const ring = &store->ring[ i ];
+		const __int64 open = ring->open;
+		
+		close_rollup_ring( ring, &store->totals, time );
+		
+		store->closed[ i ] += (unsigned)( ring->open - open );
+	}
+	
+	return;
+}
+
+
+
+/* add_rollup_event() 
+Add a hook event to the running totals.
+
+The event is counted in the buckets that are open at 'time', which is the system utc time in 
+FILETIME format that the event was found. A HOOK that's found in the initial snapshot isn't 
+counted as an event; it's counted with the hooks in the snapshot by update_rollup_store().
+
+If the rollup store isn't initialized this function returns without doing anything.
+*/
+void add_rollup_event( 
+	struct rollup *const store,   // in
+	const enum difftype difftype,   // in
+	const __int64 time   // in
+)
+{
+	if( !store || !store->init_time )
+		return;
+	
+	
+	advance_rollup_store( store, time );
+	
+	if( difftype == HOOK_ADDED )
+		++store->totals.added;
+	else if( difftype == HOOK_MODIFIED )
+		++store->totals.modified;
+	else if( difftype == HOOK_REMOVED )
+		++store->totals.removed;
+	
+	return;
+}
+
+
+
+/* get_rollup_image() 
+Get the counter of an origin image.
+
+The first ROLLUP_IMAGES - 1 image names seen each get their own counter. The hooks from any other 
+image, and the hooks whose origin isn't known, share the last counter.
+
+returns the index of the counter in rollup_totals.image
+*/
+static unsigned get_rollup_image( 
+	struct rollup *const store,   // in
+	const struct gui *const origin   // in, optional
+)
+{
+	unsigned i = 0, cch = 0;
+	const WCHAR *name = NULL;
+	
+	FAIL_IF( !store );
+	
+	
+	if( !origin || !origin->spi || !origin->spi->ImageName.Buffer )
+		return ROLLUP_IMAGES - 1;
+	
+	name = origin->spi->ImageName.Buffer;
+	cch = origin->spi->ImageName.Length / sizeof( WCHAR );
+	
+	for( i = 0; i < store->image_count; ++i )
+	{
+		if( ( wcslen( store->image[ i ] ) == cch ) && !_wcsnicmp( store->image[ i ], name, cch ) )
+			return i;
+	}
+	
+	if( store->image_count >= ( ROLLUP_IMAGES - 1 ) )
+		return ROLLUP_IMAGES - 1;
+	
+	/* the image name in the spi isn't necessarily terminated */
+	store->image[ store->image_count ] = must_calloc( ( cch + 1 ), sizeof( WCHAR ) );
+	memcpy( store->image[ store->image_count ], name, ( cch * sizeof( WCHAR ) ) );
+	
+	return store->image_count++;
+}
+
+
+
+/* update_rollup_store() 
+Add the hooks in a snapshot to the running totals.
+
+This function must be called once after each snapshot is taken. The buckets that have ended since 
+the last update are closed first, and the number closed of each resolution is in store->closed 
+until the next update. Each hook in the snapshot is counted by its type and origin image, and if 
+any of its threads is unknown. The time the snapshot took is also added.
+
+If the rollup store isn't initialized this function returns without doing anything.
+*/
+void update_rollup_store( 
+	struct rollup *const store,   // in
+	const struct snapshot *const snapshot   // in
+)
+{
+	const struct desktop_hook_item *item = NULL;
+	
+	if( !store || !store->init_time )
+		return;
+	
+	FAIL_IF( !snapshot );
+	FAIL_IF( !snapshot->init_time );   // The snapshot store must be initialized.
+	
+	FAIL_IF( GetCurrentThreadId() != G->prog->dwMainThreadId );   // main thread only
+	
+	
+	ZeroMemory( store->closed, sizeof( store->closed ) );
+	
+	advance_rollup_store( store, snapshot->init_time );
+	
+	for( item = snapshot->desktop_hooks->head; item; item = item->next )
+	{
+		unsigned i = 0;
+		
+		for( i = 0; i < item->hook_count; ++i )
+		{
+			const struct hook *const hook = &item->hook[ i ];
+			const INT id = hook->object.iHook;
+			
+			if( ( id >= WH_MIN ) && ( id <= WH_MAX ) )
+				++store->totals.type[ id - WH_MIN ];
+			else
+				++store->totals.type[ ROLLUP_TYPES - 1 ];
+			
+			++store->totals.image[ get_rollup_image( store, hook->origin ) ];
+			
+			if( ( hook->entry.pOwner && !hook->owner ) 
+				|| ( hook->object.pti && !hook->origin ) 
+				|| ( hook->object.ptiHooked && !hook->target )
+			)
+				++store->totals.unknown;
+		}
+	}
+	
+	++store->totals.snapshots;
+	
+	if( snapshot->capture_us > 0 )
+		store->totals.capture_us += (unsigned __int64)snapshot->capture_us;
+	
+	return;
+}
+
+
+
+/* query_rollup_store() 
+Get the metrics in a time range at a resolution.
+
+'resolution' is ROLLUP_MINUTE, ROLLUP_HOUR or ROLLUP_DAY.
+'begin' and 'end' are system utc times in FILETIME format. The range is every bucket that's at 
+least partly in [begin, end), clamped to the buckets that are closed and still in the ring.
+'out' receives the metrics in that range: each counter is the sum over its buckets.
+
+The query takes constant time regardless of the length of the range.
+
+returns the number of buckets in the range, or 0 if there are none. if 0 is returned 'out' is 
+zeroed.
+*/
+int query_rollup_store( 
+	const struct rollup *const store,   // in
+	const unsigned resolution,   // in
+	const __int64 begin,   // in
+	const __int64 end,   // in
+	struct rollup_totals *const out   // out
+)
+{
+	unsigned i = 0;
+	__int64 first = 0, last = 0;
+	const struct rollup_ring *ring = NULL;
+	const struct rollup_totals *a = NULL, *b = NULL;
+	
+	FAIL_IF( !store );
+	FAIL_IF( !store->init_time );   // The rollup store must be initialized.
+	FAIL_IF( resolution >= ROLLUP_RESOLUTIONS );
+	FAIL_IF( !out );
+	
+	
+	ZeroMemory( out, sizeof( *out ) );
+	
+	ring = &store->ring[ resolution ];
+	
+	/* the range of buckets [first, last) */
+	first = get_rollup_bucket( ring, begin );
+	last = get_rollup_bucket( ring, ( end + ( ring->seconds * ROLLUP_SECOND ) - 1 ) );
+	
+	if( first < ring->first )
+		first = ring->first;
+	
+	if( last > ring->open )
+		last = ring->open;
+	
+	if( first >= last )
+		return 0;
+	
+	/* the totals at the beginning and end of the range */
+	a = &ring->slot[ ( first - 1 ) % ( ring->count + 1 ) ];
+	b = &ring->slot[ ( last - 1 ) % ( ring->count + 1 ) ];
+	
+	out->snapshots = b->snapshots - a->snapshots;
+	
+	for( i = 0; i < ROLLUP_TYPES; ++i )
+		out->type[ i ] = b->type[ i ] - a->type[ i ];
+	
+	for( i = 0; i < ROLLUP_IMAGES; ++i )
+		out->image[ i ] = b->image[ i ] - a->image[ i ];
+	
+	out->unknown = b->unknown - a->unknown;
+	out->added = b->added - a->added;
+	out->modified = b->modified - a->modified;
+	out->removed = b->removed - a->removed;
+	out->capture_us = b->capture_us - a->capture_us;
+	
+	return (int)( last - first );
+}
+
+
+
+/* print_rollup_totals() 
+Print the metrics in a range of buckets.
+
+The counts of hooks are averages per snapshot.
+*/
+static void print_rollup_totals( 
+	const struct rollup *const store,   // in
+	const struct rollup_totals *const totals,   // in
+	const unsigned buckets   // in
+)
+{
+	unsigned i = 0;
+	double snapshots = 0;
+	
+	FAIL_IF( !store );
+	FAIL_IF( !totals );
+	
+	
+	snapshots = (double)(__int64)totals->snapshots;
+	
+	printf( "Buckets: %u  Snapshots: %I64u  Added: %I64u  Modified: %I64u  Removed: %I64u\n", 
+		buckets, 
+		totals->snapshots, 
+		totals->added, 
+		totals->modified, 
+		totals->removed
+	);
+	
+	if( !totals->snapshots )
+		return;
+	
+	printf( "Average hooks with an unknown thread: %.1f  Average capture: %.1f ms\n", 
+		( (double)(__int64)totals->unknown / snapshots ), 
+		( (double)(__int64)totals->capture_us / snapshots / 1000 )
+	);
+	
+	printf( "%-24s %10s\n", "type", "average" );
+	
+	for( i = 0; i < ROLLUP_TYPES; ++i )
+	{
+		if( !totals->type[ i ] )
+			continue;
+		
+		printf( "%-24ls %10.1f\n", 
+			( ( i < w_hooknames_count ) ? w_hooknames[ i ] : L"<unknown>" ), 
+			( (double)(__int64)totals->type[ i ] / snapshots )
+		);
+	}
+	
+	printf( "%-24s %10s\n", "origin image", "average" );
+	
+	for( i = 0; i < ROLLUP_IMAGES; ++i )
+	{
+		if( !totals->image[ i ] )
+			continue;
+		
+		printf( "%-24ls %10.1f\n", 
+			( ( i < store->image_count ) ? store->image[ i ] : L"<other>" ), 
+			( (double)(__int64)totals->image[ i ] / snapshots )
+		);
+	}
+	
+	return;
+}
+
+
+
+/* print_rollup_report() 
+Print the metrics in the buckets that closed in the last update.
+
+The last hour and day are printed when they close. The last minute is also printed if the user 
+requested verbosity.
+
+If the rollup store isn't initialized this function returns without having printed anything.
+*/
+void print_rollup_report( 
+	const struct rollup *const store   // in
+)
+{
+	unsigned i = 0;
+	const char *const name[ ROLLUP_RESOLUTIONS ] = { "minute", "hour", "day" };
+	
+	if( !store || !store->init_time )
+		return;
+	
+	
+	for( i = 0; i < ROLLUP_RESOLUTIONS; ++i )
+	{
+		const struct rollup_ring *const ring = &store->ring[ i ];
+		const __int64 length = ring->seconds * ROLLUP_SECOND;
+		struct rollup_totals totals;
+		int buckets = 0;
+		
+		if( !store->closed[ i ] || ( ( i == ROLLUP_MINUTE ) && ( G->config->verbose < 1 ) ) )
+			continue;
+		
+		/* the last bucket closed */
+		buckets = query_rollup_store( store, i, ( ( ring->open - 1 ) * length ), 
+			( ring->open * length ), &totals
+		);
+		
+		if( !buckets )
+			continue;
+		
+		printf( "\nHook metrics for the %s ending ", name[ i ] );
+		print_init_time( NULL, ( ring->open * length ) );
+		print_rollup_totals( store, &totals, (unsigned)buckets );
+	}
+	
+	fflush( stdout );
+	return;
+}
+
+
+
+/* print_rollup_store() 
+Print a rollup store.
+
+if 'store' is NULL this function returns without having printed anything.
+*/
+void print_rollup_store( 
+	const struct rollup *const store   // in
+)
+{
+	const char *const objname = "Rollup Store";
+	unsigned i = 0;
+	
+	
+	if( !store )
+		return;
+	
+	PRINT_DBLSEP_BEGIN( objname );
+	
+	for( i = 0; i < ROLLUP_RESOLUTIONS; ++i )
+	{
+		printf( "store->ring[ %u ].seconds: %u\n", i, store->ring[ i ].seconds );
+		printf( "store->ring[ %u ].count: %u\n", i, store->ring[ i ].count );
+		printf( "store->ring[ %u ].first: %I64d\n", i, store->ring[ i ].first );
+		printf( "store->ring[ %u ].open: %I64d\n", i, store->ring[ i ].open );
+		printf( "store->closed[ %u ]: %u\n", i, store->closed[ i ] );
+	}
+	
+	printf( "store->image_count: %u\n", store->image_count );
+	
+	for( i = 0; i < store->image_count; ++i )
+		printf( "store->image[ %u ]: %ls\n", i, store->image[ i ] );
+	
+	printf( "store->totals.snapshots: %I64u\n", store->totals.snapshots );
+	printf( "store->totals.added: %I64u\n", store->totals.added );
+	printf( "store->totals.modified: %I64u\n", store->totals.modified );
+	printf( "store->totals.removed: %I64u\n", store->totals.removed );
+	printf( "store->totals.unknown: %I64u\n", store->totals.unknown );
+	printf( "store->totals.capture_us: %I64u\n", store->totals.capture_us );
+	
+	print_init_time( "store->init_time", store->init_time );
+	PRINT_DBLSEP_END( objname );
+	
+	return;
+}
+
+
+
+/* free_rollup_store() 
+Free a rollup store and all its descendants.
+
+this function then sets the rollup store pointer to NULL and returns
+
+'in' is a pointer to a pointer to the rollup store.
+if( !in || !*in ) then this function returns.
+*/
+void free_rollup_store( 
+	struct rollup **const in   // in deref
+)
+{
+	unsigned i = 0;
+	
+	if( !in || !*in )
+		return;
+	
+	
+	for( i = 0; i < ROLLUP_RESOLUTIONS; ++i )
+		free( (*in)->ring[ i ].slot );
+	
+	for( i = 0; i < (*in)->image_count; ++i )
+		free( (*in)->image[ i ] );
+	
+	free( (*in) );
+	*in = NULL;
+	
+	return;
+}
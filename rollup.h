@@ -0,0 +1,202 @@
+/*
+Copyright (C) 2011 Jay Satiro <raysatiro@yahoo.com>
+All rights reserved.
+
+This file is part of GetHooks.
+
+GetHooks is free software: you can redistribute it and/or modify 
+it under the terms of the GNU General Public License as published by 
+the Free Software Foundation, either version 3 of the License, or 
+(at your option) any later version.
+
+GetHooks is distributed in the hope that it will be useful, 
+but WITHOUT ANY WARRANTY; without even the implied warranty of 
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License 
+along with GetHooks.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _ROLLUP_H
+#define _ROLLUP_H
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include "portable.h"
+#endif
+#include <stdio.h>
+
+#include "reactos.h"
+#include "snapshot.h"
+#include "diff.h"
+
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/* the number of hook type counters: one for each id from WH_MIN to WH_MAX, and the last one for 
+any other id.
+*/
+#define ROLLUP_TYPES   ( CWINHOOKS + 1 )
+
+/* the number of origin image counters. the first ROLLUP_IMAGES - 1 image names seen each get a 
+counter, and the last one is for any other image and for the hooks whose origin is unknown.
+*/
+#define ROLLUP_IMAGES   32
+
+
+/** The totals of the hook metrics.
+Every counter is a running total since the rollup store was initialized, so the metrics in any 
+time range are the difference of the totals at its end and at its beginning.
+*/
+struct rollup_totals
+{
+	/* the number of snapshots */
+	unsigned __int64 snapshots;
+	
+	/* the sum of the number of hooks of each type in each snapshot */
+	unsigned __int64 type[ ROLLUP_TYPES ];
+	
+	/* the sum of the number of hooks from each origin image in each snapshot. see 'image' in the 
+	rollup store.
+	*/
+	unsigned __int64 image[ ROLLUP_IMAGES ];
+	
+	/* the sum of the number of hooks in each snapshot that have an owner, origin or target thread 
+	that isn't known
+	*/
+	unsigned __int64 unknown;
+	
+	/* the number of hooks added, modified and removed between snapshots */
+	unsigned __int64 added;
+	unsigned __int64 modified;
+	unsigned __int64 removed;
+	
+	/* the sum of the time it took to take each snapshot, in microseconds */
+	unsigned __int64 capture_us;
+};
+
+
+
+/** A ring of the totals at the end of each time bucket of one resolution.
+*/
+struct rollup_ring
+{
+	/* the length of each bucket in seconds */
+	unsigned seconds;
+	
+	/* the number of buckets that can be queried. the ring has one more slot so that the totals at 
+	the beginning of the oldest bucket, which are the totals at the end of the bucket before it, 
+	are still in the ring.
+	*/
+	unsigned count;
+	
+	/* the totals at the end of each bucket. bucket number n (the seconds since 1601 divided by the 
+	bucket length) is in slot n modulo ( count + 1 ).
+	*/
+	struct rollup_totals *slot;   // calloc(), free()
+	
+	/* the number of the oldest bucket in the ring, and the number of the bucket that's open. the 
+	buckets from 'first' up to but not including 'open' are closed and can be queried.
+	*/
+	__int64 first;
+	__int64 open;
+};
+
+
+
+/** The rollup store.
+The rollup store aggregates hook metrics per minute, per hour and per day for long term trending.
+The diff events and the hooks in each snapshot are added to the running totals, and when a bucket 
+of a resolution closes the totals are copied to that resolution's ring. Each ring has a fixed 
+size, so the store takes the same memory whether it runs for a day or a year.
+*/
+struct rollup
+{
+	/* the resolutions */
+	#define ROLLUP_MINUTE   0
+	#define ROLLUP_HOUR   1
+	#define ROLLUP_DAY   2
+	#define ROLLUP_RESOLUTIONS   3
+	
+	/* the number of buckets kept of each resolution: a day of minutes, a month of hours and a year 
+	of days.
+	*/
+	#define ROLLUP_MINUTES   ( 24 * 60 )
+	#define ROLLUP_HOURS   ( 31 * 24 )
+	#define ROLLUP_DAYS   366
+	struct rollup_ring ring[ ROLLUP_RESOLUTIONS ];
+	
+	/* the running totals */
+	struct rollup_totals totals;
+	
+	/* the origin image names that have a counter. an element is NULL if it isn't used yet. */
+	WCHAR *image[ ROLLUP_IMAGES - 1 ];   // calloc(), free()
+	unsigned image_count;
+	
+	/* the number of buckets of each resolution that closed in the last call to 
+	update_rollup_store()
+	*/
+	unsigned closed[ ROLLUP_RESOLUTIONS ];
+	
+	/* the system utc time in FILETIME format immediately after this store has been initialized.
+	this is nonzero when this store has been initialized.
+	*/
+	__int64 init_time;
+};
+
+
+
+/** 
+these functions are documented in the comment block above their definitions in rollup.c
+*/
+void create_rollup_store( 
+	struct rollup **const out   // out deref
+);
+
+int init_rollup_store( 
+	struct rollup *const store   // in
+);
+
+void add_rollup_event( 
+	struct rollup *const store,   // in
+	const enum difftype difftype,   // in
+	const __int64 time   // in
+);
+
+void update_rollup_store( 
+	struct rollup *const store,   // in
+	const struct snapshot *const snapshot   // in
+);
+
+int query_rollup_store( 
+	const struct rollup *const store,   // in
+	const unsigned resolution,   // in
+	const __int64 begin,   // in
+	const __int64 end,   // in
+	struct rollup_totals *const out   // out
+);
+
+void print_rollup_report( 
+	const struct rollup *const store   // in
+);
+
+void print_rollup_store( 
+	const struct rollup *const store   // in
+);
+
+void free_rollup_store( 
+	struct rollup **const in   // in deref
+);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _ROLLUP_H
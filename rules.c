@@ -0,0 +1,2200 @@
+/*
+Copyright (C) 2011 Jay Satiro <raysatiro@yahoo.com>
+All rights reserved.
+
+This file is part of GetHooks.
+
+GetHooks is free software: you can redistribute it and/or modify 
+it under the terms of the GNU General Public License as published by 
+the Free Software Foundation, either version 3 of the License, or 
+(at your option) any later version.
+
+GetHooks is distributed in the hope that it will be useful, 
+but WITHOUT ANY WARRANTY; without even the implied warranty of 
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License 
+along with GetHooks.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/** 
+This file contains functions for a rules store (compiled rules matched against hook events).
+Each function is documented in the comment block above its definition.
+
+The rules are compiled once when the store is initialized, and the hook events printed in each 
+snapshot are evaluated against them in a batch after it. A rule is only evaluated for an event if 
+the event and HOOK id it requires match, and a predicate used by several rules is evaluated at most 
+once for an event, so the cost of an event depends on the rules that can match it and not on the 
+number of rules.
+
+-
+create_rules_store()
+
+Create a rules store and its descendants or die.
+-
+
+-
+grow_rules_array()
+
+Double the size of an array or die.
+-
+
+-
+hash_rules_hook()
+
+Get the first slot in the hash table for a HOOK address.
+-
+
+-
+rebuild_rules_hook_slots()
+
+Rebuild the hash table of HOOK addresses from the hook array.
+-
+
+-
+find_rules_hook()
+
+Find a HOOK in the hook array.
+-
+
+-
+next_rules_token()
+
+Read the next token of a rule.
+-
+
+-
+add_rules_node()
+
+Add a node to the syntax tree of a rule.
+-
+
+-
+add_rules_predicate()
+
+Add a predicate to the rules store, or find an identical one.
+-
+
+-
+parse_rules_value()
+
+Convert the value of a comparison to a predicate's constant.
+-
+
+-
+parse_rules_predicate()
+
+Parse a comparison.
+-
+
+-
+parse_rules_not()
+
+Parse a comparison, a negation or an expression in parentheses.
+-
+
+-
+parse_rules_and()
+
+Parse one or more terms joined by 'and'.
+-
+
+-
+parse_rules_or()
+
+Parse one or more terms joined by 'or'.
+-
+
+-
+emit_rules_node()
+
+Compile a syntax tree to postfix instructions.
+-
+
+-
+get_rules_event_mask()
+
+Get the events that a syntax tree can match.
+-
+
+-
+get_rules_id()
+
+Get the HOOK id that a syntax tree requires.
+-
+
+-
+compile_rules_line()
+
+Compile a line of the rules file.
+-
+
+-
+build_rules_buckets()
+
+Build the index of the rules by event and HOOK id.
+-
+
+-
+init_rules_store()
+
+Initialize a rules store by compiling the rules in its rules file.
+-
+
+-
+add_rules_event()
+
+Add a hook event to be evaluated.
+-
+
+-
+test_rules_predicate()
+
+Evaluate a predicate for an event.
+-
+
+-
+run_rules_rule()
+
+Evaluate a rule's program for an event.
+-
+
+-
+evaluate_rules_store()
+
+Evaluate the events added since the last evaluation.
+-
+
+-
+print_rules_report()
+
+Print the cost of the last evaluation and the number of matches of each rule.
+-
+
+-
+print_rules_store()
+
+Print a rules store.
+-
+
+-
+free_rules_store()
+
+Free a rules store and all its descendants.
+-
+
+*/
+
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <stdio.h>
+#include <string.h>
+
+#include "util.h"
+
+#include "str_to_int.h"
+
+#include "checkpoint.h"
+
+#include "rules.h"
+
+/* the global stores */
+#include "global.h"
+
+
+
+/* the default number of elements allocated in each array */
+#define RULES_RULES_DEFAULT   64
+#define RULES_PREDICATES_DEFAULT   128
+#define RULES_PROGRAM_DEFAULT   512
+#define RULES_EVENTS_DEFAULT   256
+#define RULES_HOOKS_DEFAULT   256
+
+/* the maximum length of a line in the rules file and of a token */
+#define RULES_LINE_MAX   4096
+#define RULES_TOKEN_MAX   512
+
+/* the maximum number of nodes in the syntax tree of a rule */
+#define RULES_NODES_MAX   256
+
+/* the maximum depth of the stack of bits when a rule is evaluated */
+#define RULES_STACK_MAX   32
+
+/* all the events */
+#define RULES_EVENT_ALL   ( ( 1u << RULES_EVENTS ) - 1 )
+
+
+/* the tokens of a rule */
+#define RULES_TOKEN_END   0   // the end of the line or a comment
+#define RULES_TOKEN_ERROR   1   // the token is too long or a string isn't terminated
+#define RULES_TOKEN_WORD   2   // a field name, a keyword or a value
+#define RULES_TOKEN_STRING   3   // a value in double quotes
+#define RULES_TOKEN_CMP   4   // a comparison. its RULES_CMP_* is in 'cmp'.
+#define RULES_TOKEN_OPEN   5   // (
+#define RULES_TOKEN_CLOSE   6   // )
+
+
+/** This is a node of the syntax tree of a rule.
+*/
+struct rules_node
+{
+	/* RULES_OP_PREDICATE, RULES_OP_AND, RULES_OP_OR or RULES_OP_NOT */
+	unsigned code;
+	
+	/* for RULES_OP_PREDICATE the index of the predicate, otherwise the indexes of the operands.
+	RULES_OP_NOT has only 'left'.
+	*/
+	unsigned predicate;
+	unsigned left;
+	unsigned right;
+};
+
+
+/** This is the state of the parser while a rule is compiled.
+*/
+struct rules_parser
+{
+	/* the next character to read */
+	const char *p;
+	
+	/* the current token and its text or comparison */
+	unsigned token;
+	char text[ RULES_TOKEN_MAX ];
+	unsigned cmp;
+	
+	/* the syntax tree */
+	struct rules_node node[ RULES_NODES_MAX ];
+	unsigned node_count;
+	
+	/* the reason the rule couldn't be compiled */
+	const char *error;
+};
+
+
+/** This is a name of a constant that can be used in a rule.
+*/
+struct rules_name
+{
+	const char *name;
+	unsigned value;
+};
+
+
+/* the names of the fields, indexed by enum rules_field */
+static const char *const rules_field_names[ RULES_FIELD_COUNT ] = 
+{
+	"event", 
+	"id", 
+	"flags", 
+	"owner.image", 
+	"owner.pid", 
+	"origin.image", 
+	"origin.pid", 
+	"target.image", 
+	"target.pid", 
+	"desktop", 
+	"lifetime", 
+	"anomaly"
+};
+
+/* the names of the events, indexed by enum difftype */
+static const char *const rules_event_names[ RULES_EVENTS + 1 ] = 
+{
+	"", 
+	"found", 
+	"added", 
+	"modified", 
+	"removed", 
+	"attributed"
+};
+
+/* the names of the comparisons, indexed by RULES_CMP_* */
+static const char *const rules_cmp_names[] = 
+{
+	"", "=", "!=", "<", "<=", ">", ">=", "has", "~"
+};
+
+/* the names of the HOOK flags */
+static const struct rules_name rules_flag_names[] = 
+{
+	{ "HF_GLOBAL", HF_GLOBAL }, 
+	{ "HF_ANSI", HF_ANSI }, 
+	{ "HF_NEEDHC_SKIP", HF_NEEDHC_SKIP }, 
+	{ "HF_HUNG", HF_HUNG }, 
+	{ "HF_HOOKFAULTED", HF_HOOKFAULTED }, 
+	{ "HF_NOPLAYBACKDELAY", HF_NOPLAYBACKDELAY }, 
+	{ "HF_WX86KNOWINDOWLL", HF_WX86KNOWINDOWLL }, 
+	{ "HF_DESTROYED", HF_DESTROYED }, 
+	{ NULL, 0 }
+};
+
+/* the names of the anomaly bits */
+static const struct rules_name rules_anomaly_names[] = 
+{
+	{ "self", HOOK_ANOMALY_SELF }, 
+	{ "globalonly", HOOK_ANOMALY_GLOBAL_ONLY }, 
+	{ "globaltarget", HOOK_ANOMALY_GLOBAL_TARGET }, 
+	{ "handle", HOOK_ANOMALY_HANDLE }, 
+	{ "flags", HOOK_ANOMALY_FLAGS }, 
+	{ "destroyed", HOOK_ANOMALY_DESTROYED }, 
+	{ "unknown", HOOK_ANOMALY_UNKNOWN }, 
+	{ NULL, 0 }
+};
+
+
+
+static void grow_rules_array( 
+	void **const array,   // in deref
+	unsigned *const max,   // in deref
+	const size_t size   // in
+);
+
+static unsigned hash_rules_hook( 
+	const void *const pHead,   // in
+	const unsigned slot_max   // in
+);
+
+static void rebuild_rules_hook_slots( 
+	struct rules *const store   // in
+);
+
+static unsigned find_rules_hook( 
+	const struct rules *const store,   // in
+	const struct hook *const hook   // in
+);
+
+static void next_rules_token( 
+	struct rules_parser *const parser   // in
+);
+
+static unsigned add_rules_node( 
+	struct rules_parser *const parser,   // in
+	const unsigned code,   // in
+	const unsigned predicate,   // in
+	const unsigned left,   // in
+	const unsigned right   // in
+);
+
+static unsigned add_rules_predicate( 
+	struct rules *const store,   // in
+	struct rules_predicate *const predicate   // in
+);
+
+static int parse_rules_value( 
+	struct rules_parser *const parser,   // in
+	struct rules_predicate *const predicate   // in, out
+);
+
+static unsigned parse_rules_predicate( 
+	struct rules *const store,   // in
+	struct rules_parser *const parser   // in
+);
+
+static unsigned parse_rules_not( 
+	struct rules *const store,   // in
+	struct rules_parser *const parser,   // in
+	const unsigned depth   // in
+);
+
+static unsigned parse_rules_and( 
+	struct rules *const store,   // in
+	struct rules_parser *const parser,   // in
+	const unsigned depth   // in
+);
+
+static unsigned parse_rules_or( 
+	struct rules *const store,   // in
+	struct rules_parser *const parser,   // in
+	const unsigned depth   // in
+);
+
+static unsigned emit_rules_node( 
+	struct rules *const store,   // in
+	const struct rules_parser *const parser,   // in
+	const unsigned index,   // in
+	const unsigned depth   // in
+);
+
+static unsigned get_rules_event_mask( 
+	const struct rules *const store,   // in
+	const struct rules_parser *const parser,   // in
+	const unsigned index   // in
+);
+
+static int get_rules_id( 
+	const struct rules *const store,   // in
+	const struct rules_parser *const parser,   // in
+	const unsigned index   // in
+);
+
+static int compile_rules_line( 
+	struct rules *const store,   // in
+	const char *const line,   // in
+	const unsigned number   // in
+);
+
+static void build_rules_buckets( 
+	struct rules *const store   // in
+);
+
+static unsigned test_rules_predicate( 
+	const struct rules_predicate *const predicate,   // in
+	const struct rules_event *const event   // in
+);
+
+static unsigned run_rules_rule( 
+	struct rules *const store,   // in
+	const struct rules_rule *const rule,   // in
+	const struct rules_event *const event   // in
+);
+
+
+
+/* create_rules_store() 
+Create a rules store and its descendants or die.
+*/
+void create_rules_store( 
+	struct rules **const out   // out deref
+)
+{
+	struct rules *rules = NULL;
+	
+	FAIL_IF( !out );
+	FAIL_IF( *out );
+	
+	
+	/* allocate a rules store */
+	rules = must_calloc( 1, sizeof( *rules ) );
+	
+	rules->rule_max = RULES_RULES_DEFAULT;
+	rules->rule = must_calloc( rules->rule_max, sizeof( *rules->rule ) );
+	
+	rules->predicate_max = RULES_PREDICATES_DEFAULT;
+	rules->predicate = must_calloc( rules->predicate_max, sizeof( *rules->predicate ) );
+	
+	rules->program_max = RULES_PROGRAM_DEFAULT;
+	rules->program = must_calloc( rules->program_max, sizeof( *rules->program ) );
+	
+	rules->event_max = RULES_EVENTS_DEFAULT;
+	rules->event = must_calloc( rules->event_max, sizeof( *rules->event ) );
+	
+	rules->hook_max = RULES_HOOKS_DEFAULT;
+	rules->hook = must_calloc( rules->hook_max, sizeof( *rules->hook ) );
+	
+	/* the hash table is kept at most half full */
+	rules->hook_slot_max = RULES_HOOKS_DEFAULT * 2;
+	rules->hook_slot = must_calloc( rules->hook_slot_max, sizeof( *rules->hook_slot ) );
+	
+	
+	*out = rules;
+	return;
+}
+
+
+
+/* grow_rules_array() 
+Double the size of an array or die.
+
+'*array' is the array, which was allocated by must_calloc() 
+'*max' is the number of elements in the array. it receives the new number of elements.
+'size' is the size of an element
+*/
+static void grow_rules_array( 
+	void **const array,   // in deref
+	unsigned *const max,   // in deref
+	const size_t size   // in
+)
+{
+	void *temp = NULL;
+	
+	FAIL_IF( !array );
+	FAIL_IF( !*array );
+	FAIL_IF( !max );
+	FAIL_IF( !*max );
+	FAIL_IF( *max > ( (unsigned)-1 / 2 ) );
+	
+	
+	temp = must_calloc( *max * 2, size );
+	memcpy( temp, *array, ( *max * size ) );
+	free( *array );
+	
+	*array = temp;
+	*max *= 2;
+	return;
+}
+
+
+
+/* hash_rules_hook() 
+Get the first slot in the hash table for a HOOK address.
+
+HOOK addresses are multiples of 8, so the low bits are dropped.
+'slot_max' is the number of slots in the hash table. It must be a power of 2.
+
+returns the slot index
+*/
+static unsigned hash_rules_hook( 
+	const void *const pHead,   // in
+	const unsigned slot_max   // in
+)
+{
+	return ( (unsigned)( (uintptr_t)pHead >> 3 ) * 2654435761u ) & ( slot_max - 1 );
+}
+
+
+
+/* rebuild_rules_hook_slots() 
+Rebuild the hash table of HOOK addresses from the hook array.
+
+If the hash table would be more than half full its size is doubled first.
+*/
+static void rebuild_rules_hook_slots( 
+	struct rules *const store   // in
+)
+{
+	unsigned i = 0;
+	
+	FAIL_IF( !store );
+	
+	
+	if( ( store->hook_count * 2 ) > store->hook_slot_max )
+	{
+		while( ( store->hook_count * 2 ) > store->hook_slot_max )
+			store->hook_slot_max *= 2;
+		
+		free( store->hook_slot );
+		store->hook_slot = must_calloc( store->hook_slot_max, sizeof( *store->hook_slot ) );
+	}
+	else
+		memset( store->hook_slot, 0, ( store->hook_slot_max * sizeof( *store->hook_slot ) ) );
+	
+	for( i = 0; i < store->hook_count; ++i )
+	{
+		unsigned slot = hash_rules_hook( store->hook[ i ].pHead, store->hook_slot_max );
+		
+		while( store->hook_slot[ slot ] )
+			slot = ( slot + 1 ) & ( store->hook_slot_max - 1 );
+		
+		store->hook_slot[ slot ] = i + 1;
+	}
+	
+	return;
+}
+
+
+
+/* find_rules_hook() 
+Find a HOOK in the hook array.
+
+A HOOK is identified by its kernel address and its handle.
+
+returns the index + 1 of the HOOK in the hook array, or 0 if it isn't there
+*/
+static unsigned find_rules_hook( 
+	const struct rules *const store,   // in
+	const struct hook *const hook   // in
+)
+{
+	unsigned slot = 0;
+	
+	FAIL_IF( !store );
+	FAIL_IF( !hook );
+	
+	
+	slot = hash_rules_hook( hook->entry.pHead, store->hook_slot_max );
+	
+	for( ; store->hook_slot[ slot ]; slot = ( slot + 1 ) & ( store->hook_slot_max - 1 ) )
+	{
+		const struct rules_hook *const item = &store->hook[ store->hook_slot[ slot ] - 1 ];
+		
+		if( ( item->pHead == hook->entry.pHead ) && ( item->handle == hook->object.head.h ) )
+			return store->hook_slot[ slot ];
+	}
+	
+	return 0;
+}
+
+
+
+/* next_rules_token() 
+Read the next token of a rule.
+
+A token is a word, a string in double quotes, a comparison or a parenthesis. Words end at 
+whitespace or at any of the characters that begin other tokens. A '#' outside of a string begins a 
+comment, which ends the rule.
+*/
+static void next_rules_token( 
+	struct rules_parser *const parser   // in
+)
+{
+	const char *p = NULL;
+	unsigned n = 0;
+	
+	FAIL_IF( !parser );
+	FAIL_IF( !parser->p );
+	
+	
+	p = parser->p;
+	
+	while( ( *p == ' ' ) || ( *p == '\t' ) )
+		++p;
+	
+	parser->text[ 0 ] = '\0';
+	parser->cmp = 0;
+	
+	if( !*p || ( *p == '#' ) )
+	{
+		parser->token = RULES_TOKEN_END;
+	}
+	else if( *p == '(' )
+	{
+		parser->token = RULES_TOKEN_OPEN;
+		++p;
+	}
+	else if( *p == ')' )
+	{
+		parser->token = RULES_TOKEN_CLOSE;
+		++p;
+	}
+	else if( ( *p == '=' ) || ( *p == '~' ) || ( *p == '<' ) || ( *p == '>' ) 
+		|| ( ( p[ 0 ] == '!' ) && ( p[ 1 ] == '=' ) )
+	)
+	{
+		parser->token = RULES_TOKEN_CMP;
+		
+		if( *p == '=' )
+			parser->cmp = RULES_CMP_EQ;
+		else if( *p == '~' )
+			parser->cmp = RULES_CMP_CONTAINS;
+		else if( *p == '!' )
+			parser->cmp = RULES_CMP_NE, ++p;
+		else if( p[ 1 ] == '=' )
+			parser->cmp = ( ( *p == '<' ) ? RULES_CMP_LE : RULES_CMP_GE ), ++p;
+		else
+			parser->cmp = ( ( *p == '<' ) ? RULES_CMP_LT : RULES_CMP_GT );
+		
+		++p;
+	}
+	else if( *p == '"' )
+	{
+		parser->token = RULES_TOKEN_STRING;
+		
+		for( ++p; *p && ( *p != '"' ) && ( n < ( RULES_TOKEN_MAX - 1 ) ); ++p )
+			parser->text[ n++ ] = *p;
+		
+		parser->text[ n ] = '\0';
+		
+		if( *p != '"' )
+		{
+			parser->token = RULES_TOKEN_ERROR;
+			parser->error = "The string is too long or isn't terminated.";
+		}
+		else
+			++p;
+	}
+	else
+	{
+		parser->token = RULES_TOKEN_WORD;
+		
+		for( ; *p && !strchr( " \t()\"=~<>!#", *p ) && ( n < ( RULES_TOKEN_MAX - 1 ) ); ++p )
+			parser->text[ n++ ] = *p;
+		
+		parser->text[ n ] = '\0';
+		
+		if( !n )
+		{
+			parser->token = RULES_TOKEN_ERROR;
+			parser->error = "Unexpected character.";
+		}
+		else if( n >= ( RULES_TOKEN_MAX - 1 ) )
+		{
+			parser->token = RULES_TOKEN_ERROR;
+			parser->error = "The word is too long.";
+		}
+		else if( !_stricmp( parser->text, "has" ) )
+		{
+			parser->token = RULES_TOKEN_CMP;
+			parser->cmp = RULES_CMP_HAS;
+		}
+	}
+	
+	parser->p = p;
+	return;
+}
+
+
+
+/* add_rules_node() 
+Add a node to the syntax tree of a rule.
+
+returns the index + 1 of the node, or 0 if the tree is full
+*/
+static unsigned add_rules_node( 
+	struct rules_parser *const parser,   // in
+	const unsigned code,   // in
+	const unsigned predicate,   // in
+	const unsigned left,   // in
+	const unsigned right   // in
+)
+{
+	struct rules_node *node = NULL;
+	
+	FAIL_IF( !parser );
+	
+	
+	if( parser->node_count >= RULES_NODES_MAX )
+	{
+		parser->error = "The rule has too many terms.";
+		return 0;
+	}
+	
+	node = &parser->node[ parser->node_count++ ];
+	node->code = code;
+	node->predicate = predicate;
+	node->left = left;
+	node->right = right;
+	
+	return parser->node_count;
+}
+
+
+
+/* add_rules_predicate() 
+Add a predicate to the rules store, or find an identical one.
+
+If there is an identical predicate then the text of 'predicate', if any, is freed.
+
+returns the index + 1 of the predicate, or 0 if there are too many predicates
+*/
+static unsigned add_rules_predicate( 
+	struct rules *const store,   // in
+	struct rules_predicate *const predicate   // in
+)
+{
+	unsigned i = 0;
+	
+	FAIL_IF( !store );
+	FAIL_IF( !predicate );
+	
+	
+	for( i = 0; i < store->predicate_count; ++i )
+	{
+		const struct rules_predicate *const item = &store->predicate[ i ];
+		
+		if( ( item->field == predicate->field ) 
+			&& ( item->cmp == predicate->cmp ) 
+			&& ( item->number == predicate->number ) 
+			&& ( !item->text == !predicate->text ) 
+			&& ( !item->text || !_wcsicmp( item->text, predicate->text ) )
+		)
+		{
+			free( predicate->text );
+			predicate->text = NULL;
+			return i + 1;
+		}
+	}
+	
+	if( store->predicate_count >= RULES_PREDICATES_MAX )
+		return 0;
+	
+	if( store->predicate_count >= store->predicate_max )
+	{
+		grow_rules_array( 
+			(void **)&store->predicate, 
+			&store->predicate_max, 
+			sizeof( *store->predicate )
+		);
+	}
+	
+	store->predicate[ store->predicate_count++ ] = *predicate;
+	predicate->text = NULL;
+	
+	return store->predicate_count;
+}
+
+
+
+/* parse_rules_value() 
+Convert the value of a comparison to a predicate's constant.
+
+The current token is the value. 'predicate' has its field and comparison and receives the constant.
+
+returns nonzero on success
+*/
+static int parse_rules_value( 
+	struct rules_parser *const parser,   // in
+	struct rules_predicate *const predicate   // in, out
+)
+{
+	const struct rules_name *names = NULL;
+	unsigned __int64 number = 0;
+	unsigned i = 0;
+	
+	FAIL_IF( !parser );
+	FAIL_IF( !predicate );
+	
+	
+	if( parser->token == RULES_TOKEN_ERROR )
+		return FALSE;
+	
+	if( ( parser->token != RULES_TOKEN_WORD ) && ( parser->token != RULES_TOKEN_STRING ) )
+	{
+		parser->error = "A value is missing.";
+		return FALSE;
+	}
+	
+	switch( predicate->field )
+	{
+		case RULES_OWNER_IMAGE:
+		case RULES_ORIGIN_IMAGE:
+		case RULES_TARGET_IMAGE:
+		case RULES_DESKTOP:
+		{
+			if( !get_wstr_from_mbstr( &predicate->text, parser->text ) )
+			{
+				parser->error = "The text couldn't be converted.";
+				return FALSE;
+			}
+			
+			predicate->cch = (unsigned)wcslen( predicate->text );
+			return TRUE;
+		}
+		
+		case RULES_EVENT:
+		{
+			for( i = 1; i <= RULES_EVENTS; ++i )
+			{
+				if( !_stricmp( parser->text, rules_event_names[ i ] ) )
+				{
+					predicate->number = i;
+					return TRUE;
+				}
+			}
+			
+			parser->error = "The event is unknown.";
+			return FALSE;
+		}
+		
+		case RULES_ID:
+		{
+			WCHAR *name = NULL;
+			int id = 0;
+			
+			
+			if( str_to_int( &id, parser->text ) )
+			{
+				predicate->number = (UINT64)(__int64)id;
+				return TRUE;
+			}
+			
+			if( !get_wstr_from_mbstr( &name, parser->text ) )
+			{
+				parser->error = "The text couldn't be converted.";
+				return FALSE;
+			}
+			
+			for( i = 0; i < w_hooknames_count; ++i )
+			{
+				if( !_wcsicmp( name, w_hooknames[ i ] ) )
+					break;
+			}
+			
+			free( name );
+			
+			if( i >= w_hooknames_count )
+			{
+				parser->error = "The HOOK id is unknown.";
+				return FALSE;
+			}
+			
+			predicate->number = (UINT64)( (__int64)i - 1 );
+			return TRUE;
+		}
+		
+		case RULES_FLAGS:
+			names = rules_flag_names;
+			break;
+		
+		case RULES_ANOMALY:
+			names = rules_anomaly_names;
+			break;
+		
+		default:
+			break;
+	}
+	
+	if( str_to_uint64( &number, parser->text ) == NUM_POS )
+	{
+		predicate->number = number;
+		return TRUE;
+	}
+	
+	for( i = 0; names && names[ i ].name; ++i )
+	{
+		if( !_stricmp( parser->text, names[ i ].name ) )
+		{
+			predicate->number = names[ i ].value;
+			return TRUE;
+		}
+	}
+	
+	parser->error = "The value isn't a number or a known name.";
+	return FALSE;
+}
+
+
+
+/* parse_rules_predicate() 
+Parse a comparison.
+
+comparison: field cmp value
+
+Which comparisons can be used depends on the field. See the comment block above init_rules_store().
+
+returns the index + 1 of the node, or 0 on error
+*/
+static unsigned parse_rules_predicate( 
+	struct rules *const store,   // in
+	struct rules_parser *const parser   // in
+)
+{
+	struct rules_predicate predicate;
+	unsigned i = 0, index = 0;
+	
+	FAIL_IF( !store );
+	FAIL_IF( !parser );
+	
+	
+	ZeroMemory( &predicate, sizeof( predicate ) );
+	
+	if( parser->token == RULES_TOKEN_ERROR )
+		return 0;
+	
+	if( parser->token != RULES_TOKEN_WORD )
+	{
+		parser->error = "A field name is missing.";
+		return 0;
+	}
+	
+	for( i = 0; i < RULES_FIELD_COUNT; ++i )
+	{
+		if( !_stricmp( parser->text, rules_field_names[ i ] ) )
+			break;
+	}
+	
+	if( i >= RULES_FIELD_COUNT )
+	{
+		parser->error = "The field name is unknown.";
+		return 0;
+	}
+	
+	predicate.field = (enum rules_field)i;
+	
+	next_rules_token( parser );
+	if( parser->token == RULES_TOKEN_ERROR )
+		return 0;
+	
+	if( parser->token != RULES_TOKEN_CMP )
+	{
+		parser->error = "A comparison is missing after the field name.";
+		return 0;
+	}
+	
+	predicate.cmp = parser->cmp;
+	
+	switch( predicate.field )
+	{
+		case RULES_OWNER_IMAGE:
+		case RULES_ORIGIN_IMAGE:
+		case RULES_TARGET_IMAGE:
+		case RULES_DESKTOP:
+			if( ( predicate.cmp != RULES_CMP_EQ ) && ( predicate.cmp != RULES_CMP_NE ) 
+				&& ( predicate.cmp != RULES_CMP_CONTAINS )
+			)
+				parser->error = "Only =, != and ~ can be used with that field.";
+			break;
+		
+		case RULES_EVENT:
+			if( ( predicate.cmp != RULES_CMP_EQ ) && ( predicate.cmp != RULES_CMP_NE ) )
+				parser->error = "Only = and != can be used with that field.";
+			break;
+		
+		case RULES_FLAGS:
+		case RULES_ANOMALY:
+			if( ( predicate.cmp != RULES_CMP_EQ ) && ( predicate.cmp != RULES_CMP_NE ) 
+				&& ( predicate.cmp != RULES_CMP_HAS )
+			)
+				parser->error = "Only =, != and has can be used with that field.";
+			break;
+		
+		default:
+			if( ( predicate.cmp == RULES_CMP_HAS ) || ( predicate.cmp == RULES_CMP_CONTAINS ) )
+				parser->error = "Only =, !=, <, <=, > and >= can be used with that field.";
+			break;
+	}
+	
+	if( parser->error )
+		return 0;
+	
+	next_rules_token( parser );
+	if( !parse_rules_value( parser, &predicate ) )
+		return 0;
+	
+	next_rules_token( parser );
+	
+	index = add_rules_predicate( store, &predicate );
+	if( !index )
+	{
+		free( predicate.text );
+		parser->error = "There are too many different comparisons.";
+		return 0;
+	}
+	
+	return add_rules_node( parser, RULES_OP_PREDICATE, ( index - 1 ), 0, 0 );
+}
+
+
+
+/* parse_rules_not() 
+Parse a comparison, a negation or an expression in parentheses.
+
+term: comparison | not term | ( expression )
+
+'depth' is the number of parentheses and negations the term is in.
+
+returns the index + 1 of the node, or 0 on error
+*/
+static unsigned parse_rules_not( 
+	struct rules *const store,   // in
+	struct rules_parser *const parser,   // in
+	const unsigned depth   // in
+)
+{
+	unsigned index = 0;
+	
+	FAIL_IF( !store );
+	FAIL_IF( !parser );
+	
+	
+	if( depth >= RULES_STACK_MAX )
+	{
+		parser->error = "The rule is nested too deeply.";
+		return 0;
+	}
+	
+	if( ( parser->token == RULES_TOKEN_WORD ) && !_stricmp( parser->text, "not" ) )
+	{
+		next_rules_token( parser );
+		
+		index = parse_rules_not( store, parser, ( depth + 1 ) );
+		if( !index )
+			return 0;
+		
+		return add_rules_node( parser, RULES_OP_NOT, 0, index, 0 );
+	}
+	
+	if( parser->token == RULES_TOKEN_OPEN )
+	{
+		next_rules_token( parser );
+		
+		index = parse_rules_or( store, parser, ( depth + 1 ) );
+		if( !index )
+			return 0;
+		
+		if( parser->token != RULES_TOKEN_CLOSE )
+		{
+			parser->error = "A closing parenthesis is missing.";
+			return 0;
+		}
+		
+		next_rules_token( parser );
+		return index;
+	}
+	
+	return parse_rules_predicate( store, parser );
+}
+
+
+
+/* parse_rules_and() 
+Parse one or more terms joined by 'and'.
+
+returns the index + 1 of the node, or 0 on error
+*/
+static unsigned parse_rules_and( 
+	struct rules *const store,   // in
+	struct rules_parser *const parser,   // in
+	const unsigned depth   // in
+)
+{
+	unsigned left = 0;
+	
+	FAIL_IF( !store );
+	FAIL_IF( !parser );
+	
+	
+	left = parse_rules_not( store, parser, depth );
+	
+	while( left && ( parser->token == RULES_TOKEN_WORD ) && !_stricmp( parser->text, "and" ) )
+	{
+		unsigned right = 0;
+		
+		
+		next_rules_token( parser );
+		
+		right = parse_rules_not( store, parser, depth );
+		if( !right )
+			return 0;
+		
+		left = add_rules_node( parser, RULES_OP_AND, 0, left, right );
+	}
+	
+	return left;
+}
+
+
+
+/* parse_rules_or() 
+Parse one or more terms joined by 'or'. 'and' binds more tightly than 'or'.
+
+returns the index + 1 of the node, or 0 on error
+*/
+static unsigned parse_rules_or( 
+	struct rules *const store,   // in
+	struct rules_parser *const parser,   // in
+	const unsigned depth   // in
+)
+{
+	unsigned left = 0;
+	
+	FAIL_IF( !store );
+	FAIL_IF( !parser );
+	
+	
+	left = parse_rules_and( store, parser, depth );
+	
+	while( left && ( parser->token == RULES_TOKEN_WORD ) && !_stricmp( parser->text, "or" ) )
+	{
+		unsigned right = 0;
+		
+		
+		next_rules_token( parser );
+		
+		right = parse_rules_and( store, parser, depth );
+		if( !right )
+			return 0;
+		
+		left = add_rules_node( parser, RULES_OP_OR, 0, left, right );
+	}
+	
+	return left;
+}
+
+
+
+/* emit_rules_node() 
+Compile a syntax tree to postfix instructions.
+
+'index' is the index + 1 of the root node of the tree 
+'depth' is the number of bits on the stack before the tree's instructions are run
+
+returns the maximum number of bits on the stack while the tree's instructions are run
+*/
+static unsigned emit_rules_node( 
+	struct rules *const store,   // in
+	const struct rules_parser *const parser,   // in
+	const unsigned index,   // in
+	const unsigned depth   // in
+)
+{
+	const struct rules_node *node = NULL;
+	struct rules_op *op = NULL;
+	unsigned max = depth + 1;
+	
+	FAIL_IF( !store );
+	FAIL_IF( !parser );
+	FAIL_IF( !index || ( index > parser->node_count ) );
+	
+	
+	node = &parser->node[ index - 1 ];
+	
+	if( node->code != RULES_OP_PREDICATE )
+	{
+		unsigned temp = emit_rules_node( store, parser, node->left, depth );
+		
+		if( temp > max )
+			max = temp;
+		
+		if( node->code != RULES_OP_NOT )
+		{
+			temp = emit_rules_node( store, parser, node->right, ( depth + 1 ) );
+			
+			if( temp > max )
+				max = temp;
+		}
+	}
+	
+	if( store->program_count >= store->program_max )
+	{
+		grow_rules_array( 
+			(void **)&store->program, 
+			&store->program_max, 
+			sizeof( *store->program )
+		);
+	}
+	
+	op = &store->program[ store->program_count++ ];
+	op->code = (unsigned short)node->code;
+	op->arg = (unsigned short)node->predicate;
+	
+	return max;
+}
+
+
+
+/* get_rules_event_mask() 
+Get the events that a syntax tree can match.
+
+'index' is the index + 1 of the root node of the tree
+
+returns a bit for each event, bit 0 for HOOK_FOUND. The bits are a superset of the events the tree 
+matches: only the event comparisons that the whole tree depends on are taken into account.
+*/
+static unsigned get_rules_event_mask( 
+	const struct rules *const store,   // in
+	const struct rules_parser *const parser,   // in
+	const unsigned index   // in
+)
+{
+	const struct rules_node *node = NULL;
+	
+	FAIL_IF( !store );
+	FAIL_IF( !parser );
+	FAIL_IF( !index || ( index > parser->node_count ) );
+	
+	
+	node = &parser->node[ index - 1 ];
+	
+	if( node->code == RULES_OP_AND )
+	{
+		return get_rules_event_mask( store, parser, node->left )
+			& get_rules_event_mask( store, parser, node->right );
+	}
+	
+	if( node->code == RULES_OP_OR )
+	{
+		return get_rules_event_mask( store, parser, node->left )
+			| get_rules_event_mask( store, parser, node->right );
+	}
+	
+	if( node->code == RULES_OP_PREDICATE )
+	{
+		const struct rules_predicate *const predicate = &store->predicate[ node->predicate ];
+		
+		if( predicate->field == RULES_EVENT )
+		{
+			const unsigned bit = 1u << ( (unsigned)predicate->number - 1 );
+			
+			if( predicate->cmp == RULES_CMP_EQ )
+				return bit;
+			
+			if( predicate->cmp == RULES_CMP_NE )
+				return RULES_EVENT_ALL & ~bit;
+		}
+	}
+	
+	return RULES_EVENT_ALL;
+}
+
+
+
+/* get_rules_id() 
+Get the HOOK id that a syntax tree requires.
+
+'index' is the index + 1 of the root node of the tree
+
+returns the HOOK id that an 'id =' comparison that the whole tree depends on requires, or 
+RULES_ID_ANY
+*/
+static int get_rules_id( 
+	const struct rules *const store,   // in
+	const struct rules_parser *const parser,   // in
+	const unsigned index   // in
+)
+{
+	const struct rules_node *node = NULL;
+	
+	FAIL_IF( !store );
+	FAIL_IF( !parser );
+	FAIL_IF( !index || ( index > parser->node_count ) );
+	
+	
+	node = &parser->node[ index - 1 ];
+	
+	if( node->code == RULES_OP_AND )
+	{
+		const int id = get_rules_id( store, parser, node->left );
+		
+		return ( ( id != RULES_ID_ANY ) ? id : get_rules_id( store, parser, node->right ) );
+	}
+	
+	if( node->code == RULES_OP_PREDICATE )
+	{
+		const struct rules_predicate *const predicate = &store->predicate[ node->predicate ];
+		
+		if( ( predicate->field == RULES_ID ) && ( predicate->cmp == RULES_CMP_EQ ) 
+			&& ( (__int64)predicate->number >= WH_MIN ) 
+			&& ( (__int64)predicate->number <= WH_MAX )
+		)
+			return (int)(__int64)predicate->number;
+	}
+	
+	return RULES_ID_ANY;
+}
+
+
+
+/* compile_rules_line() 
+Compile a line of the rules file.
+
+'line' is the line, without its newline 
+'number' is the line number
+
+A line that's empty or a comment is skipped. If the line can't be compiled the reason is printed.
+
+returns nonzero on success
+*/
+static int compile_rules_line( 
+	struct rules *const store,   // in
+	const char *const line,   // in
+	const unsigned number   // in
+)
+{
+	struct rules_parser *parser = NULL;
+	struct rules_rule *rule = NULL;
+	const char *name = NULL, *colon = NULL;
+	unsigned root = 0, name_len = 0, begin = 0, i = 0;
+	
+	FAIL_IF( !store );
+	FAIL_IF( !line );
+	
+	
+	for( name = line; ( *name == ' ' ) || ( *name == '\t' ); ++name )
+	;
+	
+	if( !*name || ( *name == '#' ) )
+		return TRUE;
+	
+	colon = strchr( name, ':' );
+	
+	for( name_len = (unsigned)( colon ? ( colon - name ) : 0 );
+		name_len && ( ( name[ name_len - 1 ] == ' ' ) || ( name[ name_len - 1 ] == '\t' ) );
+		--name_len
+	)
+	;
+	
+	if( !name_len || strcspn( name, " \t" ) < name_len )
+	{
+		MSG_ERROR( "Rules file: a rule must begin with a name without spaces and a colon." );
+		printf( "line %u: %s\n", number, line );
+		return FALSE;
+	}
+	
+	for( i = 0; i < store->rule_count; ++i )
+	{
+		if( ( strlen( store->rule[ i ].name ) == name_len ) 
+			&& !strncmp( store->rule[ i ].name, name, name_len )
+		)
+		{
+			MSG_ERROR( "Rules file: the rule name has already been used." );
+			printf( "line %u: %s\n", number, line );
+			return FALSE;
+		}
+	}
+	
+	/* the syntax tree is too big for the stack */
+	parser = must_calloc( 1, sizeof( *parser ) );
+	parser->p = colon + 1;
+	
+	next_rules_token( parser );
+	
+	if( parser->token != RULES_TOKEN_ERROR )
+		root = parse_rules_or( store, parser, 0 );
+	
+	if( root && ( parser->token != RULES_TOKEN_END ) )
+	{
+		root = 0;
+		parser->error = ( ( parser->token == RULES_TOKEN_ERROR ) ? parser->error 
+			: "Unexpected text after the rule. Is 'and' or 'or' missing?" );
+	}
+	
+	if( root )
+	{
+		begin = store->program_count;
+		
+		if( emit_rules_node( store, parser, root, 0 ) > RULES_STACK_MAX )
+		{
+			store->program_count = begin;
+			root = 0;
+			parser->error = "The rule is nested too deeply.";
+		}
+	}
+	
+	if( !root )
+	{
+		MSG_ERROR( "Rules file: the rule couldn't be compiled." );
+		printf( "line %u: %s\n", number, line );
+		printf( "reason: %s\n", ( parser->error ? parser->error : "Syntax error." ) );
+		free( parser );
+		return FALSE;
+	}
+	
+	if( store->rule_count >= store->rule_max )
+		grow_rules_array( (void **)&store->rule, &store->rule_max, sizeof( *store->rule ) );
+	
+	rule = &store->rule[ store->rule_count ];
+	
+	rule->name = must_calloc( ( name_len + 1 ), sizeof( *rule->name ) );
+	memcpy( rule->name, name, name_len );
+	
+	rule->line = number;
+	rule->begin = begin;
+	rule->count = store->program_count - begin;
+	rule->event_mask = get_rules_event_mask( store, parser, root );
+	rule->id = get_rules_id( store, parser, root );
+	
+	free( parser );
+	++store->rule_count;
+	return TRUE;
+}
+
+
+
+/* build_rules_buckets() 
+Build the index of the rules by event and HOOK id.
+
+Each rule is put in the bucket of each event it can match, either the bucket of the HOOK id it 
+requires or the bucket for any id. The rules in a bucket are in the order of the rules file.
+*/
+static void build_rules_buckets( 
+	struct rules *const store   // in
+)
+{
+	unsigned cursor[ RULES_EVENTS * RULES_ID_SLOTS ];
+	unsigned i = 0, e = 0, total = 0;
+	
+	FAIL_IF( !store );
+	FAIL_IF( store->bucket );
+	
+	
+	ZeroMemory( cursor, sizeof( cursor ) );
+	
+	/* count the rules in each bucket */
+	for( i = 0; i < store->rule_count; ++i )
+	{
+		const struct rules_rule *const rule = &store->rule[ i ];
+		const unsigned slot = ( ( rule->id != RULES_ID_ANY ) ? ( 1 + rule->id - WH_MIN ) : 0 );
+		
+		for( e = 0; e < RULES_EVENTS; ++e )
+		{
+			if( rule->event_mask & ( 1u << e ) )
+				++cursor[ ( e * RULES_ID_SLOTS ) + slot ];
+		}
+	}
+	
+	for( i = 0; i < ( RULES_EVENTS * RULES_ID_SLOTS ); ++i )
+	{
+		const unsigned count = cursor[ i ];
+		
+		store->bucket_begin[ i ] = total;
+		cursor[ i ] = total;
+		total += count;
+	}
+	
+	store->bucket_begin[ RULES_EVENTS * RULES_ID_SLOTS ] = total;
+	store->bucket = must_calloc( ( total ? total : 1 ), sizeof( *store->bucket ) );
+	
+	/* put the rules in the buckets */
+	for( i = 0; i < store->rule_count; ++i )
+	{
+		const struct rules_rule *const rule = &store->rule[ i ];
+		const unsigned slot = ( ( rule->id != RULES_ID_ANY ) ? ( 1 + rule->id - WH_MIN ) : 0 );
+		
+		for( e = 0; e < RULES_EVENTS; ++e )
+		{
+			if( rule->event_mask & ( 1u << e ) )
+				store->bucket[ cursor[ ( e * RULES_ID_SLOTS ) + slot ]++ ] = i;
+		}
+	}
+	
+	return;
+}
+
+
+
+/* init_rules_store() 
+Initialize a rules store by compiling the rules in its rules file.
+
+'pwszFile' is the rules file. Each line is a rule, a comment that begins with '#' or empty.
+
+rule: name: expression 
+expression: term [ and term ]... [ or term [ and term ]... ]...
+term: field cmp value | not term | ( expression )
+
+A hook event matches a rule if the expression is true for it. The fields are:
+event   found, added, modified, removed or attributed. = and != only.
+id   the HOOK id as a number or a name like WH_KEYBOARD_LL.
+flags   the HOOK flags as a number or a name like HF_GLOBAL. =, != and has only.
+owner.image, origin.image, target.image   the image name of the thread's process, or "" if the 
+   thread is unknown. =, != and ~ (contains) only, ignoring case.
+owner.pid, origin.pid, target.pid   the process id of the thread, or 0 if the thread is unknown.
+desktop   the desktop name. =, != and ~ only, ignoring case.
+lifetime   the milliseconds from when the HOOK was first found to the event.
+anomaly   the anomaly bits as a number or a name: self, globalonly, globaltarget, handle, flags, 
+   destroyed or unknown. =, != and has only. 'anomaly != 0' matches any anomaly.
+
+The comparisons are =, !=, <, <=, >, >=, has (all the bits are set) and ~ (contains).
+A value that has spaces or any of the characters ()"=~<>!# is put in double quotes.
+
+Example:
+ll-hooks: ( id = WH_KEYBOARD_LL or id = WH_MOUSE_LL ) and event = added and origin.image != "svchost.exe" 
+short-lived: event = removed and lifetime < 5000 
+broken: anomaly != 0
+
+If a rule can't be compiled the reason is printed.
+
+returns nonzero on success
+*/
+int init_rules_store( 
+	struct rules *const store,   // in
+	const WCHAR *const pwszFile   // in
+)
+{
+	FILE *fp = NULL;
+	char *line = NULL;
+	unsigned number = 0;
+	int ret = FALSE;
+	
+	FAIL_IF( !store );
+	FAIL_IF( store->init_time );   // Check for memory leak. This store can only be initialized once.
+	FAIL_IF( !pwszFile );
+	
+	
+	store->pwszFile = must_wcsdup( pwszFile );
+	
+	fp = _wfopen( store->pwszFile, L"r" );
+	if( !fp )
+	{
+		MSG_ERROR( "_wfopen() failed to open the rules file." );
+		printf( "file: %ls\n", store->pwszFile );
+		goto cleanup;
+	}
+	
+	line = must_calloc( RULES_LINE_MAX, sizeof( *line ) );
+	
+	while( fgets( line, RULES_LINE_MAX, fp ) )
+	{
+		const size_t len = strcspn( line, "\r\n" );
+		
+		
+		++number;
+		
+		if( !line[ len ] && !feof( fp ) )
+		{
+			MSG_ERROR( "Rules file: the line is too long." );
+			printf( "line %u\n", number );
+			goto cleanup;
+		}
+		
+		line[ len ] = '\0';
+		
+		if( !compile_rules_line( store, line, number ) )
+			goto cleanup;
+	}
+	
+	if( ferror( fp ) )
+	{
+		MSG_ERROR( "fgets() failed to read the rules file." );
+		goto cleanup;
+	}
+	
+	if( !store->rule_count )
+	{
+		MSG_ERROR( "The rules file doesn't have any rules." );
+		printf( "file: %ls\n", store->pwszFile );
+		goto cleanup;
+	}
+	
+	build_rules_buckets( store );
+	
+	QueryPerformanceFrequency( (LARGE_INTEGER *)&store->qpc_frequency );
+	
+	ret = TRUE;
+
+cleanup:
+	free( line );
+	
+	if( fp )
+		fclose( fp );
+	
+	if( !ret )
+		return FALSE;
+	
+	/* the rules store has been initialized */
+	GetSystemTimeAsFileTime( (FILETIME *)&store->init_time );
+	return TRUE;
+}
+
+
+
+/* add_rules_event() 
+Add a hook event to be evaluated.
+
+'hook' is the hook info 
+'deskname' is the desktop name 
+'difftype' is the event, eg HOOK_ADDED, HOOK_MODIFIED, HOOK_REMOVED 
+'time' is the time of the snapshot the hook info is from
+
+The values of all the fields are taken now. The event is evaluated in evaluate_rules_store().
+
+if 'store' is NULL or hasn't been initialized this function returns.
+*/
+void add_rules_event( 
+	struct rules *const store,   // in
+	const struct hook *const hook,   // in
+	const WCHAR *const deskname,   // in
+	const enum difftype difftype,   // in
+	const __int64 time   // in
+)
+{
+	struct rules_event *event = NULL;
+	const struct gui *thread[ 3 ];
+	unsigned i = 0, index = 0;
+	__int64 first_time = time;
+	
+	FAIL_IF( !hook );
+	FAIL_IF( !deskname );
+	FAIL_IF( !difftype || ( difftype > RULES_EVENTS ) );
+	
+	
+	if( !store || !store->init_time )
+		return;
+	
+	if( store->event_count >= store->event_max )
+		grow_rules_array( (void **)&store->event, &store->event_max, sizeof( *store->event ) );
+	
+	event = &store->event[ store->event_count++ ];
+	ZeroMemory( event, sizeof( *event ) );
+	
+	event->difftype = difftype;
+	event->time = time;
+	event->handle = hook->object.head.h;
+	event->pHead = hook->entry.pHead;
+	
+	event->value[ RULES_EVENT ].number = difftype;
+	event->value[ RULES_ID ].number = (UINT64)(__int64)hook->object.iHook;
+	event->value[ RULES_FLAGS ].number = hook->object.flags;
+	event->value[ RULES_ANOMALY ].number = hook->anomalies;
+	
+	event->value[ RULES_DESKTOP ].text = deskname;
+	event->value[ RULES_DESKTOP ].cch = (unsigned)wcslen( deskname );
+	
+	/* the image name and process id of the owner, origin and target threads */
+	thread[ 0 ] = hook->owner;
+	thread[ 1 ] = hook->origin;
+	thread[ 2 ] = hook->target;
+	
+	for( i = 0; i < 3; ++i )
+	{
+		const SYSTEM_PROCESS_INFORMATION *const spi = ( thread[ i ] ? thread[ i ]->spi : NULL );
+		
+		if( !spi )
+			continue;
+		
+		event->value[ RULES_OWNER_PID + ( i * 2 ) ].number = (uintptr_t)spi->UniqueProcessId;
+		
+		if( spi->ImageName.Buffer )
+		{
+			event->value[ RULES_OWNER_IMAGE + ( i * 2 ) ].text = spi->ImageName.Buffer;
+			event->value[ RULES_OWNER_IMAGE + ( i * 2 ) ].cch = 
+				spi->ImageName.Length / sizeof( WCHAR );
+		}
+	}
+	
+	/* the lifetime of the HOOK. a HOOK that hasn't been seen before was first found now, unless 
+	the checkpoint store knows of it from before.
+	*/
+	index = find_rules_hook( store, hook );
+	
+	if( !index && ( difftype != HOOK_REMOVED ) )
+	{
+		if( store->hook_count >= store->hook_max )
+			grow_rules_array( (void **)&store->hook, &store->hook_max, sizeof( *store->hook ) );
+		
+		store->hook[ store->hook_count ].pHead = hook->entry.pHead;
+		store->hook[ store->hook_count ].handle = hook->object.head.h;
+		store->hook[ store->hook_count ].first_time = time;
+		store->hook[ store->hook_count ].removed = FALSE;
+		index = ++store->hook_count;
+		
+		if( ( store->hook_count * 2 ) > store->hook_slot_max )
+			rebuild_rules_hook_slots( store );
+		else
+		{
+			unsigned slot = hash_rules_hook( hook->entry.pHead, store->hook_slot_max );
+			
+			while( store->hook_slot[ slot ] )
+				slot = ( slot + 1 ) & ( store->hook_slot_max - 1 );
+			
+			store->hook_slot[ slot ] = index;
+		}
+	}
+	else if( index && ( difftype == HOOK_ADDED ) && store->hook[ index - 1 ].removed )
+	{
+		store->hook[ index - 1 ].first_time = time;
+		store->hook[ index - 1 ].removed = FALSE;
+	}
+	
+	if( index )
+		first_time = store->hook[ index - 1 ].first_time;
+	
+	if( G->checkpoint->init_time )
+	{
+		const __int64 checkpoint_time = find_checkpoint_hook_time( G->checkpoint, hook );
+		
+		if( checkpoint_time && ( checkpoint_time < first_time ) )
+			first_time = checkpoint_time;
+	}
+	
+	if( index )
+	{
+		store->hook[ index - 1 ].first_time = first_time;
+		
+		if( difftype == HOOK_REMOVED )
+			store->hook[ index - 1 ].removed = TRUE;
+	}
+	
+	event->value[ RULES_LIFETIME ].number = 
+		( ( time > first_time ) ? (UINT64)( ( time - first_time ) / 10000 ) : 0 );
+	
+	return;
+}
+
+
+
+/* test_rules_predicate() 
+Evaluate a predicate for an event.
+
+returns 1 if the predicate is true or 0 if it's false
+*/
+static unsigned test_rules_predicate( 
+	const struct rules_predicate *const predicate,   // in
+	const struct rules_event *const event   // in
+)
+{
+	const struct rules_value *value = NULL;
+	unsigned equal = 0;
+	
+	FAIL_IF( !predicate );
+	FAIL_IF( !event );
+	
+	
+	value = &event->value[ predicate->field ];
+	
+	if( predicate->cmp == RULES_CMP_CONTAINS )
+	{
+		unsigned i = 0;
+		
+		if( !predicate->cch )
+			return 1;
+		
+		for( i = 0; ( i + predicate->cch ) <= value->cch; ++i )
+		{
+			if( !_wcsnicmp( &value->text[ i ], predicate->text, predicate->cch ) )
+				return 1;
+		}
+		
+		return 0;
+	}
+	
+	if( predicate->text )
+	{
+		equal = ( ( value->cch == predicate->cch ) 
+			&& ( !predicate->cch || !_wcsnicmp( value->text, predicate->text, predicate->cch ) ) );
+	}
+	else
+		equal = ( value->number == predicate->number );
+	
+	switch( predicate->cmp )
+	{
+		case RULES_CMP_EQ:
+			return equal;
+		case RULES_CMP_NE:
+			return !equal;
+		case RULES_CMP_LT:
+			return ( (__int64)value->number < (__int64)predicate->number );
+		case RULES_CMP_LE:
+			return ( (__int64)value->number <= (__int64)predicate->number );
+		case RULES_CMP_GT:
+			return ( (__int64)value->number > (__int64)predicate->number );
+		case RULES_CMP_GE:
+			return ( (__int64)value->number >= (__int64)predicate->number );
+		case RULES_CMP_HAS:
+			return ( ( value->number & predicate->number ) == predicate->number );
+	}
+	
+	return 0;
+}
+
+
+
+/* run_rules_rule() 
+Evaluate a rule's program for an event.
+
+The results of the predicates are cached for the event, so a predicate used by several rules is 
+only evaluated once. The store's stamp must have been incremented for the event.
+
+returns 1 if the rule matches the event or 0 if it doesn't
+*/
+static unsigned run_rules_rule( 
+	struct rules *const store,   // in
+	const struct rules_rule *const rule,   // in
+	const struct rules_event *const event   // in
+)
+{
+	const struct rules_op *op = NULL, *end = NULL;
+	unsigned stack = 0;
+	
+	FAIL_IF( !store );
+	FAIL_IF( !rule );
+	FAIL_IF( !event );
+	
+	
+	for( op = &store->program[ rule->begin ], end = op + rule->count; op < end; ++op )
+	{
+		switch( op->code )
+		{
+			case RULES_OP_PREDICATE:
+			{
+				struct rules_predicate *const predicate = &store->predicate[ op->arg ];
+				
+				if( predicate->stamp != store->stamp )
+				{
+					predicate->result = test_rules_predicate( predicate, event );
+					predicate->stamp = store->stamp;
+					++store->last_predicate_count;
+				}
+				
+				stack = ( stack << 1 ) | predicate->result;
+				break;
+			}
+			
+			case RULES_OP_AND:
+				stack = ( stack >> 1 ) & ( stack | ~1u );
+				break;
+			
+			case RULES_OP_OR:
+				stack = ( stack >> 1 ) | ( stack & 1u );
+				break;
+			
+			case RULES_OP_NOT:
+				stack ^= 1u;
+				break;
+		}
+	}
+	
+	return ( stack & 1u );
+}
+
+
+
+/* evaluate_rules_store() 
+Evaluate the events added since the last evaluation.
+
+For each event only the rules in the buckets for its event and HOOK id are evaluated. Each match is 
+printed and counted. The HOOKs removed are then dropped from the hook array.
+*/
+void evaluate_rules_store( 
+	struct rules *const store   // in
+)
+{
+	__int64 qpc_begin = 0, qpc_end = 0;
+	unsigned i = 0, j = 0;
+	
+	FAIL_IF( !store );
+	FAIL_IF( !store->init_time );   // The rules store must be initialized.
+	
+	
+	QueryPerformanceCounter( (LARGE_INTEGER *)&qpc_begin );
+	
+	store->last_event_count = store->event_count;
+	store->last_rule_count = 0;
+	store->last_predicate_count = 0;
+	store->last_match_count = 0;
+	
+	for( i = 0; i < store->event_count; ++i )
+	{
+		const struct rules_event *const event = &store->event[ i ];
+		const unsigned base = ( event->difftype - 1 ) * RULES_ID_SLOTS;
+		const int id = (int)(__int64)event->value[ RULES_ID ].number;
+		const unsigned slot = 
+			( ( ( id >= WH_MIN ) && ( id <= WH_MAX ) ) ? base + 1 + id - WH_MIN : base );
+		const unsigned *a = NULL, *a_end = NULL, *b = NULL, *b_end = NULL;
+		
+		
+		/* a new stamp invalidates the cached results of the predicates */
+		if( !++store->stamp )
+		{
+			for( j = 0; j < store->predicate_count; ++j )
+				store->predicate[ j ].stamp = 0;
+			
+			store->stamp = 1;
+		}
+		
+		/* the rules for any id and the rules for the event's id, merged in the file's order */
+		a = &store->bucket[ store->bucket_begin[ base ] ];
+		a_end = &store->bucket[ store->bucket_begin[ base + 1 ] ];
+		b = &store->bucket[ store->bucket_begin[ slot ] ];
+		b_end = ( ( slot != base ) ? &store->bucket[ store->bucket_begin[ slot + 1 ] ] : b );
+		
+		while( ( a < a_end ) || ( b < b_end ) )
+		{
+			struct rules_rule *rule = NULL;
+			
+			
+			if( ( b >= b_end ) || ( ( a < a_end ) && ( *a < *b ) ) )
+				rule = &store->rule[ *a++ ];
+			else
+				rule = &store->rule[ *b++ ];
+			
+			++store->last_rule_count;
+			
+			if( !run_rules_rule( store, rule, event ) )
+				continue;
+			
+			++rule->match_count;
+			++store->last_match_count;
+			
+			printf( "Rule '%s' matched the %s HOOK ", rule->name, 
+				rules_event_names[ event->difftype ]
+			);
+			PRINT_HEX_BARE( event->handle );
+			printf( " @ " );
+			PRINT_HEX_BARE( event->pHead );
+			printf( " on desktop '%ls'.\n", event->value[ RULES_DESKTOP ].text );
+		}
+	}
+	
+	store->event_count = 0;
+	
+	/* drop the HOOKs that were removed */
+	for( i = 0, j = 0; i < store->hook_count; ++i )
+	{
+		if( !store->hook[ i ].removed )
+			store->hook[ j++ ] = store->hook[ i ];
+	}
+	
+	if( j != store->hook_count )
+	{
+		store->hook_count = j;
+		rebuild_rules_hook_slots( store );
+	}
+	
+	QueryPerformanceCounter( (LARGE_INTEGER *)&qpc_end );
+	
+	store->last_us = ( store->qpc_frequency 
+		? ( ( qpc_end - qpc_begin ) * 1000000 / store->qpc_frequency ) : 0 );
+	
+	store->event_total += store->last_event_count;
+	store->rule_total += store->last_rule_count;
+	store->predicate_total += store->last_predicate_count;
+	store->match_total += store->last_match_count;
+	
+	if( store->last_match_count )
+		fflush( stdout );
+	
+	return;
+}
+
+
+
+/* print_rules_report() 
+Print the cost of the last evaluation and the number of matches of each rule.
+
+The cost is the number of rules and predicates evaluated per event, which depends on the rules 
+that can match each event and not on the number of rules.
+*/
+void print_rules_report( 
+	const struct rules *const store   // in
+)
+{
+	unsigned i = 0;
+	
+	FAIL_IF( !store );
+	FAIL_IF( !store->init_time );   // The rules store must be initialized.
+	
+	
+	printf( "Rules: %u events, %u matches, %u rule and %u predicate evaluations in %I64d us "
+		"(%u rules, %u predicates).\n", 
+		store->last_event_count, 
+		store->last_match_count, 
+		store->last_rule_count, 
+		store->last_predicate_count, 
+		store->last_us, 
+		store->rule_count, 
+		store->predicate_count
+	);
+	
+	if( store->event_total )
+	{
+		printf( "Rules: %I64u events so far, averaging %.2f rule and %.2f predicate evaluations "
+			"per event.\n", 
+			store->event_total, 
+			( (double)(__int64)store->rule_total / (double)(__int64)store->event_total ), 
+			( (double)(__int64)store->predicate_total / (double)(__int64)store->event_total )
+		);
+	}
+	
+	for( i = 0; i < store->rule_count; ++i )
+	{
+		if( store->rule[ i ].match_count )
+		{
+			printf( "Rule '%s' has matched %I64u events.\n", 
+				store->rule[ i ].name, 
+				store->rule[ i ].match_count
+			);
+		}
+	}
+	
+	return;
+}
+
+
+
+/* print_rules_store() 
+Print a rules store.
+
+if 'store' is NULL this function returns without having printed anything.
+*/
+void print_rules_store( 
+	const struct rules *const store   // in
+)
+{
+	const char *const objname = "Rules Store";
+	unsigned i = 0, j = 0;
+	
+	
+	if( !store )
+		return;
+	
+	PRINT_DBLSEP_BEGIN( objname );
+	
+	printf( "store->pwszFile: %ls\n", ( store->pwszFile ? store->pwszFile : L"<none>" ) );
+	printf( "store->rule_count: %u\n", store->rule_count );
+	printf( "store->predicate_count: %u\n", store->predicate_count );
+	printf( "store->program_count: %u\n", store->program_count );
+	printf( "store->hook_count: %u\n", store->hook_count );
+	printf( "store->event_total: %I64u\n", store->event_total );
+	printf( "store->match_total: %I64u\n", store->match_total );
+	
+	for( i = 0; i < store->rule_count; ++i )
+	{
+		const struct rules_rule *const rule = &store->rule[ i ];
+		
+		printf( "\nRule '%s' (line %u), events 0x%02X, id ", rule->name, rule->line, 
+			rule->event_mask
+		);
+		
+		if( rule->id == RULES_ID_ANY )
+			printf( "any" );
+		else
+			printf( "%d", rule->id );
+		
+		printf( ", %I64u matches:\n", rule->match_count );
+		
+		for( j = rule->begin; j < ( rule->begin + rule->count ); ++j )
+		{
+			const struct rules_op *const op = &store->program[ j ];
+			const struct rules_predicate *predicate = NULL;
+			
+			
+			if( op->code == RULES_OP_AND )
+			{
+				printf( "   and\n" );
+				continue;
+			}
+			else if( op->code == RULES_OP_OR )
+			{
+				printf( "   or\n" );
+				continue;
+			}
+			else if( op->code == RULES_OP_NOT )
+			{
+				printf( "   not\n" );
+				continue;
+			}
+			
+			predicate = &store->predicate[ op->arg ];
+			
+			printf( "   [%u] %s %s ", 
+				(unsigned)op->arg, 
+				rules_field_names[ predicate->field ], 
+				rules_cmp_names[ predicate->cmp ]
+			);
+			
+			if( predicate->text )
+				printf( "\"%ls\"\n", predicate->text );
+			else
+				printf( "%I64d\n", (__int64)predicate->number );
+		}
+	}
+	
+	print_init_time( "store->init_time", store->init_time );
+	
+	PRINT_DBLSEP_END( objname );
+	
+	return;
+}
+
+
+
+/* free_rules_store() 
+Free a rules store and all its descendants.
+
+The pointer to the store is set to NULL.
+
+if '*in' is NULL this function returns without having freed anything.
+*/
+void free_rules_store( 
+	struct rules **const in   // in deref
+)
+{
+	unsigned i = 0;
+	
+	FAIL_IF( !in );
+	
+	
+	if( !*in )
+		return;
+	
+	for( i = 0; i < (*in)->rule_count; ++i )
+		free( (*in)->rule[ i ].name );
+	
+	for( i = 0; i < (*in)->predicate_count; ++i )
+		free( (*in)->predicate[ i ].text );
+	
+	free( (*in)->pwszFile );
+	free( (*in)->rule );
+	free( (*in)->predicate );
+	free( (*in)->program );
+	free( (*in)->bucket );
+	free( (*in)->event );
+	free( (*in)->hook );
+	free( (*in)->hook_slot );
+	
+	free( *in );
+	*in = NULL;
+	
+	return;
+}
@@ -0,0 +1,302 @@
+/*
+Copyright (C) 2011 Jay Satiro <raysatiro@yahoo.com>
+All rights reserved.
+
+This file is part of GetHooks.
+
+GetHooks is free software: you can redistribute it and/or modify 
+it under the terms of the GNU General Public License as published by 
+the Free Software Foundation, either version 3 of the License, or 
+(at your option) any later version.
+
+GetHooks is distributed in the hope that it will be useful, 
+but WITHOUT ANY WARRANTY; without even the implied warranty of 
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License 
+along with GetHooks.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _RULES_H
+#define _RULES_H
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include "portable.h"
+#endif
+
+/* hook info struct */
+#include "desktop_hook.h"
+
+/* the diff types */
+#include "diff.h"
+
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/* the fields of a hook event that a rule can test. see the comment block above init_rules_store() 
+for the rule syntax.
+*/
+enum rules_field
+{
+	RULES_EVENT,   // the event: found, added, modified, removed or attributed
+	RULES_ID,   // the HOOK id
+	RULES_FLAGS,   // the HOOK flags
+	RULES_OWNER_IMAGE,   // the image name of the owner thread's process
+	RULES_OWNER_PID,   // the process id of the owner thread
+	RULES_ORIGIN_IMAGE,   // the image name of the origin thread's process
+	RULES_ORIGIN_PID,   // the process id of the origin thread
+	RULES_TARGET_IMAGE,   // the image name of the target thread's process
+	RULES_TARGET_PID,   // the process id of the target thread
+	RULES_DESKTOP,   // the desktop name
+	RULES_LIFETIME,   // the milliseconds since the HOOK was first found
+	RULES_ANOMALY,   // the anomaly bits. see HOOK_ANOMALY_*
+	RULES_FIELD_COUNT
+};
+
+
+/** This is a value of a field of a hook event.
+A number field has only 'number'. A text field has 'text' and 'cch', and 'text' isn't always null 
+terminated.
+*/
+struct rules_value
+{
+	UINT64 number;
+	
+	const WCHAR *text;
+	unsigned cch;
+};
+
+
+/** This is a hook event to be evaluated, with the values of all its fields.
+The image names point to the system process info of the snapshots, so the events are evaluated 
+before the next snapshot is taken. See evaluate_rules_store().
+*/
+struct rules_event
+{
+	enum difftype difftype;
+	
+	/* the time of the event in FILETIME format */
+	__int64 time;
+	
+	/* the HOOK's handle and kernel address */
+	HANDLE handle;
+	const void *pHead;
+	
+	/* the values of the fields, indexed by enum rules_field */
+	struct rules_value value[ RULES_FIELD_COUNT ];
+};
+
+
+/** This is a predicate: a comparison of one field of an event with a constant.
+Identical predicates in different rules are compiled to the same predicate, so it's evaluated at 
+most once per event however many rules use it.
+*/
+struct rules_predicate
+{
+	enum rules_field field;
+	
+	/* the comparison */
+	#define RULES_CMP_EQ   1   // =
+	#define RULES_CMP_NE   2   // !=
+	#define RULES_CMP_LT   3   // <
+	#define RULES_CMP_LE   4   // <=
+	#define RULES_CMP_GT   5   // >
+	#define RULES_CMP_GE   6   // >=
+	#define RULES_CMP_HAS   7   // has: all the bits are set
+	#define RULES_CMP_CONTAINS   8   // ~: the text contains the constant, ignoring case
+	unsigned cmp;
+	
+	/* the constant. text is compared ignoring case. */
+	UINT64 number;
+	WCHAR *text;   // get_wstr_from_mbstr(), free()
+	unsigned cch;
+	
+	/* the result for the event being evaluated, which is valid if 'stamp' is the store's stamp */
+	unsigned stamp;
+	unsigned result;
+};
+
+
+/** This is an instruction of a compiled rule.
+A rule is compiled to a postfix program: a predicate pushes its result on a stack of bits, 'and' 
+and 'or' pop two bits and push one, 'not' inverts the top bit. All the programs are in one array.
+*/
+struct rules_op
+{
+	#define RULES_OP_PREDICATE   0   // push the result of predicate 'arg'
+	#define RULES_OP_AND   1
+	#define RULES_OP_OR   2
+	#define RULES_OP_NOT   3
+	unsigned short code;
+	unsigned short arg;
+};
+
+
+/** This is a compiled rule.
+*/
+struct rules_rule
+{
+	/* the rule name and its line in the rules file */
+	char *name;   // calloc(), free()
+	unsigned line;
+	
+	/* the rule's program in the store's program array */
+	unsigned begin;
+	unsigned count;
+	
+	/* the events the rule can match, and the HOOK id it requires or RULES_ID_ANY. these are taken 
+	from the comparisons 'event = x' and 'id = x' that the whole rule depends on.
+	*/
+	unsigned event_mask;
+	#define RULES_ID_ANY   0x7FFFFFFF
+	int id;
+	
+	/* the number of events the rule matched */
+	unsigned __int64 match_count;
+};
+
+
+/** This is the info kept about a HOOK to get its lifetime.
+*/
+struct rules_hook
+{
+	const void *pHead;
+	HANDLE handle;
+	
+	/* the time the HOOK was first found in FILETIME format */
+	__int64 first_time;
+	
+	/* nonzero if the HOOK was removed. it's dropped after the events are evaluated. */
+	unsigned removed;
+};
+
+
+/** The rules store.
+The rules store matches hook events against user rules. The rules are compiled when the store is 
+initialized: each rule to a postfix program of predicates, with identical predicates shared. The 
+rules are indexed by the event and HOOK id they require, so only the rules that can match an event 
+are evaluated, and each predicate is evaluated at most once for an event. The events are added as 
+they're printed and evaluated in a batch after each snapshot. See evaluate_rules_store().
+*/
+struct rules
+{
+	/* the rules file */
+	WCHAR *pwszFile;   // _wcsdup(), free()
+	
+	/* the compiled rules, their predicates and their programs */
+	struct rules_rule *rule;   // calloc(), free()
+	unsigned rule_max;
+	unsigned rule_count;
+	
+	#define RULES_PREDICATES_MAX   65535
+	struct rules_predicate *predicate;   // calloc(), free()
+	unsigned predicate_max;
+	unsigned predicate_count;
+	
+	struct rules_op *program;   // calloc(), free()
+	unsigned program_max;
+	unsigned program_count;
+	
+	/* the index of the rules by event and HOOK id. 'bucket' is an array of rule indexes grouped by 
+	bucket, and the rules in bucket n are from bucket_begin[ n ] up to bucket_begin[ n + 1 ]. there 
+	are RULES_ID_SLOTS buckets for each event: the first for the rules that don't require an id, 
+	then one for each id from WH_MIN to WH_MAX.
+	*/
+	#define RULES_EVENTS   HOOK_ATTRIBUTED
+	#define RULES_ID_SLOTS   ( 1 + CWINHOOKS )
+	unsigned *bucket;   // calloc(), free()
+	unsigned bucket_begin[ ( RULES_EVENTS * RULES_ID_SLOTS ) + 1 ];
+	
+	/* the events added since the last evaluation */
+	struct rules_event *event;   // calloc(), free()
+	unsigned event_max;
+	unsigned event_count;
+	
+	/* the HOOKs that were found, and the hash table of their addresses. each slot is 0 or the 
+	index + 1 of an element in the hook array. the number of slots is a power of 2 that's at least 
+	twice the number of elements.
+	*/
+	struct rules_hook *hook;   // calloc(), free()
+	unsigned hook_max;
+	unsigned hook_count;
+	unsigned *hook_slot;   // calloc(), free()
+	unsigned hook_slot_max;
+	
+	/* incremented for each event evaluated. see rules_predicate.stamp */
+	unsigned stamp;
+	
+	/* in the last evaluation the number of events, the number of rules evaluated, the number of 
+	predicates evaluated, the number of matches and the time it took in microseconds
+	*/
+	unsigned last_event_count;
+	unsigned last_rule_count;
+	unsigned last_predicate_count;
+	unsigned last_match_count;
+	__int64 last_us;
+	
+	/* the totals of all evaluations */
+	unsigned __int64 event_total;
+	unsigned __int64 rule_total;
+	unsigned __int64 predicate_total;
+	unsigned __int64 match_total;
+	
+	/* the performance counter frequency */
+	__int64 qpc_frequency;
+	
+	/* the system utc time in FILETIME format immediately after this store has been initialized.
+	this is nonzero when this store has been initialized.
+	*/
+	__int64 init_time;
+};
+
+
+
+/** 
+these functions are documented in the comment block above their definitions in rules.c
+*/
+void create_rules_store( 
+	struct rules **const out   // out deref
+);
+
+int init_rules_store( 
+	struct rules *const store,   // in
+	const WCHAR *const pwszFile   // in
+);
+
+void add_rules_event( 
+	struct rules *const store,   // in
+	const struct hook *const hook,   // in
+	const WCHAR *const deskname,   // in
+	const enum difftype difftype,   // in
+	const __int64 time   // in
+);
+
+void evaluate_rules_store( 
+	struct rules *const store   // in
+);
+
+void print_rules_report( 
+	const struct rules *const store   // in
+);
+
+void print_rules_store( 
+	const struct rules *const store   // in
+);
+
+void free_rules_store( 
+	struct rules **const in   // in deref
+);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _RULES_H
@@ -0,0 +1,1657 @@
+/*
+Copyright (C) 2011 Jay Satiro <raysatiro@yahoo.com>
+All rights reserved.
+
+This file is part of GetHooks.
+
+GetHooks is free software: you can redistribute it and/or modify 
+it under the terms of the GNU General Public License as published by 
+the Free Software Foundation, either version 3 of the License, or 
+(at your option) any later version.
+
+GetHooks is distributed in the hope that it will be useful, 
+but WITHOUT ANY WARRANTY; without even the implied warranty of 
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License 
+along with GetHooks.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/** 
+This file contains functions for a scheduler store (a work-stealing pool of worker threads).
+Each function is documented in the comment block above its definition.
+
+The scheduler runs the parallel work in gethooks: each task is spawned in a task group, and the 
+group is joined to wait for its tasks. Each worker thread has its own deque of tasks and steals from 
+the other workers when it runs out. A group can be cancelled by a deadline so that work for a 
+snapshot that can't finish in time is skipped.
+
+When _WIN32 isn't defined this file uses the portable backend (POSIX threads) and doesn't depend on 
+the rest of gethooks, so that it can be built, tested and benchmarked on its own on other systems.
+See portable.h.
+
+-
+get_sched_clock()
+
+Get the scheduler clock in microseconds.
+-
+
+-
+get_sched_processor_count()
+
+Get the number of processors.
+-
+
+-
+init_sched_lock(), enter_sched_lock(), leave_sched_lock(), delete_sched_lock()
+
+Initialize, enter, leave and delete a lock.
+-
+
+-
+init_sched_sem(), post_sched_sem(), wait_sched_sem(), delete_sched_sem()
+
+Initialize, post, wait on and delete a semaphore.
+-
+
+-
+yield_sched_thread()
+
+Yield the rest of the calling thread's time slice.
+-
+
+-
+init_sched_deque()
+
+Initialize a deque.
+-
+
+-
+push_sched_deque()
+
+Push a task on the bottom of a deque.
+-
+
+-
+take_sched_deque()
+
+Take a task from the bottom or the top of a deque.
+-
+
+-
+delete_sched_deque()
+
+Delete a deque.
+-
+
+-
+get_sched_task()
+
+Get a task for a worker to run.
+-
+
+-
+run_sched_task()
+
+Run a task, or skip it if its group has been cancelled.
+-
+
+-
+work()
+
+The worker loop.
+-
+
+-
+thread()
+
+The worker thread function.
+-
+
+-
+start_sched_worker()
+
+Start a worker thread.
+-
+
+-
+create_sched_store()
+
+Create a scheduler store or die.
+-
+
+-
+init_sched_store()
+
+Initialize a scheduler store by starting its worker threads.
+-
+
+-
+create_sched_group()
+
+Create a task group or die.
+-
+
+-
+set_sched_group_deadline()
+
+Set the time at which a task group is cancelled.
+-
+
+-
+cancel_sched_group()
+
+Cancel a task group.
+-
+
+-
+is_sched_group_cancelled()
+
+Check whether a task group has been cancelled.
+-
+
+-
+spawn_sched_task()
+
+Spawn a task in a task group.
+-
+
+-
+join_sched_group()
+
+Wait for all the tasks in a task group to finish.
+-
+
+-
+get_sched_worker_index()
+
+Get the index of the worker thread that is calling this function.
+-
+
+-
+free_sched_group()
+
+Free a task group.
+-
+
+-
+print_sched_store()
+
+Print a scheduler store.
+-
+
+-
+free_sched_store()
+
+Stop the worker threads and free a scheduler store.
+-
+
+-
+benchmark_sched_store()
+
+Measure how the scheduler scales from one worker thread to one for each processor.
+-
+
+*/
+
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <process.h>
+
+#include "util.h"
+#else
+#include <errno.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#include "portable.h"
+
+#include "scheduler.h"
+
+
+
+#ifdef _WIN32
+#define SCHED_INCREMENT(p)   InterlockedIncrement( ( p ) )
+#define SCHED_DECREMENT(p)   InterlockedDecrement( ( p ) )
+#define SCHED_EXCHANGE(p,v)   InterlockedExchange( ( p ), ( v ) )
+#define SCHED_READ(p)   InterlockedCompareExchange( ( p ), 0, 0 )
+
+#define SCHED_THREAD_LOCAL   __declspec( thread )
+#else
+#define SCHED_INCREMENT(p)   __sync_add_and_fetch( ( p ), 1 )
+#define SCHED_DECREMENT(p)   __sync_sub_and_fetch( ( p ), 1 )
+#define SCHED_EXCHANGE(p,v)   ( __sync_synchronize(), __sync_lock_test_and_set( ( p ), ( v ) ) )
+#define SCHED_READ(p)   __sync_val_compare_and_swap( ( p ), 0, 0 )
+
+#define SCHED_THREAD_LOCAL   __thread
+#endif
+
+
+/* the largest number of worker threads */
+#define SCHED_WORKERS_MAX   64
+
+/* how many times a worker that can't find a task looks again before it parks */
+#define SCHED_SPIN_COUNT   64
+
+
+/* the worker that is running on this thread, or NULL if this thread isn't a worker */
+static SCHED_THREAD_LOCAL struct sched_worker *current;
+
+
+
+static void init_sched_lock( 
+	struct sched_lock *const lock   // in
+);
+
+static void enter_sched_lock( 
+	struct sched_lock *const lock   // in
+);
+
+static void leave_sched_lock( 
+	struct sched_lock *const lock   // in
+);
+
+static void delete_sched_lock( 
+	struct sched_lock *const lock   // in
+);
+
+static void init_sched_sem( 
+	struct sched_sem *const sem   // in
+);
+
+static void post_sched_sem( 
+	struct sched_sem *const sem,   // in
+	const long count   // in
+);
+
+static int wait_sched_sem( 
+	struct sched_sem *const sem,   // in
+	const unsigned ms   // in
+);
+
+static void delete_sched_sem( 
+	struct sched_sem *const sem   // in
+);
+
+static void yield_sched_thread( void );
+
+static void init_sched_deque( 
+	struct sched_deque *const deque   // in
+);
+
+static void push_sched_deque( 
+	struct sched_deque *const deque,   // in
+	const struct sched_task *const task   // in
+);
+
+static int take_sched_deque( 
+	struct sched_deque *const deque,   // in
+	struct sched_task *const out,   // out
+	const int bottom   // in
+);
+
+static void delete_sched_deque( 
+	struct sched_deque *const deque   // in
+);
+
+static int get_sched_task( 
+	struct sched *const store,   // in
+	struct sched_worker *const worker,   // in
+	struct sched_task *const out   // out
+);
+
+static void run_sched_task( 
+	struct sched_worker *const worker,   // in
+	const struct sched_task *const task   // in
+);
+
+static void work( 
+	struct sched_worker *const worker   // in
+);
+
+static void start_sched_worker( 
+	struct sched_worker *const worker   // in
+);
+
+
+
+/* get_sched_clock() 
+Get the scheduler clock in microseconds.
+
+The clock is monotonic and only meaningful relative to other readings of it. On Windows it's the 
+performance counter.
+
+returns the clock in microseconds
+*/
+__int64 get_sched_clock( void )
+{
+#ifdef _WIN32
+	static __int64 frequency;
+	__int64 counter = 0;
+	
+	
+	if( !frequency )
+		QueryPerformanceFrequency( (LARGE_INTEGER *)&frequency );
+	
+	QueryPerformanceCounter( (LARGE_INTEGER *)&counter );
+	
+	return ( ( counter / frequency ) * 1000000 ) 
+		+ ( ( ( counter % frequency ) * 1000000 ) / frequency );
+#else
+	struct timespec ts;
+	
+	
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	
+	return ( (__int64)ts.tv_sec * 1000000 ) + ( ts.tv_nsec / 1000 );
+#endif
+}
+
+
+
+/* get_sched_processor_count() 
+Get the number of processors.
+
+returns the number of processors, at least 1
+*/
+unsigned get_sched_processor_count( void )
+{
+#ifdef _WIN32
+	SYSTEM_INFO si;
+	
+	
+	ZeroMemory( &si, sizeof( si ) );
+	GetSystemInfo( &si );
+	
+	return si.dwNumberOfProcessors ? (unsigned)si.dwNumberOfProcessors : 1;
+#else
+	const long count = sysconf( _SC_NPROCESSORS_ONLN );
+	
+	
+	return ( count > 0 ) ? (unsigned)count : 1;
+#endif
+}
+
+
+
+/* init_sched_lock(), enter_sched_lock(), leave_sched_lock(), delete_sched_lock() 
+Initialize, enter, leave and delete a lock.
+*/
+static void init_sched_lock( 
+	struct sched_lock *const lock   // in
+)
+{
+	FAIL_IF( !lock );
+
+
+#ifdef _WIN32
+	InitializeCriticalSection( &lock->cs );
+#else
+	if( pthread_mutex_init( &lock->mutex, NULL ) )
+	{
+		MSG_FATAL( "pthread_mutex_init() failed." );
+		exit( 1 );
+	}
+#endif
+
+	return;
+}
+
+static void enter_sched_lock( 
+	struct sched_lock *const lock   // in
+)
+{
+#ifdef _WIN32
+	EnterCriticalSection( &lock->cs );
+#else
+	pthread_mutex_lock( &lock->mutex );
+#endif
+
+	return;
+}
+
+static void leave_sched_lock( 
+	struct sched_lock *const lock   // in
+)
+{
+#ifdef _WIN32
+	LeaveCriticalSection( &lock->cs );
+#else
+	pthread_mutex_unlock( &lock->mutex );
+#endif
+
+	return;
+}
+
+static void delete_sched_lock( 
+	struct sched_lock *const lock   // in
+)
+{
+#ifdef _WIN32
+	DeleteCriticalSection( &lock->cs );
+#else
+	pthread_mutex_destroy( &lock->mutex );
+#endif
+
+	return;
+}
+
+
+
+/* init_sched_sem(), post_sched_sem(), wait_sched_sem(), delete_sched_sem() 
+Initialize, post, wait on and delete a semaphore.
+
+post_sched_sem() adds 'count' to the semaphore. wait_sched_sem() waits up to 'ms' milliseconds for 
+the semaphore to be nonzero and then subtracts 1.
+
+wait_sched_sem() returns nonzero if the semaphore was nonzero, or zero if the wait timed out
+*/
+static void init_sched_sem( 
+	struct sched_sem *const sem   // in
+)
+{
+	FAIL_IF( !sem );
+
+
+#ifdef _WIN32
+	sem->handle = CreateSemaphore( NULL, 0, LONG_MAX, NULL );
+	if( !sem->handle )
+	{
+		MSG_FATAL_GLE( "CreateSemaphore() failed." );
+		exit( 1 );
+	}
+#else
+	if( pthread_mutex_init( &sem->mutex, NULL ) || pthread_cond_init( &sem->cond, NULL ) )
+	{
+		MSG_FATAL( "pthread_mutex_init() or pthread_cond_init() failed." );
+		exit( 1 );
+	}
+	
+	sem->count = 0;
+#endif
+
+	return;
+}
+
+static void post_sched_sem( 
+	struct sched_sem *const sem,   // in
+	const long count   // in
+)
+{
+	if( count <= 0 )
+		return;
+
+#ifdef _WIN32
+	ReleaseSemaphore( sem->handle, count, NULL );
+#else
+	pthread_mutex_lock( &sem->mutex );
+	sem->count += (unsigned)count;
+	
+	if( count == 1 )
+		pthread_cond_signal( &sem->cond );
+	else
+		pthread_cond_broadcast( &sem->cond );
+	
+	pthread_mutex_unlock( &sem->mutex );
+#endif
+
+	return;
+}
+
+static int wait_sched_sem( 
+	struct sched_sem *const sem,   // in
+	const unsigned ms   // in
+)
+{
+#ifdef _WIN32
+	return ( WaitForSingleObject( sem->handle, ms ) == WAIT_OBJECT_0 );
+#else
+	struct timespec ts;
+	int ret = FALSE;
+	
+	
+	clock_gettime( CLOCK_REALTIME, &ts );
+	ts.tv_sec += ms / 1000;
+	ts.tv_nsec += (long)( ms % 1000 ) * 1000000;
+	
+	if( ts.tv_nsec >= 1000000000 )
+	{
+		++ts.tv_sec;
+		ts.tv_nsec -= 1000000000;
+	}
+	
+	pthread_mutex_lock( &sem->mutex );
+	
+	while( !sem->count )
+	{
+		if( pthread_cond_timedwait( &sem->cond, &sem->mutex, &ts ) == ETIMEDOUT )
+			break;
+	}
+	
+	if( sem->count )
+	{
+		--sem->count;
+		ret = TRUE;
+	}
+	
+	pthread_mutex_unlock( &sem->mutex );
+	
+	return ret;
+#endif
+}
+
+static void delete_sched_sem( 
+	struct sched_sem *const sem   // in
+)
+{
+#ifdef _WIN32
+	if( sem->handle )
+	{
+		CloseHandle( sem->handle );
+		sem->handle = NULL;
+	}
+#else
+	pthread_cond_destroy( &sem->cond );
+	pthread_mutex_destroy( &sem->mutex );
+#endif
+
+	return;
+}
+
+
+
+/* yield_sched_thread() 
+Yield the rest of the calling thread's time slice.
+*/
+static void yield_sched_thread( void )
+{
+#ifdef _WIN32
+	SwitchToThread();
+#else
+	sched_yield();
+#endif
+
+	return;
+}
+
+
+
+/* init_sched_deque() 
+Initialize a deque.
+*/
+static void init_sched_deque( 
+	struct sched_deque *const deque   // in
+)
+{
+	FAIL_IF( !deque );
+	FAIL_IF( deque->task );
+	
+	
+	init_sched_lock( &deque->lock );
+	
+	deque->max = SCHED_DEQUE_MIN;
+	deque->task = must_calloc( deque->max, sizeof( *deque->task ) );
+	
+	deque->top = 0;
+	deque->bottom = 0;
+	
+	return;
+}
+
+
+
+/* push_sched_deque() 
+Push a task on the bottom of a deque.
+
+If the deque is full then its task array is doubled and the tasks are copied to the new array in 
+order, starting at index 0.
+*/
+static void push_sched_deque( 
+	struct sched_deque *const deque,   // in
+	const struct sched_task *const task   // in
+)
+{
+	enter_sched_lock( &deque->lock );
+	
+	if( ( deque->bottom - deque->top ) == deque->max )
+	{
+		struct sched_task *const old = deque->task;
+		const unsigned count = deque->bottom - deque->top;
+		unsigned i = 0;
+		
+		
+		deque->task = must_calloc( deque->max * 2, sizeof( *deque->task ) );
+		
+		for( i = 0; i < count; ++i )
+			deque->task[ i ] = old[ ( deque->top + i ) & ( deque->max - 1 ) ];
+		
+		free( old );
+		
+		deque->max *= 2;
+		deque->top = 0;
+		deque->bottom = count;
+	}
+	
+	deque->task[ deque->bottom & ( deque->max - 1 ) ] = *task;
+	++deque->bottom;
+	
+	leave_sched_lock( &deque->lock );
+	return;
+}
+
+
+
+/* take_sched_deque() 
+Take a task from the bottom or the top of a deque.
+
+If 'bottom' is nonzero then the newest task is taken, otherwise the oldest task is taken.
+
+returns nonzero if a task was taken and copied to 'out', or zero if the deque is empty
+*/
+static int take_sched_deque( 
+	struct sched_deque *const deque,   // in
+	struct sched_task *const out,   // out
+	const int bottom   // in
+)
+{
+	int ret = FALSE;
+	
+	
+	/* check without the lock first so that the deques of idle workers aren't contended */
+	if( deque->top == deque->bottom )
+		return FALSE;
+	
+	enter_sched_lock( &deque->lock );
+	
+	if( deque->top != deque->bottom )
+	{
+		if( bottom )
+		{
+			--deque->bottom;
+			*out = deque->task[ deque->bottom & ( deque->max - 1 ) ];
+		}
+		else
+		{
+			*out = deque->task[ deque->top & ( deque->max - 1 ) ];
+			++deque->top;
+		}
+		
+		ret = TRUE;
+	}
+	
+	leave_sched_lock( &deque->lock );
+	return ret;
+}
+
+
+
+/* delete_sched_deque() 
+Delete a deque.
+*/
+static void delete_sched_deque( 
+	struct sched_deque *const deque   // in
+)
+{
+	if( !deque->task )
+		return;
+	
+	delete_sched_lock( &deque->lock );
+	
+	free( deque->task );
+	deque->task = NULL;
+	
+	return;
+}
+
+
+
+/* get_sched_task() 
+Get a task for a worker to run.
+
+The worker takes the newest task from its own deque, and if there isn't one then the oldest task in 
+the injection queue, and if there isn't one then it tries to steal the oldest task from each of the 
+other workers, starting with a random one.
+
+returns nonzero if a task was copied to 'out'
+*/
+static int get_sched_task( 
+	struct sched *const store,   // in
+	struct sched_worker *const worker,   // in
+	struct sched_task *const out   // out
+)
+{
+	unsigned victim = 0;
+	unsigned i = 0;
+	
+	
+	if( take_sched_deque( &worker->deque, out, TRUE ) )
+		return TRUE;
+	
+	if( take_sched_deque( &store->inject, out, FALSE ) )
+		return TRUE;
+	
+	if( store->worker_count < 2 )
+		return FALSE;
+	
+	worker->seed = ( worker->seed * 1664525u ) + 1013904223u;
+	victim = ( worker->seed >> 16 ) % store->worker_count;
+	
+	for( i = 0; i < store->worker_count; ++i, victim = ( victim + 1 ) % store->worker_count )
+	{
+		if( victim == worker->index )
+			continue;
+		
+		++worker->steal_attempts;
+		
+		if( take_sched_deque( &store->worker[ victim ].deque, out, FALSE ) )
+		{
+			++worker->steal_count;
+			return TRUE;
+		}
+	}
+	
+	return FALSE;
+}
+
+
+
+/* run_sched_task() 
+Run a task, or skip it if its group has been cancelled.
+
+When the last task in a group finishes and a thread that isn't a worker is joining then the joining 
+threads are woken. The group may be freed as soon as its pending count is 0, so the group isn't 
+touched after that.
+*/
+static void run_sched_task( 
+	struct sched_worker *const worker,   // in
+	const struct sched_task *const task   // in
+)
+{
+	struct sched_group *const group = task->group;
+	struct sched *const store = group->store;
+	long joining = 0;
+	
+	
+	if( is_sched_group_cancelled( group ) )
+	{
+		SCHED_INCREMENT( &group->skipped );
+		++worker->skip_count;
+	}
+	else
+	{
+		task->pfn( task->param, group );
+		++worker->run_count;
+	}
+	
+	if( SCHED_DECREMENT( &group->pending ) )
+		return;
+	
+	joining = SCHED_READ( &store->joining );
+	if( joining )
+		post_sched_sem( &store->joined, joining );
+	
+	return;
+}
+
+
+
+/* work() 
+The worker loop.
+
+The worker runs tasks until the store is terminated. When there are no tasks it looks again up to 
+SCHED_SPIN_COUNT times and then parks on the wake semaphore. A worker counts itself as sleeping 
+before it looks for a task the last time, so a task spawned after that look wakes it.
+*/
+static void work( 
+	struct sched_worker *const worker   // in
+)
+{
+	struct sched *const store = worker->store;
+	unsigned spin = 0;
+	
+	
+	current = worker;
+	
+	while( !SCHED_READ( &store->terminate ) )
+	{
+		struct sched_task task;
+		
+		
+		if( get_sched_task( store, worker, &task ) )
+		{
+			run_sched_task( worker, &task );
+			spin = 0;
+			continue;
+		}
+		
+		if( spin < SCHED_SPIN_COUNT )
+		{
+			++spin;
+			yield_sched_thread();
+			continue;
+		}
+		
+		SCHED_INCREMENT( &store->sleeping );
+		
+		if( get_sched_task( store, worker, &task ) )
+		{
+			SCHED_DECREMENT( &store->sleeping );
+			run_sched_task( worker, &task );
+			spin = 0;
+			continue;
+		}
+		
+		if( !SCHED_READ( &store->terminate ) )
+		{
+			++worker->park_count;
+			wait_sched_sem( &store->wake, SCHED_PARK_MS );
+		}
+		
+		SCHED_DECREMENT( &store->sleeping );
+	}
+	
+	current = NULL;
+	return;
+}
+
+
+
+/* thread() 
+The worker thread function.
+
+returns 0
+*/
+#ifdef _WIN32
+static unsigned __stdcall thread( 
+	void *p   // in
+)
+{
+	work( (struct sched_worker *)p );
+	return 0;
+}
+#else
+static void *thread( 
+	void *p   // in
+)
+{
+	work( (struct sched_worker *)p );
+	return NULL;
+}
+#endif
+
+
+
+/* start_sched_worker() 
+Start a worker thread.
+*/
+static void start_sched_worker( 
+	struct sched_worker *const worker   // in
+)
+{
+#ifdef _WIN32
+	worker->hThread = (HANDLE)_beginthreadex( NULL, 0, thread, worker, 0, NULL );
+	if( !worker->hThread )
+	{
+		MSG_FATAL( _strerror( "_beginthreadex() failed" ) );
+		exit( 1 );
+	}
+#else
+	if( pthread_create( &worker->thread, NULL, thread, worker ) )
+	{
+		MSG_FATAL( "pthread_create() failed." );
+		exit( 1 );
+	}
+	
+	worker->have_thread = TRUE;
+#endif
+
+	return;
+}
+
+
+
+/* create_sched_store() 
+Create a scheduler store or die.
+*/
+void create_sched_store( 
+	struct sched **const out   // out deref
+)
+{
+	struct sched *sched = NULL;
+	
+	FAIL_IF( !out );
+	FAIL_IF( *out );
+	
+	
+	/* allocate a scheduler store */
+	sched = must_calloc( 1, sizeof( *sched ) );
+	
+	
+	*out = sched;
+	return;
+}
+
+
+
+/* init_sched_store() 
+Initialize a scheduler store by starting its worker threads.
+
+'worker_count' is the number of worker threads. If it's 0 then there is one worker thread for each 
+processor. The number of worker threads is at most SCHED_WORKERS_MAX.
+
+returns nonzero on success
+*/
+int init_sched_store( 
+	struct sched *const store,   // in
+	const unsigned worker_count   // in, optional
+)
+{
+	unsigned i = 0;
+	
+	FAIL_IF( !store );
+	FAIL_IF( store->init_time );   // Fail if this store has already been initialized.
+	
+	
+	store->worker_count = worker_count ? worker_count : get_sched_processor_count();
+	
+	if( store->worker_count > SCHED_WORKERS_MAX )
+		store->worker_count = SCHED_WORKERS_MAX;
+	
+	init_sched_deque( &store->inject );
+	init_sched_sem( &store->wake );
+	init_sched_sem( &store->joined );
+	
+	store->worker = must_calloc( store->worker_count, sizeof( *store->worker ) );
+	
+	for( i = 0; i < store->worker_count; ++i )
+	{
+		store->worker[ i ].store = store;
+		store->worker[ i ].index = i;
+		store->worker[ i ].seed = ( i * 2654435761u ) + 1;
+		
+		init_sched_deque( &store->worker[ i ].deque );
+	}
+	
+	for( i = 0; i < store->worker_count; ++i )
+		start_sched_worker( &store->worker[ i ] );
+	
+	
+	/* the scheduler store has been initialized */
+#ifdef _WIN32
+	GetSystemTimeAsFileTime( (FILETIME *)&store->init_time );
+#else
+	store->init_time = PORTABLE_UTC_NOW();
+#endif
+	return TRUE;
+}
+
+
+
+/* create_sched_group() 
+Create a task group or die.
+*/
+void create_sched_group( 
+	struct sched *const store,   // in
+	struct sched_group **const out   // out deref
+)
+{
+	struct sched_group *group = NULL;
+	
+	FAIL_IF( !store );
+	FAIL_IF( !store->init_time );   // The scheduler store must be initialized.
+	
+	FAIL_IF( !out );
+	FAIL_IF( *out );
+	
+	
+	/* allocate a task group */
+	group = must_calloc( 1, sizeof( *group ) );
+	
+	group->store = store;
+	
+	
+	*out = group;
+	return;
+}
+
+
+
+/* set_sched_group_deadline() 
+Set the time at which a task group is cancelled.
+
+'deadline' is the scheduler clock in microseconds (see get_sched_clock()), or 0 for no deadline. A 
+task group has no deadline when it's created.
+*/
+void set_sched_group_deadline( 
+	struct sched_group *const group,   // in
+	const __int64 deadline   // in
+)
+{
+	FAIL_IF( !group );
+	
+	
+	group->deadline = deadline;
+	return;
+}
+
+
+
+/* cancel_sched_group() 
+Cancel a task group.
+
+The tasks in the group that haven't started yet are skipped. Running tasks aren't interrupted.
+*/
+void cancel_sched_group( 
+	struct sched_group *const group   // in
+)
+{
+	FAIL_IF( !group );
+	
+	
+	SCHED_EXCHANGE( &group->cancelled, TRUE );
+	return;
+}
+
+
+
+/* is_sched_group_cancelled() 
+Check whether a task group has been cancelled.
+
+A group is cancelled by cancel_sched_group() or when the scheduler clock reaches its deadline. A 
+long running task can call this function to stop early.
+
+returns nonzero if the group has been cancelled
+*/
+int is_sched_group_cancelled( 
+	struct sched_group *const group   // in
+)
+{
+	FAIL_IF( !group );
+	
+	
+	if( SCHED_READ( &group->cancelled ) )
+		return TRUE;
+	
+	if( group->deadline && ( get_sched_clock() >= group->deadline ) )
+	{
+		SCHED_EXCHANGE( &group->cancelled, TRUE );
+		return TRUE;
+	}
+	
+	return FALSE;
+}
+
+
+
+/* spawn_sched_task() 
+Spawn a task in a task group.
+
+If the calling thread is a worker then the task is pushed on the worker's deque, otherwise the task is 
+put in the injection queue. If a worker is parked then it's woken.
+*/
+void spawn_sched_task( 
+	struct sched_group *const group,   // in
+	void (*pfn)( void *param, struct sched_group *group ),   // in
+	void *const param   // in, optional
+)
+{
+	struct sched *store = NULL;
+	struct sched_task task;
+	
+	FAIL_IF( !group );
+	FAIL_IF( !pfn );
+	
+	
+	store = group->store;
+	
+	task.pfn = pfn;
+	task.param = param;
+	task.group = group;
+	
+	SCHED_INCREMENT( &group->pending );
+	SCHED_INCREMENT( &store->spawn_count );
+	
+	if( current && ( current->store == store ) )
+		push_sched_deque( &current->deque, &task );
+	else
+		push_sched_deque( &store->inject, &task );
+	
+	if( SCHED_READ( &store->sleeping ) )
+		post_sched_sem( &store->wake, 1 );
+	
+	return;
+}
+
+
+
+/* join_sched_group() 
+Wait for all the tasks in a task group to finish.
+
+A worker that joins a group runs other tasks while it waits, so a task can spawn tasks in its own 
+group and join it. Any other thread blocks until the group's tasks have finished.
+
+returns nonzero if all the tasks in the group ran, or zero if any were skipped because the group was 
+cancelled
+*/
+int join_sched_group( 
+	struct sched_group *const group   // in
+)
+{
+	struct sched *store = NULL;
+	
+	FAIL_IF( !group );
+	
+	
+	store = group->store;
+	
+	if( current && ( current->store == store ) )
+	{
+		while( SCHED_READ( &group->pending ) )
+		{
+			struct sched_task task;
+			
+			
+			if( get_sched_task( store, current, &task ) )
+				run_sched_task( current, &task );
+			else
+				yield_sched_thread();
+		}
+	}
+	else
+	{
+		SCHED_INCREMENT( &store->joining );
+		
+		while( SCHED_READ( &group->pending ) )
+			wait_sched_sem( &store->joined, SCHED_PARK_MS );
+		
+		SCHED_DECREMENT( &store->joining );
+	}
+	
+	return !SCHED_READ( &group->skipped );
+}
+
+
+
+/* get_sched_worker_index() 
+Get the index of the worker thread that is calling this function.
+
+A task can use the index to keep per worker state, like a table it counts in, without locking.
+
+returns the index of the worker in the store's worker array, or the number of workers if the 
+calling thread isn't one of the store's workers
+*/
+unsigned get_sched_worker_index( 
+	const struct sched *const store   // in
+)
+{
+	FAIL_IF( !store );
+	
+	
+	if( current && ( current->store == store ) )
+		return current->index;
+	
+	return store->worker_count;
+}
+
+
+
+/* free_sched_group() 
+Free a task group.
+
+The group must have been joined.
+
+this function then sets the task group pointer to NULL and returns
+
+'in' is a pointer to a pointer to the task group.
+if( !in || !*in ) then this function returns.
+*/
+void free_sched_group( 
+	struct sched_group **const in   // in deref
+)
+{
+	if( !in || !*in )
+		return;
+	
+	FAIL_IF( SCHED_READ( &(*in)->pending ) );   // The group must have been joined.
+	
+	free( (*in) );
+	*in = NULL;
+	
+	return;
+}
+
+
+
+/* print_sched_store() 
+Print a scheduler store.
+
+if 'store' is NULL this function returns without having printed anything.
+*/
+void print_sched_store( 
+	const struct sched *const store   // in
+)
+{
+	const char *const objname = "Scheduler Store";
+	unsigned i = 0;
+	
+	
+	if( !store )
+		return;
+	
+	PRINT_DBLSEP_BEGIN( objname );
+	print_init_time( "store->init_time", store->init_time );
+	
+	printf( "store->worker_count: %u\n", store->worker_count );
+	printf( "store->spawn_count: %ld\n", (long)store->spawn_count );
+	printf( "store->sleeping: %ld\n", (long)store->sleeping );
+	printf( "store->joining: %ld\n", (long)store->joining );
+	printf( "store->inject.max: %u\n", store->inject.max );
+	
+	for( i = 0; i < store->worker_count; ++i )
+	{
+		const struct sched_worker *const worker = &store->worker[ i ];
+		
+		
+		printf( 
+			"worker %u: run %" PORTABLE_I64U ", skipped %" PORTABLE_I64U ", stolen %" PORTABLE_I64U
+			" of %" PORTABLE_I64U " attempts, parked %" PORTABLE_I64U ", deque max %u\n", 
+			i, 
+			worker->run_count, 
+			worker->skip_count, 
+			worker->steal_count, 
+			worker->steal_attempts, 
+			worker->park_count, 
+			worker->deque.max
+		);
+	}
+	
+	PRINT_DBLSEP_END( objname );
+	
+	return;
+}
+
+
+
+/* free_sched_store() 
+Stop the worker threads and free a scheduler store.
+
+All the groups must have been joined. Tasks that are still queued aren't run.
+
+this function then sets the scheduler store pointer to NULL and returns
+
+'in' is a pointer to a pointer to the scheduler store.
+if( !in || !*in ) then this function returns.
+*/
+void free_sched_store( 
+	struct sched **const in   // in deref
+)
+{
+	unsigned i = 0;
+	
+	
+	if( !in || !*in )
+		return;
+	
+	if( (*in)->worker )
+	{
+		SCHED_EXCHANGE( &(*in)->terminate, TRUE );
+		post_sched_sem( &(*in)->wake, (long)(*in)->worker_count );
+		
+		for( i = 0; i < (*in)->worker_count; ++i )
+		{
+#ifdef _WIN32
+			if( (*in)->worker[ i ].hThread )
+			{
+				WaitForSingleObject( (*in)->worker[ i ].hThread, INFINITE );
+				CloseHandle( (*in)->worker[ i ].hThread );
+			}
+#else
+			if( (*in)->worker[ i ].have_thread )
+				pthread_join( (*in)->worker[ i ].thread, NULL );
+#endif
+
+			delete_sched_deque( &(*in)->worker[ i ].deque );
+		}
+		
+		free( (*in)->worker );
+		
+		delete_sched_deque( &(*in)->inject );
+		delete_sched_sem( &(*in)->wake );
+		delete_sched_sem( &(*in)->joined );
+	}
+	
+	free( (*in) );
+	*in = NULL;
+	
+	return;
+}
+
+
+
+/** the benchmark.
+The benchmark has two workloads. The tree workload is a binary tree of tasks in which each node 
+spawns its two children in a new group and joins it, and each leaf spins a random number generator.
+This is the fork-join pattern and most of its tasks are run by stealing. The flat workload is many 
+leaves of uneven cost spawned by the calling thread, which go through the injection queue.
+
+Each leaf counts itself and adds its result to the counters of the worker that ran it, and the 
+totals are compared with the results of running the leaves on the calling thread.
+*/
+#define SCHED_BENCH_DEPTH   13
+#define SCHED_BENCH_SPIN   20000
+#define SCHED_BENCH_FLAT   4096
+#define SCHED_BENCH_RUNS   3
+
+struct sched_bench_slot
+{
+	unsigned __int64 leaves;
+	unsigned __int64 sum;
+	
+	/* keep each worker's counters on its own cache line */
+	char pad[ 64 - ( 2 * sizeof( unsigned __int64 ) ) ];
+};
+
+struct sched_bench
+{
+	struct sched *store;
+	struct sched_bench_slot slot[ SCHED_WORKERS_MAX + 1 ];
+};
+
+struct sched_bench_node
+{
+	struct sched_bench *bench;
+	unsigned depth;
+	unsigned seed;
+};
+
+
+/* spin a random number generator 'count' times */
+static unsigned bench_spin( 
+	unsigned seed,   // in
+	unsigned count   // in
+)
+{
+	while( count-- )
+		seed = ( seed * 1664525u ) + 1013904223u;
+	
+	return seed;
+}
+
+/* a leaf of the flat workload. 'param' is the seed. */
+static void bench_flat_task( 
+	void *param,   // in
+	struct sched_group *group   // in
+)
+{
+	struct sched_bench *const bench = ( (struct sched_bench_node *)param )->bench;
+	const unsigned seed = ( (struct sched_bench_node *)param )->seed;
+	struct sched_bench_slot *const slot = &bench->slot[ get_sched_worker_index( group->store ) ];
+	
+	
+	slot->sum += bench_spin( seed, SCHED_BENCH_SPIN * ( 1 + ( seed % 7 ) ) / 4 );
+	++slot->leaves;
+	return;
+}
+
+/* a node of the tree workload. the children are on this task's stack, which is valid until the 
+group they were spawned in has been joined.
+*/
+static void bench_tree_task( 
+	void *param,   // in
+	struct sched_group *group   // in
+)
+{
+	const struct sched_bench_node *const node = (struct sched_bench_node *)param;
+	struct sched_bench_node child[ 2 ];
+	struct sched_group *sub = NULL;
+	unsigned i = 0;
+	
+	
+	if( !node->depth )
+	{
+		struct sched_bench_slot *const slot = 
+			&node->bench->slot[ get_sched_worker_index( group->store ) ];
+		
+		slot->sum += bench_spin( node->seed, SCHED_BENCH_SPIN );
+		++slot->leaves;
+		return;
+	}
+	
+	if( is_sched_group_cancelled( group ) )
+		return;
+	
+	create_sched_group( group->store, &sub );
+	set_sched_group_deadline( sub, group->deadline );
+	
+	for( i = 0; i < 2; ++i )
+	{
+		child[ i ].bench = node->bench;
+		child[ i ].depth = node->depth - 1;
+		child[ i ].seed = ( node->seed * 2 ) + i;
+		
+		spawn_sched_task( sub, bench_tree_task, &child[ i ] );
+	}
+	
+	join_sched_group( sub );
+	free_sched_group( &sub );
+	return;
+}
+
+/* run a workload on 'bench->store' and return the elapsed microseconds. the counters of each 
+worker are summed in 'leaves' and 'sum'.
+*/
+static __int64 bench_run( 
+	struct sched_bench *const bench,   // in
+	const int tree,   // in
+	const __int64 deadline,   // in
+	unsigned __int64 *const leaves,   // out
+	unsigned __int64 *const sum   // out
+)
+{
+	struct sched_group *group = NULL;
+	struct sched_bench_node root;
+	struct sched_bench_node *flat = NULL;
+	__int64 begin = 0;
+	__int64 elapsed = 0;
+	unsigned i = 0;
+	
+	
+	memset( bench->slot, 0, sizeof( bench->slot ) );
+	
+	if( !tree )
+	{
+		flat = must_calloc( SCHED_BENCH_FLAT, sizeof( *flat ) );
+		
+		for( i = 0; i < SCHED_BENCH_FLAT; ++i )
+		{
+			flat[ i ].bench = bench;
+			flat[ i ].seed = i;
+		}
+	}
+	
+	root.bench = bench;
+	root.depth = SCHED_BENCH_DEPTH;
+	root.seed = 1;
+	
+	begin = get_sched_clock();
+	
+	create_sched_group( bench->store, &group );
+	set_sched_group_deadline( group, deadline );
+	
+	if( tree )
+		spawn_sched_task( group, bench_tree_task, &root );
+	else
+	{
+		for( i = 0; i < SCHED_BENCH_FLAT; ++i )
+			spawn_sched_task( group, bench_flat_task, &flat[ i ] );
+	}
+	
+	join_sched_group( group );
+	free_sched_group( &group );
+	
+	elapsed = get_sched_clock() - begin;
+	
+	*leaves = 0;
+	*sum = 0;
+	
+	for( i = 0; i <= SCHED_WORKERS_MAX; ++i )
+	{
+		*leaves += bench->slot[ i ].leaves;
+		*sum += bench->slot[ i ].sum;
+	}
+	
+	free( flat );
+	return elapsed;
+}
+
+
+
+/* benchmark_sched_store() 
+Measure how the scheduler scales from one worker thread to one for each processor.
+
+'max_workers' is the largest number of worker threads to measure. If it's 0 or UI64_MAX then it's 
+the number of processors. The workloads are run with 1, 2, 4 ... worker threads up to 'max_workers', 
+and then once more with a deadline of half the time the last run took to show the cancellation.
+
+returns nonzero if every run got the same results as running the leaves on the calling thread
+*/
+unsigned __int64 benchmark_sched_store( 
+	const unsigned __int64 max_workers   // in
+)
+{
+	struct sched_bench *bench = NULL;
+	unsigned __int64 expected_leaves[ 2 ] = { 0, 0 };
+	unsigned __int64 expected_sum[ 2 ] = { 0, 0 };
+	__int64 base[ 2 ] = { 0, 0 };
+	__int64 last = 0;
+	unsigned __int64 leaves = 0;
+	unsigned __int64 sum = 0;
+	unsigned max = 0;
+	unsigned count = 0;
+	unsigned i = 0;
+	int ok = TRUE;
+	
+	
+	if( !max_workers || ( max_workers == (unsigned __int64)-1 ) )
+		max = get_sched_processor_count();
+	else if( max_workers > SCHED_WORKERS_MAX )
+		max = SCHED_WORKERS_MAX;
+	else
+		max = (unsigned)max_workers;
+	
+	bench = must_calloc( 1, sizeof( *bench ) );
+	
+	/* the results of running the leaves on the calling thread */
+	for( i = 0; i < ( 1u << SCHED_BENCH_DEPTH ); ++i )
+		expected_sum[ 1 ] += bench_spin( ( 1u << SCHED_BENCH_DEPTH ) + i, SCHED_BENCH_SPIN );
+	
+	expected_leaves[ 1 ] = 1u << SCHED_BENCH_DEPTH;
+	
+	for( i = 0; i < SCHED_BENCH_FLAT; ++i )
+		expected_sum[ 0 ] += bench_spin( i, SCHED_BENCH_SPIN * ( 1 + ( i % 7 ) ) / 4 );
+	
+	expected_leaves[ 0 ] = SCHED_BENCH_FLAT;
+	
+	printf( "\nScheduler benchmark (%u processors, up to %u workers).\n", 
+		get_sched_processor_count(), 
+		max
+	);
+	printf( "The tree workload is %u leaves of fork-join tasks and the flat workload is %u tasks.\n", 
+		1u << SCHED_BENCH_DEPTH, 
+		SCHED_BENCH_FLAT
+	);
+	printf( "The times are the best of %u runs.\n\n", SCHED_BENCH_RUNS );
+	printf( "workers   tree ms  speedup  eff%%   flat ms  speedup  eff%%    stolen    parked\n" );
+	
+	for( count = 1; count <= max; count = ( ( count * 2 ) > max && count != max ) ? max : count * 2 )
+	{
+		__int64 best[ 2 ] = { 0, 0 };
+		unsigned __int64 stolen = 0;
+		unsigned __int64 parked = 0;
+		int tree = 0;
+		unsigned run = 0;
+		
+		
+		create_sched_store( &bench->store );
+		init_sched_store( bench->store, count );
+		
+		for( tree = 0; tree < 2; ++tree )
+		{
+			for( run = 0; run < SCHED_BENCH_RUNS; ++run )
+			{
+				const __int64 elapsed = bench_run( bench, tree, 0, &leaves, &sum );
+				
+				
+				if( ( leaves != expected_leaves[ tree ] ) || ( sum != expected_sum[ tree ] ) )
+				{
+					printf( "The %s workload with %u workers got the wrong results.\n", 
+						( tree ? "tree" : "flat" ), 
+						count
+					);
+					ok = FALSE;
+				}
+				
+				if( !best[ tree ] || ( elapsed < best[ tree ] ) )
+					best[ tree ] = elapsed;
+			}
+			
+			if( count == 1 )
+				base[ tree ] = best[ tree ];
+		}
+		
+		for( i = 0; i < bench->store->worker_count; ++i )
+		{
+			stolen += bench->store->worker[ i ].steal_count;
+			parked += bench->store->worker[ i ].park_count;
+		}
+		
+		printf( "%7u  %8.1f  %7.2f  %4.0f  %8.1f  %7.2f  %4.0f  %8" PORTABLE_I64U
+			"  %8" PORTABLE_I64U "\n", 
+			count, 
+			best[ 1 ] / 1000.0, 
+			(double)base[ 1 ] / ( best[ 1 ] ? best[ 1 ] : 1 ), 
+			100.0 * base[ 1 ] / ( ( best[ 1 ] ? best[ 1 ] : 1 ) * (double)count ), 
+			best[ 0 ] / 1000.0, 
+			(double)base[ 0 ] / ( best[ 0 ] ? best[ 0 ] : 1 ), 
+			100.0 * base[ 0 ] / ( ( best[ 0 ] ? best[ 0 ] : 1 ) * (double)count ), 
+			stolen, 
+			parked
+		);
+		
+		last = best[ 1 ];
+		
+		if( count == max )
+			break;
+		
+		free_sched_store( &bench->store );
+	}
+	
+	/* run the tree workload again with a deadline of half the time it took */
+	{
+		const __int64 elapsed = 
+			bench_run( bench, TRUE, get_sched_clock() + ( last / 2 ), &leaves, &sum );
+		
+		
+		printf( "\nWith a deadline of %.1f ms the tree workload was cancelled after %.1f ms "
+			"and ran %" PORTABLE_I64U " of %" PORTABLE_I64U " leaves.\n", 
+			( last / 2 ) / 1000.0, 
+			elapsed / 1000.0, 
+			leaves, 
+			expected_leaves[ 1 ]
+		);
+	}
+	
+	free_sched_store( &bench->store );
+	free( bench );
+	
+	printf( "\nThe benchmark %s.\n", ( ok ? "passed" : "failed" ) );
+	return ok;
+}
@@ -0,0 +1,287 @@
+/*
+Copyright (C) 2011 Jay Satiro <raysatiro@yahoo.com>
+All rights reserved.
+
+This file is part of GetHooks.
+
+GetHooks is free software: you can redistribute it and/or modify 
+it under the terms of the GNU General Public License as published by 
+the Free Software Foundation, either version 3 of the License, or 
+(at your option) any later version.
+
+GetHooks is distributed in the hope that it will be useful, 
+but WITHOUT ANY WARRANTY; without even the implied warranty of 
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License 
+along with GetHooks.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _SCHEDULER_H
+#define _SCHEDULER_H
+
+/* The scheduler has two backends. The Windows backend uses _beginthreadex(), critical sections and 
+semaphores. The portable backend uses POSIX threads and is used when _WIN32 isn't defined, so that 
+scheduler.c can be built, tested and benchmarked on its own on other systems.
+*/
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+
+#ifndef __int64
+#define __int64   long long
+#endif
+#endif
+
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+struct sched;
+struct sched_group;
+
+
+/** A lock. A critical section, or a mutex in the portable backend.
+*/
+struct sched_lock
+{
+#ifdef _WIN32
+	CRITICAL_SECTION cs;
+#else
+	pthread_mutex_t mutex;
+#endif
+};
+
+
+
+/** A counting semaphore that can be waited on with a timeout.
+*/
+struct sched_sem
+{
+#ifdef _WIN32
+	HANDLE handle;   // CreateSemaphore(), CloseHandle()
+#else
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	unsigned count;
+#endif
+};
+
+
+
+/** A task. The function is called with the task's parameter and the group the task was spawned in.
+*/
+struct sched_task
+{
+	void (*pfn)( void *param, struct sched_group *group );
+	void *param;
+	struct sched_group *group;
+};
+
+
+
+/** A double ended queue of tasks.
+The worker that owns a deque pushes and pops tasks at the bottom, newest first, and the other 
+workers steal tasks from the top, oldest first. The deque is a ring: the number of elements in the 
+task array is a power of 2 and 'top' and 'bottom' are indexes modulo that number. The deque is empty 
+when they're equal.
+*/
+struct sched_deque
+{
+	struct sched_lock lock;
+	
+	#define SCHED_DEQUE_MIN   64
+	struct sched_task *task;   // must_calloc(), free()
+	unsigned max;
+	
+	volatile unsigned top;
+	volatile unsigned bottom;
+};
+
+
+
+/** A worker thread.
+*/
+struct sched_worker
+{
+	struct sched *store;
+	
+	/* the index of this worker in the store's worker array */
+	unsigned index;
+	
+	/* the tasks spawned by this worker */
+	struct sched_deque deque;
+	
+	/* the state of the random number generator that picks the first worker to steal from */
+	unsigned seed;
+	
+	/* the number of tasks run, of tasks stolen from other workers and of attempts to steal, and the 
+	number of tasks skipped because their group was cancelled. only written by this worker.
+	*/
+	unsigned __int64 run_count;
+	unsigned __int64 steal_count;
+	unsigned __int64 steal_attempts;
+	unsigned __int64 skip_count;
+	
+	/* the number of times this worker parked because there was nothing to do */
+	unsigned __int64 park_count;
+
+#ifdef _WIN32
+	HANDLE hThread;   // _beginthreadex(), CloseHandle()
+#else
+	pthread_t thread;   // pthread_create(), pthread_join()
+	int have_thread;
+#endif
+};
+
+
+
+/** A task group.
+Tasks are spawned in a group and the group is joined to wait for them, including any tasks that they 
+spawned in the group. A group can be cancelled, either explicitly or by a deadline, after which its 
+tasks that haven't started yet are skipped. A running task can check is_sched_group_cancelled() to 
+stop early.
+
+The deadline is normally the time the next snapshot is due, so that work for a snapshot that can't 
+finish in time is dropped instead of delaying the next one.
+*/
+struct sched_group
+{
+	struct sched *store;
+	
+	/* the number of tasks spawned in this group that haven't finished */
+	volatile long pending;
+	
+	/* nonzero if this group has been cancelled */
+	volatile long cancelled;
+	
+	/* the number of tasks skipped because this group was cancelled */
+	volatile long skipped;
+	
+	/* the scheduler clock (see get_sched_clock()) in microseconds at which this group is cancelled, 
+	or 0 if there is no deadline.
+	*/
+	__int64 deadline;
+};
+
+
+
+/** The scheduler store.
+The scheduler is a pool of worker threads that run tasks. Each worker has its own deque of tasks: a 
+task spawned by a worker is pushed on that worker's deque, and when a worker runs out of tasks it 
+steals from the other workers. Tasks spawned by threads that aren't workers, like the main thread, 
+are put in the injection queue, which the workers take from in the order the tasks were spawned.
+
+A worker that can't find a task parks on the wake semaphore for up to SCHED_PARK_MS milliseconds. A 
+worker that is joining a group runs other tasks while it waits instead of blocking, so tasks can 
+spawn and join their own groups.
+*/
+struct sched
+{
+	/* the worker threads */
+	struct sched_worker *worker;   // must_calloc(), free()
+	unsigned worker_count;
+	
+	/* the tasks spawned by threads that aren't workers */
+	struct sched_deque inject;
+	
+	/* the parked workers wait on this semaphore. 'sleeping' is the number of parked workers. */
+	#define SCHED_PARK_MS   10
+	struct sched_sem wake;
+	volatile long sleeping;
+	
+	/* threads that aren't workers wait on this semaphore to join a group. 'joining' is the number 
+	of those threads.
+	*/
+	struct sched_sem joined;
+	volatile long joining;
+	
+	/* nonzero when the workers should exit */
+	volatile long terminate;
+	
+	/* the number of tasks spawned */
+	volatile long spawn_count;
+	
+	/* the system utc time in FILETIME format immediately after this store has been initialized.
+	this is nonzero when this store has been initialized.
+	*/
+	__int64 init_time;
+};
+
+
+
+/** 
+these functions are documented in the comment block above their definitions in scheduler.c
+*/
+__int64 get_sched_clock( void );
+
+unsigned get_sched_processor_count( void );
+
+void create_sched_store( 
+	struct sched **const out   // out deref
+);
+
+int init_sched_store( 
+	struct sched *const store,   // in
+	const unsigned worker_count   // in, optional
+);
+
+void create_sched_group( 
+	struct sched *const store,   // in
+	struct sched_group **const out   // out deref
+);
+
+void set_sched_group_deadline( 
+	struct sched_group *const group,   // in
+	const __int64 deadline   // in
+);
+
+void cancel_sched_group( 
+	struct sched_group *const group   // in
+);
+
+int is_sched_group_cancelled( 
+	struct sched_group *const group   // in
+);
+
+void spawn_sched_task( 
+	struct sched_group *const group,   // in
+	void (*pfn)( void *param, struct sched_group *group ),   // in
+	void *const param   // in, optional
+);
+
+int join_sched_group( 
+	struct sched_group *const group   // in
+);
+
+unsigned get_sched_worker_index( 
+	const struct sched *const store   // in
+);
+
+void free_sched_group( 
+	struct sched_group **const in   // in deref
+);
+
+void print_sched_store( 
+	const struct sched *const store   // in
+);
+
+void free_sched_store( 
+	struct sched **const in   // in deref
+);
+
+unsigned __int64 benchmark_sched_store( 
+	const unsigned __int64 max_workers   // in
+);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _SCHEDULER_H
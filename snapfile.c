@@ -0,0 +1,1468 @@
+/*
+Copyright (C) 2011 Jay Satiro <raysatiro@yahoo.com>
+All rights reserved.
+
+This file is part of GetHooks.
+
+GetHooks is free software: you can redistribute it and/or modify 
+it under the terms of the GNU General Public License as published by 
+the Free Software Foundation, either version 3 of the License, or 
+(at your option) any later version.
+
+GetHooks is distributed in the hope that it will be useful, 
+but WITHOUT ANY WARRANTY; without even the implied warranty of 
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License 
+along with GetHooks.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/** 
+This file contains functions for a snapshot file store (write snapshots to a file) and a snapshot 
+file view store (read snapshots from a file), and offline mode.
+Each function is documented in the comment block above its definition.
+
+A snapshot file holds one or more snapshots' desktop hook stores and the thread info their hooks 
+refer to. The file format is documented in snapfile.h. Offline mode reads snapshot files without 
+attaching to any desktop or taking any snapshot of the system, so that captures from different 
+times or different computers can be inspected and compared using the same diff code that is used 
+in monitor mode.
+
+-
+create_snapfile_store()
+
+Create a snapshot file store and its descendants or die.
+-
+
+-
+init_snapfile_store()
+
+Initialize a snapshot file store by creating the file and writing the file header.
+-
+
+-
+write_snapfile_record()
+
+Write a snapshot to the snapshot file as a record.
+-
+
+-
+free_snapfile_store()
+
+Free a snapshot file store and all its descendants.
+-
+
+-
+create_snapfile_view()
+
+Create a snapshot file view store and its descendants or die.
+-
+
+-
+validate_snapfile_record()
+
+Validate a record in a snapshot file.
+-
+
+-
+init_snapfile_view()
+
+Initialize a snapshot file view store by mapping the file and indexing its records.
+-
+
+-
+init_snapfile_view_last()
+
+Initialize a snapshot file view store with only the last record in the file.
+-
+
+-
+print_snapfile_view_error()
+
+Print why a snapshot file view store couldn't be initialized.
+-
+
+-
+get_snapfile_time()
+
+Get a record time from a string.
+-
+
+-
+find_snapfile_record()
+
+Find the index of a record in a snapshot file view by time.
+-
+
+-
+add_snapfile_record_desktops()
+
+Add the desktops in a record to an offline desktop store.
+-
+
+-
+load_snapfile_record()
+
+Load a record into a snapshot store.
+-
+
+-
+print_snapfile_view()
+
+Print a snapshot file view store and a brief summary of each of its records.
+-
+
+-
+free_snapfile_view()
+
+Free a snapshot file view store and all its descendants.
+-
+
+-
+offlinemode()
+
+Inspect or compare snapshot files.
+-
+
+*/
+
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <stdio.h>
+
+#include "util.h"
+
+#include "snapshot.h"
+
+#include "desktop_hook.h"
+
+#include "diff.h"
+
+#include "snapfile.h"
+
+#include "export.h"
+
+/* the global stores */
+#include "global.h"
+
+
+
+/* create_snapfile_store() 
+Create a snapshot file store and its descendants or die.
+*/
+void create_snapfile_store( 
+	struct snapfile **const out   // out deref
+)
+{
+	struct snapfile *snapfile = NULL;
+	
+	FAIL_IF( !out );
+	FAIL_IF( *out );
+	
+	
+	/* allocate a snapshot file store */
+	snapfile = must_calloc( 1, sizeof( *snapfile ) );
+	
+	
+	*out = snapfile;
+	return;
+}
+
+
+
+/* The snapshot file is only written in monitor mode, which is only built on Windows. */
+#ifdef _WIN32
+
+/* init_snapfile_store() 
+Initialize a snapshot file store by creating the file and writing the file header.
+
+If the file already exists it is overwritten.
+
+returns nonzero on success
+*/
+int init_snapfile_store( 
+	struct snapfile *const store,   // in
+	const WCHAR *const file   // in
+)
+{
+	struct snapfile_header header;
+	DWORD cch = 0;
+	
+	FAIL_IF( !G );   // The global store must exist.
+	FAIL_IF( !G->prog->init_time );   // The program store must be initialized.
+	
+	FAIL_IF( !store );
+	FAIL_IF( !file );
+	FAIL_IF( store->init_time );   // Fail if this store has already been initialized.
+	
+	
+	store->pwszFile = must_wcsdup( file );
+	
+	store->fp = _wfopen( store->pwszFile, L"wb" );
+	if( !store->fp )
+	{
+		MSG_ERROR( "_wfopen() failed." );
+		printf( "file: %ls\n", store->pwszFile );
+		return FALSE;
+	}
+	
+	ZeroMemory( &header, sizeof( header ) );
+	
+	memcpy( header.magic, SNAPFILE_MAGIC, SNAPFILE_MAGIC_LEN );
+	header.version = SNAPFILE_VERSION;
+	header.header_bcount = sizeof( header );
+	header.pointer_bcount = sizeof( void * );
+	header.os_version = G->prog->dwOSVersion;
+	GetSystemTimeAsFileTime( (FILETIME *)&header.create_time );
+	
+	/* the computer name is informational only. it is truncated if it doesn't fit. WCHAR is UTF-16 
+	on Windows, which is the only system the file is written on.
+	*/
+	cch = sizeof( header.computer_name ) / sizeof( header.computer_name[ 0 ] );
+	if( !GetComputerNameW( (WCHAR *)header.computer_name, &cch ) )
+		header.computer_name[ 0 ] = L'\0';
+	
+	header.computer_name[ ( sizeof( header.computer_name ) / sizeof( header.computer_name[ 0 ] ) ) - 1 ] = 0;
+	
+	if( ( fwrite( &header, sizeof( header ), 1, store->fp ) != 1 ) || fflush( store->fp ) )
+	{
+		MSG_ERROR( "Failed to write the snapshot file header." );
+		printf( "file: %ls\n", store->pwszFile );
+		return FALSE;
+	}
+	
+	
+	/* the snapshot file store has been initialized */
+	GetSystemTimeAsFileTime( (FILETIME *)&store->init_time );
+	return TRUE;
+}
+
+
+
+/* write_snapfile_record() 
+Write a snapshot to the snapshot file as a record.
+
+Only the threads that are the owner, origin or target of a hook are written. They are written in 
+the same order as they are in the snapshot's gui array, which is sorted by Win32ThreadInfo, so the 
+thread array in the record is sorted as well.
+
+returns nonzero on success
+*/
+int write_snapfile_record( 
+	struct snapfile *const store,   // in
+	const struct snapshot *const snapshot   // in
+)
+{
+	unsigned i = 0;
+	unsigned desktop_count = 0, thread_count = 0, hook_count = 0;
+	size_t string_bcount = 0, record_bcount = 0, offset = 0;
+	const struct desktop_hook_item *item = NULL;
+	struct snapfile_record *record = NULL;
+	struct snapfile_desktop *desktop = NULL;
+	struct snapfile_thread *thread = NULL;
+	struct snapfile_hook *hook = NULL;
+	BYTE *strings = NULL;
+	int ret = FALSE;
+	
+	/* map[ gui index ] is the thread's index in the record + 1, or 0 if not referenced */
+	unsigned *map = NULL;
+	
+	FAIL_IF( !store );
+	FAIL_IF( !store->init_time );   // The snapshot file store must be initialized.
+	FAIL_IF( !snapshot );
+	FAIL_IF( !snapshot->init_time );   // The snapshot store must be initialized.
+	FAIL_IF( snapshot->gui_count > snapshot->gui_max );
+	
+	
+	map = must_calloc( snapshot->gui_count + 1, sizeof( *map ) );
+	
+	/* count the desktops and hooks, mark the referenced threads and total the size of the names */
+	for( item = snapshot->desktop_hooks->head; item; item = item->next )
+	{
+		++desktop_count;
+		hook_count += item->hook_count;
+		
+		string_bcount += ( wcslen( item->desktop->pwszDesktopName ) + 1 ) * sizeof( WCHAR );
+		
+		for( i = 0; i < item->hook_count; ++i )
+		{
+			const struct hook *const h = &item->hook[ i ];
+			
+			if( h->owner )
+				map[ h->owner - snapshot->gui ] = 1;
+			
+			if( h->origin )
+				map[ h->origin - snapshot->gui ] = 1;
+			
+			if( h->target )
+				map[ h->target - snapshot->gui ] = 1;
+		}
+	}
+	
+	for( i = 0; i < snapshot->gui_count; ++i )
+	{
+		if( !map[ i ] )
+			continue;
+		
+		map[ i ] = ++thread_count;
+		
+		if( snapshot->gui[ i ].spi && snapshot->gui[ i ].spi->ImageName.Buffer )
+			string_bcount += snapshot->gui[ i ].spi->ImageName.Length + sizeof( WCHAR );
+	}
+	
+	string_bcount = SNAPFILE_ALIGN( string_bcount );
+	
+	record_bcount = sizeof( *record ) 
+		+ ( desktop_count * sizeof( *desktop ) ) 
+		+ ( thread_count * sizeof( *thread ) ) 
+		+ ( hook_count * sizeof( *hook ) ) 
+		+ string_bcount;
+	
+	if( record_bcount > 0xFFFFFFF8 )
+	{
+		MSG_ERROR( "The snapshot is too large to be written as a record." );
+		goto cleanup;
+	}
+	
+	
+	/* build the record in memory and then write it all at once */
+	record = must_calloc( record_bcount, 1 );
+	desktop = (struct snapfile_desktop *)SNAPFILE_DESKTOPS( record );
+	
+	memcpy( record->magic, SNAPFILE_RECORD_MAGIC, SNAPFILE_RECORD_MAGIC_LEN );
+	record->record_bcount = (UINT32)record_bcount;
+	record->time = snapshot->init_time;
+	record->time_spi = snapshot->init_time_spi;
+	record->flags = ( G->config->flags & CFG_COMPLETELY_PASSIVE ) ? SNAPFILE_RECORD_PASSIVE : 0;
+	record->desktop_count = desktop_count;
+	record->thread_count = thread_count;
+	record->hook_count = hook_count;
+	record->string_bcount = (UINT32)string_bcount;
+	
+	thread = (struct snapfile_thread *)SNAPFILE_THREADS( record );
+	hook = (struct snapfile_hook *)SNAPFILE_HOOKS( record );
+	strings = (BYTE *)SNAPFILE_STRINGS( record );
+	
+	/* the threads */
+	for( i = 0; i < snapshot->gui_count; ++i )
+	{
+		const struct gui *const gui = &snapshot->gui[ i ];
+		struct snapfile_thread *t = NULL;
+		
+		if( !map[ i ] )
+			continue;
+		
+		t = &thread[ map[ i ] - 1 ];
+		
+		t->pvWin32ThreadInfo = (uintptr_t)gui->pvWin32ThreadInfo;
+		t->pvTeb = (uintptr_t)gui->pvTeb;
+		
+		if( gui->sti )
+		{
+			t->tid = (uintptr_t)gui->sti->ClientId.UniqueThread;
+			t->thread_create_time = gui->sti->CreateTime.QuadPart;
+		}
+		
+		if( gui->spi )
+		{
+			t->pid = (uintptr_t)gui->spi->UniqueProcessId;
+			t->parent_pid = (uintptr_t)gui->spi->InheritedFromUniqueProcessId;
+			t->process_create_time = gui->spi->CreateTime.QuadPart;
+			t->session_id = gui->spi->SessionId;
+			
+			if( gui->spi->ImageName.Buffer )
+			{
+				t->name_offset = (UINT32)offset;
+				t->name_cch = gui->spi->ImageName.Length / sizeof( WCHAR );
+				
+				memcpy( strings + offset, gui->spi->ImageName.Buffer, gui->spi->ImageName.Length );
+				offset += ( t->name_cch + 1 ) * sizeof( WCHAR );
+			}
+		}
+	}
+	
+	/* the desktops and their hooks */
+	hook_count = 0;
+	for( item = snapshot->desktop_hooks->head; item; item = item->next, ++desktop )
+	{
+		desktop->name_offset = (UINT32)offset;
+		desktop->name_cch = (UINT32)wcslen( item->desktop->pwszDesktopName );
+		
+		memcpy( strings + offset, item->desktop->pwszDesktopName, desktop->name_cch * sizeof( WCHAR ) );
+		offset += ( desktop->name_cch + 1 ) * sizeof( WCHAR );
+		
+		if( item->desktop->pDeskInfo )
+		{
+			desktop->pvDesktopBase = (uintptr_t)item->desktop->pDeskInfo->pvDesktopBase;
+			desktop->pvDesktopLimit = (uintptr_t)item->desktop->pDeskInfo->pvDesktopLimit;
+		}
+		
+		desktop->hook_index = hook_count;
+		desktop->hook_count = item->hook_count;
+		
+		for( i = 0; i < item->hook_count; ++i, ++hook_count )
+		{
+			const struct hook *const h = &item->hook[ i ];
+			struct snapfile_hook *const r = &hook[ hook_count ];
+			
+			r->pHead = (uintptr_t)h->entry.pHead;
+			r->pOwner = (uintptr_t)h->entry.pOwner;
+			r->bType = h->entry.bType;
+			r->bFlags = h->entry.bFlags;
+			r->wUniq = h->entry.wUniq;
+			r->entry_index = h->entry_index;
+			
+			r->h = (uintptr_t)h->object.head.h;
+			r->cLockObj = h->object.head.cLockObj;
+			r->pti = (uintptr_t)h->object.pti;
+			r->rpdesk1 = (uintptr_t)h->object.rpdesk1;
+			r->pSelf = (uintptr_t)h->object.pSelf;
+			r->phkNext = (uintptr_t)h->object.phkNext;
+			r->iHook = h->object.iHook;
+			r->offPfn = h->object.offPfn;
+			r->flags = h->object.flags;
+			r->ihmod = h->object.ihmod;
+			r->ptiHooked = (uintptr_t)h->object.ptiHooked;
+			r->rpdesk2 = (uintptr_t)h->object.rpdesk2;
+			
+			r->ignore = h->ignore;
+			
+			r->owner = h->owner ? ( map[ h->owner - snapshot->gui ] - 1 ) : SNAPFILE_NO_THREAD;
+			r->origin = h->origin ? ( map[ h->origin - snapshot->gui ] - 1 ) : SNAPFILE_NO_THREAD;
+			r->target = h->target ? ( map[ h->target - snapshot->gui ] - 1 ) : SNAPFILE_NO_THREAD;
+		}
+	}
+	
+	if( ( fwrite( record, record_bcount, 1, store->fp ) != 1 ) || fflush( store->fp ) )
+	{
+		MSG_ERROR( "Failed to write the snapshot file record." );
+		printf( "file: %ls\n", store->pwszFile );
+		goto cleanup;
+	}
+	
+	++store->record_count;
+	ret = TRUE;
+
+cleanup:
+	free( record );
+	free( map );
+	return ret;
+}
+
+#endif // _WIN32
+
+
+
+/* free_snapfile_store() 
+Free a snapshot file store and all its descendants.
+
+this function then sets the snapshot file store pointer to NULL and returns
+
+'in' is a pointer to a pointer to the snapshot file store.
+if( !in || !*in ) then this function returns.
+*/
+void free_snapfile_store( 
+	struct snapfile **const in   // in deref
+)
+{
+	if( !in || !*in )
+		return;
+	
+	if( (*in)->fp )
+		fclose( (*in)->fp );
+	
+	free( (*in)->pwszFile );
+	
+	free( (*in) );
+	*in = NULL;
+	
+	return;
+}
+
+
+
+/* create_snapfile_view() 
+Create a snapshot file view store and its descendants or die.
+*/
+void create_snapfile_view( 
+	struct snapfile_view **const out   // out deref
+)
+{
+	struct snapfile_view *view = NULL;
+	
+	FAIL_IF( !out );
+	FAIL_IF( *out );
+	
+	
+	/* allocate a snapshot file view store */
+	view = must_calloc( 1, sizeof( *view ) );
+	
+	
+	*out = view;
+	return;
+}
+
+
+
+/* validate_snapfile_record() 
+Validate a record in a snapshot file.
+
+'base' is the beginning of the file's contents and 'bcount' is their size in bytes. They are 
+usually a file view but can be any memory, the record is only parsed.
+'offset' is the offset of the record from 'base'. It must be a multiple of 8.
+
+The record is validated in place. Every count and offset in the record is checked so that the 
+record's arrays and strings can be accessed without any further bounds checking.
+
+returns nonzero if the record is valid
+*/
+int validate_snapfile_record( 
+	const BYTE *const base,   // in
+	const size_t bcount,   // in
+	const size_t offset   // in
+)
+{
+	unsigned i = 0;
+	unsigned __int64 total = 0;
+	const struct snapfile_record *record = NULL;
+	const struct snapfile_desktop *desktop = NULL;
+	const struct snapfile_thread *thread = NULL;
+	const struct snapfile_hook *hook = NULL;
+	const UINT16 *strings = NULL;
+	
+	FAIL_IF( !base );
+	FAIL_IF( offset % 8 );
+	
+	
+	if( ( offset > bcount ) || ( ( bcount - offset ) < sizeof( *record ) ) )
+		return FALSE;
+	
+	record = (const struct snapfile_record *)( base + offset );
+	
+	if( memcmp( record->magic, SNAPFILE_RECORD_MAGIC, SNAPFILE_RECORD_MAGIC_LEN ) 
+		|| ( record->record_bcount % 8 ) 
+		|| ( record->record_bcount > ( bcount - offset ) ) 
+		|| ( record->string_bcount % 8 )
+	)
+		return FALSE;
+	
+	/* the size of the record must be exactly the size of its parts */
+	total = (unsigned __int64)sizeof( *record ) 
+		+ ( (unsigned __int64)record->desktop_count * sizeof( *desktop ) ) 
+		+ ( (unsigned __int64)record->thread_count * sizeof( *thread ) ) 
+		+ ( (unsigned __int64)record->hook_count * sizeof( *hook ) ) 
+		+ record->string_bcount;
+	
+	if( total != record->record_bcount )
+		return FALSE;
+	
+	desktop = SNAPFILE_DESKTOPS( record );
+	thread = SNAPFILE_THREADS( record );
+	hook = SNAPFILE_HOOKS( record );
+	strings = SNAPFILE_STRINGS( record );
+	
+	/* each name must be in the string pool and null terminated */
+	#define NAME_IS_VALID(offset,cch)   \
+		( !( ( offset ) % sizeof( UINT16 ) ) \
+			&& ( (unsigned __int64)( offset ) + ( ( (unsigned __int64)( cch ) + 1 ) * sizeof( UINT16 ) ) \
+				<= record->string_bcount \
+			) \
+			&& !SNAPFILE_NAME( strings, offset )[ cch ] \
+		)
+	
+	for( i = 0, total = 0; i < record->desktop_count; ++i )
+	{
+		if( !NAME_IS_VALID( desktop[ i ].name_offset, desktop[ i ].name_cch ) 
+			|| !desktop[ i ].name_cch 
+			|| ( desktop[ i ].hook_index != total ) 
+			|| ( desktop[ i ].hook_count > ( record->hook_count - desktop[ i ].hook_index ) )
+		)
+			return FALSE;
+		
+		total += desktop[ i ].hook_count;
+	}
+	
+	if( total != record->hook_count )
+		return FALSE;
+	
+	for( i = 0; i < record->thread_count; ++i )
+	{
+		if( thread[ i ].name_cch && !NAME_IS_VALID( thread[ i ].name_offset, thread[ i ].name_cch ) )
+			return FALSE;
+	}
+	
+	#undef NAME_IS_VALID
+	
+	for( i = 0; i < record->hook_count; ++i )
+	{
+		if( ( ( hook[ i ].owner != SNAPFILE_NO_THREAD ) && ( hook[ i ].owner >= record->thread_count ) ) 
+			|| ( ( hook[ i ].origin != SNAPFILE_NO_THREAD ) 
+				&& ( hook[ i ].origin >= record->thread_count )
+			) 
+			|| ( ( hook[ i ].target != SNAPFILE_NO_THREAD ) 
+				&& ( hook[ i ].target >= record->thread_count )
+			)
+		)
+			return FALSE;
+	}
+	
+	return TRUE;
+}
+
+
+
+/* init_snapfile_view() 
+Initialize a snapshot file view store by mapping the file and indexing its records.
+
+The file is mapped read only by open_portable_view() and its records are read in place. If the last 
+record is incomplete, for example because the program that was recording to the file was terminated 
+while it was writing the record, the incomplete record is ignored with a warning.
+
+returns nonzero on success
+*/
+int init_snapfile_view( 
+	struct snapfile_view *const store,   // in
+	const WCHAR *const file   // in
+)
+{
+	size_t offset = 0;
+	unsigned count = 0, i = 0;
+	
+	FAIL_IF( !store );
+	FAIL_IF( !file );
+	FAIL_IF( store->init_time );   // Fail if this store has already been initialized.
+	
+	
+	store->pwszFile = must_wcsdup( file );
+	
+	/* the file may be opened while it is still being recorded to */
+	if( !open_portable_view( &store->file, store->pwszFile ) )
+	{
+		print_portable_view_error( &store->file, store->pwszFile );
+		return FALSE;
+	}
+	
+	store->header = (const struct snapfile_header *)store->file.base;
+	
+	if( ( store->file.bcount < sizeof( *store->header ) ) 
+		|| memcmp( store->header->magic, SNAPFILE_MAGIC, SNAPFILE_MAGIC_LEN ) 
+		|| ( store->header->version != SNAPFILE_VERSION ) 
+		|| ( store->header->header_bcount != sizeof( *store->header ) )
+	)
+	{
+		MSG_ERROR( "The file is not a snapshot file or its version is not supported." );
+		printf( "file: %ls\n", store->pwszFile );
+		store->header = NULL;
+		return FALSE;
+	}
+	
+	/* the addresses in the file must fit in this program's pointers */
+	if( store->header->pointer_bcount > sizeof( void * ) )
+	{
+		MSG_ERROR( "The snapshot file was written by a program with larger pointers." );
+		printf( "file: %ls\n", store->pwszFile );
+		printf( "store->header->pointer_bcount: %u\n", store->header->pointer_bcount );
+		return FALSE;
+	}
+	
+	for( i = 0; i < ( ( sizeof( store->computer_name ) / sizeof( store->computer_name[ 0 ] ) ) - 1 ); ++i )
+		store->computer_name[ i ] = store->header->computer_name[ i ];
+	
+	/* count the valid records and then index them */
+	for( offset = sizeof( *store->header ); offset < store->file.bcount; ++count )
+	{
+		if( !validate_snapfile_record( store->file.base, store->file.bcount, offset ) )
+		{
+			MSG_WARNING( "The snapshot file has an invalid or incomplete record. Ignoring the rest." );
+			printf( "file: %ls\n", store->pwszFile );
+			printf( "record index: %u\n", count );
+			printf( "offset: %Iu\n", offset );
+			break;
+		}
+		
+		offset += ( (const struct snapfile_record *)( store->file.base + offset ) )->record_bcount;
+	}
+	
+	if( !count )
+	{
+		MSG_ERROR( "The snapshot file does not have any valid records." );
+		printf( "file: %ls\n", store->pwszFile );
+		return FALSE;
+	}
+	
+	store->record = must_calloc( count, sizeof( *store->record ) );
+	store->strings = must_calloc( count, sizeof( *store->strings ) );
+	
+	for( offset = sizeof( *store->header ); store->record_count < count; ++store->record_count )
+	{
+		const struct snapfile_record *const record = 
+			(const struct snapfile_record *)( store->file.base + offset );
+		
+		store->record[ store->record_count ] = record;
+
+#ifdef _WIN32
+		store->strings[ store->record_count ] = (const WCHAR *)SNAPFILE_STRINGS( record );
+#else
+		store->strings[ store->record_count ] = 
+			widen_portable_string( SNAPFILE_STRINGS( record ), record->string_bcount / sizeof( UINT16 ) );
+#endif
+
+		offset += record->record_bcount;
+	}
+	
+	
+	/* the snapshot file view store has been initialized */
+	GetSystemTimeAsFileTime( (FILETIME *)&store->init_time );
+	return TRUE;
+}
+
+
+
+/* init_snapfile_view_last() 
+Initialize a snapshot file view store with only the last record in the file.
+
+This is for a reader that only needs the current state of a recording, see aggregate.c. The records 
+before the last one are only stepped over by their size and aren't validated. As in 
+init_snapfile_view() an incomplete last record is ignored, so the record in the view is the last 
+complete record, and if that record isn't valid the file isn't used.
+
+Nothing is printed, so that views can be initialized on several threads at once. If this function 
+fails then print_snapfile_view_error() prints why.
+
+returns nonzero on success
+*/
+int init_snapfile_view_last( 
+	struct snapfile_view *const store,   // in
+	const WCHAR *const file   // in
+)
+{
+	size_t offset = 0, last = 0;
+	unsigned i = 0;
+	const struct snapfile_record *record = NULL;
+	
+	FAIL_IF( !store );
+	FAIL_IF( !file );
+	FAIL_IF( store->init_time );   // Fail if this store has already been initialized.
+	
+	
+	store->pwszFile = must_wcsdup( file );
+	
+	/* the file may be opened while it is still being recorded to */
+	if( !open_portable_view( &store->file, store->pwszFile ) )
+		return FALSE;
+	
+	store->header = (const struct snapfile_header *)store->file.base;
+	
+	if( ( store->file.bcount < sizeof( *store->header ) ) 
+		|| memcmp( store->header->magic, SNAPFILE_MAGIC, SNAPFILE_MAGIC_LEN ) 
+		|| ( store->header->version != SNAPFILE_VERSION ) 
+		|| ( store->header->header_bcount != sizeof( *store->header ) )
+	)
+	{
+		store->error = "The file is not a snapshot file or its version is not supported.";
+		store->header = NULL;
+		return FALSE;
+	}
+	
+	/* the addresses in the file must fit in this program's pointers */
+	if( store->header->pointer_bcount > sizeof( void * ) )
+	{
+		store->error = "The snapshot file was written by a program with larger pointers.";
+		return FALSE;
+	}
+	
+	for( i = 0; i < ( ( sizeof( store->computer_name ) / sizeof( store->computer_name[ 0 ] ) ) - 1 ); ++i )
+		store->computer_name[ i ] = store->header->computer_name[ i ];
+	
+	/* step over the complete records to the last one */
+	for( offset = sizeof( *store->header );
+		( store->file.bcount - offset ) >= sizeof( *record );
+		offset += record->record_bcount
+	)
+	{
+		record = (const struct snapfile_record *)( store->file.base + offset );
+		
+		if( ( record->record_bcount < sizeof( *record ) ) 
+			|| ( record->record_bcount % 8 ) 
+			|| ( record->record_bcount > ( store->file.bcount - offset ) )
+		)
+			break;
+		
+		last = offset;
+	}
+	
+	if( !last || !validate_snapfile_record( store->file.base, store->file.bcount, last ) )
+	{
+		store->error = "The snapshot file does not have a valid last record.";
+		return FALSE;
+	}
+	
+	record = (const struct snapfile_record *)( store->file.base + last );
+	
+	store->record = must_calloc( 1, sizeof( *store->record ) );
+	store->strings = must_calloc( 1, sizeof( *store->strings ) );
+	
+	store->record[ 0 ] = record;
+
+#ifdef _WIN32
+	store->strings[ 0 ] = (const WCHAR *)SNAPFILE_STRINGS( record );
+#else
+	store->strings[ 0 ] = 
+		widen_portable_string( SNAPFILE_STRINGS( record ), record->string_bcount / sizeof( UINT16 ) );
+#endif
+
+	store->record_count = 1;
+	
+	
+	/* the snapshot file view store has been initialized */
+	GetSystemTimeAsFileTime( (FILETIME *)&store->init_time );
+	return TRUE;
+}
+
+
+
+/* print_snapfile_view_error() 
+Print why a snapshot file view store couldn't be initialized by init_snapfile_view_last().
+*/
+void print_snapfile_view_error( 
+	const struct snapfile_view *const store   // in
+)
+{
+	FAIL_IF( !store );
+	FAIL_IF( !store->pwszFile );
+	
+	
+	if( store->file.error )
+	{
+		print_portable_view_error( &store->file, store->pwszFile );
+		return;
+	}
+	
+	MSG_ERROR( ( store->error ? store->error : "The snapshot file could not be read." ) );
+	printf( "file: %ls\n", store->pwszFile );
+	return;
+}
+
+
+
+/* get_snapfile_time() 
+Get a record time from a string.
+
+The string is either a FILETIME or #n where n is the index of a record.
+
+if success then '*time' has received a time that can be passed to find_snapfile_record().
+
+returns nonzero on success
+*/
+int get_snapfile_time( 
+	__int64 *const time,   // out
+	const char *const str   // in
+)
+{
+	unsigned index = 0;
+	
+	FAIL_IF( !time );
+	FAIL_IF( !str );
+	
+	
+	if( str[ 0 ] == '#' )
+	{
+		if( ( str_to_uint( &index, str + 1 ) != NUM_POS ) || ( index == UINT_MAX ) )
+			return FALSE;
+		
+		*time = SNAPFILE_TIME_FROM_INDEX( index );
+		return TRUE;
+	}
+	
+	/* a FILETIME of 0 would be SNAPFILE_TIME_LAST */
+	if( ( str_to_int64( time, str ) != NUM_POS ) || !*time )
+		return FALSE;
+	
+	return TRUE;
+}
+
+
+
+/* find_snapfile_record() 
+Find the index of a record in a snapshot file view by time.
+
+'time' is a FILETIME, or SNAPFILE_TIME_LAST for the last record, or a record index made with 
+SNAPFILE_TIME_FROM_INDEX().
+
+If 'time' is a FILETIME then the record that was taken last at or before that time is found. That 
+is the snapshot that was current at that time.
+
+if success then '*index' has received the index of the record in the view's record array.
+
+returns nonzero on success
+*/
+int find_snapfile_record( 
+	unsigned *const index,   // out
+	const struct snapfile_view *const store,   // in
+	const __int64 time   // in
+)
+{
+	unsigned i = 0;
+	
+	FAIL_IF( !index );
+	FAIL_IF( !store );
+	FAIL_IF( !store->init_time );   // The snapshot file view store must be initialized.
+	
+	
+	if( time == SNAPFILE_TIME_LAST )
+	{
+		*index = store->record_count - 1;
+		return TRUE;
+	}
+	
+	if( SNAPFILE_TIME_IS_INDEX( time ) )
+	{
+		if( SNAPFILE_INDEX_FROM_TIME( time ) >= store->record_count )
+			return FALSE;
+		
+		*index = SNAPFILE_INDEX_FROM_TIME( time );
+		return TRUE;
+	}
+	
+	/* the records are in the order they were taken */
+	for( i = 0; ( i < store->record_count ) && ( store->record[ i ]->time <= time ); ++i )
+		;
+	
+	if( !i ) // every record was taken after 'time'
+		return FALSE;
+	
+	*index = i - 1;
+	return TRUE;
+}
+
+
+
+/* add_snapfile_record_desktops() 
+Add the desktops in a record to an offline desktop store.
+
+'index' is the index of the record in the view's record array.
+
+The desktop items in an offline desktop store have only a name. A desktop in a record is the same 
+desktop as an item in the store if they have the same name (case insensitive). The desktops of 
+every record that will be loaded must be added before any record is loaded, so that the desktop 
+hook stores of all the records have the same desktops in the same order and can be compared.
+*/
+void add_snapfile_record_desktops( 
+	struct desktop_list *const desktops,   // in, out
+	const struct snapfile_view *const view,   // in
+	const unsigned index   // in
+)
+{
+	unsigned i = 0;
+	const struct snapfile_record *record = NULL;
+	const struct snapfile_desktop *desktop = NULL;
+	
+	FAIL_IF( !desktops );
+	FAIL_IF( !view );
+	FAIL_IF( !view->init_time );   // The snapshot file view store must be initialized.
+	FAIL_IF( index >= view->record_count );
+	
+	
+	record = view->record[ index ];
+	desktop = SNAPFILE_DESKTOPS( record );
+	
+	for( i = 0; i < record->desktop_count; ++i )
+	{
+		const WCHAR *const name = SNAPFILE_NAME( view->strings[ index ], desktop[ i ].name_offset );
+		unsigned j = 0;
+		struct desktop_item item;
+		
+		/* check if there is already an item for this desktop */
+		for( j = 0; j < desktops->count; ++j )
+		{
+			if( !_wcsicmp( desktops->item[ j ].pwszDesktopName, name ) )
+				break;
+		}
+		
+		if( j < desktops->count )
+			continue;
+		
+		/* add a new item to the table */
+		ZeroMemory( &item, sizeof( item ) );
+		item.pwszDesktopName = must_wcsdup( name );
+		
+		append_desktop_item( desktops, &item );
+	}
+	
+	desktops->type = DESKTOP_SPECIFIED;
+	GetSystemTimeAsFileTime( (FILETIME *)&desktops->init_time );
+	return;
+}
+
+
+
+/* load_snapfile_record() 
+Load a record into a snapshot store.
+
+'store' is a snapshot store created by create_snapshot_store(). It may be reused.
+'index' is the index of the record in the view's record array.
+'desktops' is an offline desktop store that the record's desktops have been added to.
+
+For each thread in the record a SYSTEM_PROCESS_INFORMATION struct with only that thread is made in 
+the snapshot's spi buffer. The names of the threads' processes point to the record, so the view 
+must not be freed before the snapshot store.
+
+Each hook's ignore member is set according to this program's configuration, not the configuration 
+of the program that wrote the record.
+
+returns nonzero on success
+*/
+int load_snapfile_record( 
+	struct snapshot *const store,   // in, out
+	const struct snapfile_view *const view,   // in
+	const unsigned index,   // in
+	const struct desktop_list *const desktops   // in
+)
+{
+	unsigned i = 0;
+	struct desktop_hook_item *item = NULL;
+	const struct snapfile_record *record = NULL;
+	const struct snapfile_desktop *desktop = NULL;
+	const struct snapfile_thread *thread = NULL;
+	const struct snapfile_hook *hook = NULL;
+	const WCHAR *strings = NULL;
+	
+	FAIL_IF( !store );
+	FAIL_IF( !view );
+	FAIL_IF( !view->init_time );   // The snapshot file view store must be initialized.
+	FAIL_IF( index >= view->record_count );
+	FAIL_IF( !desktops );
+	FAIL_IF( !desktops->init_time );   // The offline desktop store must be initialized.
+	
+	
+	record = view->record[ index ];
+	desktop = SNAPFILE_DESKTOPS( record );
+	thread = SNAPFILE_THREADS( record );
+	hook = SNAPFILE_HOOKS( record );
+	strings = view->strings[ index ];
+	
+	/* this store is reused. do a soft reset */
+	store->init_time = 0;
+	store->init_time_gui = 0;
+	store->init_time_spi = 0;
+	store->desktop_hooks->init_time = 0;
+	
+	if( ( record->thread_count > store->gui_max ) 
+		|| ( ( (unsigned __int64)record->thread_count * sizeof( *store->spi ) ) > store->spi_max_bytes )
+	)
+	{
+		MSG_ERROR( "The record has more threads than the maximum allowed in a snapshot." );
+		printf( "record->thread_count: %u\n", record->thread_count );
+		printf( "store->gui_max: %u\n", store->gui_max );
+		printf( "Use option 't' to increase the maximum number of threads.\n" );
+		return FALSE;
+	}
+	
+	/* make a process info with one thread for each thread in the record */
+	ZeroMemory( store->spi, record->thread_count * sizeof( *store->spi ) );
+	store->spi_extended = 0;
+	
+	for( i = 0; i < record->thread_count; ++i )
+	{
+		SYSTEM_PROCESS_INFORMATION *const spi = &store->spi[ i ];
+		struct gui *const gui = &store->gui[ i ];
+		
+		if( ( i + 1 ) < record->thread_count )
+			spi->NextEntryOffset = sizeof( *spi );
+		
+		spi->NumberOfThreads = 1;
+		spi->CreateTime.QuadPart = thread[ i ].process_create_time;
+		spi->UniqueProcessId = (HANDLE)(uintptr_t)thread[ i ].pid;
+		spi->InheritedFromUniqueProcessId = (HANDLE)(uintptr_t)thread[ i ].parent_pid;
+		spi->SessionId = thread[ i ].session_id;
+		
+		if( thread[ i ].name_cch )
+		{
+			spi->ImageName.Buffer = (PWSTR)SNAPFILE_NAME( strings, thread[ i ].name_offset );
+			spi->ImageName.Length = (USHORT)( thread[ i ].name_cch * sizeof( WCHAR ) );
+			spi->ImageName.MaximumLength = (USHORT)( spi->ImageName.Length + sizeof( WCHAR ) );
+		}
+		
+		spi->Threads[ 0 ].CreateTime.QuadPart = thread[ i ].thread_create_time;
+		spi->Threads[ 0 ].ClientId.UniqueProcess = spi->UniqueProcessId;
+		spi->Threads[ 0 ].ClientId.UniqueThread = (HANDLE)(uintptr_t)thread[ i ].tid;
+		
+		ZeroMemory( gui, sizeof( *gui ) );
+		gui->pvWin32ThreadInfo = (void *)(uintptr_t)thread[ i ].pvWin32ThreadInfo;
+		gui->pvTeb = (void *)(uintptr_t)thread[ i ].pvTeb;
+		gui->spi = spi;
+		gui->sti = &spi->Threads[ 0 ];
+		
+		/* only threads with a unique Win32ThreadInfo are ever associated with a hook */
+		gui->unique_w32thread = TRUE;
+	}
+	
+	store->gui_count = record->thread_count;
+	store->init_time_spi = record->time_spi;
+	store->init_time_gui = record->time_spi;
+	
+	
+	/* if the desktop hook store does not have a table of desktops yet create it */
+	if( !store->desktop_hooks->count )
+	{
+		/* add the desktops from the offline desktop store */
+		for( i = 0; i < desktops->count; ++i )
+			add_desktop_hook_item( store->desktop_hooks, &desktops->item[ i ] );
+	}
+	else // the desktop hook table already exists. reuse it.
+	{
+		for( i = 0; i < store->desktop_hooks->count; ++i )
+			store->desktop_hooks->item[ i ].hook_count = 0; // soft reset of hook array
+	}
+	
+	for( i = 0; i < record->desktop_count; ++i )
+	{
+		const WCHAR *const name = SNAPFILE_NAME( strings, desktop[ i ].name_offset );
+		unsigned j = 0;
+		
+		for( item = store->desktop_hooks->head; item; item = item->next )
+		{
+			if( !_wcsicmp( item->desktop->pwszDesktopName, name ) )
+				break;
+		}
+		
+		if( !item )
+		{
+			MSG_ERROR( "The record's desktop is not in the offline desktop store." );
+			printf( "desktop: %ls\n", name );
+			return FALSE;
+		}
+		
+		if( ( item->hook_count + desktop[ i ].hook_count ) > item->hook_max )
+		{
+			MSG_ERROR( "Too many HOOK objects!" );
+			printf( "desktop: %ls\n", name );
+			printf( "item->hook_max: %u\n", item->hook_max );
+			return FALSE;
+		}
+		
+		for( j = 0; j < desktop[ i ].hook_count; ++j )
+		{
+			const struct snapfile_hook *const r = &hook[ desktop[ i ].hook_index + j ];
+			struct hook *const h = &item->hook[ item->hook_count++ ];
+			
+			ZeroMemory( h, sizeof( *h ) );
+			
+			h->entry_index = r->entry_index;
+			h->entry.pHead = (PHEAD)(uintptr_t)r->pHead;
+			h->entry.pOwner = (void *)(uintptr_t)r->pOwner;
+			h->entry.bType = r->bType;
+			h->entry.bFlags = r->bFlags;
+			h->entry.wUniq = r->wUniq;
+			
+			h->object.head.h = (HANDLE)(uintptr_t)r->h;
+			h->object.head.cLockObj = r->cLockObj;
+			h->object.pti = (void *)(uintptr_t)r->pti;
+			h->object.rpdesk1 = (void *)(uintptr_t)r->rpdesk1;
+			h->object.pSelf = (void *)(uintptr_t)r->pSelf;
+			h->object.phkNext = (HOOK *)(uintptr_t)r->phkNext;
+			h->object.iHook = r->iHook;
+			h->object.offPfn = r->offPfn;
+			h->object.flags = r->flags;
+			h->object.ihmod = r->ihmod;
+			h->object.ptiHooked = (void *)(uintptr_t)r->ptiHooked;
+			h->object.rpdesk2 = (void *)(uintptr_t)r->rpdesk2;
+			
+			h->owner = ( r->owner != SNAPFILE_NO_THREAD ) ? &store->gui[ r->owner ] : NULL;
+			h->origin = ( r->origin != SNAPFILE_NO_THREAD ) ? &store->gui[ r->origin ] : NULL;
+			h->target = ( r->target != SNAPFILE_NO_THREAD ) ? &store->gui[ r->target ] : NULL;
+			
+			/* 'ignore' should be the last member of the hook to set. see init_desktop_hook_store() */
+			h->ignore = !is_hook_wanted( h );
+		}
+	}
+	
+	/* the hooks were sorted when the record was written but sort again in case the record came 
+	from a different version of this program.
+	*/
+	for( item = store->desktop_hooks->head; item; item = item->next )
+	{
+		qsort( item->hook, item->hook_count, sizeof( *item->hook ), compare_hook );
+		
+		/* the anomalies aren't in the record. check for them as if the hooks were just captured. */
+		set_hook_anomalies( item );
+	}
+	
+	
+	/* the snapshot store has been loaded */
+	store->desktop_hooks->init_time = record->time;
+	store->init_time = record->time;
+	return TRUE;
+}
+
+
+
+/* print_snapfile_view() 
+Print a snapshot file view store and a brief summary of each of its records.
+
+if 'store' is NULL this function returns without having printed anything.
+*/
+void print_snapfile_view( 
+	const struct snapfile_view *const store   // in
+)
+{
+	const char *const objname = "Snapshot File View Store";
+	unsigned i = 0;
+	
+	
+	if( !store )
+		return;
+	
+	PRINT_DBLSEP_BEGIN( objname );
+	print_init_time( "store->init_time", store->init_time );
+	
+	printf( "store->pwszFile: %ls\n", store->pwszFile );
+	printf( "store->file.bcount: %Iu\n", store->file.bcount );
+	
+	if( store->header )
+	{
+		printf( "store->header->version: %u\n", store->header->version );
+		printf( "store->header->pointer_bcount: %u\n", store->header->pointer_bcount );
+		printf( "store->header->os_version: 0x%08X\n", store->header->os_version );
+		printf( "store->computer_name: %ls\n", store->computer_name );
+		print_init_time( "store->header->create_time", store->header->create_time );
+	}
+	
+	printf( "store->record_count: %u\n", store->record_count );
+	
+	for( i = 0; i < store->record_count; ++i )
+	{
+		const struct snapfile_record *const record = store->record[ i ];
+		
+		printf( "\nRecord #%u: time %I64d, %u desktops, %u threads, %u hooks%s\n", 
+			i, 
+			record->time, 
+			record->desktop_count, 
+			record->thread_count, 
+			record->hook_count, 
+			( ( record->flags & SNAPFILE_RECORD_PASSIVE ) ? " (passive)" : "" )
+		);
+		print_init_time( NULL, record->time );
+	}
+	
+	PRINT_DBLSEP_END( objname );
+	
+	return;
+}
+
+
+
+/* free_snapfile_view() 
+Free a snapshot file view store and all its descendants.
+
+this function then sets the snapshot file view store pointer to NULL and returns
+
+'in' is a pointer to a pointer to the snapshot file view store.
+if( !in || !*in ) then this function returns.
+*/
+void free_snapfile_view( 
+	struct snapfile_view **const in   // in deref
+)
+{
+	if( !in || !*in )
+		return;
+	
+#ifndef _WIN32
+	{
+		unsigned i = 0;
+		
+		for( i = 0; i < (*in)->record_count; ++i )
+			free( (void *)(*in)->strings[ i ] );
+	}
+#endif
+
+	free( (void *)(*in)->strings );
+	free( (void *)(*in)->record );
+	
+	close_portable_view( &(*in)->file );
+	
+	free( (*in)->pwszFile );
+	
+	free( (*in) );
+	*in = NULL;
+	
+	return;
+}
+
+
+
+/* offlinemode() 
+Inspect or compare snapshot files.
+
+The files and record times are in the user-specified file list (G->config->filelist).
+
+OFFLINE_INSPECT:
+Print a summary of the records in the file. If a time was specified print the HOOKs found in the 
+record for that time. If the file is a columnar export file instead of a snapshot file then print 
+its rows.
+
+OFFLINE_DIFF:
+Print the HOOKs that have been added/removed/modified between the record of the first file and the 
+record of the second file. If no time was specified for a file its last record is used.
+
+returns nonzero on success
+*/
+int offlinemode( void )
+{
+	const char *const objname = "Offline Mode";
+	struct snapfile_view *view[ 2 ] = { NULL, NULL };
+	struct snapshot *snapshot[ 2 ] = { NULL, NULL };
+	struct desktop_list *desktops = NULL;
+	const struct list_item *item = NULL;
+	unsigned index[ 2 ] = { 0, 0 };
+	unsigned count = 0, i = 0;
+	int ret = FALSE;
+	
+	FAIL_IF( !G );   // The global store must exist.
+	FAIL_IF( !G->prog->init_time );   // The program store must be initialized.
+	FAIL_IF( !G->config->init_time );   // The configuration store must be initialized.
+	FAIL_IF( !G->config->offline );   // Offline mode must have been requested.
+	
+	FAIL_IF( GetCurrentThreadId() != G->prog->dwMainThreadId );   // main thread only
+	
+	
+	if( G->config->verbose >= 5 )
+		PRINT_HASHSEP_BEGIN( objname );
+	
+	count = ( G->config->offline == OFFLINE_DIFF ) ? 2 : 1;
+	
+	/* a columnar export file can be inspected but it doesn't have records */
+	if( ( G->config->offline == OFFLINE_INSPECT ) && is_export_file( G->config->filelist->head->name ) )
+	{
+		if( G->config->filelist->head->id != SNAPFILE_TIME_LAST )
+		{
+			MSG_ERROR( "A time can't be specified for a columnar export file." );
+			printf( "file: %ls\n", G->config->filelist->head->name );
+			goto cleanup;
+		}
+		
+		ret = print_export_file( G->config->filelist->head->name );
+		goto cleanup;
+	}
+	
+	/* map each file and find the requested record */
+	for( i = 0, item = G->config->filelist->head; i < count; ++i, item = item->next )
+	{
+		FAIL_IF( !item );
+		
+		create_snapfile_view( &view[ i ] );
+		
+		if( !init_snapfile_view( view[ i ], item->name ) )
+			goto cleanup;
+		
+		if( G->config->verbose >= 5 )
+			print_snapfile_view( view[ i ] );
+		
+		if( !find_snapfile_record( &index[ i ], view[ i ], item->id ) )
+		{
+			MSG_ERROR( "The record for the specified time was not found in the snapshot file." );
+			printf( "file: %ls\n", item->name );
+			
+			if( SNAPFILE_TIME_IS_INDEX( item->id ) )
+				printf( "record index: %u\n", SNAPFILE_INDEX_FROM_TIME( item->id ) );
+			else
+				printf( "time: %I64d\n", item->id );
+			
+			goto cleanup;
+		}
+	}
+	
+	if( G->config->offline == OFFLINE_INSPECT )
+	{
+		printf( "Snapshot file: %ls\n", view[ 0 ]->pwszFile );
+		printf( "Computer: %ls\n", view[ 0 ]->computer_name );
+		printf( "Records: %u\n", view[ 0 ]->record_count );
+		
+		for( i = 0; i < view[ 0 ]->record_count; ++i )
+		{
+			printf( "#%u: %I64d (%u hooks) ", 
+				i, 
+				view[ 0 ]->record[ i ]->time, 
+				view[ 0 ]->record[ i ]->hook_count
+			);
+			print_init_time( NULL, view[ 0 ]->record[ i ]->time );
+		}
+		
+		/* if a time wasn't specified the summary is all that's printed */
+		if( G->config->filelist->head->id == SNAPFILE_TIME_LAST )
+		{
+			ret = TRUE;
+			goto cleanup;
+		}
+		
+		create_desktop_store( &desktops );
+		add_snapfile_record_desktops( desktops, view[ 0 ], index[ 0 ] );
+		
+		create_snapshot_store( &snapshot[ 0 ] );
+		
+		if( !load_snapfile_record( snapshot[ 0 ], view[ 0 ], index[ 0 ], desktops ) )
+			goto cleanup;
+		
+		printf( "\nRecord #%u:\n", index[ 0 ] );
+		
+		if( G->config->verbose >= 8 )
+			print_snapshot_store( snapshot[ 0 ] );
+		
+		print_initial_desktop_hook_list( snapshot[ 0 ]->desktop_hooks );
+		printf( "\n" );
+	}
+	else if( G->config->offline == OFFLINE_DIFF )
+	{
+		/* the desktops of both records must be added before either record is loaded */
+		create_desktop_store( &desktops );
+		
+		for( i = 0; i < count; ++i )
+			add_snapfile_record_desktops( desktops, view[ i ], index[ i ] );
+		
+		for( i = 0; i < count; ++i )
+		{
+			create_snapshot_store( &snapshot[ i ] );
+			
+			if( !load_snapfile_record( snapshot[ i ], view[ i ], index[ i ], desktops ) )
+				goto cleanup;
+			
+			printf( "%s: %ls record #%u ", 
+				( i ? "Current" : "Previous" ), 
+				view[ i ]->pwszFile, 
+				index[ i ]
+			);
+			print_init_time( NULL, snapshot[ i ]->init_time );
+			
+			if( G->config->verbose >= 8 )
+				print_snapshot_store( snapshot[ i ] );
+		}
+		
+		/* Print the HOOKs that have been added/removed/modified between the records */
+		print_diff_desktop_hook_lists( snapshot[ 0 ]->desktop_hooks, snapshot[ 1 ]->desktop_hooks );
+		printf( "\n" );
+	}
+	else
+	{
+		MSG_FATAL( "Unknown offline mode." );
+		printf( "G->config->offline: %d\n", G->config->offline );
+		exit( 1 );
+	}
+	
+	ret = TRUE;
+
+cleanup:
+	/* the snapshot stores point to the views so they must be freed first */
+	for( i = 0; i < 2; ++i )
+		free_snapshot_store( &snapshot[ i ] );
+	
+	free_desktop_store( &desktops );
+	
+	for( i = 0; i < 2; ++i )
+		free_snapfile_view( &view[ i ] );
+	
+	if( G->config->verbose >= 5 )
+		PRINT_HASHSEP_END( objname );
+	
+	return ret;
+}
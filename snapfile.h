@@ -0,0 +1,363 @@
+/*
+Copyright (C) 2011 Jay Satiro <raysatiro@yahoo.com>
+All rights reserved.
+
+This file is part of GetHooks.
+
+GetHooks is free software: you can redistribute it and/or modify 
+it under the terms of the GNU General Public License as published by 
+the Free Software Foundation, either version 3 of the License, or 
+(at your option) any later version.
+
+GetHooks is distributed in the hope that it will be useful, 
+but WITHOUT ANY WARRANTY; without even the implied warranty of 
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License 
+along with GetHooks.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _SNAPFILE_H
+#define _SNAPFILE_H
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include <stdio.h>
+
+/* the file view, and the stand-ins for windows.h on other systems */
+#include "portable.h"
+
+/* snapshot store (system process info, gui threads, desktop hooks) */
+#include "snapshot.h"
+
+/* desktop store (linked list of desktops' heap and thread info) */
+#include "desktop.h"
+
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/** The snapshot file format.
+A snapshot file is a file header followed by one or more records. Each record is a snapshot's 
+desktop hook store and only the thread info that its hooks refer to. A file with more than one 
+record is a recording.
+
+All members are fixed width and little endian. Addresses are stored as UINT64 regardless of the 
+pointer size of the program that wrote the file. Every struct size is a multiple of 8 so that the 
+records can be read in place from a mapped view without copying. The strings are UTF-16, which is 
+the WCHAR of Windows; on other systems they are widened when the file is viewed.
+
+record layout:
+struct snapfile_record 
+struct snapfile_desktop [ desktop_count ] 
+struct snapfile_thread [ thread_count ] 
+struct snapfile_hook [ hook_count ] 
+UINT16 strings [ string_bcount / sizeof( UINT16 ) ]   // null terminated, padded to 8 bytes
+*/
+#define SNAPFILE_MAGIC   "GHSNAP\r\n"
+#define SNAPFILE_MAGIC_LEN   8
+#define SNAPFILE_VERSION   1
+
+#define SNAPFILE_RECORD_MAGIC   "HREC"
+#define SNAPFILE_RECORD_MAGIC_LEN   4
+
+/* a thread index in struct snapfile_hook when the thread is unknown */
+#define SNAPFILE_NO_THREAD   ( (UINT32)-1 )
+
+/* round up a byte count to the next multiple of 8 */
+#define SNAPFILE_ALIGN(bcount)   ( ( (bcount) + 7 ) & ~(size_t)7 )
+
+struct snapfile_header
+{
+	char magic[ SNAPFILE_MAGIC_LEN ];
+	UINT32 version;
+	
+	/* sizeof( struct snapfile_header ) */
+	UINT32 header_bcount;
+	
+	/* sizeof( void * ) in the program that wrote the file */
+	UINT32 pointer_bcount;
+	
+	/* G->prog->dwOSVersion in the program that wrote the file */
+	UINT32 os_version;
+	
+	/* the system utc time in FILETIME format when the file was created */
+	__int64 create_time;
+	
+	/* the name of the computer that wrote the file. null terminated. */
+	UINT16 computer_name[ 16 ];
+};
+
+/* a time passed to find_snapfile_record() is either a FILETIME or one of the following.
+the offline options accept a FILETIME or #n for the record at index n.
+*/
+#define SNAPFILE_TIME_LAST   0   // the last record in the file
+#define SNAPFILE_TIME_FROM_INDEX(index)   ( -(__int64)( index ) - 1 )
+#define SNAPFILE_TIME_IS_INDEX(time)   ( ( time ) < 0 )
+#define SNAPFILE_INDEX_FROM_TIME(time)   ( (unsigned)( -( ( time ) + 1 ) ) )
+
+/* the record is a snapshot taken in completely passive mode (no thread info) */
+#define SNAPFILE_RECORD_PASSIVE   1u
+
+struct snapfile_record
+{
+	char magic[ SNAPFILE_RECORD_MAGIC_LEN ];
+	
+	/* the size of the record in bytes, including this struct. a multiple of 8. */
+	UINT32 record_bcount;
+	
+	/* the snapshot's init_time and init_time_spi */
+	__int64 time;
+	__int64 time_spi;
+	
+	UINT32 flags;
+	UINT32 desktop_count;
+	UINT32 thread_count;
+	UINT32 hook_count;
+	
+	/* the size of the string pool in bytes, including padding */
+	UINT32 string_bcount;
+	UINT32 reserved;
+};
+
+struct snapfile_desktop
+{
+	/* the desktop name's byte offset in the string pool and its length in characters */
+	UINT32 name_offset;
+	UINT32 name_cch;
+	
+	/* the desktop's hooks: hook_count hooks beginning at hook_index in the record's hook array */
+	UINT32 hook_index;
+	UINT32 hook_count;
+	
+	UINT64 pvDesktopBase;
+	UINT64 pvDesktopLimit;
+};
+
+struct snapfile_thread
+{
+	UINT64 pvWin32ThreadInfo;
+	UINT64 pvTeb;
+	UINT64 pid;
+	UINT64 tid;
+	UINT64 parent_pid;
+	__int64 process_create_time;
+	__int64 thread_create_time;
+	UINT32 session_id;
+	
+	/* the process image name's byte offset in the string pool and its length in characters */
+	UINT32 name_offset;
+	UINT32 name_cch;
+	UINT32 reserved;
+};
+
+struct snapfile_hook
+{
+	/* HANDLEENTRY */
+	UINT64 pHead;
+	UINT64 pOwner;
+	
+	/* HOOK */
+	UINT64 h;
+	UINT64 pti;
+	UINT64 rpdesk1;
+	UINT64 pSelf;
+	UINT64 phkNext;
+	UINT64 ptiHooked;
+	UINT64 rpdesk2;
+	
+	UINT32 entry_index;
+	UINT32 cLockObj;
+	INT32 iHook;
+	UINT32 offPfn;
+	UINT32 flags;
+	INT32 ihmod;
+	
+	/* HANDLEENTRY */
+	BYTE bType;
+	BYTE bFlags;
+	UINT16 wUniq;
+	
+	/* whether the hook was ignored by the configuration of the program that wrote the file */
+	UINT32 ignore;
+	
+	/* indexes in the record's thread array, or SNAPFILE_NO_THREAD */
+	UINT32 owner;
+	UINT32 origin;
+	UINT32 target;
+	UINT32 reserved;
+};
+
+/* pointers to the arrays that follow a record. the record must have been validated. */
+#define SNAPFILE_DESKTOPS(record)   \
+	( (const struct snapfile_desktop *)( (const BYTE *)( record ) + sizeof( struct snapfile_record ) ) )
+
+#define SNAPFILE_THREADS(record)   \
+	( (const struct snapfile_thread *)( SNAPFILE_DESKTOPS( record ) + ( record )->desktop_count ) )
+
+#define SNAPFILE_HOOKS(record)   \
+	( (const struct snapfile_hook *)( SNAPFILE_THREADS( record ) + ( record )->thread_count ) )
+
+#define SNAPFILE_STRINGS(record)   \
+	( (const UINT16 *)( SNAPFILE_HOOKS( record ) + ( record )->hook_count ) )
+
+/* a name in a record's string pool, by its byte offset in the file.
+'strings' is the record's string pool, or the pool widened to WCHAR. see struct snapfile_view.
+*/
+#define SNAPFILE_NAME(strings,offset)   ( ( strings ) + ( ( offset ) / sizeof( UINT16 ) ) )
+
+
+
+/** The snapshot file store.
+The snapshot file store is used to write snapshots to a file (a recording).
+*/
+struct snapfile
+{
+	/* the name of the file */
+	WCHAR *pwszFile;   // must_wcsdup(), free()
+	
+	FILE *fp;   // _wfopen(), fclose()
+	
+	/* how many records have been written to the file */
+	unsigned record_count;
+	
+	/* the system utc time in FILETIME format immediately after this store has been initialized.
+	this is nonzero when this store has been initialized.
+	*/
+	__int64 init_time;
+};
+
+
+
+/** The snapshot file view store.
+The snapshot file view store holds a read only view of a snapshot file and an index of its records.
+*/
+struct snapfile_view
+{
+	/* the name of the file */
+	WCHAR *pwszFile;   // must_wcsdup(), free()
+	
+	/* the read only view of the file */
+	struct portable_view file;   // open_portable_view(), close_portable_view()
+	
+	/* the file header. this points into the view. */
+	const struct snapfile_header *header;
+	
+	/* the computer name in the file header. null terminated. */
+	WCHAR computer_name[ 16 ];
+	
+	/* an array of pointers to the validated records in the view, in file order. 
+	init_snapfile_view_last() only indexes the last record.
+	*/
+	const struct snapfile_record **record;   // calloc(), free()
+	
+	/* an array of pointers to the records' string pools, in the same order as the record array.
+	on Windows they point into the view. on other systems WCHAR is wider than the strings in the 
+	file, and each pool is a copy that has been widened.
+	*/
+	const WCHAR **strings;   // calloc(), free(). other systems: widen_portable_string(), free()
+	
+	/* the number of elements in the record array */
+	unsigned record_count;
+	
+	/* if the file is open but isn't a valid snapshot file, why. see print_snapfile_view_error() */
+	const char *error;
+	
+	/* the system utc time in FILETIME format immediately after this store has been initialized.
+	this is nonzero when this store has been initialized.
+	*/
+	__int64 init_time;
+};
+
+
+
+/** 
+these functions are documented in the comment block above their definitions in snapfile.c
+*/
+void create_snapfile_store( 
+	struct snapfile **const out   // out deref
+);
+
+int init_snapfile_store( 
+	struct snapfile *const store,   // in
+	const WCHAR *const file   // in
+);
+
+int write_snapfile_record( 
+	struct snapfile *const store,   // in
+	const struct snapshot *const snapshot   // in
+);
+
+void free_snapfile_store( 
+	struct snapfile **const in   // in deref
+);
+
+void create_snapfile_view( 
+	struct snapfile_view **const out   // out deref
+);
+
+int validate_snapfile_record( 
+	const BYTE *const base,   // in
+	const size_t bcount,   // in
+	const size_t offset   // in
+);
+
+int init_snapfile_view( 
+	struct snapfile_view *const store,   // in
+	const WCHAR *const file   // in
+);
+
+int init_snapfile_view_last( 
+	struct snapfile_view *const store,   // in
+	const WCHAR *const file   // in
+);
+
+void print_snapfile_view_error( 
+	const struct snapfile_view *const store   // in
+);
+
+int get_snapfile_time( 
+	__int64 *const time,   // out
+	const char *const str   // in
+);
+
+int find_snapfile_record( 
+	unsigned *const index,   // out
+	const struct snapfile_view *const store,   // in
+	const __int64 time   // in
+);
+
+void add_snapfile_record_desktops( 
+	struct desktop_list *const desktops,   // in, out
+	const struct snapfile_view *const view,   // in
+	const unsigned index   // in
+);
+
+int load_snapfile_record( 
+	struct snapshot *const store,   // in, out
+	const struct snapfile_view *const view,   // in
+	const unsigned index,   // in
+	const struct desktop_list *const desktops   // in
+);
+
+void print_snapfile_view( 
+	const struct snapfile_view *const store   // in
+);
+
+void free_snapfile_view( 
+	struct snapfile_view **const in   // in deref
+);
+
+int offlinemode( void );
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _SNAPFILE_H
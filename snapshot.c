@@ -30,6 +30,12 @@ create_snapshot_store()
 Create a snapshot store and its descendants or die.
 -
 
+-
+create_hook_snapshot_store()
+
+Create a hooks only snapshot store and its descendants or die.
+-
+
 -
 match_gui_process_name()
 
@@ -48,6 +54,12 @@ match_gui_thread_id()
 Compare a GUI thread's id to the passed in thread id.
 -
 
+-
+find_desktop_by_key()
+
+Find the attached to desktop whose DESKTOPINFO is at the passed in kernel address.
+-
+
 -
 callback_add_gui()
 
@@ -66,12 +78,54 @@ find_Win32ThreadInfo()
 Search a snapshot store's array of gui threads for a Win32ThreadInfo address.
 -
 
+-
+sort_gui_array()
+
+Sort a snapshot store's gui array and mark the Win32ThreadInfo addresses that aren't unique.
+-
+
+-
+callback_add_known()
+
+Add the passed in thread info to the passed in snapshot's array of threads known to the re-probe.
+-
+
+-
+compare_thread_key()
+
+Compare two threads according to their thread id and creation time.
+-
+
+-
+add_reprobe_key()
+
+Add a THREADINFO address to an array of them if it isn't there already.
+-
+
+-
+get_unknown_keys()
+
+Get the THREADINFO addresses that the hooks in a snapshot refer to but that aren't identified.
+-
+
+-
+reprobe_snapshot_store()
+
+Re-probe the threads that started after the spi array was queried.
+-
+
 -
 init_snapshot_store()
 
 Take a snapshot of the system state. This initializes a snapshot store.
 -
 
+-
+init_hook_snapshot_store()
+
+Take a snapshot of only the desktop hooks. This initializes a hooks only snapshot store.
+-
+
 -
 print_gui_brief()
 
@@ -122,11 +176,38 @@ Free a snapshot store and all its descendants.
 
 #include "snapshot.h"
 
+#include "ancestry.h"
+
+#include "prefetch.h"
+
+#include "checkpoint.h"
+
+#include "stream.h"
+
+/* get_governor_retry_delay() */
+#include "governor.h"
+
 /* the global stores */
 #include "global.h"
 
 
 
+/* the part of a TEB32 that's read for each thread: from Win32ThreadInfo to the end of 
+CLIENTINFO.ulClientDelta. see callback_add_gui()
+*/
+#define SNAPSHOT_TEB_W32THREADINFO   0x040   /* offsetof W32ThreadInfo. 0x40 TEB32, 0x78 TEB64 */
+#define SNAPSHOT_TEB_CLIENTINFO   0x6cc   /* offsetof Win32ClientInfo */
+#define SNAPSHOT_TEB_READ_BCOUNT   \
+	( SNAPSHOT_TEB_CLIENTINFO + 24 + ( 2 * sizeof( void * ) ) - SNAPSHOT_TEB_W32THREADINFO )
+
+
+
+/* Snapshots are only taken on Windows. Other systems only use the store offline. */
+#ifdef _WIN32
+static const struct desktop_item *find_desktop_by_key( 
+	const uintptr_t desktop_key   // in
+);
+
 static int callback_add_gui( 
 	void *cb_param,   // in, out
 	SYSTEM_PROCESS_INFORMATION *const spi,   // in
@@ -134,12 +215,49 @@ static int callback_add_gui(
 	const ULONG remaining,   // in
 	const DWORD flags   // in, optional
 );
+#endif // _WIN32
 
 static int compare_gui( 
 	const void *const p1,   // in
 	const void *const p2   // in
 );
 
+#ifdef _WIN32
+static int sort_gui_array( 
+	struct snapshot *const store   // in
+);
+
+static int callback_add_known( 
+	void *cb_param,   // in, out
+	SYSTEM_PROCESS_INFORMATION *const spi,   // in
+	SYSTEM_THREAD_INFORMATION *const sti,   // in
+	const ULONG remaining,   // in
+	const DWORD flags   // in, optional
+);
+
+static int compare_thread_key( 
+	const void *const p1,   // in
+	const void *const p2   // in
+);
+
+static unsigned add_reprobe_key( 
+	const void **const key,   // in, out
+	const unsigned key_count,   // in
+	const void *const address   // in
+);
+
+static unsigned get_unknown_keys( 
+	const struct snapshot *const store,   // in
+	const void **const key,   // out
+	const unsigned key_max,   // in
+	int *const truncated   // out, optional
+);
+
+static void reprobe_snapshot_store( 
+	struct snapshot *const store   // in
+);
+#endif // _WIN32
+
 
 
 /* create_snapshot_store()
@@ -205,6 +323,36 @@ void create_snapshot_store(
 
 
 
+/* create_hook_snapshot_store() 
+Create a hooks only snapshot store and its descendants or die.
+
+A hooks only snapshot store holds desktop hook info but no spi or gui info, so its gui array is 
+never allocated (gui_max is 0) and the threads associated with each hook are left unidentified.
+It's initialized by init_hook_snapshot_store(), which only reads the handle table and the HOOK 
+objects and is much faster than a full snapshot.
+*/
+void create_hook_snapshot_store( 
+	struct snapshot **const out   // out deref
+)
+{
+	struct snapshot *snapshot = NULL;
+	
+	FAIL_IF( !out );
+	FAIL_IF( *out );
+	
+	
+	/* allocate a snapshot store */
+	snapshot = must_calloc( 1, sizeof( *snapshot ) );
+	
+	create_desktop_hook_store( &snapshot->desktop_hooks );
+	
+	
+	*out = snapshot;
+	return;
+}
+
+
+
 /* match_gui_process_name()
 Compare a GUI thread's process name to the passed in name.
 
@@ -272,6 +420,7 @@ int match_gui_thread_id(
 
 
 
+#ifdef _WIN32
 /* stuff to be passed to callback_add_gui().
 this struct members' annotations are similar to those of function parameters
 "actual" is used if the structure member will be modified by the function, regardless of if what it 
@@ -286,11 +435,56 @@ struct callback_info
 	If traverse_threads() did not terminate successfully this handle must be closed.
 	*/
 	HANDLE process;   // in, out, actual, optional
+	
+	/* In a re-probe the threads in the first query, which aren't probed again.
+	NULL if this isn't a re-probe. see reprobe_snapshot_store()
+	*/
+	const struct snapshot_thread_key *known;   // in, optional
+	unsigned known_count;   // in, optional
 };
 
+/* find_desktop_by_key() 
+Find the attached to desktop whose DESKTOPINFO is at the passed in kernel address.
+
+'desktop_key' is the kernel address of a thread's DESKTOPINFO. see callback_add_gui()
+
+returns the desktop item, or NULL if no attached to desktop has that DESKTOPINFO
+*/
+static const struct desktop_item *find_desktop_by_key( 
+	const uintptr_t desktop_key   // in
+)
+{
+	const struct desktop_item *desktop = NULL;
+	
+	
+	for( desktop = G->desktops->head; desktop; desktop = desktop->next )
+	{
+		if( desktop_key == ( (uintptr_t)desktop->pDeskInfo + (uintptr_t)desktop->pvClientDelta ) )
+			break;
+	}
+	
+	return desktop;
+}
+
+
+
 /* callback_add_gui()
 If the passed in thread info is for a GUI thread add it to the passed in snapshot's gui array.
 
+Win32ThreadInfo and the thread's CLIENTINFO are read from its TEB in one read. CLIENTINFO has the 
+address of the thread's DESKTOPINFO in its process, and the difference between that and the 
+kernel address. A GUI thread on a desktop that isn't attached to can't be associated with any hook 
+that's found, so it's counted but isn't added to the gui array.
+
+In a re-probe only the threads that aren't in the first query are probed, and the ancestry, 
+checkpoint and stream stores aren't updated. See reprobe_snapshot_store()
+
+If the user requested a checkpoint file then a GUI thread's TEB info is cached, and its TEB is only 
+read again when the cached info is due to be verified. The cached info is only used if its desktop 
+is unknown or is attached to. Otherwise the thread may have moved since its desktop was cached, so 
+the TEB is read again, and a thread is only pruned on a desktop read from its TEB in this snapshot.
+A process is only opened if the TEB of one of its threads has to be read.
+
 traverse_threads() callback: this function is called for every SYSTEM_THREAD_INFORMATION.
 This function uses x86 offsets only, it will have to be fixed for x64.
 
@@ -314,6 +508,18 @@ static int callback_add_gui(
 	// address of Win32ThreadInfo
 	void *pvWin32ThreadInfo = NULL;
 	
+	// the attached to desktop the thread is on, or NULL if unknown
+	const struct desktop_item *desktop = NULL;
+	
+	// the kernel address of the thread's DESKTOPINFO, or 0 if unknown
+	uintptr_t desktop_key = 0;
+	
+	// nonzero if the thread is on a desktop that isn't attached to
+	unsigned unattached = FALSE;
+	
+	// the thread's entry in the checkpoint store, or NULL if it isn't cached
+	const struct checkpoint_thread *cached = NULL;
+	
 	// the return code of this function
 	int return_code = TRAVERSE_CALLBACK_ABORT;
 	
@@ -339,6 +545,14 @@ static int callback_add_gui(
 	
 	
 	
+	/* if the user requested the ancestry of hook origins then index each process.
+	this is done before the process id check so that the idle process is indexed.
+	*/
+	if( process_is_new && G->ancestry->init_time && !ci->known )
+		add_ancestry_process( G->ancestry, spi );
+	
+	
+	
 	/** 
 	Open the process if it isn't open already
 	*/
@@ -353,34 +567,14 @@ static int callback_add_gui(
 		goto cleanup;
 	}
 	
-	if( process_is_new )
+	/* the last opened process' handle should have already been closed.
+	this shouldn't happen. abort
+	*/
+	if( process_is_new && ci->process ) // there is a process handle already open
 	{
-		if( ci->process ) // there is a process handle already open
-		{
-			/* the last opened process' handle should have already been closed.
-			this shouldn't happen. abort 
-			*/
-			dbg_printf( "There is a process handle already open. Aborting!\n" );
-			return_code = TRAVERSE_CALLBACK_ABORT;
-			goto cleanup;
-		}
-		
-		SetLastError( 0 ); // error code is evaluated on success
-		ci->process = OpenProcess( PROCESS_VM_READ, FALSE, (DWORD)spi->UniqueProcessId );
-		
-		dbg_printf( "OpenProcess() %s. pid: %lu, GLE: %lu, Handle: 0x%p.\n", 
-			( ci->process ? "success" : "error" ), 
-			(DWORD)spi->UniqueProcessId, 
-			GetLastError(), 
-			ci->process 
-		);
-		
-		/* if the process couldn't be opened then skip traversing its threads */
-		if( !ci->process )
-		{
-			return_code = TRAVERSE_CALLBACK_SKIP;
-			goto cleanup;
-		}
+		dbg_printf( "There is a process handle already open. Aborting!\n" );
+		return_code = TRAVERSE_CALLBACK_ABORT;
+		goto cleanup;
 	}
 	
 	
@@ -399,12 +593,41 @@ static int callback_add_gui(
 		goto cleanup;
 	}
 	
+	/* in a re-probe the threads that were in the first query have already been probed */
+	if( ci->known )
+	{
+		struct snapshot_thread_key findme;
+		
+		
+		findme.tid = (uintptr_t)sti->ClientId.UniqueThread;
+		findme.create_time = sti->CreateTime.QuadPart;
+		
+		if( bsearch( &findme, ci->known, ci->known_count, sizeof( *ci->known ), compare_thread_key ) )
+		{
+			return_code = TRAVERSE_CALLBACK_CONTINUE;
+			goto cleanup;
+		}
+		
+		ci->store->reprobe_probed++;
+	}
+	
+	/* the thread's TEB info is cached if it was read in a previous snapshot, or by the program 
+	that wrote the checkpoint file
+	*/
+	if( G->checkpoint->init_time && !ci->known )
+		cached = use_checkpoint_thread( G->checkpoint, spi, sti );
+	
 	/* check to see if we already have this thread's TEB address.
 	if TRAVERSE_FLAG_EXTENDED was passed in then traverse_threads()
 	called NtQuerySystemInformation() with SystemExtendedProcessInformation.
 	On Vista+ (major >= 6) that should have yielded the TEB address.
 	*/
-	if( ( flags & TRAVERSE_FLAG_EXTENDED ) && ( G->prog->dwOSMajorVersion >= 6 ) )
+	if( cached )
+	{
+		dbg_printf( "Getting TEB address from the checkpoint store\n" );
+		pvTeb = (void *)(uintptr_t)cached->pvTeb;
+	}
+	else if( ( flags & TRAVERSE_FLAG_EXTENDED ) && ( G->prog->dwOSMajorVersion >= 6 ) )
 	{
 		dbg_printf( "Getting TEB address from SYSTEM_EXTENDED_THREAD_INFORMATION\n" );
 		pvTeb = ( (SYSTEM_EXTENDED_THREAD_INFORMATION *)sti )->TebAddress;
@@ -426,17 +649,48 @@ static int callback_add_gui(
 	
 	
 	/** 
-	Get Win32ThreadInfo from the TEB
+	Get Win32ThreadInfo and CLIENTINFO from the TEB
 	*/
+	if( cached && cached->pvWin32ThreadInfo && !CHECKPOINT_VERIFY_DUE( G->checkpoint, cached ) 
+		&& ( !cached->desktop_key || find_desktop_by_key( (uintptr_t)cached->desktop_key ) )
+	)
+	{
+		dbg_printf( "Getting Win32ThreadInfo and CLIENTINFO from the checkpoint store\n" );
+		pvWin32ThreadInfo = (void *)(uintptr_t)cached->pvWin32ThreadInfo;
+		desktop_key = (uintptr_t)cached->desktop_key;
+	}
+	else
 	{
 		BOOL ret = 0;
+		char buffer[ SNAPSHOT_TEB_READ_BCOUNT ];
+		
+		/* open the process when the first of its threads whose TEB has to be read is found */
+		if( !ci->process )
+		{
+			SetLastError( 0 ); // error code is evaluated on success
+			ci->process = OpenProcess( PROCESS_VM_READ, FALSE, (DWORD)spi->UniqueProcessId );
+			
+			dbg_printf( "OpenProcess() %s. pid: %lu, GLE: %lu, Handle: 0x%p.\n", 
+				( ci->process ? "success" : "error" ), 
+				(DWORD)spi->UniqueProcessId, 
+				GetLastError(), 
+				ci->process
+			);
+			
+			/* if the process couldn't be opened then skip traversing the rest of its threads */
+			if( !ci->process )
+			{
+				return_code = TRAVERSE_CALLBACK_SKIP;
+				goto cleanup;
+			}
+		}
 		
 		SetLastError( 0 ); // error code is evaluated on success
 		ret = ReadProcessMemory( 
 			ci->process, 
-			(char *)pvTeb + 0x040, /* pvTeb + offsetof W32ThreadInfo. 0x40 TEB32, 0x78 TEB64 */
-			&pvWin32ThreadInfo, 
-			sizeof( pvWin32ThreadInfo ), 
+			(char *)pvTeb + SNAPSHOT_TEB_W32THREADINFO, 
+			buffer, 
+			sizeof( buffer ), 
 			NULL 
 		);
 		
@@ -446,11 +700,45 @@ static int callback_add_gui(
 			ci->process 
 		);
 		
-		if( !ret )
+		if( ret )
+		{
+			/* CLIENTINFO.pDeskInfo and the next member, CLIENTINFO.ulClientDelta. see desktop.c */
+			const size_t offsetof_pDeskInfo = 
+				( ( G->prog->dwOSMajorVersion == 5 ) && ( G->prog->dwOSMinorVersion == 0 ) ) ? 20 : 24;
+			const char *const clientinfo = 
+				buffer + ( SNAPSHOT_TEB_CLIENTINFO - SNAPSHOT_TEB_W32THREADINFO );
+			const uintptr_t pDeskInfo = *(const uintptr_t *)( clientinfo + offsetof_pDeskInfo );
+			const uintptr_t ulClientDelta = 
+				*(const uintptr_t *)( clientinfo + offsetof_pDeskInfo + sizeof( void * ) );
+			
+			
+			pvWin32ThreadInfo = *(void **)buffer;
+			
+			if( pDeskInfo )
+				desktop_key = pDeskInfo + ulClientDelta;
+		}
+		else
 			pvWin32ThreadInfo = 0;
+		
+		/* 'cached' is invalid after this call */
+		if( G->checkpoint->init_time && !ci->known )
+		{
+			add_checkpoint_thread( G->checkpoint, spi, sti, pvTeb, pvWin32ThreadInfo, desktop_key );
+			cached = NULL;
+		}
+	}
+	
+	/* match the kernel address of the thread's DESKTOPINFO to an attached to desktop */
+	if( desktop_key )
+	{
+		desktop = find_desktop_by_key( desktop_key );
+		unattached = !desktop;
 	}
 	
 	dbg_printf( "Win32ThreadInfo: 0x%p\n", pvWin32ThreadInfo );
+	dbg_printf( "Desktop: %ls\n", 
+		( desktop ? desktop->pwszDesktopName : ( unattached ? L"<not attached>" : L"<unknown>" ) )
+	);
 	
 	/* if there's no Win32ThreadInfo then this thread is not a GUI thread.
 	continue to the next thread
@@ -461,6 +749,15 @@ static int callback_add_gui(
 		goto cleanup;
 	}
 	
+	/* if the thread is on a desktop that isn't attached to then continue to the next thread */
+	if( unattached )
+	{
+		ci->store->gui_pruned++;
+		
+		return_code = TRAVERSE_CALLBACK_CONTINUE;
+		goto cleanup;
+	}
+	
 	/* if the number of gui threads found is more than can be held in the array 
 	then abort. this is a high number like 10,000 - 100,000 so this shouldn't happen.
 	*/
@@ -490,10 +787,17 @@ static int callback_add_gui(
 	ci->store->gui[ ci->store->gui_count ].pvTeb = pvTeb;
 	ci->store->gui[ ci->store->gui_count ].spi = spi;
 	ci->store->gui[ ci->store->gui_count ].sti = sti;
+	ci->store->gui[ ci->store->gui_count ].desktop = desktop;
 	
 	// increment the number of gui threads found
 	ci->store->gui_count++;
 	
+	/* if the initial hooks are streamed then print each desktop's hooks when all their threads 
+	have been found
+	*/
+	if( G->stream->pending && !ci->known )
+		add_stream_thread( G->stream, ci->store, ci->store->gui_count - 1 );
+	
 	return_code = TRAVERSE_CALLBACK_CONTINUE;
 	
 cleanup:
@@ -521,6 +825,7 @@ cleanup:
 	
 	return return_code;
 }
+#endif // _WIN32
 
 
 
@@ -598,6 +903,453 @@ struct gui *find_Win32ThreadInfo(
 
 
 
+#ifdef _WIN32
+/* sort_gui_array() 
+Sort a snapshot store's gui array and mark the Win32ThreadInfo addresses that aren't unique.
+
+The array must be sorted so that bsearch() can be called to later search for a Win32ThreadInfo.
+
+returns nonzero on success. if there's an invalid Win32ThreadInfo the gui struct is printed.
+*/
+static int sort_gui_array( 
+	struct snapshot *const store   // in
+)
+{
+	unsigned i = 0;
+	
+	FAIL_IF( !store );
+	
+	
+	/* sort the gui array according to Win32ThreadInfo */
+	qsort( 
+		store->gui, 
+		store->gui_count, 
+		sizeof( *store->gui ), 
+		compare_gui
+	);
+	
+	/* search for invalid or duplicate Win32ThreadInfo */
+	for( i = 1; i < store->gui_count; ++i )
+	{
+		struct gui *const a = &store->gui[ i - 1 ];
+		struct gui *const b = &store->gui[ i ];
+		
+		
+		if( a->pvWin32ThreadInfo == b->pvWin32ThreadInfo )
+		{
+			a->unique_w32thread = FALSE;
+			b->unique_w32thread = FALSE;
+		}
+		
+		if( !a->pvWin32ThreadInfo )
+		{
+			MSG_ERROR( "Invalid pvWin32ThreadInfo." );
+			print_gui( a );
+			return FALSE;
+		}
+		
+		if( !b->pvWin32ThreadInfo )
+		{
+			MSG_ERROR( "Invalid pvWin32ThreadInfo." );
+			print_gui( b );
+			return FALSE;
+		}
+	}
+	
+	return TRUE;
+}
+
+
+
+/* callback_add_known() 
+Add the passed in thread info to the passed in snapshot's array of threads known to the re-probe.
+
+traverse_threads() callback: this function is called for every SYSTEM_THREAD_INFORMATION in the 
+snapshot's spi array, which is recycled.
+
+The behavior of a traverse_threads() callback is documented in traverse_threads.txt.
+*/
+static int callback_add_known( 
+	void *cb_param,   // in, out
+	SYSTEM_PROCESS_INFORMATION *const spi,   // in
+	SYSTEM_THREAD_INFORMATION *const sti,   // in
+	const ULONG remaining,   // in
+	const DWORD flags   // in, optional
+)
+{
+	struct snapshot *const store = (struct snapshot *)cb_param;
+	struct snapshot_thread_key *key = NULL;
+	
+	FAIL_IF( !store );
+	FAIL_IF( !spi );
+	FAIL_IF( !sti );
+	
+	
+	if( store->reprobe_known_count >= store->gui_max )
+		return TRAVERSE_CALLBACK_ABORT;
+	
+	key = &store->reprobe_known[ store->reprobe_known_count++ ];
+	key->tid = (uintptr_t)sti->ClientId.UniqueThread;
+	key->create_time = sti->CreateTime.QuadPart;
+	
+	return TRAVERSE_CALLBACK_CONTINUE;
+}
+
+
+
+/* compare_thread_key() 
+Compare two threads according to their thread id and creation time.
+
+qsort() callback: this function is called when sorting the threads known to the re-probe 
+bsearch() callback: this function is called when searching them for a thread
+
+returns -1, 1 or 0 if 'p1' is less than, greater than or the same as 'p2'
+*/
+static int compare_thread_key( 
+	const void *const p1,   // in
+	const void *const p2   // in
+)
+{
+	const struct snapshot_thread_key *const a = p1;
+	const struct snapshot_thread_key *const b = p2;
+	
+	
+	if( a->tid < b->tid )
+		return -1;
+	else if( a->tid > b->tid )
+		return 1;
+	else if( a->create_time < b->create_time )
+		return -1;
+	else if( a->create_time > b->create_time )
+		return 1;
+	else
+		return 0;
+}
+
+
+
+/* add_reprobe_key() 
+Add a THREADINFO address to an array of them if it isn't there already.
+
+'key' is the array. it must have room for another address.
+'key_count' is the number of addresses in the array.
+
+returns the number of addresses in the array
+*/
+static unsigned add_reprobe_key( 
+	const void **const key,   // in, out
+	const unsigned key_count,   // in
+	const void *const address   // in
+)
+{
+	unsigned i = 0;
+	
+	FAIL_IF( !key );
+	
+	
+	for( i = 0; i < key_count; ++i )
+	{
+		if( key[ i ] == address )
+			return key_count;
+	}
+	
+	key[ key_count ] = address;
+	return key_count + 1;
+}
+
+
+
+/* get_unknown_keys() 
+Get the THREADINFO addresses that the hooks in a snapshot refer to but that aren't identified.
+
+'key' receives up to 'key_max' addresses, each only once.
+'truncated' receives nonzero if there may be more addresses than fit in 'key'
+
+returns the number of addresses written to 'key'
+*/
+static unsigned get_unknown_keys( 
+	const struct snapshot *const store,   // in
+	const void **const key,   // out
+	const unsigned key_max,   // in
+	int *const truncated   // out, optional
+)
+{
+	unsigned count = 0;
+	const struct desktop_hook_item *item = NULL;
+	
+	FAIL_IF( !store );
+	FAIL_IF( !key );
+	
+	
+	if( truncated )
+		*truncated = FALSE;
+	
+	for( item = store->desktop_hooks->head; item; item = item->next )
+	{
+		unsigned i = 0;
+		
+		for( i = 0; i < item->hook_count; ++i )
+		{
+			const struct hook *const hook = &item->hook[ i ];
+			
+			/* there's no room for the addresses of another hook */
+			if( ( count + 3 ) > key_max )
+			{
+				if( ( hook->entry.pOwner && !hook->owner ) 
+					|| ( hook->object.pti && !hook->origin ) 
+					|| ( hook->object.ptiHooked && !hook->target )
+				)
+				{
+					if( truncated )
+						*truncated = TRUE;
+					
+					return count;
+				}
+				
+				continue;
+			}
+			
+			if( hook->entry.pOwner && !hook->owner )
+				count = add_reprobe_key( key, count, hook->entry.pOwner );
+			
+			if( hook->object.pti && !hook->origin )
+				count = add_reprobe_key( key, count, hook->object.pti );
+			
+			if( hook->object.ptiHooked && !hook->target )
+				count = add_reprobe_key( key, count, hook->object.ptiHooked );
+		}
+	}
+	
+	return count;
+}
+
+
+
+/* reprobe_snapshot_store() 
+Re-probe the threads that started after the spi array was queried.
+
+The spi array is queried before the handle table is read, so a HOOK set by a thread that started 
+in between refers to a THREADINFO that isn't in the gui array, and its thread is unknown. If there 
+are any such THREADINFO addresses then the system process info is queried once more and only the 
+threads that aren't in the first query are probed. The GUI threads found are added to the gui 
+array and the threads of each hook are identified again, in place. The ancestry of a process found 
+this way isn't known.
+
+A THREADINFO address that the last re-probe of this store couldn't identify doesn't cause another 
+re-probe. If the re-probe fails the hooks are left as they are.
+
+There's no re-probe if there are more unknown addresses than SNAPSHOT_REPROBE_KEYS_MAX, since they 
+couldn't all be remembered as skipped and every snapshot would be re-probed. There's also no 
+re-probe if the user requested only the processes in a session other than this program's: the hooks 
+are on this program's desktops, so their threads are in its session and the filter excludes them.
+*/
+static void reprobe_snapshot_store( 
+	struct snapshot *const store   // in
+)
+{
+	const void *key[ SNAPSHOT_REPROBE_KEYS_MAX ];
+	unsigned key_count = 0, i = 0, j = 0, gui_count = 0;
+	__int64 qpc_frequency = 0, qpc_begin = 0, qpc_end = 0;
+	LONG nt_status = 0;
+	DWORD flags = 0, session = 0;
+	int ret = 0, truncated = 0;
+	struct callback_info ci;
+	struct traverse_filter filter;
+	
+	FAIL_IF( !store );
+	FAIL_IF( !store->init_time_gui );   // The gui array must be initialized.
+	
+	
+	store->reprobe_probed = 0;
+	store->reprobe_added = 0;
+	store->reprobe_unknown = 0;
+	store->reprobe_unresolved = 0;
+	store->reprobe_us = 0;
+	
+	/* the threads of the hooks are all in this program's session */
+	if( ( G->config->flags & CFG_SESSION_FILTER ) 
+		&& ProcessIdToSessionId( GetCurrentProcessId(), &session ) 
+		&& ( session != G->config->session )
+	)
+		return;
+	
+	key_count = get_unknown_keys( store, key, SNAPSHOT_REPROBE_KEYS_MAX, &truncated );
+	
+	if( truncated )
+	{
+		if( G->config->verbose >= 1 )
+		{
+			printf( "Not re-probing: more than %u THREADINFO addresses are unknown.\n", 
+				key_count
+			);
+		}
+		
+		return;
+	}
+	
+	/* only the addresses that the last re-probe of this store didn't fail to identify count */
+	for( i = 0; i < key_count; ++i )
+	{
+		for( j = 0; j < store->reprobe_skip_count; ++j )
+		{
+			if( key[ i ] == store->reprobe_skip[ j ] )
+				break;
+		}
+		
+		if( j >= store->reprobe_skip_count )
+			break;
+	}
+	
+	if( i >= key_count )
+	{
+		/* nothing to re-probe. forget the addresses that have since been identified. */
+		memcpy( store->reprobe_skip, key, ( key_count * sizeof( *key ) ) );
+		store->reprobe_skip_count = key_count;
+		return;
+	}
+	
+	QueryPerformanceFrequency( (LARGE_INTEGER *)&qpc_frequency );
+	QueryPerformanceCounter( (LARGE_INTEGER *)&qpc_begin );
+	
+	store->reprobe_unknown = key_count;
+	
+	if( !store->reprobe_spi )
+	{
+		store->reprobe_spi = must_calloc( store->spi_max_bytes, 1 );
+		store->reprobe_known = must_calloc( store->gui_max, sizeof( *store->reprobe_known ) );
+	}
+	
+	/* the threads in the first query. its spi array is recycled. */
+	flags = TRAVERSE_FLAG_RECYCLE;
+	if( store->spi_extended )
+		flags |= TRAVERSE_FLAG_EXTENDED;
+	
+	store->reprobe_known_count = 0;
+	
+	ret = traverse_threads( 
+		callback_add_known, 
+		store, 
+		store->spi, 
+		store->spi_max_bytes, 
+		flags, 
+		NULL
+	);
+	
+	if( ret != TRAVERSE_SUCCESS )
+	{
+		if( G->config->verbose >= 1 )
+		{
+			MSG_WARNING( "traverse_threads() failed to list the threads for the re-probe." );
+			printf( "traverse_threads() returned: %s\n", traverse_threads_retcode_to_cstr( ret ) );
+		}
+		
+		return;
+	}
+	
+	qsort( 
+		store->reprobe_known, 
+		store->reprobe_known_count, 
+		sizeof( *store->reprobe_known ), 
+		compare_thread_key
+	);
+	
+	/* query the system process info again and probe only the threads that are new */
+	ZeroMemory( &ci, sizeof( ci ) );
+	ci.store = store;
+	ci.known = store->reprobe_known;
+	ci.known_count = store->reprobe_known_count;
+	
+	flags = TRAVERSE_FLAG_VALIDATE_ONCE;
+	if( store->spi_extended )
+		flags |= TRAVERSE_FLAG_EXTENDED;
+	
+	if( G->config->verbose >= 9 )
+		flags |= TRAVERSE_FLAG_DEBUG;
+	
+	ZeroMemory( &filter, sizeof( filter ) );
+	
+	if( G->config->flags & CFG_SESSION_FILTER )
+	{
+		filter.flags = TRAVERSE_FILTER_SESSION;
+		filter.session_id = G->config->session;
+	}
+	
+	gui_count = store->gui_count;
+	
+	ret = traverse_threads_ex( 
+		callback_add_gui, 
+		&ci, 
+		store->reprobe_spi, 
+		store->spi_max_bytes, 
+		flags, 
+		&nt_status, 
+		&filter
+	);
+	
+	if( ci.process )
+	{
+		CloseHandle( ci.process );
+		ci.process = NULL;
+	}
+	
+	if( ret != TRAVERSE_SUCCESS )
+	{
+		/* the gui structs added may point to an spi array that isn't valid */
+		store->gui_count = gui_count;
+		
+		if( G->config->verbose >= 1 )
+		{
+			MSG_WARNING( "traverse_threads() failed to re-probe the new threads." );
+			printf( "traverse_threads() returned: %s\n", traverse_threads_retcode_to_cstr( ret ) );
+		}
+		
+		return;
+	}
+	
+	store->reprobe_added = store->gui_count - gui_count;
+	
+	/* the gui array is sorted again, so every hook's threads are found again */
+	if( store->reprobe_added )
+	{
+		for( i = 0; i < store->gui_count; ++i )
+			store->gui[ i ].unique_w32thread = TRUE;
+		
+		if( !sort_gui_array( store ) )
+		{
+			MSG_FATAL( "The gui array is invalid after the re-probe." );
+			exit( 1 );
+		}
+		
+		resolve_desktop_hook_store( store );
+	}
+	
+	/* the addresses that are still unknown don't cause the next re-probe of this store */
+	key_count = get_unknown_keys( store, key, SNAPSHOT_REPROBE_KEYS_MAX, NULL );
+	memcpy( store->reprobe_skip, key, ( key_count * sizeof( *key ) ) );
+	store->reprobe_skip_count = key_count;
+	store->reprobe_unresolved = 
+		( key_count < store->reprobe_unknown ) ? key_count : store->reprobe_unknown;
+	
+	QueryPerformanceCounter( (LARGE_INTEGER *)&qpc_end );
+	store->reprobe_us = ( ( qpc_end - qpc_begin ) * 1000000 ) / qpc_frequency;
+	
+	if( G->config->verbose >= 1 )
+	{
+		printf( "Re-probed %u new threads in %I64d us: %u GUI threads added, %u of %u unknown "
+			"THREADINFO addresses identified.\n", 
+			store->reprobe_probed, 
+			store->reprobe_us, 
+			store->reprobe_added, 
+			( store->reprobe_unknown - store->reprobe_unresolved ), 
+			store->reprobe_unknown
+		);
+	}
+	
+	return;
+}
+
+
+
 /* init_snapshot_store()
 Take a snapshot of the system state. This initializes a snapshot store.
 
@@ -621,12 +1373,14 @@ int init_snapshot_store(
 	struct snapshot *const store   // in
 )
 {
-	unsigned i = 0;
 	__int64 first_fail_time = 0;
+	unsigned retry_count = 0;
 	int ret = 0;
 	LONG nt_status = 0;
 	DWORD flags = 0;
+	__int64 qpc_frequency = 0, qpc_begin = 0, qpc_end = 0;
 	struct callback_info ci;
+	struct traverse_filter filter;
 	
 	FAIL_IF( !G->prog->init_time );   // The program store must be initialized.
 	FAIL_IF( !G->config->init_time );   // The configuration store must be initialized.
@@ -637,12 +1391,16 @@ int init_snapshot_store(
 	FAIL_IF( !store );   // a snapshot store must always be passed in
 	
 	
+	QueryPerformanceFrequency( (LARGE_INTEGER *)&qpc_frequency );
+	QueryPerformanceCounter( (LARGE_INTEGER *)&qpc_begin );
+	
 retry:
 	flags = 0;
 	nt_status = 0;
 	
 	/* snapshot stores are reused. do a soft reset to reuse gui array */
 	store->gui_count = 0;
+	store->gui_pruned = 0;
 	/* the spi array doesn't have a count. traverse_threads() overwrites the spi regardless */
 	/* store->desktop_hooks is soft reset by init_desktop_hook_store() */
 	
@@ -660,25 +1418,52 @@ retry:
 	ZeroMemory( &ci, sizeof( ci ) );
 	ci.store = store;
 	
+	/* callback_add_gui() adds each process to the ancestry store during the traversal */
+	if( G->ancestry->init_time )
+		begin_ancestry_update( G->ancestry );
+	
+	/* callback_add_gui() uses and updates the cached TEB info of each thread */
+	if( G->checkpoint->init_time )
+		begin_checkpoint_update( G->checkpoint );
+	
 	/* callback_add_gui() gets TEBs faster with EXTENDED */
 	store->spi_extended = TRUE;
 	if( store->spi_extended ) 
 		flags |= TRAVERSE_FLAG_EXTENDED;
 	
+	/* validate the whole spi array in one pass before callback_add_gui() is called for any of it */
+	flags |= TRAVERSE_FLAG_VALIDATE_ONCE;
+	
 	if( G->config->verbose >= 9 )
 		flags |= TRAVERSE_FLAG_DEBUG;
 	
+	/* if the system process info was prefetched and is fresh enough then it's swapped into the 
+	spi array and the spi init time is set to when it was queried. see claim_prefetch_store()
+	*/
+	if( G->prefetch->init_time && claim_prefetch_store( G->prefetch, store ) )
+		flags |= TRAVERSE_FLAG_RECYCLE;
+	
+	/* if the user requested only one session then the processes in other sessions are skipped */
+	ZeroMemory( &filter, sizeof( filter ) );
+	
+	if( G->config->flags & CFG_SESSION_FILTER )
+	{
+		filter.flags = TRAVERSE_FILTER_SESSION;
+		filter.session_id = G->config->session;
+	}
+	
 	/* call traverse_threads() to write the array of spi and gui.
 	traverse_threads() calls callback_add_gui() which writes to the store's array of gui and sets 
 	the spi init time.
 	*/
-	ret = traverse_threads( 
+	ret = traverse_threads_ex( 
 		callback_add_gui, /* callback */
 		&ci, /* pointer to callback data */
 		ci.store->spi, /* buffer that will receive the array of spi */
 		ci.store->spi_max_bytes, /* buffer's byte count */
 		flags, /* flags */
-		&nt_status /* pointer to receive status */
+		&nt_status, /* pointer to receive status */
+		&filter /* the processes to traverse */
 	);
 	
 	if( ret != TRAVERSE_SUCCESS )
@@ -717,8 +1502,9 @@ retry:
 				 fflush( stdout );
 			}
 
+			/* so as not to suck up cpu. with a CPU budget the delay increases with each retry. */
 			if( G->config->polling != 0 )
-				Sleep( 1 ); // so as not to suck up cpu
+				Sleep( get_governor_retry_delay( G->governor, retry_count++ ) );
 
 			goto retry;
 		}
@@ -766,49 +1552,70 @@ retry:
 		return FALSE;
 	}
 	
-	/* sort the gui array according to Win32ThreadInfo.
-	this array must be sorted so that bsearch() can be called to later search for a Win32ThreadInfo
-	*/
-	qsort( 
-		store->gui,
-		store->gui_count,
-		sizeof( *store->gui ),
-		compare_gui
-	);
+	/* the processes not seen in this traversal have exited */
+	if( G->ancestry->init_time )
+		end_ancestry_update( G->ancestry, store->init_time_spi );
 	
-	/* search for invalid or duplicate Win32ThreadInfo */
-	for( i = 1; i < store->gui_count; ++i )
-	{
-		struct gui *const a = &store->gui[ i - 1 ];
-		struct gui *const b = &store->gui[ i ];
-		
-		
-		if( a->pvWin32ThreadInfo == b->pvWin32ThreadInfo )
-		{
-			a->unique_w32thread = FALSE;
-			b->unique_w32thread = FALSE;
-		}
-		
-		if( !a->pvWin32ThreadInfo )
-		{
-			MSG_ERROR( "Invalid pvWin32ThreadInfo." );
-			print_gui( a );
-			return FALSE;
-		}
-		
-		if( !b->pvWin32ThreadInfo )
-		{
-			MSG_ERROR( "Invalid pvWin32ThreadInfo." );
-			print_gui( b );
-			return FALSE;
-		}
-	}
+	/* the threads not seen in this traversal have exited */
+	if( G->checkpoint->init_time )
+		end_checkpoint_update( G->checkpoint );
+	
+	/* sort the gui array according to Win32ThreadInfo */
+	if( !sort_gui_array( store ) )
+		return FALSE;
 	
 	/* the gui array has been initialized */
 	GetSystemTimeAsFileTime( (FILETIME *)&store->init_time_gui );
 	
 	
 gethooks:
+	/* init the desktop hook store */
+	if( !init_desktop_hook_store( store ) )
+		return FALSE;
+	
+	/* identify the threads of the hooks set by threads that started after the spi array query */
+	if( store->init_time_gui )
+		reprobe_snapshot_store( store );
+	
+	QueryPerformanceCounter( (LARGE_INTEGER *)&qpc_end );
+	store->capture_us = ( ( qpc_end - qpc_begin ) * 1000000 ) / qpc_frequency;
+	
+	/* the snapshot store has been initialized */
+	GetSystemTimeAsFileTime( (FILETIME *)&store->init_time );
+	return TRUE;
+}
+
+
+
+/* init_hook_snapshot_store() 
+Take a snapshot of only the desktop hooks. This initializes a hooks only snapshot store.
+
+'store' must have been created by create_hook_snapshot_store().
+
+No threads are traversed, so each hook's owner, origin and target are NULL and only their 
+THREADINFO kernel addresses are known. Like other snapshot stores this store is reused.
+
+This function must only be called from the main thread.
+
+returns nonzero on success
+*/
+int init_hook_snapshot_store( 
+	struct snapshot *const store   // in
+)
+{
+	FAIL_IF( !G->prog->init_time );   // The program store must be initialized.
+	FAIL_IF( !G->config->init_time );   // The configuration store must be initialized.
+	FAIL_IF( !G->desktops->init_time );   // The desktop store must be initialized.
+	
+	FAIL_IF( GetCurrentThreadId() != G->prog->dwMainThreadId );   // main thread only
+	
+	FAIL_IF( !store );   // a snapshot store must always be passed in
+	FAIL_IF( store->gui_max || store->spi );   // the snapshot store must be hooks only
+	
+	
+	/* reset init times. the spi and gui init times are never set in a hooks only store */
+	store->init_time = 0;
+	
 	/* init the desktop hook store */
 	if( !init_desktop_hook_store( store ) )
 		return FALSE;
@@ -817,6 +1624,7 @@ gethooks:
 	GetSystemTimeAsFileTime( (FILETIME *)&store->init_time );
 	return TRUE;
 }
+#endif // _WIN32
 
 
 
@@ -890,6 +1698,7 @@ void print_gui_array_brief(
 	
 	printf( "store->gui_max: %u\n", store->gui_max );
 	printf( "store->gui_count: %u\n", store->gui_count );
+	printf( "store->gui_pruned: %u\n", store->gui_pruned );
 	
 	if( store->gui )
 	{
@@ -931,6 +1740,7 @@ void print_gui(
 	PRINT_HEX( gui->pvWin32ThreadInfo );
 	printf( "gui->unique_w32thread: %s\n", ( gui->unique_w32thread ? "TRUE" : "FALSE" ) );
 	PRINT_HEX( gui->pvTeb );
+	printf( "gui->desktop: %ls\n", ( gui->desktop ? gui->desktop->pwszDesktopName : L"<unknown>" ) );
 	
 	printf( "\n" );
 	
@@ -939,10 +1749,13 @@ void print_gui(
 	eg
 	procexp.exe: PID 5860, TID 4076 state Waiting (UserRequest).
 	CreateTime: 12:45:24 PM  9/7/2011
+	traverse_threads() is only built on Windows, and elsewhere the gui is never from a query.
 	*/
+#ifdef _WIN32
 	if( gui->spi )
 		callback_print_thread_state( &G->prog->dwOSVersion, gui->spi, gui->sti, 0, 0 );
 	else
+#endif
 		MSG_ERROR( "gui->spi == NULL" );
 	
 	PRINT_SEP_END( objname );
@@ -972,6 +1785,7 @@ void print_gui_array(
 	
 	printf( "store->gui_max: %u\n", store->gui_max );
 	printf( "store->gui_count: %u\n", store->gui_count );
+	printf( "store->gui_pruned: %u\n", store->gui_pruned );
 	
 	if( store->gui )
 	{
@@ -990,6 +1804,8 @@ void print_gui_array(
 
 
 
+/* The spi array is only queried on Windows. */
+#ifdef _WIN32
 /* print_spi_array_brief()
 Print some brief information from a snapshot store's spi array.
 
@@ -1040,6 +1856,7 @@ void print_spi_array_brief(
 	
 	return;
 }
+#endif // _WIN32
 
 
 
@@ -1061,10 +1878,21 @@ void print_snapshot_store(
 	PRINT_DBLSEP_BEGIN( objname );
 	print_init_time( "store->init_time", store->init_time );
 	
+#ifdef _WIN32
 	print_spi_array_brief( store );
+#endif
 	
 	print_gui_array( store );
 	
+	printf( "store->reprobe_known_count: %u\n", store->reprobe_known_count );
+	printf( "store->reprobe_skip_count: %u\n", store->reprobe_skip_count );
+	printf( "store->reprobe_probed: %u\n", store->reprobe_probed );
+	printf( "store->reprobe_added: %u\n", store->reprobe_added );
+	printf( "store->reprobe_unknown: %u\n", store->reprobe_unknown );
+	printf( "store->reprobe_unresolved: %u\n", store->reprobe_unresolved );
+	printf( "store->reprobe_us: %I64d\n", store->reprobe_us );
+	printf( "store->capture_us: %I64d\n", store->capture_us );
+	
 	print_desktop_hook_store( store->desktop_hooks );
 	
 	PRINT_DBLSEP_END( objname );
@@ -1095,6 +1923,10 @@ void free_snapshot_store(
 	
 	free( (*in)->spi );
 	
+	free( (*in)->reprobe_known );
+	
+	free( (*in)->reprobe_spi );
+	
 	free( (*in) );
 	*in = NULL;
 	
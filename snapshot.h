@@ -21,7 +21,11 @@ along with GetHooks.  If not, see <http://www.gnu.org/licenses/>.
 #ifndef _SNAPSHOT_H
 #define _SNAPSHOT_H
 
+#ifdef _WIN32
 #include <windows.h>
+#else
+#include "portable.h"
+#endif
 
 /* SYSTEM_THREAD_INFORMATION,
 SYSTEM_EXTENDED_THREAD_INFORMATION,
@@ -86,6 +90,22 @@ struct gui
 	members using a pointer to SYSTEM_THREAD_INFORMATION.
 	*/
 	SYSTEM_THREAD_INFORMATION *sti;
+	
+	/* The attached to desktop that the thread is on.
+	This is found from the thread's CLIENTINFO, which is read from the TEB in the same read as 
+	Win32ThreadInfo. NULL if the thread's desktop isn't known.
+	*/
+	const struct desktop_item *desktop;
+};
+
+
+
+/** This is a thread in the spi array, identified by its id and creation time.
+*/
+struct snapshot_thread_key
+{
+	uintptr_t tid;
+	__int64 create_time;
 };
 
 
@@ -140,6 +160,11 @@ struct snapshot
 	*/
 	unsigned gui_count;
 	
+	/* how many GUI threads were found on desktops that aren't attached to. these threads can't be 
+	associated with any hook that's found so they aren't added to the gui array.
+	*/
+	unsigned gui_pruned;
+	
 	
 	
 	/* desktop hook store. a linked list of desktops and their hooks */
@@ -147,6 +172,43 @@ struct snapshot
 	
 	
 	
+	/** the re-probe of the threads that started after the spi array was queried. see 
+	reprobe_snapshot_store()
+	*/
+	/* a second buffer of spi, the same size as 'spi', that the re-probe queries into. the gui 
+	structs of the threads it finds point to this buffer. it's allocated the first time it's needed.
+	*/
+	SYSTEM_PROCESS_INFORMATION *reprobe_spi;   // calloc(), free()
+	
+	/* the threads in the spi array, sorted by id and creation time. allocated with 'reprobe_spi'.
+	the number of elements allocated is gui_max.
+	*/
+	struct snapshot_thread_key *reprobe_known;   // calloc(), free()
+	unsigned reprobe_known_count;
+	
+	/* the THREADINFO kernel addresses that the last re-probe of this store couldn't identify. they 
+	don't cause another re-probe, so that a thread that can never be identified (eg its process 
+	can't be opened) doesn't cost a query with every snapshot.
+	*/
+	#define SNAPSHOT_REPROBE_KEYS_MAX   64
+	const void *reprobe_skip[ SNAPSHOT_REPROBE_KEYS_MAX ];
+	unsigned reprobe_skip_count;
+	
+	/* in the last re-probe of this store the number of threads probed, the number of GUI threads 
+	added, the number of unknown THREADINFO addresses before and after, and the time it took in 
+	microseconds. all 0 if this store wasn't re-probed.
+	*/
+	unsigned reprobe_probed;
+	unsigned reprobe_added;
+	unsigned reprobe_unknown;
+	unsigned reprobe_unresolved;
+	__int64 reprobe_us;
+	
+	/* the time it took to take this snapshot in microseconds, including any retries */
+	__int64 capture_us;
+	
+	
+	
 	/* the system utc time in FILETIME format immediately after spi has been initialized.
 	this is nonzero when the spi array has been initialized.
 	*/
@@ -172,6 +234,10 @@ void create_snapshot_store(
 	struct snapshot **const out   // out deref
 );
 
+void create_hook_snapshot_store( 
+	struct snapshot **const out   // out deref
+);
+
 int match_gui_process_name(
 	const struct gui *const gui,   // in
 	const WCHAR *const name   // in
@@ -196,6 +262,10 @@ int init_snapshot_store(
 	struct snapshot *const store   // in
 );
 
+int init_hook_snapshot_store( 
+	struct snapshot *const store   // in
+);
+
 void print_gui_brief( 
 	const struct gui *const gui   // in
 );
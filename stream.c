@@ -0,0 +1,719 @@
+/*
+Copyright (C) 2011 Jay Satiro <raysatiro@yahoo.com>
+All rights reserved.
+
+This file is part of GetHooks.
+
+GetHooks is free software: you can redistribute it and/or modify 
+it under the terms of the GNU General Public License as published by 
+the Free Software Foundation, either version 3 of the License, or 
+(at your option) any later version.
+
+GetHooks is distributed in the hope that it will be useful, 
+but WITHOUT ANY WARRANTY; without even the implied warranty of 
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License 
+along with GetHooks.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/** 
+This file contains functions for a stream store (incremental initial hook list).
+Each function is documented in the comment block above its definition.
+
+A hook's owner, origin and target threads can only be identified once the thread with the same 
+Win32ThreadInfo has been found, and the threads are found by traversing every thread on the 
+system. Instead of waiting for the traversal to finish, the hooks are captured first in a hooks 
+only snapshot and each desktop's hooks are printed as soon as all the threads they refer to have 
+been found.
+
+-
+create_stream_store()
+
+Create a stream store and its descendants or die.
+-
+
+-
+hash_stream_pti()
+
+Get the first slot in the hash table for a Win32ThreadInfo.
+-
+
+-
+find_stream_gui()
+
+Find the gui thread found so far for a Win32ThreadInfo that a desktop's hooks refer to.
+-
+
+-
+emit_stream_desktop()
+
+Print the hooks of a desktop in the hooks only snapshot.
+-
+
+-
+flush_stream_store()
+
+Print the hooks of the desktops that are ready in ordered mode.
+-
+
+-
+init_stream_store()
+
+Initialize a stream store and if streaming take the hooks only snapshot.
+-
+
+-
+add_stream_thread()
+
+Note a gui thread found during the traversal and print any desktop that's now resolved.
+-
+
+-
+end_stream_store()
+
+End streaming after the first snapshot has been taken.
+-
+
+-
+note_stream_output()
+
+Note that a hook in the initial hook list is about to be printed.
+-
+
+-
+print_stream_report()
+
+Print the time to first hook.
+-
+
+-
+print_stream_store()
+
+Print a stream store.
+-
+
+-
+free_stream_store()
+
+Free a stream store and all its descendants.
+-
+
+*/
+
+#include <stdio.h>
+
+#include "util.h"
+
+#include "diff.h"
+
+#include "stream.h"
+
+/* the global stores */
+#include "global.h"
+
+
+
+static unsigned hash_stream_pti( 
+	const struct stream *const store,   // in
+	const void *const pti   // in
+);
+
+static const struct gui *find_stream_gui( 
+	const struct stream *const store,   // in
+	const struct snapshot *const snapshot,   // in, optional
+	const unsigned desktop,   // in
+	const void *const pti   // in, optional
+);
+
+static void emit_stream_desktop( 
+	struct stream *const store,   // in
+	const struct snapshot *const snapshot,   // in, optional
+	const unsigned index,   // in
+	const unsigned early   // in
+);
+
+static void flush_stream_store( 
+	struct stream *const store,   // in
+	const struct snapshot *const snapshot,   // in, optional
+	const unsigned early   // in
+);
+
+
+
+/* create_stream_store() 
+Create a stream store and its descendants or die.
+
+The hooks only snapshot and the arrays are allocated when the store is initialized, since they're 
+only needed if the hooks are streamed.
+*/
+void create_stream_store( 
+	struct stream **const out   // out deref
+)
+{
+	struct stream *stream = NULL;
+	
+	FAIL_IF( !out );
+	FAIL_IF( *out );
+	
+	
+	/* allocate a stream store */
+	stream = must_calloc( 1, sizeof( *stream ) );
+	
+	
+	*out = stream;
+	return;
+}
+
+
+
+/* hash_stream_pti() 
+Get the first slot in the hash table for a Win32ThreadInfo.
+
+returns the slot index
+*/
+static unsigned hash_stream_pti( 
+	const struct stream *const store,   // in
+	const void *const pti   // in
+)
+{
+	FAIL_IF( !store );
+	
+	
+	return ( (unsigned)( (uintptr_t)pti >> 3 ) * 2654435761u ) & ( store->slot_max - 1 );
+}
+
+
+
+/* find_stream_gui() 
+Find the gui thread found so far for a Win32ThreadInfo that a desktop's hooks refer to.
+
+'snapshot' is the snapshot whose threads are being traversed, or NULL if none 
+'desktop' is the index of the desktop in the desktop array 
+'pti' is the Win32ThreadInfo, or NULL
+
+returns the gui thread in the snapshot's gui array, or NULL if it hasn't been found
+*/
+static const struct gui *find_stream_gui( 
+	const struct stream *const store,   // in
+	const struct snapshot *const snapshot,   // in, optional
+	const unsigned desktop,   // in
+	const void *const pti   // in, optional
+)
+{
+	unsigned slot = 0;
+	
+	FAIL_IF( !store );
+	
+	
+	if( !snapshot || !pti )
+		return NULL;
+	
+	for( slot = hash_stream_pti( store, pti );
+		store->slot[ slot ];
+		slot = ( slot + 1 ) & ( store->slot_max - 1 )
+	)
+	{
+		const struct stream_thread *const thread = &store->thread[ store->slot[ slot ] - 1 ];
+		
+		
+		if( ( thread->pti == pti ) && ( thread->desktop == desktop ) )
+			return thread->gui ? &snapshot->gui[ thread->gui - 1 ] : NULL;
+	}
+	
+	return NULL;
+}
+
+
+
+/* emit_stream_desktop() 
+Print the hooks of a desktop in the hooks only snapshot.
+
+'snapshot' is the snapshot whose threads are being traversed, or NULL if none 
+'index' is the index of the desktop in the desktop array 
+'early' is nonzero if the traversal of the threads hasn't finished
+
+The hooks' threads are set to the gui threads found so far and whether each hook is wanted is 
+decided again. The gui array is sorted after the traversal, so the hooks' threads are cleared 
+after they're printed. See end_stream_store().
+*/
+static void emit_stream_desktop( 
+	struct stream *const store,   // in
+	const struct snapshot *const snapshot,   // in, optional
+	const unsigned index,   // in
+	const unsigned early   // in
+)
+{
+	unsigned i = 0;
+	struct stream_desktop *desktop = NULL;
+	
+	FAIL_IF( !store );
+	FAIL_IF( index >= store->desktop_count );
+	FAIL_IF( store->desktop[ index ].emitted );
+	
+	
+	desktop = &store->desktop[ index ];
+	
+	for( i = 0; i < desktop->item->hook_count; ++i )
+	{
+		struct hook *const hook = &desktop->item->hook[ i ];
+		
+		
+		hook->owner = find_stream_gui( store, snapshot, index, hook->entry.pOwner );
+		hook->origin = find_stream_gui( store, snapshot, index, hook->object.pti );
+		hook->target = find_stream_gui( store, snapshot, index, hook->object.ptiHooked );
+		
+		hook->ignore = !is_hook_wanted( hook );
+	}
+	
+	/* the threads were unknown when the hooks were captured */
+	set_hook_anomalies( desktop->item );
+	
+	store->printed += 
+		print_initial_desktop_hook_item( desktop->item, store->capture->desktop_hooks->init_time );
+	
+	fflush( stdout );
+	
+	for( i = 0; i < desktop->item->hook_count; ++i )
+	{
+		struct hook *const hook = &desktop->item->hook[ i ];
+		
+		
+		hook->owner = hook->origin = hook->target = NULL;
+	}
+	
+	desktop->emitted = TRUE;
+	desktop->early = early;
+	
+	if( early )
+		++store->early_count;
+	
+	--store->pending;
+	
+	if( !store->pending )
+		GetSystemTimeAsFileTime( (FILETIME *)&store->done_time );
+	
+	return;
+}
+
+
+
+/* flush_stream_store() 
+Print the hooks of the desktops that are ready in ordered mode.
+
+'snapshot' is the snapshot whose threads are being traversed, or NULL if none 
+'early' is nonzero if the traversal of the threads hasn't finished
+
+In ordered mode a desktop is only printed after all the desktops before it in the desktop list.
+*/
+static void flush_stream_store( 
+	struct stream *const store,   // in
+	const struct snapshot *const snapshot,   // in, optional
+	const unsigned early   // in
+)
+{
+	FAIL_IF( !store );
+	
+	
+	while( ( store->next < store->desktop_count ) && !store->desktop[ store->next ].pending )
+	{
+		if( !store->desktop[ store->next ].emitted )
+			emit_stream_desktop( store, snapshot, store->next, early );
+		
+		++store->next;
+	}
+	
+	return;
+}
+
+
+
+/* init_stream_store() 
+Initialize a stream store and if streaming take the hooks only snapshot.
+
+'mode' is how the hooks are streamed: STREAM_OFF, STREAM_RESOLVED or STREAM_ORDERED
+
+If streaming, the desktops whose hooks don't refer to any threads are printed right away.
+
+returns nonzero on success
+*/
+int init_stream_store( 
+	struct stream *const store,   // in
+	const unsigned mode   // in
+)
+{
+	unsigned i = 0, hook_total = 0;
+	struct desktop_hook_item *item = NULL;
+	FILETIME creation, exited, kernel, user;
+	
+	FAIL_IF( !G );   // The global store must exist.
+	FAIL_IF( !G->desktops->init_time );   // The desktop store must be initialized.
+	
+	FAIL_IF( !store );
+	FAIL_IF( store->init_time );   // Fail if this store has already been initialized.
+	
+	
+	if( ( mode != STREAM_OFF ) && ( mode != STREAM_RESOLVED ) && ( mode != STREAM_ORDERED ) )
+	{
+		MSG_ERROR( "The stream mode is invalid." );
+		printf( "mode: %u\n", mode );
+		return FALSE;
+	}
+	
+	store->mode = mode;
+	
+	/* the time to first hook is measured from when this process was created */
+	if( GetProcessTimes( GetCurrentProcess(), &creation, &exited, &kernel, &user ) )
+		store->launch_time = *(__int64 *)&creation;
+	else
+		GetSystemTimeAsFileTime( (FILETIME *)&store->launch_time );
+	
+	if( store->mode == STREAM_OFF )
+		goto done;
+	
+	
+	create_hook_snapshot_store( &store->capture );
+	
+	if( !init_hook_snapshot_store( store->capture ) )
+	{
+		MSG_ERROR( "The hooks only snapshot failed to initialize." );
+		return FALSE;
+	}
+	
+	store->capture_time = store->capture->init_time;
+	
+	for( item = store->capture->desktop_hooks->head; item; item = item->next )
+	{
+		++store->desktop_count;
+		hook_total += item->hook_count;
+	}
+	
+	store->desktop = must_calloc( store->desktop_count + 1, sizeof( *store->desktop ) );
+	
+	/* each hook refers to at most three threads. the hash table is kept at most half full. */
+	store->thread_max = ( hook_total * 3 ) + 1;
+	store->thread = must_calloc( store->thread_max, sizeof( *store->thread ) );
+	
+	for( store->slot_max = 2; store->slot_max < ( store->thread_max * 2 ); store->slot_max *= 2 )
+		;
+	
+	store->slot = must_calloc( store->slot_max, sizeof( *store->slot ) );
+	
+	/* note each distinct thread that each desktop's hooks refer to */
+	for( item = store->capture->desktop_hooks->head, i = 0; item; item = item->next, ++i )
+	{
+		unsigned j = 0;
+		
+		
+		store->desktop[ i ].item = item;
+		
+		for( j = 0; j < ( item->hook_count * 3 ); ++j )
+		{
+			unsigned slot = 0;
+			const struct hook *const hook = &item->hook[ j / 3 ];
+			const void *const pti = 
+				( ( j % 3 ) == 0 ) ? hook->entry.pOwner :
+				( ( j % 3 ) == 1 ) ? hook->object.pti :
+				hook->object.ptiHooked;
+			
+			
+			if( !pti )
+				continue;
+			
+			for( slot = hash_stream_pti( store, pti );
+				store->slot[ slot ] 
+					&& ( ( store->thread[ store->slot[ slot ] - 1 ].pti != pti ) 
+						|| ( store->thread[ store->slot[ slot ] - 1 ].desktop != i ) );
+				slot = ( slot + 1 ) & ( store->slot_max - 1 )
+			)
+				;
+			
+			if( store->slot[ slot ] ) // already noted
+				continue;
+			
+			store->thread[ store->thread_count ].pti = pti;
+			store->thread[ store->thread_count ].desktop = i;
+			store->thread[ store->thread_count ].gui = 0;
+			
+			store->slot[ slot ] = ++store->thread_count;
+			++store->desktop[ i ].pending;
+		}
+	}
+	
+	store->pending = store->desktop_count;
+	
+	/* print the desktops that don't have to wait for any threads */
+	if( store->mode == STREAM_ORDERED )
+		flush_stream_store( store, NULL, TRUE );
+	else
+	{
+		for( i = 0; i < store->desktop_count; ++i )
+		{
+			if( !store->desktop[ i ].pending )
+				emit_stream_desktop( store, NULL, i, TRUE );
+		}
+	}
+
+done:
+	/* the stream store has been initialized */
+	GetSystemTimeAsFileTime( (FILETIME *)&store->init_time );
+	return TRUE;
+}
+
+
+
+/* add_stream_thread() 
+Note a gui thread found during the traversal and print any desktop that's now resolved.
+
+'snapshot' is the snapshot whose threads are being traversed 
+'index' is the index of the gui thread in the snapshot's gui array
+
+callback_add_gui() calls this function for each gui thread it adds while the hooks are streamed.
+*/
+void add_stream_thread( 
+	struct stream *const store,   // in
+	const struct snapshot *const snapshot,   // in
+	const unsigned index   // in
+)
+{
+	unsigned slot = 0;
+	const void *pti = NULL;
+	
+	FAIL_IF( !store );
+	FAIL_IF( !store->init_time );   // The stream store must be initialized.
+	FAIL_IF( !snapshot );
+	FAIL_IF( index >= snapshot->gui_count );
+	
+	
+	if( !store->pending )
+		return;
+	
+	pti = snapshot->gui[ index ].pvWin32ThreadInfo;
+	
+	for( slot = hash_stream_pti( store, pti );
+		store->slot[ slot ];
+		slot = ( slot + 1 ) & ( store->slot_max - 1 )
+	)
+	{
+		struct stream_thread *const thread = &store->thread[ store->slot[ slot ] - 1 ];
+		struct stream_desktop *desktop = NULL;
+		
+		
+		if( ( thread->pti != pti ) || thread->gui )
+			continue;
+		
+		thread->gui = index + 1;
+		
+		desktop = &store->desktop[ thread->desktop ];
+		
+		if( --desktop->pending )
+			continue;
+		
+		if( store->mode == STREAM_ORDERED )
+			flush_stream_store( store, snapshot, TRUE );
+		else
+			emit_stream_desktop( store, snapshot, thread->desktop, TRUE );
+	}
+	
+	return;
+}
+
+
+
+/* end_stream_store() 
+End streaming after the first snapshot has been taken.
+
+'snapshot' is the first snapshot
+
+The hooks in the hooks only snapshot are matched to the threads in the first snapshot, and the 
+desktops that weren't printed because some of their hooks' threads weren't found are printed.
+Afterwards the hooks only snapshot can be compared to the first snapshot.
+*/
+void end_stream_store( 
+	struct stream *const store,   // in
+	const struct snapshot *const snapshot   // in
+)
+{
+	unsigned i = 0;
+	
+	FAIL_IF( !store );
+	FAIL_IF( !store->init_time );   // The stream store must be initialized.
+	FAIL_IF( store->mode == STREAM_OFF );
+	FAIL_IF( !snapshot );
+	
+	
+	for( i = 0; i < store->desktop_count; ++i )
+	{
+		unsigned j = 0;
+		struct desktop_hook_item *const item = store->desktop[ i ].item;
+		
+		
+		for( j = 0; j < item->hook_count; ++j )
+		{
+			struct hook *const hook = &item->hook[ j ];
+			
+			
+			hook->owner = find_Win32ThreadInfo( snapshot, hook->entry.pOwner );
+			hook->origin = find_Win32ThreadInfo( snapshot, hook->object.pti );
+			hook->target = find_Win32ThreadInfo( snapshot, hook->object.ptiHooked );
+			
+			hook->ignore = !is_hook_wanted( hook );
+		}
+		
+		set_hook_anomalies( item );
+	}
+	
+	/* print the desktops whose hooks' threads weren't all found during the traversal */
+	for( i = 0; i < store->desktop_count; ++i )
+	{
+		if( store->desktop[ i ].emitted )
+			continue;
+		
+		store->printed += print_initial_desktop_hook_item( 
+			store->desktop[ i ].item, 
+			store->capture->desktop_hooks->init_time
+		);
+		
+		store->desktop[ i ].emitted = TRUE;
+	}
+	
+	if( store->pending )
+	{
+		store->pending = 0;
+		GetSystemTimeAsFileTime( (FILETIME *)&store->done_time );
+	}
+	
+	store->next = store->desktop_count;
+	return;
+}
+
+
+
+/* note_stream_output() 
+Note that a hook in the initial hook list is about to be printed.
+
+print_initial_desktop_hook_item() calls this function before it prints each hook.
+
+if 'store' is NULL or uninitialized this function returns without doing anything.
+*/
+void note_stream_output( 
+	struct stream *const store   // in
+)
+{
+	if( !store || !store->init_time || store->first_time )
+		return;
+	
+	GetSystemTimeAsFileTime( (FILETIME *)&store->first_time );
+	return;
+}
+
+
+
+/* print_stream_report() 
+Print the time to first hook.
+
+The times are in milliseconds since the program was started.
+
+if 'store' is NULL this function returns without having printed anything.
+*/
+void print_stream_report( 
+	const struct stream *const store   // in
+)
+{
+	if( !store )
+		return;
+	
+	FAIL_IF( !store->init_time );   // The stream store must be initialized.
+	
+	
+	printf( "\nTime to first hook: " );
+	
+	if( store->first_time )
+		printf( "%I64d ms", ( ( store->first_time - store->launch_time ) / 10000 ) );
+	else
+		printf( "<no hooks printed>" );
+	
+	if( store->mode != STREAM_OFF )
+	{
+		printf( " (hooks captured at %I64d ms, %u of %u desktops printed during the traversal, "
+			"all at %I64d ms)", 
+			( ( store->capture_time - store->launch_time ) / 10000 ), 
+			store->early_count, 
+			store->desktop_count, 
+			( ( store->done_time - store->launch_time ) / 10000 )
+		);
+	}
+	
+	printf( "\n" );
+	fflush( stdout );
+	return;
+}
+
+
+
+/* print_stream_store() 
+Print a stream store.
+
+if 'store' is NULL this function returns without having printed anything.
+*/
+void print_stream_store( 
+	const struct stream *const store   // in
+)
+{
+	const char *const objname = "Stream Store";
+	
+	
+	if( !store )
+		return;
+	
+	PRINT_DBLSEP_BEGIN( objname );
+	print_init_time( "store->init_time", store->init_time );
+	
+	printf( "store->mode: %u\n", store->mode );
+	printf( "store->desktop_count: %u\n", store->desktop_count );
+	printf( "store->thread_max: %u\n", store->thread_max );
+	printf( "store->thread_count: %u\n", store->thread_count );
+	printf( "store->slot_max: %u\n", store->slot_max );
+	printf( "store->pending: %u\n", store->pending );
+	printf( "store->next: %u\n", store->next );
+	printf( "store->early_count: %u\n", store->early_count );
+	printf( "store->printed: %u\n", store->printed );
+	print_init_time( "store->launch_time", store->launch_time );
+	print_init_time( "store->capture_time", store->capture_time );
+	print_init_time( "store->first_time", store->first_time );
+	print_init_time( "store->done_time", store->done_time );
+	
+	PRINT_DBLSEP_END( objname );
+	
+	return;
+}
+
+
+
+/* free_stream_store() 
+Free a stream store and all its descendants.
+
+this function then sets the stream store pointer to NULL and returns
+
+'in' is a pointer to a pointer to the stream store.
+if( !in || !*in ) then this function returns.
+*/
+void free_stream_store( 
+	struct stream **const in   // in deref
+)
+{
+	if( !in || !*in )
+		return;
+	
+	free_snapshot_store( &(*in)->capture );
+	
+	free( (*in)->desktop );
+	free( (*in)->thread );
+	free( (*in)->slot );
+	
+	free( (*in) );
+	*in = NULL;
+	
+	return;
+}
@@ -0,0 +1,184 @@
+/*
+Copyright (C) 2011 Jay Satiro <raysatiro@yahoo.com>
+All rights reserved.
+
+This file is part of GetHooks.
+
+GetHooks is free software: you can redistribute it and/or modify 
+it under the terms of the GNU General Public License as published by 
+the Free Software Foundation, either version 3 of the License, or 
+(at your option) any later version.
+
+GetHooks is distributed in the hope that it will be useful, 
+but WITHOUT ANY WARRANTY; without even the implied warranty of 
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License 
+along with GetHooks.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _STREAM_H
+#define _STREAM_H
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include "portable.h"
+#endif
+
+/* snapshot store (system process info, gui threads, desktop hooks) */
+#include "snapshot.h"
+
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/** This is a Win32ThreadInfo that a hook on a desktop refers to.
+*/
+struct stream_thread
+{
+	/* the Win32ThreadInfo kernel address */
+	const void *pti;
+	
+	/* the index of the desktop in the stream store's desktop array */
+	unsigned desktop;
+	
+	/* the index + 1 of the thread in the gui array of the snapshot being taken, or 0 if it hasn't 
+	been found yet
+	*/
+	unsigned gui;
+};
+
+
+/** This is the info kept for each desktop in the hooks only snapshot.
+*/
+struct stream_desktop
+{
+	/* the desktop and its hooks in the hooks only snapshot */
+	struct desktop_hook_item *item;
+	
+	/* the number of threads the desktop's hooks refer to that haven't been found yet */
+	unsigned pending;
+	
+	/* nonzero if the desktop's hooks have been printed */
+	unsigned emitted;
+	
+	/* nonzero if the desktop's hooks were printed before the traversal of the threads finished */
+	unsigned early;
+};
+
+
+
+/** The stream store.
+The stream store prints the initial hook list incrementally. Before the first snapshot the hooks 
+are captured in a hooks only snapshot, which takes a fraction of the time of a full snapshot, and 
+the Win32ThreadInfo of each thread that the hooks refer to is noted. As the threads are traversed 
+for the first snapshot each desktop's hooks are printed as soon as all the threads they refer to 
+have been found. The hooks that changed between the hooks only snapshot and the first snapshot are 
+printed after it as if they were found by monitor mode.
+
+The time to first hook, the time from when the program was started to when the first hook was 
+printed, is measured whether or not the hooks are streamed.
+*/
+struct stream
+{
+	/* how the hooks are streamed. see config->stream */
+	#define STREAM_OFF   0   // not streamed. only the time to first hook is measured.
+	#define STREAM_RESOLVED   1   // each desktop is printed as soon as its hooks are resolved
+	#define STREAM_ORDERED   2   // the desktops are printed in order, each as soon as possible
+	unsigned mode;
+	
+	/* the hooks only snapshot */
+	struct snapshot *capture;   // create_hook_snapshot_store(), free_snapshot_store()
+	
+	/* an array of the desktops in the hooks only snapshot, in the order of its desktop list */
+	struct stream_desktop *desktop;   // calloc(), free()
+	unsigned desktop_count;
+	
+	/* an array of the threads that the hooks refer to, and its hash table of Win32ThreadInfo. each 
+	slot is 0 or the index + 1 of an element in the thread array. the number of slots is a power of 
+	2 that's at least twice the number of elements.
+	*/
+	struct stream_thread *thread;   // calloc(), free()
+	unsigned thread_max;
+	unsigned thread_count;
+	unsigned *slot;   // calloc(), free()
+	unsigned slot_max;
+	
+	/* the number of desktops whose hooks haven't been printed yet. 0 when not streaming. */
+	unsigned pending;
+	
+	/* in ordered mode the index of the next desktop to be printed */
+	unsigned next;
+	
+	/* the number of desktops printed before the traversal of the threads finished */
+	unsigned early_count;
+	
+	/* the number of hooks printed */
+	unsigned printed;
+	
+	/* the system utc times in FILETIME format when the program was started, when the hooks only 
+	snapshot was taken, when the first hook was printed and when the last desktop was printed
+	*/
+	__int64 launch_time;
+	__int64 capture_time;
+	__int64 first_time;
+	__int64 done_time;
+	
+	/* the system utc time in FILETIME format immediately after this store has been initialized.
+	this is nonzero when this store has been initialized.
+	*/
+	__int64 init_time;
+};
+
+
+
+/** 
+these functions are documented in the comment block above their definitions in stream.c
+*/
+void create_stream_store( 
+	struct stream **const out   // out deref
+);
+
+int init_stream_store( 
+	struct stream *const store,   // in
+	const unsigned mode   // in
+);
+
+void add_stream_thread( 
+	struct stream *const store,   // in
+	const struct snapshot *const snapshot,   // in
+	const unsigned index   // in
+);
+
+void end_stream_store( 
+	struct stream *const store,   // in
+	const struct snapshot *const snapshot   // in
+);
+
+void note_stream_output( 
+	struct stream *const store   // in
+);
+
+void print_stream_report( 
+	const struct stream *const store   // in
+);
+
+void print_stream_store( 
+	const struct stream *const store   // in
+);
+
+void free_stream_store( 
+	struct stream **const in   // in deref
+);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _STREAM_H
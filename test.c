@@ -109,12 +109,21 @@ Run user-specified tests.
 
 #include "diff.h"
 
-/* traverse_threads() */
+/* traverse_threads(), fuzz_process_info() */
 #include "nt_independent_sysprocinfo_structs.h"
 #include "traverse_threads.h"
 
 #include "debug.h"
 
+/* HOOK chain links */
+#include "chain.h"
+
+/* benchmark_sched_store() */
+#include "scheduler.h"
+
+/* simulate_governor_store() */
+#include "governor.h"
+
 #include "test.h"
 
 /* the global stores */
@@ -298,7 +307,9 @@ unsigned __int64 print_kernel_HOOK(
 		MSG_WARNING( "Could not initialize the snapshot store." );
 	}
 	
-	print_hook_notice_begin( &hook, desktop->pwszDesktopName, HOOK_FOUND );
+	hook.anomalies = get_hook_anomalies( &hook );
+	
+	print_hook_notice_begin( &hook, desktop->pwszDesktopName, HOOK_FOUND, snapshot->init_time );
 	print_hook_notice_end();
 	
 	free_snapshot_store( &snapshot );
@@ -367,6 +378,9 @@ Take a snapshot and search it for the HOOK that most precedes the passed in HOOK
 'addr' is the kernel address of a HOOK. cast to unsigned __int64
 '*out' receives the kernel address of the HOOK that most precedes 'addr' in its chain.
 
+The links of the HOOKs in the snapshot are built once by the chain store, so each preceding HOOK 
+is found without rescanning the snapshot. See build_chain_links().
+
 returns nonzero if a preceding HOOK was found.
 returns zero otherwise and '*out' receives 0.
 */
@@ -375,12 +389,9 @@ static int find_most_preceding_kernel_HOOK(
 	const unsigned __int64 addr   // in
 )
 {
-	unsigned i = 0, j = 0;
+	unsigned i = 0, j = 0, index = 0;
 	struct snapshot *snapshot = NULL;
-	struct desktop_hook_item *dh = NULL;
-	
-	/* The kernel address of the most preceding HOOK */
-	unsigned __int64 phk = 0;
+	struct chain *chain = NULL;
 	
 	/* This function will search through a HOOK chain of maximum length 'chainmax' */
 	const unsigned chainmax = 65535;
@@ -400,50 +411,74 @@ static int find_most_preceding_kernel_HOOK(
 		goto cleanup;
 	}
 	
-	for( phk = addr, j = 0; j < chainmax; ++j )
+	create_chain_store( &chain );
+	if( !init_chain_store( chain ) )
+	{
+		MSG_ERROR( "Could not initialize the chain store." );
+		goto cleanup;
+	}
+	
+	build_chain_links( chain, snapshot );
+	
+	index = find_chain_link( chain, (void *)(uintptr_t)addr );
+	
+	/* if 'addr' isn't a HOOK in the snapshot then a HOOK could still point to it */
+	if( !index )
+	{
+		for( i = 0; i < chain->link_count; ++i )
+		{
+			if( addr == (uintptr_t)chain->link[ i ].hook->object.phkNext )
+			{
+				index = i + 1;
+				break;
+			}
+		}
+		
+		if( !index )
+			goto cleanup;
+	}
+	else
+		index = chain->link[ index - 1 ].prev;
+	
+	for( j = 0; index && ( j < chainmax ); ++j )
 	{
-		unsigned __int64 found = 0;
+		const struct chain_link *const link = &chain->link[ index - 1 ];
+		
 		
-		/* for each desktop in the list of attached to desktops */
-		for( dh = snapshot->desktop_hooks->head; dh; dh = dh->next )
+		/* if a different HOOK that also points to this HOOK was found then alert the user.
+		this shouldn't ever happen.
+		*/
+		if( link->in_degree > 1 )
 		{
-			/* for each hook info in the desktop's array of hook info structs */
-			for( i = 0; i < dh->hook_count; ++i )
+			unsigned k = 0, found = 0;
+			
+			
+			PRINT_DBLSEP_BEGIN( "wtf?" );
+			
+			MSG_ERROR( "Two different HOOKs point to the same link in a chain.\n" );
+			printf( "The HOOK pointed to: " );
+			PRINT_HEX_BARE( link->hook->entry.pHead );
+			printf( "\n" );
+			
+			/* print the first two HOOKs whose phkNext points to this HOOK */
+			for( k = 0; ( k < chain->link_count ) && ( found < 2 ); ++k )
 			{
-				/* if there is a HOOK that points to HOOK address 'phk' then a preceding HOOK has 
-				been found.
-				*/
-				if( phk == (uintptr_t)dh->hook[ i ].object.phkNext )
+				if( chain->link[ k ].next == index )
 				{
-					/* dh->hook[ i ] has the HOOK preceding HOOK 'phk' in a chain */
-					
-					/* if a different HOOK that also points to 'phk' was already found then alert 
-					the user. this shouldn't ever happen. 
-					*/
-					if( found && ( found != (uintptr_t)dh->hook[ i ].entry.pHead ) )
-					{
-						PRINT_DBLSEP_BEGIN( "wtf?" );
-						
-						MSG_ERROR( "Two different HOOKs point to the same link in a chain.\n" );
-						print_kernel_HOOK( found );
-						print_kernel_HOOK( (uintptr_t)dh->hook[ i ].entry.pHead );
-						
-						PRINT_DBLSEP_END( "wtf?" );
-						continue;
-					}
-					
-					found = (uintptr_t)dh->hook[ i ].entry.pHead;
+					print_kernel_HOOK( (uintptr_t)chain->link[ k ].hook->entry.pHead );
+					++found;
 				}
 			}
+			
+			PRINT_DBLSEP_END( "wtf?" );
 		}
 		
-		/* Stop if no preceding HOOK was found or if for some reason 'addr' points to itself as the 
-		next HOOK in the chain
-		*/
-		if( !found || ( found == addr ) )
+		/* Stop if for some reason the chain leads back to 'addr' */
+		if( addr == (uintptr_t)link->hook->entry.pHead )
 			break;
 		
-		phk = found;
+		*out = (uintptr_t)link->hook->entry.pHead;
+		index = link->prev;
 	}
 	
 	if( j == chainmax )
@@ -452,10 +487,8 @@ static int find_most_preceding_kernel_HOOK(
 		printf( "Maximum supported length: %u\n", chainmax );
 	}
 	
-	if( phk != addr ) // preceding HOOK was found
-		*out = phk;
-	
 cleanup:
+	free_chain_store( &chain );
 	free_snapshot_store( &snapshot );
 	return !!*out;
 }
@@ -740,6 +773,39 @@ const struct
 		NULL,   // extra_info
 		L"148",   // example_name
 		L"Dump the TEB of thread id 148 to a file.",   // example_description
+	}, 
+	{
+		benchmark_sched_store,   // pfn
+		L"sched",   // name
+		/* description */
+		L"Measure how the work-stealing scheduler scales from 1 worker thread to 1 for each processor.", 
+		L"workers",   // param_name
+		FALSE,   // param_required
+		L"Specify the largest number of worker threads to measure.",   // extra_info
+		L"4",   // example_name
+		L"Measure the scheduler with 1, 2 and 4 worker threads.",   // example_description
+	}, 
+	{
+		simulate_governor_store,   // pfn
+		L"governor",   // name
+		/* description */
+		L"Simulate the CPU budget governor with light, heavy and light snapshots.", 
+		L"percent",   // param_name
+		FALSE,   // param_required
+		L"Specify the budget in percent of a core. The default is 10.",   // extra_info
+		L"5",   // example_name
+		L"Simulate the governor with a budget of 5% of a core.",   // example_description
+	}, 
+	{
+		fuzz_process_info,   // pfn
+		L"spi",   // name
+		/* description */
+		L"Benchmark validate_process_info() and fuzz it with mutated process info buffers.", 
+		L"iterations",   // param_name
+		FALSE,   // param_required
+		L"Specify the number of mutated buffers. The default is 100000.",   // extra_info
+		L"1000000",   // example_name
+		L"Fuzz the validation with a million mutated buffers.",   // example_description
 	}
 };
 const unsigned function_count = sizeof( function ) / sizeof( function[ 0 ] );
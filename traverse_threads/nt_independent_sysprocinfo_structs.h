@@ -34,7 +34,11 @@ above undocumented structs before including traverse_threads.h.
 #ifndef _NT_INDEPENDENT_SYSPROCINFO_STRUCTS_H
 #define _NT_INDEPENDENT_SYSPROCINFO_STRUCTS_H
 
+#ifdef _WIN32
 #include <windows.h>
+#else
+#include "portable.h"
+#endif
 
 
 #ifdef __cplusplus
@@ -74,6 +74,15 @@ typedef struct _SYSTEM_PROCESS_IMAGE_NAME_INFORMATION
 } SYSTEM_PROCESS_IMAGE_NAME_INFORMATION, *PSYSTEM_PROCESS_IMAGE_NAME_INFORMATION;
 
 
+//SystemSessionProcessInformation input. Buffer receives an array of SYSTEM_PROCESS_INFORMATION.
+typedef struct _SYSTEM_SESSION_PROCESS_INFORMATION
+{
+	ULONG SessionId;
+	ULONG SizeOfBuf;
+	PVOID Buffer;
+} SYSTEM_SESSION_PROCESS_INFORMATION, *PSYSTEM_SESSION_PROCESS_INFORMATION;
+
+
 //http://wj32.wordpress.com/2010/03/30/get-the-image-file-name-of-any-process-from-any-user-on-vista-and-above/#comment-395
 typedef enum _SYSTEM_INFORMATION_CLASS {
 	SystemBasicInformation = 0x0,
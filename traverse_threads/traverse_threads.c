@@ -20,9 +20,12 @@ along with GetHooks.  If not, see <http://www.gnu.org/licenses/>.
 
 /**
 This file contains traverse_threads(). It is documented in traverse_threads.txt
+validate_process_info() is in traverse_threads__validate.c
 */
 
 #include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
 #include <windows.h>
 
 #include "nt_independent_sysprocinfo_structs.h"
@@ -32,8 +35,159 @@ This file contains traverse_threads(). It is documented in traverse_threads.txt
 
 
 
+/** compare_filter_pid() 
+bsearch() callback to search a traverse_filter's sorted array of process ids.
+*/
+static int __cdecl compare_filter_pid( 
+	const void *const p1,   // in
+	const void *const p2   // in
+)
+{
+	const ULONG_PTR a = *(const ULONG_PTR *)p1;
+	const ULONG_PTR b = *(const ULONG_PTR *)p2;
+	
+	return ( ( a < b ) ? -1 : ( ( a > b ) ? 1 : 0 ) );
+}
+
+
+
+/** is_filtered_out() 
+Returns nonzero if the process info (spi) is filtered out by 'filter'.
+*/
+static int is_filtered_out( 
+	const struct traverse_filter *const filter,   // in
+	const SYSTEM_PROCESS_INFORMATION *const spi,   // in
+	const DWORD flags   // in, optional
+)
+{
+	const ULONG_PTR pid = (ULONG_PTR)spi->UniqueProcessId;
+	
+	if( ( ( filter->flags & TRAVERSE_FILTER_SESSION ) 
+			&& ( spi->SessionId != filter->session_id )
+		) 
+		|| ( filter->pid_count 
+			&& !bsearch( 
+				&pid, 
+				filter->pid, 
+				filter->pid_count, 
+				sizeof( *filter->pid ), 
+				compare_filter_pid
+			)
+		)
+	)
+	{
+		if( ( flags & TRAVERSE_FLAG_DEBUG ) )
+			printf( "Process id %Iu is filtered out, skipping.\n", (size_t)pid );
+		
+		return TRUE;
+	}
+	
+	return FALSE;
+}
+
+
+
+/** dispatch_threads() 
+Call the callback for each of the first 'threads_ecount' thread info structs in the process 
+info (spi), or once with a NULL thread info if there are none and TRAVERSE_FLAG_ZERO_THREADS_OK.
+The process info must already have passed all sanity checks.
+
+returns TRAVERSE_SUCCESS or TRAVERSE_ERROR_CALLBACK if the callback aborted.
+*/
+static int dispatch_threads( 
+	int ( __cdecl *callback )( 
+		void *cb_param,   // in, out, optional
+		SYSTEM_PROCESS_INFORMATION *const spi,   // in
+		SYSTEM_THREAD_INFORMATION *const sti,   // in, optional
+		const ULONG remaining,   // in
+		const DWORD flags   // in, optional
+	),   // in, optional
+	void *cb_param,   // in, out, optional
+	SYSTEM_PROCESS_INFORMATION *const spi,   // in
+	const ULONG threads_ecount,   // in
+	const size_t sti_bcount,   // in
+	const DWORD flags   // in, optional
+)
+{
+	/* a pointer to the current thread info struct. cast size_t for pointer arithmetic */
+	SYSTEM_THREAD_INFORMATION *sti = NULL;
+	
+	/* how many threads in this spi have not yet been processed */
+	ULONG remaining = 0;
+	
+	
+	if( !callback || ( !threads_ecount && !( flags & TRAVERSE_FLAG_ZERO_THREADS_OK ) ) )
+		return TRAVERSE_SUCCESS;
+	
+	if( threads_ecount ) /* there are thread info structs to be processed */
+	{
+		sti = (SYSTEM_THREAD_INFORMATION *)&spi->Threads;
+		remaining = threads_ecount - 1;
+	}
+	
+	for( ;; ) /* for each thread info in the current spi */
+	{
+		/* callback return code */
+		int ret;
+		
+		
+		if( ( flags & TRAVERSE_FLAG_DEBUG ) )
+		{
+			printf( 
+				">>>Calling callback function on process id %Iu, thread id ", 
+				(size_t)spi->UniqueProcessId
+			);
+			
+			if( sti )
+				printf( "%Iu.", (size_t)sti->ClientId.UniqueThread );
+			else
+				printf( "(null)." );
+			
+			printf( "\n" );
+		}
+		
+		ret = callback( 
+			cb_param, /* the cb_param that was passed in to traverse_threads()*/
+			spi, /* the current process info struct */
+			sti, /* the current thread info struct */
+			remaining, /* how many threads in this spi have not yet been processed */
+			flags /* the flags that were passed in to traverse_threads() */
+		);
+		
+		if( ret == TRAVERSE_CALLBACK_SKIP ) /* do not process spi's remaining threads */
+		{
+			if( ( flags & TRAVERSE_FLAG_DEBUG ) )
+				printf( "<<<Callback function returned: skip process' remaining threads.\n" );
+			
+			break;
+		}
+		else if( ret != TRAVERSE_CALLBACK_CONTINUE ) /* some other problem. quit */
+		{
+			if( ( flags & TRAVERSE_FLAG_DEBUG ) )
+				printf( "<<<Callback function returned: abort immediately. ret: %d\n", ret );
+			
+			return TRAVERSE_ERROR_CALLBACK;
+		}
+		
+		if( ( flags & TRAVERSE_FLAG_DEBUG ) )
+			printf( "<<<Callback returned normally.\n\n" );
+		
+		
+		if( !remaining ) /* no more threads in this spi */
+			break;
+		
+		--remaining;
+		sti = (SYSTEM_THREAD_INFORMATION *)( (size_t)sti + sti_bcount );
+	}
+	
+	return TRAVERSE_SUCCESS;
+}
+
+
+
 /** traverse_threads()
 This function is well documented in traverse_threads.txt 
+It's the same as traverse_threads_ex() without a filter.
 */
 int traverse_threads( 
 	int ( __cdecl *callback )( 
@@ -49,6 +203,30 @@ int traverse_threads(
 	const DWORD flags,   // in, optional
 	LONG *status   // out, optional
 )
+{
+	return traverse_threads_ex( callback, cb_param, buffer, buffer_bcount, flags, status, NULL );
+}
+
+
+
+/** traverse_threads_ex() 
+This function is well documented in traverse_threads.txt
+*/
+int traverse_threads_ex( 
+	int ( __cdecl *callback )( 
+		void *cb_param,   // in, out, optional
+		SYSTEM_PROCESS_INFORMATION *const spi,   // in
+		SYSTEM_THREAD_INFORMATION *const sti,   // in, optional
+		const ULONG remaining,   // in
+		const DWORD flags   // in, optional
+	),   // in, optional
+	void *cb_param,   // in, out, optional
+	void *buffer,   // in, out, optional
+	size_t buffer_bcount,   // in, optional
+	const DWORD flags,   // in, optional
+	LONG *status,   // out, optional
+	const struct traverse_filter *filter   // in, optional
+)
 {
 	/** initialization
 	*/
@@ -69,6 +247,11 @@ int traverse_threads(
 	/* the type of system information that will be requested */
 	SYSTEM_INFORMATION_CLASS infotype = -1;
 	
+	/* if infotype is SystemSessionProcessInformation then this is passed to 
+	NtQuerySystemInformation() instead of the buffer, and it points to the buffer.
+	*/
+	SYSTEM_SESSION_PROCESS_INFORMATION session_info;
+	
 	/* the size in bytes of SYSTEM_THREAD_INFORMATION, or if TRAVERSE_FLAG_EXTENDED 
 	then SYSTEM_EXTENDED_THREAD_INFORMATION */
 	size_t sti_bcount = 0;
@@ -91,6 +274,13 @@ int traverse_threads(
 	/* the version number of the operating system returned by GetVersion() */
 	DWORD dwVersion = 0;
 	
+	/* if TRAVERSE_FLAG_VALIDATE_ONCE then this is the index of validated spi structs written by 
+	validate_process_info(), its size in elements, and how many elements were written
+	*/
+	struct traverse_index *index = NULL;
+	size_t index_max = 0;
+	size_t index_count = 0;
+	
 	/* error_code is the variable returned by this function */
 	int error_code = TRAVERSE_ERROR_GENERAL;
 	
@@ -233,6 +423,27 @@ int traverse_threads(
 		dbg_printf( "Process info type: SystemProcessInformation\n" );
 	}
 	
+	/* if the caller is filtering by session then only query the processes in that session.
+	there is no session-scoped query for extended info, and it's only available in XP+.
+	otherwise the processes in other sessions are skipped in the main loop.
+	*/
+	ZeroMemory( &session_info, sizeof( session_info ) );
+	
+	if( filter 
+		&& ( filter->flags & TRAVERSE_FILTER_SESSION ) 
+		&& !( flags & TRAVERSE_FLAG_EXTENDED ) 
+		&& ( ( LOBYTE( LOWORD( dwVersion ) ) > 5 ) 
+			|| ( ( LOBYTE( LOWORD( dwVersion ) ) == 5 ) && ( HIBYTE( LOWORD( dwVersion ) ) >= 1 ) )
+		)
+	)
+	{
+		infotype = SystemSessionProcessInformation;
+		session_info.SessionId = filter->session_id;
+		dbg_printf( "Process info type: SystemSessionProcessInformation (session %lu)\n", 
+			filter->session_id
+		);
+	}
+	
 	
 	if( !status ) /* the caller did not specify a location to receive status. use placeholder */
 		status = &status_placeholder;
@@ -297,7 +508,19 @@ int traverse_threads(
 		/* pass in a stub to receive the buffer's approximate needed size */
 		retlen = 0;
 		dbg_printf( "Calling NtQuerySystemInformation() to get buffer size estimate.\n" );
-		*status = (LONG)NtQuerySystemInformation( infotype, &stub, 1, &retlen );
+		if( infotype == SystemSessionProcessInformation )
+		{
+			session_info.SizeOfBuf = 1;
+			session_info.Buffer = &stub;
+			*status = (LONG)NtQuerySystemInformation( 
+				infotype, 
+				&session_info, 
+				sizeof( session_info ), 
+				&retlen
+			);
+		}
+		else
+			*status = (LONG)NtQuerySystemInformation( infotype, &stub, 1, &retlen );
 		dbg_printf( 
 			"NtQuerySystemInformation() status: 0x%08X retlen: %lu\n\n", 
 			(unsigned)*status, 
@@ -430,12 +653,26 @@ int traverse_threads(
 	{
 		retlen = 0;
 		dbg_printf( "Calling NtQuerySystemInformation() to get process info.\n" );
-		*status = (LONG)NtQuerySystemInformation( 
-			infotype, 
-			buffer, 
-			buffer_bcount, 
-			&retlen 
-		);
+		if( infotype == SystemSessionProcessInformation )
+		{
+			session_info.SizeOfBuf = (ULONG)buffer_bcount;
+			session_info.Buffer = buffer;
+			*status = (LONG)NtQuerySystemInformation( 
+				infotype, 
+				&session_info, 
+				sizeof( session_info ), 
+				&retlen
+			);
+		}
+		else
+		{
+			*status = (LONG)NtQuerySystemInformation( 
+				infotype, 
+				buffer, 
+				buffer_bcount, 
+				&retlen
+			);
+		}
 		dbg_printf( 
 			"NtQuerySystemInformation() status: 0x%08X retlen: %lu\n\n", 
 			(unsigned)*status, 
@@ -480,6 +717,65 @@ int traverse_threads(
 	
 	
 	
+	/** validate-once mode.
+	validate the entire array of SYSTEM_PROCESS_INFORMATION structs in one pass, then call the 
+	callback for each validated spi without checking it again.
+	*/
+	if( ( flags & TRAVERSE_FLAG_VALIDATE_ONCE ) )
+	{
+		size_t i = 0;
+		
+		
+		/* every spi struct is at least as big as its members before its thread info array */
+		index_max = ( retlen / offsetof( SYSTEM_PROCESS_INFORMATION, Threads ) ) + 1;
+		
+		dbg_printf( "Calling malloc( %Iu ) for the validated index.\n", 
+			index_max * sizeof( *index )
+		);
+		index = malloc( index_max * sizeof( *index ) );
+		if( !index )
+		{
+			dbg_printf( "Error: malloc() failed.\n" );
+			
+			error_code = TRAVERSE_ERROR_MEMORY;
+			goto quit;
+		}
+		
+		error_code = validate_process_info( buffer, retlen, flags, index, index_max, &index_count );
+		if( error_code != TRAVERSE_SUCCESS )
+		{
+			dbg_printf( "Error: validate_process_info() failed. error_code: %d\n", error_code );
+			
+			goto quit;
+		}
+		
+		dbg_printf( "Validated %Iu process info structs.\n", index_count );
+		
+		for( i = 0; i < index_count; ++i )
+		{
+			spi = index[ i ].spi;
+			
+			if( filter && is_filtered_out( filter, spi, flags ) )
+				continue;
+			
+			error_code = dispatch_threads( 
+				callback, 
+				cb_param, 
+				spi, 
+				index[ i ].threads_ecount, 
+				sti_bcount, 
+				flags
+			);
+			if( error_code != TRAVERSE_SUCCESS )
+				goto quit;
+		}
+		
+		error_code = TRAVERSE_SUCCESS;
+		goto quit;
+	}
+	
+	
+	
 	/** main loop.
 	traverse the SYSTEM_THREAD_INFORMATION struct array in each 
 	SYSTEM_PROCESS_INFORMATION struct.
@@ -633,6 +929,14 @@ int traverse_threads(
 		
 		
 		
+		/** skip the process if it's filtered out. it is never passed to the callback.
+		the endpoints have been checked so it's safe to skip to the next spi.
+		*/
+		if( filter && is_filtered_out( filter, spi, flags ) )
+			goto next_spi;
+		
+		
+		
 		/** print ImageName.Buffer (process' name) and info if accessible
 		*/
 		dbg_printf( "UniqueProcessId: %Iu\n", (size_t)spi->UniqueProcessId );
@@ -751,81 +1055,11 @@ int traverse_threads(
 		
 		/** callback if there are threads to be processed, or zero threads is ok
 		*/
-		if( callback 
-			&& ( threads_ecount || ( flags & TRAVERSE_FLAG_ZERO_THREADS_OK ) ) 
-		)
-		{
-			/* a pointer to the current thread info struct. cast size_t for pointer arithmetic */
-			SYSTEM_THREAD_INFORMATION *sti = NULL;
-			
-			/* how many threads in this spi have not yet been processed */
-			ULONG remaining = 0;
-			
-			if( threads_ecount ) /* there are thread info structs to be processed */
-			{
-				sti = (SYSTEM_THREAD_INFORMATION *)&spi->Threads;
-				remaining = threads_ecount - 1;
-			}
-			
-			for( ;; ) /* for each thread info in the current spi */
-			{
-				/* callback return code */
-				int ret;
-				
-				
-				if( ( flags & TRAVERSE_FLAG_DEBUG ) )
-				{
-					printf( 
-						">>>Calling callback function on process id %Iu, thread id ",
-						(size_t)spi->UniqueProcessId
-					);
-					
-					if( sti )
-						printf( "%Iu.", (size_t)sti->ClientId.UniqueThread );
-					else
-						printf( "(null)." );
-					
-					printf( "\n" );
-				}
-				
-				ret = callback( 
-					cb_param, /* the cb_param that was passed in to traverse_threads()*/
-					spi, /* the current process info struct */
-					sti, /* the current thread info struct */
-					remaining, /* how many threads in this spi have not yet been processed */
-					flags /* the flags that were passed in to traverse_threads() */
-				);
-				
-				if( ret == TRAVERSE_CALLBACK_SKIP ) /* do not process spi's remaining threads */
-				{
-					dbg_printf( 
-						"<<<Callback function returned: skip process' remaining threads.\n" 
-					);
-					
-					break;
-				}
-				else if( ret != TRAVERSE_CALLBACK_CONTINUE ) /* some other problem. quit */
-				{
-					dbg_printf( 
-						"<<<Callback function returned: abort immediately. ret: %d\n",
-						ret 
-					);
-					
-					error_code = TRAVERSE_ERROR_CALLBACK;
-					goto quit;
-				}
-				
-				dbg_printf( "<<<Callback returned normally.\n\n" );
-				
-				
-				if( !remaining ) /* no more threads in this spi */
-					break;
-				
-				--remaining;
-				sti = (SYSTEM_THREAD_INFORMATION *)( (size_t)sti + sti_bcount );
-			}
-		}
+		error_code = dispatch_threads( callback, cb_param, spi, threads_ecount, sti_bcount, flags );
+		if( error_code != TRAVERSE_SUCCESS )
+			goto quit;
 		
+next_spi:
 		/* break if there are no more spi structs to process */
 		if( !spi->NextEntryOffset || spi_end == buffer_end )
 			break;
@@ -842,6 +1076,9 @@ int traverse_threads(
 quit:
 	dbg_printf( "============================================\n\n" );
 	
+	free( index );
+	index = NULL;
+	
 	/* if memory isn't null then temporary memory was allocated for buffer
 	( ie no buffer was passed in )
 	*/
@@ -21,7 +21,11 @@ along with GetHooks.  If not, see <http://www.gnu.org/licenses/>.
 #ifndef _TRAVERSE_THREADS_H
 #define _TRAVERSE_THREADS_H
 
+#ifdef _WIN32
 #include <windows.h>
+#else
+#include "portable.h"
+#endif
 
 
 #ifdef __cplusplus
@@ -41,6 +45,10 @@ extern "C" {
 #define TRAVERSE_FLAG_ZERO_THREADS_OK   (1u << 3)
 #define TRAVERSE_FLAG_RECYCLE   (1u << 4)
 #define TRAVERSE_FLAG_TEST_MEMORY   (1u << 5)
+#define TRAVERSE_FLAG_VALIDATE_ONCE   (1u << 6)
+
+
+#define TRAVERSE_FILTER_SESSION   (1u)
 
 
 #define TRAVERSE_SUCCESS   (0)
@@ -56,6 +64,39 @@ extern "C" {
 #define TRAVERSE_ERROR_ACCESS_VIOLATION   (-9)
 
 
+/** traverse_filter 
+The processes to traverse. Any other process is never passed to the callback.
+This struct is documented in traverse_threads.txt
+*/
+struct traverse_filter
+{
+	/* TRAVERSE_FILTER_SESSION to only traverse the processes in session 'session_id' */
+	DWORD flags;
+	ULONG session_id;
+	
+	/* if 'pid_count' is nonzero only traverse the processes whose ids are in 'pid'.
+	the array must be sorted in ascending order.
+	*/
+	const ULONG_PTR *pid;
+	size_t pid_count;
+};
+
+
+/** traverse_index 
+An entry in the index of validated process info written by validate_process_info().
+This struct is documented in traverse_threads.txt
+*/
+struct traverse_index
+{
+	/* a process info (spi) that passed validation */
+	SYSTEM_PROCESS_INFORMATION *spi;
+	
+	/* how many thread info structs in spi's thread info array can be accessed */
+	ULONG threads_ecount;
+};
+
+
+
 /** traverse_threads()
 This function is well documented in traverse_threads.txt 
 */
@@ -74,6 +115,42 @@ int traverse_threads(
 	LONG *status   // out, optional
 );
 
+int traverse_threads_ex( 
+	int ( __cdecl *callback )( 
+		void *cb_param,   // in, out, optional
+		SYSTEM_PROCESS_INFORMATION *const spi,   // in
+		SYSTEM_THREAD_INFORMATION *const sti,   // in, optional
+		const ULONG remaining,   // in
+		const DWORD flags   // in, optional
+	),   // in, optional
+	void *cb_param,   // in, out, optional
+	void *buffer,   // in, out, optional
+	size_t buffer_bcount,   // in, optional
+	const DWORD flags,   // in, optional
+	LONG *status,   // out, optional
+	const struct traverse_filter *filter   // in, optional
+);
+
+int validate_process_info( 
+	void *const buffer,   // in
+	const size_t buffer_bcount,   // in
+	const DWORD flags,   // in, optional
+	struct traverse_index *const index,   // out
+	const size_t index_max,   // in
+	size_t *const index_count   // out
+);
+
+
+
+/** 
+this function is documented in the comment block above its definition in 
+traverse_threads__validate.c
+*/
+
+unsigned __int64 fuzz_process_info( 
+	const unsigned __int64 iterations   // in
+);
+
 
 
 /** 
@@ -0,0 +1,600 @@
+/*
+Copyright (C) 2011 Jay Satiro <raysatiro@yahoo.com>
+All rights reserved.
+
+This file is part of GetHooks.
+
+GetHooks is free software: you can redistribute it and/or modify 
+it under the terms of the GNU General Public License as published by 
+the Free Software Foundation, either version 3 of the License, or 
+(at your option) any later version.
+
+GetHooks is distributed in the hope that it will be useful, 
+but WITHOUT ANY WARRANTY; without even the implied warranty of 
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License 
+along with GetHooks.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/** 
+This file contains validate_process_info() and a driver to fuzz and benchmark it.
+validate_process_info() is documented in traverse_threads.txt. The other functions are documented 
+in the comment block above their definitions.
+
+The functions in this file don't call any Windows API functions or depend on the rest of 
+traverse_threads, so that validate_process_info() can be built, fuzzed and benchmarked on its own, 
+including on other systems (see portable.h in gethooks).
+
+-
+next_fuzz_random()
+
+Get the next number from a xorshift pseudorandom number generator.
+-
+
+-
+build_process_info()
+
+Write a valid array of process info structs (spi) for the fuzz test.
+-
+
+-
+check_process_index()
+
+Check that an index written by validate_process_info() only refers to memory in the buffer.
+-
+
+-
+fuzz_process_info()
+
+Benchmark validate_process_info() and fuzz it with mutated process info buffers.
+-
+
+*/
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "nt_independent_sysprocinfo_structs.h"
+#include "traverse_threads.h"
+
+
+
+/* the printf length modifier of a size_t */
+#ifdef _WIN32
+#define TRAVERSE_SIZE_T   "I"
+#else
+#define TRAVERSE_SIZE_T   "z"
+#endif
+
+/* the number of spi structs in the buffer that's benchmarked and mutated */
+#define FUZZ_PROCESS_COUNT   64
+
+/* the default number of mutated buffers */
+#define FUZZ_ITERATIONS   100000
+
+/* the number of times the valid buffer is validated to benchmark it */
+#define FUZZ_BENCH_RUNS   1000
+
+
+
+static unsigned next_fuzz_random( 
+	unsigned *const state   // in, out
+);
+
+static size_t build_process_info( 
+	void *const buffer   // out, optional
+);
+
+static int check_process_index( 
+	const void *const buffer,   // in
+	const size_t buffer_bcount,   // in
+	const DWORD flags,   // in
+	const struct traverse_index *const index,   // in
+	const size_t index_count   // in
+);
+
+
+
+/** validate_process_info() 
+This function is well documented in traverse_threads.txt
+*/
+int validate_process_info( 
+	void *const buffer,   // in
+	const size_t buffer_bcount,   // in
+	const DWORD flags,   // in, optional
+	struct traverse_index *const index,   // out
+	const size_t index_max,   // in
+	size_t *const index_count   // out
+)
+{
+	/* the size in bytes of SYSTEM_THREAD_INFORMATION, or if TRAVERSE_FLAG_EXTENDED 
+	then SYSTEM_EXTENDED_THREAD_INFORMATION */
+	const size_t sti_bcount = ( ( flags & TRAVERSE_FLAG_EXTENDED ) 
+		? sizeof( SYSTEM_EXTENDED_THREAD_INFORMATION ) 
+		: sizeof( SYSTEM_THREAD_INFORMATION )
+	);
+	
+	/* the endpoint address of the array of SYSTEM_PROCESS_INFORMATION structs */
+	const size_t buffer_end = (size_t)buffer + buffer_bcount;
+	
+	/* a pointer to the current spi struct */
+	SYSTEM_PROCESS_INFORMATION *spi = (SYSTEM_PROCESS_INFORMATION *)buffer;
+	
+	
+	if( !index_count )
+		return TRAVERSE_ERROR_PARAMETER;
+	
+	*index_count = 0;
+	
+	if( !buffer || !index || !index_max || ( buffer_end < (size_t)buffer ) )
+		return TRAVERSE_ERROR_PARAMETER;
+	
+	for( ;; )
+	{
+		/* the endpoint addresses of the current spi and of its thread info array */
+		size_t spi_end = 0;
+		size_t threads_end = 0;
+		
+		/* how many bytes are needed to hold the reported thread info array */
+		unsigned __int64 threads_bcount = 0;
+		
+		
+		/* the spi must be aligned and its members up to the thread info array must be in the 
+		buffer, otherwise it's definitely garbage data.
+		*/
+		if( ( (size_t)spi & ( sizeof( ULONG_PTR ) - 1 ) ) 
+			|| ( (size_t)&spi->Threads < (size_t)spi ) 
+			|| ( (size_t)&spi->Threads > buffer_end )
+		)
+		{
+			if( ( flags & TRAVERSE_FLAG_DEBUG ) )
+				printf( "Error: Definite garbage data at spi %" TRAVERSE_SIZE_T "u, quitting...\n", (size_t)spi );
+			
+			return TRAVERSE_ERROR_CALCULATION;
+		}
+		
+		spi_end = ( spi->NextEntryOffset ? ( (size_t)spi + spi->NextEntryOffset ) : buffer_end );
+		
+		if( spi_end < (size_t)&spi->Threads )
+		{
+			if( ( flags & TRAVERSE_FLAG_DEBUG ) )
+				printf( "Error: Definite garbage data at spi %" TRAVERSE_SIZE_T "u, quitting...\n", (size_t)spi );
+			
+			return TRAVERSE_ERROR_CALCULATION;
+		}
+		
+		/* check if fewer accessible threads than reported. unless IGNORE_CALCULATION_ERRORS 
+		that's an error, otherwise recover by adjusting the endpoints so they aren't out-of-bounds.
+		*/
+		threads_bcount = (unsigned __int64)(ULONG)spi->NumberOfThreads * sti_bcount;
+		
+		if( ( spi_end > buffer_end ) 
+			|| ( threads_bcount > (unsigned __int64)( spi_end - (size_t)&spi->Threads ) )
+		)
+		{
+			if( ( flags & TRAVERSE_FLAG_DEBUG ) )
+			{
+				printf( "Error: process info may contain fewer thread structs than reported.\n" );
+				printf( "spi: %" TRAVERSE_SIZE_T "u, spi_end: %" TRAVERSE_SIZE_T "u, buffer_end: %" TRAVERSE_SIZE_T "u, NumberOfThreads: %lu\n", 
+					(size_t)spi, 
+					spi_end, 
+					buffer_end, 
+					spi->NumberOfThreads
+				);
+			}
+			
+			if( !( flags & TRAVERSE_FLAG_IGNORE_CALCULATION_ERRORS ) )
+				return TRAVERSE_ERROR_CALCULATION;
+			
+			if( spi_end > buffer_end )
+				spi_end = buffer_end;
+			
+			if( threads_bcount > (unsigned __int64)( spi_end - (size_t)&spi->Threads ) )
+				threads_bcount = (unsigned __int64)( spi_end - (size_t)&spi->Threads );
+		}
+		
+		threads_end = (size_t)&spi->Threads + (size_t)threads_bcount;
+		
+		/* ImageName.Buffer must point to memory in the current spi after its thread info array */
+		if( spi->ImageName.Buffer 
+			&& spi->ImageName.Length 
+			&& ( ( (size_t)spi->ImageName.Buffer < threads_end ) 
+				|| ( (size_t)spi->ImageName.Buffer > spi_end ) 
+				|| ( spi->ImageName.Length > ( spi_end - (size_t)spi->ImageName.Buffer ) )
+			)
+		)
+		{
+			if( ( flags & TRAVERSE_FLAG_DEBUG ) )
+			{
+				printf( "Warning: ImageName.Buffer is out of process info memory range!\n" );
+				printf( "spi: %" TRAVERSE_SIZE_T "u, ImageName.Buffer: %" TRAVERSE_SIZE_T "u, ImageName.Length: %hu\n", 
+					(size_t)spi, 
+					(size_t)spi->ImageName.Buffer, 
+					spi->ImageName.Length
+				);
+			}
+			
+			if( !( flags & TRAVERSE_FLAG_IGNORE_CALCULATION_ERRORS ) )
+				return TRAVERSE_ERROR_CALCULATION;
+		}
+		
+		/* record the validated spi */
+		if( *index_count >= index_max )
+			return TRAVERSE_ERROR_BUFFER_TOO_SMALL;
+		
+		index[ *index_count ].spi = spi;
+		index[ *index_count ].threads_ecount = (ULONG)( threads_bcount / sti_bcount );
+		++*index_count;
+		
+		/* break if there are no more spi structs to process */
+		if( !spi->NextEntryOffset || ( spi_end == buffer_end ) )
+			break;
+		
+		spi = (SYSTEM_PROCESS_INFORMATION *)spi_end;
+	}
+	
+	return TRAVERSE_SUCCESS;
+}
+
+
+
+/* next_fuzz_random() 
+Get the next number from a xorshift pseudorandom number generator.
+
+'state' is the generator's state. it must not be 0.
+
+returns a pseudorandom number
+*/
+static unsigned next_fuzz_random( 
+	unsigned *const state   // in, out
+)
+{
+	unsigned x = *state;
+	
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	
+	*state = x;
+	return x;
+}
+
+
+
+/* build_process_info() 
+Write a valid array of process info structs (spi) for the fuzz test.
+
+There are FUZZ_PROCESS_COUNT spi structs, each with 0 to 4 thread info structs and an image name 
+after its thread info array, like the array output by NtQuerySystemInformation().
+
+'buffer' receives the array. It must be aligned for a pointer and big enough, or NULL to get the 
+size of the array.
+
+returns the size of the array in bytes
+*/
+static size_t build_process_info( 
+	void *const buffer   // out, optional
+)
+{
+	size_t offset = 0;
+	unsigned i = 0;
+	
+	
+	for( i = 0; i < FUZZ_PROCESS_COUNT; ++i )
+	{
+		const ULONG threads = i % 5;
+		const USHORT name_bcount = (USHORT)( ( 8 + ( i % 7 ) ) * sizeof( WCHAR ) );
+		const size_t name_offset = 
+			offsetof( SYSTEM_PROCESS_INFORMATION, Threads ) + ( threads * sizeof( SYSTEM_THREAD_INFORMATION ) );
+		
+		/* the next spi is aligned for a pointer */
+		const size_t spi_bcount = 
+			( name_offset + name_bcount + sizeof( ULONG_PTR ) - 1 ) & ~( sizeof( ULONG_PTR ) - 1 );
+		
+		
+		if( buffer )
+		{
+			SYSTEM_PROCESS_INFORMATION *const spi = 
+				(SYSTEM_PROCESS_INFORMATION *)( (char *)buffer + offset );
+			unsigned c = 0;
+			
+			
+			memset( spi, 0, spi_bcount );
+			
+			spi->NextEntryOffset = ( ( i + 1 ) < FUZZ_PROCESS_COUNT ) ? (ULONG)spi_bcount : 0;
+			spi->NumberOfThreads = threads;
+			spi->UniqueProcessId = (HANDLE)(ULONG_PTR)( ( i + 1 ) * 4 );
+			spi->ImageName.Length = name_bcount;
+			spi->ImageName.MaximumLength = name_bcount;
+			spi->ImageName.Buffer = (PWSTR)( (char *)spi + name_offset );
+			
+			for( c = 0; c < ( name_bcount / sizeof( WCHAR ) ); ++c )
+				spi->ImageName.Buffer[ c ] = (WCHAR)( 'a' + ( ( i + c ) % 26 ) );
+		}
+		
+		offset += spi_bcount;
+	}
+	
+	return offset;
+}
+
+
+
+/* check_process_index() 
+Check that an index written by validate_process_info() only refers to memory in the buffer.
+
+Each spi in the index must be aligned and in the buffer, after the previous one, and its accessible 
+thread info structs must be in the buffer as well.
+
+returns nonzero if the index is consistent with the buffer
+*/
+static int check_process_index( 
+	const void *const buffer,   // in
+	const size_t buffer_bcount,   // in
+	const DWORD flags,   // in
+	const struct traverse_index *const index,   // in
+	const size_t index_count   // in
+)
+{
+	const size_t sti_bcount = ( ( flags & TRAVERSE_FLAG_EXTENDED ) 
+		? sizeof( SYSTEM_EXTENDED_THREAD_INFORMATION ) 
+		: sizeof( SYSTEM_THREAD_INFORMATION )
+	);
+	const size_t buffer_end = (size_t)buffer + buffer_bcount;
+	size_t previous = 0;
+	size_t i = 0;
+	
+	
+	if( !index_count 
+		|| ( index_count > ( ( buffer_bcount / offsetof( SYSTEM_PROCESS_INFORMATION, Threads ) ) + 1 ) )
+	)
+		return FALSE;
+	
+	for( i = 0; i < index_count; ++i )
+	{
+		const size_t spi = (size_t)index[ i ].spi;
+		const size_t threads = spi + offsetof( SYSTEM_PROCESS_INFORMATION, Threads );
+		
+		
+		if( ( spi & ( sizeof( ULONG_PTR ) - 1 ) ) 
+			|| ( spi < (size_t)buffer ) 
+			|| ( i && ( spi <= previous ) ) 
+			|| ( threads > buffer_end ) 
+			|| ( index[ i ].threads_ecount > ( ( buffer_end - threads ) / sti_bcount ) )
+		)
+			return FALSE;
+		
+		previous = spi;
+	}
+	
+	return TRUE;
+}
+
+
+
+/* fuzz_process_info() 
+Benchmark validate_process_info() and fuzz it with mutated process info buffers.
+
+A valid array of process info structs is validated FUZZ_BENCH_RUNS times to measure how long a 
+validation takes on average. Then 'iterations' copies of it are mutated and validated: bytes and the members 
+that the checks depend on are overwritten with pseudorandom values and the buffer may be truncated.
+Each buffer is allocated with its exact size so that a memory checker can catch a read past its end.
+The flags alternate between none, TRAVERSE_FLAG_IGNORE_CALCULATION_ERRORS and 
+TRAVERSE_FLAG_EXTENDED, and the pseudorandom numbers are the same every time.
+
+'iterations' is the number of mutated buffers. If it's 0 or UI64_MAX then it's FUZZ_ITERATIONS.
+
+returns nonzero if the valid array passed and each mutated array either passed with an index that 
+only refers to memory in the buffer, or was rejected with TRAVERSE_ERROR_CALCULATION
+*/
+unsigned __int64 fuzz_process_info( 
+	const unsigned __int64 iterations   // in
+)
+{
+	const size_t valid_bcount = build_process_info( NULL );
+	const size_t index_max = ( valid_bcount / offsetof( SYSTEM_PROCESS_INFORMATION, Threads ) ) + 1;
+	unsigned count = 0, i = 0, state = 0x9E3779B9;
+	unsigned passed = 0, rejected = 0, failed = 0;
+	size_t index_count = 0;
+	void *buffer = NULL;
+	struct traverse_index *index = NULL;
+	clock_t begin = 0, elapsed = 0;
+	double ns = 0;
+	int ret = 0;
+	
+	
+	if( !iterations || ( iterations == (unsigned __int64)-1 ) )
+		count = FUZZ_ITERATIONS;
+	else if( iterations > 0xFFFFFFFF )
+		count = 0xFFFFFFFF;
+	else
+		count = (unsigned)iterations;
+	
+	buffer = malloc( valid_bcount );
+	index = calloc( index_max, sizeof( *index ) );
+	
+	if( !buffer || !index )
+	{
+		printf( "Failed to allocate the process info buffer and its index.\n" );
+		free( buffer );
+		free( index );
+		return FALSE;
+	}
+	
+	printf( "\nProcess info validation benchmark and fuzz test.\n" );
+	printf( "The valid buffer is %u process info structs in %u bytes.\n", 
+		FUZZ_PROCESS_COUNT, 
+		(unsigned)valid_bcount
+	);
+	
+	/* benchmark the valid buffer */
+	build_process_info( buffer );
+	
+	begin = clock();
+	
+	for( i = 0; i < FUZZ_BENCH_RUNS; ++i )
+	{
+		ret = validate_process_info( buffer, valid_bcount, 0, index, index_max, &index_count );
+		
+		if( ( ret != TRAVERSE_SUCCESS ) || ( index_count != FUZZ_PROCESS_COUNT ) 
+			|| !check_process_index( buffer, valid_bcount, 0, index, index_count )
+		)
+		{
+			printf( "The valid buffer failed validation. validate_process_info() returned %d.\n", ret );
+			free( buffer );
+			free( index );
+			return FALSE;
+		}
+	}
+	
+	elapsed = clock() - begin;
+	ns = (double)elapsed * 1000000000.0 / CLOCKS_PER_SEC / FUZZ_BENCH_RUNS;
+	
+	printf( "Validated in %.1f ns, %.2f ns per process info (average of %u runs).\n", 
+		ns, 
+		ns / FUZZ_PROCESS_COUNT, 
+		FUZZ_BENCH_RUNS
+	);
+	
+	free( buffer );
+	buffer = NULL;
+	
+	/* fuzz */
+	for( i = 0; i < count; ++i )
+	{
+		const DWORD flags = ( ( i % 3 ) == 1 ) ? TRAVERSE_FLAG_IGNORE_CALCULATION_ERRORS 
+			: ( ( i % 3 ) == 2 ) ? TRAVERSE_FLAG_EXTENDED 
+			: 0;
+		size_t bcount = valid_bcount;
+		SYSTEM_PROCESS_INFORMATION *spi = NULL;
+		unsigned mutations = 0, m = 0;
+		
+		
+		/* one in eight buffers is truncated */
+		if( !( next_fuzz_random( &state ) % 8 ) )
+			bcount = offsetof( SYSTEM_PROCESS_INFORMATION, Threads ) 
+				+ ( next_fuzz_random( &state ) % ( valid_bcount - offsetof( SYSTEM_PROCESS_INFORMATION, Threads ) ) );
+		
+		buffer = malloc( valid_bcount );
+		if( !buffer )
+		{
+			printf( "Failed to allocate a process info buffer.\n" );
+			free( index );
+			return FALSE;
+		}
+		
+		build_process_info( buffer );
+		
+		/* the buffer is copied to its exact size so that a read past the end can be caught */
+		if( bcount != valid_bcount )
+		{
+			void *const truncated = malloc( bcount );
+			
+			
+			if( !truncated )
+			{
+				printf( "Failed to allocate a process info buffer.\n" );
+				free( buffer );
+				free( index );
+				return FALSE;
+			}
+			
+			memcpy( truncated, buffer, bcount );
+			free( buffer );
+			buffer = truncated;
+		}
+		
+		mutations = 1 + ( next_fuzz_random( &state ) % 4 );
+		
+		for( m = 0; m < mutations; ++m )
+		{
+			const unsigned r = next_fuzz_random( &state );
+			
+			
+			/* an aligned spi that's completely in the buffer */
+			spi = (SYSTEM_PROCESS_INFORMATION *)buffer;
+			while( ( r & 1 ) && spi->NextEntryOffset 
+				&& !( spi->NextEntryOffset & ( sizeof( ULONG_PTR ) - 1 ) ) 
+				&& ( ( (size_t)spi + spi->NextEntryOffset + sizeof( *spi ) ) <= ( (size_t)buffer + bcount ) ) 
+				&& ( ( next_fuzz_random( &state ) % 8 ) != 0 )
+			)
+				spi = (SYSTEM_PROCESS_INFORMATION *)( (size_t)spi + spi->NextEntryOffset );
+			
+			if( ( (size_t)spi + sizeof( *spi ) ) > ( (size_t)buffer + bcount ) )
+				spi = NULL;
+			
+			switch( ( r >> 1 ) % 6 )
+			{
+				case 0:
+					( (unsigned char *)buffer )[ next_fuzz_random( &state ) % bcount ] = 
+						(unsigned char)next_fuzz_random( &state );
+					break;
+				case 1:
+					if( spi )
+						spi->NextEntryOffset = next_fuzz_random( &state ) % ( (unsigned)valid_bcount * 2 );
+					break;
+				case 2:
+					if( spi )
+						spi->NextEntryOffset = next_fuzz_random( &state );
+					break;
+				case 3:
+					if( spi )
+						spi->NumberOfThreads = ( r & 0x100 ) ? next_fuzz_random( &state ) 
+							: ( next_fuzz_random( &state ) % 16 );
+					break;
+				case 4:
+					if( spi )
+						spi->ImageName.Length = (USHORT)next_fuzz_random( &state );
+					break;
+				case 5:
+					if( spi )
+						spi->ImageName.Buffer = 
+							(PWSTR)( (size_t)buffer + ( next_fuzz_random( &state ) % ( bcount * 2 ) ) );
+					break;
+			}
+		}
+		
+		ret = validate_process_info( buffer, bcount, flags, index, index_max, &index_count );
+		
+		if( ( ret == TRAVERSE_SUCCESS ) && check_process_index( buffer, bcount, flags, index, index_count ) )
+			++passed;
+		else if( ret == TRAVERSE_ERROR_CALCULATION )
+			++rejected;
+		else
+		{
+			if( !failed )
+			{
+				printf( "Mutated buffer %u (%u bytes, flags 0x%lX) failed. "
+					"validate_process_info() returned %d%s.\n", 
+					i, 
+					(unsigned)bcount, 
+					(unsigned long)flags, 
+					ret, 
+					( ( ret == TRAVERSE_SUCCESS ) ? " with an index that refers outside the buffer" : "" )
+				);
+			}
+			
+			++failed;
+		}
+		
+		free( buffer );
+		buffer = NULL;
+	}
+	
+	printf( "Fuzzed %u buffers: %u passed, %u rejected as garbage, %u failed.\n", 
+		count, 
+		passed, 
+		rejected, 
+		failed
+	);
+	
+	free( index );
+	
+	printf( "\nThe fuzz test %s.\n", ( failed ? "failed" : "passed" ) );
+	return !failed;
+}
@@ -56,6 +56,26 @@ Print the program's usage and exit(1).
 
 #include "usage.h"
 
+#include "export.h"
+
+#include "latency.h"
+
+#include "fastpoll.h"
+
+#include "hookscan.h"
+
+#include "prefetch.h"
+
+#include "occupancy.h"
+
+#include "churn.h"
+
+#include "governor.h"
+
+#include "checkpoint.h"
+
+#include "stream.h"
+
 /* the global stores */
 #include "global.h"
 
@@ -141,6 +161,12 @@ void print_more_options_and_exit( void )
 		"These options are compatible with all other options unless stated otherwise.\n"
 		"\n"
 		"[-t <num>]  [-f]  [-e]  [-u]  [-g]  [-z <func> [param]]\n"
+		"[--record <file>]  [--inspect <file> [time]]  [--diff <file> [time] <file> [time]]\n"
+		"[--aggregate <file|@listfile> [...]]  [--columns <file>]  [--ancestry]\n"
+		"[--latency <ms>]  [--cost]  [--fastpoll <ratio>]  [--hookscan <ms>]\n"
+		"[--prefetch <ms>]  [--session <id>]  [--config <file>]  [--chains]\n"
+		"[--occupancy <min>]  [--churn <ms> [file]]  [--checkpoint <file>]\n"
+		"[--stream [ordered]]  [--rules <file>]  [--rollup]  [--budget <percent>]\n"
 	);
 	
 	
@@ -281,6 +307,328 @@ void print_more_options_and_exit( void )
 	);
 	
 	
+	printf( "\n\n"
+		"   --record     write each snapshot to a snapshot file\n"
+		"\n"
+		"Each snapshot's hooks and the threads associated with them are written to the \n"
+		"file as a record. In monitor mode a record is written for every snapshot, so \n"
+		"the file is a recording of the hooks over time. If the file exists it is \n"
+		"overwritten. The file can be inspected or compared later with the offline \n"
+		"options below, on this computer or another one.\n"
+	);
+	
+	
+	printf( "\n\n"
+		"   --columns    write each hook event to a columnar export file\n"
+		"\n"
+		"Each hook that is printed as found, added, modified or removed is also written \n"
+		"to the file as a row: time, event, hook id, flags, handle, owner/origin/target \n"
+		"PIDs and TIDs, origin and target image names and desktop. The rows are written \n"
+		"in row groups with one compressed column for each of those, so they can be \n"
+		"loaded by analytics tools without parsing text. In monitor mode a row group is \n"
+		"written at most every %d seconds. If the file exists it is overwritten. Use \n"
+		"--inspect <file> to print the rows.\n", 
+		EXPORT_FLUSH_SECONDS
+	);
+	
+	
+	printf( "\n\n"
+		"   --ancestry    show the ancestry of the process each hook originated from\n"
+		"\n"
+		"For each hook that is printed the origin process and its parent processes are \n"
+		"shown, eg: Origin ancestry: a.exe (PID 12) <- explorer.exe (PID 8) [exited] \n"
+		"A process is identified by its PID and creation time, so a parent whose PID \n"
+		"was reused by another process is not mistaken for the original. Parents that \n"
+		"have exited are still shown if they were seen in an earlier snapshot. This \n"
+		"option has no effect in completely passive mode (option 'y').\n"
+	);
+	
+	
+	printf( "\n\n"
+		"   --latency    rank low-level and global hooks by input latency impact\n"
+		"\n"
+		"The procedure of a low-level hook runs in the thread that set it, and input is \n"
+		"delayed until it returns. In monitor mode this option samples the state of the \n"
+		"origin thread of each low-level and global hook every <ms> milliseconds (%u to \n"
+		"%u) between snapshots. After each snapshot the hooks are ranked by estimated \n"
+		"input delay: the longest time the thread was not waiting for input. A thread \n"
+		"that was not waiting for input in at least half of the samples is flagged \n"
+		"[busy], and a hook that was marked hung by the system is flagged [hung]. \n"
+		"This option requires option 'm' and is incompatible with option 'y'.\n", 
+		LATENCY_INTERVAL_MIN, 
+		LATENCY_INTERVAL_MAX
+	);
+	
+	
+	printf( "\n\n"
+		"   --cost    rank hook owners by the CPU time their hook threads use\n"
+		"\n"
+		"In monitor mode this option compares the CPU time and context switches of the \n"
+		"owner and origin threads of each hook to the previous snapshot. A thread is \n"
+		"matched by its TID and creation time. After each snapshot the processes and \n"
+		"hooks whose threads used the most CPU time since they were first found are \n"
+		"printed, with the CPU time used since the previous snapshot. This uses only \n"
+		"the thread info already in each snapshot. This option requires option 'm' \n"
+		"and is incompatible with option 'y'.\n"
+	);
+	
+	
+	printf( "\n\n"
+		"   --fastpoll    re-poll only the hook threads between snapshots\n"
+		"\n"
+		"In monitor mode this option keeps a handle open to the owner and origin \n"
+		"threads of each hook and queries only those threads <ratio> times (%u to %u) \n"
+		"between snapshots, instead of waiting. Each re-poll is one query per thread, a \n"
+		"tiny fraction of the cost of a snapshot. After each snapshot the threads are \n"
+		"ranked by the CPU time and cycles they used, with the percentage of re-polls \n"
+		"in which they had used CPU. This option requires option 'm' and is \n"
+		"incompatible with option 'y' and '--latency'.\n", 
+		FASTPOLL_RATIO_MIN, 
+		FASTPOLL_RATIO_MAX
+	);
+	
+	
+	printf( "\n\n"
+		"   --hookscan    report hooks added and removed between snapshots\n"
+		"\n"
+		"In monitor mode this option reads only the handle table and the HOOK objects \n"
+		"every <ms> milliseconds (%u to %u) between snapshots, instead of waiting. The \n"
+		"hooks added and removed are reported immediately, with the kernel addresses of \n"
+		"their threads. After the next snapshot the threads are identified and each of \n"
+		"those hooks is reported again as [Attributed]. A hook that is added and removed \n"
+		"between snapshots is reported too. If 'u' or a program list is specified then \n"
+		"an added hook isn't reported until its threads are identified. This option \n"
+		"requires option 'm' and is incompatible with option 'y', '--latency' and \n"
+		"'--fastpoll'.\n", 
+		HOOKSCAN_INTERVAL_MIN, 
+		HOOKSCAN_INTERVAL_MAX
+	);
+	
+	
+	printf( "\n\n"
+		"   --prefetch    query the system process info ahead of each snapshot\n"
+		"\n"
+		"In monitor mode this option queries the system process info on a background \n"
+		"thread shortly before each snapshot is due, so the snapshot doesn't wait for \n"
+		"the query. The query is started as far ahead as the previous query took. The \n"
+		"prefetched info is only used if it's no older than <ms> milliseconds (%u to \n"
+		"%u), otherwise the snapshot queries the info itself. This option requires \n"
+		"option 'm' and is incompatible with option 'y'.\n", 
+		PREFETCH_AGE_MIN, 
+		PREFETCH_AGE_MAX
+	);
+	
+	
+	printf( "\n\n"
+		"   --session    only traverse the processes in one session\n"
+		"\n"
+		"By default every process in the system is traversed to find the threads \n"
+		"associated with each hook. This option skips the processes that aren't in \n"
+		"session <id>, and they're never opened. A hook whose threads are in another \n"
+		"session is still reported but its threads are unknown. The input latency \n"
+		"samples ('--latency') query only the processes in the session. This option is \n"
+		"incompatible with option 'y'.\n"
+	);
+	
+	
+	printf( "\n\n"
+		"   --config    read options from a file and reload it when it changes\n"
+		"\n"
+		"The file has one option per line, written the same as on the command line, \n"
+		"and a comment begins with '#'. Only these options can be in the file: \n"
+		"m <sec>, v [level], i|x <hook> [...], p|r <prog> [...], e, u, g, f, c \n"
+		"A hook or program list in the file replaces the one on the command line, and \n"
+		"the other options are added to those on the command line. Option 'm' can only \n"
+		"change the interval, so monitor mode must be on the command line. In monitor \n"
+		"mode the file is checked before each wait for the next snapshot. If it changed \n"
+		"and is valid the new configuration is used from then on, otherwise the \n"
+		"configuration is unchanged. The desktops and everything tracked between \n"
+		"snapshots are kept. This option is incompatible with the offline options.\n"
+	);
+	
+	
+	printf( "\n\n"
+		"   --chains    check the integrity of the HOOK chains in each snapshot\n"
+		"\n"
+		"In monitor mode this option follows the chain of each HOOK and the global hook \n"
+		"chains that start on each desktop. Every live global hook should be reached \n"
+		"exactly once from its desktop. A HOOK that isn't reached is [orphaned], one \n"
+		"that's reached more than once or by more than one HOOK is [doubly-linked], one \n"
+		"whose chain loops back is [cyclic], one that points to a HOOK that doesn't \n"
+		"exist is [dangling], and one reached from the wrong chain is [misplaced]. A \n"
+		"HOOK can be in the middle of being added or removed when a snapshot is taken, \n"
+		"so an anomaly is only reported if it's found in two consecutive snapshots. The \n"
+		"include and exclude options apply. This option requires option 'm'.\n"
+	);
+	
+	
+	printf( "\n\n"
+		"   --occupancy    estimate how full each desktop heap is\n"
+		"\n"
+		"This option counts every USER object in the handle table by the desktop heap \n"
+		"it's in, by its type and by its owner, in the same pass that finds the hooks. \n"
+		"The heap is allocated from the bottom up, so the highest object in a heap is \n"
+		"an estimate of how much of it is in use. The occupancy of each desktop is \n"
+		"printed after the first snapshot, and after every snapshot if 'v' is \n"
+		"specified. In monitor mode the growth of each desktop's object count is \n"
+		"tracked, and a desktop is alerted with the owners of the most objects when at \n"
+		"that growth its heap is projected to be exhausted within <min> minutes (%u to \n"
+		"%u), or when its highest object is at %u%% of the heap.\n", 
+		OCCUPANCY_HORIZON_MIN, 
+		OCCUPANCY_HORIZON_MAX, 
+		OCCUPANCY_FULL_PERCENT
+	);
+	
+	
+	printf( "\n\n"
+		"   --churn    sample the USER handle counts every few milliseconds\n"
+		"\n"
+		"In monitor mode this option counts the handle entries of each type in the USER \n"
+		"handle table every <ms> milliseconds (%u to %u) on a background thread. The \n"
+		"interval can't be shorter than the resolution of the system timer. After each \n"
+		"snapshot the count, changes per second, net change per second and largest \n"
+		"change between samples of each type are printed, with the percentiles of the \n"
+		"changes of all types between samples. If the sampling uses more than %u%% of a \n"
+		"core the interval is lengthened until it doesn't. If [file] is specified then \n"
+		"every sample is written to it as a row of comma separated values: the time in \n"
+		"microseconds since sampling began and the count of each type. This option \n"
+		"requires option 'm'.\n", 
+		CHURN_INTERVAL_MIN, 
+		CHURN_INTERVAL_MAX, 
+		CHURN_OVERHEAD_PERCENT
+	);
+	
+	
+	printf( "\n\n"
+		"   --checkpoint    keep the warm state in a file that's reused on restart\n"
+		"\n"
+		"This option caches the TEB address, Win32ThreadInfo and desktop of each \n"
+		"thread, so that a process is only opened and a TEB only read for a thread \n"
+		"that's new or whose cached info is due to be verified, every %u snapshots. \n"
+		"The first time each HOOK was found is kept and printed with the HOOK. The \n"
+		"cache is written to <file> every %u seconds in monitor mode, when the program \n"
+		"is terminated from the console (eg CTRL+C) and after a single snapshot. When \n"
+		"the program starts it reads <file> and reuses the entries of the threads and \n"
+		"HOOKs that still exist, so that its first snapshot takes about as long as any \n"
+		"other. A thread is only matched if its id, its process id and both of their \n"
+		"creation times are the same.\n", 
+		CHECKPOINT_VERIFY_SNAPSHOTS, 
+		CHECKPOINT_SAVE_SECONDS
+	);
+	
+	
+	printf( "\n\n"
+		"   --stream    print the initial hooks as soon as they're resolved\n"
+		"\n"
+		"This option captures the hooks before the first snapshot, which takes only a \n"
+		"fraction of the time, and prints each desktop's hooks during the snapshot as \n"
+		"soon as all the threads they refer to have been found. If [ordered] is \n"
+		"specified then the desktops are printed in the same order as they would be \n"
+		"without this option, each as soon as it and the desktops before it are ready. \n"
+		"The hooks that were added, removed or modified between the capture and the \n"
+		"snapshot are printed after it. The ancestry of a streamed hook's origin may \n"
+		"be incomplete. The time from when the program started to when the first hook \n"
+		"was printed is printed after the initial hooks, and without this option if \n"
+		"'v' is specified.\n"
+	);
+	
+	
+	printf( "\n\n"
+		"   --rules    match the hook events against the rules in a file\n"
+		"\n"
+		"Each line of <file> is a rule, a comment that begins with '#' or empty. A rule \n"
+		"is a name, a colon and an expression of comparisons joined by 'and', 'or', \n"
+		"'not' and parentheses. A comparison is a field, one of = != < <= > >= has ~ \n"
+		"(contains) and a value, which is put in double quotes if it has spaces. The \n"
+		"fields are event (found, added, modified, removed, attributed), id (eg \n"
+		"WH_KEYBOARD_LL), flags (eg HF_GLOBAL), owner.image, owner.pid, origin.image, \n"
+		"origin.pid, target.image, target.pid, desktop, lifetime (milliseconds since \n"
+		"the HOOK was first found) and anomaly (self, globalonly, globaltarget, \n"
+		"handle, flags, destroyed, unknown). The rules are compiled when the program \n"
+		"starts and the hook events printed in each snapshot are matched against them \n"
+		"after it. Each match is printed, and if 'v' is specified the number of rules \n"
+		"and comparisons evaluated and the matches of each rule are printed as well.\n"
+		"Example:\n"
+		"ll: ( id = WH_KEYBOARD_LL or id = WH_MOUSE_LL ) and origin.image != svchost.exe\n"
+	);
+	
+	
+	printf( "\n\n"
+		"   --rollup    aggregate the hook metrics per minute, hour and day\n"
+		"\n"
+		"The hooks in each snapshot are counted by type and by origin image, as are the \n"
+		"hooks with a thread that isn't known, the hooks added, modified and removed \n"
+		"and the time each snapshot took. The counts are kept for the last day of \n"
+		"minutes, month of hours and year of days in a few MB. When an hour or a day \n"
+		"ends its counts are printed, and if 'v' is specified so is each minute's. \n"
+		"This option requires monitor mode ('m').\n"
+	);
+	
+	
+	printf( "\n\n"
+		"   --budget    keep the monitor within a CPU budget\n"
+		"\n"
+		"The CPU time used by this program is measured over the last %u snapshots and \n"
+		"kept within <percent> percent of a core (%u to %u). The wait between \n"
+		"snapshots is stretched up to %u times so that each snapshot's CPU time is \n"
+		"within the budget. If that isn't enough then the sampling between snapshots \n"
+		"('--latency', '--fastpoll' and '--hookscan') is deferred, and while the \n"
+		"budget is exceeded the priority of the main thread is lowered. Both are \n"
+		"undone once the CPU time is %u%% of the budget or less. Whenever the budget \n"
+		"delays the snapshots or defers the sampling, or stops doing so, it's printed, \n"
+		"and if 'v' is specified it's printed after every snapshot. Failed snapshot \n"
+		"queries are retried with an increasing delay instead of every millisecond. \n"
+		"This option requires monitor mode ('m').\n", 
+		GOVERNOR_WINDOW, 
+		GOVERNOR_BUDGET_MIN, 
+		GOVERNOR_BUDGET_MAX, 
+		GOVERNOR_STRETCH_MAX, 
+		GOVERNOR_RESUME_PERCENT
+	);
+	
+	
+	printf( "\n\n"
+		"   --inspect    list the records in a snapshot file (offline)\n"
+		"   --diff       compare two records in snapshot files (offline)\n"
+		"\n"
+		"These options read snapshot files instead of taking snapshots of the system, \n"
+		"and they are not compatible with options 'm', 'z' or '--record'. A record is \n"
+		"specified by a time in FILETIME format, in which case the record that was \n"
+		"taken last at or before that time is used, or by #n where n is the record's \n"
+		"index in the file. If a time is not specified the last record is used.\n"
+		"\n"
+		"--inspect <file> lists the records in the file. If a time is also specified \n"
+		"the hooks in that record are shown as if that snapshot was just taken. If the \n"
+		"file is a columnar export file its rows are printed instead.\n"
+		"\n"
+		"--diff <file> [time] <file> [time] shows the hooks that were added, removed \n"
+		"or modified between the record in the first file and the record in the \n"
+		"second file. To compare two records in the same recording use \n"
+		"--diff <file> <time> <time>. The include and exclude options apply to the \n"
+		"hooks in the records. For example, to compare the first and last records of \n"
+		"a recording and show only WH_KEYBOARD_LL hooks:\n"
+		"\n"
+		"          %s --diff rec.ghs #0 rec.ghs -i WH_KEYBOARD_LL\n", 
+		G->prog->pszBasename
+	);
+	
+	
+	printf( "\n\n"
+		"   --aggregate  count the hooks in many snapshot files (offline)\n"
+		"\n"
+		"The last record of each file is read, typically one file from each endpoint \n"
+		"in a fleet. Hooks are counted by identity: hook id, flags, module index and \n"
+		"the image name of the origin thread. The report has the number of endpoints \n"
+		"each hook was found on, the rare hooks and the number of endpoints that have \n"
+		"hooks from each origin image. A file name that begins with @ is a text file \n"
+		"with a snapshot file name on each line. The files are read in parallel. The \n"
+		"hook include and exclude options apply. For example:\n"
+		"\n"
+		"          %s --aggregate @endpoints.txt -x WH_MOUSE_LL\n", 
+		G->prog->pszBasename
+	);
+	
+	
 	exit( 1 );
 }
 
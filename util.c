@@ -28,6 +28,12 @@ must_calloc()
 Must calloc() or die.
 -
 
+-
+must_recalloc()
+
+Must grow a calloc()'d array or die.
+-
+
 -
 must_wcsdup()
 
@@ -67,12 +73,12 @@ Print the local time and date. No newline.
 #include <stdio.h>
 #include <limits.h>
 
+#include "util.h"
+
 /* traverse_threads() */
 #include "nt_independent_sysprocinfo_structs.h"
 #include "traverse_threads.h"
 
-#include "util.h"
-
 
 
 /* must_calloc()
@@ -104,6 +110,47 @@ void *must_calloc(
 
 
 
+/* must_recalloc() 
+Must grow a calloc()'d array or die.
+
+'mem' is the array, which has 'old_num' elements of 'size' bytes. it may be NULL if 'old_num' is 0.
+'num' is the number of elements the array is grown to. the elements added are zeroed.
+
+The array may be moved, so pointers to its elements are invalid after this call. Indexes aren't.
+
+returns a pointer to the grown array 
+if allocation fails this function calls exit(1)
+*/
+void *must_recalloc( 
+	void *const mem,   // in
+	const size_t old_num,   // in
+	const size_t num,   // in
+	const size_t size   // in
+)
+{
+	void *grown;
+	
+	FAIL_IF( !num || !size );
+	FAIL_IF( num < old_num );
+	FAIL_IF( !mem && old_num );
+	FAIL_IF( num > ( (size_t)-1 / size ) );
+	
+	
+	grown = realloc( mem, ( num * size ) );
+	if( !grown )
+	{
+		MSG_FATAL( "realloc() failed:" );
+		printf( "realloc(%p, %Iu)\n", mem, ( num * size ) );
+		exit( 1 );
+	}
+	
+	ZeroMemory( (char *)grown + ( old_num * size ), ( ( num - old_num ) * size ) );
+	
+	return grown;
+}
+
+
+
 /* must_wcsdup()
 Must _wcsdup() or die.
 
@@ -182,6 +229,9 @@ int get_wstr_from_mbstr(
 
 
 
+/* User objects are only on Windows. */
+#ifdef _WIN32
+
 /* get_user_obj_name()
 Get the name of a user object.
 
@@ -228,6 +278,8 @@ int get_user_obj_name(
 	return TRUE;
 }
 
+#endif // _WIN32
+
 
 
 /* print_init_time()
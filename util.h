@@ -21,11 +21,20 @@ along with GetHooks.  If not, see <http://www.gnu.org/licenses/>.
 #ifndef _UTIL_H
 #define _UTIL_H
 
+#ifdef _WIN32
 #include <windows.h>
+#else
+#include "portable.h"
+#endif
 #include <limits.h>
 
 #include "str_to_int.h"
 
+/* in the offline build the Microsoft size prefixes in printf formats (eg %I64u) are translated */
+#ifndef _WIN32
+#define printf   portable_printf
+#endif
+
 
 #ifdef __cplusplus
 extern "C" {
@@ -173,6 +182,13 @@ void *must_calloc(
 	const size_t size   // in
 );
 
+void *must_recalloc( 
+	void *const mem,   // in
+	const size_t old_num,   // in
+	const size_t num,   // in
+	const size_t size   // in
+);
+
 WCHAR *must_wcsdup( 
 	const WCHAR *const strSource   // in
 );